@@ -0,0 +1,233 @@
+/*
+ * The harness of executable tests that reads the inputs from a .ktest file
+ * when it runs, so that one binary executes all the tests of a program:
+ *
+ *   clang -c ktest-harness.c -o ktest-harness.o
+ *   clang ktest-harness.o program.c -Dmain=__symbiotic_main -o program.exe
+ *   ./program.exe test000001.ktest [arguments of the program]
+ *
+ * (the harness is compiled separately, -Dmain would rename its main too)
+ *
+ * The __VERIFIER_nondet_* functions return the values of the objects
+ * of the test in the order in which KLEE created them (the objects
+ * named function:variable:line:column and the buffers of -coalesce-nondet,
+ * the same objects as in the test-case XML). A value is truncated or
+ * zero-extended to the type of the function, the missing values are 0.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+extern int __symbiotic_main(int argc, char *argv[], char *envp[]);
+
+struct input {
+	const unsigned char *bytes;
+	uint32_t size;
+};
+
+static struct input *inputs;
+static size_t inputs_num;
+static size_t next_input;
+
+static void fail(const char *path, const char *msg)
+{
+	fprintf(stderr, "[harness] %s: %s\n", path, msg);
+	exit(2);
+}
+
+static uint32_t read_u32(const unsigned char **pos, const unsigned char *end)
+{
+	const unsigned char *p = *pos;
+	if (end - p < 4)
+		return UINT32_MAX;
+	*pos = p + 4;
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static void add_input(const unsigned char *bytes, uint32_t size)
+{
+	if (size == 0)
+		return;
+	inputs = realloc(inputs, (inputs_num + 1) * sizeof *inputs);
+	if (!inputs)
+		abort();
+	inputs[inputs_num].bytes = bytes;
+	inputs[inputs_num].size = size;
+	++inputs_num;
+}
+
+static size_t count_colons(const char *s, size_t len)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < len; ++i)
+		n += s[i] == ':';
+	return n;
+}
+
+/* __nondet_buffer|function:variable:line:column:size:kind|... */
+static void add_buffer(const char *name, size_t len,
+                       const unsigned char *bytes, uint32_t size)
+{
+	uint32_t offset = 0;
+	const char *end = name + len;
+	const char *part = memchr(name, '|', len);
+	while (part && part < end) {
+		const char *next = memchr(part + 1, '|', end - part - 1);
+		const char *part_end = next ? next : end;
+		/* the size is the fifth field of the part */
+		const char *field = part + 1;
+		for (int i = 0; i < 4 && field; ++i) {
+			field = memchr(field, ':', part_end - field);
+			if (field)
+				++field;
+		}
+		if (!field)
+			break;
+		uint32_t value_size = (uint32_t)strtoul(field, NULL, 10);
+		if (value_size > size - offset)
+			break;
+		add_input(bytes + offset, value_size);
+		offset += value_size;
+		part = next;
+	}
+}
+
+static void load_test(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		fail(path, "cannot open the test");
+
+	size_t capacity = 4096, len = 0;
+	unsigned char *data = malloc(capacity);
+	size_t n;
+	while (data && (n = fread(data + len, 1, capacity - len, f)) > 0) {
+		len += n;
+		if (len == capacity)
+			data = realloc(data, capacity *= 2);
+	}
+	fclose(f);
+	if (!data)
+		abort();
+
+	const unsigned char *pos = data, *end = data + len;
+	if (len < 5 || (memcmp(pos, "KTEST", 5) != 0 &&
+	                memcmp(pos, "BOUT\n", 5) != 0))
+		fail(path, "unrecognized file");
+	pos += 5;
+
+	uint32_t version = read_u32(&pos, end);
+	if (version > 3)
+		fail(path, "unrecognized version");
+
+	/* skip the arguments */
+	uint32_t num = read_u32(&pos, end);
+	for (uint32_t i = 0; i < num; ++i) {
+		uint32_t size = read_u32(&pos, end);
+		if (size > (size_t)(end - pos))
+			fail(path, "truncated file");
+		pos += size;
+	}
+	if (version >= 2) {
+		if (end - pos < 8)
+			fail(path, "truncated file");
+		pos += 8;
+	}
+
+	num = read_u32(&pos, end);
+	for (uint32_t i = 0; i < num; ++i) {
+		uint32_t name_size = read_u32(&pos, end);
+		if (name_size > (size_t)(end - pos))
+			fail(path, "truncated file");
+		const char *name = (const char *)pos;
+		pos += name_size;
+
+		uint32_t size = read_u32(&pos, end);
+		if (size > (size_t)(end - pos))
+			fail(path, "truncated file");
+		const unsigned char *bytes = pos;
+		pos += size;
+
+		if (name_size > 16 && memcmp(name, "__nondet_buffer|", 16) == 0)
+			add_buffer(name, name_size, bytes, size);
+		else if (count_colons(name, name_size) == 3)
+			add_input(bytes, size);
+	}
+	/* the data stay allocated, the inputs point into them */
+}
+
+static void next_value(void *value, size_t size)
+{
+	memset(value, 0, size);
+	if (next_input >= inputs_num)
+		return;
+	struct input *in = &inputs[next_input++];
+	/* (little-endian, the lower bytes come first) */
+	memcpy(value, in->bytes, in->size < size ? in->size : size);
+}
+
+#define NONDET(type, name)                         \
+	type __VERIFIER_nondet_##name(void)        \
+	{                                          \
+		type value;                        \
+		next_value(&value, sizeof value);  \
+		return value;                      \
+	}
+
+NONDET(int, int)
+NONDET(unsigned int, uint)
+NONDET(unsigned int, unsigned)
+NONDET(char, char)
+NONDET(unsigned char, uchar)
+NONDET(short, short)
+NONDET(unsigned short, ushort)
+NONDET(long, long)
+NONDET(unsigned long, ulong)
+NONDET(long long, longlong)
+NONDET(unsigned long long, ulonglong)
+NONDET(float, float)
+NONDET(double, double)
+NONDET(void *, pointer)
+NONDET(size_t, size_t)
+NONDET(long, loff_t)
+NONDET(char *, pchar)
+
+_Bool __VERIFIER_nondet_bool(void)
+{
+	unsigned char value;
+	next_value(&value, sizeof value);
+	return value != 0;
+}
+
+_Bool __VERIFIER_nondet__Bool(void)
+{
+	return __VERIFIER_nondet_bool();
+}
+
+void __VERIFIER_assume(int expr)
+{
+	if (!expr)
+		exit(0);
+}
+
+void __VERIFIER_error(void)
+{
+	fprintf(stderr, "[harness] __VERIFIER_error called\n");
+	abort();
+}
+
+int main(int argc, char *argv[], char *envp[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s test.ktest [arguments]\n", argv[0]);
+		return 2;
+	}
+	load_test(argv[1]);
+
+	/* the program gets its name and the rest of the arguments */
+	argv[1] = argv[0];
+	return __symbiotic_main(argc - 1, argv + 1, envp);
+}
@@ -0,0 +1,35 @@
+#include <stdio.h>
+
+int __symbiotic_nondet_int(void);
+void __VERIFIER_assume(int);
+size_t __symbiotic_input_len(size_t);
+
+extern size_t __symbiotic_input_limit;
+extern void klee_make_symbolic(void *, size_t, const char *);
+
+/* The models in lib/input are used with --symbolic-input-buffers.
+ * The read string is a single symbolic object instead of
+ * a symbolic object for every character. */
+
+char *fgets(char *restrict s, int size, FILE *restrict stream) {
+    *stream; /* test the pointer */
+
+    __VERIFIER_assume(size > 0);
+    size_t rs = __symbiotic_input_len(size);
+
+    /* the object must have a concrete size, so it is bounded
+     * by the size of the buffer and the limit on the length */
+    size_t n = size;
+    if (__symbiotic_input_limit < n - 1)
+        n = __symbiotic_input_limit + 1;
+
+    char input[n];
+    klee_make_symbolic(input, n, "fgets");
+    for (size_t i = 0; i < rs; ++i)
+        s[i] = input[i];
+    s[rs] = '\0';
+
+    if (__symbiotic_nondet_int() == 0)
+        return NULL;
+    return s;
+}
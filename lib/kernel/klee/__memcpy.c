@@ -0,0 +1,28 @@
+#include "symbiotic-size_t.h"
+
+extern unsigned klee_is_symbolic(size_t);
+
+typedef size_t __attribute__((__may_alias__)) word_t;
+
+#define ALIGNED(p) \
+	(!klee_is_symbolic((size_t)(p)) && ((size_t)(p) % sizeof(word_t)) == 0)
+
+// With a concrete size and aligned addresses, copy whole words --
+// KLEE interprets several times fewer instructions then. The words
+// of symbolic bytes are just the concatenations of the bytes.
+void *__memcpy(void *dest, const void *src, size_t n)
+{
+	size_t i = 0;
+	if (!klee_is_symbolic(n) && ALIGNED(dest) && ALIGNED(src)) {
+		for (; n - i >= sizeof(word_t); i += sizeof(word_t))
+			*(word_t *)((char *)dest + i) =
+				*(const word_t *)((const char *)src + i);
+	}
+
+	while(i < n) {
+		((char *)dest)[i] = ((char *)src)[i];
+		++i;
+	}
+
+	return dest;
+}
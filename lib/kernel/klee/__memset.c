@@ -0,0 +1,28 @@
+#include "symbiotic-size_t.h"
+
+extern unsigned klee_is_symbolic(size_t);
+
+typedef size_t __attribute__((__may_alias__)) word_t;
+
+#define ALIGNED(p) \
+	(!klee_is_symbolic((size_t)(p)) && ((size_t)(p) % sizeof(word_t)) == 0)
+
+// the memset of KLEE sets one byte at a time, with a concrete size
+// and an aligned address set whole words
+void *__memset(void *ptr, int c, size_t size)
+{
+	size_t i = 0;
+	if (!klee_is_symbolic(size) && ALIGNED(ptr)) {
+		// the byte in every byte of the word
+		word_t word = ((word_t) -1 / 0xff) * (unsigned char) c;
+		for (; size - i >= sizeof(word_t); i += sizeof(word_t))
+			*(word_t *)((char *)ptr + i) = word;
+	}
+
+	while(i < size) {
+		((unsigned char *)ptr)[i] = (unsigned char) c;
+		++i;
+	}
+
+	return ptr;
+}
@@ -1,13 +1,11 @@
 #include "symbiotic-size_t.h"
 
-extern void *malloc(size_t);
-extern void *memset(void *, int, size_t);
+extern void *calloc(size_t, size_t);
 
+/* calloc instead of malloc + memset: KLEE allocates a zeroed
+ * object directly instead of writing the zeros byte by byte */
 void *kzalloc(int size, int flgs)
 {
 	(void) flgs;
-	void *mem = malloc(size);
-	memset(mem, 0, size);
-
-	return mem;
+	return calloc(1, size);
 }
@@ -0,0 +1,46 @@
+#include "symbiotic-size_t.h"
+
+extern void *malloc(size_t);
+extern void free(void *);
+extern void *memcpy(void *, const void *, size_t);
+extern size_t klee_get_obj_size(void *);
+extern void klee_make_symbolic(void *, size_t, const char *);
+extern _Bool __symbiotic_malloc_fails(void);
+
+/* realloc for KLEE (see -instrument-alloc-realloc). The realloc of KLEE
+ * never fails and copies the object byte by byte into a new object
+ * (forking on the symbolic sizes). Here realloc forks only on success
+ * and failure like __VERIFIER_malloc, a shrunk object is kept as it is
+ * (realloc may return the same pointer, KLEE cannot make the object
+ * smaller, so this is not for memory safety) and a grown object
+ * is a new symbolic object with one copy of the old contents. */
+void *__VERIFIER_realloc(void *ptr, size_t size)
+{
+	if (!ptr) {
+		if (__symbiotic_malloc_fails())
+			return ((void *) 0);
+
+		void *mem = malloc(size);
+		klee_make_symbolic(mem, size, "realloc");
+		return mem;
+	}
+
+	if (size == 0) {
+		free(ptr);
+		return ((void *) 0);
+	}
+
+	size_t old = klee_get_obj_size(ptr);
+	if (size <= old)
+		return ptr;
+
+	/* the old object is kept if the allocation fails */
+	if (__symbiotic_malloc_fails())
+		return ((void *) 0);
+
+	void *mem = malloc(size);
+	klee_make_symbolic(mem, size, "realloc");
+	memcpy(mem, ptr, old);
+	free(ptr);
+	return mem;
+}
@@ -4,14 +4,13 @@
 
 extern void *malloc(size_t);
 void klee_make_symbolic(void *, size_t, const char *);
+_Bool __symbiotic_malloc_fails(void);
 
 /* add our own versions of malloc and calloc */
 /* non-deterministically return memory or NULL */
 void *__VERIFIER_malloc(size_t size)
 {
-	_Bool fails;
-	klee_make_symbolic(&fails, sizeof(fails), "malloc-fails");
-	if (fails)
+	if (__symbiotic_malloc_fails())
 		return ((void *) 0);
 
 	void *mem = malloc(size);
@@ -20,22 +19,15 @@ void *__VERIFIER_malloc(size_t size)
 	return mem;
 }
 
-void *memset(void *s, int c, size_t n);
+extern void *calloc(size_t, size_t);
 void *__VERIFIER_calloc(size_t nmem, size_t size)
 {
-	_Bool fails;
-	klee_make_symbolic(&fails, sizeof(fails), "calloc-fails");
-	if (fails)
+	if (__symbiotic_malloc_fails())
 		return ((void *) 0);
 
-	void *mem = malloc(nmem * size);
-	/* do it symbolic, so that subsequent
-	 * uses will be symbolic, but initialize it
-	 * to 0s */
-	klee_make_symbolic(mem, nmem * size, "calloc");
-	memset(mem, 0, nmem * size);
-
-	return mem;
+	/* KLEE creates a concrete zero-filled object, no need to make
+	 * the memory symbolic and overwrite it with zeros */
+	return calloc(nmem, size);
 }
 
 /* this versions never return NULL */
@@ -51,11 +43,6 @@ void *__VERIFIER_malloc0(size_t size)
 
 void *__VERIFIER_calloc0(size_t nmem, size_t size)
 {
-	void *mem = malloc(nmem * size);
-	//klee_assume(mem != (void *) 0);
-	klee_make_symbolic(mem, nmem * size, "calloc0");
-	memset(mem, 0, nmem * size);
-
-	return mem;
+	return calloc(nmem, size);
 }
 
@@ -1,12 +1,42 @@
 #include "symbiotic-size_t.h"
 
+extern unsigned klee_is_symbolic(size_t);
+
+typedef size_t __attribute__((__may_alias__)) word_t;
+
+#define ONES ((word_t) -1 / 0xff)
+#define HIGHS (ONES * 0x80)
+// some byte of the word is zero
+#define HAS_ZERO(w) (((w) - ONES) & ~(w) & HIGHS)
+
 void *memchr(const void *mem, int c, size_t n)
 {
-	size_t i;
+	size_t i = 0;
 	const unsigned char *byte = mem;
-	for (i = 0; i < n; ++i)
-		if (byte[i] == (unsigned char) c)
-			return (void *) byte;
+	const unsigned char ch = (unsigned char) c;
+
+	// check a concrete word for the character at once, search only
+	// the words that contain it (or are symbolic) byte by byte
+	if (!klee_is_symbolic(n) && !klee_is_symbolic(ch) &&
+	    !klee_is_symbolic((size_t) mem)) {
+		for (; i < n && (size_t)(byte + i) % sizeof(word_t) != 0; ++i)
+			if (byte[i] == ch)
+				return (void *) (byte + i);
+
+		const word_t pattern = ONES * ch;
+		for (; n - i >= sizeof(word_t); i += sizeof(word_t)) {
+			word_t w = *(const word_t *)(byte + i);
+			if (!klee_is_symbolic(w) && !HAS_ZERO(w ^ pattern))
+				continue;
+			for (size_t j = i; j < i + sizeof(word_t); ++j)
+				if (byte[j] == ch)
+					return (void *) (byte + j);
+		}
+	}
+
+	for (; i < n; ++i)
+		if (byte[i] == ch)
+			return (void *) (byte + i);
 
 	return ((void *) 0);
 }
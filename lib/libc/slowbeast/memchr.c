@@ -0,0 +1,12 @@
+#include "symbiotic-size_t.h"
+
+void *memchr(const void *s, int c, size_t n)
+{
+	const unsigned char *bytes = (const unsigned char *) s;
+	for (size_t i = 0; i < n; ++i) {
+		if (bytes[i] == (unsigned char) c)
+			return (void *) (bytes + i);
+	}
+
+	return ((void *) 0);
+}
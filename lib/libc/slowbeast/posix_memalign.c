@@ -0,0 +1,15 @@
+#include "symbiotic-size_t.h"
+
+extern void *malloc(size_t);
+
+/* the objects of slowbeast have no addresses, any object is aligned */
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	(void) alignment;
+	void *mem = malloc(size);
+	if (!mem)
+		return 12 /* ENOMEM */;
+
+	*memptr = mem;
+	return 0;
+}
@@ -0,0 +1,17 @@
+#include "symbiotic-size_t.h"
+
+char *strcat(char *dest, const char *src)
+{
+	size_t n = 0;
+	while (dest[n] != '\0')
+		++n;
+
+	size_t i = 0;
+	while (src[i] != '\0') {
+		dest[n + i] = src[i];
+		++i;
+	}
+	dest[n + i] = '\0';
+
+	return dest;
+}
@@ -0,0 +1,13 @@
+#include "symbiotic-size_t.h"
+
+char *strchr(const char *str, int c)
+{
+	size_t i = 0;
+	while (str[i] != (char) c) {
+		if (str[i] == '\0')
+			return ((char *) 0);
+		++i;
+	}
+
+	return (char *) str + i;
+}
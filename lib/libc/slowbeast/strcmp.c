@@ -0,0 +1,15 @@
+#include "symbiotic-size_t.h"
+
+int strcmp(const char *s1, const char *s2)
+{
+	const unsigned char *a = (const unsigned char *) s1;
+	const unsigned char *b = (const unsigned char *) s2;
+	size_t i = 0;
+	while (a[i] == b[i]) {
+		if (a[i] == '\0' /* => b[i] == '\0' */)
+			return 0;
+		++i;
+	}
+
+	return a[i] < b[i] ? -1 : 1;
+}
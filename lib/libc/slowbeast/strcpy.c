@@ -0,0 +1,15 @@
+#include "symbiotic-size_t.h"
+
+char *strcpy(char *dest, const char *src)
+{
+	size_t i = 0;
+	while (src[i] != '\0') {
+		dest[i] = src[i];
+		++i;
+	}
+
+	/* include the terminating 0 */
+	dest[i] = '\0';
+
+	return dest;
+}
@@ -0,0 +1,18 @@
+#include "symbiotic-size_t.h"
+
+extern void *malloc(size_t);
+
+char *strdup(const char *s)
+{
+	size_t n = 0;
+	while (s[n] != '\0')
+		++n;
+
+	char *copy = malloc(n + 1);
+	if (!copy)
+		return ((char *) 0);
+	for (size_t i = 0; i <= n; ++i)
+		copy[i] = s[i];
+
+	return copy;
+}
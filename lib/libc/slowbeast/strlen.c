@@ -0,0 +1,14 @@
+#include "symbiotic-size_t.h"
+
+/* The models for slowbeast access the memory only by indices
+ * from the start of the object (no differences of pointers, no reads
+ * of whole words), that is what its memory model handles cheaply. */
+
+size_t strlen(const char *str)
+{
+	size_t i = 0;
+	while (str[i] != '\0')
+		++i;
+
+	return i;
+}
@@ -0,0 +1,19 @@
+#include "symbiotic-size_t.h"
+
+extern void *malloc(size_t);
+
+char *strndup(const char *s, size_t max)
+{
+	size_t n = 0;
+	while (n < max && s[n] != '\0')
+		++n;
+
+	char *copy = malloc(n + 1);
+	if (!copy)
+		return ((char *) 0);
+	for (size_t i = 0; i < n; ++i)
+		copy[i] = s[i];
+	copy[n] = '\0';
+
+	return copy;
+}
@@ -0,0 +1,10 @@
+#include "symbiotic-size_t.h"
+
+size_t strnlen(const char *str, size_t n)
+{
+	size_t i = 0;
+	while (i < n && str[i] != '\0')
+		++i;
+
+	return i;
+}
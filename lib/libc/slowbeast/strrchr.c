@@ -0,0 +1,13 @@
+#include "symbiotic-size_t.h"
+
+char *strrchr(const char *str, int c)
+{
+	char *last = ((char *) 0);
+	size_t i = 0;
+	do {
+		if (str[i] == (char) c)
+			last = (char *) str + i;
+	} while (str[i++] != '\0');
+
+	return last;
+}
@@ -1,15 +1,66 @@
-// our implementation of qsort does not actually sorts,
-// but just checks that the array is sorted -- so that if
+// If the array is concrete, we really sort it (heapsort, that is in-place
+// and non-recursive). Otherwise, our implementation of qsort does not
+// actually sorts, but just checks that the array is sorted -- so that if
 // the array is symbolic, we can continue with this assumption.
-// If the array is concrete and unsorted, we abort...
+// If the array is unsorted there, we abort...
 //
 #include "symbiotic-size_t.h"
 
 extern void klee_warning_once(const char *);
+extern unsigned klee_is_symbolic(size_t);
 void klee_silent_exit(int) __attribute__((noreturn));
 
+static int is_concrete(const unsigned char *mem, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (klee_is_symbolic(mem[i]))
+            return 0;
+    }
+    return 1;
+}
+
+static void swap(unsigned char *a, unsigned char *b, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        unsigned char tmp = a[i];
+        a[i] = b[i];
+        b[i] = tmp;
+    }
+}
+
+// move the element at index 'root' down the heap of 'n' elements
+static void sift_down(unsigned char *base, size_t root, size_t n, size_t size,
+                      int (*compar)(const void *, const void *)) {
+    size_t child;
+    while ((child = 2*root + 1) < n) {
+        if (child + 1 < n &&
+            compar(base + child*size, base + (child + 1)*size) < 0)
+            ++child;
+        if (compar(base + root*size, base + child*size) >= 0)
+            return;
+        swap(base + root*size, base + child*size, size);
+        root = child;
+    }
+}
+
+static void heapsort(unsigned char *base, size_t nmemb, size_t size,
+                     int (*compar)(const void *, const void *)) {
+    for (size_t i = nmemb / 2; i > 0; --i)
+        sift_down(base, i - 1, nmemb, size, compar);
+    for (size_t n = nmemb - 1; n > 0; --n) {
+        swap(base, base + n*size, size);
+        sift_down(base, 0, n, size, compar);
+    }
+}
+
 void qsort(void *base, size_t nmemb, size_t size,
            int (*compar)(const void *, const void *)) {
+    if (nmemb < 2)
+        return;
+
+    if (is_concrete((unsigned char *) base, nmemb*size)) {
+        heapsort((unsigned char *) base, nmemb, size, compar);
+        return;
+    }
+
     unsigned char *nxt = (unsigned char *) base;
     for (unsigned i = 1; i < nmemb; ++i) {
         nxt += size;
@@ -0,0 +1,24 @@
+#include "symbiotic-size_t.h"
+
+extern _Bool __symbiotic_nondet__Bool(void);
+extern void __VERIFIER_assume(int);
+extern size_t strlen(const char *);
+
+/* The models in lib/numbers are used with --numeric-models=summary.
+ * They do not parse the string, so that a symbolic string does not fork
+ * a path for every digit: the number is nondeterministic and either
+ * nothing is parsed (the result is 0 and the end pointer is the string),
+ * or the whole string is (the end pointer points to the terminating zero).
+ * This over-approximates the exact models, a program that depends on
+ * the exact value of the parsed number can reach more states.
+ * The string is still read (by strlen), so that the invalid pointers
+ * are found as with the exact models. */
+
+/* the number of characters of s parsed by a model */
+size_t __symbiotic_parsed_len(const char *s)
+{
+	size_t len = strlen(s);
+	if (len == 0 || __symbiotic_nondet__Bool())
+		return 0;
+	return len;
+}
@@ -0,0 +1,11 @@
+#include "symbiotic-size_t.h"
+
+extern int __symbiotic_nondet_int(void);
+extern size_t __symbiotic_parsed_len(const char *);
+
+int atoi(const char *s)
+{
+	if (__symbiotic_parsed_len(s) == 0)
+		return 0;
+	return __symbiotic_nondet_int();
+}
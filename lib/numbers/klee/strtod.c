@@ -0,0 +1,14 @@
+#include "symbiotic-size_t.h"
+
+extern double __symbiotic_nondet_double(void);
+extern size_t __symbiotic_parsed_len(const char *);
+
+double strtod(const char *nptr, char **endptr)
+{
+	size_t len = __symbiotic_parsed_len(nptr);
+	if (endptr)
+		*endptr = (char *) nptr + len;
+	if (len == 0)
+		return 0.0;
+	return __symbiotic_nondet_double();
+}
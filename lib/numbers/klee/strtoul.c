@@ -0,0 +1,14 @@
+#include "symbiotic-size_t.h"
+
+extern unsigned long __symbiotic_nondet_ulong(void);
+extern size_t __symbiotic_parsed_len(const char *);
+
+unsigned long strtoul(const char *nptr, char **endptr, int base)
+{
+	size_t len = __symbiotic_parsed_len(nptr);
+	if (endptr)
+		*endptr = (char *) nptr + len;
+	if (len == 0)
+		return 0;
+	return __symbiotic_nondet_ulong();
+}
@@ -0,0 +1,21 @@
+#include "symbiotic-size_t.h"
+
+/* The models in lib/strings are used with --string-models=select.
+ * They compute the result with selects instead of branching on every
+ * byte, so that KLEE does not fork a path for every position where
+ * symbolic contents may differ. */
+
+int memcmp(const void *dest, const void *src, size_t n)
+{
+	const unsigned char *a = dest;
+	const unsigned char *b = src;
+	int res = 0;
+
+	/* memcmp may read all the n bytes, the only branch is on n */
+	for (size_t i = 0; i < n; ++i) {
+		int d = (a[i] > b[i]) - (a[i] < b[i]);
+		res = res == 0 ? d : res;
+	}
+
+	return res;
+}
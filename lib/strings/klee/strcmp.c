@@ -0,0 +1,16 @@
+/* We must not read behind the terminating zero, so we still branch on
+ * the end of the comparison (one fork per byte instead of two),
+ * but the result is computed without branching. */
+
+int strcmp(const char *s1, const char *s2)
+{
+	const unsigned char *a = (const unsigned char *) s1;
+	const unsigned char *b = (const unsigned char *) s2;
+
+	while (*a == *b && *a != '\0') {
+		++a;
+		++b;
+	}
+
+	return (*a > *b) - (*a < *b);
+}
@@ -0,0 +1,21 @@
+#include "symbiotic-size_t.h"
+
+/* We must not read behind the terminating zero, so we still branch on
+ * the end of the comparison (one fork per byte instead of two),
+ * but the result is computed without branching. */
+
+int strncmp(const char *s1, const char *s2, size_t n)
+{
+	const unsigned char *a = (const unsigned char *) s1;
+	const unsigned char *b = (const unsigned char *) s2;
+
+	if (n == 0)
+		return 0;
+
+	while (--n > 0 && *a == *b && *a != '\0') {
+		++a;
+		++b;
+	}
+
+	return (*a > *b) - (*a < *b);
+}
@@ -0,0 +1,7 @@
+#include <pthread.h>
+
+extern void *__symbiotic_region_lock(unsigned region);
+void __symbiotic_atomic_begin_region(unsigned region)
+{
+	pthread_mutex_lock(__symbiotic_region_lock(region));
+}
@@ -0,0 +1,7 @@
+#include <pthread.h>
+
+extern void *__symbiotic_region_lock(unsigned region);
+void __symbiotic_atomic_end_region(unsigned region)
+{
+	pthread_mutex_unlock(__symbiotic_region_lock(region));
+}
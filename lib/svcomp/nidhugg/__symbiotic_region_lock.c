@@ -0,0 +1,23 @@
+#include <pthread.h>
+
+#define REGION_LOCKS 16
+
+extern void *__symbiotic_global_lock(void);
+// the lock of the atomic sections in the region
+// (see -replace-verifier-atomic), the region 0 uses the global lock
+void *__symbiotic_region_lock(unsigned region) {
+	static pthread_mutex_t locks[REGION_LOCKS] = {
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER
+	};
+	if (region == 0)
+		return __symbiotic_global_lock();
+	// more regions can share a lock, they just do not run in parallel
+	return (void*)&locks[(region - 1) % REGION_LOCKS];
+}
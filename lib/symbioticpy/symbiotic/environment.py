@@ -4,6 +4,7 @@ from os import environ, getcwd
 from os.path import isfile, isdir
 from . utils import err, dbg
 from . utils.utils import process_grep
+from . utils.cache import ProbeCache
 
 import re
 
@@ -14,16 +15,21 @@ def _vers_are_same(v1, v2):
     # compare major and minor versions, ignore micro version
     return all(parts1[i] == parts2[i] for i in range(2))
 
-def _check_clang_in_path(llvm_version):
+def _get_clang_version():
     versline = process_grep(['clang', '-v'], 'clang version')
     if versline[0] != 0 or len(versline[1]) != 1:
-        return False
+        return None
 
     match = re.search(r'\d+\.\d+\.\d+', versline[1][0].decode())
     if match is None:
         err('Could not determine the clang version')
 
-    return _vers_are_same(match[0], llvm_version)
+    return match[0]
+
+def _check_clang_in_path(llvm_version, cachedir=None):
+    # (the version is probed only if clang changed since the last run)
+    vers = ProbeCache(cachedir).get('version', 'clang', _get_clang_version)
+    return vers is not None and _vers_are_same(vers, llvm_version)
 
 def _set_symbiotic_environ(tool, env, opts):
     env.cwd = getcwd()
@@ -42,7 +48,7 @@ def _set_symbiotic_environ(tool, env, opts):
 
     if not isdir(llvm_prefix):
         dbg('Did not find a build of LLVM, checking the system LLVM')
-        if not _check_clang_in_path(llvm_version):
+        if not _check_clang_in_path(llvm_version, opts.cache_dir):
             dbg("System's LLVM does not have the right version ({0})".format(llvm_version))
             dbg("Cannot use system LLVM neither the directory with LLVM binaries exists: '{0}'".format(llvm_prefix))
 
@@ -50,7 +56,7 @@ def _set_symbiotic_environ(tool, env, opts):
             dbg("Trying binaries in install/ directory")
             llvm_prefix = '{0}/install/llvm-{1}'.format(env.symbiotic_dir, llvm_version)
             env.prepend('PATH', '{0}/bin'.format(llvm_prefix))
-            if not _check_clang_in_path(llvm_version):
+            if not _check_clang_in_path(llvm_version, opts.cache_dir):
                 err('Could not find a suitable LLVM binaries')
             else:
                 dbg('The binary in install/ folder can do!')
@@ -69,6 +75,7 @@ def _set_symbiotic_environ(tool, env, opts):
         env.prepend('PATH', '{0}/sbt-instrumentation/analyses'.format(env.symbiotic_dir, llvm_version))
         env.prepend('PATH', '{0}/llvm2c/build-{1}/'.format(env.symbiotic_dir, llvm_version))
         env.prepend('PATH', '{0}/predator-{1}/sl_build/'.format(env.symbiotic_dir, llvm_version))
+        env.prepend('PATH', '{0}/transforms/build-{1}/'.format(env.symbiotic_dir, llvm_version))
 
         env.prepend('LD_LIBRARY_PATH', '{0}/build/lib'.format(llvm_prefix))
         env.prepend('LD_LIBRARY_PATH', '{0}/transforms/build-{1}/'.format(env.symbiotic_dir,llvm_version))
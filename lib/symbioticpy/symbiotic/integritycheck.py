@@ -3,11 +3,17 @@ from . exceptions import SymbioticException
 from . utils.utils import process_grep
 from . utils.process import ProcessRunner
 from . utils.watch import ProcessWatch
+from . utils.cache import ProbeCache
 
 class IntegrityChecker(object):
-    def __init__(self, versions):
+    def __init__(self, versions, cachedir=None):
         self._versions = versions
         self._process = ProcessRunner()
+        # the versions are probed only if the tools changed
+        self._cache = ProbeCache(cachedir)
+
+    def _probe(self, executable, get_version):
+        return self._cache.get('version', executable, get_version)
 
     def _decode(self, vers):
         if version_info < (3,0):
@@ -54,15 +60,15 @@ class IntegrityChecker(object):
             if k == 'KLEE':
                 # check KLEE only if we are using KLEE
                 if verifier.startswith('klee'):
-                    vers = self._get_klee_version()
+                    vers = self._probe('klee', self._get_klee_version)
                     expected = self._decode(v)
                     self._check(k, expected, vers)
             elif k == 'sbt-slicer':
-                vers = self._get_slicer_version()
+                vers = self._probe('sbt-slicer', self._get_slicer_version)
                 expected = self._decode(v[:8])
                 self._check(k, expected, vers)
             elif k == 'sbt-instrumentation':
-                vers = self._get_instr_version()
+                vers = self._probe('sbt-instr', self._get_instr_version)
                 expected = self._decode(v[:8])
                 self._check(k, expected, vers)
 
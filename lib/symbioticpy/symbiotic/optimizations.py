@@ -25,7 +25,9 @@ optimizations = {
      '-constmerge', '-ipsccp', '-deadargelim', '-die',
      '-instcombine'],
 
-    # FIXME: disable vectorizers?
+    # (the vectorizers of -O3 cannot be turned off, the pipelines
+    # tuned by tests/pipelines.py list the passes explicitly and
+    # --opt-pipelines removes the vectorizers, see lib/opt-pipelines.json)
     'O3': ['-O3'],
     'O2': ['-O2'],
 }
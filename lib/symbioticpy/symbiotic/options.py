@@ -1,9 +1,10 @@
 #!/usr/bin/env python3
 
 import sys
-from os import getcwd
+from os import getcwd, environ
 from os.path import isfile, isdir, abspath, expanduser
 from . utils import err, dbg, enable_debug
+from . utils.trace import enable_trace
 
 def get_versions():
     """ Return a tuple (VERSION, versions, llvm_versions) """
@@ -40,7 +41,13 @@ class SymbioticOptions(object):
         self.property = None
         self.noslice = False
         self.malloc_never_fails = False
+        # the maximal number of allocations that may fail
+        # on a path (None = no limit)
+        self.malloc_fail_budget = None
         self.explicit_symbolic = False
+        # make uninitialized arrays on stack and allocations of at least
+        # this size symbolic lazily, by chunks (0 = never)
+        self.lazy_uninitialized = 0
         self.undef_retval_nosym = False
         self.undefined_are_pure = False
         self.require_slicer = False
@@ -53,16 +60,37 @@ class SymbioticOptions(object):
         self.final_output = None
         self.witness_output = '{0}/witness.graphml'.format(getcwd())
         self.testsuite_output = '{0}/test-suite'.format(getcwd())
+        # if set, pack the test suite into this zip archive (see testpack.py)
+        self.testsuite_zip = None
         self.source_is_bc = False
         self.argv = []
+        # the maximal number and length of the symbolic arguments
+        # of main (see -symbolic-argv), None for the concrete --argv
+        self.symbolic_argv = None
         self.optlevel = ["before-O3", "after-O3"]
         self.slicer_pta = 'fi'
         self.memsafety_config_file = None
         self.overflow_config_file = None
         self.repeat_slicing = 1
+        # programs with less instructions than this are preprocessed
+        # without slicing and optimizations (0 turns it off)
+        self.tiny_task = 0
         self.exit_on_error = False
         # folders where to look for models of undefined functions
         self.linkundef = ['verifier', 'libc', 'posix', 'kernel']
+        # models of string functions: 'default' or 'select' (the models
+        # from lib/strings that fork less paths in symbolic execution)
+        self.string_models = 'default'
+        # models of the functions that parse numbers (atoi, strtol, strtod):
+        # 'exact' or 'summary' (the models from lib/numbers that return
+        # a nondeterministic number instead of parsing the string)
+        self.numeric_models = 'exact'
+        # make the strings read by the models of input functions
+        # one symbolic object (the models from lib/input)
+        self.symbolic_input_buffers = False
+        # the maximal length of a string read by the models
+        # of input functions (0 = no limit)
+        self.max_input_length = 0
         # these files will be linked unconditionally just after compilation
         self.link_files = []
         # these files are going to be linked before slicing if they are undefined
@@ -109,7 +137,109 @@ class SymbioticOptions(object):
         self.dump_env_only = False
         self.dump_env_cmd = False
         self.save_files = False
+        # stages after which we generate .ll files (for debugging)
+        self.save_ll_stages = []
         self.working_dir_prefix = '/tmp'
+        # run the LLVM passes in sbt-pipeline (if available)
+        # instead of starting opt for every stage
+        self.pipeline_driver = True
+        # run the passes of opt in the new pass manager (LLVMsbt.so is loaded
+        # also as a pass plugin) instead of the legacy one (LLVM 13+)
+        self.new_pm = False
+        # directory with the persistent cache of compiled bitcode
+        # (function models, instrumentation definitions), None = no cache
+        self.cache_dir = environ.get('SYMBIOTIC_CACHE_DIR')
+        # store time, memory and changes of code of every pass
+        # run by sbt-pipeline into this (JSON) file
+        self.pass_report = None
+        # store the timeline of the run (the phases, processes and passes)
+        # into this file in the trace-event format of Chrome
+        self.trace = None
+        # the limit of the address space of opt and sbt-pipeline (in bytes),
+        # None = no limit
+        self.stage_memlimit = None
+        # roll back the optional stages of sbt-pipeline that multiply
+        # the number of instructions by more than this (0 = never)
+        self.growth_budget = 10
+        # store the profile of the verification (the hot loops and the lines
+        # with the most solver time) into this file (JSON)
+        self.profile_verification = None
+        # if set, store the features of the program into this file (JSON)
+        self.features = None
+        # the features of the compiled program (loaded from the file above)
+        self.program_features = None
+        # choose the options of KLEE by the features of the program
+        # from this table of profiles ('default' = lib/klee-profiles.json)
+        self.klee_profiles = None
+        # create the nondeterministic values of the calls that follow
+        # each other in a block in one symbolic object (see -coalesce-nondet)
+        self.coalesce_nondet = False
+        # reuse the transformed program from the cache if the compiled
+        # program did not change (see --incremental)
+        self.incremental = False
+        # reuse the verdict of the previous version of the program
+        # if the sliced program did not change (see --incremental-verification)
+        self.incremental_verification = False
+        # the directory with the checkpoints of the preprocessing,
+        # continue from the last valid one there (see --resume)
+        self.resume = None
+        # reuse the verdict (and the witness) from the cache if the same
+        # task was verified with the same options and versions
+        self.result_cache = False
+        # share the solver queries of KLEE between the runs on the same
+        # bitcode (in the cache directory), the size of the cache in bytes
+        self.query_cache = False
+        self.query_cache_size = 1024 * 1024 * 1024
+        # run first the verifiers that answered the most for the programs
+        # with similar features (the outcomes are kept in the cache)
+        self.adaptive_verifiers = False
+        # options from the command line (pairs from getopt)
+        self.cmdline = []
+        # run the verifiers of the tool in parallel,
+        # the first true/false answer wins
+        self.parallel_verifiers = False
+        # split the input space into 2^N cubes that are verified
+        # in parallel (see --split-input)
+        self.split_input = 0
+        # split the module into N partitions that are optimized
+        # in parallel (see --split-optimize, 0 = do not split)
+        self.split_optimize = 0
+        # use the optimization pipelines tuned for the target and LLVM
+        # from this table ('default' = lib/opt-pipelines.json)
+        self.opt_pipelines = None
+        # run sbt-instr and sbt-slicer from their libraries in sbt-pipeline
+        # on the module in memory (if the libraries are available)
+        self.in_process_tools = False
+        # run the verifiers on these machines over ssh
+        # (one job at a time on every item of the list)
+        self.remote_workers = []
+        # bracket simple loop bodies and diamonds with the merge hints
+        # of KLEE (see -insert-merge-hints)
+        self.merge_hints = False
+        # annotate the memory accesses with the objects that they may
+        # access for the resolution of pointers in KLEE (see -annotate-points-to)
+        self.points_to_hints = False
+        # annotate the blocks with the distance to the nearest error
+        # (or test target) for a directed search (see -annotate-target-distance)
+        self.target_distance = False
+        # execute the deterministic prefix of main concretely
+        # before the symbolic execution (see -concrete-prefix)
+        self.concrete_prefix = False
+        # replace the reads from the table of __ctype_b_loc (isdigit, ...)
+        # by comparisons with the ranges of characters (see -lower-ctype)
+        self.lower_ctype = False
+        # check memcleanup by KLEE's walk over the live objects
+        # instead of counting the allocations (see -count-allocations)
+        self.memcleanup_by_scan = False
+        # run the 32-bit and the 64-bit verification in parallel
+        # and report both results
+        self.both_data_models = False
+        # with --gen-c, translate only the functions that the
+        # preprocessing changed (in parallel)
+        self.generate_c_changed = False
+        # keep the working directory in a tmpfs with this cap in MB
+        # (0 = no cap, None = do not use a tmpfs)
+        self.tmpfs_cap = None
         self.unroll_count = 0
 
 def _remove_linkundef(options, what):
@@ -230,28 +360,41 @@ def parse_command_line():
                                     'debug=', 'timeout=','slicer-timeout=',
                                     'instrumentation-timeout=', 'version', 'help',
                                     'no-verification', 'output=', 'witness=', 'bc',
-                                    'optimize=', 'malloc-never-fails',
-                                    'pta=', 'no-link=', 'argv=', 'no-instrument',
+                                    'optimize=', 'split-optimize=', 'opt-pipelines=', 'in-process-tools', 'malloc-never-fails', 'malloc-fail-budget=',
+                                    'pta=', 'no-link=', 'argv=', 'symbolic-argv=', 'no-instrument',
                                     'cflags=', 'cppflags=', 'link=', 'executable-witness',
                                     'verifier=','target=', 'require-slicer',
-                                    'no-link-undefined', 'repeat-slicing=',
+                                    'no-link-undefined', 'repeat-slicing=', 'tiny-task=',
                                     'slicer-params=', 'slicer-cmd=', 'verifier-params=',
-                                    'explicit-symbolic', 'undefined-retval-nosym',
+                                    'explicit-symbolic', 'lazy-uninitialized=', 'undefined-retval-nosym',
                                     'save-files', 'version-short', 'no-witness',
                                     'witness-with-source-lines', 'exit-on-error',
                                     'undefined-are-pure',
                                     'no-integrity-check', 'dump-env', 'dump-env-cmd',
                                     'memsafety-config-file=', 'overflow-config-file=',
                                     'statistics', 'working-dir-prefix=', 'sv-comp', 'test-comp',
-                                    'overflow-with-clang', 'gen-ll', 'gen-c', 'test-suite=',
+                                    'overflow-with-clang', 'gen-ll', 'save-ll=', 'gen-c', 'test-suite=', 'test-suite-zip=',
                                     'search-include-paths', 'replay-error', 'cc',
                                     'report=', 'no-replay-error',
                                     'unroll=', 'full-instrumentation', 'target-settings=',
-                                    'witness-check='])
+                                    'witness-check=', 'no-pipeline', 'new-pm', 'cache-dir=',
+                                    'no-cache', 'pass-report=', 'trace=', 'features=', 'stage-memlimit=', 'growth-budget=',
+                                    'profile-verification=',
+                                    'incremental', 'incremental-verification', 'resume=',
+                                    'coalesce-nondet',
+                                    'string-models=', 'numeric-models=',
+                                    'symbolic-input-buffers', 'max-input-length=',
+                                    'parallel-verifiers', 'result-cache',
+                                    'query-cache', 'query-cache-size=', 'adaptive-verifiers',
+                                    'split-input=', 'remote-workers=',
+                                    'merge-hints', 'points-to-hints', 'target-distance', 'tmpfs=', 'klee-profiles=',
+                                    'concrete-prefix', 'lower-ctype', 'memcleanup-by-scan', 'both-data-models',
+                                    'gen-c-changed'])
                                    # add klee-params
     except getopt.GetoptError as e:
         err('{0}'.format(str(e)))
 
+    options.cmdline = opts
     for opt, arg in opts:
         if opt == '--help':
             print(usage_msg)
@@ -262,6 +405,8 @@ def parse_command_line():
             options.report_type=arg.split(',')
         elif opt == '--gen-ll':
             options.generate_ll = True
+        elif opt == '--save-ll':
+            options.save_ll_stages += arg.split(',')
         elif opt == '--gen-c':
             options.generate_c = True
         elif opt == '--cc':
@@ -274,6 +419,16 @@ def parse_command_line():
             sys.exit(0)
         elif opt == '--argv':
             options.argv = arg.split(',')
+        elif opt == '--symbolic-argv':
+            try:
+                parts = [int(x) for x in arg.split(',')]
+                if len(parts) == 1:
+                    parts.append(8)
+                if len(parts) != 2 or not 0 < parts[0] <= 255 or parts[1] <= 0:
+                    raise ValueError(arg)
+                options.symbolic_argv = tuple(parts)
+            except ValueError:
+                err('Invalid argument for --symbolic-argv')
         elif opt == '--version':
             print_versions()
             sys.exit(0)
@@ -290,6 +445,8 @@ def parse_command_line():
             options.executable_witness = True
         elif opt == '--explicit-symbolic':
             options.explicit_symbolic = True
+        elif opt == '--lazy-uninitialized':
+            options.lazy_uninitialized = int(arg)
         elif opt == '--undefined-retval-nosym':
             options.undef_retval_nosym = True
         elif opt == '--no-link-undefined':
@@ -298,9 +455,28 @@ def parse_command_line():
         elif opt == '--no-link':
             for x in arg.split(','):
                 _remove_linkundef(options, x)
+        elif opt == '--string-models':
+            if arg not in ('default', 'select'):
+                err('Unknown string models: {0}'.format(arg))
+            options.string_models = arg
+        elif opt == '--numeric-models':
+            if arg not in ('exact', 'summary'):
+                err('Unknown numeric models: {0}'.format(arg))
+            options.numeric_models = arg
+        elif opt == '--symbolic-input-buffers':
+            options.symbolic_input_buffers = True
+        elif opt == '--max-input-length':
+            options.max_input_length = int(arg)
         elif opt == '--malloc-never-fails':
             dbg('Assuming malloc and calloc will never fail')
             options.malloc_never_fails = True
+        elif opt == '--malloc-fail-budget':
+            options.malloc_fail_budget = int(arg)
+            if options.malloc_fail_budget < 0:
+                err('Invalid argument for --malloc-fail-budget')
+            # no allocation fails, no forking at all
+            if options.malloc_fail_budget == 0:
+                options.malloc_never_fails = True
         elif opt == '--undefined-are-pure':
             dbg('Assuming that undefined functions are pure')
             options.undefined_are_pure = True
@@ -333,12 +509,27 @@ def parse_command_line():
                     options.no_optimize = True
                     options.optlevel = []
                     break
+        elif opt == '--split-optimize':
+            try:
+                options.split_optimize = int(arg)
+            except ValueError:
+                err('Invalid argument for --split-optimize')
+        elif opt == '--in-process-tools':
+            options.in_process_tools = True
+        elif opt == '--opt-pipelines':
+            options.opt_pipelines = arg if arg == 'default' else abspath(arg)
         elif opt == '--prp':
             if arg == 'valid-free' or arg == 'valid-deref' or arg == 'valid-memtrack':
                 print("WARNING: Separated memsafety properties are not supported "\
                       "at this moment setting the property to \'memsafety\'")
                 arg = "memsafety"
-            if options.propertystr is not None:
+            if arg == 'valid-memcleanup':
+                arg = "memcleanup"
+            # memsafety and memcleanup are checked together in one run
+            if {options.propertystr, arg} == {'memcleanup', 'memsafety'}:
+                arg = "memsafety-memcleanup"
+            elif options.propertystr is not None and\
+                 options.propertystr != arg:
                 print("WARNING: only one property is supported at the moment, "\
                       "Symbiotic will use the last one specified")
             options.propertystr = arg
@@ -354,6 +545,11 @@ def parse_command_line():
             except ValueError:
                 err('Invalid argument for --repeat-slicing')
             dbg('Will repeat slicing {0} times'.format(arg))
+        elif opt == '--tiny-task':
+            try:
+                options.tiny_task = int(arg)
+            except ValueError:
+                err('Invalid argument for --tiny-task')
         elif opt == '--timeout':
             try:
                 options.timeout = int(arg)
@@ -417,6 +613,89 @@ def parse_command_line():
             options.exit_on_error = True
         elif opt == '--statistics':
             options.stats = True
+        elif opt == '--cache-dir':
+            options.cache_dir = abspath(expanduser(arg))
+        elif opt == '--no-cache':
+            options.cache_dir = None
+        elif opt == '--pass-report':
+            options.pass_report = abspath(arg)
+        elif opt == '--trace':
+            options.trace = abspath(arg)
+            enable_trace(options.trace)
+        elif opt == '--profile-verification':
+            options.profile_verification = abspath(arg)
+        elif opt == '--stage-memlimit':
+            try:
+                options.stage_memlimit = max(0, int(arg)) * 1024 * 1024 or None
+            except ValueError:
+                err('Invalid argument for --stage-memlimit')
+        elif opt == '--growth-budget':
+            try:
+                options.growth_budget = max(0.0, float(arg))
+            except ValueError:
+                err('Invalid argument for --growth-budget')
+        elif opt == '--features':
+            options.features = abspath(arg)
+        elif opt == '--klee-profiles':
+            options.klee_profiles = arg if arg == 'default' else abspath(arg)
+        elif opt == '--incremental':
+            options.incremental = True
+        elif opt == '--incremental-verification':
+            options.incremental_verification = True
+        elif opt == '--resume':
+            options.resume = abspath(expanduser(arg))
+        elif opt == '--coalesce-nondet':
+            options.coalesce_nondet = True
+        elif opt == '--result-cache':
+            options.result_cache = True
+        elif opt == '--query-cache':
+            options.query_cache = True
+        elif opt == '--adaptive-verifiers':
+            options.adaptive_verifiers = True
+        elif opt == '--query-cache-size':
+            try:
+                options.query_cache_size = int(arg) * 1024 * 1024
+            except ValueError:
+                err('Invalid argument for --query-cache-size')
+        elif opt == '--parallel-verifiers':
+            options.parallel_verifiers = True
+        elif opt == '--tmpfs':
+            try:
+                options.tmpfs_cap = int(arg)
+            except ValueError:
+                err('Invalid size for --tmpfs: {0}'.format(arg))
+        elif opt == '--merge-hints':
+            options.merge_hints = True
+        elif opt == '--points-to-hints':
+            options.points_to_hints = True
+        elif opt == '--target-distance':
+            options.target_distance = True
+        elif opt == '--concrete-prefix':
+            options.concrete_prefix = True
+        elif opt == '--lower-ctype':
+            options.lower_ctype = True
+        elif opt == '--memcleanup-by-scan':
+            options.memcleanup_by_scan = True
+        elif opt == '--both-data-models':
+            options.both_data_models = True
+        elif opt == '--gen-c-changed':
+            options.generate_c = True
+            options.generate_c_changed = True
+        elif opt == '--remote-workers':
+            options.remote_workers += [h for h in arg.split(',') if h]
+        elif opt == '--split-input':
+            try:
+                options.split_input = int(arg)
+            except ValueError:
+                err('Invalid number of bits for --split-input: {0}'.format(arg))
+            if not 0 <= options.split_input <= 10:
+                err('--split-input takes the number of bits '
+                    'between 0 and 10, got {0}'.format(arg))
+        elif opt == '--no-pipeline':
+            dbg('Will run passes in opt instead of sbt-pipeline')
+            options.pipeline_driver = False
+        elif opt == '--new-pm':
+            options.new_pm = True
         elif opt == '--memsafety-config-file':
             options.memsafety_config_file = arg
         elif opt == '--overflow-config-file':
@@ -440,10 +719,44 @@ def parse_command_line():
             options.full_instrumentation = True
         elif opt == '--test-suite':
             options.testsuite_output = abspath(arg)
+        elif opt == '--test-suite-zip':
+            options.testsuite_zip = abspath(arg)
+
+    # the alternative models of string functions take precedence over libc
+    if options.string_models == 'select' and 'libc' in options.linkundef:
+        options.linkundef.insert(options.linkundef.index('libc'), 'strings')
+    if options.numeric_models == 'summary' and 'libc' in options.linkundef:
+        options.linkundef.insert(options.linkundef.index('libc'), 'numbers')
+    # the models of input functions are spread in verifier and libc
+    if options.symbolic_input_buffers:
+        options.linkundef.insert(0, 'input')
 
     # check conflicts
     if options.require_slicer and options.noslice:
         err("Slicing is forbidden but required at the same time")
+    if options.incremental and options.cache_dir is None:
+        err("--incremental needs a cache, use --cache-dir")
+    if options.symbolic_argv and options.argv:
+        err('--symbolic-argv and --argv cannot be used together')
+
+    if options.incremental_verification and options.cache_dir is None:
+        err("--incremental-verification needs a cache, use --cache-dir")
+    if options.coalesce_nondet and options.replay_error:
+        # the tests of the coalesced program do not fit the unsliced one
+        dbg('Not replaying errors, the nondet values are coalesced')
+        options.replay_error = False
+    if options.result_cache and options.cache_dir is None:
+        err("--result-cache needs a cache, use --cache-dir")
+    if options.query_cache and options.cache_dir is None:
+        err("--query-cache needs a cache, use --cache-dir")
+    if options.adaptive_verifiers and options.cache_dir is None:
+        err("--adaptive-verifiers needs a cache, use --cache-dir")
+    if options.split_input and options.parallel_verifiers:
+        err("--split-input cannot be used with --parallel-verifiers")
+    if options.split_input and options.test_comp:
+        err("--split-input cannot be used with --test-comp")
+    if options.remote_workers and options.test_comp:
+        err("--remote-workers cannot be used with --test-comp")
 
     return options, args
 
@@ -458,7 +771,10 @@ where OPTS can be following:
     --bc                         Given files are LLVM bitcode (force this assumption)
     --32                         Use 32-bit environment
     --64                         Use 64-bit environment (the default)
-    --timeout=t                  Set timeout to t seconds
+    --timeout=t                  Set timeout to t seconds. Instrumentation and slicing
+                                 then get at most a part of the time (25-50% depending
+                                 on the size of the program), the rest is left for
+                                 the verifiers
     --instrumentation-timeout=t  Set timeout for instrumentation (if instrumentation
                                  timeouts, the original bitcode is used and slicing
                                  is skipped)
@@ -470,9 +786,16 @@ where OPTS can be following:
                                  Skink and SMACK.
     --explicit-symbolic          Do not make all memory symbolic,
                                  but rely on calls to __VERIFIER_nondet_*
+    --lazy-uninitialized=BYTES   Make uninitialized arrays on stack and allocations
+                                 of at least BYTES bytes symbolic by chunks, when a chunk
+                                 is accessed for the first time, and do not make
+                                 so big calloc'd memory symbolic at all (saves memory
+                                 in KLEE)
     --undefined-retval-nosym     Do not make return value of undefined functions symbolic,
                                  but replace it with 0.
     --malloc-never-fails         Suppose malloc and calloc never return NULL
+    --malloc-fail-budget=K       Suppose that at most K calls of malloc and calloc
+                                 return NULL on a path (0 = --malloc-never-fails)
     --undefined-are-pure         Suppose that undefined functions have no side-effects
     --no-verification            Do not run verification phase (handy for debugging)
     --optimize=opt1,...          Run optimizations, every item in the optimizations list
@@ -482,16 +805,35 @@ where OPTS can be following:
                                  disables optimizations (same as --no-optimize).
                                  You can also pass optimizations directly to LLVM's opt,
                                  by providing a string when-opt-what, e.g. before-opt-iconstprop
+    --split-optimize=N           Split the module into N partitions (functions that share
+                                 internal symbols stay together) and optimize them in
+                                 parallel, the global optimizations run once on the linked
+                                 module (for huge generated or amalgamated programs)
+    --opt-pipelines=TABLE        Use the optimizations tuned for the target and the version
+                                 of LLVM from TABLE instead of --optimize and do not run
+                                 the passes that the table marks as harmful (JSON,
+                                 'default' is lib/opt-pipelines.json)
+    --in-process-tools           Run the instrumentation and the slicer in sbt-pipeline
+                                 on the loaded module if their libraries (e.g.,
+                                 libsbt-slicer-stage.so) are installed and the stages
+                                 have no timeouts. A failure of the tools is fatal then
+                                 (there is no file to fall back to)
     --no-optimize                Don't optimize the code (same as --optimize=none)
     --no-instrument              Don't instrument the code, for debugging.
     --libc=klee                  Link klee-libc.bc to the module
     --repeat-slicing=N           Repeat slicing N times
+    --tiny-task=N                Do not slice nor optimize programs that have less than N
+                                 instructions after compilation (and do not print
+                                 statistics for them), go straight to verification
     --prp=property               Specify property that should hold. It is either LTL formula
                                  as specivied by SV-COMP, or one of following shortcuts:
                                    null-deref         -- program is free of null-dereferences
                                    memsafety          -- program does not use invalid memory
                                                          (e.g., no double-free,
                                                           no invalid dereference, etc.)
+                                   memsafety-memcleanup -- memsafety and all memory freed,
+                                                         checked in one run (also
+                                                         --prp=memsafety --prp=memcleanup)
                                    undefined-behavior -- check for undefined behaviour
                                    undef-behavior
                                    undefined
@@ -517,13 +859,20 @@ where OPTS can be following:
                                  --debug= to print basic messages.
     --report=STR                 A comma-separated list of {normal, short, sv-comp}
                                  that affects how symbiotic-verify reports the results.
-    --gen-ll                     Generate also .ll files (for debugging)
+    --gen-ll                     Generate also .ll file of the final code (for debugging)
+    --save-ll=STAGE[,...]        Generate .ll files also after the given stages
+                                 (compile, link, link-models, instrumentation,
+                                 slicing, optimize, names of run_opt() stages
+                                 like prepare, or all)
     --output=FILE                Store the final code (that is to be run by a tool) to FILE
     --witness=FILE               Store witness into FILE (default is witness.graphml)
     --cflags=flags
     --cppflags=flags             Append extra CFLAGS and CPPFLAGS to use while compiling,
                                  the environment CFLAGS and CPPFLAGS are used too
     --argv=args                  A comma-separated list of arguments for the main function
+    --symbolic-argv=N[,LEN]      Call main with at most N (up to 255) symbolic arguments
+                                 of at most LEN characters (default 8), all of them
+                                 in one symbolic object of KLEE
     --slicer-params=STR          Pass parameters directly to slicer
     --slicer-cmd=STR             Command to run slicer, default: sbt-slicer
     --verifier-params=STR        Pass parameters directly to the verifier
@@ -532,6 +881,19 @@ where OPTS can be following:
     --no-link                    Do not link missing functions from the given category
                                  (libc, svcomp, verifier, posix, kernel). The argument
                                  is a comma-separated list of values.
+    --string-models=MODELS       Models of string functions (memcmp, strcmp, strncmp):
+                                 'default' or 'select' that computes the results
+                                 without branching where possible, so that
+                                 the symbolic executor forks less paths
+    --numeric-models=MODELS      Models of the functions that parse numbers (atoi, atol,
+                                 strtol, strtoul, strtoll, strtoull, strtod): 'exact'
+                                 or 'summary' that return a nondeterministic number
+                                 and parse either nothing or the whole string, for
+                                 the programs that do not depend on the exact value
+    --symbolic-input-buffers     Make the string read by fgets one symbolic object
+                                 instead of a symbolic object for every character
+    --max-input-length=N         The models of input functions (fgets) read
+                                 at most N characters at once
     --exit-on-error              Exit after the first error is found.
                                  but continue searching
     --help                       Show help message
@@ -540,14 +902,115 @@ where OPTS can be following:
     --no-integrity-check         Does not run integrity check. For development only.
     --dump-env                   Only dump environment variables (for debugging)
     --dump-env-cmd               Dump environment variables for using them in command line
-    --statistics                 Dump statistics about bitcode
+    --statistics                 Dump statistics about bitcode and the resources
+                                 (time, memory) used by the executed tools
+    --cache-dir=DIR              Cache compiled function models and instrumentation
+                                 definitions in DIR and reuse them in the next runs
+                                 (default is $SYMBIOTIC_CACHE_DIR if set)
+    --no-cache                   Do not use the cache of compiled bitcode
+    --pass-report=FILE           Store wall time, peak memory change and the number of
+                                 visited/added/removed instructions of every pass
+                                 run by sbt-pipeline into FILE (JSON)
+    --trace=FILE                 Store the timeline of the run (the phases, every process
+                                 and every pass of sbt-pipeline) into FILE in the
+                                 trace-event format of Chrome (chrome://tracing, Perfetto)
+    --profile-verification=FILE  Collect the statistics of instructions from KLEE, map them
+                                 to the source, print the hot loops and the lines with
+                                 the most solver time and store them into FILE (JSON)
+    --stage-memlimit=MB          Limit the memory of every run of opt and sbt-pipeline
+                                 to MB megabytes. A stage that runs out of memory
+                                 is skipped (or run without the optional passes)
+                                 if the program is correct without it
+    --growth-budget=FACTOR       Roll back the optional stages of sbt-pipeline (inlining,
+                                 unrolling, ...) that multiply the number of instructions
+                                 by more than FACTOR, stop if the instrumentation does
+                                 (default 10, 0 = no budget)
+    --features=FILE              Store the features of the compiled program (counts
+                                 of instructions, memory operations, thread calls,
+                                 loops) into FILE (JSON) and use them to choose
+                                 the verifiers
+    --klee-profiles=TABLE        Choose the search heuristics and the limits of KLEE
+                                 by the features of the program from the profiles
+                                 in TABLE (JSON, 'default' is lib/klee-profiles.json)
+    --incremental                If the compiled program, the options and Symbiotic
+                                 did not change since a previous run, reuse the
+                                 transformed program from the cache (see --cache-dir).
+                                 The options only of the verifier (--verifier-params,
+                                 --timeout, ...) are not a part of the key
+    --incremental-verification   Store the sliced program of the task with its verdict
+                                 in the cache (see --cache-dir). If a new version of
+                                 the program (the same sources and options) changes
+                                 only the code outside the slice, reuse the verdict
+    --resume=DIR                 Write a checkpoint into DIR after compilation,
+                                 instrumentation, slicing and post-processing and
+                                 continue from the last valid checkpoint there
+                                 (of the same sources, options and versions),
+                                 e.g., when the previous run was killed
+    --coalesce-nondet            Create the values of the __VERIFIER_nondet_* calls
+                                 that follow each other in a block in one symbolic
+                                 object in KLEE (the tests and witnesses are split
+                                 back into the values of the calls). Errors are
+                                 not replayed on the unsliced program then
+    --result-cache               If the same preprocessed program was verified with
+                                 the same property, options and versions of Symbiotic
+                                 and the tools, report the verdict (and the witness)
+                                 stored in the cache (see --cache-dir)
+    --query-cache                Share the solved queries of KLEE between the runs
+                                 on the same bitcode (e.g., the members of a portfolio)
+                                 in the cache (see --cache-dir)
+    --query-cache-size=MB        Prune the least recently used queries when the cache
+                                 of queries exceeds MB megabytes (default 1024)
+    --adaptive-verifiers         Run first the verifiers that answered the most often
+                                 (and the fastest) for the programs with similar features,
+                                 the outcomes are kept in the cache (see --cache-dir)
+    --no-pipeline                Run every stage of passes in a separate opt process
+                                 instead of batching them in sbt-pipeline
+    --new-pm                     Run the passes of opt in the new pass manager
+                                 (LLVM 13+) instead of the legacy one
+    --parallel-verifiers         Run the verifiers of the tool in parallel (splitting
+                                 the CPUs between them), the first true/false answer wins
+    --split-input=N              Split the inputs of the program into 2^N cubes by the lowest
+                                 N bits of the first nondet values in main and verify the cubes
+                                 in parallel, any false answer wins, true needs all cubes true
+                                 (meant for KLEE, which stores its output next to the bitcode)
+    --merge-hints                Let KLEE merge the states forked in simple loop bodies
+                                 and if-then-else regions without calls
+    --points-to-hints            Annotate the loads and stores with the allocation sites
+                                 that they may access, so that KLEE can resolve symbolic
+                                 pointers only among these objects
+    --target-distance            Annotate the blocks with the distance to the nearest
+                                 error call (or test target) for a directed search in KLEE
+    --concrete-prefix            Execute the code of main before the first input (building tables,
+                                 parsing constant data, ...) concretely and let KLEE start from
+                                 the state after it (the globals get new initializers)
+    --lower-ctype                Replace the classifications of characters (isdigit, isspace,
+                                 ... from the table of __ctype_b_loc) by comparisons with
+                                 the ranges of the characters, cheaper for the solver
+    --memcleanup-by-scan         Check memcleanup by the walk of KLEE over the objects
+                                 at the end of every path, not by counting the allocations
+    --both-data-models           Verify the program in the 32-bit and in the 64-bit environment
+                                 in parallel and report both results (the witnesses get
+                                 the suffixes -32 and -64, the runs share the cache of
+                                 compiled files)
+    --gen-c-changed              Like --gen-c, but translate back to C only the functions
+                                 that differ from the unsliced code, one per job in parallel
+    --remote-workers=H1,H2,...   Run the verifiers on these hosts over ssh (the name of a host
+                                 can be repeated to run more jobs on it), the bitcode is prepared
+                                 here and copied to the hosts with the same installation
+                                 of Symbiotic, the output of the verifiers is copied back
     --working-dir-prefix         Where to create the temporary directory (defaults to /tmp)
+    --tmpfs=CAP                  Create the temporary directory in a tmpfs (/dev/shm), if its files
+                                 take more than CAP MB (0 = no limit), move the oldest of them
+                                 to the disk (under --working-dir-prefix)
     --replay-error               Try replaying a found error on non-sliced code
     --no-replay-error            Do not replay a found error on non-sliced code (overrides --sv-comp)
     --search-include-paths       Try automatically finding paths with standard include directories
     --sv-comp                    Shortcut for SV-COMP settings (malloc-never-fails, etc.)
     --test-comp                  Shortcut for TEST-COMP settings
     --test-suite                 Output for tests if --test-comp options is on
+    --test-suite-zip=FILE        Pack the tests from --test-suite into the zip archive FILE
+                                 (from the test pack tests.pack in the output of KLEE,
+                                 or from the .ktest files if there is no pack)
     --full-instrumentation       Tranform checking errors to reachability problem, i.e.
                                  instrument tracking of the state of the program directly
                                  into the program.
@@ -0,0 +1,80 @@
+"""
+Optimization pipelines tuned on benchmarks (--opt-pipelines).
+The table is a JSON file (lib/opt-pipelines.json by default) with
+the best pipelines (the optimizations before and after slicing) for
+a target and a major version of LLVM, and with the passes that hurt
+the verifiers (they are removed from all optimizations).
+The table is generated by tests/pipelines.py.
+"""
+
+import json
+import os
+
+from . utils import dbg
+from . utils.utils import get_symbiotic_dir
+
+VERSION = 1
+
+# the loaded tables, the keys are the paths
+_tables = {}
+
+
+def table_path(table):
+    if table == 'default':
+        return os.path.join(get_symbiotic_dir(), 'lib', 'opt-pipelines.json')
+    return table
+
+
+def llvm_major(llvm_version):
+    return str(llvm_version).split('.')[0]
+
+
+def load_table(table):
+    """
+    Return the table (a path or 'default') as a dictionary,
+    an empty table if it cannot be loaded
+    """
+    path = table_path(table)
+    if path in _tables:
+        return _tables[path]
+
+    data = {}
+    try:
+        with open(path, 'r') as f:
+            data = json.load(f)
+        if data.get('version') != VERSION:
+            dbg('Unknown version of the optimization pipelines in {0}'.format(path))
+            data = {}
+    except (IOError, OSError, ValueError) as e:
+        dbg('Failed loading the optimization pipelines: {0}'.format(str(e)))
+
+    _tables[path] = data
+    return data
+
+
+def find_pipeline(data, target, llvm_version):
+    """ The entry of the table for the target and LLVM (or None) """
+    major = llvm_major(llvm_version)
+    for p in data.get('pipelines', []):
+        if p.get('target') == target and str(p.get('llvm')) == major:
+            return p
+    return None
+
+
+def get_pipeline(table, target, llvm_version):
+    """
+    The tuned pipeline for the target and the version of LLVM,
+    a dictionary with the lists of passes 'before' and 'after'
+    slicing, None if there is none
+    """
+    return find_pipeline(load_table(table), target, llvm_version)
+
+
+def get_harmful(table, target, llvm_version):
+    """ The passes that should not be run for the target """
+    data = load_table(table)
+    harmful = list(data.get('harmful', []))
+    p = find_pipeline(data, target, llvm_version)
+    if p:
+        harmful += [h for h in p.get('harmful', []) if h not in harmful]
+    return harmful
@@ -93,6 +93,22 @@ class PropertyMemCleanup(Property):
         return "unfreed memory"
 
 
+class PropertyMemSafetyCleanup(PropertyMemSafety):
+    """
+    The memory safety and the cleanup of memory checked in one run:
+    the program is instrumented for memory safety and the verifier
+    attributes every error to its sub-property
+    """
+    def __init__(self, prpfile = None):
+        PropertyMemSafety.__init__(self, prpfile)
+
+    def memcleanup(self):
+        return True
+
+    def help(self):
+        return "invalid dereferences, invalid free, memory leaks and unfreed memory"
+
+
 class PropertyNoOverflow(Property):
     def __init__(self, prpfile = None):
         Property.__init__(self, prpfile)
@@ -237,6 +253,7 @@ supported_properties = {
     'no-overflow'                                              : PropertyNoOverflow,
     'memsafety'                                                : PropertyMemSafety,
     'memcleanup'                                               : PropertyMemCleanup,
+    'memsafety-memcleanup'                                     : PropertyMemSafetyCleanup,
     'termination'                                              : PropertyTermination,
     'coverage'                                                 : PropertyCoverStmts,
     'cover-branches'                                           : PropertyCoverBranches,
@@ -370,15 +387,31 @@ def _assign_default_prpfile(p, symbiotic_dir):
 
 def _merge_memsafety_prop(properties):
     memsafety = None
+    memcleanup = None
     props = []
     for p in properties:
         if p.memsafety():
             if not memsafety:
                 memsafety = p
                 props.append(p)
+            elif p.memcleanup() and not memsafety.memcleanup():
+                props[props.index(memsafety)] = p
+                memsafety = p
+        elif p.memcleanup():
+            memcleanup = p
         else:
             props.append(p)
 
+    if memcleanup:
+        if memsafety is None:
+            props.append(memcleanup)
+        elif not memsafety.memcleanup():
+            # check them in one run
+            merged = PropertyMemSafetyCleanup(memsafety.getPrpFile())
+            merged._ltl = memsafety._ltl +\
+                          [l for l in memcleanup._ltl if l not in memsafety._ltl]
+            props[props.index(memsafety)] = merged
+
     return props
 
 def get_property(symbiotic_dir, prp):
@@ -404,8 +437,12 @@ def get_property(symbiotic_dir, prp):
             _assign_default_prpfile(p, symbiotic_dir)
         if not p._ltl:
             p._ltl, _ = _parse_prp(p.getPrpFile())
+            if p.memsafety() and p.memcleanup():
+                cleanup, _ = _parse_prp(join(symbiotic_dir, 'properties',
+                                             'valid-memcleanup.prp'))
+                p._ltl += cleanup
 
-    # FOR NOW squeeze all memsafety properties into one
+    # FOR NOW squeeze all memsafety properties (and the memcleanup) into one
     properties = _merge_memsafety_prop(set(properties))
     assert len(properties) == 1, "Multiple properties unsupported at this moment"
     return properties[0]
@@ -4,6 +4,7 @@ import os
 
 from . utils import err, dbg
 from . utils.utils import print_stdout, print_stderr, get_symbiotic_dir
+from . utils.workdir import find_tmpfs, set_working_dir, cleanup_working_dir
 from . environment import Environment
 from . verifier import initialize_verifier
 from . property import get_property
@@ -28,6 +29,10 @@ def rm_tmp_dir(d):
     from shutil import rmtree
     rmtree(d, onerror=on_rm_error)
 
+# the components that were already checked by this process
+# (symbiotic-server checks them once for all the tasks)
+_checked_components = set()
+
 class SetupSymbiotic:
     """
     Setup and check environment for Symbiotic to run
@@ -61,7 +66,16 @@ class SetupSymbiotic:
                 dbg('Found no {0} dir, falling-back to curdir: {1}'.format(self.opts.working_dir_prefix, os.getcwd()))
                 prefix = 'symbiotic-'
 
-            tmpdir = mkdtemp(prefix=prefix, dir='.')
+            tmpfs = find_tmpfs() if self.opts.tmpfs_cap is not None else None
+            if tmpfs:
+                tmpdir = mkdtemp(prefix='symbiotic-', dir=tmpfs)
+                # the files that do not fit into the cap go to the disk
+                set_working_dir(tmpdir, self.opts.tmpfs_cap * 1024 * 1024,
+                                os.path.abspath(prefix) + 'spill-')
+            else:
+                if self.opts.tmpfs_cap is not None:
+                    dbg('Found no writable tmpfs, using the disk')
+                tmpdir = mkdtemp(prefix=prefix, dir='.')
 
         return tmpdir
 
@@ -90,6 +104,11 @@ class SetupSymbiotic:
                 dbg("'{0}' is '{1}'".format(os.path.basename(exe), exe_path))
 
     def _check_components(self, opts, additional_bins = []):
+        key = (opts.tool_name, opts.no_integrity_check, tuple(additional_bins))
+        if key in _checked_components:
+            dbg('The components were already checked')
+            return
+
         # check availability of binaries and libraries
         self._perform_binaries_check(additional_bins)
         self._perform_libraries_check()
@@ -101,12 +120,14 @@ class SetupSymbiotic:
 
             try:
                 _, versions, _, _= get_versions()
-                checker = IntegrityChecker(versions)
+                checker = IntegrityChecker(versions, self.opts.cache_dir)
                 checker.check(opts.tool_name);
             except SymbioticException as e:
                 err('{0}\nIf you are aware of this, you may use --no-integrity-check '\
                     'to suppress this error'.format(str(e)))
 
+        _checked_components.add(key)
+
     def setup(self):
         self.environment = Environment(get_symbiotic_dir())
         dbg('Symbiotic dir: {0}'.format(self.environment.symbiotic_dir))
@@ -145,4 +166,5 @@ class SetupSymbiotic:
         assert self.environment.symbiotic_dir != self.environment.working_dir
         if not self.opts.save_files:
             rm_tmp_dir(self.environment.working_dir)
+            cleanup_working_dir()
 
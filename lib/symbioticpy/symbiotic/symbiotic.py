@@ -10,7 +10,9 @@ from . options import SymbioticOptions
 from . utils import err, dbg, print_elapsed_time, restart_counting_time
 from . utils.utils import print_stdout
 from . utils.process import ProcessRunner
-from . exceptions import SymbioticExceptionalResult
+from . utils.cache import ResultCache, SliceCache, changed_functions
+from . utils import metrics
+from . exceptions import SymbioticException, SymbioticExceptionalResult
 
 class Symbiotic(object):
     """
@@ -77,14 +79,101 @@ class Symbiotic(object):
 
         return res
 
+    def _cached_result(self, key):
+        witness = None if self.options.nowitness else self.options.witness_output
+        res = ResultCache(self.options.cache_dir).get(key, witness)
+        if res is not None:
+            print_stdout('INFO: Using the result from the cache', color='WHITE')
+        return res
+
+    def _cache_result(self, key, res):
+        # store only the verdicts, not errors, unknowns, etc.
+        if not (res.startswith('true') or res.startswith('false')):
+            return
+        witness = None if self.options.nowitness else self.options.witness_output
+        ResultCache(self.options.cache_dir).put(key, res, witness)
+
+    def _reused_verdict(self, key, hashes):
+        """
+        Return the verdict of the previous version of the task if its
+        sliced program is the same (the changes are outside of the slice),
+        None otherwise
+        """
+        cache = SliceCache(self.options.cache_dir)
+        entry = cache.get(key)
+        if entry is None:
+            return None
+        oldhashes, res = entry
+        if oldhashes != hashes:
+            changed = changed_functions(oldhashes, hashes)
+            print_stdout('INFO: The slice changed in: {0}'.format(', '.join(changed)),
+                         color='WHITE')
+            return None
+        if not self.options.nowitness and\
+           not cache.get_witness(key, self.options.witness_output):
+            return None
+        print_stdout('INFO: The slice did not change, reusing the verdict',
+                     color='WHITE')
+        return res
+
+    def _cache_slice(self, key, hashes, res, bitcode):
+        # store only the verdicts, not errors, unknowns, etc.
+        if not (res.startswith('true') or res.startswith('false')):
+            return
+        witness = None if self.options.nowitness else self.options.witness_output
+        SliceCache(self.options.cache_dir).put(key, hashes, res, bitcode, witness)
+
     def _run_symbiotic(self):
         options = self.options
         cc = SymbioticCC(self.sources, self._tool, options, self.env)
-        bitcode = cc.run()
+
+        reskey = cc.get_result_key()
+        if reskey:
+            res = self._cached_result(reskey)
+            if res is not None:
+                return res
+
+        res = self._verify(cc)
+        if reskey and res:
+            self._cache_result(reskey, res)
+        return res
+
+    def _verify(self, cc):
+        options = self.options
+        try:
+            bitcode = cc.run()
+        except SymbioticExceptionalResult as res:
+            # the preprocessing decided the result (e.g., no error site
+            # can be reached), only a correctness witness can be generated
+            # without running the verifier
+            res = str(res)
+            if res == 'true' and not options.nowitness and\
+               hasattr(self._tool, "generate_witness"):
+                try:
+                    self._tool.generate_witness(cc.curfile or '',
+                                                self.sources, False)
+                except (OSError, SymbioticException) as e:
+                    # the tool may need its own outputs for the witness
+                    dbg('Failed generating the witness: {0}'.format(str(e)))
+            return res
 
         if options.no_verification:
             return 'No verification'
 
+        slicekey = cc.get_slice_key()
+        hashes = cc.get_slice_hashes() if slicekey else None
+        if hashes is not None:
+            res = self._reused_verdict(slicekey, hashes)
+            if res is not None:
+                return res
+
+        res = self._verify_sliced(cc, bitcode)
+        if hashes is not None and res:
+            self._cache_slice(slicekey, hashes, res, bitcode)
+        return res
+
+    def _verify_sliced(self, cc, bitcode):
+        options = self.options
         verifier = SymbioticVerifier(bitcode, self.sources,
                                      self._tool, options, self.env)
         # result and the tool that decided this result
@@ -146,6 +235,9 @@ class Symbiotic(object):
         if has_error and hasattr(tool, "describe_error"):
             tool.describe_error(cc.curfile)
 
+        if options.profile_verification and hasattr(tool, "describe_profile"):
+            tool.describe_profile(cc.curfile)
+
         if has_error and options.executable_witness and\
            hasattr(tool, "generate_exec_witness"):
             tool.generate_exec_witness(cc.curfile, self.sources)
@@ -153,11 +245,18 @@ class Symbiotic(object):
         if not options.nowitness and hasattr(tool, "generate_witness"):
             tool.generate_witness(cc.curfile, self.sources, has_error)
 
+        if options.test_comp and options.testsuite_zip and\
+           hasattr(tool, "generate_testsuite_zip"):
+            tool.generate_testsuite_zip(self.sources)
+
+        metrics.set_result(res, tool.name() if tool else None)
         return res
 
     def run(self):
         try:
-            return self._run_symbiotic()
+            res = self._run_symbiotic()
+            metrics.set_result(res)
+            return res
         except KeyboardInterrupt:
             self.terminate()
             self.kill()
@@ -1,55 +1,68 @@
-from . klee import SymbioticTool as KleeTool
-from . witchklee import SymbioticTool as WitchKleeTool
-from . ceagle import SymbioticTool as CeagleTool
-from . cbmc import SymbioticTool as CbmcTool
-from . cbmcsvcomp import SymbioticTool as CbmcSVCOMPTool
-from . esbmc import SymbioticTool as EsbmcTool
-from . ikos import SymbioticTool as IkosTool
-from . map2check import SymbioticTool as Map2CheckTool
-from . cpachecker import SymbioticTool as CpaTool
-from . skink import SymbioticTool as SkinkTool
-from . smack import SymbioticTool as SmackTool
-from . seahorn import SymbioticTool as SeahornTool
-from . nidhugg import SymbioticTool as NidhuggTool
-from . divine import SymbioticTool as DivineTool
-from . divinesvc import SymbioticTool as DivineSvcompTool
-from . ultimateautomizer import SymbioticTool as UltimateTool
-from . svcomp import SymbioticTool as SVCompTool
-from . testcomp import SymbioticTool as TestCompTool
-from . slowbeast import SymbioticTool as SlowbeastTool
-from . predatorhp import SymbioticTool as PredatorHPTool
-from . predator import SymbioticTool as PredatorTool
-from . twols import SymbioticTool as TwolsTool
-from . cc import CCTarget
-
-targets = {
-    'klee':               KleeTool,
-    'witch-klee':         WitchKleeTool,
-    'ceagle':             CeagleTool,
-    'ikos':               IkosTool,
-    'cbmc':               CbmcTool,
-    'cbmc-svcomp':        CbmcSVCOMPTool,
-    'esbmc':              EsbmcTool,
-    'map2check':          Map2CheckTool,
-    'cpachecker':         CpaTool,
-    'cpa':                CpaTool,
-    'skink':              SkinkTool,
-    'smack':              SmackTool,
-    'seahorn':            SeahornTool,
-    'nidhugg':            NidhuggTool,
-    'divine':             DivineTool,
-    'divine-svcomp':      DivineSvcompTool,
-    'ultimateautomizer':  UltimateTool,
-    'ultimate':           UltimateTool,
-    'uautomizer':         UltimateTool,
-    'ua':                 UltimateTool,
-    'svcomp':             SVCompTool,
-    'testcomp':           TestCompTool,
-    'slowbeast':          SlowbeastTool,
-    'sb':                 SlowbeastTool,
-    'predatorhp':         PredatorHPTool,
-    'predator':           PredatorTool,
-    '2ls':                TwolsTool,
-    'cc':                 CCTarget
+"""
+The registry of the verifier targets. A target module is imported
+only when the target is looked up (one run uses one target, so there
+is no need to import the modules of all the backends at startup).
+"""
+
+from collections.abc import Mapping
+from importlib import import_module
+
+# the name of the target -> (the module, the class)
+_registry = {
+    'klee':               ('klee', 'SymbioticTool'),
+    'witch-klee':         ('witchklee', 'SymbioticTool'),
+    'ceagle':             ('ceagle', 'SymbioticTool'),
+    'ikos':               ('ikos', 'SymbioticTool'),
+    'cbmc':               ('cbmc', 'SymbioticTool'),
+    'cbmc-svcomp':        ('cbmcsvcomp', 'SymbioticTool'),
+    'esbmc':              ('esbmc', 'SymbioticTool'),
+    'map2check':          ('map2check', 'SymbioticTool'),
+    'cpachecker':         ('cpachecker', 'SymbioticTool'),
+    'cpa':                ('cpachecker', 'SymbioticTool'),
+    'skink':              ('skink', 'SymbioticTool'),
+    'smack':              ('smack', 'SymbioticTool'),
+    'seahorn':            ('seahorn', 'SymbioticTool'),
+    'nidhugg':            ('nidhugg', 'SymbioticTool'),
+    'divine':             ('divine', 'SymbioticTool'),
+    'divine-svcomp':      ('divinesvc', 'SymbioticTool'),
+    'ultimateautomizer':  ('ultimateautomizer', 'SymbioticTool'),
+    'ultimate':           ('ultimateautomizer', 'SymbioticTool'),
+    'uautomizer':         ('ultimateautomizer', 'SymbioticTool'),
+    'ua':                 ('ultimateautomizer', 'SymbioticTool'),
+    'svcomp':             ('svcomp', 'SymbioticTool'),
+    'testcomp':           ('testcomp', 'SymbioticTool'),
+    'slowbeast':          ('slowbeast', 'SymbioticTool'),
+    'sb':                 ('slowbeast', 'SymbioticTool'),
+    'predatorhp':         ('predatorhp', 'SymbioticTool'),
+    'predator':           ('predator', 'SymbioticTool'),
+    '2ls':                ('twols', 'SymbioticTool'),
+    'cc':                 ('cc', 'CCTarget')
 }
 
+
+class _Targets(Mapping):
+    """
+    The mapping from the names of the targets to their classes,
+    a class is imported when it is looked up for the first time
+    """
+
+    def __init__(self, registry):
+        self._registry = registry
+        self._loaded = {}
+
+    def __getitem__(self, name):
+        cls = self._loaded.get(name)
+        if cls is None:
+            module, clsname = self._registry[name]
+            cls = getattr(import_module('.' + module, __name__), clsname)
+            self._loaded[name] = cls
+        return cls
+
+    def __iter__(self):
+        return iter(self._registry)
+
+    def __len__(self):
+        return len(self._registry)
+
+
+targets = _Targets(_registry)
@@ -1,3 +1,4 @@
+from os import cpu_count
 from os.path import join, abspath
 
 from . tool import SymbioticBaseTool
@@ -16,6 +17,8 @@ class CCTarget(SymbioticBaseTool):
     def __init__(self, opts):
         SymbioticBaseTool.__init__(self, opts)
         self.cwd = None
+        # the unsliced code that gen-c compares the final code against
+        self._original = None
 
     def name(self):
         return 'cc'
@@ -26,6 +29,9 @@ class CCTarget(SymbioticBaseTool):
     def set_environment(self, env, opts):
         self.cwd = env.cwd
 
+    def actions_after_slicing(self, symbiotic):
+        self._original = symbiotic.nonsliced_llvmfile
+
     def cmdline(self, executable, options, tasks, propertyfile=None, rlimits={}):
         """
         Compose the command line to execute from the name of the executable
@@ -33,7 +39,12 @@ class CCTarget(SymbioticBaseTool):
         if self._options.generate_c:
             output = self._options.final_output or\
                      join(self.cwd, 'symbiotic-output.c')
-            return ['gen-c', '-o', output] + options + tasks
+            cmd = ['gen-c', '-o', output]
+            if self._options.generate_c_changed and self._original:
+                # llvm2c is slow on large modules, translate only
+                # the functions changed by slicing and optimizations
+                cmd += ['-c', self._original, '-j', str(cpu_count() or 1)]
+            return cmd + options + tasks
 
         output = self._options.final_output
         if output is None:
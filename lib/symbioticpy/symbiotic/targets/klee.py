@@ -92,6 +92,21 @@ class KleeToolFullInstrumentation(KleeBase):
        #    passes.append('-instrument-alloc-nf')
        #else:
             passes.append('-instrument-alloc')
+            # the lazy models allocate the flags about initialized chunks
+            # that are never freed, do not use them if we look for leaks
+            prp = self._options.property
+            # failing allocations that are dereferenced right away
+            # only dereference NULL, that matters only for memory safety
+            if not (prp.memsafety() or prp.memcleanup()):
+                passes.append('-instrument-alloc-deref-nf')
+            # realloc that may fail and does not copy a shrunk object
+            # (it keeps its old size, so not for memory safety)
+            if not prp.memsafety():
+                passes.append('-instrument-alloc-realloc')
+            if self._options.lazy_uninitialized > 0 and\
+               not (prp.memsafety() or prp.memcleanup()):
+                passes.append('-instrument-alloc-lazy-size={0}'\
+                              .format(self._options.lazy_uninitialized))
 
         # remove/replace the rest of undefined functions
         # for which we do not have a definition and
@@ -125,7 +140,7 @@ class KleeToolFullInstrumentation(KleeBase):
         """
         opts = self._options
 
-        cmd = [executable] + self._arguments
+        cmd = [executable] + self._get_arguments()
 
         if opts.timeout is not None:
                cmd.append('-max-time={0}'.format(opts.timeout))
@@ -139,6 +154,7 @@ class KleeToolFullInstrumentation(KleeBase):
         if opts.executable_witness:
             cmd.append('-write-harness')
 
+        cmd += self._query_cache_arguments(tasks)
         return cmd + options + tasks + opts.argv
 
     def _parse_klee_output_line(self, line):
@@ -159,6 +175,9 @@ class KleeToolFullInstrumentation(KleeBase):
                         return result.RESULT_FALSE_FREE
                     if key == 'EMEMLEAK':
                         return result.RESULT_FALSE_MEMTRACK
+                    if key == 'EMEMCLEANUP' and\
+                       self._options.property.memcleanup():
+                        return result.RESULT_FALSE_MEMCLEANUP
                 return key
 
         return None
@@ -170,11 +189,12 @@ class KleeToolFullInstrumentation(KleeBase):
         if output is None:
             return 'ERROR (no output)'
 
-        found = []
-        for line in map(str, output):
-            fnd = self._parse_klee_output_line(line)
-            if fnd:
-                found.append(fnd)
+        return self._determine_result_by_parser(returncode, returnsignal,
+                                                output, isTimeout)
+
+    def _result_from_found(self, returncode, returnsignal, found, isTimeout):
+        if isTimeout:
+            return 'timeout'
 
         if not found:
             if returncode != 0:
@@ -207,6 +227,8 @@ class SymbioticTool(KleeBase):
 
         # define and compile regular expressions for parsing klee's output
         self._patterns = [
+            # the check of -count-allocations
+            ('EMEMCLEANUP', re.compile('.*ASSERTION FAIL: memory not cleaned up.*')),
             ('ASSERTIONFAILED', re.compile('.*ASSERTION FAIL:.*')),
             ('ASSERTIONFAILED2', re.compile('.Assertion .* failed.*')),
             ('ESTPTIMEOUT', re.compile('.*query timed out (resolve).*')),
@@ -252,6 +274,23 @@ class SymbioticTool(KleeBase):
             ('ERESOLV', re.compile('.*ERROR:.*Could not resolve.*'))
         ]
 
+    def _count_allocations(self):
+        """
+        Check memcleanup by counting the allocations in the program
+        (-count-allocations) instead of the walk over all the objects
+        by KLEE at the end of every path
+        """
+        opts = self._options
+        return opts.property.memcleanup() and not opts.property.memsafety() and\
+            not opts.memcleanup_by_scan and not opts.test_comp and\
+            self.FullInstr is None
+
+    def passes_before_verification(self):
+        passes = super().passes_before_verification()
+        if self._count_allocations():
+            passes.append('-count-allocations')
+        return passes
+
     def passes_after_slicing(self):
         if self.FullInstr:
             return self.FullInstr.passes_after_slicing()
@@ -281,7 +320,7 @@ class SymbioticTool(KleeBase):
        #       '-malloc-symbolic-contents',
        #       '-max-memory=8000']
 
-        cmd = [executable] + self._arguments +\
+        cmd = [executable] + self._get_arguments() +\
               ['-output-dir={0}'.format(opts.testsuite_output),
                '-write-testcases',
                '-malloc-symbolic-contents']
@@ -302,6 +341,7 @@ class SymbioticTool(KleeBase):
             cmd.append('-write-harness')
 
         cmd.append('-output-source=false')
+        cmd += self._query_cache_arguments(tasks)
 
         return cmd + options + tasks
 
@@ -319,7 +359,7 @@ class SymbioticTool(KleeBase):
         elif self.FullInstr:
             return self.FullInstr.cmdline(executable, options, tasks, propertyfile, rlimits)
 
-        cmd = [executable] + self._arguments
+        cmd = [executable] + self._get_arguments()
 
         if opts.timeout is not None:
                cmd.append('-max-time={0}'.format(opts.timeout))
@@ -330,8 +370,12 @@ class SymbioticTool(KleeBase):
            #    cmd.append('-check-leaks')
            #else: # if not in SV-COMP, consider any unfreed memory as a leak
            #    cmd.append('-check-memcleanup')
+            if prop.memcleanup():
+                # memsafety together with memcleanup (one run)
+                cmd.append('-check-memcleanup')
         elif prop.memcleanup():
-            cmd.append('-check-memcleanup')
+            if not self._count_allocations():
+                cmd.append('-check-memcleanup')
         elif prop.unreachcall():
             # filter out the non-standard error calls,
             # because we support only one such call atm.
@@ -355,7 +399,10 @@ class SymbioticTool(KleeBase):
             elif prop.nullderef():
                 cmd.append('-exit-on-error-type=Ptr')
             elif prop.memcleanup():
-                cmd.append('-exit-on-error-type=Leak')
+                if self._count_allocations():
+                    cmd.append('-exit-on-error-type=Assert')
+                else:
+                    cmd.append('-exit-on-error-type=Leak')
             else:
                 cmd.append('-exit-on-error-type=Assert')
 
@@ -372,6 +419,7 @@ class SymbioticTool(KleeBase):
         # we have the disassembly already (it may be a bit different,
         # but we may remove this switch during debugging)
         cmd.append('-output-source=false')
+        cmd += self._query_cache_arguments(tasks)
 
         return cmd + options + tasks + self._options.argv
 
@@ -401,8 +449,37 @@ class SymbioticTool(KleeBase):
 
         return None
 
+    def output_parser(self):
+        if self.FullInstr and not self._options.test_comp:
+            return self.FullInstr.output_parser()
+        return super().output_parser()
+
+    def _output_needed(self):
+        opts = self._options
+        # for coverage, the result does not depend on the output
+        return not opts.test_comp or opts.property.errorcall()
+
+    def _is_final(self, found):
+        return self._options.test_comp and found == result.RESULT_FALSE_REACH
+
     def determine_result(self, returncode, returnsignal, output, isTimeout):
         opts = self._options
+
+        if not opts.test_comp:
+            if self.FullInstr:
+                return self.FullInstr.determine_result(returncode, returnsignal, output, isTimeout)
+
+            if isTimeout:
+                return 'timeout'
+
+            if output is None:
+                return 'ERROR (no output)'
+
+        return self._determine_result_by_parser(returncode, returnsignal,
+                                                output or [], isTimeout)
+
+    def _result_from_found(self, returncode, returnsignal, found, isTimeout):
+        opts = self._options
         prop = opts.property
 
         ##
@@ -410,11 +487,8 @@ class SymbioticTool(KleeBase):
         # #
         if opts.test_comp:
             if prop.errorcall():
-                found = []
-                for line in output:
-                    fnd = self._parse_klee_output_line(str(line))
-                    if fnd == result.RESULT_FALSE_REACH:
-                        return result.RESULT_DONE
+                if result.RESULT_FALSE_REACH in found:
+                    return result.RESULT_DONE
 
                 return result.RESULT_UNKNOWN
 
@@ -424,21 +498,9 @@ class SymbioticTool(KleeBase):
         ##
         # GENERIC
         # #
-        if self.FullInstr:
-            return self.FullInstr.determine_result(returncode, returnsignal, output, isTimeout)
-
         if isTimeout:
             return 'timeout'
 
-        if output is None:
-            return 'ERROR (no output)'
-
-        found = []
-        for line in output:
-            fnd = self._parse_klee_output_line(str(line))
-            if fnd:
-                found.append(fnd)
-
         if not found:
             if returncode != 0:
                 return f'{result.RESULT_ERROR} (KLEE exited with {returncode})'
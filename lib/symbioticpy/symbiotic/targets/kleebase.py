@@ -18,15 +18,22 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License.
 """
+import sys
+import json
 from os.path import basename, dirname, abspath, isfile, join, realpath
 from os import listdir, rename
 from struct import unpack
-from symbiotic.utils.utils import print_stdout, process_grep
+from symbiotic.utils.utils import print_stdout, process_grep, set_pass_manager
 from symbiotic.utils import dbg
 from symbiotic.utils.process import runcmd
+from symbiotic.utils.cache import QueryCache
+from symbiotic.utils.watch import DbgWatch
+from symbiotic.utils.istats import profile, load_loops, format_profile
 from symbiotic.exceptions import SymbioticException
+from symbiotic.targets.kleeprofiles import profile_arguments
 from symbiotic.witnesses.witnesses import GraphMLWriter
 from symbiotic.witnesses.YAMLwitnesswriter import YAMLWriter
+from symbiotic.testsuits.testcases import iter_ktest, split_argv, split_buffer, split_objects
 
 
 from sys import version_info
@@ -52,6 +59,32 @@ except ImportError:
 
 from . tool import SymbioticBaseTool
 
+class KleeOutputParser(object):
+    """
+    Parse the output of KLEE while it runs. Only the found events
+    are stored, the tool decides the result from them at the end.
+    """
+
+    def __init__(self, tool):
+        self._tool = tool
+        self._found = []
+        # do we still need to parse the lines?
+        self._done = not tool._output_needed()
+
+    def parse(self, line):
+        if self._done:
+            return
+
+        fnd = self._tool._parse_klee_output_line(str(line))
+        if fnd:
+            self._found.append(fnd)
+            # the result cannot change anymore
+            self._done = self._tool._is_final(fnd)
+
+    def result(self, returncode, returnsignal, isTimeout):
+        return self._tool._result_from_found(returncode, returnsignal,
+                                             self._found, isTimeout)
+
 def get_repr(obj):
     ret = []
     if not len(obj[1]) > 0:
@@ -107,6 +140,12 @@ def get_nice_repr(obj):
     return rep
 
 def print_object(obj):
+    # the arguments of main (see --symbolic-argv)
+    args = split_argv(obj[0], obj[1])
+    if args is not None:
+        print('argv := [{0}]'.format(', '.join(repr(a)[1:] for a in args)))
+        return
+
     rep = 'len {0} bytes, ['.format(len(obj[1]))
     objrepr = get_repr(obj)
     if objrepr == ():
@@ -140,39 +179,11 @@ def print_object(obj):
 # dumping human readable error
 ##
 def _parseKtest(pathFile):
-    # this code is taken from ktest-tool from KLEE (but modified)
-
-    f = open(pathFile, 'rb')
-
-    hdr = f.read(5)
-    if len(hdr) != 5 or (hdr != b'KTEST' and hdr != b"BOUT\n"):
-        print('unrecognized file')
-        sys.exit(1)
-    version, = unpack('>i', f.read(4))
-    if version > 3:
-        print('unrecognized version')
+    try:
+        return list(split_objects(iter_ktest(pathFile)))
+    except ValueError as e:
+        print(str(e))
         sys.exit(1)
-    # skip args
-    numArgs, = unpack('>i', f.read(4))
-    for i in range(numArgs):
-        size, = unpack('>i', f.read(4))
-        f.read(size)
-
-    if version >= 2:
-        unpack('>i', f.read(4))
-        unpack('>i', f.read(4))
-
-    numObjects, = unpack('>i', f.read(4))
-    objects = []
-    for i in range(numObjects):
-        size, = unpack('>i', f.read(4))
-        name = f.read(size)
-        size, = unpack('>i', f.read(4))
-        bytes = f.read(size)
-        objects.append((name, bytes))
-
-    f.close()
-    return objects
 
 def _dumpObjects(ktestfile):
     objects = _parseKtest(ktestfile)
@@ -225,12 +236,14 @@ def generate_graphml(path, source, is_correctness_wit, opts, saveto):
         assert path is None
     gen.write(saveto)
 
-def generate_yaml(path, source, is_correctness_wit, opts, saveto):
+def generate_yaml(path, source, is_correctness_wit, opts, saveto, invariants=None):
     assert saveto is not None
     gen = YAMLWriter(source, opts.property.ltl(),
                         opts.is32bit, is_correctness_wit)
     if not is_correctness_wit:
         gen.generate_violation_witness(path, opts.property.termination())
+    else:
+        gen.generate_correctness_witness(invariants or [])
        
     gen.write(saveto)
 
@@ -247,11 +260,65 @@ def get_ktest(bindir):
 def get_harness_file(bindir):
     return get_testcase(bindir) + '.harness.c';
 
-def generate_witness(bindir, sources, is_correctness_wit, opts, saveto = None):
+def get_ktest_harness():
+    """
+    The harness that reads the inputs from a .ktest file at runtime
+    (one binary executes all the tests of a program)
+    """
+    from symbiotic.utils.utils import get_symbiotic_dir
+    return join(get_symbiotic_dir(), 'lib', 'harness', 'ktest-harness.c')
+
+def _buffer_waypoints(ktest, waypoints):
+    """
+    KLEE does not write the values of the nondet calls that were coalesced
+    into buffers (see -coalesce-nondet) into the .waypoints file. Write
+    the file with the values of the calls from the buffers in the test
+    and return its path, or return the original file if there are no
+    buffers or if we cannot find out the order of the values.
+    """
+    values = []
+    for name, data in iter_ktest(ktest):
+        parts = split_buffer(name)
+        if parts is None:
+            continue
+        offset = 0
+        for fun, _, line, col, size, kind in parts:
+            value = int.from_bytes(data[offset:offset + size], 'little',
+                                   signed=(kind == 's'))
+            if kind == 'b':
+                value = int(value != 0)
+            values.append('{0}:{1}:{2}:{3}\n'.format(fun, line, col, value))
+            offset += size
+    if not values:
+        return waypoints
+
+    with open(waypoints, 'r') as f:
+        lines = f.readlines()
+    if any(l[0] != '@' for l in lines if l.strip()):
+        # the values of other calls are there, we do not know
+        # how they interleave with the values from the buffers
+        dbg('Cannot put the values of nondet buffers into the witness')
+        return waypoints
+
+    output = '{0}buffers.waypoints'.format(waypoints[:-len('waypoints')])
+    with open(output, 'w') as f:
+        f.writelines(values + lines)
+    return output
+
+def generate_witness(bindir, sources, is_correctness_wit, opts, saveto = None,
+                     invariants = None):
     assert len(sources) == 1 and "Can not generate witnesses for more sources yet"
     print('Generating {0} witness: {1}'.format('correctness' if is_correctness_wit else 'error', saveto))
     if is_correctness_wit:
         generate_graphml(None, sources[0], is_correctness_wit, opts, saveto)
+        # the invariants that we know are useful only in the YAML format
+        if invariants:
+            try:
+                generate_yaml(None, sources[0], is_correctness_wit, opts,
+                              saveto.strip('graphml') + 'yml', invariants)
+            except Exception as e:
+                dbg(str(e))
+                print("Failed generating YAML witness")
         return
 
     pth = get_ktest(join(bindir, 'klee-last'))
@@ -262,6 +329,7 @@ def generate_witness(bindir, sources, is_correctness_wit, opts, saveto = None):
         try:
             saveto = saveto.strip('graphml') + 'yml'
             test = '{0}waypoints'.format(pth[:pth.rfind('.') + 1])
+            test = _buffer_waypoints(pth, test)
             generate_yaml(test, sources[0], is_correctness_wit, opts, saveto)
         except:
             print("Failed generating YAML witness")
@@ -273,11 +341,6 @@ def generate_exec_witness(bindir, sources, opts, saveto = None):
         saveto = '{0}.exe'.format(sources[:sources.rfind('.')])
     print('Generating executable witness to : {0}'.format(saveto))
 
-    if opts.test_comp:
-        pth = get_harness_file(join(opts.testsuite_output))
-    else:
-        pth = get_harness_file(join(bindir, 'klee-last'))
-
     from symbiotic.exceptions import SymbioticException
     try:
         from symbiotic.transform import CompileWatch
@@ -286,8 +349,22 @@ def generate_exec_witness(bindir, sources, opts, saveto = None):
             flags+=['-fsanitize=address']
         elif opts.property.signedoverflow() or opts.property.undefinedness():
             flags+=['-fsanitize=undefined']
-        runcmd(['clang', '-g', pth, sources[0], '-o', saveto] + flags,
-               CompileWatch(), 'Generating executable witness failed')
+
+        if opts.test_comp:
+            # there are many tests, so build one binary that reads
+            # the test from the .ktest file given as the first argument
+            # instead of compiling a harness for every test
+            harness = '{0}.harness.o'.format(saveto)
+            runcmd(['clang', '-g', '-c', get_ktest_harness(), '-o', harness],
+                   CompileWatch(), 'Compiling the ktest harness failed')
+            runcmd(['clang', '-g', harness, sources[0],
+                    '-Dmain=__symbiotic_main', '-o', saveto] + flags,
+                   CompileWatch(), 'Generating executable witness failed')
+            print('Run the tests as: {0} test.ktest'.format(saveto))
+        else:
+            pth = get_harness_file(join(bindir, 'klee-last'))
+            runcmd(['clang', '-g', pth, sources[0], '-o', saveto] + flags,
+                   CompileWatch(), 'Generating executable witness failed')
     except SymbioticException as e:
         dbg(str(e))
 
@@ -314,6 +391,56 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
                            '--libc=klee',
                            '--lazy-init',
                            '-external-calls=pure', '-max-memory=8000']
+        if opts.merge_hints:
+            # merge the states at the hints from -insert-merge-hints
+            self._arguments.append('-use-merge')
+        if opts.profile_verification:
+            # the statistics of instructions for describe_profile()
+            self._arguments.append('--output-istats=1')
+
+    def output_parser(self):
+        return KleeOutputParser(self)
+
+    def _get_arguments(self):
+        """
+        The arguments of KLEE with the options from the profiles
+        that match the features of the program (see --klee-profiles)
+        """
+        if not self._options.klee_profiles:
+            return self._arguments
+        return profile_arguments(self._arguments, self._options.klee_profiles,
+                                 self._options.program_features)
+
+    def _query_cache_arguments(self, tasks):
+        """
+        The arguments of KLEE for the shared cache of solver
+        queries of the verified bitcode (see --query-cache)
+        """
+        opts = self._options
+        if not opts.query_cache or not tasks:
+            return []
+        path = QueryCache(opts.cache_dir, opts.query_cache_size).get(tasks[0])
+        return ['-query-cache-dir={0}'.format(path)] if path else []
+
+    def _output_needed(self):
+        """ Do we need to parse the output to get the result? """
+        return True
+
+    def _is_final(self, found):
+        """ Is the result known once we found this in the output? """
+        return False
+
+    def _determine_result_by_parser(self, returncode, returnsignal,
+                                    output, isTimeout):
+        parser = self.output_parser()
+        for line in output:
+            parser.parse(line)
+        return parser.result(returncode, returnsignal, isTimeout)
+
+    def status_channel(self):
+        # our fork of KLEE writes the verdicts into the status channel
+        # (for test-comp, the result does not come from the verdicts)
+        return not self._options.test_comp
 
     def can_replay(self):
         """ Return true if the tool can do error replay """
@@ -369,6 +496,28 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
                         '{0}/llvm-{1}/lib/klee/runtime'.\
                         format(prefix, self.llvm_version()))
 
+    def passes_after_compilation(self):
+        passes = []
+        # main gets the arguments from one symbolic object
+        if self._options.symbolic_argv:
+            count, length = self._options.symbolic_argv
+            passes += ['-symbolic-argv',
+                       '-symbolic-argv-count={0}'.format(count),
+                       '-symbolic-argv-length={0}'.format(length)]
+        # run the deterministic beginning of main concretely,
+        # before we link any models of the undefined functions
+        if self._options.concrete_prefix:
+            passes.append('-concrete-prefix')
+        # isdigit() and friends as comparisons instead of reads
+        # from the symbolic offsets of the table of __ctype_b_loc
+        if self._options.lower_ctype:
+            passes.append('-lower-ctype')
+        # replace the loops that fill or copy arrays by memset/memcpy,
+        # KLEE would fork on every iteration (this must run before
+        # the instrumentation makes the accesses volatile)
+        passes += ['-mem2reg', '-summarize-array-loops']
+        return passes
+
     #  def actions_before_slicing(self, symbiotic):
     #      # FIXME: use -abort-on-threads with slicer
     #      # check whether there are threads in the program
@@ -401,10 +550,50 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
         # make the uninitialized variables symbolic (if desired)
         if not self._options.explicit_symbolic:
             passes.append('-initialize-uninitialized')
+            if self._options.lazy_uninitialized > 0:
+                passes.append('-initialize-uninitialized-lazy-size={0}'\
+                              .format(self._options.lazy_uninitialized))
+            # remove the initializations that are overwritten
+            # on every path before a read
+            passes.append('-remove-dead-nondet-init')
+
+        # bound the length of strings read by the models of input functions
+        if self._options.max_input_length > 0:
+            passes.append('-set-input-limit')
+            passes.append('-set-input-limit-value={0}'\
+                          .format(self._options.max_input_length))
+
+        # bound the number of allocations that may fail on a path
+        if self._options.malloc_fail_budget and\
+           not self._options.malloc_never_fails:
+            passes.append('-set-malloc-fail-budget')
+            passes.append('-set-malloc-fail-budget-value={0}'\
+                          .format(self._options.malloc_fail_budget))
 
         # make external globals non-deterministic
         if not self._options.sv_comp:
             passes.append('-internalize-globals')
+            # initialize many globals from a table in one function
+            # instead of a call for every global
+            passes.append('-internalize-globals-batch=32')
+
+        # KLEE is slow on floating point, remove the float computations
+        # that cannot influence the control flow (e.g., the values that
+        # are only printed), they cannot influence the reachability
+        if self._options.property.unreachcall():
+            passes.append('-abstract-floats')
+
+        # make the symbolic values of __VERIFIER_nondet_* only as wide
+        # as the program uses them (e.g., a char or a boolean)
+        passes.append('-narrow-nondet')
+
+        # create the nondet values of a block in one symbolic object
+        if self._options.coalesce_nondet:
+            passes.append('-coalesce-nondet')
+
+        # replace the loops that only compute values (counters, sums)
+        # by the closed form of the values, KLEE would fork on every iteration
+        passes.append('-accelerate-loops')
 
         # for the memsafety property, make functions behave like they have
         # side-effects, because LLVM optimizations could remove them otherwise,
@@ -414,15 +603,84 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
         elif self._options.property.termination():
             passes.append('-instrument-nontermination')
             passes.append('-instrument-nontermination-mark-header')
+            # the checks of the instrumentation are branches, not calls
+            passes.append('-inline-checks')
+
+        # mark constant the globals that are never written (or only
+        # by the initial stores in main), the loads from them can be
+        # folded by the after-slicing optimizations
+        passes.append('-constify-globals')
 
         return super().passes_after_slicing() + passes
 
+    def passes_before_verification(self):
+        # the bounds on the iterations of loops (metadata for the searcher)
+        passes = ['-annotate-loop-bounds']
+        # merge the runs of assumes and terminate the paths at assume(0)
+        # (for termination, assume(0) is a non-terminating path)
+        if not self._options.property.termination():
+            passes.append('-consolidate-assumes')
+        if self._options.merge_hints:
+            passes.append('-insert-merge-hints')
+        if self._options.points_to_hints:
+            # the objects that the loads and stores may access
+            passes.append('-annotate-points-to')
+        if self._options.target_distance:
+            # the distances of the blocks to the nearest error call
+            passes.append('-annotate-target-distance')
+        # KLEE creates an object for every global, merge the constants
+        # (string literals, ...) into a few pools. The reads out of bounds
+        # of a constant would read the next one, so not for memsafety.
+        if not self._options.property.memsafety():
+            passes.append('-merge-constants')
+        # KLEE needs only the line tables, the invariants of correctness
+        # witnesses take the variables from the code before slicing
+        if getattr(self, '_nonsliced', None):
+            passes.append('-slim-debug-info')
+        return passes
+
     def describe_error(self, llvmfile):
         if self._options.test_comp:
             dump_errors(self._options.testsuite_output)
         else:
             dump_errors(join(dirname(llvmfile), 'klee-last'))
 
+    def describe_profile(self, llvmfile):
+        """
+        Map the statistics of instructions from KLEE to the loops
+        and the lines of the source (--profile-verification)
+        """
+        if self._options.test_comp:
+            bindir = self._options.testsuite_output
+        else:
+            bindir = join(dirname(llvmfile), 'klee-last')
+        istats = join(bindir, 'run.istats')
+        if not isfile(istats):
+            dbg('Cannot find the statistics of KLEE ({0})'.format(istats))
+            return
+
+        loops = join(dirname(llvmfile), 'loops.json')
+        cmd = ['opt', '-load', 'LLVMsbt.so', '-classify-loops',
+               '-classify-loops-lines={0}'.format(loops),
+               '-o', '/dev/null', llvmfile]
+        set_pass_manager(cmd, self.llvm_version(), self._options.new_pm)
+        try:
+            runcmd(cmd, DbgWatch('all'), 'Failed finding the loops')
+        except SymbioticException as e:
+            # we report the lines at least
+            dbg(str(e))
+
+        prof = profile(istats, load_loops(loops))
+        print_stdout('INFO: Profile of the verification:', color='WHITE')
+        for line in format_profile(prof):
+            print_stdout(line)
+
+        try:
+            with open(self._options.profile_verification, 'w') as f:
+                json.dump(prof, f, indent=1)
+        except OSError as e:
+            dbg('Failed storing the profile: {0}'.format(str(e)))
+
     def replay_error_params(self, llvmfile):
         """ Replay error on the unsliced file """
         if self._options.test_comp:
@@ -438,12 +696,69 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
 
         params = self._options.tool_params if self._options.tool_params else []
         params.append('-replay-nondets={0}'.format(ktest))
+        # The branches of the sliced module are not the branches of the
+        # unsliced one, so the path of the counterexample cannot be followed
+        # decision by decision. The replayed values decide the branches
+        # on the nondet values though, so go depth-first along them
+        # and stop at the first error instead of exploring the other paths
+        params.append('-search=dfs')
+        params.append('-exit-on-error')
 
         return params
 
+    def actions_after_slicing(self, symbiotic):
+        # the invariants for correctness witnesses are taken from the code
+        # before slicing (the sliced code may not compute all the variables)
+        self._nonsliced = getattr(symbiotic, 'nonsliced_llvmfile', None)
+
+    def export_invariants(self, llvmfile):
+        """
+        Return the invariants of loops that LLVM knows (the ranges
+        of variables at the loop heads) for correctness witnesses
+        """
+        bitcode = getattr(self, '_nonsliced', None) or llvmfile
+        if not bitcode or not isfile(bitcode):
+            return []
+        output = join(dirname(llvmfile), 'invariants.json')
+        cmd = ['opt', '-load', 'LLVMsbt.so', '-export-invariants',
+               '-export-invariants-file={0}'.format(output),
+               '-o', '/dev/null', bitcode]
+        set_pass_manager(cmd, self.llvm_version(), self._options.new_pm)
+        try:
+            runcmd(cmd, DbgWatch('all'), 'Failed exporting invariants')
+            with open(output, 'r') as f:
+                return json.load(f)
+        except (SymbioticException, IOError, OSError, ValueError) as e:
+            dbg(str(e))
+            return []
+
     def generate_witness(self, llvmfile, sources, has_error):
+        invariants = None
+        if not has_error and (self._options.property.signedoverflow() or
+                              self._options.property.unreachcall()):
+            invariants = self.export_invariants(llvmfile)
         generate_witness(dirname(llvmfile), sources, not has_error,
-                         self._options, self._options.witness_output)
+                         self._options, self._options.witness_output,
+                         invariants)
+
+    def generate_testsuite_zip(self, sources):
+        """
+        Pack the test suite into the zip archive for graders, in one pass
+        over the test pack (it is created from the .ktest files of
+        the output directory if KLEE did not write it)
+        """
+        from symbiotic.testsuits.testpack import pack_directory, write_testsuite_zip
+        outdir = self._options.testsuite_output
+        pack = join(outdir, 'tests.pack')
+        try:
+            if not isfile(pack):
+                pack_directory(outdir, pack)
+            n = write_testsuite_zip(pack, self._options.testsuite_zip, sources[0],
+                                    metadata=join(outdir, 'metadata.xml'))
+        except (OSError, ValueError) as e:
+            dbg('Failed packing the test suite: {0}'.format(str(e)))
+            return
+        print_stdout('Packed {0} tests into {1}'.format(n, self._options.testsuite_zip))
 
     def generate_exec_witness(self, bitcode, sources):
         out = self._options.witness_output[:self._options.witness_output.rfind('.')+1]+'exe'
@@ -0,0 +1,99 @@
+"""
+Profiles of KLEE options for classes of programs (--klee-profiles).
+The table of profiles is a JSON file (lib/klee-profiles.json by default),
+every profile has conditions on the features of the program (see
+--features) and the options of KLEE that it sets.
+"""
+
+import json
+import os
+
+from .. utils import dbg
+from .. utils.utils import get_symbiotic_dir
+
+# the loaded tables, the keys are the paths
+_tables = {}
+
+
+def _table_path(table):
+    if table == 'default':
+        return os.path.join(get_symbiotic_dir(), 'lib', 'klee-profiles.json')
+    return table
+
+
+def load_profiles(table):
+    """
+    Return the list of profiles from the table (a path or 'default'),
+    an empty list if the table cannot be loaded
+    """
+    path = _table_path(table)
+    if path in _tables:
+        return _tables[path]
+
+    profiles = []
+    try:
+        with open(path, 'r') as f:
+            data = json.load(f)
+        if data.get('version') != 1:
+            dbg('Unknown version of the KLEE profiles in {0}'.format(path))
+        else:
+            profiles = data.get('profiles', [])
+    except (IOError, OSError, ValueError) as e:
+        dbg('Failed loading the KLEE profiles: {0}'.format(str(e)))
+
+    _tables[path] = profiles
+    return profiles
+
+
+def _feature(features, path):
+    val = features
+    for key in path.split('.'):
+        if not isinstance(val, dict) or key not in val:
+            return None
+        val = val[key]
+    return val
+
+
+def _holds(cond, val):
+    if val is None:
+        return False
+    if isinstance(cond, dict):
+        if 'min' in cond and val < cond['min']:
+            return False
+        if 'max' in cond and val > cond['max']:
+            return False
+        return True
+    return val == cond
+
+
+def matches(profile, features):
+    return all(_holds(cond, _feature(features, path))
+               for path, cond in profile.get('when', {}).items())
+
+
+def _name(arg):
+    return arg.split('=', 1)[0].lstrip('-')
+
+
+def apply_profile(args, profile_args):
+    """
+    Replace the options in args with the options of the same name
+    from profile_args (e.g., all -search=... options by the new ones)
+    """
+    names = set(_name(a) for a in profile_args)
+    return [a for a in args if _name(a) not in names] + list(profile_args)
+
+
+def profile_arguments(args, table, features):
+    """
+    Apply all profiles from the table that match the features
+    of the program to the arguments of KLEE
+    """
+    if not features:
+        return args
+
+    for profile in load_profiles(table):
+        if matches(profile, features):
+            dbg('Using the KLEE profile {0}'.format(profile.get('name')))
+            args = apply_profile(args, profile.get('args', []))
+    return args
@@ -100,9 +100,14 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
         opts.is32bit = False
 
     def actions_after_slicing(self, symbiotic):
-        # unroll the loops and rename __VERIFIER_atomic_begin/end
-        # to avoid a bug in nidhugg
-        symbiotic.run_opt(['-reg2mem', '-sbt-loop-unroll',
+        # turn the globals that only main accesses into its locals and
+        # the globals that are never written into constants (the other
+        # threads cannot see their accesses, nidhugg need not interleave
+        # them), unroll the loops and replace __VERIFIER_atomic_begin/end
+        # by locking the regions of the sections (the independent sections
+        # get different locks, the renaming also avoids a bug in nidhugg)
+        symbiotic.run_opt(['-localize-main-globals', '-constify-globals',
+                           '-reg2mem', '-sbt-loop-unroll',
                            '-sbt-loop-unroll-count', '7',
                            '-sbt-loop-unroll-terminate',
                            '-replace-verifier-atomic'])
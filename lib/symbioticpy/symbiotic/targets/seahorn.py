@@ -31,9 +31,9 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
         prp = self._options.property
         if not (prp.unreachcall() or prp.assertions()):
             return
-        for fun in self._options.property.getcalls():
-            symbiotic.run_opt(['-replace-asserts',
-                               f'-replace-asserts-fn={fun}'])
+        calls = ','.join(self._options.property.getcalls())
+        symbiotic.run_opt(['-normalize-error-sites',
+                           f'-normalize-error-sites-assert-fn={calls}'])
 
     def cmdline(self, executable, options, tasks, propertyfile, rlimits):
         assert len(tasks) == 1
@@ -60,8 +60,10 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
     def set_environment(self, env, opts):
         """ Set environment for the tool """
 
-        # do not link any functions
-        opts.linkundef = []
+        # link only the models of the library functions for slowbeast
+        # (lib/libc/slowbeast), the other models are written for
+        # the memory and the symbolic objects of KLEE
+        opts.linkundef = ['libc']
         env.prepend('LD_LIBRARY_PATH', '{0}/slowbeast/'.\
                         format(env.symbiotic_dir))
         env.reset('PYTHONOPTIMIZE', '1')
@@ -90,7 +92,11 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
         passes = ["-lowerswitch", "-simplifycfg"]
         if self._bself:
             passes.append("-flatten-loops")
-        return passes + ["-O3", "-remove-constant-exprs", "-reg2mem"]
+        # slowbeast does not read the metadata with the bounds of loops,
+        # assume the bounds in the code (BMC can stop unwinding at them)
+        return passes + ["-O3", "-annotate-loop-bounds",
+                         "-annotate-loop-bounds-assume",
+                         "-remove-constant-exprs", "-reg2mem"]
 
     def generate_witness(self, llvmfile, sources, has_error):
         print_stdout('Generating {0} witness: {1}'\
@@ -115,6 +121,9 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
                                  self._options.property.termination())
         gen.write(self._options.witness_output)
 
+    def status_channel(self):
+        return True
+
     def determine_result(self, returncode, returnsignal, output, isTimeout):
         if isTimeout:
             return ''
@@ -46,11 +46,14 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
         self._options = opts
         self._env = None
         self._hit_threads = False
+        # set by set_features() if we know that KLEE cannot help
+        self._skip_klee = False
 
     def verifiers(self):
         prp = self._options.property
         if prp.unreachcall():
-            yield (KleeTool(self._options), None, 333)
+            if not self._skip_klee:
+                yield (KleeTool(self._options), None, 333)
             if self._hit_threads:
                 yield (SlowbeastTool(self._options), ['-threads'], None)
             else:
@@ -85,6 +88,9 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
         self._env = env
         self.klee.set_environment(env, self._options)
         self.slowbeast.set_environment(env, self._options)
+        # the program is shared by KLEE and slowbeast, the models
+        # of either would not fit the other one
+        self._options.linkundef = []
 
     def actions_before_slicing(self, symbiotic):
         if hasattr(self.klee, 'actions_before_slicing'):
@@ -123,6 +129,30 @@ class SymbioticTool(BaseTool, SymbioticBaseTool):
     def determine_result(self, returncode, returnsignal, output, isTimeout):
         raise NotImplementedError("This should be never called")
 
+    def set_features(self, features):
+        """
+        Use the features of the program (see --features) to choose
+        the verifiers before running them
+        """
+        threads = features.get('threads', {})
+        if threads.get('pthread_calls', 0) > 0:
+            # do not wait until KLEE fails on the threads
+            dbg('The program uses threads, skipping KLEE')
+            self._hit_threads = True
+            self._skip_klee = True
+
+    def set_module_summary(self, summary):
+        """
+        Use the summary of the program after compilation
+        (see -check-module-summary) to choose the verifiers
+        before the program is instrumented and sliced
+        """
+        if summary.get('pthread_calls', 0) > 0 or\
+           summary.get('verifier_atomic_calls', 0) > 0:
+            dbg('The program uses threads, skipping KLEE')
+            self._hit_threads = True
+            self._skip_klee = True
+
     def verifier_failed(self, verifier, res, watch):
         """
         Register that a verifier failed (so that subsequent verifiers can
@@ -77,7 +77,11 @@ class SymbioticTool(KleeTool):
                 prp = calls[0]
  
 
-        return [executable, prp, self._options.testsuite_output] + tasks
+        cmd = [executable]
+        if self._options.cache_dir:
+            # reuse the tests from the previous runs as seeds
+            cmd.append('--seed-store={0}/seeds'.format(self._options.cache_dir))
+        return cmd + [prp, self._options.testsuite_output] + tasks
 
 
     def determine_result(self, returncode, returnsignal, output, isTimeout):
@@ -17,6 +17,16 @@ class SymbioticBaseTool(object):
             return 'error'
         return 'done'
 
+    def output_parser(self):
+        """
+        Return an object that determines the result from the output of the
+        tool line by line while the tool is running (methods parse(line)
+        and result(returncode, returnsignal, isTimeout)). Then the whole
+        output of the tool does not need to be stored. If this returns
+        None, determine_result() gets the whole output.
+        """
+        return None
+
     def cmdline(self, executable, options, tasks, propertyfile=None, rlimits={}):
         """
         Compose the command line to execute from the name of the executable
@@ -52,6 +62,39 @@ class SymbioticBaseTool(object):
         # pairs (tool, params, timeout)
         return ((self, None, None),)
 
+    def status_channel(self):
+        """
+        Return True if the tool can write its status into the file
+        from the environment variable SYMBIOTIC_STATUS_FILE. The file
+        has one JSON object per line, the tool writes {"event": "start"}
+        right when it starts and {"event": "result", "verdict": V}
+        when it decides the result, where V is true, false or unknown.
+        A false verdict has also "property" (e.g., unreach-call,
+        valid-deref), an unknown verdict may have a "reason".
+        Once the tool starts writing the file, its output is not parsed.
+        """
+        return False
+
+    def result_from_status(self, events, returncode, isTimeout):
+        """
+        The result from the events of the status channel,
+        None if the events do not decide the result.
+        """
+        if isTimeout:
+            return 'timeout'
+        for event in reversed(events):
+            if event.get('event') != 'result':
+                continue
+            verdict = event.get('verdict')
+            if verdict == 'true':
+                return 'true'
+            if verdict == 'false':
+                prp = event.get('property')
+                return 'false({0})'.format(prp) if prp else 'false'
+            reason = event.get('reason')
+            return 'unknown ({0})'.format(reason) if reason else 'unknown'
+        return None
+
    # we run these passes for every tool
    #def passes_after_compilation(self):
    #    """
@@ -198,13 +241,18 @@ class SymbioticBaseTool(object):
                      '-delete-call', '__INSTR_mark_pointer',
                      '-delete-call', '__INSTR_mark_allocation',
                      '-delete-call', '__INSTR_mark_free',
-                     '-delete-call', '__INSTR_mark_exit',
-                     '-delete-call', '__symbiotic_keep_ptr']
+                     '-delete-call', '__INSTR_mark_exit']
                     )
         elif prop.signedoverflow():
             return ['-delete-call', '__symbiotic_check_overflow']
         return []
 
+   #def set_module_summary(self, summary):
+    # Called right after compilation with the summary of the features
+    # that decide which verifier to use (see -check-module-summary):
+    # the numbers of pthread_*, __VERIFIER_atomic_* and indirect calls,
+    # of atomic and floating-point instructions
+
    #def passes_before_verification(self):
    #def actions_before_verification(self, symbiotic):
    # These callbacks are run 'always' before running a verification tool,
@@ -1,8 +1,15 @@
 #!/usr/bin/env python3
 
-from os.path import basename
+import sys
+from os import listdir, replace, unlink
+from os.path import basename, isfile, join
+from shutil import which
+from subprocess import call, DEVNULL
+from struct import unpack, error as StructError
 from sys import version_info
+from time import sleep
 from hashlib import sha256 as hashfunc
+from xml.sax.saxutils import quoteattr, escape
 
 from sys import version_info
 if version_info < (3, 0):
@@ -71,6 +78,52 @@ def print_object(obj):
     print('{0} := {1}'.format(obj[0], rep))
 
 
+def iter_ktest(pathFile):
+    """
+    Yield the objects (name, bytes) from the .ktest file one by one,
+    so that the whole file is never kept in memory.
+    Raises ValueError for unknown files and struct.error
+    for truncated files (e.g., those that KLEE still writes).
+    """
+    with open(pathFile, 'rb') as f:
+        for obj in iter_ktest_stream(f):
+            yield obj
+
+
+def iter_ktest_stream(f):
+    """
+    Yield the objects (name, bytes) of the ktest read from the binary
+    stream f (e.g., a test from a test pack, see testpack.py)
+    """
+    # this code is taken from ktest-tool from KLEE
+    # (but modified)
+    hdr = f.read(5)
+    if len(hdr) != 5 or (hdr != b'KTEST' and hdr != b"BOUT\n"):
+        raise ValueError('unrecognized file')
+    version, = unpack('>i', f.read(4))
+    if version > 3:
+        raise ValueError('unrecognized version')
+    # skip args
+    numArgs, = unpack('>i', f.read(4))
+    for i in range(numArgs):
+        size, = unpack('>i', f.read(4))
+        f.read(size)
+
+    if version >= 2:
+        unpack('>i', f.read(4))
+        unpack('>i', f.read(4))
+
+    numObjects, = unpack('>i', f.read(4))
+    for i in range(numObjects):
+        size, = unpack('>i', f.read(4))
+        name = f.read(size)
+        size, = unpack('>i', f.read(4))
+        bytes = f.read(size)
+        if len(bytes) != size:
+            raise StructError('truncated object')
+        yield (name, bytes)
+
+
 def split_name(name):
     var = name.decode('utf-8').split(":")
     if len(var) != 4:
@@ -78,8 +131,66 @@ def split_name(name):
     return var[0], var[1], var[2]
 
 
+def split_buffer(name):
+    """
+    The parts (function, variable, line, column, size, kind) of
+    a buffer of nondeterministic values (see -coalesce-nondet),
+    None if the object is not such a buffer. The kind is 's' (signed),
+    'u' (unsigned) or 'b' (_Bool).
+    """
+    name = name.decode('utf-8')
+    if not name.startswith('__nondet_buffer|'):
+        return None
+    parts = []
+    for part in name.split('|')[1:]:
+        # (KLEE may append something to the name of the object)
+        fun, var, line, col, size, kind = part.split(':')[:6]
+        parts.append((fun, var, line, col, int(size), kind[:1]))
+    return parts
+
+
+def split_argv(name, data):
+    """
+    The arguments of main (without argv[0]) from the object with all
+    the arguments (see -symbolic-argv), None if the object is not such
+    an object
+    """
+    name = name.decode('utf-8')
+    if not name.startswith('__symbiotic_argv|'):
+        return None
+    # (KLEE may append something to the name of the object)
+    count, length = [int(part.split(':')[0]) for part in name.split('|')[1:3]]
+    slot = length + 1
+    args = []
+    for i in range(min(data[0], count)):
+        arg = data[1 + i * slot:1 + i * slot + length]
+        args.append(arg.split(b'\0')[0])
+    return args
+
+
+def split_objects(objects):
+    """
+    Yield the objects (name, bytes) with the buffers of nondeterministic
+    values split into the objects of the values, in the order of the calls
+    """
+    for name, data in objects:
+        parts = split_buffer(name)
+        if parts is None:
+            yield (name, data)
+            continue
+        offset = 0
+        for fun, var, line, col, size, _ in parts:
+            yield ('{0}:{1}:{2}:{3}'.format(fun, var, line, col).encode('utf-8'),
+                   data[offset:offset + size])
+            offset += size
+
+
+doctype = """<!DOCTYPE testcase PUBLIC "+//IDN sosy-lab.org//DTD test-format testcase 1.0//EN" "https://sosy-lab.org/test-format/testcase-1.0.dtd">"""
+
+
 class TestCaseWriter(object):
     def __init__(self, source, covers_error):
+        self._covers_error = covers_error
         if covers_error:
             self._root = ET.Element('testcase', key = 'coverError')
         else:
@@ -93,41 +204,11 @@ class TestCaseWriter(object):
             "^[_a-zA-Z\$][_a-zA-Z\$0-9]*(\[.*\])?$")
 
     def _parseKtest(self, pathFile):
-        # this code is taken from ktest-tool from KLEE
-        # (but modified)
-        from struct import unpack
-
-        f = open(pathFile, 'rb')
-
-        hdr = f.read(5)
-        if len(hdr) != 5 or (hdr != b'KTEST' and hdr != b"BOUT\n"):
-            print('unrecognized file')
-            sys.exit(1)
-        version, = unpack('>i', f.read(4))
-        if version > 3:
-            print('unrecognized version')
+        try:
+            return list(iter_ktest(pathFile))
+        except ValueError as e:
+            print(str(e))
             sys.exit(1)
-        # skip args
-        numArgs, = unpack('>i', f.read(4))
-        for i in range(numArgs):
-            size, = unpack('>i', f.read(4))
-            f.read(size)
-
-        if version >= 2:
-            unpack('>i', f.read(4))
-            unpack('>i', f.read(4))
-
-        numObjects, = unpack('>i', f.read(4))
-        objects = []
-        for i in range(numObjects):
-            size, = unpack('>i', f.read(4))
-            name = f.read(size)
-            size, = unpack('>i', f.read(4))
-            bytes = f.read(size)
-            objects.append((name, bytes))
-
-        f.close()
-        return objects
 
     def _newNodeEdge(self, last_id, line=None, originfile=None):
         # create new node
@@ -144,20 +225,14 @@ class TestCaseWriter(object):
 
         return node, edge
 
-    def _dumpObjects(self, ktestfile, originfile):
-        from struct import unpack
-
-        objects = self._parseKtest(ktestfile)
-       #print(' -- ---- --')
-       #print('Symbolic objects:')
-       #for o in objects:
-       #    print_object(o)
-       #print(' -- ---- --')
-
+    def _inputs(self, objects):
+        """
+        Yield the (variable, value) pairs of the test from the objects
+        """
         if not include_objects:
-            return 1
+            return
 
-        last_id = 1
+        objects = split_objects(objects)
 
         if only_objects_in_main:
             # filter the objects to those that are present in main
@@ -191,7 +266,6 @@ class TestCaseWriter(object):
                # or multiple assignments now
                 continue
 
-            ass_list = []
             bytes_num = len(o[1])
             # If possible, dump the value as a regular number (not byte per byte)
             # XXX: the length may not be sufficient. We need to know also
@@ -214,8 +288,12 @@ class TestCaseWriter(object):
                     else:
                         val = o[1][i]
 
-            ET.SubElement(self._root, 'input', variable = var_name).text = str(val)
+            yield (var_name, str(val))
 
+    def _dumpObjects(self, ktestfile, originfile):
+        last_id = 1
+        for var_name, val in self._inputs(self._parseKtest(ktestfile)):
+            ET.SubElement(self._root, 'input', variable = var_name).text = val
             last_id += 1
 
         return last_id
@@ -237,9 +315,40 @@ class TestCaseWriter(object):
         else:
             print(ET.tostring(self._root, pretty_print=True))
 
+    def stream(self, ktestfile, to):
+        """
+        Convert the .ktest file to the test-case XML file 'to' without
+        building the XML tree: the inputs are written as they are read.
+        The file is written under a temporary name and renamed at the end,
+        so that 'to' never contains a partial test.
+        """
+        tmp = '{0}.tmp'.format(to)
+        try:
+            with open(tmp, 'w', encoding='utf-8') as f:
+                self.stream_objects(iter_ktest(ktestfile), f)
+        except:
+            unlink(tmp)
+            raise
+        replace(tmp, to)
+
+    def stream_objects(self, objects, f):
+        """
+        Write the test-case XML with the inputs from the objects (name, bytes)
+        of a ktest into the text stream f
+        """
+        f.write('<?xml version="1.0" encoding="UTF-8" standalone="no"?>\n')
+        f.write(doctype + '\n')
+        if self._covers_error:
+            f.write('<testcase key="coverError">\n')
+        else:
+            f.write('<testcase>\n')
+        for var_name, val in self._inputs(objects):
+            f.write('  <input variable={0}>{1}</input>\n'\
+                    .format(quoteattr(var_name), escape(val)))
+        f.write('</testcase>\n')
+
     def write(self, to):
         et = ET.ElementTree(self._root)
-        doctype = """<!DOCTYPE testcase PUBLIC "+//IDN sosy-lab.org//DTD test-format testcase 1.0//EN" "https://sosy-lab.org/test-format/testcase-1.0.dtd">"""
         if no_lxml:
            with open(to, 'wb') as f:
                 f.write("""<?xml version="1.0" encoding="UTF-8" standalone="no"?>""".encode('utf8'))
@@ -249,3 +358,84 @@ class TestCaseWriter(object):
         else:
             et.write(to, encoding='UTF-8', method="xml", doctype = doctype,
                      pretty_print=True, xml_declaration=True)
+
+
+class TestSuiteWriter(object):
+    """
+    Convert the .ktest files from the output directory of KLEE
+    into test-suite XML files as they appear, so that neither all
+    the tests nor their XML trees are kept in memory. The files are
+    converted by sbt-ktest2xml if it is available.
+    """
+
+    def __init__(self, source, kleedir, outdir, native=True):
+        self._source = source
+        self._kleedir = kleedir
+        self._outdir = outdir
+        self._done = set()
+        # the native converter (much faster for many tests)
+        self._native = which('sbt-ktest2xml') if native else None
+
+    def _output(self, ktest):
+        return join(self._outdir, '{0}xml'.format(ktest[:-len('ktest')]))
+
+    def _convert_native(self, ktests):
+        """
+        Convert the files by sbt-ktest2xml, return the list
+        of the files that it failed to convert
+        """
+        for i in range(0, len(ktests), 1000):
+            batch = ktests[i:i + 1000]
+            call([self._native, '-o', self._outdir] +
+                 [join(self._kleedir, f) for f in batch],
+                 stdout=DEVNULL, stderr=DEVNULL)
+        return [f for f in ktests if not isfile(self._output(f))]
+
+    def poll(self, finished=False):
+        """
+        Convert the .ktest files that were not converted yet and return
+        the number of converted files. The files that KLEE did not finish
+        writing are left for the next call, unless 'finished' is set.
+        """
+        files = sorted(listdir(self._kleedir))
+        # KLEE stores the errors into testN.<kind>.err
+        errors = set(f[:f.find('.') + 1] for f in files if f.endswith('.err'))
+        ktests = [f for f in files
+                  if f.endswith('.ktest') and f not in self._done]
+
+        failed = ktests
+        if self._native and ktests:
+            failed = self._convert_native(ktests)
+
+        n = len(ktests) - len(failed)
+        failed_set = set(failed)
+        self._done.update(f for f in ktests if f not in failed_set)
+        for ktest in failed:
+            path = join(self._kleedir, ktest)
+            if not isfile(path):
+                continue
+
+            writer = TestCaseWriter(self._source,
+                                    ktest[:-len('ktest')] in errors)
+            try:
+                writer.stream(path, self._output(ktest))
+            except (ValueError, StructError, IOError) as e:
+                if not finished:
+                    continue
+                print('Failed converting {0}: {1}'.format(path, str(e)))
+
+            self._done.add(ktest)
+            n += 1
+
+        return n
+
+    def run(self, is_running, interval=1):
+        """
+        Convert the tests while is_running() returns True
+        and then convert the rest of them
+        """
+        while is_running():
+            self.poll()
+            sleep(interval)
+
+        return self.poll(finished=True)
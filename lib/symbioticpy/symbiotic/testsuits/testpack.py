@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""
+Test packs: all the tests of a run in one append-only indexed file
+instead of a .ktest file and a test-case XML file per test.
+
+    pack   := "SBTPACK" version:u8 record*
+    record := name-size:u32 name flags:u32 size:u32 ktest
+
+The integers are big-endian (as in .ktest files), the name is the name
+of the test without the extension (e.g., test000001) and the bit 0
+of the flags is set if the test covers an error. The writer appends
+a record at a time, so a reader ignores a truncated record at the end
+(the one being written). The headers of the records are the index:
+reading it seeks over the tests, and the tests are converted into
+the final zip for graders in one sequential pass over the file.
+"""
+
+from io import BytesIO, TextIOWrapper
+from os import listdir
+from os.path import basename, isfile, join
+from struct import pack, unpack, error as StructError
+import zipfile
+
+from . testcases import TestCaseWriter, iter_ktest_stream
+
+MAGIC = b'SBTPACK'
+VERSION = 1
+COVERS_ERROR = 1
+
+
+class TestPackWriter(object):
+    """
+    Append the tests to a test pack
+    """
+
+    def __init__(self, path):
+        self._file = open(path, 'ab')
+        if self._file.tell() == 0:
+            self._file.write(MAGIC + pack('>B', VERSION))
+            self._file.flush()
+
+    def append(self, name, ktest, covers_error=False):
+        if isinstance(name, str):
+            name = name.encode('utf-8')
+        flags = COVERS_ERROR if covers_error else 0
+        # one write, so that a reader sees either
+        # the whole record or a truncated one
+        self._file.write(pack('>I', len(name)) + name +
+                         pack('>II', flags, len(ktest)) + ktest)
+        self._file.flush()
+
+    def close(self):
+        self._file.close()
+
+
+def _records(f):
+    """
+    Yield (name, covers_error, size) for the records of the pack
+    with f positioned at the ktest of the record
+    """
+    hdr = f.read(len(MAGIC) + 1)
+    if len(hdr) != len(MAGIC) + 1 or hdr[:len(MAGIC)] != MAGIC:
+        raise ValueError('unrecognized test pack')
+    if hdr[len(MAGIC)] > VERSION:
+        raise ValueError('unrecognized version of the test pack')
+    while True:
+        try:
+            size, = unpack('>I', f.read(4))
+            name = f.read(size)
+            flags, size = unpack('>II', f.read(8))
+        except StructError:
+            return
+        yield name.decode('utf-8'), bool(flags & COVERS_ERROR), size
+
+
+def read_index(path):
+    """
+    The list of (name, covers_error, offset, size) of the tests
+    in the pack, without reading the tests
+    """
+    index = []
+    with open(path, 'rb') as f:
+        f.seek(0, 2)
+        end = f.tell()
+        f.seek(0)
+        for name, covers_error, size in _records(f):
+            offset = f.tell()
+            if offset + size > end:
+                break
+            index.append((name, covers_error, offset, size))
+            f.seek(size, 1)
+    return index
+
+
+def iter_pack(path):
+    """
+    Yield the tests (name, covers_error, ktest) from the pack
+    """
+    with open(path, 'rb') as f:
+        for name, covers_error, size in _records(f):
+            ktest = f.read(size)
+            if len(ktest) != size:
+                return
+            yield name, covers_error, ktest
+
+
+def pack_directory(kleedir, path):
+    """
+    Append the .ktest files from the output directory of KLEE to the pack
+    (for KLEE that writes a file per test), return the number of the tests
+    """
+    files = sorted(listdir(kleedir))
+    # KLEE stores the errors into testN.<kind>.err
+    errors = set(f[:f.find('.')] for f in files if f.endswith('.err'))
+    writer = TestPackWriter(path)
+    n = 0
+    for f in files:
+        if not f.endswith('.ktest'):
+            continue
+        name = f[:-len('.ktest')]
+        with open(join(kleedir, f), 'rb') as ktest:
+            writer.append(name, ktest.read(), name in errors)
+        n += 1
+    writer.close()
+    return n
+
+
+def write_testsuite_zip(path, to, source, metadata=None, prefix='test-suite/'):
+    """
+    Convert the tests from the pack to the test-case XML files of the zip
+    archive 'to' in one pass over the pack. 'metadata' is the path of
+    metadata.xml to store into the archive. Return the number of the tests.
+    """
+    n = 0
+    with zipfile.ZipFile(to, 'w', zipfile.ZIP_DEFLATED) as z:
+        if metadata and isfile(metadata):
+            z.write(metadata, prefix + basename(metadata))
+        for name, covers_error, ktest in iter_pack(path):
+            xml = TextIOWrapper(BytesIO(), encoding='utf-8')
+            try:
+                TestCaseWriter(source, covers_error)\
+                    .stream_objects(iter_ktest_stream(BytesIO(ktest)), xml)
+            except (ValueError, StructError) as e:
+                print('Failed converting {0}: {1}'.format(name, str(e)))
+                continue
+            xml.flush()
+            z.writestr('{0}{1}.xml'.format(prefix, name),
+                       xml.buffer.getvalue())
+            n += 1
+    return n
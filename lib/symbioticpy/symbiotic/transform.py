@@ -3,24 +3,54 @@
 import os
 import sys
 import re
+import json
 
 from . exceptions import SymbioticExceptionalResult
-from . options import SymbioticOptions
+from . options import SymbioticOptions, get_versions
+from . optpipelines import get_pipeline, get_harmful, llvm_major
 from . utils import dbg, print_elapsed_time, restart_counting_time
 from . utils.process import ProcessRunner, runcmd
 from . utils.watch import ProcessWatch, DbgWatch
-from . utils.utils import print_stdout, print_stderr, process_grep
+from . utils.cache import BitcodeCache, ProbeCache, file_digest
+from . utils.checkpoint import Checkpoints
+from . utils import metrics
+from . utils.timeout import remaining_time, stage_timeout
+from . utils.trace import add_pass_events, tracing
+from . utils.utils import print_stdout, print_stderr, process_grep, set_pass_manager
 from . exceptions import SymbioticException
 from symbiotic.witnesses.witchtransformer import ValidationTransformer
-from shutil import move
+from shutil import move, which
+from concurrent.futures import ThreadPoolExecutor
+from time import monotonic, time
+
+# the messages of opt and sbt-pipeline when an allocation fails
+OUT_OF_MEMORY = (b'out of memory', b'Allocation failed', b'std::bad_alloc')
+oom_stage_re = re.compile(rb'sbt-pipeline: out of memory in stage (\d+)')
 
 class PrepareWatch(ProcessWatch):
     def __init__(self, lines=100):
         ProcessWatch.__init__(self, lines)
+        self.out_of_memory = False
+        # the index of the stage of sbt-pipeline that ran out of memory
+        self.oom_stage = None
 
     def parse(self, line):
-        if b'Removed' in line or b'Defining' in line:
+        if b'over its budget' in line:
+            # a stage of sbt-pipeline grew the module too much
+            print_stdout('WARNING: {0}'.format(
+                         line.decode('utf-8').replace('sbt-pipeline: ', '', 1)),
+                         color='BROWN', print_nl=False)
+            return
+        if any(msg in line for msg in OUT_OF_MEMORY):
+            self.out_of_memory = True
+            match = oom_stage_re.search(line)
+            if match:
+                self.oom_stage = int(match.group(1))
+        if b'Removed' in line or b'Defining' in line or b'Linked' in line:
             sys.stdout.write(line.decode('utf-8'))
+        elif line.startswith(b'INFO: '):
+            # statistics printed by sbt-pipeline
+            print_stdout(line.decode('utf-8'), print_nl=False)
         else:
             dbg(line.decode('utf-8'), 'prepare', False)
 
@@ -65,6 +95,27 @@ class PrintWatch(ProcessWatch):
                      print_nl=False, color=self._color)
 
 
+class CountWatch(PrintWatch):
+    """
+    Parse the statistics printed by -count-instr,
+    print them only if a prefix is given
+    """
+
+    def __init__(self, prefix=None):
+        PrintWatch.__init__(self, prefix or '')
+        self._print = prefix is not None
+        self.instructions = None
+
+    def parse(self, line):
+        if self._print:
+            PrintWatch.parse(self, line)
+        if line.startswith(b'stats: '):
+            try:
+                self.instructions = int(line.split()[-1])
+            except ValueError:
+                pass
+
+
 class CompileWatch(ProcessWatch):
     """ Parse output of compilation """
 
@@ -95,6 +146,26 @@ class UnsuppWatch(ProcessWatch):
         dbg(uline, domain='prepare', print_nl=False)
         self._ok = not UnsuppWatch.unsupported_call.match(uline)
 
+# the kinds of loops that -remove-infinite-loops may remove: natural loops
+# without exits and irreducible cycles
+INFINITE_LOOPS = 'nonterm-loops,irreducible-loops'
+
+# the passes that only look at the module, the stages with only these
+# passes do not need to store the module (see _flush_pipeline)
+READ_ONLY_PASSES = ('-stats=', '-check-module', '-classify-instructions',
+                    '-find-criteria')
+
+# the stages that the program is correct without (they only make the code
+# easier for the verifiers) and the passes that may be dropped from the other
+# stages, used when a stage runs out of memory (see --stage-memlimit)
+SKIPPABLE_STAGES = ('unroll', 'optimize')
+DROPPABLE_PASSES = ('-ainline', '-accelerate-loops', '-summarize-array-loops')
+
+# the optimizations that need the whole module, with --split-optimize
+# they run once on the linked partitions instead of on every partition
+GLOBAL_OPT_PASSES = ('-globaldce', '-globalopt', '-constmerge', '-ipsccp',
+                     '-ipconstprop', '-deadargelim', '-strip-dead-prototypes')
+
 def get_optlist_before(optlevel):
     from . optimizations import optimizations
     lst = []
@@ -136,6 +207,15 @@ class SymbioticCC(object):
     def __init__(self, src, tool, opts=None, env=None):
         # source file
         self.sources = src
+        # stages (lists of passes) that wait for sbt-pipeline,
+        # see _run_opt() and the curfile property. All the stages run
+        # in one process and the options of the passes apply only to the stage
+        # that they are given in, so a pass that should run twice with other
+        # options must run in two stages (one stage gives it the same options)
+        self._pending_stages = []
+        self._pipeline = None
+        # records about passes run by sbt-pipeline (see --pass-report)
+        self._pass_records = []
         # source compiled to llvm bitecode
         self.curfile = None
         # environment
@@ -155,6 +235,199 @@ class SymbioticCC(object):
         # optimization renames in used LLVM release
         self._opt_renames = {}
 
+        # cache of compiled bitcode, created lazily
+        self._bitcode_cache = None
+        # checkpoints of the preprocessing (see --resume), created lazily
+        self._checkpoints = None
+        # the number of instructions after compilation (if counted)
+        self._instructions = None
+        # the time until which instrumentation and slicing must finish
+        self._preprocessing_deadline = None
+        # the line of the target of the validated witness
+        self._witness_target = None
+        # symbols of precompiled models, loaded lazily
+        self._symbol_index = None
+        # the models compiled in the background, {model path: future}
+        # (see _prefetch_models)
+        self._prefetched = {}
+        self._prefetch_pool = None
+        # the file with functions for -delete-undefined-keep, created lazily
+        self._keep_calls = None
+        # remove the bitcode files superseded by the output of a stage
+        # (only in run(), the other users of this object may need them)
+        self._remove_superseded = False
+
+    @property
+    def curfile(self):
+        """
+        The current bitcode file. If there are some stages waiting
+        for sbt-pipeline, run them first, so that everybody that
+        uses the file sees the up-to-date code.
+        """
+        self._flush_pipeline()
+        return self._curfile
+
+    @curfile.setter
+    def curfile(self, value):
+        self._flush_pipeline()
+        self._curfile = value
+
+    def _superseded(self, old):
+        """
+        A stage replaced the bitcode 'old' with its output. Remove 'old'
+        if nobody needs it anymore: it is an intermediate file in
+        the working directory and it is not the non-sliced file
+        (for replaying errors) or the saved files (--save-files).
+        """
+        if not self._remove_superseded or self.options.save_files:
+            return
+        if not old or old == getattr(self, 'nonsliced_llvmfile', None):
+            return
+        workdir = getattr(self.env, 'working_dir', None)
+        if not workdir or\
+           os.path.dirname(os.path.abspath(old)) != os.path.abspath(workdir):
+            return
+
+        try:
+            os.unlink(old)
+            dbg("Removed the superseded '{0}'".format(os.path.basename(old)),
+                'compile')
+        except OSError:
+            pass
+
+    def _use_pipeline(self):
+        """
+        Can we batch the opt runs into one run of sbt-pipeline?
+        """
+        if self._pipeline is None:
+            self._pipeline = self.options.pipeline_driver and\
+                             which('sbt-pipeline') is not None
+            if self._pipeline:
+                dbg('Using sbt-pipeline for running passes')
+        return self._pipeline
+
+    def _flush_pipeline(self):
+        """
+        Run all pending stages in sbt-pipeline, loading
+        and storing the bitcode only once
+        """
+        if not self._pending_stages:
+            return
+
+        stages = self._pending_stages
+        self._pending_stages = []
+
+        curfile = self._curfile
+        while True:
+            # if we only print statistics or look at the module,
+            # there is no need for a new file
+            only_stats = all(p.startswith(READ_ONLY_PASSES)
+                             for (_, passes) in stages for p in passes)
+            if only_stats:
+                output = '/dev/null'
+            else:
+                output = '{0}-pr.bc'.format(curfile[:curfile.rfind('.')])
+            cmd = ['sbt-pipeline', curfile, '-o', output]
+            for name, passes in stages:
+                cmd.append('-stage={0}'.format(name))
+                cmd += passes
+            if self.options.stage_memlimit:
+                cmd.append('-memory-report')
+
+            # the trace gets the passes from the report of sbt-pipeline
+            report = None
+            if self.options.pass_report or tracing():
+                report = '{0}-passes.json'.format(curfile[:curfile.rfind('.')])
+                cmd.append('-pass-report={0}'.format(report))
+
+            dbg('Running {0} stage(s) in sbt-pipeline: {1}'\
+                .format(len(stages), ', '.join(s[0] for s in stages)))
+            started = time()
+            watch = self._run_limited(cmd, 'Running sbt-pipeline failed')
+            if not watch.out_of_memory:
+                break
+
+            # run the stages again without the one that ran out of memory
+            if watch.oom_stage is None or watch.oom_stage >= len(stages):
+                raise SymbioticException('sbt-pipeline ran out of memory')
+            name, passes = stages[watch.oom_stage]
+            passes = self._degrade_stage(name, passes)
+            stages = stages[:watch.oom_stage] +\
+                     ([(name, passes)] if passes is not None else []) +\
+                     stages[watch.oom_stage + 1:]
+            if not stages:
+                return
+
+        if not only_stats:
+            self._curfile = output
+            self._superseded(curfile)
+            self._save_ll(*(s[0] for s in stages))
+
+        if report:
+            self._collect_pass_report(report, started)
+            self._superseded(report)
+
+    def _run_limited(self, cmd, err_msg):
+        """
+        Run opt or sbt-pipeline with the memory limit (--stage-memlimit).
+        Return the watch of the process, the caller should check if
+        the process ran out of memory (the other failures raise an exception).
+        """
+        watch = PrepareWatch()
+        retval = ProcessRunner().run(cmd, watch,
+                                     memlimit=self.options.stage_memlimit)
+        if retval == 0:
+            return watch
+        if watch.out_of_memory and self.options.stage_memlimit:
+            return watch
+
+        for line in watch.getLines():
+            print_stderr(line.decode('utf-8'), color='RED', print_nl=False)
+        raise SymbioticException(err_msg)
+
+    def _degrade_stage(self, stage, passes):
+        """
+        The stage ran out of memory. Return the passes to run instead
+        (None to skip the stage), or raise an exception if the program
+        needs the stage.
+        """
+        limit = self.options.stage_memlimit // (1024 * 1024)
+        if stage in SKIPPABLE_STAGES:
+            print_stdout("WARNING: Stage '{0}' ran out of memory ({1} MB), "
+                         "skipping it".format(stage, limit), color='BROWN')
+            return None
+
+        kept = [p for p in passes if p not in DROPPABLE_PASSES]
+        if len(kept) < len(passes):
+            print_stdout("WARNING: Stage '{0}' ran out of memory ({1} MB), "
+                         "running it without {2}"\
+                         .format(stage, limit,
+                                 ' '.join(p for p in passes if p not in kept)),
+                         color='BROWN')
+            return kept
+
+        raise SymbioticException("Stage '{0}' ran out of memory ({1} MB)"
+                                 .format(stage, limit))
+
+    def _collect_pass_report(self, report, started):
+        """
+        Add the records from the report of sbt-pipeline (that started
+        at 'started') to the records from the previous runs and store them
+        all into the final report, add the passes to the trace
+        """
+        try:
+            with open(report, 'r') as f:
+                records = json.load(f)
+            add_pass_events(records, started)
+            if not self.options.pass_report:
+                return
+            self._pass_records += records
+            with open(self.options.pass_report, 'w') as f:
+                json.dump(self._pass_records, f, indent=1)
+        except (IOError, OSError, ValueError) as e:
+            # not fatal, continue working
+            dbg('Failed collecting the report about passes: {0}'.format(str(e)))
+
     def _get_cc(self):
         if hasattr(self._tool, 'cc'):
             return self._tool.cc()
@@ -162,10 +435,18 @@ class SymbioticCC(object):
         return ['clang']
 
     def cc_has_lifetime_markers(self):
-        retval, out = process_grep(self._get_cc() + ['-cc1', '--help'],
-                                   '-fsanitize-address-use-after-scope')
-        return retval == 0 and len(out) == 1 and\
-                out[0].lstrip().decode('ascii').startswith('-fsanitize-address-use-after-scope')
+        cc = list(self._get_cc())
+
+        def probe():
+            retval, out = process_grep(cc + ['-cc1', '--help'],
+                                       '-fsanitize-address-use-after-scope')
+            return retval == 0 and len(out) == 1 and\
+                    out[0].lstrip().decode('ascii').startswith('-fsanitize-address-use-after-scope')
+
+        # the results do not change while the compiler does not change
+        # (symbiotic-server probes it once for all the tasks)
+        return ProbeCache(self.options.cache_dir)\
+                .get('lifetime-markers:' + ' '.join(cc[1:]), cc[0], probe)
 
     def cc_disable_optimizations(self):
         # Use -O0 -disable-O0-optnone to get the code without optnone attribute
@@ -173,18 +454,29 @@ class SymbioticCC(object):
         # XXX: does -disable-llvm-passes have an effect here?
         return ['-O0', '-disable-O0-optnone', '-disable-llvm-passes']
 
-    def _save_ll(self):
+    def _want_ll(self, stages):
+        wanted = self.options.save_ll_stages
+        return 'all' in wanted or any(s in wanted for s in stages)
+
+    def _save_ll(self, *stages):
         """
-        This is _generate_ll() that is enabled
-        only when save_files is turned on (so that we do not
-        generate .ll redundantly)
+        Generate the .ll file for the current file, but only if the user
+        asked for the .ll files of (one of) the given stages
+        (--save-ll=STAGE,...). The .ll file of the final output is generated
+        once in _finish_run(), the intermediate files are touched only
+        on demand.
         """
-        if not self.options.save_files:
+        if not self._want_ll(stages):
+            return
+        if self._pending_stages:
+            # run the pending stages now, the .ll file
+            # is generated for their result in _flush_pipeline()
+            self._flush_pipeline()
             return
-        return self._generate_ll()
+        return self._generate_ll(force=True)
 
-    def _generate_ll(self, outf=None):
-        if not self.options.generate_ll:
+    def _generate_ll(self, outf=None, force=False):
+        if not (force or self.options.generate_ll):
             return
         cmd = ["llvm-dis", self.curfile]
         if outf is not None:
@@ -201,9 +493,26 @@ class SymbioticCC(object):
         return runcmd(cmd, DbgWatch('all'),
                       "Failed running command: {0}".format(" ".join(cmd)))
 
-    def _compile_to_llvm(self, source, output=None, with_g=True, opts=[]):
+    def _get_bitcode_cache(self):
+        if self.options.cache_dir is None:
+            return None
+
+        if self._bitcode_cache is None:
+            # the models include our headers, so they are a part of the key
+            includes = []
+            if self.env:
+                includes.append(os.path.join(self.env.symbiotic_dir, 'include'))
+            self._bitcode_cache = BitcodeCache(self.options.cache_dir, includes)
+        return self._bitcode_cache
+
+    def _compile_to_llvm(self, source, output=None, with_g=True, opts=[],
+                         cache=False):
         """
-        Compile given source to LLVM bitecode
+        Compile given source to LLVM bitecode. If cache is True,
+        the bitcode may be taken from (and is stored to) the persistent cache.
+        If cache is 'stamp', the key is computed only from the stamp
+        of the source (see BitcodeCache.stamp_key) and the returned path
+        may be the path of the file in the cache (it must not be modified).
         """
 
         # __inline attribute is buggy in clang, remove it using -D__inline
@@ -234,56 +543,339 @@ class SymbioticCC(object):
             # make the bitcode better readable if we generate the .ll files
             cmd.append("-fno-discard-value-names")
 
-        cmd.append('-o')
         if output is None:
             basename = os.path.basename(source)
             llvmfile = '{0}.bc'.format(basename[:basename.rfind('.')])
         else:
             llvmfile = output
-        cmd.append(llvmfile)
-        cmd.append(source)
 
+        bccache = self._get_bitcode_cache() if cache else None
+        if bccache and cache == 'stamp':
+            key = bccache.stamp_key(source, cmd + [self._tool.llvm_version()])
+            cached = bccache.lookup(key)
+            if cached:
+                return cached
+        elif bccache:
+            key = bccache.key(source, cmd + [self._tool.llvm_version()])
+            if bccache.get(key, llvmfile):
+                return llvmfile
+
+        cmd += ['-o', llvmfile, source]
         runcmd(cmd, CompileWatch(),
                "Compiling source '{0}' failed".format(source))
 
+        if bccache:
+            bccache.put(key, llvmfile)
+
         return llvmfile
 
-    def run_opt(self, passes):
+    def run_opt(self, passes, stage='opt', run_if=None):
+        """
+        Run passes over the current file. run_if are kinds of loops
+        (see LoopSummary) separated by commas, sbt-pipeline then runs the
+        passes only if the module has some of these loops (the passes
+        cannot change the module otherwise). opt runs them always.
+        """
         if not passes:
             return
 
-        self._run_opt(passes)
-
-    def _run_opt(self, passes):
-        output = '{0}-pr.bc'.format(self.curfile[:self.curfile.rfind('.')])
-        cmd = ['opt', '-load', 'LLVMsbt.so',
-               self.curfile, '-o', output] + passes
-        self._disable_new_pm(cmd)
+        self._run_opt(passes, stage, run_if)
 
-        runcmd(cmd, PrepareWatch(), 'Running opt failed')
-        self.curfile = output
-        self._save_ll()
+    def _get_keep_calls(self):
+        """
+        Create the file for -delete-undefined-keep: the functions from
+        lib/keep-calls.txt and the functions that we have models for
+        (so that their calls are not deleted, we link the models later)
+        """
+        if self._keep_calls is not None:
+            return self._keep_calls
+
+        names = set()
+        symbdir = self.env.symbiotic_dir
+        keepfile = os.path.join(symbdir, 'lib', 'keep-calls.txt')
+        if os.path.isfile(keepfile):
+            with open(keepfile, 'r') as f:
+                names.update(l.strip() for l in f
+                             if l.strip() and not l.startswith('#'))
+
+        for defined, _ in self._load_symbol_index().values():
+            names.update(defined)
+
+        tool = self._tool.name().lower()
+        for ty in self.options.linkundef:
+            for d in (os.path.join(symbdir, 'lib', ty, tool),
+                      os.path.join(symbdir, 'lib', ty)):
+                if not os.path.isdir(d):
+                    continue
+                names.update(f[:-2] for f in os.listdir(d) if f.endswith('.c'))
+
+        self._keep_calls = os.path.abspath('keep-calls.txt')
+        with open(self._keep_calls, 'w') as f:
+            for name in sorted(names):
+                f.write('{0}\n'.format(name))
+
+        return self._keep_calls
+
+    def _add_keep_calls(self, passes):
+        if self.env is None or\
+           not any(p in ('-delete-undefined', '-delete-undefined-nosym')
+                   for p in passes):
+            return passes
+        return passes + ['-delete-undefined-keep={0}'.format(self._get_keep_calls())]
+
+    def _growth_budget(self, stage, passes, required=False):
+        """
+        The budget of the growth of the module for the stage of sbt-pipeline
+        (see --growth-budget): the stages that the program is correct
+        without are rolled back, the required ones stop the run. The other
+        stages have no budget, they mix the optional passes with the required.
+        """
+        budget = self.options.growth_budget
+        if not budget:
+            return []
+        if required:
+            return ['-max-growth={0}'.format(budget), '-max-growth-fail']
+        if stage in SKIPPABLE_STAGES:
+            return ['-max-growth={0}'.format(budget)]
+        return []
+
+    def _run_opt(self, passes, stage='opt', run_if=None):
+        passes = self._add_keep_calls(passes)
+        if self._use_pipeline():
+            # postpone running the passes until somebody needs the file
+            passes = list(passes) + self._growth_budget(stage, passes)
+            if run_if:
+                passes.append('-run-if={0}'.format(run_if))
+            self._pending_stages.append((stage, passes))
+            self._save_ll(stage)
+            return
 
-    def _disable_new_pm(self, cmd):
-        # disable new pass manager in LLVM 13+
-        # TODO: support natively
-        ver_major, *_ = self._tool.llvm_version().split('.')
-        if int(ver_major) >= 13:
-            cmd.append('-enable-new-pm=0')
+        output = '{0}-pr.bc'.format(self.curfile[:self.curfile.rfind('.')])
+        while True:
+            cmd = ['opt', '-load', 'LLVMsbt.so',
+                   self.curfile, '-o', output] + passes
+            self._set_pass_manager(cmd)
+
+            if not self._run_limited(cmd, 'Running opt failed').out_of_memory:
+                break
+            passes = self._degrade_stage(stage, passes)
+            if passes is None:
+                return
+        old, self.curfile = self.curfile, output
+        self._superseded(old)
+        self._save_ll(stage)
+
+    def _set_pass_manager(self, cmd):
+        set_pass_manager(cmd, self._tool.llvm_version(), self.options.new_pm)
 
     def _get_stats(self, prefix=''):
         if not self.options.stats:
             return
 
+        if self._use_pipeline():
+            # let sbt-pipeline print the statistics after the pending stages,
+            # so that we do not need to load the module again
+            self._pending_stages.append(('stats', ['-stats={0}'.format(prefix)]))
+            return
+
+        self._count_instructions('INFO: ' + prefix)
+
+    def _count_instructions(self, prefix=None):
+        """
+        Return the number of instructions in the current file (None if it
+        cannot be found out). If prefix is given, print the statistics
+        with this prefix.
+        """
         cmd = ['opt', '-load', 'LLVMsbt.so', '-count-instr',
                '-o', '/dev/null', self.curfile]
-        self._disable_new_pm(cmd)
+        self._set_pass_manager(cmd)
 
+        watch = CountWatch(prefix)
         try:
-            runcmd(cmd, PrintWatch('INFO: ' + prefix), 'Failed running opt')
+            runcmd(cmd, watch, 'Failed running opt')
         except SymbioticException:
             # not fatal, continue working
             dbg('Failed getting statistics')
+            return None
+
+        if self._instructions is None:
+            self._instructions = watch.instructions
+        return watch.instructions
+
+    def _preprocessing_timeout(self, timeout, share):
+        """
+        With the global timeout, instrumentation and slicing share a budget
+        that is a part of the time remaining after compilation. The part
+        grows with the size of the program, but the verifiers always get
+        at least a half of the time. A stage gets the given share of what
+        remains from the budget (and at most the given timeout, if > 0).
+        """
+        rem = remaining_time()
+        if rem is None:
+            return timeout
+
+        if self._preprocessing_deadline is None:
+            if self._instructions is None:
+                self._count_instructions()
+            n = self._instructions or 0
+            part = 0.25 if n < 10000 else 0.35 if n < 100000 else 0.5
+            self._preprocessing_deadline = monotonic() + rem * part
+            dbg('Instrumentation and slicing may take {0:.0f} s'
+                .format(rem * part))
+
+        return stage_timeout(timeout, share, self._preprocessing_deadline)
+
+    def _check_tiny_task(self):
+        """
+        Use the fast path for tiny programs (--tiny-task=N): skip slicing,
+        the optimization rounds and the statistics, so that only the passes
+        that are needed for the semantics of the program are run.
+        If the fast path is not used, print the statistics after compilation.
+        """
+        if self.options.tiny_task <= 0 or self.options.require_slicer:
+            self._get_stats('After compilation ')
+            return
+
+        # the statistics are printed by the same run that counts the instructions
+        prefix = 'INFO: After compilation ' if self.options.stats else None
+        count = self._count_instructions(prefix)
+        if count is None or count >= self.options.tiny_task:
+            return
+
+        print_stdout('INFO: The program is tiny ({0} instructions), '
+                     'skipping slicing and optimizations'.format(count),
+                     color='WHITE')
+        self.options.noslice = True
+        self.options.repeat_slicing = 1
+        self.options.optlevel = []
+        self.options.stats = False
+
+    def _features_file(self):
+        """
+        The file for the features of the program: the one given
+        by --features, or a file in the working directory if only
+        the profiles of KLEE or the ordering of the verifiers need them
+        (None if nobody needs them)
+        """
+        if self.options.features:
+            return self.options.features
+        if self.options.klee_profiles or self.options.adaptive_verifiers:
+            return os.path.abspath('features.json')
+        return None
+
+    def _compute_features(self):
+        """
+        Store the features of the program (see -classify-instructions)
+        into the file given by --features
+        """
+        features = self._features_file()
+        if not features:
+            return
+
+        passes = ['-classify-instructions',
+                  '-classify-instructions-json={0}'.format(features)]
+        if self._use_pipeline():
+            self._pending_stages.append(('features', passes))
+            return
+
+        cmd = ['opt', '-load', 'LLVMsbt.so', '-o', '/dev/null',
+               self.curfile] + passes
+        self._set_pass_manager(cmd)
+
+        try:
+            runcmd(cmd, PrepareWatch(), 'Failed running opt')
+        except SymbioticException:
+            # not fatal, continue working
+            dbg('Failed getting the features of the program')
+
+    def _check_module(self):
+        """
+        Get the summary of the features that decide which verifier to use
+        (see -check-module-summary) right after compilation, so that the tool
+        can choose the verifiers before instrumentation and slicing
+        """
+        if not hasattr(self._tool, 'set_module_summary'):
+            return
+
+        output = os.path.abspath('module-summary.json')
+        passes = ['-check-module', '-check-module-summary={0}'.format(output)]
+        try:
+            if self._use_pipeline():
+                self._pending_stages.append(('check-module', passes))
+                self._flush_pipeline()
+            else:
+                cmd = ['opt', '-load', 'LLVMsbt.so', '-o', '/dev/null',
+                       self.curfile] + passes
+                self._set_pass_manager(cmd)
+                runcmd(cmd, PrepareWatch(), 'Failed running opt')
+
+            with open(output, 'r') as f:
+                summary = json.load(f)
+        except (SymbioticException, IOError, OSError, ValueError) as e:
+            # not fatal, the tool just does not learn anything
+            dbg('Failed checking the module: {0}'.format(str(e)))
+            return
+
+        if summary.get('version') != 1:
+            dbg('Unknown version of the summary of the module, ignoring it')
+            return
+
+        self._tool.set_module_summary(summary)
+
+    def _load_features(self):
+        """
+        Give the features stored by _compute_features() to the tool
+        (and keep them in the options for the verifiers)
+        """
+        path = self._features_file()
+        if not path:
+            return
+
+        # make sure that the pending stages have run
+        self._flush_pipeline()
+        try:
+            with open(path, 'r') as f:
+                features = json.load(f)
+        except (IOError, OSError, ValueError) as e:
+            dbg('Failed loading the features of the program: {0}'.format(str(e)))
+            return
+
+        if features.get('version') != 1:
+            dbg('Unknown version of the features of the program, ignoring them')
+            return
+
+        self.options.program_features = features
+        if hasattr(self._tool, 'set_features'):
+            self._tool.set_features(features)
+
+    def _get_tool_stage(self, tool, timeout):
+        """
+        The library that runs the tool in sbt-pipeline on the module
+        in memory (lib<tool>-stage.so next to the executables, see
+        --in-process-tools), None if the tool should run as a process:
+        there is no such library or the tool has a timeout (sbt-pipeline
+        cannot stop a tool in the middle and keep the old module)
+        """
+        if not self.options.in_process_tools or timeout > 0 or\
+           not self._use_pipeline():
+            return None
+
+        name = 'lib{0}-stage.so'.format(os.path.basename(tool))
+        for d in os.environ.get('PATH', '').split(os.pathsep):
+            for lib in (os.path.join(d, name),
+                        os.path.join(d, '..', 'lib', name)):
+                if os.path.isfile(lib):
+                    return os.path.abspath(lib)
+        dbg("Did not find '{0}', running '{1}'".format(name, tool))
+        return None
+
+    def _run_tool_stage(self, stage, lib, args):
+        """ Run the tool from the library as a stage of sbt-pipeline """
+        budget = self._growth_budget(stage, [], stage == 'instrumentation')
+        self._pending_stages.append((stage, ['-tool-stage={0}'.format(lib)] +
+                                            ['-tool-arg={0}'.format(a)
+                                             for a in args] + budget))
+        self._save_ll(stage)
 
     def _instrument(self):
         if not hasattr(self._tool, 'instrumentation_options'):
@@ -327,10 +919,11 @@ class SymbioticCC(object):
             assert os.path.isfile(definitions)
 
         # module with defintions of instrumented functions
+        # (sbt-instr only reads it, so it is used right from the cache)
         if not definitionsbc:
             definitionsbc = os.path.abspath(self._compile_to_llvm(definitions,\
                  output=os.path.basename(definitions[:-2]+'.bc'),
-                 with_g=False, opts=['-O3']))
+                 with_g=False, opts=['-O3'], cache='stamp'))
 
         assert definitionsbc
 
@@ -338,8 +931,20 @@ class SymbioticCC(object):
         print_stdout('INFO: Starting instrumentation', color='WHITE')
 
         output = '{0}-inst.bc'.format(self.curfile[:self.curfile.rfind('.')])
-        if self.options.instrumentation_timeout > 0:
-            cmd = ['timeout', str(self.options.instrumentation_timeout)]
+        # leave the rest of the budget for slicing
+        timeout = self._preprocessing_timeout(self.options.instrumentation_timeout,
+                                              0.5)
+        stage = self._get_tool_stage('sbt-instr', timeout)
+        if stage:
+            args = [config, definitionsbc]
+            if not shouldlink:
+                args.append('--no-linking')
+            self._run_tool_stage('instrumentation', stage, args)
+            self._get_stats('After instrumentation ')
+            return
+
+        if timeout > 0:
+            cmd = ['timeout', str(timeout)]
         else:
             cmd = []
 
@@ -364,6 +969,9 @@ class SymbioticCC(object):
             # since it depends on instrumentation
             if not self.options.full_instrumentation and\
                     (retval == 124 or self.options.sv_comp):
+                if retval == 124:
+                    print_stdout('INFO: Instrumentation timeouted, using '
+                                 'the uninstrumented file without slicing')
                 self.options.noslice = True
                 self.options.no_optimize = False
                 self.options.optlevel = []
@@ -372,8 +980,9 @@ class SymbioticCC(object):
             print_elapsed_time('INFO: Instrumentation [FAILED] time', color='WHITE')
         else:
             print_elapsed_time('INFO: Instrumentation time', color='WHITE')
-            self.curfile = output
-            self._save_ll()
+            old, self.curfile = self.curfile, output
+            self._superseded(old)
+            self._save_ll('instrumentation')
 
         self._get_stats('After instrumentation ')
 
@@ -385,6 +994,15 @@ class SymbioticCC(object):
 
     def link(self, libs, output=None):
         assert libs
+        # link into the module in sbt-pipeline, it does not need
+        # to be written and loaded again
+        if output is None and self._curfile and self._use_pipeline():
+            self._pending_stages.append(('link',
+                                         ['-link={0}'.format(os.path.abspath(l))
+                                          for l in libs]))
+            self._save_ll('link')
+            return
+
         if output is None:
             output = '{0}-ln.bc'.format(
                 self.curfile[:self.curfile.rfind('.')])
@@ -395,10 +1013,11 @@ class SymbioticCC(object):
 
         runcmd(cmd, DbgWatch('compile'),
                'Failed linking llvm file with libraries')
-        self.curfile = output
-        self._save_ll()
+        old, self.curfile = self.curfile, output
+        self._superseded(old)
+        self._save_ll('link')
 
-    def _link_undefined(self, undefs):
+    def _get_model_path(self, undef):
         def _get_path(symbdir, llvmver, ty, tool, undef):
             # check also if we have precompiled .bc files
             if self.options.is32bit:
@@ -426,30 +1045,107 @@ class SymbioticCC(object):
 
             return None
 
-        def get_path(symbdir, llvmver, tool, undef):
-            # return the first found definition (in the order of linkundef)
-            for ty in self.options.linkundef:
-                path = _get_path(symbdir, llvmver, ty, tool, undef)
-                if path:
-                    return path
+        # return the first found definition (in the order of linkundef)
+        for ty in self.options.linkundef:
+            path = _get_path(self.env.symbiotic_dir, self._tool.llvm_version(),
+                             ty, self._tool.name().lower(), undef)
+            if path:
+                return path
+        return None
+
+    def _compile_model(self, undef):
+        """
+        Find and compile the model of the function 'undef'.
+        Return the pair (compiled file, model path) or None.
+        """
+        path = self._get_model_path(undef)
+        if path is None:
             return None
 
+        future = self._prefetched.pop(path, None)
+        if future:
+            # (re-raises the error if the compilation failed)
+            output = future.result()
+        else:
+            output = self._compile_model_file(path)
 
-        tolink = []
-        for undef in undefs:
-            path = get_path(self.env.symbiotic_dir, self._tool.llvm_version(),
-                            self._tool.name().lower(), undef)
-            if path is None:
-                continue
+        # for debugging
+        self._linked_functions.append(undef)
 
-            basename = os.path.basename(path)
-            bcfile='{0}.bc'.format(basename[:basename.rfind('.')])
-            output = os.path.abspath(bcfile)
-            self._compile_to_llvm(path, output)
-            tolink.append(output)
+        return output, path
 
-            # for debugging
-            self._linked_functions.append(undef)
+    def _compile_model_file(self, path):
+        basename = os.path.basename(path)
+        bcfile='{0}.bc'.format(basename[:basename.rfind('.')])
+        output = os.path.abspath(bcfile)
+        self._compile_to_llvm(path, output, cache=True)
+        return output
+
+    def _prefetch_models(self):
+        """
+        Start compiling the models that will (likely) be linked:
+        the models of the undefined functions of the compiled program
+        (and of what they need according to the index of models)
+        and the files to link. The preprocessing runs meanwhile,
+        _compile_model then only waits for the compiled file.
+        A model that is not linked in the end is just not used.
+        """
+        names = list(self.options.link_files)
+        # (sbt-pipeline links the models from the archive of
+        # precompiled models, there is nothing to compile)
+        if self.options.linkundef and not self._get_models_archive():
+            names += self.options.link_files_before_slicing or []
+            names += ['atexit', 'qsort']
+            defined, undefs = self._get_symbols([self.curfile])[self.curfile]
+            index = self._load_symbol_index()
+            known = set(defined)
+            while undefs:
+                new = []
+                for undef in undefs:
+                    if undef in known:
+                        continue
+                    known.add(undef)
+                    names.append(undef)
+                    path = self._get_model_path(undef)
+                    if path in index:
+                        new += index[path][1]
+                undefs = new
+
+        paths = []
+        for name in names:
+            path = self._get_model_path(name)
+            if path and path not in self._prefetched and path not in paths:
+                paths.append(path)
+        if not paths:
+            return
+
+        # (create the cache here, not in the threads)
+        self._get_bitcode_cache()
+        workers = min(len(paths), len(os.sched_getaffinity(0)))
+        dbg('Compiling {0} models in the background'.format(len(paths)))
+        self._prefetch_pool = ThreadPoolExecutor(max_workers=workers)
+        for path in paths:
+            self._prefetched[path] =\
+                self._prefetch_pool.submit(self._compile_model_file, path)
+
+    def _stop_prefetching(self):
+        """ Drop the models that were compiled in vain """
+        if self._prefetch_pool is None:
+            return
+        for future in self._prefetched.values():
+            future.cancel()
+        # wait for the running compilations, they write into
+        # the working directory
+        self._prefetch_pool.shutdown(wait=True)
+        self._prefetch_pool = None
+        self._prefetched = {}
+
+    def _link_undefined(self, undefs):
+        tolink = []
+        for undef in undefs:
+            model = self._compile_model(undef)
+            if model:
+                tolink.append(model[0])
 
         if tolink:
             self.link(libs=tolink)
@@ -462,28 +1158,140 @@ class SymbioticCC(object):
 
         return self._link_undefined(self.options.link_files)
 
-    def _get_undefined(self, bitcode, only_func=None):
-        cmd = ['llvm-nm', '--undefined-only', '-j', bitcode]
+    def _load_symbol_index(self):
+        """
+        Load the index of symbols of precompiled models
+        (generated by precompile_bitcode_files.sh). Every line of the
+        index is 'file<TAB>defined symbols<TAB>undefined symbols'.
+        """
+        if self._symbol_index is not None:
+            return self._symbol_index
+
+        self._symbol_index = {}
+        libdir = 'lib32' if self.options.is32bit else 'lib'
+        idxdir = os.path.join(self.env.symbiotic_dir,
+                              'llvm-{0}'.format(self._tool.llvm_version()),
+                              libdir)
+        idxfile = os.path.join(idxdir, 'symbols.idx')
+        if not os.path.isfile(idxfile):
+            dbg("No index of models' symbols ({0})".format(idxfile))
+            return self._symbol_index
+
+        with open(idxfile, 'r') as f:
+            for line in f:
+                parts = line.rstrip('\n').split('\t')
+                if len(parts) != 3:
+                    continue
+                path = os.path.abspath(os.path.join(idxdir, parts[0]))
+                self._symbol_index[path] = (parts[1].split(), parts[2].split())
+
+        return self._symbol_index
+
+    def _get_symbols(self, bitcodes):
+        """
+        Get defined and undefined symbols of the given bitcode files
+        using one run of llvm-nm. Return {file: (defined, undefined)}.
+        """
+        result = {bc: ([], []) for bc in bitcodes}
+        if not bitcodes:
+            return result
+
+        cmd = ['llvm-nm'] + bitcodes
         watch = ProcessWatch(None)
-        runcmd(cmd, watch, 'Failed getting undefined symbols from bitcode')
-        undefs = list(map(lambda s: s.strip().decode('ascii'), watch.getLines()))
-        if only_func:
-            return [x for x in undefs if x in only_func]
-        return undefs
+        runcmd(cmd, watch, 'Failed getting symbols from bitcode')
+
+        # with more files, llvm-nm prints 'file:' before the symbols of file
+        cur = bitcodes[0] if len(bitcodes) == 1 else None
+        for line in watch.getLines():
+            line = line.decode('utf-8').rstrip()
+            if not line:
+                continue
+            if line.endswith(':') and line[:-1] in result:
+                cur = line[:-1]
+                continue
+
+            parts = line.split()
+            if cur is None or len(parts) < 2:
+                continue
+
+            ty, name = parts[-2], parts[-1]
+            if ty in ('U', 'w', 'v'):
+                result[cur][1].append(name)
+            else:
+                result[cur][0].append(name)
+
+        return result
 
     def _rec_link_undefined(self, only_func=None):
-        # get undefined functions from the bitcode
-        undefs = self._get_undefined(self.curfile, only_func)
-        if self._link_undefined(undefs):
-            # if we linked someting, try get undefined again,
-            # because the functions may have added some new undefined
-            # functions
-            self._rec_link_undefined()
+        """
+        Compute the transitive closure of models needed by the undefined
+        functions of the current file and link them all at once
+        """
+        defined, undefs = self._get_symbols([self.curfile])[self.curfile]
+        if only_func:
+            undefs = [x for x in undefs if x in only_func]
+
+        index = self._load_symbol_index()
+        known = set(defined)
+        tolink = []
+        while undefs:
+            models = []
+            for undef in undefs:
+                if undef in known:
+                    continue
+                known.add(undef)
+                model = self._compile_model(undef)
+                if model:
+                    models.append(model)
+
+            # the models may have added some new undefined functions,
+            # get their symbols from the index or from llvm-nm
+            notindexed = [out for (out, path) in models if path not in index]
+            symbols = self._get_symbols(notindexed)
+            undefs = []
+            for out, path in models:
+                d, u = index[path] if path in index else symbols[out]
+                known.update(d)
+                undefs += u
+                tolink.append(out)
+
+        if tolink:
+            self.link(libs=tolink)
+
+    def _get_models_archive(self):
+        """
+        Get the library of all precompiled models for the current tool and
+        order of the models (made by precompile_bitcode_files.sh), if we can
+        use it. sbt-pipeline links from it lazily only the needed functions.
+        """
+        if not self._use_pipeline():
+            return None
+
+        libdir = 'lib32' if self.options.is32bit else 'lib'
+        path = os.path.join(self.env.symbiotic_dir,
+                            'llvm-{0}'.format(self._tool.llvm_version()),
+                            libdir, 'models-{0}-{1}.bc'.format(
+                                self._tool.name().lower(),
+                                '+'.join(self.options.linkundef)))
+        if os.path.isfile(path):
+            return path
+        return None
 
     def link_undefined(self, only_func=None):
         if not self.options.linkundef:
             return
 
+        archive = self._get_models_archive()
+        if archive:
+            dbg("Linking the needed models from '{0}'".format(archive))
+            args = ['-link-needed={0}'.format(archive)]
+            if only_func:
+                # link only these functions (and what they need)
+                args.append('-link-only={0}'.format(','.join(only_func)))
+            self._pending_stages.append(('link-models', args))
+            self._save_ll('link-models')
+            return
+
         self._linked_functions = [] # for printing
         self._rec_link_undefined(only_func)
 
@@ -493,6 +1301,33 @@ class SymbioticCC(object):
                 print_stdout('  ', print_nl=False)
                 print_stdout(f)
 
+    def _normalize_error_sites_passes(self):
+        """
+        The passes for -normalize-error-sites according to the property
+        """
+        prp = self.options.property
+        passes = []
+        if prp.memsafety() or \
+           prp.undefinedness() or \
+           prp.signedoverflow() or \
+           prp.termination() or \
+           prp.memcleanup():
+            passes.append('-normalize-error-sites-remove')
+            if prp.memcleanup() or prp.termination():
+                passes.append('-normalize-error-sites-use-exit')
+
+        if (prp.undefinedness() or prp.signedoverflow()) and \
+           not self.options.witness_check:
+            if prp.signedoverflow() and not self.options.overflow_with_clang:
+                # the overflows are checked by -prepare-overflows
+                passes.append('-normalize-error-sites-ubsan=remove-keep-shifts')
+            else:
+                passes.append('-normalize-error-sites-ubsan=replace')
+
+        if passes:
+            passes.insert(0, '-normalize-error-sites')
+        return passes
+
     def slicer(self, add_params=[]):
         if hasattr(self._tool, 'slicer_options'):
             crit, opts = self._tool.slicer_options()
@@ -504,11 +1339,7 @@ class SymbioticCC(object):
         output = '{0}.sliced'.format(self.curfile[:self.curfile.rfind('.')])
 
 
-        if self.options.slicer_timeout > 0:
-            cmd = ['timeout', str(self.options.slicer_timeout)] +\
-                   self.options.slicer_cmd + ['-c', ",".join(crit)] + opts
-        else:
-            cmd = self.options.slicer_cmd + ['-c', ",".join(crit)] + opts
+        cmd = self.options.slicer_cmd + ['-c', ",".join(crit)] + opts
 
         if self.options.slicer_pta in ['fi', 'fs']:
             cmd.append('-pta')
@@ -526,6 +1357,24 @@ class SymbioticCC(object):
         if add_params:
             cmd += add_params
 
+        timeout = self._preprocessing_timeout(self.options.slicer_timeout, 1.0)
+        stage = self._get_tool_stage(cmd[0], timeout)
+        if stage:
+            self._run_tool_stage('slicing', stage, cmd[1:])
+            return
+
+        # the slicer (and its pointer analysis) gives the same result
+        # for the same module, e.g., when the repeated slicing reached
+        # a fixpoint or in the next run of the same program
+        key = self._get_sliced_key(cmd)
+        if key and self._get_bitcode_cache().get(key, output):
+            old, self.curfile = self.curfile, output
+            self._superseded(old)
+            self._save_ll('slicing')
+            return
+
+        if timeout > 0:
+            cmd = ['timeout', str(timeout)] + cmd
         cmd.append(self.curfile)
 
         watch = SlicerWatch()
@@ -544,14 +1393,76 @@ class SymbioticCC(object):
             # act as the slicing was disabled
             self.options.noslice = True
         else:
-            self.curfile = output
-            self._save_ll()
+            old, self.curfile = self.curfile, output
+            self._superseded(old)
+            if key:
+                self._get_bitcode_cache().put(key, output)
+            self._save_ll('slicing')
 
-    def optimize(self, passes, disable=[], load_sbt = False):
+    def _get_sliced_key(self, cmd):
+        """
+        The key of the sliced module in the cache, computed from the current
+        file and the slicer command (without the file). None if there
+        is no cache.
+        """
+        bccache = self._get_bitcode_cache()
+        if bccache is None:
+            return None
+
+        VERSION, versions, llvm_version, _ = get_versions()
+        keycmd = ['sliced', VERSION, llvm_version]
+        keycmd += ['{0}={1}'.format(k, v) for (k, v) in sorted(versions.items())]
+        return bccache.key(self.curfile, keycmd + cmd)
+
+    def run_opt_parts(self, parts, stage='opt'):
+        """
+        Run the list of (passes, run_if) as run_opt() does. With
+        sbt-pipeline, every part is a stage of its own, so that the
+        conditional parts can be skipped. Without it, all the passes
+        are run by one opt process.
+        """
+        if self._use_pipeline():
+            for passes, run_if in parts:
+                self.run_opt(passes, stage, run_if)
+        else:
+            self.run_opt([p for passes, _ in parts for p in passes], stage)
+
+    def optimize_parts(self, parts, load_sbt = False):
+        """ The same as run_opt_parts() for optimize() """
+        if self._use_pipeline():
+            for passes, run_if in parts:
+                self.optimize(passes, load_sbt=load_sbt, run_if=run_if)
+        else:
+            self.optimize([p for passes, _ in parts for p in passes],
+                          load_sbt=load_sbt)
+
+    def _get_optlist(self, when):
+        """
+        The optimizations 'before' or 'after' slicing: the pipeline tuned
+        for the target and LLVM from --opt-pipelines if there is one,
+        the levels from --optimize otherwise
+        """
+        if self.options.opt_pipelines and self.options.optlevel:
+            pipeline = get_pipeline(self.options.opt_pipelines,
+                                    self._tool.name().lower(),
+                                    self._tool.llvm_version())
+            if pipeline and when in pipeline:
+                dbg('Using the tuned optimizations {0} slicing'.format(when))
+                return list(pipeline[when])
+
+        if when == 'before':
+            return get_optlist_before(self.options.optlevel)
+        return get_optlist_after(self.options.optlevel)
+
+    def optimize(self, passes, disable=[], load_sbt = False, run_if=None):
         if not passes or self.options.no_optimize:
             return
 
-        disable += self.options.disabled_optimizations
+        disable = disable + self.options.disabled_optimizations
+        if self.options.opt_pipelines:
+            disable = disable + get_harmful(self.options.opt_pipelines,
+                                            self._tool.name().lower(),
+                                            self._tool.llvm_version())
         if disable:
             passes = filter(lambda x: x not in disable, passes)
 
@@ -561,20 +1472,92 @@ class SymbioticCC(object):
         if not passes:
             dbg("No passes available for optimizations")
 
+        # (the conditional parts are small, they are not worth splitting)
+        if self.options.split_optimize > 1 and run_if is None:
+            passes = self._optimize_split(list(passes), load_sbt)
+            if not passes:
+                return
+
+        if self._use_pipeline():
+            passes = list(passes)
+            if not passes:
+                return
+            passes += self._growth_budget('optimize', passes)
+            if run_if:
+                passes.append('-run-if={0}'.format(run_if))
+            self._pending_stages.append(('optimize', passes))
+            self._save_ll('optimize')
+            return
+
         output = '{0}-opt.bc'.format(self.curfile[:self.curfile.rfind('.')])
         cmd = ['opt']
         if load_sbt:
             cmd += ['-load', 'LLVMsbt.so']
-        self._disable_new_pm(cmd)
+        self._set_pass_manager(cmd)
         cmd += ['-o', output, self.curfile]
         cmd += passes
 
         restart_counting_time()
-        runcmd(cmd, CompileWatch(), 'Optimizing the code failed')
+        if self._run_limited(cmd, 'Optimizing the code failed').out_of_memory:
+            self._degrade_stage('optimize', passes)
+            return
         print_elapsed_time('INFO: Optimizations time', color='WHITE')
 
-        self.curfile = output
-        self._save_ll()
+        old, self.curfile = self.curfile, output
+        self._superseded(old)
+        self._save_ll('optimize')
+
+    def _optimize_split(self, passes, load_sbt):
+        """
+        Split the current file into partitions (llvm-split keeps together
+        the functions that share internal symbols, so no symbol changes its
+        linkage), run the passes that do not need the whole module on the
+        partitions in parallel and link the partitions back. Return the rest
+        of the passes, they should be run on the linked module.
+        """
+        local = [p for p in passes if p not in GLOBAL_OPT_PASSES]
+        rest = [p for p in passes if p in GLOBAL_OPT_PASSES]
+        if not local:
+            return rest
+
+        parts = self.options.split_optimize
+        base = self.curfile[:self.curfile.rfind('.')]
+        prefix = '{0}-part'.format(base)
+        restart_counting_time()
+        runcmd(['llvm-split', '-preserve-locals', '-j', str(parts),
+                '-o', prefix, self.curfile],
+               DbgWatch('compile'), 'Splitting the module failed')
+
+        def optimize_part(n):
+            part = '{0}{1}'.format(prefix, n)
+            output = '{0}-opt.bc'.format(part)
+            cmd = ['opt']
+            if load_sbt:
+                cmd += ['-load', 'LLVMsbt.so']
+            self._set_pass_manager(cmd)
+            cmd += ['-o', output, part] + local
+            if self._run_limited(cmd, 'Optimizing the code failed').out_of_memory:
+                # the optimizations are not needed, keep the partition
+                return part
+            self._superseded(part)
+            return output
+
+        workers = min(parts, len(os.sched_getaffinity(0)))
+        dbg('Optimizing {0} partitions, {1} at once'.format(parts, workers))
+        with ThreadPoolExecutor(max_workers=workers) as pool:
+            outputs = list(pool.map(optimize_part, range(parts)))
+
+        output = '{0}-opt.bc'.format(base)
+        runcmd(['llvm-link', '-o', output] + outputs,
+               DbgWatch('compile'), 'Linking the partitions failed')
+        for part in outputs:
+            self._superseded(part)
+        print_elapsed_time('INFO: Optimizations of partitions time', color='WHITE')
+
+        old, self.curfile = self.curfile, output
+        self._superseded(old)
+        self._save_ll('optimize')
+        return rest
 
     def _compile_sources(self, output='code.bc'):
         """
@@ -600,25 +1583,131 @@ class SymbioticCC(object):
 
         opts += self.cc_disable_optimizations()
 
+        # clang 12 marks the loops that must make progress (the C11 loops
+        # with a non-constant condition, all C++ loops), the optimizations
+        # then remove them (and take them as terminating) even if they
+        # do not terminate
+        if int(llvm_major(self._tool.llvm_version())) >= 12:
+            opts.append('-fno-finite-loops')
+
+        if self.options.incremental:
+            # the working directory is different in every run, do not let
+            # it get into the debugging information (and so into the key
+            # of the transformed program in the cache)
+            opts.append('-fdebug-prefix-map={0}=.'.format(os.getcwd()))
+
         llvmsrc = []
+        tocompile = []
         options = self.options
         for source in self.sources:
             if options.source_is_bc:
                 dbg("Treating '{0}' as LLVM bitcode (required)".format(source))
-                llvms = source
+                llvmsrc.append(source)
             elif source.endswith('.bc') or source.endswith('.ll'):
                 dbg("Treating '{0}' as LLVM bitcode (according to suffix)".format(source))
-                llvms = source
+                llvmsrc.append(source)
             else:
-                llvms = self._compile_to_llvm(source, opts=opts)
-            llvmsrc.append(llvms)
+                tocompile.append((len(llvmsrc), source))
+                llvmsrc.append(None)
+
+        # the sources from different directories may have the same name
+        outputs = set()
+        def get_output(n, source):
+            basename = os.path.basename(source)
+            output = '{0}.bc'.format(basename[:basename.rfind('.')])
+            if output in outputs:
+                output = '{0}-{1}.bc'.format(basename[:basename.rfind('.')], n)
+            outputs.add(output)
+            return output
+
+        tocompile = [(n, source, get_output(n, source)) for (n, source) in tocompile]
+        workers = min(len(tocompile), len(os.sched_getaffinity(0)))
+        if workers > 1:
+            dbg('Compiling {0} files, {1} at once'.format(len(tocompile), workers))
+            with ThreadPoolExecutor(max_workers=workers) as pool:
+                futures = [(n, pool.submit(self._compile_to_llvm, source,
+                                           output=output, opts=opts))
+                           for (n, source, output) in tocompile]
+                # result() re-raises the exception if compilation failed
+                for n, future in futures:
+                    llvmsrc[n] = future.result()
+        else:
+            for n, source, output in tocompile:
+                llvmsrc[n] = self._compile_to_llvm(source, output=output, opts=opts)
 
         # link all compiled sources to a one bitecode
         # the result is stored to self.curfile
         dbg("Linking all input files into one file")
         self.link(llvmsrc, output)
 
+    def pre_slice(self):
+        """
+        Cheaply remove the code that the slicer would remove anyway,
+        so that its pointer analysis works with a smaller module
+        """
+        passes = []
+        # the removed calls may not terminate
+        if not self.options.property.termination():
+            crit = ['__assert_fail', '__VERIFIER_error']
+            if hasattr(self._tool, 'slicer_options'):
+                crit, _ = self._tool.slicer_options()
+            passes.append('-pre-slice')
+            passes.append('-pre-slice-criteria={0}'.format(','.join(crit)))
+        passes.append('-prune-unreachable')
+        self.run_opt(passes, stage='pre-slice')
+
+    def _find_criteria_sites(self, crit=None):
+        """
+        The calls of the slicing criteria (or of the functions crit)
+        that can be executed (see -find-criteria), None if we do not know
+        """
+        if crit is None and hasattr(self._tool, 'slicer_options'):
+            crit, _ = self._tool.slicer_options()
+        elif crit is None:
+            crit = ['__assert_fail', '__VERIFIER_error']
+
+        output = os.path.abspath('criteria-sites.txt')
+        self.run_opt(['-find-criteria',
+                      '-find-criteria-fn={0}'.format(','.join(crit)),
+                      '-find-criteria-output={0}'.format(output)],
+                     stage='find-criteria')
+        self._flush_pipeline()
+        try:
+            with open(output, 'r') as f:
+                return [l.strip() for l in f if l.strip()]
+        except (IOError, OSError) as e:
+            dbg('Failed reading the criteria sites: {0}'.format(str(e)))
+            return None
+
+    def _check_error_sites(self):
+        """
+        Answer 'true' at once if no error function can be called.
+        Only for the properties that are violated just by the calls
+        of the error functions, the verifiers check the memory safety,
+        overflows etc. also on their own.
+        """
+        prp = self.options.property
+        if not prp.unreachcall() or prp.memsafety() or prp.signedoverflow() or\
+           prp.termination() or self.options.full_instrumentation:
+            return
+
+        # __VERIFIER_assert is linked later and calls __VERIFIER_error
+        fns = set(prp.getcalls())
+        fns.update(['__VERIFIER_error', '__assert_fail', '__INSTR_fail',
+                    '__VERIFIER_assert'])
+        sites = self._find_criteria_sites(sorted(fns))
+        if sites is not None and not sites:
+            print_stdout('INFO: No call of the error functions can be executed',
+                         color='WHITE')
+            raise SymbioticExceptionalResult('true')
+
     def perform_slicing(self):
+        self.pre_slice()
+
+        sites = self._find_criteria_sites()
+        if sites is not None:
+            dbg('Slicing criteria sites: {0}'.format(len(sites)))
+
         self._get_stats('Before slicing ')
 
         add_params = []
@@ -632,12 +1721,18 @@ class SymbioticCC(object):
             # if n == 0 and self.options.repeat_slicing > 1:
             #    add_params = ['-pta-field-sensitive=8']
 
+            before = file_digest(self.curfile)
             self.slicer(add_params)
 
             if self.options.repeat_slicing > 1:
-                opt = get_optlist_after(self.options.optlevel)
+                opt = self._get_optlist('after')
                 self.optimize(opt + ['-remove-infinite-loops'], load_sbt=True)
 
+                # the next rounds would analyze the same module again
+                if file_digest(self.curfile) == before:
+                    dbg('Slicing reached a fixpoint after {0} round(s)'.format(n + 1))
+                    break
+
         print_elapsed_time('INFO: Total slicing time', color='WHITE')
 
         self._get_stats('After slicing ')
@@ -646,11 +1741,13 @@ class SymbioticCC(object):
         if hasattr(self._tool, 'actions_after_slicing'):
             self._tool.actions_after_slicing(self)
 
-        passes = []
+        parts = []
 
         # there may have been created new loops
         if not self.options.property.termination():
-            passes.append('-remove-infinite-loops')
+            parts.append((['-remove-infinite-loops'], INFINITE_LOOPS))
+
+        passes = []
 
         # side-effects, because LLVM optimizations could remove them otherwise,
         # even though they contain calls to assert
@@ -660,15 +1757,27 @@ class SymbioticCC(object):
 
         if hasattr(self._tool, 'passes_after_slicing'):
             passes += self._tool.passes_after_slicing()
-        self.run_opt(passes)
+        parts.append((passes, None))
+        self.run_opt_parts(parts, stage='after-slicing')
 
         # link undefined functions at this point
         self.link_undefined()
+        # the callbacks in the linked models can be called directly
+        # (and inlined by the optimizations)
+        self.run_opt(['-devirtualize-calls'], stage='devirtualize')
+        # the linked models and the translation units may bring identical
+        # helpers, every function costs the verifiers some setup
+        self.run_opt(['-merge-identical-functions'], stage='merge-functions')
 
         # optimize the code after slicing and linking and before verification
-        opt = get_optlist_after(self.options.optlevel)
+        opt = self._get_optlist('after')
         self.optimize(passes=opt)
 
+        # the markers of allocations (-dummy-marker) were needed only
+        # by the optimizations, the verifiers do not need to execute them
+        if self.options.property.memsafety():
+            self.run_opt(['-strip-dummy-markers'], stage='strip-markers')
+
         print_elapsed_time('INFO: After-slicing optimizations and transformations time',
                            color='WHITE')
 
@@ -731,6 +1840,248 @@ class SymbioticCC(object):
             dbg('Renamed these optimizations: %s' % renames)
         self._opt_renames = renames
 
+    # options that do not change how the program is transformed
+    _INCREMENTAL_IGNORED_OPTS = ('--output', '--witness', '--test-suite',
+                                 '--features', '--pass-report', '--report',
+                                 '--statistics', '--debug', '--timeout',
+                                 '--cache-dir', '--incremental',
+                                 '--working-dir-prefix', '--no-verification',
+                                 '--parallel-verifiers', '--no-pipeline',
+                                 '--gen-ll', '--gen-c', '--exit-on-error',
+                                 '--result-cache', '--split-input', '--trace',
+                                 '--remote-workers', '--merge-hints',
+                                 '--tmpfs', '--klee-profiles',
+                                 '--incremental-verification', '--resume')
+
+    # the options only of the verifier, so that sweeps over its settings
+    # reuse the transformed program (but not the results)
+    _VERIFIER_ONLY_OPTS = ('--verifier-params', '--profile-verification',
+                           '--query-cache', '--query-cache-size',
+                           '--replay-error', '--no-replay-error',
+                           '--no-witness', '--witness-with-source-lines',
+                           '--save-files')
+
+    def _get_incremental_key(self):
+        """
+        The key of the transformed program in the cache (see --incremental).
+        The key is computed from the compiled program, from the options that
+        may change the transformations and from the versions of Symbiotic.
+        Return None if we should not use the cache.
+        """
+        if not self.options.incremental or self.options.witness_check:
+            return None
+
+        bccache = self._get_bitcode_cache()
+        if bccache is None:
+            return None
+
+        VERSION, versions, llvm_version, _ = get_versions()
+        cmd = ['transformed', self._tool.name(), VERSION, llvm_version]
+        cmd += ['{0}={1}'.format(k, v) for (k, v) in sorted(versions.items())]
+        for opt, arg in self.options.cmdline:
+            if opt in self._INCREMENTAL_IGNORED_OPTS or\
+               opt in self._VERIFIER_ONLY_OPTS:
+                continue
+            cmd.append('{0}={1}'.format(opt, arg))
+            # the property may be given in a file
+            if opt == '--prp' and os.path.isfile(arg):
+                with open(arg, 'r') as f:
+                    cmd.append(f.read())
+
+        return bccache.key(self.curfile, cmd)
+
+    def _preprocessed_digest(self, source):
+        """ The hash of the source after running the preprocessor on it """
+        if self.options.source_is_bc or\
+           source.endswith('.bc') or source.endswith('.ll'):
+            return file_digest(source)
+
+        basename = os.path.basename(source)
+        output = '{0}.i'.format(basename[:basename.rfind('.')])
+        cmd = self._get_cc() + ['-E', '-D__inline=']
+        if self.options.witness_check:
+            cmd.append('-includewitch.h')
+        cmd += self.options.CFLAGS + self.options.CPPFLAGS
+        if self.options.is32bit:
+            cmd.append('-m32')
+        runcmd(cmd + ['-o', output, source], DbgWatch('compile'),
+               "Preprocessing source '{0}' failed".format(source))
+
+        digest = file_digest(output)
+        os.unlink(output)
+        return digest
+
+    def get_result_key(self):
+        """
+        The key of the result of the task in the result cache (see
+        --result-cache). The key is computed from the preprocessed sources,
+        from the options (and the files given as their arguments, e.g.,
+        the property) and from the versions of Symbiotic and the tools.
+        Return None if we should not use the cache.
+        """
+        if not self.options.result_cache or self.options.cache_dir is None:
+            return None
+        # the test-suites and executable witnesses are not cached
+        if self.options.test_comp or self.options.executable_witness:
+            return None
+
+        h = self._task_hash('result')
+        for source in self.sources:
+            h.update(self._preprocessed_digest(source).encode('ascii'))
+
+        return h.hexdigest()
+
+    def _task_hash(self, kind):
+        """
+        The hash of the options (and the files given as their arguments)
+        and of the versions of Symbiotic and the tools
+        """
+        from hashlib import sha256
+        h = sha256()
+
+        VERSION, versions, llvm_version, _ = get_versions()
+        cmd = [kind, self._tool.name(), VERSION, llvm_version]
+        cmd += ['{0}={1}'.format(k, v) for (k, v) in sorted(versions.items())]
+        for opt, arg in self.options.cmdline:
+            if opt in self._INCREMENTAL_IGNORED_OPTS:
+                continue
+            cmd.append('{0}={1}'.format(opt, arg))
+            if arg and os.path.isfile(arg):
+                cmd.append(file_digest(arg))
+        h.update('\0'.join(cmd).encode('utf-8'))
+        return h
+
+    def get_slice_key(self):
+        """
+        The key of the task in the cache of slices (see
+        --incremental-verification). Unlike the key of the result,
+        it does not depend on the contents of the sources, only on their
+        names, so that the versions of a program share the entry.
+        Return None if we should not use the cache.
+        """
+        if not self.options.incremental_verification or\
+           self.options.cache_dir is None or self.options.noslice:
+            return None
+        if self.options.test_comp or self.options.executable_witness:
+            return None
+
+        h = self._task_hash('slice')
+        for source in self.sources:
+            h.update(os.path.abspath(source).encode('utf-8'))
+            h.update(b'\0')
+        return h.hexdigest()
+
+    def get_slice_hashes(self):
+        """
+        The hashes of the functions and the globals in the sliced
+        program (see -hash-functions), None if we failed computing them
+        """
+        output = os.path.abspath('slice-hashes.json')
+        cmd = ['opt', '-load', 'LLVMsbt.so', '-hash-functions',
+               '-hash-functions-output={0}'.format(output),
+               '-o', '/dev/null', self.curfile]
+        self._set_pass_manager(cmd)
+        try:
+            runcmd(cmd, DbgWatch('all'), 'Failed hashing the sliced program')
+            with open(output, 'r') as f:
+                return json.load(f)
+        except (SymbioticException, IOError, OSError, ValueError) as e:
+            dbg(str(e))
+            return None
+
+    def _incremental_output(self, suffix):
+        return '{0}-{1}.bc'.format(self.curfile[:self.curfile.rfind('.')],
+                                   suffix)
+
+    def _load_transformed(self, key):
+        """
+        Get the transformed program (and the transformed program
+        before slicing) from the cache, return False if it is not there
+        """
+        bccache = self._get_bitcode_cache()
+        output = self._incremental_output('inc')
+        if not bccache.get(key, output):
+            return False
+
+        nonsliced = self._incremental_output('inc-nonsliced')
+        if not bccache.get('{0}-nonsliced'.format(key), nonsliced):
+            return False
+
+        self.nonsliced_llvmfile = nonsliced
+        self.curfile = output
+        self._save_ll('incremental')
+        return True
+
+    def _store_transformed(self, key):
+        bccache = self._get_bitcode_cache()
+        bccache.put('{0}-nonsliced'.format(key), self.nonsliced_llvmfile)
+        bccache.put(key, self.curfile)
+
+    def _get_checkpoints(self):
+        """
+        The checkpoints of the preprocessing (see --resume), created
+        lazily. The key of the checkpoints is computed from the sources,
+        from the options and from the versions of Symbiotic and the tools.
+        """
+        if self.options.resume is None:
+            return None
+
+        if self._checkpoints is None:
+            h = self._task_hash('checkpoint')
+            for source in self.sources:
+                h.update(file_digest(source).encode('ascii'))
+            self._checkpoints = Checkpoints(self.options.resume, h.hexdigest())
+        return self._checkpoints
+
+    def _checkpoint(self, stage):
+        """
+        Write the checkpoint of the finished stage: the current file
+        and the non-sliced file (after slicing)
+        """
+        checkpoints = self._get_checkpoints()
+        if checkpoints is None:
+            return
+
+        files = {'bc': self.curfile}
+        if stage in ('sliced', 'postprocessed'):
+            files['nonsliced.bc'] = self.nonsliced_llvmfile
+        checkpoints.save(stage, files)
+
+    def _load_checkpoint(self, stage):
+        """
+        Continue with the files of the checkpoint of the stage,
+        return False if the checkpoint is not valid
+        """
+        outputs = {'bc': os.path.abspath('resumed-{0}.bc'.format(stage)),
+                   'nonsliced.bc': os.path.abspath('resumed-nonsliced.bc')}
+        copied = self._get_checkpoints().load(stage, outputs)
+        if not copied or 'bc' not in copied:
+            return False
+
+        self.curfile = outputs['bc']
+        if 'nonsliced.bc' in copied:
+            self.nonsliced_llvmfile = outputs['nonsliced.bc']
+        return True
+
+    def _resume_stage(self):
+        """
+        The last stage that has a valid checkpoint (see --resume),
+        None if we must start from the beginning. The compiled program
+        is loaded here, the analyses that follow the compilation run on it
+        again (they only compute the state of this object and of the tool).
+        """
+        checkpoints = self._get_checkpoints()
+        if checkpoints is None:
+            return None
+
+        stage = checkpoints.latest()
+        if stage is None or not self._load_checkpoint('compiled'):
+            return None
+
+        print_stdout("INFO: Resuming after the stage '{0}'".format(stage),
+                     color='WHITE')
+        return stage
+
     def run(self):
         """
         Compile the program, optimize and slice it and
@@ -739,6 +2090,7 @@ class SymbioticCC(object):
         restart_counting_time()
 
         dbg('Running symbiotic-cc for {0}'.format(self._tool.name()))
+        self._remove_superseded = True
 
         self._disable_and_rename_optimizations(self._tool.llvm_version())
 
@@ -751,17 +2103,67 @@ class SymbioticCC(object):
         #  - compile the code into LLVM bitcode
         #################### #################### ###################
 
-        # compile all given sources
-        self._compile_sources()
+        # compile all given sources (or continue from the last
+        # checkpoint of a previous run, see --resume)
+        resumed = self._resume_stage()
+        if resumed is None:
+            with metrics.stage('compile'):
+                self._compile_sources()
+
+            # make the path absolute
+            self.curfile = os.path.abspath(self.curfile)
+            self._checkpoint('compiled')
+        self._save_ll('compile')
+
+        # compile the models that we are going to link while
+        # the program is preprocessed
+        self._prefetch_models()
+
+        self._check_tiny_task()
+        self._compute_features()
+        self._check_module()
+
+        key = self._get_incremental_key()
+        if key and self._load_transformed(key):
+            print_stdout('INFO: The program did not change, '
+                         'reusing the transformed program', color='WHITE')
+            return self._finish_run()
+
+        if resumed in ('instrumented', 'sliced', 'postprocessed') and\
+           not self._load_checkpoint(resumed):
+            resumed = 'compiled'
+        if resumed == 'postprocessed':
+            return self._finish_run()
+
+        if resumed not in ('instrumented', 'sliced'):
+            with metrics.stage('instrument'):
+                self._prepare_and_instrument()
+            self._checkpoint('instrumented')
+
+        if resumed != 'sliced':
+            with metrics.stage('slice'):
+                self._optimize_and_slice()
+            self._checkpoint('sliced')
+
+        # start a new time era
+        restart_counting_time()
 
-        # make the path absolute
-        self.curfile = os.path.abspath(self.curfile)
-        self._save_ll()
+        self.process_after_slicing()
+        self._checkpoint('postprocessed')
 
-        self._get_stats('After compilation ')
+        if key:
+            self._store_transformed(key)
 
+        return self._finish_run()
+
+    def _prepare_and_instrument(self):
+        """
+        Prepare the compiled program for instrumentation,
+        instrument it and post-process the instrumented program
+        """
         if hasattr(self._tool, 'passes_after_compilation'):
-            self.run_opt(self._tool.passes_after_compilation())
+            self.run_opt(self._tool.passes_after_compilation(),
+                         stage='after-compilation')
 
         if hasattr(self._tool, 'actions_after_compilation'):
             self._tool.actions_after_compilation(self)
@@ -771,7 +2173,14 @@ class SymbioticCC(object):
             self.run_opt(['-reg2mem', '-sbt-loop-unroll',
                           '-sbt-loop-unroll-count',
                           str(self.options.unroll_count),
-                          '-sbt-loop-unroll-terminate'])
+                          '-sbt-loop-unroll-terminate'], stage='unroll',
+                         run_if='loops')
+            # bound the depth of recursion the same way
+            # (a recursive program does not need to have loops)
+            self.run_opt(['-sbt-recursion-bound',
+                          '-sbt-recursion-bound-count={0}'\
+                          .format(self.options.unroll_count)],
+                         stage='unroll')
 
         #################### #################### ###################
         # PREPROCESSING before instrumentation
@@ -785,39 +2194,49 @@ class SymbioticCC(object):
         # and that we are required to link in on any circumstances
         self.link_unconditional()
 
-        passes = []
-        # NOTE: remove error calls must go first as the other passes
-        # may include error calss
+        # rewrite the error calls in one pass: remove the original calls
+        # to __VERIFIER_error/__assert_fail if we do not aim for their
+        # reachability and replace the UBSan checks (the replaced checks
+        # are not removed, they are the new error calls)
         prp = self.options.property
-        if prp.memsafety() or \
-           prp.undefinedness() or \
-           prp.signedoverflow() or \
-           prp.termination() or \
-           prp.memcleanup():
-            # remove the original calls to __VERIFIER_error/__assert_fail
-            passes.append('-remove-error-calls')
-
-        if prp.memcleanup() or prp.termination():
-            passes.append('-remove-error-calls-use-exit')
+        passes = self._normalize_error_sites_passes()
 
+        parts = [(passes, None)]
+        # the verifiers do not handle inline assembly, replace its
+        # common idioms (barriers, bswap, locked RMW, rdtsc) by LLVM IR
+        parts.append((['-replace-inline-asm'], None))
         if not prp.termination():
-            passes.append('-remove-infinite-loops')
-
-        if (prp.undefinedness() or \
-           prp.signedoverflow()) and \
-            not self.options.witness_check:
-            passes.append('-replace-ubsan')
+            parts.append((['-remove-infinite-loops'], INFINITE_LOOPS))
 
+        passes = []
         if prp.signedoverflow() and \
            not self.options.overflow_with_clang:
             if not self.options.witness_check:
-                passes.append('-replace-ubsan-just-remove')
-                passes.append('-replace-ubsan-keep-shifts')
                 passes.append('-prepare-overflows')
             passes.append('-mem2reg')
             passes.append('-break-crit-edges')
-
-        self.run_opt(passes)
+            # do not instrument the operations that cannot overflow
+            passes.append('-prune-overflow-checks')
+
+        parts.append((passes, None))
+        # a program that cannot allocate memory cannot leak it
+        # (but it can still dereference invalid pointers)
+        if prp.memcleanup() and not prp.memsafety():
+            parts.append((['-prune-no-allocations'], None))
+        # instrument only the code that can be executed
+        parts.append((['-prune-unreachable'], None))
+        # the validator does not need the paths that cannot reach the target
+        # of the witness (for the properties where the violation must happen
+        # right at the target)
+        if self._witness_target and\
+           (prp.unreachcall() or prp.signedoverflow()):
+            # (we do not match the file, with the line markers in .i files
+            # the debug locations do not have the name of the source,
+            # the matched lines from other files only keep more code)
+            parts.append((['-prune-witness-path',
+                           '-prune-witness-path-line={0}'.format(self._witness_target)],
+                          None))
+        self.run_opt_parts(parts, stage='prepare')
 
         #################### #################### ###################
         # INSTRUMENTATION
@@ -838,16 +2257,36 @@ class SymbioticCC(object):
             passes = self._tool.passes_after_instrumentation()
 
         if self.options.property.memsafety():
+            # the accesses to allocas and globals that are in bounds
+            # do not need to be marked (and made volatile)
+            passes.append('-remove-safe-marks')
+            # the accesses checked already by a dominating marked access
+            # (and the loop-invariant loads, checked in the preheaders)
+            passes.append('-remove-redundant-marks')
+
             # replace llvm.lifetime.start/end with __VERIFIER_scope_enter/leave
             # so that optimizations will not mess the code up
             passes.append('-replace-lifetime-markers')
+            # variables whose address is not taken cannot be used
+            # out of their scope
+            passes.append('-replace-lifetime-markers-skip-unescaped')
 
             # make all store/load insts that are marked by instrumentation
             # volatile, so that we can run optimizations later on them
             passes.append('-mark-volatile')
+            # the accesses checked already by a previous volatile access
+            # can be optimized
+            passes.append('-mark-volatile-skip-redundant')
 
         if passes:
-            self.run_opt(passes)
+            self.run_opt(passes, stage='after-instrumentation')
+
+    def _optimize_and_slice(self):
+        """
+        Optimize the instrumented program and slice it
+        """
+        # no need to slice and verify the code without error sites
+        self._check_error_sites()
 
         #################### #################### ###################
         # SLICING
@@ -855,18 +2294,20 @@ class SymbioticCC(object):
         #################### #################### ###################
 
         # run optimizations if desired
-        passes = get_optlist_before(self.options.optlevel)
+        parts = [(self._get_optlist('before'), None)]
         # Special optimizations for slicing.
         if not self.options.noslice and 'before-O3' in self.options.optlevel:
             # Break the infinite loops just before slicing so that the
-            # optimizations won't make them syntactically infinite again. We must
-            # run reg2mem before breaking to loops, because breaking the loops can
-            # not handle PHI nodes well.
+            # optimizations won't make them syntactically infinite again.
             if self.options.property.termination():
-                passes += ['-reg2mem', '-break-infinite-loops',]
-            passes += ['-remove-infinite-loops',
-                       '-mem2reg', '-break-crit-loops', '-lowerswitch']
-        self.optimize(passes, load_sbt=True)
+                parts.append((['-break-infinite-loops'],
+                              'nonterm-loops'))
+            parts.append((['-remove-infinite-loops'], INFINITE_LOOPS))
+            # (the slicer does not support switch, lower it to balanced
+            # trees of range checks instead of chains of comparisons)
+            parts.append((['-mem2reg', '-break-crit-loops', '-balance-switch'],
+                          None))
+        self.optimize_parts(parts, load_sbt=True)
 
         if hasattr(self._tool, 'actions_before_slicing'):
             self._tool.actions_before_slicing(self)
@@ -880,24 +2321,24 @@ class SymbioticCC(object):
         if hasattr(self._tool, 'passes_before_slicing'):
             passes = self._tool.passes_before_slicing()
             if passes:
-                self.run_opt(passes)
+                self.run_opt(passes, stage='before-slicing')
 
         # link definition of atexit and get rid of llvm.global_dtors,
         # link also qsort before slicing as it can call function pointers
+        # (that we turn into direct calls where we can)
         self.link_undefined(['atexit', 'qsort'])
-        self.run_opt(['-explicit-consdes'])
+        self.run_opt(['-explicit-consdes', '-devirtualize-calls'], stage='consdes')
 
         if not self.options.noslice:
             self.perform_slicing()
         elif self.options.require_slicer:
             raise SymbioticException("Slicing required but forbiden...")
 
-        # start a new time era
-        restart_counting_time()
-
-        self.process_after_slicing()
 
+    def _finish_run(self):
+        self._stop_prefetching()
         self._get_stats('After slicing and post-processing')
+        self._load_features()
 
         if not self.options.final_output is None:
             # copy the file to final_output
@@ -925,7 +2366,8 @@ class SymbioticCC(object):
         witness_transformed =  os.path.basename(self.options.witness_check_file)
         transformer = ValidationTransformer(self.sources[0], self.options.witness_check_file, program_transformed, witness_transformed)
         transformer.transform()
-        
+        self._witness_target = transformer.target_line()
+
         self.options.witness_check_file = witness_transformed
         self.sources = [program_transformed]
         print_stdout('INFO: Done witness preprocessing', color='WHITE')
@@ -0,0 +1,533 @@
+#!/usr/bin/env python3
+
+"""
+Persistent content-addressed cache of compiled bitcode files
+(function models, instrumentation definitions), of the results
+of verification tasks, of the sliced programs of tasks (to reuse
+the verdicts for new versions of programs), of the solver queries
+shared between runs, of the results of probing the tools
+and of the outcomes of the verifiers.
+"""
+
+import os
+import json
+from hashlib import sha256
+from shutil import copyfile, rmtree, which
+from tempfile import mkstemp, mkdtemp
+
+from . metrics import count_cache
+from . utils import dbg
+
+
+def file_digest(path):
+    """ Return the hash of the content of the file """
+    h = sha256()
+    with open(path, 'rb') as f:
+        h.update(f.read())
+    return h.hexdigest()
+
+
+class BitcodeCache(object):
+    """
+    The cached files are stored as <dir>/<key[:2]>/<key>.bc where the key
+    is a hash of the source file, of the compilation command and of the
+    headers from the include directories that are given to the constructor.
+
+    New entries are first written into a temporary file in the cache
+    directory and then atomically renamed, so concurrent workers can share
+    the same cache directory (in the worst case they compile the same file
+    twice).
+    """
+
+    def __init__(self, cachedir, include_dirs=[]):
+        self._dir = os.path.abspath(cachedir)
+        self._include_dirs = include_dirs
+        self._headers_hash = None
+
+    def _get_headers_hash(self):
+        if self._headers_hash is not None:
+            return self._headers_hash
+
+        h = sha256()
+        for idir in self._include_dirs:
+            if not os.path.isdir(idir):
+                continue
+            for root, dirs, files in os.walk(idir):
+                dirs.sort()
+                for f in sorted(files):
+                    path = os.path.join(root, f)
+                    h.update(path.encode('utf-8'))
+                    with open(path, 'rb') as fl:
+                        h.update(fl.read())
+
+        self._headers_hash = h.hexdigest()
+        return self._headers_hash
+
+    def key(self, source, cmd):
+        """
+        Compute the key for compiling 'source' with 'cmd'
+        (cmd should not contain the paths to the source and output)
+        """
+        h = sha256()
+        with open(source, 'rb') as f:
+            h.update(f.read())
+        h.update('\0'.join(cmd).encode('utf-8'))
+        h.update(self._get_headers_hash().encode('ascii'))
+        return h.hexdigest()
+
+    def stamp_key(self, source, cmd):
+        """
+        Compute the key for compiling 'source' with 'cmd' from the path,
+        the modification time and the size of the source, without reading
+        it and the headers. Meant for the installed files that change only
+        with a new installation (the instrumentation definitions), the key
+        of an edited file changes with its stamp.
+        """
+        st = os.stat(source)
+        h = sha256()
+        h.update(os.path.realpath(source).encode('utf-8'))
+        h.update('\0{0}\0{1}\0'.format(st.st_mtime_ns, st.st_size).encode('ascii'))
+        h.update('\0'.join(cmd).encode('utf-8'))
+        return h.hexdigest()
+
+    def _path(self, key):
+        return os.path.join(self._dir, key[:2], '{0}.bc'.format(key))
+
+    def lookup(self, key):
+        """
+        Return the path of the cached file in the cache or None if there is
+        no such file. The file is never rewritten (only atomically replaced),
+        so it can be used in place by the tools that only read it.
+        """
+        path = self._path(key)
+        if not os.path.isfile(path):
+            count_cache('model', False)
+            return None
+        count_cache('model', True)
+        dbg("Using cached bitcode '{0}'".format(path), 'compile')
+        return path
+
+    def get(self, key, output):
+        """
+        Copy the cached file to output, return False if there is no such file
+        """
+        path = self._path(key)
+        try:
+            copyfile(path, output)
+        except (IOError, OSError):
+            count_cache('model', False)
+            return False
+
+        count_cache('model', True)
+        dbg("Using cached bitcode '{0}'".format(path), 'compile')
+        return True
+
+    def put(self, key, bitcode):
+        """
+        Store (a copy of) the bitcode file under the key.
+        Failing to store the file is not an error.
+        """
+        path = self._path(key)
+        tmp = None
+        try:
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            fd, tmp = mkstemp(dir=os.path.dirname(path), suffix='.tmp')
+            os.close(fd)
+            copyfile(bitcode, tmp)
+            os.replace(tmp, path)
+        except (IOError, OSError) as e:
+            dbg("Failed caching '{0}': {1}".format(bitcode, str(e)), 'compile')
+            if tmp and os.path.exists(tmp):
+                os.unlink(tmp)
+
+
+class ResultCache(object):
+    """
+    The results are stored as <dir>/results/<key[:2]>/<key>/ directories
+    that contain the file 'result' with the verdict and optionally
+    the file 'witness.graphml'. The key is computed by the caller.
+
+    Like in BitcodeCache, an entry is created in a temporary directory
+    and renamed when complete, so a reader never sees a partial entry.
+    """
+
+    def __init__(self, cachedir):
+        self._dir = os.path.join(os.path.abspath(cachedir), 'results')
+
+    def _path(self, key):
+        return os.path.join(self._dir, key[:2], key)
+
+    def get(self, key, witness=None):
+        """
+        Return the stored verdict or None if there is no such entry.
+        If witness is not None, copy the stored witness there (and return
+        None if the entry has no witness).
+        """
+        path = self._path(key)
+        try:
+            with open(os.path.join(path, 'result'), 'r') as f:
+                res = f.read().strip()
+            if witness:
+                copyfile(os.path.join(path, 'witness.graphml'), witness)
+        except (IOError, OSError):
+            count_cache('result', False)
+            return None
+
+        count_cache('result', True)
+        dbg("Using cached result '{0}'".format(path))
+        return res
+
+    def put(self, key, res, witness=None):
+        """
+        Store the verdict and (a copy of) the witness under the key.
+        Failing to store the result is not an error.
+        """
+        path = self._path(key)
+        tmp = None
+        try:
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            tmp = mkdtemp(dir=os.path.dirname(path), suffix='.tmp')
+            with open(os.path.join(tmp, 'result'), 'w') as f:
+                f.write(res)
+                f.write('\n')
+            if witness and os.path.isfile(witness):
+                copyfile(witness, os.path.join(tmp, 'witness.graphml'))
+            # fails if another worker stored the result meanwhile, that is ok
+            os.rename(tmp, path)
+            tmp = None
+        except (IOError, OSError) as e:
+            dbg("Failed caching the result: {0}".format(str(e)))
+        finally:
+            if tmp:
+                rmtree(tmp, ignore_errors=True)
+
+
+class SliceCache(object):
+    """
+    The sliced programs of tasks are stored as <dir>/slices/<key[:2]>/<key>/
+    directories that contain the hashes of the functions and globals
+    of the sliced program ('hashes.json', see -hash-functions), the verdict
+    ('result'), the sliced bitcode ('sliced.bc') and optionally
+    the witness ('witness.graphml'). The key identifies the task (the names
+    of the sources and the options), not its content, so a new version
+    of the program replaces the entry of the previous one.
+    """
+
+    def __init__(self, cachedir):
+        self._dir = os.path.join(os.path.abspath(cachedir), 'slices')
+
+    def _path(self, key):
+        return os.path.join(self._dir, key[:2], key)
+
+    def get(self, key):
+        """
+        Return (hashes, verdict) of the stored slice of the task
+        or None if there is no such entry
+        """
+        path = self._path(key)
+        try:
+            with open(os.path.join(path, 'hashes.json'), 'r') as f:
+                hashes = json.load(f)
+            with open(os.path.join(path, 'result'), 'r') as f:
+                res = f.read().strip()
+        except (IOError, OSError, ValueError):
+            count_cache('slice', False)
+            return None
+        count_cache('slice', True)
+        return hashes, res
+
+    def get_witness(self, key, witness):
+        """ Copy the stored witness to witness, return False on failure """
+        try:
+            copyfile(os.path.join(self._path(key), 'witness.graphml'), witness)
+        except (IOError, OSError):
+            return False
+        return True
+
+    def put(self, key, hashes, res, bitcode, witness=None):
+        """
+        Store the slice of the task (replacing the previous one).
+        Failing to store the slice is not an error.
+        """
+        path = self._path(key)
+        tmp = None
+        try:
+            os.makedirs(os.path.dirname(path), exist_ok=True)
+            tmp = mkdtemp(dir=os.path.dirname(path), suffix='.tmp')
+            with open(os.path.join(tmp, 'hashes.json'), 'w') as f:
+                json.dump(hashes, f)
+            with open(os.path.join(tmp, 'result'), 'w') as f:
+                f.write(res)
+                f.write('\n')
+            copyfile(bitcode, os.path.join(tmp, 'sliced.bc'))
+            if witness and os.path.isfile(witness):
+                copyfile(witness, os.path.join(tmp, 'witness.graphml'))
+            # move the old entry away first, renaming a directory
+            # does not replace a non-empty one
+            if os.path.isdir(path):
+                old = mkdtemp(dir=os.path.dirname(path), suffix='.old')
+                os.rename(path, os.path.join(old, 'entry'))
+                rmtree(old, ignore_errors=True)
+            os.rename(tmp, path)
+            tmp = None
+        except (IOError, OSError) as e:
+            dbg("Failed caching the slice: {0}".format(str(e)))
+        finally:
+            if tmp:
+                rmtree(tmp, ignore_errors=True)
+
+
+def changed_functions(old, new):
+    """
+    Return the names of the functions and globals whose hashes differ
+    in the two results of -hash-functions (including the added
+    and the removed ones)
+    """
+    changed = []
+    for kind in ('functions', 'globals'):
+        o, n = old.get(kind, {}), new.get(kind, {})
+        changed += sorted(name for name in set(o) | set(n)
+                          if o.get(name) != n.get(name))
+    return changed
+
+
+class QueryCache(object):
+    """
+    The directories for the solver queries of KLEE are
+    <dir>/queries/<key[:2]>/<key>/ where the key is the hash of the verified
+    bitcode, so all the instances of KLEE that verify the same bitcode
+    (the members of a portfolio, repeated runs) share the solved queries.
+    KLEE (-query-cache-dir) stores every query into a file named by the hash
+    of the query and renames it into the directory when it is complete,
+    so the instances can use the directory concurrently.
+
+    The directories are pruned by the time of the last use when the whole
+    cache exceeds the given size.
+    """
+
+    def __init__(self, cachedir, max_size):
+        self._dir = os.path.join(os.path.abspath(cachedir), 'queries')
+        self._max_size = max_size
+
+    def get(self, bitcode):
+        """
+        Return the directory for the queries of the bitcode
+        (or None if it cannot be created)
+        """
+        key = file_digest(bitcode)
+        path = os.path.join(self._dir, key[:2], key)
+        try:
+            os.makedirs(path, exist_ok=True)
+            # mark the use for pruning
+            os.utime(path)
+        except (IOError, OSError) as e:
+            dbg("Failed creating the cache of queries: {0}".format(str(e)))
+            return None
+
+        self.prune(keep=path)
+        return path
+
+    def _entries(self):
+        if not os.path.isdir(self._dir):
+            return []
+        entries = []
+        for sub in os.listdir(self._dir):
+            subdir = os.path.join(self._dir, sub)
+            if not os.path.isdir(subdir):
+                continue
+            for key in os.listdir(subdir):
+                path = os.path.join(subdir, key)
+                try:
+                    size = sum(os.path.getsize(os.path.join(path, f))
+                               for f in os.listdir(path))
+                    entries.append((os.path.getmtime(path), size, path))
+                except (IOError, OSError):
+                    # removed by another worker meanwhile
+                    continue
+        return entries
+
+    def prune(self, keep=None):
+        """
+        Remove the least recently used directories until the cache
+        fits into its size (the directory 'keep' is never removed)
+        """
+        if not self._max_size:
+            return
+        entries = self._entries()
+        total = sum(size for _, size, _ in entries)
+        for _, size, path in sorted(entries):
+            if total <= self._max_size:
+                break
+            if path == keep:
+                continue
+            dbg("Removing the cached queries '{0}'".format(path))
+            rmtree(path, ignore_errors=True)
+            total -= size
+
+
+class ProbeCache(object):
+    """
+    The results of probing the tools (their versions, supported options)
+    are stored in <dir>/probes.json. An entry is keyed by the name
+    of the probe and by the path of the executable, and it is valid while
+    the executable has the same mtime and size, so revalidating an entry
+    costs a stat() instead of running the tool. Without a cache directory,
+    the results are remembered only in this process.
+    """
+
+    # the results from this process, the keys are as in the file
+    _memory = {}
+
+    def __init__(self, cachedir):
+        self._path = None
+        if cachedir:
+            self._path = os.path.join(os.path.abspath(cachedir), 'probes.json')
+        self._entries = None
+
+    def _load(self):
+        if self._entries is None:
+            self._entries = {}
+            if self._path:
+                try:
+                    with open(self._path, 'r') as f:
+                        self._entries = json.load(f)
+                except (IOError, OSError, ValueError):
+                    pass
+        return self._entries
+
+    def _store(self):
+        if not self._path:
+            return
+        tmp = None
+        try:
+            os.makedirs(os.path.dirname(self._path), exist_ok=True)
+            fd, tmp = mkstemp(dir=os.path.dirname(self._path), suffix='.tmp')
+            with os.fdopen(fd, 'w') as f:
+                json.dump(self._entries, f)
+            os.replace(tmp, self._path)
+        except (IOError, OSError) as e:
+            dbg("Failed storing the probes: {0}".format(str(e)))
+            if tmp and os.path.exists(tmp):
+                os.unlink(tmp)
+
+    def get(self, name, executable, compute):
+        """
+        Return the result of the probe 'name' of the executable (a command
+        found in PATH), call compute() if it is not cached or the executable
+        changed. The result is a string, bytes, a number or a bool (or
+        a list of them).
+        """
+        path = which(executable)
+        if path is None:
+            return compute()
+        path = os.path.realpath(path)
+        st = os.stat(path)
+        stamp = [st.st_mtime_ns, st.st_size]
+        key = '{0}:{1}'.format(name, path)
+
+        mem = ProbeCache._memory.get(key)
+        if mem and mem[0] == stamp:
+            return mem[1]
+
+        entry = self._load().get(key)
+        if entry and entry.get('stamp') == stamp:
+            value = _decode_probe(entry.get('value'))
+        else:
+            value = compute()
+            self._entries[key] = {'stamp': stamp,
+                                  'value': _encode_probe(value)}
+            self._store()
+
+        ProbeCache._memory[key] = (stamp, value)
+        return value
+
+
+def _encode_probe(value):
+    if isinstance(value, bytes):
+        return {'bytes': value.decode('latin-1')}
+    if isinstance(value, (list, tuple)):
+        return [_encode_probe(v) for v in value]
+    return value
+
+
+def _decode_probe(value):
+    if isinstance(value, dict):
+        return value['bytes'].encode('latin-1')
+    if isinstance(value, list):
+        return [_decode_probe(v) for v in value]
+    return value
+
+
+class OutcomeCache(object):
+    """
+    The outcomes of the verifiers are stored in <dir>/outcomes.json
+    by the class of the program (see feature_class) and by the verifier:
+    how many times the verifier ran, how many times it answered
+    (true or false) and how long it took to answer in total.
+    The entries are updated by load-modify-rename, an update from
+    a concurrent run may be lost, which only makes the statistics
+    a bit less precise.
+    """
+
+    def __init__(self, cachedir):
+        self._path = os.path.join(os.path.abspath(cachedir), 'outcomes.json')
+
+    def _load(self):
+        try:
+            with open(self._path, 'r') as f:
+                return json.load(f)
+        except (IOError, OSError, ValueError):
+            return {}
+
+    def get(self, cls):
+        """ Return {verifier: {'runs': N, 'answers': N, 'time': T}} """
+        return self._load().get(cls, {})
+
+    def record(self, cls, verifier, answered, time):
+        entries = self._load()
+        entry = entries.setdefault(cls, {}).setdefault(
+            verifier, {'runs': 0, 'answers': 0, 'time': 0.0})
+        entry['runs'] += 1
+        if answered:
+            entry['answers'] += 1
+            entry['time'] += time
+
+        tmp = None
+        try:
+            os.makedirs(os.path.dirname(self._path), exist_ok=True)
+            fd, tmp = mkstemp(dir=os.path.dirname(self._path), suffix='.tmp')
+            with os.fdopen(fd, 'w') as f:
+                json.dump(entries, f)
+            os.replace(tmp, self._path)
+        except (IOError, OSError) as e:
+            dbg("Failed storing the outcome: {0}".format(str(e)))
+            if tmp and os.path.exists(tmp):
+                os.unlink(tmp)
+
+
+def feature_class(prp, features):
+    """
+    The coarse class of the program for OutcomeCache: the property
+    and the features that decide the most which verifier succeeds
+    (the loops, floats, the heap, threads and the size), from
+    the features of -classify-instructions (None if we do not have them)
+    """
+    if not features:
+        return None
+
+    loops = features.get('loops', {})
+    if loops.get('nested'):
+        loops = 'nested'
+    elif loops.get('loops', 0) > 0:
+        loops = 'loops'
+    else:
+        loops = 'none'
+    memory = features.get('memory', {})
+    heap = any(memory.get(k, 0) > 0 for k in ('malloc', 'calloc', 'realloc'))
+    threads = features.get('threads', {}).get('pthread_calls', 0) > 0
+    size = features.get('size', {}).get('instructions', 0)
+    size = 'small' if size < 1000 else 'medium' if size < 50000 else 'large'
+
+    return '{0}:loops={1}:float={2}:heap={3}:threads={4}:size={5}'.format(
+        prp, loops, int(bool(features.get('float'))), int(heap), int(threads),
+        size)
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+
+"""
+Durable checkpoints of the preprocessing of a task (see --resume),
+so that a run that was killed (a crash, a preempted machine) continues
+from the last finished stage instead of compiling, instrumenting
+and slicing the program again.
+"""
+
+import os
+import json
+from shutil import copyfile
+from tempfile import mkstemp
+
+from . utils import dbg
+from . cache import file_digest
+
+# the stages after which we write a checkpoint, in the order of the run
+STAGES = ('compiled', 'instrumented', 'sliced', 'postprocessed')
+
+
+def _sync_dir(path):
+    try:
+        fd = os.open(path, os.O_RDONLY)
+    except OSError:
+        return
+    try:
+        os.fsync(fd)
+    except OSError:
+        pass
+    finally:
+        os.close(fd)
+
+
+def _write_durably(path, write):
+    """
+    Write the file through a temporary file that is synced and renamed,
+    so that the file is either the old one or the complete new one
+    """
+    fd, tmp = mkstemp(dir=os.path.dirname(path), suffix='.tmp')
+    try:
+        with os.fdopen(fd, 'wb') as f:
+            write(f)
+            f.flush()
+            os.fsync(f.fileno())
+        os.replace(tmp, path)
+    except BaseException:
+        if os.path.exists(tmp):
+            os.unlink(tmp)
+        raise
+    _sync_dir(os.path.dirname(path))
+
+
+class Checkpoints(object):
+    """
+    A checkpoint of the stage S is stored in the directory as the files
+    S.<role> (the bitcode, the non-sliced bitcode, ...) and the manifest
+    S.json with the key of the task and the hashes of the files.
+    The manifest is written last, so a checkpoint is valid only if
+    the key matches (the same sources, options and versions) and all
+    its files have the recorded hashes: a run killed while writing
+    a checkpoint leaves a checkpoint that is ignored.
+    """
+
+    def __init__(self, directory, key):
+        self._dir = os.path.abspath(directory)
+        self._key = key
+
+    def _manifest(self, stage):
+        return os.path.join(self._dir, '{0}.json'.format(stage))
+
+    def _file(self, stage, role):
+        return os.path.join(self._dir, '{0}.{1}'.format(stage, role))
+
+    def save(self, stage, files):
+        """
+        Store (copies of) the files {role: path} as the checkpoint
+        of the stage. Failing to store the checkpoint is not an error.
+        """
+        assert stage in STAGES
+        manifest = {'version': 1, 'stage': stage,
+                    'key': self._key, 'files': {}}
+        try:
+            os.makedirs(self._dir, exist_ok=True)
+            for role, path in files.items():
+                dest = self._file(stage, role)
+                with open(path, 'rb') as src:
+                    _write_durably(dest, lambda f: f.write(src.read()))
+                manifest['files'][role] = file_digest(dest)
+            data = json.dumps(manifest, indent=1).encode('utf-8')
+            _write_durably(self._manifest(stage), lambda f: f.write(data))
+        except (IOError, OSError) as e:
+            dbg("Failed writing the checkpoint '{0}': {1}".format(stage, str(e)))
+            return False
+
+        dbg("Wrote the checkpoint '{0}'".format(stage))
+        return True
+
+    def _valid(self, stage):
+        """ Return the manifest of the stage if it is a valid checkpoint """
+        try:
+            with open(self._manifest(stage), 'r') as f:
+                manifest = json.load(f)
+        except (IOError, OSError, ValueError):
+            return None
+
+        if manifest.get('version') != 1 or manifest.get('key') != self._key:
+            dbg("The checkpoint '{0}' is of another task".format(stage))
+            return None
+        for role, digest in manifest.get('files', {}).items():
+            try:
+                if file_digest(self._file(stage, role)) != digest:
+                    raise OSError('the hash does not match')
+            except (IOError, OSError) as e:
+                dbg("The checkpoint '{0}' is damaged ({1}): {2}"
+                    .format(stage, role, str(e)))
+                return None
+        return manifest
+
+    def latest(self, stages=STAGES):
+        """ The last of the given stages that has a valid checkpoint """
+        for stage in reversed(stages):
+            if self._valid(stage):
+                return stage
+        return None
+
+    def load(self, stage, outputs):
+        """
+        Copy the files of the checkpoint to the outputs {role: path}
+        (the roles that the checkpoint does not have are skipped).
+        Return the roles that were copied or None if the checkpoint
+        is not valid.
+        """
+        manifest = self._valid(stage)
+        if manifest is None:
+            return None
+
+        copied = []
+        try:
+            for role, path in outputs.items():
+                if role in manifest['files']:
+                    copyfile(self._file(stage, role), path)
+                    copied.append(role)
+        except (IOError, OSError) as e:
+            dbg("Failed reading the checkpoint '{0}': {1}".format(stage, str(e)))
+            return None
+        return copied
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+
+"""
+Profiles of verification: the statistics of instructions from KLEE
+(run.istats, in the callgrind format) mapped to the source lines and to
+the loops of the program (the source lines of loops are written by
+'opt -classify-loops -classify-loops-lines=FILE').
+"""
+
+import json
+from os.path import basename
+
+# the events of KLEE that we report: executed instructions,
+# the number of queries and the time of the solver (in microseconds)
+EVENTS = ('I', 'Forks', 'Q', 'Qtime')
+
+
+def parse_istats(path):
+    """
+    Return {(file, function, line): {event: value}} from
+    the istats file of KLEE, the counts of all the instructions
+    on the same source line are summed up
+    """
+    lines = {}
+    events = []
+    positions = 1
+    fl = fn = None
+    skip_next = False
+    with open(path, 'r') as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            if line.startswith('positions:'):
+                positions = len(line.split()[1:])
+            elif line.startswith('events:'):
+                events = line.split()[1:]
+            elif line.startswith('fl='):
+                fl = line[3:]
+            elif line.startswith('fn='):
+                fn = line[3:]
+            elif line.startswith('calls='):
+                # the next line are the inclusive costs of the call,
+                # they are counted in the called function
+                skip_next = True
+            elif line[0].isdigit():
+                if skip_next:
+                    skip_next = False
+                    continue
+                nums = line.split()
+                if len(nums) < positions:
+                    continue
+                # the last position is the source line
+                key = (fl, fn, int(nums[positions - 1]))
+                rec = lines.setdefault(key, {})
+                for event, val in zip(events, nums[positions:]):
+                    if event in EVENTS:
+                        rec[event] = rec.get(event, 0) + int(val)
+    return lines
+
+
+def load_loops(path):
+    """ Load the loops from the output of -classify-loops-lines """
+    try:
+        with open(path, 'r') as f:
+            return json.load(f)
+    except (IOError, OSError, ValueError):
+        return []
+
+
+def _same_file(f1, f2):
+    # KLEE may use the full path, the debug locations only the name
+    return f1 and f2 and (f1 == f2 or basename(f1) == basename(f2))
+
+
+def profile(istats, loops, top=10):
+    """
+    Return the profile: the loops that executed the most instructions
+    and the source lines with the most time spent in the solver
+    (at most 'top' of both). Every line is counted only in the innermost
+    loop that contains it.
+    """
+    lines = parse_istats(istats)
+
+    loopstats = [dict(loop, **{e: 0 for e in EVENTS}) for loop in loops]
+    # the innermost loops first
+    ordered = sorted(loopstats, key=lambda l: (l['last'] - l['first'],
+                                               -l['depth']))
+    for (fl, fn, line), rec in lines.items():
+        for loop in ordered:
+            if loop['function'] == fn and _same_file(loop['file'], fl) and\
+               loop['first'] <= line <= loop['last']:
+                for e in EVENTS:
+                    loop[e] += rec.get(e, 0)
+                break
+
+    hot_loops = sorted((l for l in loopstats if l['I'] > 0),
+                       key=lambda l: l['I'], reverse=True)[:top]
+    solver_lines = sorted(({'file': fl, 'function': fn, 'line': line,
+                            **{e: rec.get(e, 0) for e in EVENTS}}
+                           for (fl, fn, line), rec in lines.items()
+                           if rec.get('Qtime', 0) > 0),
+                          key=lambda l: l['Qtime'], reverse=True)[:top]
+
+    return {'instructions': sum(r.get('I', 0) for r in lines.values()),
+            'solver_time': sum(r.get('Qtime', 0) for r in lines.values()) / 1e6,
+            'hot_loops': hot_loops,
+            'solver_lines': solver_lines}
+
+
+def format_profile(prof):
+    """ Return the lines of a human-readable form of the profile """
+    out = ['Executed {0} instructions, {1:.2f} s in the solver'
+           .format(prof['instructions'], prof['solver_time'])]
+    total = prof['instructions'] or 1
+
+    out.append('Hot loops (executed instructions):')
+    for l in prof['hot_loops']:
+        out.append('  {0:5.1f}%  {1}:{2}-{3} in {4} (forks: {5}, queries: {6})'
+                   .format(100.0 * l['I'] / total, l['file'], l['first'],
+                           l['last'], l['function'], l['Forks'], l['Q']))
+    if not prof['hot_loops']:
+        out.append('  none')
+
+    out.append('Lines with the most solver time:')
+    for l in prof['solver_lines']:
+        out.append('  {0:8.2f} s  {1}:{2} in {3} ({4} queries)'
+                   .format(l['Qtime'] / 1e6, l['file'], l['line'],
+                           l['function'], l['Q']))
+    if not prof['solver_lines']:
+        out.append('  none')
+
+    return out
@@ -0,0 +1,268 @@
+#!/usr/bin/env python3
+
+"""
+Metrics of the tasks of symbiotic-server (--metrics). A task (a run
+of symbiotic in a process forked by the server) records the durations
+of its stages, the hits and the misses of the caches, its result
+and the verifier that decided it. The report is written into a JSON
+file when the task finishes (see enable_metrics and write_report).
+The server collects the reports of the finished tasks into a Registry,
+adds what it knows itself (the tasks in flight, the queue, the peak
+memory of the workers) and serves it in the text format of Prometheus
+on http://HOST:PORT/metrics (MetricsServer).
+"""
+
+import json
+import os
+import resource
+import select
+import socket
+from contextlib import contextmanager
+from threading import Lock
+from time import time
+
+_path = None
+_report = None
+_lock = Lock()
+
+
+def enable_metrics(path):
+    """ Record the metrics of this task, write_report stores them at path """
+    global _path, _report
+    _path = path
+    _report = {'stages': {}, 'caches': {}, 'result': None, 'verifier': None}
+
+
+def observe_stage(name, seconds):
+    if _path is None:
+        return
+    with _lock:
+        stages = _report['stages']
+        stages[name] = stages.get(name, 0.0) + seconds
+
+
+@contextmanager
+def stage(name):
+    """ Measure the duration of the stage (compile, instrument, slice, verify) """
+    start = time()
+    try:
+        yield
+    finally:
+        observe_stage(name, time() - start)
+
+
+def count_cache(name, hit):
+    """ Count a lookup in the cache 'name' (model, result, slice) """
+    if _path is None:
+        return
+    with _lock:
+        counts = _report['caches'].setdefault(name, [0, 0])
+        counts[0 if hit else 1] += 1
+
+
+def set_result(result, verifier=None):
+    if _path is None:
+        return
+    _report['result'] = result
+    if verifier:
+        _report['verifier'] = verifier
+
+
+def write_report():
+    """
+    Write the report (with the peak memory of this process and of its
+    children, e.g., the verifiers). Failing to write it is not an error
+    """
+    if _path is None:
+        return
+
+    # (ru_maxrss is in kilobytes)
+    peak = max(resource.getrusage(resource.RUSAGE_SELF).ru_maxrss,
+               resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss)
+    with _lock:
+        report = dict(_report, peak_memory=peak * 1024)
+    try:
+        with open(_path, 'w') as f:
+            json.dump(report, f)
+    except (IOError, OSError):
+        pass
+
+
+def read_report(path):
+    """ Read and remove the report of a task, None if there is none """
+    try:
+        with open(path, 'r') as f:
+            report = json.load(f)
+        os.unlink(path)
+    except (IOError, OSError, ValueError):
+        return None
+    return report
+
+
+def result_class(result):
+    """ true, false, unknown, error, ... (without the property) """
+    if not result:
+        return 'none'
+    return result.split('(')[0].split()[0].lower()
+
+
+def _escape(value):
+    return str(value).replace('\\', '\\\\').replace('"', '\\"')\
+                     .replace('\n', '\\n')
+
+
+class Registry(object):
+    """ The metrics of the tasks in the text format of Prometheus """
+
+    # the buckets of the histograms of the durations of stages (seconds)
+    BUCKETS = (0.1, 0.5, 1, 5, 10, 30, 60, 300, 900)
+
+    def __init__(self):
+        self.in_flight = 0
+        self.queued = 0
+        self._tasks = {}
+        self._stages = {}
+        self._caches = {}
+        self._wins = {}
+        self._peak = {}
+
+    def add_report(self, report, worker, peak_memory=0):
+        """
+        Add the report of a finished task (None if the task did not
+        write any). peak_memory is what the server measured itself
+        """
+        report = report or {}
+        result = result_class(report.get('result'))
+        self._tasks[result] = self._tasks.get(result, 0) + 1
+
+        for name, seconds in report.get('stages', {}).items():
+            hist = self._stages.setdefault(name,
+                                           [0] * len(self.BUCKETS) + [0.0, 0])
+            for i, bound in enumerate(self.BUCKETS):
+                if seconds <= bound:
+                    hist[i] += 1
+            hist[-2] += seconds
+            hist[-1] += 1
+
+        for name, (hits, misses) in report.get('caches', {}).items():
+            counts = self._caches.setdefault(name, [0, 0])
+            counts[0] += hits
+            counts[1] += misses
+
+        verifier = report.get('verifier')
+        if verifier and result in ('true', 'false'):
+            self._wins[verifier] = self._wins.get(verifier, 0) + 1
+
+        peak = max(peak_memory, report.get('peak_memory', 0))
+        self._peak[worker] = max(self._peak.get(worker, 0), peak)
+
+    def render(self):
+        lines = []
+
+        def metric(name, ty, doc, samples):
+            lines.append('# HELP {0} {1}'.format(name, doc))
+            lines.append('# TYPE {0} {1}'.format(name, ty))
+            for labels, value in samples:
+                if labels:
+                    lbl = ','.join('{0}="{1}"'.format(k, _escape(v))
+                                   for k, v in labels)
+                    lines.append('{0}{{{1}}} {2}'.format(name, lbl, value))
+                else:
+                    lines.append('{0} {1}'.format(name, value))
+
+        metric('symbiotic_tasks_in_flight', 'gauge',
+               'The number of running tasks', [((), self.in_flight)])
+        metric('symbiotic_queue_depth', 'gauge',
+               'The number of tasks waiting for a worker',
+               [((), self.queued)])
+        metric('symbiotic_tasks_total', 'counter',
+               'The number of finished tasks by the result',
+               [((('result', r),), n) for r, n in sorted(self._tasks.items())])
+
+        name = 'symbiotic_stage_duration_seconds'
+        lines.append('# HELP {0} The duration of the stages of tasks'
+                     .format(name))
+        lines.append('# TYPE {0} histogram'.format(name))
+        for st, hist in sorted(self._stages.items()):
+            for bound, n in zip(self.BUCKETS, hist):
+                lines.append('{0}_bucket{{stage="{1}",le="{2}"}} {3}'
+                             .format(name, _escape(st), bound, n))
+            lines.append('{0}_bucket{{stage="{1}",le="+Inf"}} {2}'
+                         .format(name, _escape(st), hist[-1]))
+            lines.append('{0}_sum{{stage="{1}"}} {2}'
+                         .format(name, _escape(st), hist[-2]))
+            lines.append('{0}_count{{stage="{1}"}} {2}'
+                         .format(name, _escape(st), hist[-1]))
+
+        metric('symbiotic_cache_hits_total', 'counter',
+               'The lookups in the caches that found an entry',
+               [((('cache', c),), n[0]) for c, n in sorted(self._caches.items())])
+        metric('symbiotic_cache_misses_total', 'counter',
+               'The lookups in the caches that found nothing',
+               [((('cache', c),), n[1]) for c, n in sorted(self._caches.items())])
+        metric('symbiotic_verifier_wins_total', 'counter',
+               'The number of true/false results decided by the verifier',
+               [((('verifier', v),), n) for v, n in sorted(self._wins.items())])
+        metric('symbiotic_worker_peak_memory_bytes', 'gauge',
+               'The peak memory of a task run by the worker',
+               [((('worker', w),), n) for w, n in sorted(self._peak.items())])
+
+        return '\n'.join(lines) + '\n'
+
+
+class MetricsServer(object):
+    """
+    A minimal HTTP server of the metrics. It does not run in a thread,
+    the loop of symbiotic-server calls handle() when the socket
+    is readable (the server forks the tasks, threads do not mix
+    with that), or serve() while waiting for something else.
+    """
+
+    def __init__(self, address, registry):
+        host, _, port = address.rpartition(':')
+        self.registry = registry
+        self._sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self._sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self._sock.bind((host or '127.0.0.1', int(port)))
+        self._sock.listen(16)
+
+    def fileno(self):
+        return self._sock.fileno()
+
+    def close(self):
+        self._sock.close()
+
+    def handle(self):
+        conn, _ = self._sock.accept()
+        try:
+            conn.settimeout(2)
+            data = b''
+            while b'\r\n\r\n' not in data and len(data) < 8192:
+                chunk = conn.recv(4096)
+                if not chunk:
+                    break
+                data += chunk
+            request = data.split(b'\r\n', 1)[0].split()
+            if len(request) >= 2 and request[0] == b'GET' and\
+               request[1].split(b'?')[0] == b'/metrics':
+                status = '200 OK'
+                body = self.registry.render()
+            else:
+                status = '404 Not Found'
+                body = 'Not found, the metrics are on /metrics\n'
+            body = body.encode('utf-8')
+            conn.sendall('HTTP/1.0 {0}\r\n'
+                         'Content-Type: text/plain; version=0.0.4\r\n'
+                         'Content-Length: {1}\r\n\r\n'
+                         .format(status, len(body)).encode('ascii') + body)
+        except OSError:
+            # the client went away
+            pass
+        finally:
+            conn.close()
+
+    def serve(self, timeout):
+        """ Handle the requests that come in the next 'timeout' seconds """
+        readable, _, _ = select.select([self._sock], [], [], timeout)
+        if readable:
+            self.handle()
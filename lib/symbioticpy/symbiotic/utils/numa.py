@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+
+"""
+The placement of the processes that run at once (the parallel portfolio,
+the batch mode of symbiotic-server) on the NUMA nodes: every process gets
+the CPUs of one node and its memory is bound to that node, so that
+the memory-heavy symbolic execution does not access the memory
+of the other socket. Without NUMA (one node or no information
+in /sys), the CPUs are just split between the processes.
+"""
+
+import ctypes
+import os
+from glob import glob
+from platform import machine
+
+from . utils import dbg
+
+_NODES_DIR = '/sys/devices/system/node'
+
+# the numbers of the syscall set_mempolicy
+_SET_MEMPOLICY = {'x86_64': 238, 'aarch64': 237, 'i386': 276, 'i686': 276,
+                  'ppc64le': 261, 'ppc64': 261, 's390x': 237}
+_MPOL_BIND = 2
+
+
+def _parse_cpulist(text):
+    """ Parse the list of CPUs as in /sys (e.g., '0-3,8-11') """
+    cpus = set()
+    for part in text.strip().split(','):
+        if not part:
+            continue
+        if '-' in part:
+            lo, hi = part.split('-')
+            cpus.update(range(int(lo), int(hi) + 1))
+        else:
+            cpus.add(int(part))
+    return cpus
+
+
+def numa_nodes(cpus):
+    """
+    Return the list of (node, sorted CPUs) of the NUMA nodes that have
+    some of the given CPUs, [(None, CPUs)] if we do not know the nodes
+    """
+    nodes = []
+    for path in sorted(glob(os.path.join(_NODES_DIR, 'node[0-9]*'))):
+        try:
+            with open(os.path.join(path, 'cpulist'), 'r') as f:
+                nodecpus = _parse_cpulist(f.read()) & set(cpus)
+        except (IOError, OSError, ValueError):
+            continue
+        if nodecpus:
+            nodes.append((int(os.path.basename(path)[4:]), sorted(nodecpus)))
+    return nodes or [(None, sorted(cpus))]
+
+
+def _split(cpus, num):
+    """ Split the CPUs into num contiguous groups (they share CPUs if num is bigger) """
+    if num >= len(cpus):
+        return [{cpus[i % len(cpus)]} for i in range(num)]
+    size, rest = divmod(len(cpus), num)
+    groups, start = [], 0
+    for i in range(num):
+        end = start + size + (1 if i < rest else 0)
+        groups.append(set(cpus[start:end]))
+        start = end
+    return groups
+
+
+def place(num, cpus=None):
+    """
+    Place num processes on the CPUs (default: the CPUs that we may use).
+    The processes are spread over the NUMA nodes by the numbers of their
+    CPUs. Return the list of (set of CPUs, node) for every process,
+    the node is None without NUMA.
+    """
+    if cpus is None:
+        cpus = os.sched_getaffinity(0)
+    nodes = numa_nodes(cpus)
+    if len(nodes) == 1:
+        return [(g, nodes[0][0]) for g in _split(nodes[0][1], num)]
+
+    # the number of processes per node by the numbers of CPUs,
+    # the remaining processes go to the nodes with the most CPUs left
+    total = sum(len(c) for _, c in nodes)
+    counts = [num * len(c) // total for _, c in nodes]
+    by_rest = sorted(range(len(nodes)),
+                     key=lambda i: -(num * len(nodes[i][1]) % total))
+    for i in by_rest[:num - sum(counts)]:
+        counts[i] += 1
+
+    placement = []
+    for (node, nodecpus), count in zip(nodes, counts):
+        if count > 0:
+            placement.extend((g, node) for g in _split(nodecpus, count))
+    return _interleave(placement)
+
+
+def _interleave(placement):
+    """
+    Interleave the nodes, so that the first processes (e.g., when there
+    are fewer verifiers than slots) run on different nodes
+    """
+    bynode = {}
+    for p in placement:
+        bynode.setdefault(p[1], []).append(p)
+    result = []
+    while any(bynode.values()):
+        for node in sorted(bynode):
+            if bynode[node]:
+                result.append(bynode[node].pop(0))
+    return result
+
+
+def bind_memory(node):
+    """
+    Bind the memory of this process (and of the processes it executes)
+    to the NUMA node. This is called in the child process before exec,
+    it must not raise. Return False if the memory could not be bound.
+    """
+    nr = _SET_MEMPOLICY.get(machine())
+    if node is None or nr is None:
+        return False
+    try:
+        libc = ctypes.CDLL(None, use_errno=True)
+        bits = 8 * ctypes.sizeof(ctypes.c_ulong)
+        mask = (ctypes.c_ulong * (node // bits + 1))()
+        mask[node // bits] = 1 << (node % bits)
+        return libc.syscall(nr, _MPOL_BIND, mask,
+                            ctypes.c_ulong(len(mask) * bits + 1)) == 0
+    except (OSError, AttributeError, ValueError):
+        return False
+
+
+def pin(cpus, node):
+    """ Pin this process to the CPUs and bind its memory to the node """
+    try:
+        os.sched_setaffinity(0, cpus)
+    except (OSError, ValueError) as e:
+        dbg('Failed setting the affinity: {0}'.format(str(e)))
+    bind_memory(node)
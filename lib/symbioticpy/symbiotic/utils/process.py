@@ -1,11 +1,19 @@
 #!/usr/bin/env python3
 
 from subprocess import Popen, PIPE, STDOUT
+from . numa import bind_memory
 from . utils import dbg, print_stderr
+from . trace import add_event, tracing
 from . watch import ProcessWatch
+from . workdir import account_io
 from .. import SymbioticException
 from signal import SIGKILL, SIGTERM
-from os import killpg, setpgid
+from os import killpg, setpgid, sched_setaffinity, wait4
+from os import WIFSIGNALED, WTERMSIG, WEXITSTATUS
+from os.path import basename
+from resource import setrlimit, RLIMIT_AS
+from threading import Lock
+from time import perf_counter, time
 
 try:
     from benchexec.util import find_executable
@@ -14,77 +22,200 @@ except ImportError:
 
 
 class ProcessRunner(object):
-    # we have one global process so that we can kill it anytime
-    # (there's always at most one process running anyway)
-    current_process = None
-
-    def run(self, cmd, watch = ProcessWatch()):
+    # all running processes, so that we can kill them anytime
+    # (on timeout or signal). Usually there is at most one,
+    # only the parallel portfolio of verifiers runs more of them.
+    processes = set()
+    # the resources used by the finished processes, the keys are the names
+    # of the executables and the values [runs, wall time, CPU time,
+    # max RSS in kB]
+    usage = {}
+    # the NUMA nodes on which the executables ran (see numa.place)
+    placement = {}
+    _lock = Lock()
+
+    def __init__(self):
+        # the process started by this runner
+        self._process = None
+        self._node = None
+
+    def run(self, cmd, watch = ProcessWatch(), cpus = None, memlimit = None,
+            env = None, node = None):
         """
         Run command cmd and pass its stdout+stderr output
         to the watch object. watch object is supposed to be
         an instance of ProcessWatch object.
 
+        If cpus is given, the process can run only on those CPUs,
+        if node is given, its memory is bound to that NUMA node,
+        memlimit limits its address space (in bytes). If env is given,
+        it is the environment of the process.
+
         \return return code of the process or None when the
         process has been stopped by the watch object
         """
 
         assert isinstance(watch, ProcessWatch)
         # we executed another process while the previous one is still running
-        assert ProcessRunner.current_process is None
+        assert self._process is None
 
         dbg('|> {0}'.format(' '.join(map(str, cmd))), prefix='', color='CYAN')
 
         # run the command and store the handle into the class attribute
-        # current_process, so that we can easily kill this process
-        # on timeout or signal. This way we can run only one
-        # process at the time, but we don't need more (yet?)
+        # processes, so that we can easily kill this process
+        # on timeout or signal.
         try:
             # create a new process group before performing exec so that we can
             # kill every child this process will create as well
             # (assuming that they won't create their own process groups)
             def newpgrp():
                 # sets the subprocess pid as a pgid of the new process group
-                return setpgid(0, 0)
-            ProcessRunner.current_process = Popen(cmd, stdout=PIPE,
-                                                  stderr=STDOUT,
-                                                  preexec_fn=newpgrp)
+                setpgid(0, 0)
+                # the limits are only a hint, run the process without them
+                # if we cannot set them
+                try:
+                    if cpus:
+                        sched_setaffinity(0, cpus)
+                    if memlimit:
+                        setrlimit(RLIMIT_AS, (memlimit, memlimit))
+                except (OSError, ValueError):
+                    pass
+                if node is not None:
+                    bind_memory(node)
+            with ProcessRunner._lock:
+                self._process = Popen(cmd, stdout=PIPE,
+                                      stderr=STDOUT,
+                                      preexec_fn=newpgrp,
+                                      env=env)
+                ProcessRunner.processes.add(self._process)
+                if node is not None:
+                    ProcessRunner.placement.setdefault(
+                        basename(str(cmd[0])), set()).add(node)
+            self._node = node
         except OSError as e:
             msg = ' '.join(cmd) + '\n'
             raise SymbioticException(msg + str(e))
 
-        for line in ProcessRunner.current_process.stdout:
-            if line == b'':
-                break
-
-            watch.putLine(line)
-            if not watch.ok():
-                # watch told us to kill the process for some reason
-                ProcessRunner.current_process.terminate()
-                ProcessRunner.current_process.kill()
-                ProcessRunner.current_process = None
-                return None
-
-        status = ProcessRunner.current_process.wait()
-        ProcessRunner.current_process = None
+        start = perf_counter()
+        try:
+            for line in self._process.stdout:
+                if line == b'':
+                    break
+
+                watch.putLine(line)
+                if not watch.ok():
+                    # watch told us to kill the process for some reason
+                    self._process.terminate()
+                    self._process.kill()
+                    self._wait(cmd, start)
+                    return None
+
+            return self._wait(cmd, start)
+        finally:
+            with ProcessRunner._lock:
+                ProcessRunner.processes.discard(self._process)
+                # spill the files of the working directory only
+                # if no other process may be using them
+                may_spill = not ProcessRunner.processes
+            self._process = None
+            account_io(basename(str(cmd[0])), may_spill)
+
+    def _wait(self, cmd, start):
+        """
+        Wait for the process to finish and account the resources it used
+        (including its children that it waited for)
+        """
+        try:
+            _, status, ru = wait4(self._process.pid, 0)
+        except ChildProcessError:
+            # somebody else (poll() in exitStatus()) reaped the process
+            return self._process.wait()
+
+        self._process.returncode = -WTERMSIG(status) if WIFSIGNALED(status)\
+                                   else WEXITSTATUS(status)
+
+        elapsed = perf_counter() - start
+        with ProcessRunner._lock:
+            u = ProcessRunner.usage.setdefault(basename(str(cmd[0])),
+                                               [0, 0.0, 0.0, 0])
+            u[0] += 1
+            u[1] += elapsed
+            u[2] += ru.ru_utime + ru.ru_stime
+            u[3] = max(u[3], ru.ru_maxrss)
+
+        if tracing():
+            # name the event by the tool, not by its wrapper
+            tool = cmd[2] if basename(str(cmd[0])) == 'timeout' and\
+                             len(cmd) > 2 else cmd[0]
+            add_event(basename(str(tool)), 'process', time() - elapsed,
+                      elapsed, {'cmd': ' '.join(map(str, cmd)),
+                                'exitcode': self._process.returncode,
+                                'cpu': ru.ru_utime + ru.ru_stime,
+                                'maxrss_kb': ru.ru_maxrss,
+                                'node': self._node})
+
+        return self._process.returncode
+
+    @staticmethod
+    def getUsage():
+        """
+        Return the list of (executable, runs, wall time, CPU time,
+        max RSS in kB) for every executable that we have run
+        """
+        with ProcessRunner._lock:
+            return [(k,) + tuple(v) for (k, v)
+                    in sorted(ProcessRunner.usage.items())]
 
-        return status
+    @staticmethod
+    def getPlacement():
+        """
+        Return the list of (executable, sorted NUMA nodes) for the
+        executables that we have run placed on NUMA nodes
+        """
+        with ProcessRunner._lock:
+            return [(k, sorted(v)) for (k, v)
+                    in sorted(ProcessRunner.placement.items())]
+
+    def _get_processes(self):
+        # a runner that started a process controls only that process,
+        # other runners control all processes
+        if self._process is not None:
+            return [self._process]
+        with ProcessRunner._lock:
+            return list(ProcessRunner.processes)
 
     def hasProcess(self):
-        return ProcessRunner.current_process is not None
+        return len(self._get_processes()) > 0
+
+    def _signal(self, sig):
+        for p in self._get_processes():
+            if p.poll() is None:
+                try:
+                    killpg(p.pid, sig)
+                except OSError:
+                    # the process finished meanwhile
+                    pass
 
     def terminate(self):
         assert self.hasProcess()
-        if self.exitStatus() is None:
-            killpg(ProcessRunner.current_process.pid, SIGTERM)
+        self._signal(SIGTERM)
 
     def kill(self):
         assert self.hasProcess()
-        if self.exitStatus() is None:
-            killpg(ProcessRunner.current_process.pid, SIGKILL)
+        self._signal(SIGKILL)
 
     def exitStatus(self):
+        """
+        Return the exit status of the process, None if it is still running
+        (for more processes, None if any of them is still running)
+        """
         assert self.hasProcess()
-        return ProcessRunner.current_process.poll()
+        status = None
+        for p in self._get_processes():
+            status = p.poll()
+            if status is None:
+                return None
+        return status
 
 def runcmd(cmd, watch = ProcessWatch(), err_msg = ""):
     ## if the binary does not have absolute path, tell us which binary it is
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+
+"""
+Running the verifiers on other machines over SSH. The bitcode prepared
+on this machine (the coordinator) is copied to a temporary directory
+on the worker, the verifier runs there and the directory (with the
+output of the verifier, e.g., klee-last and the tests) is copied back
+next to the local bitcode. The workers must have Symbiotic (and
+the verifiers) installed at the same paths as the coordinator and
+must accept SSH connections without a password.
+"""
+
+import os
+from shlex import quote
+from subprocess import Popen, PIPE, DEVNULL
+
+from . utils import dbg
+from . process import ProcessRunner
+from .. exceptions import SymbioticException
+
+SSH = ['ssh', '-o', 'BatchMode=yes']
+
+
+def _check_call(cmd, what):
+    dbg('|> {0}'.format(' '.join(cmd)), prefix='', color='CYAN')
+    proc = Popen(cmd, stdout=PIPE, stderr=PIPE)
+    out, errout = proc.communicate()
+    if proc.returncode != 0:
+        raise SymbioticException('{0} failed: {1}'.format(
+            what, errout.decode('utf-8', 'replace').strip()))
+    return out.decode('utf-8', 'replace')
+
+
+class RemoteWorker(object):
+    """
+    One job slot on a worker machine (HOST or USER@HOST as for ssh)
+    """
+
+    def __init__(self, host):
+        self.host = host
+
+    def _mkdir(self):
+        return _check_call(SSH + [self.host, 'mktemp', '-d',
+                                  '/tmp/symbiotic-XXXXXX'],
+                           'Creating a directory on {0}'.format(self.host)).strip()
+
+    def _push(self, bitcode, remotedir):
+        _check_call(['scp', '-q', '-o', 'BatchMode=yes', bitcode,
+                     '{0}:{1}/'.format(self.host, remotedir)],
+                    'Copying {0} to {1}'.format(bitcode, self.host))
+
+    def _pull(self, remotedir, localdir):
+        """
+        Copy the remote directory back, the symlinks
+        to the remote directory (e.g., klee-last) are made local
+        """
+        dbg('Copying the output from {0}:{1}'.format(self.host, remotedir))
+        ssh = Popen(SSH + [self.host, 'tar', '-C', quote(remotedir), '-c', '.'],
+                    stdout=PIPE, stderr=DEVNULL)
+        tar = Popen(['tar', '-C', localdir, '-x'], stdin=ssh.stdout)
+        ssh.stdout.close()
+        tar.wait()
+        ssh.wait()
+
+        for entry in os.listdir(localdir):
+            path = os.path.join(localdir, entry)
+            if not os.path.islink(path):
+                continue
+            target = os.readlink(path)
+            if target.startswith(remotedir + '/'):
+                os.unlink(path)
+                os.symlink(os.path.join(localdir,
+                                        target[len(remotedir) + 1:]), path)
+
+    def _cleanup(self, remotedir):
+        Popen(SSH + [self.host, 'rm', '-rf', quote(remotedir)],
+              stdout=DEVNULL, stderr=DEVNULL).wait()
+
+    def run(self, cmdline, bitcode, watch):
+        """
+        Run the verifier on the worker. cmdline is a function that returns
+        the command for the given path of the bitcode. Return the return
+        code of the verifier (as ProcessRunner.run does).
+        """
+        remotedir = self._mkdir()
+        try:
+            self._push(bitcode, remotedir)
+            remotebc = '{0}/{1}'.format(remotedir, os.path.basename(bitcode))
+            cmd = 'cd {0} && {1}'.format(quote(remotedir),
+                                         ' '.join(map(quote, cmdline(remotebc))))
+            # killing ssh (on timeout or when another verifier won)
+            # stops the verifier once it writes its output, the verifiers
+            # have also their own timeout
+            returncode = ProcessRunner().run(SSH + [self.host, cmd], watch)
+            self._pull(remotedir, os.path.dirname(os.path.abspath(bitcode)))
+        finally:
+            self._cleanup(remotedir)
+
+        return returncode
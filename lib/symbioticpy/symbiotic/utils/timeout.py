@@ -1,6 +1,10 @@
 #!/usr/bin/env python3
 
 import signal
+from time import monotonic
+
+# when the global timeout expires (None = no timeout)
+_deadline = None
 
 
 class Timeout(Exception):
@@ -8,14 +12,47 @@ class Timeout(Exception):
 
 
 def start_timeout(sec):
+    global _deadline
+
     def alarm_handler(signum, data):
         raise Timeout
 
     signal.signal(signal.SIGALRM, alarm_handler)
     signal.alarm(sec)
+    _deadline = monotonic() + sec if sec > 0 else None
 
 
 def stop_timeout():
+    global _deadline
+
     # turn of timeout
     signal.signal(signal.SIGALRM, signal.SIG_DFL)
     signal.alarm(0)
+    _deadline = None
+
+
+def remaining_time(deadline=None):
+    """
+    Return the number of seconds until the deadline (the global timeout
+    by default) expires or None if there is no global timeout
+    """
+    if _deadline is None:
+        return None
+    return max(0.0, (deadline or _deadline) - monotonic())
+
+
+def stage_timeout(timeout, share=1.0, deadline=None):
+    """
+    Return the timeout for a stage that may take at most the given share
+    of the time remaining until the deadline (the global timeout by default),
+    so that the previous stages cannot eat the time of the next stages.
+    If a timeout of the stage is given (> 0), the returned timeout is not
+    bigger than that. 0 means no timeout.
+    """
+    rem = remaining_time(deadline)
+    if rem is None:
+        return timeout
+    limit = max(1, int(rem * share))
+    if timeout and timeout > 0:
+        return min(timeout, limit)
+    return limit
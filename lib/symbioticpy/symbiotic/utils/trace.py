@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+
+"""
+The timeline of the run in the trace-event format of Chrome
+(chrome://tracing, Perfetto) -- see --trace. Every phase of symbiotic
+(the times printed by print_elapsed_time), every process run through
+ProcessRunner and every pass run by sbt-pipeline is a complete event
+("ph": "X") with the start and the duration in microseconds. The events
+are kept in memory and written at the exit of symbiotic.
+"""
+
+import atexit
+import json
+from os import getpid
+from threading import Lock, get_ident
+from time import time
+
+_path = None
+_events = []
+_lock = Lock()
+
+
+def enable_trace(path):
+    """ Write the trace of this run into path at the exit """
+    global _path
+    if _path is None:
+        atexit.register(write_trace)
+    _path = path
+
+
+def tracing():
+    return _path is not None
+
+
+def add_event(name, cat, start, duration, args=None):
+    """
+    Add an event that started at start (seconds since the epoch, as from
+    time()) and took duration seconds. The events of one thread nest
+    by their times (e.g., the passes in the process of sbt-pipeline).
+    """
+    if _path is None:
+        return
+
+    event = {'name': name, 'cat': cat, 'ph': 'X',
+             'ts': int(start * 1e6), 'dur': int(duration * 1e6),
+             'pid': getpid(), 'tid': get_ident()}
+    if args:
+        event['args'] = args
+    with _lock:
+        _events.append(event)
+
+
+def add_pass_events(records, start):
+    """
+    Add the events of the passes from the report of sbt-pipeline
+    (see -pass-report), the process started at start. The passes
+    run one after another, so they are laid out from the start
+    (the time of loading of the module is not in the report).
+    """
+    for rec in records:
+        add_event(rec['pass'], 'pass', start, rec['time'],
+                  {'stage': rec['stage'], 'visited': rec['visited'],
+                   'added': rec['added'], 'removed': rec['removed']})
+        start += rec['time']
+
+
+def write_trace():
+    if _path is None:
+        return
+
+    with _lock:
+        events = sorted(_events, key=lambda e: e['ts'])
+    try:
+        with open(_path, 'w') as f:
+            json.dump({'traceEvents': events, 'displayTimeUnit': 'ms'}, f)
+    except (IOError, OSError) as e:
+        # the run itself did not fail
+        print('Failed writing the trace into {0}: {1}'.format(_path, str(e)))
@@ -3,7 +3,8 @@
 import sys
 import os
 from time import time
-from distutils.version import LooseVersion
+
+from . trace import add_event, tracing
 
 COLORS = {
     'DARK_BLUE': '\033[0;34m',
@@ -115,6 +116,11 @@ def print_elapsed_time(msg, color=None):
 
     tm = time() - last_time
     print_stdout('{0}: {1}'.format(msg, tm), color=color)
+    if tracing():
+        name = msg[len('INFO: '):] if msg.startswith('INFO: ') else msg
+        if name.endswith(' time'):
+            name = name[:-len(' time')]
+        add_event(name, 'phase', last_time, tm)
     # set new starting point
     last_time = time()
 
@@ -131,6 +137,19 @@ def get_clang_version():
 
     return lines[0].split()[2].strip()
 
+def set_pass_manager(cmd, llvm_version, new_pm=False):
+    """
+    Choose the pass manager of the opt command cmd (LLVM 13+ uses
+    the new one by default). In the new pass manager, the passes
+    of LLVMsbt.so are found through its pass plugin interface.
+    """
+    if int(llvm_version.split('.')[0]) < 13:
+        return
+    if not new_pm:
+        cmd.append('-enable-new-pm=0')
+    elif 'LLVMsbt.so' in cmd:
+        cmd.append('-load-pass-plugin=LLVMsbt.so')
+
 def dump_paths(dump_as_cmd=False, fun = print_stdout):
     variables = ['PATH', 'LD_LIBRARY_PATH', 'C_INCLUDE_DIR']
     for v in variables:
@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+
+"""
+The working directory in a tmpfs (--tmpfs). The intermediate files
+are written to the memory, and if they take more than the given cap,
+the oldest of them are moved to a directory on the disk (and replaced
+with symlinks, so that their paths stay valid). We also account how much
+every executable wrote to the working directory.
+"""
+
+import os
+from shutil import move, rmtree
+from tempfile import mkdtemp
+from threading import Lock
+
+from . utils import dbg
+
+# where to look for a tmpfs
+TMPFS_DIRS = ('/dev/shm', '/run/shm')
+
+# the working directory of the current task (if it is in a tmpfs)
+_workdir = None
+_lock = Lock()
+
+
+def find_tmpfs():
+    for d in TMPFS_DIRS:
+        if os.path.isdir(d) and os.access(d, os.W_OK):
+            return d
+    return None
+
+
+def _du(path):
+    """ The size of the files in the directory (not following symlinks) """
+    size = 0
+    with os.scandir(path) as it:
+        for entry in it:
+            # the files may be removed meanwhile
+            try:
+                if entry.is_dir(follow_symlinks=False):
+                    size += _du(entry.path)
+                elif not entry.is_symlink():
+                    size += entry.stat(follow_symlinks=False).st_size
+            except FileNotFoundError:
+                pass
+    return size
+
+
+class SpillingDir(object):
+    def __init__(self, path, cap, spillprefix):
+        self.path = path
+        # the maximal size of the files in path in bytes (0 = no limit)
+        self.cap = cap
+        # the prefix of the directory on the disk for the spilled files
+        self._spillprefix = spillprefix
+        self._spilldir = None
+        self._size = _du(path)
+        # the bytes written per executable
+        self.written = {}
+        self.spilled = 0
+
+    def account(self, name, may_spill):
+        if self.path is None:
+            return
+        size = _du(self.path)
+        if size > self._size:
+            self.written[name] = self.written.get(name, 0) + size - self._size
+        self._size = size
+
+        if may_spill and self.cap and size > self.cap:
+            self._spill()
+
+    def _spill(self):
+        if self._spilldir is None:
+            self._spilldir = mkdtemp(prefix=self._spillprefix)
+            dbg('Spilling the working directory to {0}'.format(self._spilldir))
+
+        entries = []
+        with os.scandir(self.path) as it:
+            for entry in it:
+                if entry.is_symlink():
+                    continue
+                st = entry.stat(follow_symlinks=False)
+                size = _du(entry.path) if entry.is_dir() else st.st_size
+                entries.append((st.st_mtime, entry.name, size))
+
+        # the oldest files are the least likely to be used again
+        for _, name, size in sorted(entries):
+            if self._size <= self.cap:
+                break
+            src = os.path.join(self.path, name)
+            dst = os.path.join(self._spilldir, name)
+            move(src, dst)
+            os.symlink(dst, src)
+            self._size -= size
+            self.spilled += size
+            dbg('Spilled {0} ({1} kB)'.format(name, size // 1024))
+
+    def cleanup(self):
+        # keep the statistics, they are reported at the end
+        self.path = None
+        if self._spilldir:
+            rmtree(self._spilldir, ignore_errors=True)
+            self._spilldir = None
+
+
+def set_working_dir(path, cap, spillprefix):
+    global _workdir
+    with _lock:
+        _workdir = SpillingDir(path, cap, spillprefix)
+
+
+def cleanup_working_dir():
+    """ Remove the spilled files (the working directory is removed elsewhere) """
+    with _lock:
+        if _workdir:
+            _workdir.cleanup()
+
+
+def account_io(name, may_spill):
+    """
+    Account what the executable 'name' wrote to the working directory,
+    spill the files to the disk if may_spill is True (no other process
+    is running) and the directory is too big
+    """
+    with _lock:
+        if not _workdir:
+            return
+        try:
+            _workdir.account(name, may_spill)
+        except OSError as e:
+            dbg('Failed accounting the working directory: {0}'.format(str(e)))
+
+
+def get_io():
+    """
+    Return the list of (executable, bytes written) and the number
+    of spilled bytes, or None if the working directory is not in a tmpfs
+    """
+    with _lock:
+        if not _workdir:
+            return None
+        return sorted(_workdir.written.items()), _workdir.spilled
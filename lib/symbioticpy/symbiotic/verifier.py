@@ -1,10 +1,23 @@
 #!/usr/bin/env python3
 
 import sys
+import os
+import json
+from os.path import abspath
+from shutil import copyfile
+from threading import Thread
+from queue import Queue
+from resource import getrlimit, RLIMIT_AS, RLIM_INFINITY
+from time import time
 
 from . utils import dbg
 from . utils import dbg, print_elapsed_time, restart_counting_time
 from . utils.process import runcmd, ProcessRunner
+from . utils.cache import OutcomeCache, feature_class
+from . utils import metrics
+from . utils.numa import place
+from . utils.remote import RemoteWorker
+from . utils.timeout import stage_timeout
 from . utils.watch import ProcessWatch, DbgWatch
 from . utils.utils import print_stderr, print_stdout
 from . exceptions import SymbioticException, SymbioticExceptionalResult
@@ -17,13 +30,80 @@ def initialize_verifier(opts):
     except KeyError:
         raise SymbioticException('Unknown verifier: {0}'.format(opts.tool_name))
 
+def _verifier_name(tool, addparams):
+    """ The verifier with its parameters, the key of the outcomes """
+    return ' '.join([tool.name()] + list(addparams or []))
+
 class ToolWatch(ProcessWatch):
-    def __init__(self, tool):
-        # store the whole output of a tool
-        ProcessWatch.__init__(self, None)
+    # the number of the last lines of the output that we keep
+    # for reporting errors if the tool parses its output on the fly
+    ERROR_LINES = 1000
+    # how often (in lines) we check whether the tool writes
+    # into the status channel
+    STATUS_CHECK_LINES = 256
+
+    def __init__(self, tool, status=None):
+        self._parser = None
+        if hasattr(tool, 'output_parser'):
+            self._parser = tool.output_parser()
+
+        # store the whole output of a tool if it needs it for the result
+        ProcessWatch.__init__(self,
+                              ToolWatch.ERROR_LINES if self._parser else None)
         self._tool = tool
+        # the file of the status channel (see SymbioticBaseTool.status_channel)
+        # and whether the tool writes into it, then we do not parse the output
+        self._status = status
+        self._status_active = False
+        self._lines = 0
+
+    def _read_status(self):
+        events = []
+        try:
+            with open(self._status, 'r') as f:
+                for line in f:
+                    try:
+                        events.append(json.loads(line))
+                    except ValueError:
+                        # the tool may have been killed while writing
+                        dbg('Invalid line in the status channel: {0}'.format(line))
+        except OSError:
+            return None
+        return events
+
+    def getResult(self, returncode, returnsignal, isTimeout):
+        if self._status:
+            events = self._read_status()
+            if events is not None:
+                res = self._tool.result_from_status(events, returncode, isTimeout)
+                if res is not None:
+                    return res
+                if self._status_active:
+                    # we did not parse the output
+                    return 'ERROR (no result in the status channel, '\
+                           'the tool exited with {0})'.format(returncode)
+
+        if self._parser:
+            return self._parser.result(returncode, returnsignal, isTimeout)
+        return self._tool.determine_result(returncode, returnsignal,
+                                           self.getLines(), isTimeout)
+
+    def putLine(self, line):
+        # the whole output is not needed once the tool writes the status
+        if self._status_active and not self._parser:
+            self.parse(line)
+        else:
+            ProcessWatch.putLine(self, line)
 
     def parse(self, line):
+        if self._status and not self._status_active:
+            if self._lines % ToolWatch.STATUS_CHECK_LINES == 0:
+                self._status_active = os.path.exists(self._status)
+            self._lines += 1
+
+        if self._parser and not self._status_active:
+            self._parser.parse(line)
+
         if b'ERROR' in line or b'WARN' in line or b'Assertion' in line\
            or b'error' in line or b'warn' in line:
             line = line.decode('utf-8', 'replace')
@@ -58,6 +138,9 @@ class SymbioticVerifier(object):
         # create an instance of CC so that we can do auxiliary
         # transformations before verification
         self._cc = SymbioticCC(sources, tool, opts, env)
+        # the job slots on other machines (--remote-workers),
+        # the verifiers run locally if there are none
+        self._workers = [RemoteWorker(h) for h in opts.remote_workers]
 
     def command(self, cmd):
         return runcmd(cmd, DbgWatch('all'),
@@ -73,29 +156,43 @@ class SymbioticVerifier(object):
         self._cc.link_undefined(only_func)
         self.curfile = self._cc.curfile
 
-    def _run_tool(self, tool, prp, params, timeout):
-        cmd = []
-        if timeout:
-            cmd = ['timeout', str(int(timeout))]
-        cmd += tool.cmdline(tool.executable(), params,
-                            [self.curfile], prp, [])
-        watch = ToolWatch(tool)
-        process = ProcessRunner()
+    def _run_tool(self, tool, prp, params, timeout,
+                  bitcode=None, cpus=None, memlimit=None, worker=None,
+                  node=None):
+        def cmdline(path):
+            cmd = []
+            if timeout:
+                cmd = ['timeout', str(int(timeout))]
+            return cmd + tool.cmdline(tool.executable(), params,
+                                      [path], prp, [])
+        bitcode = bitcode or self.curfile
+        # the tool writes its status into a file next to the bitcode
+        # (not on the remote workers)
+        status, env = None, None
+        if not worker and hasattr(tool, 'status_channel') and\
+           tool.status_channel():
+            status = bitcode + '.status'
+            if os.path.exists(status):
+                os.unlink(status)
+            env = dict(os.environ, SYMBIOTIC_STATUS_FILE=abspath(status))
+        watch = ToolWatch(tool, status)
 
-        returncode = process.run(cmd, watch)
+        if worker:
+            returncode = worker.run(cmdline, bitcode, watch)
+        else:
+            returncode = ProcessRunner().run(cmdline(bitcode), watch,
+                                             cpus, memlimit, env, node)
         if returncode != 0:
             dbg('The verifier return non-0 return status')
 
-        res = tool.determine_result(returncode, 0,
-                                    watch.getLines(),
-                                    False)
+        res = watch.getResult(returncode, 0, False)
         if res.lower().startswith('error'):
             for line in watch.getLines():
                 print_stderr(line.decode('utf-8', 'replace'),
                              color='RED', print_nl=False)
         return res, watch
 
-    def _run_verifier(self, tool, addparams, timeout):
+    def _prepare_verifier(self, tool, addparams):
         # do any additional transformations before verification
         if hasattr(tool, 'passes_before_verification'):
             self.run_opt(tool.passes_before_verification())
@@ -109,17 +206,277 @@ class SymbioticVerifier(object):
             params = params + addparams
         prp = self.options.property.getPrpFile()
 
+        return params, prp
+
+    def _run_verifier(self, tool, addparams, timeout):
+        params, prp = self._prepare_verifier(tool, addparams)
         # do it!
-        return self._run_tool(tool, prp, params, timeout)
+        worker = self._workers[0] if self._workers else None
+        return self._run_tool(tool, prp, params, timeout, worker=worker)
+
+    def _get_quotas(self, num):
+        """
+        Split the CPUs and the memory between num verifiers that run
+        at once. Return the list of (set of CPUs, NUMA node) for every
+        verifier (see numa.place) and the memory limit for one verifier
+        (None if we have no limit).
+        """
+        groups = place(num)
+
+        memlimit = None
+        soft, _ = getrlimit(RLIMIT_AS)
+        if soft != RLIM_INFINITY:
+            memlimit = soft // num
+        return groups, memlimit
+
+    def _race_verifiers(self, verifiers):
+        """
+        Run the verifiers in parallel and return the first
+        true/false answer (the other verifiers are killed then).
+        We run at most as many verifiers as we have CPUs at once,
+        the others wait (in their order) until some verifier finishes.
+        """
+        orig_bitcode = self.curfile
+        base = orig_bitcode[:orig_bitcode.rfind('.')]
+
+        # prepare the bitcode for all verifiers, this is done serially
+        setups = []
+        for n, (tool, addparams, timeout) in enumerate(verifiers):
+            self.curfile = orig_bitcode
+            if hasattr(tool, 'passes_before_verification') or\
+               hasattr(tool, 'actions_before_verification'):
+                # the transformations derive the names of files from
+                # the current file, so every verifier needs its own copy
+                self.curfile = '{0}-v{1}.bc'.format(base, n)
+                copyfile(orig_bitcode, self.curfile)
+            params, prp = self._prepare_verifier(tool, addparams)
+            setups.append((tool, prp, params, stage_timeout(timeout or 0),
+                           self.curfile))
+        self.curfile = orig_bitcode
+
+        answers, winner = self._run_setups(setups, ('true', 'false'))
+        if winner is not None:
+            return answers[winner], setups[winner][0]
+        # return the answer of the last verifier as in the serial mode
+        return answers[-1], None
+
+    def _run_setups(self, setups, decisive, report_failures=True):
+        """
+        Run the prepared verifiers (tool, prp, params, timeout, bitcode)
+        in parallel, at most as many at once as we have CPUs (or job
+        slots on the remote workers). Stop
+        when some verifier gives an answer that starts with one of
+        decisive (the other verifiers are killed then). Return
+        the answers (None for the verifiers that did not finish) and
+        the index of the decisive answer (or None).
+        """
+        workers = self._workers
+        if workers:
+            slots = min(len(setups), len(workers))
+            groups, memlimit = [(None, None)] * slots, None
+        else:
+            slots = min(len(setups), len(os.sched_getaffinity(0)))
+            groups, memlimit = self._get_quotas(slots)
+        dbg('Running {0} verifiers, {1} at once'.format(len(setups), slots))
+
+        results = Queue()
+        def run(n, slot):
+            tool, prp, params, timeout, bitcode = setups[n]
+            worker = workers[slot] if workers else None
+            try:
+                cpus, node = groups[slot]
+                res, watch = self._run_tool(tool, prp, params, timeout,
+                                            bitcode, cpus, memlimit,
+                                            worker, node)
+            except Exception as e:
+                # do not let the main thread wait for this verifier forever
+                res, watch = 'ERROR ({0})'.format(str(e)), None
+            results.put((n, slot, res, watch))
+
+        threads = []
+        def start(n, slot):
+            t = Thread(target=run, args=(n, slot))
+            t.start()
+            threads.append(t)
+
+        for n in range(slots):
+            start(n, n)
+
+        finished = 0
+        answers = [None] * len(setups)
+        winner = None
+        while finished < len(setups):
+            n, slot, res, watch = results.get()
+            finished += 1
+            answers[n] = res
+            verifiertool = setups[n][0]
+
+            if res.lower().startswith(decisive):
+                winner = n
+                break
+
+            if report_failures:
+                print(f"{verifiertool.name()} answered {res}")
+                if hasattr(self._tool, "verifier_failed") and watch:
+                    self._tool.verifier_failed(verifiertool, res, watch)
+
+            if len(threads) < len(setups):
+                start(len(threads), slot)
+
+        if winner is not None:
+            # kill the other verifiers
+            pr = ProcessRunner()
+            if pr.hasProcess():
+                pr.terminate()
+        for t in threads:
+            t.join()
+
+        return answers, winner
+
+    def _use_cube_output(self, cubedir):
+        """
+        Make the output of the verifier of the cube (klee-last) the output
+        for the original bitcode, the witnesses and the replaying
+        of the error look for it there
+        """
+        last = os.path.join(cubedir, 'klee-last')
+        if not os.path.islink(last):
+            return
+        link = os.path.join(os.path.dirname(self.curfile), 'klee-last')
+        if os.path.lexists(link):
+            os.unlink(link)
+        os.symlink(os.path.realpath(last), link)
+
+    def _run_cubes(self, tool, addparams, timeout):
+        """
+        Split the input space of the program into 2^N cubes
+        (-split-input-space) and verify the cubes in parallel.
+        The program is incorrect if some cube is incorrect
+        and correct if all the cubes are correct.
+        """
+        bits = self.options.split_input
+        orig_bitcode = self.curfile
+        workdir, name = os.path.split(orig_bitcode)
+
+        setups = []
+        for n in range(2 ** bits):
+            # KLEE stores its output next to the bitcode,
+            # so every cube needs a directory of its own
+            cubedir = os.path.join(workdir, 'cube-{0}'.format(n))
+            os.makedirs(cubedir, exist_ok=True)
+            self.curfile = os.path.join(cubedir, name)
+            copyfile(orig_bitcode, self.curfile)
+            self.run_opt(['-split-input-space',
+                          '-split-input-space-bits={0}'.format(bits),
+                          '-split-input-space-cube={0}'.format(n)])
+            self.link_undefined(['__VERIFIER_assume'])
+            params, prp = self._prepare_verifier(tool, addparams)
+            setups.append((tool, prp, params, stage_timeout(timeout or 0),
+                           self.curfile))
+        self.curfile = orig_bitcode
+
+        answers, winner = self._run_setups(setups, ('false',),
+                                           report_failures=False)
+        if winner is not None:
+            self._use_cube_output(os.path.dirname(setups[winner][4]))
+            return answers[winner]
+
+        for n, res in enumerate(answers):
+            if not res.lower().startswith('true'):
+                dbg('Cube {0} answered {1}'.format(n, res))
+                return res
+        return answers[0]
 
     def run_verification(self):
+        if self.options.split_input:
+            return self.run_verification_cubes()
+        if self.options.parallel_verifiers:
+            return self.run_verification_parallel()
+        return self.run_verification_serial()
+
+    def run_verification_cubes(self):
+        print_stdout('INFO: Starting verification ({0} cubes of the input)'\
+                     .format(2 ** self.options.split_input), color='WHITE')
+        restart_counting_time()
+        for verifiertool, addparams, verifiertimeout in self._tool.verifiers():
+            res = self._run_cubes(verifiertool, addparams, verifiertimeout)
+            sw = res.lower().startswith
+            if sw('true') or sw('false'):
+                print_elapsed_time("INFO: Verification time", color='WHITE')
+                return res, verifiertool
+            print(f"{verifiertool.name()} answered {res}")
+        print_elapsed_time("INFO: Verification time", color='WHITE')
+        return res, None
+
+    def run_verification_parallel(self):
+        print_stdout('INFO: Starting verification (parallel portfolio)',
+                     color='WHITE')
+        restart_counting_time()
+        # the list of verifiers may depend on the results of the previous
+        # verifiers (verifier_failed), here we get it at once
+        verifiers = list(self._tool.verifiers())
+        res, verifiertool = self._race_verifiers(verifiers)
+        print_elapsed_time("INFO: Verification time", color='WHITE')
+        return res, verifiertool
+
+    def _outcome_class(self):
+        """
+        The class of the program for the outcomes of the verifiers
+        (see --adaptive-verifiers), None if we do not keep them
+        """
+        opts = self.options
+        if not opts.adaptive_verifiers:
+            return None
+        prp = opts.propertystr or os.path.basename(opts.property.getPrpFile() or '')
+        return feature_class(prp, opts.program_features)
+
+    def _order_verifiers(self, cls, verifiers):
+        """
+        Sort the verifiers by how often they answered for the programs
+        of the class (the untried ones count as answering half of the time)
+        and then by the mean time of the answers. The sort is stable,
+        without any outcomes the order of the tool stays. The verifiers
+        without a timeout stay at the end, they would block the others.
+        """
+        outcomes = OutcomeCache(self.options.cache_dir).get(cls)
+
+        def score(verifier):
+            entry = outcomes.get(_verifier_name(verifier[0], verifier[1]))
+            if not entry:
+                return (-0.5, 0)
+            rate = (entry['answers'] + 1) / (entry['runs'] + 2)
+            mean = entry['time'] / entry['answers'] if entry['answers'] else 0
+            return (-rate, mean)
+
+        ordered = sorted((v for v in verifiers if v[2]), key=score) +\
+                  [v for v in verifiers if not v[2]]
+        if ordered != verifiers:
+            dbg('Verifiers ordered by the outcomes for {0}: {1}'.format(
+                cls, ', '.join(_verifier_name(v[0], v[1]) for v in ordered)))
+        return ordered
+
+    def run_verification_serial(self):
         print_stdout('INFO: Starting verification', color='WHITE')
         restart_counting_time()
         orig_bitcode = self.curfile
-        for verifiertool, addparams, verifiertimeout in self._tool.verifiers():
+        verifiers = self._tool.verifiers()
+        cls = self._outcome_class()
+        if cls:
+            # the list of verifiers may depend on the results of the previous
+            # verifiers (verifier_failed), here we get it at once
+            verifiers = self._order_verifiers(cls, list(verifiers))
+        for verifiertool, addparams, verifiertimeout in verifiers:
             self.curfile = orig_bitcode
+            # the verifier must be stopped before the global timeout,
+            # so that we get (and report) its answer
+            verifiertimeout = stage_timeout(verifiertimeout or 0)
+            started = time()
             res, watch = self._run_verifier(verifiertool, addparams, verifiertimeout)
             sw = res.lower().startswith
+            if cls:
+                OutcomeCache(self.options.cache_dir).record(
+                    cls, _verifier_name(verifiertool, addparams),
+                    sw('true') or sw('false'), time() - started)
             # we got an answer, we can finish
             if sw('true') or sw('false'):
                 return res, verifiertool
@@ -132,7 +489,8 @@ class SymbioticVerifier(object):
 
     def run(self):
         try:
-            return self.run_verification()
+            with metrics.stage('verify'):
+                return self.run_verification()
         except KeyboardInterrupt as e:
             raise SymbioticException('interrupted')
         except SymbioticExceptionalResult as res:
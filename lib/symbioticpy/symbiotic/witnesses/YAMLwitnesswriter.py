@@ -1,20 +1,11 @@
 #!/usr/bin/env python3
 
-from os.path import basename
-from hashlib import sha256 as hashfunc
-import subprocess
 import datetime
-import re
+import uuid
 import yaml
+from os.path import basename
 
-def get_hash(source):
-    f = open(source, 'r', encoding='utf-8')
-    hsh = hashfunc()
-    for l in f:
-        hsh.update(l.encode('utf-8'))
-
-    f.close()
-    return hsh.hexdigest()
+from . sourceindex import get_hash, get_index
 
 class YAMLWriter(object):
     def __init__(self, source, prps, is32bit, is_correctness_wit):
@@ -23,15 +14,20 @@ class YAMLWriter(object):
         self._is32bit = is32bit
         self._correctness_wit = is_correctness_wit
 
-        self.test = []
+        # the .waypoints file with the trace
+        self._path = None
         self.errorLoc = None
+        # the invariants of loops for correctness witnesses
+        self._invariants = []
         self.witness = []
 
     def add_metadata(self):
         witness = {}
-        witness['entry_type'] = "violation_sequence" if not self._correctness_wit else "correctness_witness"
+        # correctness witnesses are sets of invariants (format 2.0)
+        witness['entry_type'] = "violation_sequence" if not self._correctness_wit else "invariant_set"
         witness['metadata'] = {
-            'format_version' : "0.1",
+            'format_version' : "0.1" if not self._correctness_wit else "2.0",
+            'uuid' : str(uuid.uuid4()),
             'creation_time' :  '{date:%Y-%m-%dT%T}Z'.format(date=datetime.datetime.utcnow()),
             'producer' : {'name' : 'symbiotic'},
             'task' :
@@ -50,163 +46,109 @@ class YAMLWriter(object):
 
     def generate_witness(self, path, is_termination):
         """
-        Take a .graphml file generated by a tool and generate a new
-        .graphml file from it that has all the needed metadata.
+        Take a .waypoints file generated by a tool and prepare generating
+        the witness from it (the witness is generated while writing,
+        so that long traces are not kept in the memory).
 
         \param path         the .waypoints file
         """
-        # parse the graphml file from KLEE
-        self.parse(path)
-        assert self.errorLoc, "Failed parsing a witness" + path 
+        self._path = path
+        # find the error location (the last line of the file)
+        with open(path, "r") as testfile:
+            for line in testfile:
+                if line[0] == '@':
+                    self.errorLoc = line.strip('\n').split(':')[1:]
+                    break
+        assert self.errorLoc, "Failed parsing a witness" + path
 
         self.add_metadata()
-        self.create_content()
-
+        self._shift_error()
 
     def generate_violation_witness(self, path, is_termination):
         self.generate_witness(path, is_termination)
 
+    def generate_correctness_witness(self, invariants):
+        """
+        Generate the set of invariants of loops from the list of
+        {function, file, line, column, invariant} (as written by
+        'opt -export-invariants'). The invariants of other files than
+        the source are skipped.
+        """
+        self.add_metadata()
+        for inv in invariants:
+            if basename(inv['file']) != basename(self._source):
+                continue
+            self._invariants.append({'invariant' : {
+                'type' : 'loop_invariant',
+                'location' : {
+                    'file_name' : self._source,
+                    'line' : inv['line'],
+                    'column' : inv['column'],
+                    'function' : inv['function']
+                },
+                'value' : inv['invariant'],
+                'format' : 'c_expression'
+            }})
+        self.witness[-1]['content'] = self._invariants
+
     def dump(self):
         print(self.witness)
 
     def write(self, to):
         with open(to, "w") as witness_file:
-            yaml.safe_dump(self.witness, witness_file, default_style=None)
- 
-    def get_locations(self):
-        this_file = True
-        shifterror = True
-        call_map = dict()
-        last_ln = "" 
-        ast = subprocess.run(['clang', '-Xclang', '-ast-dump', '-fsyntax-only', '-fno-color-diagnostics', self._source], 
-                             stdout=subprocess.PIPE, 
-                             stderr=subprocess.DEVNULL).stdout.decode('utf-8')
-        
-        for line in ast.splitlines():
-            # check if we have a begin and end
-            loc = re.search("^[^-]*-[a-zA-Z]* 0x[0-9A-Fa-f]* <([^>,]*), ([^,]*)>", line)
-
-            if not loc:  # if not, we only care about the line
-                ln = re.search("^[^-]*-[a-zA-Z]* 0x[0-9A-Fa-f]* <([^:>]*):([0-9]*)", line)
-                if ln and ln[1] != "col":
-                    last_ln = ln[2]
-                    if ln[1] != "line":
-                        this_file = ln[1] == self._source
-                continue
-
-            start = loc[1]
-            end = loc[2]
-
-            location = re.search("([^:]*):([0-9]*):([0-9]*)", start)
-            if not location:
-                if not this_file:
-                    continue
-                # if there's no line specified, use the previous one
-                name = None
-                start_ln = last_ln
-                start_col = re.search("col:([0-9]*)", start)[1]
-                if not start_col:
-                    continue
-            else:
-                name = location[1]
-                start_ln = location[2]
-                start_col = location[3]
-
-            # if there is a filename, check if its the program under validation - we do not care about headers
-            if name and name != "line":
-                if name != self._source:
-                    this_file = False
-                    continue
-                else:
-                    this_file = True
-
-            # update last line
-            last_ln = start_ln
-
-            # again, check if there's a line number, otherwise use previous
-            if "line" in end:
-                end_loc = re.search("line:([0-9]*):([0-9]*)", end)
-                end_ln, end_col = end_loc[1], end_loc[2]
-            else:
-                end_ln = last_ln
-                end_col_match = re.search("col:([0-9]*)", end)
-                if not end_col_match:
-                    this_file = False
-                    continue
-                end_col = end_col_match[1]
-
-            last_ln = end_ln
-
-            if not this_file:
-                continue
-
-            start_location = start_ln + ":" + start_col
-            end_location = end_ln + ":" + end_col
-
-            # index callmap by start location
-            if "CallExpr" in line:
-                if start_location not in call_map:
-                    call_map[start_location] = end_location
-
-            if not shifterror or "FunctionDecl" in line \
-                or "CompoundStmt" in line \
-                or "IfStmt" in line \
-                or "DoStmt" in line \
-                or "WhileStmt" in line \
-                or "ForStmt" in line \
-                or "LabelStmt" in line:
-                continue
-            
-
-            if int(start_ln) > int(self.errorLoc[1]) or int(end_ln) < int(self.errorLoc[1]):
-                continue
-
-            if (int(start_ln) == int(self.errorLoc[1]) and int(start_col) > int(self.errorLoc[2])) or \
-                (int(end_ln) == int(self.errorLoc[1]) and int(end_col) < int(self.errorLoc[2])):
-                continue
+            if self._path is None:
+                yaml.safe_dump(self.witness, witness_file, default_style=None)
+                return
 
-            if "ReturnStmt" in line and (int(start_ln) != int(self.errorLoc[1]) or \
-                                                          int(start_col) != int(self.errorLoc[2])):
-                continue      
+            # the metadata, the content is written segment by segment
+            yaml.safe_dump(self.witness, witness_file, default_style=None)
+            witness_file.write('  content:\n')
+            for segment in self._segments():
+                chunk = yaml.safe_dump([{'segment' : segment}], default_style=None)
+                for line in chunk.splitlines(True):
+                    witness_file.write('  ')
+                    witness_file.write(line)
+
+    def _shift_error(self):
+        """
+        Move the error location to the start of its statement
+        """
+        error = (int(self.errorLoc[1]), int(self.errorLoc[2]))
+        shifted = get_index(self._source).error_location(error)
+        if shifted is None:
+            print("Something went wrong. Error location might not comply with the witness format.")
+            shifted = error
 
-            self.errorLoc[1] = int(start_ln)
-            self.errorLoc[2] = int(start_col)
-            shifterror = False
+        self.errorLoc[1], self.errorLoc[2] = shifted
 
-        if shifterror:
-            print("Something went wrong. Error location might not comply with the witness format.")
-            self.errorLoc[1] = int(self.errorLoc[1])
-            self.errorLoc[2] = int(self.errorLoc[2])
-
-        return call_map
-
-    def create_content(self):
-        content = []
-
-        call_map = self.get_locations()
-
-        for call in self.test:
-            loc = "{line}:{col}".format(line=call[1], col=call[2])
-            assert loc in call_map, "Failed creating witness"
-            call[1], call[2] = map(int, call_map[loc].split(':'))
-            segment = []
-            waypoint = { 'type' : 'function_return',
-                          'action' : 'follow',
-                          'constraint' : {
-                            'format' : 'C',
-                            'value' : '\\result == ' + call[3]
-                          },
-                          'location' : {
-                            'file_name' : self._source,
-                            'line' : call[1],
-                            'column' : call[2]
-                          }
+    def _segments(self):
+        error = (int(self.errorLoc[1]), int(self.errorLoc[2]))
+        call_map = get_index(self._source).calls(error)
 
-                        }
-            segment.append({'waypoint' : waypoint})
-            content.append({'segment' : segment})
+        with open(self._path, "r") as testfile:
+            for line in testfile:
+                if line[0] == '@':
+                    break
+                call = line.strip('\n').split(':')
+
+                loc = "{line}:{col}".format(line=call[1], col=call[2])
+                assert loc in call_map, "Failed creating witness"
+                call[1], call[2] = map(int, call_map[loc].split(':'))
+                waypoint = { 'type' : 'function_return',
+                              'action' : 'follow',
+                              'constraint' : {
+                                'format' : 'C',
+                                'value' : '\\result == ' + call[3]
+                              },
+                              'location' : {
+                                'file_name' : self._source,
+                                'line' : call[1],
+                                'column' : call[2]
+                              }
+
+                            }
+                yield [{'waypoint' : waypoint}]
 
-        target_segment = []
         target = { 'type' : 'target',
                    'action' : 'follow',
                    'location' : {
@@ -216,19 +158,4 @@ class YAMLWriter(object):
                           }
 
                  }
-            
-        target_segment.append({'waypoint' : target})
-        content.append({'segment' : target_segment})
-
-        self.witness[0]['content'] = content
-
-
-
-    def parse(self, path):
-        with open(path, "r") as testfile:
-            for line in testfile.readlines():
-                if line[0] == '@':
-                    self.errorLoc = line.strip('\n').split(':')[1:]
-                    break
-                self.test.append(line.strip('\n').split(':'))
-
+        yield [{'waypoint' : target}]
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+
+"""
+The information about the source file that the witness writers need
+(the hash of the file, the locations of calls and statements). It is
+computed once per task and shared by the GraphML and YAML writers.
+"""
+
+import os
+import re
+import subprocess
+from hashlib import sha256 as hashfunc
+
+# the hashes of files, the keys are (path, mtime, size)
+_hashes = {}
+# the indexes of the sources, the keys are the paths
+_indexes = {}
+
+def get_hash(source):
+    st = os.stat(source)
+    key = (os.path.abspath(source), st.st_mtime_ns, st.st_size)
+    hsh = _hashes.get(key)
+    if hsh is not None:
+        return hsh
+
+    h = hashfunc()
+    with open(source, 'r', encoding='utf-8') as f:
+        for l in f:
+            h.update(l.encode('utf-8'))
+
+    hsh = _hashes[key] = h.hexdigest()
+    return hsh
+
+def get_index(source):
+    index = _indexes.get(source)
+    if index is None:
+        index = _indexes[source] = SourceIndex(source)
+    return index
+
+
+class SourceIndex(object):
+    """
+    The locations of the calls and of the statements in the source.
+    The AST of the source is read from clang line by line, so only
+    the found locations are kept in the memory.
+    """
+
+    _LOC = re.compile("^[^-]*-[a-zA-Z]* 0x[0-9A-Fa-f]* <([^>,]*), ([^,]*)>")
+    _LN = re.compile("^[^-]*-[a-zA-Z]* 0x[0-9A-Fa-f]* <([^:>]*):([0-9]*)")
+    _NOSHIFT = ("FunctionDecl", "CompoundStmt", "IfStmt", "DoStmt",
+                "WhileStmt", "ForStmt", "LabelStmt")
+
+    def __init__(self, source):
+        self._source = source
+        # {start of the call : end of the call}, both 'line:col'
+        self._calls = None
+        # {error location : the location of its statement}
+        self._errors = {}
+
+    def _ast(self):
+        proc = subprocess.Popen(['clang', '-Xclang', '-ast-dump', '-fsyntax-only',
+                                 '-fno-color-diagnostics', self._source],
+                                stdout=subprocess.PIPE,
+                                stderr=subprocess.DEVNULL)
+        try:
+            for line in proc.stdout:
+                yield line.decode('utf-8', 'replace')
+        finally:
+            proc.stdout.close()
+            proc.wait()
+
+    def _nodes(self):
+        """
+        Yield (kind line, start line, start col, end line, end col)
+        for the nodes of the AST that come from the source
+        """
+        this_file = True
+        last_ln = ""
+        for line in self._ast():
+            # check if we have a begin and end
+            loc = self._LOC.search(line)
+
+            if not loc:  # if not, we only care about the line
+                ln = self._LN.search(line)
+                if ln and ln[1] != "col":
+                    last_ln = ln[2]
+                    if ln[1] != "line":
+                        this_file = ln[1] == self._source
+                continue
+
+            start = loc[1]
+            end = loc[2]
+
+            location = re.search("([^:]*):([0-9]*):([0-9]*)", start)
+            if not location:
+                if not this_file:
+                    continue
+                # if there's no line specified, use the previous one
+                name = None
+                start_ln = last_ln
+                start_col = re.search("col:([0-9]*)", start)[1]
+                if not start_col:
+                    continue
+            else:
+                name = location[1]
+                start_ln = location[2]
+                start_col = location[3]
+
+            # if there is a filename, check if its the program under
+            # validation - we do not care about headers
+            if name and name != "line":
+                if name != self._source:
+                    this_file = False
+                    continue
+                else:
+                    this_file = True
+
+            # update last line
+            last_ln = start_ln
+
+            # again, check if there's a line number, otherwise use previous
+            if "line" in end:
+                end_loc = re.search("line:([0-9]*):([0-9]*)", end)
+                end_ln, end_col = end_loc[1], end_loc[2]
+            else:
+                end_ln = last_ln
+                end_col_match = re.search("col:([0-9]*)", end)
+                if not end_col_match:
+                    this_file = False
+                    continue
+                end_col = end_col_match[1]
+
+            last_ln = end_ln
+
+            if not this_file:
+                continue
+
+            yield line, int(start_ln), int(start_col), int(end_ln), int(end_col)
+
+    def _scan(self, error):
+        """
+        Go over the AST once, collect the calls (if not collected yet)
+        and find the statement of the error location (line, col)
+        """
+        calls = {} if self._calls is None else None
+        shifted = None
+        err_ln, err_col = error
+
+        for line, start_ln, start_col, end_ln, end_col in self._nodes():
+            # index callmap by start location
+            if calls is not None and "CallExpr" in line:
+                start_location = "{0}:{1}".format(start_ln, start_col)
+                if start_location not in calls:
+                    calls[start_location] = "{0}:{1}".format(end_ln, end_col)
+
+            if shifted or any(kind in line for kind in self._NOSHIFT):
+                if calls is None:
+                    break
+                continue
+
+            if start_ln > err_ln or end_ln < err_ln:
+                continue
+
+            if (start_ln == err_ln and start_col > err_col) or \
+               (end_ln == err_ln and end_col < err_col):
+                continue
+
+            if "ReturnStmt" in line and (start_ln != err_ln or start_col != err_col):
+                continue
+
+            shifted = (start_ln, start_col)
+            if calls is None:
+                break
+
+        if calls is not None:
+            self._calls = calls
+        self._errors[error] = shifted
+
+    def calls(self, error):
+        """
+        Return the map from the starts of calls to their ends
+        ('line:col' strings)
+        """
+        if self._calls is None:
+            self._scan(error)
+        return self._calls
+
+    def error_location(self, error):
+        """
+        Return the location (line, col) where the statement with the error
+        location starts or None if no statement contains the location
+        """
+        if error not in self._errors:
+            self._scan(error)
+        return self._errors[error]
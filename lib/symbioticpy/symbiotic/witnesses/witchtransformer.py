@@ -1,6 +1,7 @@
 import sys
 import clang.cindex
 import yaml
+from bisect import bisect_left
 
 
 class ValidationTransformer:
@@ -23,6 +24,9 @@ class ValidationTransformer:
         self._branchings = dict()   # {witness_location : (control_expr_begin, control_expr_end, col)}
         self._switches = dict()     # {witness_location : (control_expr_begin, control_expr_end, col)}
         self._target = dict()       # {witness_location : (begin_location, end_location)}
+        # the sorted lines of all witness locations, we do not need to visit
+        # the parts of the AST that do not span any of these lines
+        self._lines = []
 
         # Keep information about what we want to insert into the C code
         # and how the witness locations will change
@@ -89,6 +93,15 @@ class ValidationTransformer:
         
         assert self._target, "Missing target waypoint!"
 
+        lines = set()
+        for map in (self._calls, self._assumptions, self._branchings, self._target):
+            lines.update(line for (line, _) in map)
+        self._lines = sorted(lines)
+
+    def _spans_witness_line(self, start, end):
+        i = bisect_left(self._lines, start)
+        return i < len(self._lines) and self._lines[i] <= end
+
     # Traverse the AST, find the locations mentioned in the witness and store information
     # about them in one of: _calls, _assumptions, _branchings, _target.
     def traverse_AST(self, node, full=True):
@@ -101,6 +114,15 @@ class ValidationTransformer:
             start = child.extent.start
             end = child.extent.end
 
+            # Every location that we look for (the start of a statement
+            # or of a control expression, the end of a call, the '?' of
+            # a ternary operator) lies within the extent of its node.
+            # Skipping the other subtrees saves most of the work on large
+            # (preprocessed) files.
+            if not self._spans_witness_line(start.line, end.line):
+                child_index += 1
+                continue
+
             # For all function calls and returns, we change the location
             # from the right paranthesis to the position of the call.
             if child.kind == clang.cindex.CursorKind.CALL_EXPR:
@@ -286,6 +308,11 @@ class ValidationTransformer:
         with open(self.out_program, 'w') as program_file2:
             program_file2.writelines(self.c_lines)
 
+    def target_line(self):
+        """ The line of the target waypoint (call after transform()) """
+        target = self.witness[0]['content'][-1]['segment'][-1]['waypoint']
+        return target['location']['line']
+
     def _insert_calls(self):
         self._insert.sort(key=lambda item: item[2])
         self._insert.sort(key=lambda item: item[1], reverse = True)
@@ -1,10 +1,11 @@
 #!/usr/bin/env python3
 
 from os.path import basename
-from hashlib import sha256 as hashfunc
 import datetime
 import re
 
+from . sourceindex import get_hash
+
 no_lxml = False
 try:
     from lxml import etree as ET
@@ -14,15 +15,6 @@ if no_lxml:
     # if this fails, then we're screwed, so let the script die
     from xml.etree import ElementTree as ET
 
-def get_hash(source):
-    f = open(source, 'r', encoding='utf-8')
-    hsh = hashfunc()
-    for l in f:
-        hsh.update(l.encode('utf-8'))
-
-    f.close()
-    return hsh.hexdigest()
-
 def _add_edge_key(root, name):
     e = ET.SubElement(root, 'key', id=name)
     e.set('for', 'edge')
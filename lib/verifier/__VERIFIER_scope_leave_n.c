@@ -0,0 +1,10 @@
+#include "symbiotic-size_t.h"
+
+extern void __VERIFIER_scope_leave(void *);
+
+// the objects of one scope batched by -replace-lifetime-markers-batch
+void __VERIFIER_scope_leave_n(void **objs, size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		__VERIFIER_scope_leave(objs[i]);
+}
@@ -0,0 +1,17 @@
+#include "symbiotic-size_t.h"
+
+extern unsigned __symbiotic_nondet_uint(void);
+extern void __VERIFIER_assume(int);
+
+/* the maximal number of characters that a model of an input function
+ * reads at once. The definition is weak, -set-input-limit overrides it. */
+__attribute__((weak)) size_t __symbiotic_input_limit = (size_t) -1;
+
+/* the length of a string read into a buffer of 'size' bytes
+ * (there must be a room for the terminating zero) */
+size_t __symbiotic_input_len(size_t size)
+{
+	size_t len = __symbiotic_nondet_uint();
+	__VERIFIER_assume(len < size && len <= __symbiotic_input_limit);
+	return len;
+}
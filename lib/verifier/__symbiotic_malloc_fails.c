@@ -0,0 +1,21 @@
+extern _Bool __symbiotic_nondet__Bool(void);
+
+/* the maximal number of allocations that may fail on a path.
+ * The definition is weak, -set-malloc-fail-budget overrides it. */
+__attribute__((weak)) unsigned __symbiotic_malloc_fail_budget = (unsigned) -1;
+
+/* the number of allocations that failed on this path */
+static unsigned __symbiotic_malloc_failures;
+
+/* should the allocation fail? (while the budget is not exhausted,
+ * the allocation fails non-deterministically) */
+_Bool __symbiotic_malloc_fails(void)
+{
+	if (__symbiotic_malloc_failures >= __symbiotic_malloc_fail_budget)
+		return 0;
+	if (!__symbiotic_nondet__Bool())
+		return 0;
+
+	++__symbiotic_malloc_failures;
+	return 1;
+}
@@ -0,0 +1,14 @@
+#include "symbiotic-size_t.h"
+
+extern void *calloc(size_t, size_t);
+extern _Bool __symbiotic_malloc_fails(void);
+
+/* the same as __VERIFIER_calloc (the zeroed memory of calloc
+ * needs no lazy initialization) */
+void *__VERIFIER_calloc_lazy(size_t nmem, size_t size)
+{
+	if (__symbiotic_malloc_fails())
+		return ((void *) 0);
+
+	return calloc(nmem, size);
+}
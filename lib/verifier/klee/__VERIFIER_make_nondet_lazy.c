@@ -0,0 +1,55 @@
+#include "symbiotic-size_t.h"
+
+extern void klee_make_symbolic(void *, size_t, const char *);
+extern unsigned klee_is_symbolic(size_t);
+
+static void init_chunk(char *mem, size_t size, size_t chunk,
+                       char *flags, size_t idx, const char *name)
+{
+	if (flags[idx])
+		return;
+
+	flags[idx] = 1;
+
+	size_t start = idx * chunk;
+	size_t len = size - start < chunk ? size - start : chunk;
+	char nondet[len];
+	klee_make_symbolic(nondet, len, name);
+	for (size_t i = 0; i < len; ++i)
+		mem[start + i] = nondet[i];
+}
+
+/* Called by -initialize-uninitialized before every access of size 'width'
+ * via 'ptr' into the uninitialized array 'mem' of size 'size'. Make the
+ * accessed chunks symbolic if they were not accessed yet ('flags' has
+ * one byte for every chunk). */
+void __VERIFIER_make_nondet_lazy(void *mem, size_t size, size_t chunk,
+                                 char *flags, void *ptr, size_t width,
+                                 const char *name)
+{
+	/* leave the dereference of NULL to the program */
+	if (!mem)
+		return;
+
+	size_t off = (char *) ptr - (char *) mem;
+	size_t chunks = (size + chunk - 1) / chunk;
+
+	/* we do not want to fork on which chunks are accessed,
+	 * so initialize all of them */
+	if (klee_is_symbolic(off)) {
+		for (size_t idx = 0; idx < chunks; ++idx)
+			init_chunk(mem, size, chunk, flags, idx, name);
+		return;
+	}
+
+	/* out-of-bounds accesses are left for the verifier */
+	if (off >= size || width == 0)
+		return;
+
+	size_t last = off + width - 1;
+	if (last >= size)
+		last = size - 1;
+
+	for (size_t idx = off / chunk; idx <= last / chunk; ++idx)
+		init_chunk(mem, size, chunk, flags, idx, name);
+}
@@ -0,0 +1,9 @@
+#include "symbiotic-size_t.h"
+
+extern void *calloc(size_t, size_t);
+
+/* the flags for __VERIFIER_make_nondet_lazy, one byte for every chunk */
+char *__VERIFIER_make_nondet_lazy_flags(size_t size, size_t chunk)
+{
+	return calloc((size + chunk - 1) / chunk, 1);
+}
@@ -1,14 +1,14 @@
 #include "symbiotic-size_t.h"
 
 extern void *malloc(size_t);
-extern _Bool __symbiotic_nondet__Bool(void);
+extern _Bool __symbiotic_malloc_fails(void);
 extern void klee_make_symbolic(void *, size_t, const char *);
 
 /* add our own versions of malloc and calloc */
 /* non-deterministically return memory or NULL */
 void *__VERIFIER_malloc(size_t size)
 {
-	if (__symbiotic_nondet__Bool())
+	if (__symbiotic_malloc_fails())
 		return ((void *) 0);
 
 	void *mem = malloc(size);
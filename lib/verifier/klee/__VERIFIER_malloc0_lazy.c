@@ -0,0 +1,10 @@
+#include "symbiotic-size_t.h"
+
+extern void *malloc(size_t);
+
+/* like __VERIFIER_malloc0, but the memory is made symbolic lazily
+ * by __VERIFIER_make_nondet_lazy (see -instrument-alloc-lazy-size) */
+void *__VERIFIER_malloc0_lazy(size_t size)
+{
+	return malloc(size);
+}
@@ -0,0 +1,14 @@
+#include "symbiotic-size_t.h"
+
+extern void *malloc(size_t);
+extern _Bool __symbiotic_malloc_fails(void);
+
+/* like __VERIFIER_malloc, but the memory is made symbolic lazily
+ * by __VERIFIER_make_nondet_lazy (see -instrument-alloc-lazy-size) */
+void *__VERIFIER_malloc_lazy(size_t size)
+{
+	if (__symbiotic_malloc_fails())
+		return ((void *) 0);
+
+	return malloc(size);
+}
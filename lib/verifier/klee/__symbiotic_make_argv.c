@@ -0,0 +1,35 @@
+#include "symbiotic-size_t.h"
+
+extern void klee_make_symbolic(void *, size_t, const char *);
+extern void klee_assume(int);
+
+/* The arguments of main for --symbolic-argv (see -symbolic-argv).
+ * All the arguments are one symbolic object 'buf': the first byte
+ * is the number of the arguments after argv[0] (at most 'count'),
+ * then there are 'count' slots of 'length' characters and
+ * the terminating zero. The name of the object carries the count
+ * and the length, so that the tests can be decoded back.
+ * Return argc, argv (of 'count' + 2 pointers) is filled here. */
+
+int __symbiotic_make_argv(char *buf, int count, int length,
+                          char **argv, const char *name)
+{
+	static char program[] = "program";
+	size_t slot = (size_t)length + 1;
+
+	klee_make_symbolic(buf, 1 + count * slot, name);
+	unsigned char n = buf[0];
+	klee_assume(n <= count);
+
+	argv[0] = program;
+	int i = 0;
+	/* (fork once for every possible number of the arguments,
+	 * the pointers in argv are concrete then) */
+	for (; i < count && i < n; ++i) {
+		char *arg = buf + 1 + i * slot;
+		arg[length] = '\0';
+		argv[i + 1] = arg;
+	}
+	argv[i + 1] = 0;
+	return i + 1;
+}
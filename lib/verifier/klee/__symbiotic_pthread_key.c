@@ -0,0 +1,19 @@
+#include <pthread.h>
+
+// the number of keys for the thread-local storage,
+// KLEE runs only the main thread, so the values are global
+#define SYMBIOTIC_PTHREAD_KEYS 64
+
+struct __symbiotic_pthread_key {
+    int used;
+    const void *value;
+};
+
+// the entry of the key in the table of keys (all in one object),
+// NULL if the key is out of the table
+struct __symbiotic_pthread_key *__symbiotic_pthread_key(pthread_key_t key) {
+    static struct __symbiotic_pthread_key keys[SYMBIOTIC_PTHREAD_KEYS];
+    if (key >= SYMBIOTIC_PTHREAD_KEYS)
+        return 0;
+    return &keys[key];
+}
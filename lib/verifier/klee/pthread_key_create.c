@@ -1,6 +1,24 @@
 #include <pthread.h>
+#include <errno.h>
 
+struct __symbiotic_pthread_key {
+    int used;
+    const void *value;
+};
+
+struct __symbiotic_pthread_key *__symbiotic_pthread_key(pthread_key_t key);
+
+// the destructors are called only when a thread exits
+// and KLEE runs only the main thread
 int pthread_key_create(pthread_key_t *key, void (*destructor)(void*)) {
-    *key = 0;
-    return 0;
+    struct __symbiotic_pthread_key *entry;
+    for (pthread_key_t k = 0; (entry = __symbiotic_pthread_key(k)); ++k) {
+        if (!entry->used) {
+            entry->used = 1;
+            entry->value = 0;
+            *key = k;
+            return 0;
+        }
+    }
+    return EAGAIN;
 }
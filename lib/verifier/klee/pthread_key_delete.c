@@ -0,0 +1,17 @@
+#include <pthread.h>
+#include <errno.h>
+
+struct __symbiotic_pthread_key {
+    int used;
+    const void *value;
+};
+
+struct __symbiotic_pthread_key *__symbiotic_pthread_key(pthread_key_t key);
+
+int pthread_key_delete(pthread_key_t key) {
+    struct __symbiotic_pthread_key *entry = __symbiotic_pthread_key(key);
+    if (!entry || !entry->used)
+        return EINVAL;
+    entry->used = 0;
+    return 0;
+}
@@ -1,7 +1,64 @@
 #!/usr/bin/env python3
 from subprocess import Popen, PIPE, STDOUT
-from time import sleep
 from sys import stderr
+from heapq import heappush, heappop, heapify
+from itertools import count
+from glob import glob
+from hashlib import sha256
+from struct import unpack, error as StructError
+from shutil import copyfile
+import selectors
+import re
+import os
+
+# KLEE never gets more memory than this (in MB)
+MAX_JOB_MEMORY = 8000
+# do not run a job if it would get less memory than this (in MB)
+MIN_JOB_MEMORY = 1000
+# keep at most this number of seeds for one program
+MAX_SEEDS = 1000
+
+def get_available_memory():
+    """ Return the available memory in MB (or None if unknown) """
+    try:
+        with open('/proc/meminfo') as f:
+            for line in f:
+                if line.startswith('MemAvailable:'):
+                    return int(line.split()[1]) // 1024
+    except (IOError, OSError, ValueError):
+        pass
+
+    try:
+        return os.sysconf('SC_PAGE_SIZE') *\
+               os.sysconf('SC_AVPHYS_PAGES') // (1024 * 1024)
+    except (ValueError, OSError):
+        return None
+
+def get_workers_num():
+    """
+    Return the number of jobs that we can run at once and the memory
+    limit for each of them. The number of jobs is bounded by the number
+    of cores and the available memory, it can be overridden by
+    the environment variable KLEETESTER_JOBS.
+    """
+    cores = len(os.sched_getaffinity(0)) if hasattr(os, 'sched_getaffinity')\
+            else (os.cpu_count() or 1)
+    mem = get_available_memory()
+
+    jobs = cores
+    if mem is not None:
+        jobs = min(jobs, max(1, mem // MIN_JOB_MEMORY))
+
+    env = os.environ.get('KLEETESTER_JOBS')
+    if env:
+        try:
+            jobs = max(1, int(env))
+        except ValueError:
+            print(f"Invalid KLEETESTER_JOBS: {env}", file=stderr)
+
+    if mem is None:
+        return jobs, MAX_JOB_MEMORY
+    return jobs, max(MIN_JOB_MEMORY, min(MAX_JOB_MEMORY, mem // jobs))
 
 def runcmd(cmd):
     print("[kleetester] {0}".format(" ".join(cmd)), file=stderr)
@@ -15,12 +72,269 @@ def runcmd(cmd):
 
     return p
 
-def gentest(bitcode, outdir, prp, suffix=None, params=None):
+class Job:
+    """
+    A command with a callback that is called with the return code
+    and the output once the command finishes
+    """
+    def __init__(self, cmd, on_finish, on_output=None):
+        self.cmd = cmd
+        self.on_finish = on_finish
+        # called with each chunk of the output (while running)
+        self.on_output = on_output
+        self.output = bytearray()
+        self.proc = None
+        self.priority = None
+        # killed by Scheduler.cancel(), on_finish is not called
+        self.cancelled = False
+
+class Scheduler:
+    """
+    Runs jobs with at most 'workers' of them running at once. The jobs
+    are started in the order of their priority (lower is sooner). Finished
+    processes are detected when their output is closed, so we do not need
+    to poll them, and reading the output continuously also prevents the
+    processes from being blocked on a full pipe.
+    """
+    def __init__(self, workers):
+        self._workers = workers
+        self._queue = []
+        self._seq = count()
+        self._running = []
+        self._selector = selectors.DefaultSelector()
+        self._stopped = False
+
+    def add(self, job, priority):
+        if not self._stopped:
+            job.priority = priority
+            heappush(self._queue, (priority, next(self._seq), job))
+
+    def running(self):
+        return len(self._running)
+
+    def queued(self):
+        return len(self._queue)
+
+    def drop(self, pred):
+        """ Remove the queued jobs whose priority satisfies pred """
+        self._queue = [item for item in self._queue if not pred(item[0])]
+        heapify(self._queue)
+
+    def cancel(self, pred):
+        """
+        Remove the queued jobs whose priority satisfies pred
+        and kill the running ones
+        """
+        self.drop(pred)
+        for job in self._running:
+            if pred(job.priority):
+                job.cancelled = True
+                try:
+                    job.proc.kill()
+                except OSError:
+                    pass
+
+    def stop(self):
+        """ Kill all running jobs and drop the queued ones """
+        self._stopped = True
+        self._queue = []
+        for job in self._running:
+            try:
+                job.proc.kill()
+            except OSError:
+                pass
+
+    def _start(self, job):
+        job.proc = runcmd(job.cmd)
+        if job.proc is None:
+            job.on_finish(None, b'')
+            return
+
+        self._running.append(job)
+        self._selector.register(job.proc.stdout, selectors.EVENT_READ, job)
+
+    def _finished(self, job):
+        self._selector.unregister(job.proc.stdout)
+        job.proc.stdout.close()
+        self._running.remove(job)
+        ret = job.proc.wait()
+        if not self._stopped and not job.cancelled:
+            job.on_finish(ret, bytes(job.output))
+
+    def run(self):
+        while True:
+            while self._queue and len(self._running) < self._workers:
+                self._start(heappop(self._queue)[2])
+
+            if not self._running:
+                if self._queue:
+                    continue
+                break
+
+            for key, _ in self._selector.select():
+                job = key.data
+                data = os.read(key.fd, 65536)
+                if not data:
+                    self._finished(job)
+                    continue
+
+                old = len(job.output)
+                job.output.extend(data)
+                if job.on_output and not self._stopped:
+                    job.on_output(job, old)
+
+def ktest_digest(path):
+    """
+    Return the hash of the objects (names and contents) in the .ktest file
+    or None if the file cannot be parsed (e.g., KLEE did not finish it yet)
+    """
+    h = sha256()
+    try:
+        with open(path, 'rb') as f:
+            if f.read(5) not in (b'KTEST', b'BOUT\n'):
+                return None
+            version, = unpack('>i', f.read(4))
+            # skip args
+            num, = unpack('>i', f.read(4))
+            for i in range(num):
+                size, = unpack('>i', f.read(4))
+                f.seek(size, os.SEEK_CUR)
+            if version >= 2:
+                f.seek(8, os.SEEK_CUR)
+
+            num, = unpack('>i', f.read(4))
+            for i in range(num):
+                for part in range(2):
+                    size, = unpack('>i', f.read(4))
+                    data = f.read(size)
+                    if len(data) != size:
+                        return None
+                    h.update(size.to_bytes(4, 'big'))
+                    h.update(data)
+    except (IOError, OSError, StructError):
+        return None
+
+    return h.hexdigest()
+
+class Deduplicator:
+    """
+    Remove the tests that have the same inputs as some previous test.
+    The parallel KLEE processes (on different targets) generate the same
+    inputs often and every test in the suite makes the validation slower.
+    The tests of the main KLEE (without a suffix) are preferred, because
+    the tests of the others may be removed at the end.
+    """
+    def __init__(self, outdir):
+        self.outdir = outdir
+        # digest -> the kept test (its path without the extension)
+        self._seen = {}
+        self._checked = set()
+        self.removed = 0
+
+    def _remove(self, test):
+        for ext in ('.ktest', '.xml'):
+            try:
+                os.unlink(test + ext)
+            except OSError:
+                pass
+        self.removed += 1
+
+    def run(self):
+        for ktest in glob(f"{self.outdir}/test*.ktest"):
+            if ktest in self._checked:
+                continue
+            digest = ktest_digest(ktest)
+            if digest is None:
+                continue
+            self._checked.add(ktest)
+
+            test = ktest[:-len('.ktest')]
+            kept = self._seen.get(digest)
+            if kept is None:
+                self._seen[digest] = test
+            elif '.' in os.path.basename(kept) and\
+                 '.' not in os.path.basename(test):
+                # the kept test is from a side KLEE, keep the main one
+                self._remove(kept)
+                self._seen[digest] = test
+            else:
+                self._remove(test)
+
+# the names of the nondet values that -make-nondet and -delete-undefined
+# create (function:variable:line)
+NONDET_NAME = re.compile(rb'c"([^"\\]+:[^"\\]*:[0-9]+)\\00"')
+
+class SeedStore:
+    """
+    The tests from the previous runs on the same program that KLEE
+    uses as seeds. The program is identified by the names of its
+    nondeterministic values, so the tests are reused for the programs
+    that have the same nondet call sites (e.g., the same program with
+    different parameters or small changes elsewhere). The tests are
+    stored as <store>/<key>/<digest of the test>.ktest.
+    """
+    def __init__(self, store, bitcode):
+        self.dir = None
+        key = self._get_key(bitcode)
+        if key:
+            self.dir = os.path.join(store, key)
+
+    def _get_key(self, bitcode):
+        try:
+            p = Popen(['llvm-dis', '-o', '-', bitcode], stdout=PIPE)
+        except OSError as e:
+            print(f"[kleetester] Cannot get the nondet values: {e}", file=stderr)
+            return None
+
+        names = set()
+        for line in p.stdout:
+            names.update(NONDET_NAME.findall(line))
+        if p.wait() != 0 or not names:
+            return None
+
+        h = sha256()
+        for name in sorted(names):
+            h.update(name)
+            h.update(b'\0')
+        return h.hexdigest()
+
+    def seeds(self):
+        """ Return the directory with seeds or None if there are none """
+        if self.dir and glob(f"{self.dir}/*.ktest"):
+            return self.dir
+        return None
+
+    def save(self, outdir):
+        """ Store the tests from outdir """
+        if not self.dir:
+            return
+
+        os.makedirs(self.dir, exist_ok=True)
+        stored = len(glob(f"{self.dir}/*.ktest"))
+        for ktest in sorted(glob(f"{outdir}/test*.ktest")):
+            if stored >= MAX_SEEDS:
+                break
+            digest = ktest_digest(ktest)
+            if digest is None:
+                continue
+            path = os.path.join(self.dir, f"{digest}.ktest")
+            if os.path.exists(path):
+                continue
+            tmp = f"{path}.{os.getpid()}.tmp"
+            try:
+                copyfile(ktest, tmp)
+                os.replace(tmp, path)
+                stored += 1
+            except OSError as e:
+                print(f"[kleetester] Failed storing a seed: {e}", file=stderr)
+
+def gentest(bitcode, outdir, prp, suffix=None, params=None,
+            max_memory=MAX_JOB_MEMORY):
     options = ['-use-forked-solver=0', '--use-call-paths=0',
                '--output-stats=0', '-istats-write-interval=60s',
                '-timer-interval=10', '-external-calls=pure',
                '-write-testcases', '-malloc-symbolic-contents',
-               '-max-memory=8000', '-output-source=false']
+               f'-max-memory={max_memory}', '-output-source=false']
     if prp != 'coverage':
         options.append(f'-error-fn={prp}')
         options.append('-exit-on-error-type=Assert')
@@ -38,186 +352,281 @@ def gentest(bitcode, outdir, prp, suffix=None, params=None):
     cmd.extend(options)
     cmd.append(bitcode)
 
-    return runcmd(cmd)
+    return cmd
 
 def find_criterions(bitcode):
     newbitcode = f"{bitcode}.tpr.bc"
-    # FIXME: generate it directly from slicer (multiple slices)
     # FIXME: modify the code also such that any path that avoids the criterion
     # is aborted
+    # (the targets report when a path of KLEE reaches them)
     cmd = ['opt', '-load', 'LLVMsbt.so', '-get-test-targets',
-           '-o', newbitcode, bitcode]
-    p = runcmd(cmd)
-    if p is None:
-        return None, None
-    out, errs = p.communicate()
-    if p.poll() != 0:
-        print(errs)
-        print(out)
-        return None, None
-    if out and out != '':
-        return newbitcode, (crit.decode('utf-8', 'ignore') for crit in out.splitlines())
-    return None, None
-
-def constrain_to_target(bitcode, target):
-    newbitcode = f"{bitcode}.opt.bc"
+           '-get-test-targets-report', '-o', newbitcode, bitcode]
+    return cmd, newbitcode
+
+# the calls of this function are the test targets,
+# the argument is the ID of the target
+TARGET_FUNCTION = '__SYMBIOTIC_test_target'
+
+def get_criterions(out):
+    # the lines of the table of targets: __SYMBIOTIC_test_target ID [line]
+    crits = []
+    for line in out.splitlines():
+        parts = line.decode('utf-8', 'ignore').split()
+        if len(parts) >= 2 and parts[0] == TARGET_FUNCTION:
+            crits.append(int(parts[1]))
+    return crits
+
+# the number of targets constrained in one run of opt
+CONSTRAIN_BATCH = 16
+
+def constrain_to_targets(bitcode, targets):
+    # every target needs its own file, the targets are processed in parallel
+    # (-constraint-to-target removes the calls of the other targets).
+    # One run parses the module and computes the reachability of the targets
+    # once and writes the file of every target as <prefix><target>.bc
+    prefix = f"{bitcode}-ctt-"
     cmd = ['opt', '-load', 'LLVMsbt.so', '-constraint-to-target',
-           f'-ctt-target={target}', '-O3', '-o', newbitcode, bitcode]
-    p = runcmd(cmd)
-    if p is None:
-        return None
-    ret = p.wait()
-    if ret != 0:
-        out, errs = p.communicate()
-        print(out, file=stderr)
-        print(errs, file=stderr)
-        return None
-    return newbitcode
+           '-ctt-targets={0}'.format(','.join(map(str, targets))),
+           f'-ctt-output-prefix={prefix}', '-o', '/dev/null', bitcode]
+    return cmd, {target: f"{prefix}{target}.bc" for target in targets}
 
 def sliceprocess(bitcode, crit):
-    bitcode = constrain_to_target(bitcode, crit)
-    if bitcode is None:
-        return None, None
-        
+    # FIXME: generate all the slices in one run of the slicer, so that
+    # the pointer analysis and the dependence graph are computed only once.
+    # That needs a batch mode in llvm-slicer (the dg and sbt-slicer
+    # submodules): one -c per output file. Also, every target is first
+    # constrained by -constraint-to-target, so the slicer gets a different
+    # module for every target and could share the analyses only if they
+    # were computed before constraining.
     slbitcode = f"{bitcode}-{crit}.bc"
-    cmd = ['timeout', '120', 'llvm-slicer', '-c', crit,
+    cmd = ['timeout', '120', 'llvm-slicer', '-c', TARGET_FUNCTION,
            '-o', slbitcode, bitcode]
-    return runcmd(cmd), slbitcode
+    return cmd, slbitcode
 
 def optimize(bitcode):
     newbitcode = f"{bitcode}.opt.bc"
     cmd = ['opt', '-load', 'LLVMsbt.so', '-O3', '-remove-infinite-loops',
            '-O2', '-o', newbitcode, bitcode]
-    p = runcmd(cmd)
-    ret = p.wait()
-    return newbitcode
+    return cmd, newbitcode
+
+ERROR_MARK = b'ASSERTION FAIL: '
+# printed by KLEE when a path reaches a target (-get-test-targets-report)
+TARGET_REACHED = re.compile(rb'__SYMBIOTIC_test_target:\s*(?:\(w32 )?([0-9]+)\)?\r?\n')
+
+def reached_targets(output, start=0):
+    # the line may be split between two chunks of the output,
+    # search again from the start of the last (unfinished) line
+    start = output.rfind(b'\n', 0, start) + 1
+    return [int(m.group(1)) for m in TARGET_REACHED.finditer(output, start)]
 
-def check_error(outs, errs):
-    for line in outs.splitlines():
-        if b'ASSERTION FAIL: ' in line:
+class KleeTester:
+    """
+    Runs the main KLEE and for every test target the chain
+    constrain -> slice -> optimize -> KLEE. A target that got further
+    in the chain has a higher priority, so that we get its tests sooner,
+    and from the targets at the same stage the deeper ones go first.
+    """
+    # stages of the processing of a target
+    CONSTRAIN, SLICE, OPTIMIZE, KLEE = range(4)
+
+    def __init__(self, prp, outdir, bitcode, seeds=None):
+        self.prp = prp
+        self.outdir = outdir
+        self.bitcode = bitcode
+        # the directory with seeds for the main KLEE
+        self.seeds = seeds
+        self.found_error = False
+        self.dedup = Deduplicator(outdir) if prp == 'coverage' else None
+        # the targets reached by the main KLEE and the numbers of the targets
+        self.covered = set()
+        self._target_num = {}
+
+        workers, self.max_memory = get_workers_num()
+        print(f"[kleetester] Running at most {workers} jobs "
+              f"with {self.max_memory} MB each", file=stderr)
+        self.scheduler = Scheduler(workers)
+
+    def _prio(self, stage, n):
+        return (1, -stage, n)
+
+    def _on_klee_output(self, job, start):
+        if self.prp != 'coverage' and check_error(job.output, start):
             print('Found ERROR!', file=stderr)
-            return True
-    return False
+            self.found_error = True
+            self.scheduler.stop()
 
-def main(argv):
-    if len(argv) != 4:
-        exit(1)
-    prp = argv[1]
-    outdir = argv[2]
-    bitcode = argv[3]
+    def _on_main_output(self, job, start):
+        self._on_klee_output(job, start)
+        for crit in reached_targets(job.output, start):
+            self._covered(crit)
 
-    generators = []
+    def _covered(self, crit):
+        """
+        The main KLEE reached the target, its path gets a test, cancel
+        the jobs for the target (the constraining of a batch of targets
+        is not cancelled, the covered targets are skipped after it)
+        """
+        if crit in self.covered:
+            return
+        self.covered.add(crit)
+        n = self._target_num.get(crit)
+        if n is None:
+            return
+        print(f'{crit} covered by the main KLEE, cancelling its jobs',
+              file=stderr)
+        self.scheduler.cancel(lambda prio: len(prio) == 3 and prio[0] == 1 and
+                                           prio[1] != -KleeTester.CONSTRAIN and
+                                           prio[2] == n)
 
-    # run KLEE on the original bitcode
-    print("\n--- Running the main KLEE --- ", file=stderr)
-    maingen = gentest(bitcode, outdir, prp)
-    if maingen:
-        generators.append(maingen)
+    def _klee(self, bitcode, prio, on_finish, suffix=None, params=None,
+              on_output=None):
+        cmd = gentest(bitcode, self.outdir, self.prp, suffix=suffix,
+                      params=params, max_memory=self.max_memory)
+        self.scheduler.add(Job(cmd, on_finish,
+                               on_output or self._on_klee_output), prio)
 
-    bitcodewithcrits, crits = find_criterions(bitcode)
-    if bitcodewithcrits:
-        # The later crits are likely deeper in the code.
-        # Since run use only part of them, use those.
-        crits = list(crits)
-        crits.reverse()
-        for n, crit in enumerate(crits):
-            print(f"\n--- Targeting at {crit} target --- ", file=stderr)
-            if prp == 'coverage' and maingen and maingen.poll() is not None:
-                break # the main process finished, we can finish too
+    def _main_finished(self, ret, out):
+        print("\n--- The main KLEE finished --- ", file=stderr)
+        if self.prp == 'coverage':
+            # the main process finished, we can finish too
+            self.scheduler.stop()
 
-            # slice bitcode
-            p, slicedcode = sliceprocess(bitcodewithcrits, crit)
-            if p is None:
-                print(f'Slicing w.r.t {crit} FAILED', file=stderr)
-                continue
-            print(f'Starget slicing w.r.t {crit}, waiting for the job...', file=stderr)
-            ret = p.wait()
+    def _target_failed(self, crit, what, ret, out):
+        print(f'{what} w.r.t {crit} FAILED', file=stderr)
+        if out:
+            print(out.decode('utf-8', 'ignore'), file=stderr)
+
+    def _add_target(self, n, crit, newbitcode):
+        def klee_finished(ret, out):
+            print(f'Test generation for {crit} finished', file=stderr)
+            if self.dedup:
+                self.dedup.run()
+
+        def optimized(ret, out, slicedcode):
             if ret != 0:
-                out, errs = p.communicate()
-                print(f'Slicing w.r.t {crit} FAILED', file=stderr)
+                self._target_failed(crit, 'Optimizing', ret, out)
+                return
+            self._klee(slicedcode, self._prio(KleeTester.KLEE, n),
+                       klee_finished, suffix=str(n),
+                       params=['--search=dfs', '--use-batching-search'])
+
+        def sliced(ret, out, slicedcode):
+            if ret != 0:
+                self._target_failed(crit, 'Slicing', ret, out)
                 if ret == 124:
-                    break # one timeouted, others will too...
-                print(out, file=stderr)
-                print(errs, file=stderr)
-                continue
+                    # one timeouted, others will too...
+                    self._drop_targets()
+                return
             print(f'Slicing w.r.t {crit} done', file=stderr)
+            cmd, optcode = optimize(slicedcode)
+            self.scheduler.add(Job(cmd, lambda r, o: optimized(r, o, optcode)),
+                               self._prio(KleeTester.OPTIMIZE, n))
 
-            slicedcode = optimize(slicedcode)
-            if slicedcode is None:
-                print("Optimizing failed", file=stderr)
-                continue
+        cmd, slicedcode = sliceprocess(newbitcode, crit)
+        self.scheduler.add(Job(cmd, lambda r, o: sliced(r, o, slicedcode)),
+                           self._prio(KleeTester.SLICE, n))
 
-            # generate tests
-            if prp == 'coverage' and maingen and maingen.poll() is not None:
-                break # the main process finished, we can finish too
-            p = gentest(slicedcode, outdir, prp, suffix=str(n),
-                        params=['--search=dfs', '--use-batching-search'])
-            if p is None:
-                continue
-            generators.append(p)
-
-            newgens = []
-            for p in generators:
-                if p.poll() is not None:
-                    if prp != 'coverage':
-                        if check_error(*p.communicate()):
-                            for gen in generators:
-                                if gen.poll() is not None:
-                                    gen.kill()
-                            exit(0)
-                else:
-                    newgens.append(p)
-            generators = newgens
-
-            # run atmost 8 at once
-            while len(generators) >= 8:
-                if prp == 'coverage' and maingen and maingen.poll() is not None:
-                    break # the main process finished, we can finish too
-
-                print("Got enough test generators, waiting for some to finish...",
-                      file=stderr)
-                sleep(2) # sleep 2 seconds
-                for p in generators:
-                    if p.poll() is not None:
-                        if prp != 'coverage':
-                            if check_error(*p.communicate()):
-                                for gen in generators:
-                                    if gen.poll() is not None:
-                                        gen.kill()
-                                exit(0)
-                    else:
-                        newgens.append(p)
-                # some processes finished
-                generators = newgens
-
-    print(f"\n--- All targets running --- ", file=stderr)
-    stderr.flush()
+    def _add_targets(self, bitcode, first, crits):
+        def constrained(ret, out, newbitcodes):
+            if ret != 0:
+                self._target_failed(crits, 'Constraining', ret, out)
+                return
+            for n, crit in enumerate(crits, first):
+                if crit not in self.covered:
+                    self._add_target(n, crit, newbitcodes[crit])
+
+        crits = [crit for crit in crits if crit not in self.covered]
+        if not crits:
+            return
+        for n, crit in enumerate(crits, first):
+            self._target_num[crit] = n
+            print(f"\n--- Targeting at {crit} target --- ", file=stderr)
+        cmd, newbitcodes = constrain_to_targets(bitcode, crits)
+        self.scheduler.add(Job(cmd, lambda r, o: constrained(r, o, newbitcodes)),
+                           self._prio(KleeTester.CONSTRAIN, first))
+
+    def _drop_targets(self):
+        # keep only the jobs that are already running
+        # and the KLEE processes that wait for a worker
+        self.scheduler.drop(lambda prio: prio[0] == 1 and
+                                         prio[1] != -KleeTester.KLEE)
+
+    def _criterions_found(self, ret, out, bitcodewithcrits):
+        if self.prp == 'coverage':
+            # the main KLEE reports the targets that it reaches,
+            # the jobs for them are then cancelled
+            self._main_klee(bitcodewithcrits if ret == 0 else self.bitcode,
+                            self._on_main_output if ret == 0 else None)
+        if ret != 0:
+            print(out.decode('utf-8', 'ignore'), file=stderr)
+            return
+        # The later crits are likely deeper in the code.
+        # Since run use only part of them, use those.
+        crits = get_criterions(out)
+        crits.reverse()
+        for first in range(0, len(crits), CONSTRAIN_BATCH):
+            self._add_targets(bitcodewithcrits, first,
+                              crits[first:first + CONSTRAIN_BATCH])
+
+    def _main_klee(self, bitcode, on_output=None):
+        # run KLEE on the whole bitcode
+        print("\n--- Running the main KLEE --- ", file=stderr)
+        params = None
+        if self.seeds:
+            print(f"[kleetester] Using seeds from {self.seeds}", file=stderr)
+            # the seeds are matched to the nondet values by their names,
+            # they may come from a (slightly) different program
+            params = [f'-seed-dir={self.seeds}', '-named-seed-matching',
+                      '-allow-seed-extension', '-allow-seed-truncation']
+        self._klee(bitcode, (0,), self._main_finished, params=params,
+                   on_output=on_output)
+
+    def run(self):
+        # for coverage, the main KLEE runs on the bitcode with the targets
+        # once they are found
+        if self.prp != 'coverage':
+            self._main_klee(self.bitcode)
 
-    while generators:
-        print(f"Have {len(generators)} test generators running", file=stderr)
+        cmd, bitcodewithcrits = find_criterions(self.bitcode)
+        self.scheduler.add(Job(cmd,
+                               lambda r, o: self._criterions_found(r, o, bitcodewithcrits)),
+                           (0,))
+
+        self.scheduler.run()
+        print(f"\n--- All KLEE finished --- ", file=stderr)
+        if self.dedup:
+            self.dedup.run()
+            print(f"[kleetester] Removed {self.dedup.removed} duplicate tests",
+                  file=stderr)
         stderr.flush()
-        newgens = []
-        for p in generators:
-            if p.poll() is not None:
-                if prp != 'coverage':
-                    if check_error(*p.communicate()):
-                        for gen in generators:
-                            if gen.poll() is not None:
-                                gen.kill()
-                        exit(0)
-            else:
-                newgens.append(p)
-        generators = newgens
-        if generators:
-            sleep(2) # sleep 2 seconds
 
-    print(f"\n--- All KLEE finished --- ", file=stderr)
+def main(argv):
+    # kleetester.py [--seed-store=DIR] prp outdir bitcode
+    store = None
+    if len(argv) > 1 and argv[1].startswith('--seed-store='):
+        store = argv[1][len('--seed-store='):]
+        argv = argv[:1] + argv[2:]
+    if len(argv) != 4:
+        exit(1)
+    prp = argv[1]
+    outdir = argv[2]
+    bitcode = argv[3]
+
+    seeds = SeedStore(store, bitcode) if store else None
+    tester = KleeTester(prp, outdir, bitcode,
+                        seeds.seeds() if seeds else None)
+    tester.run()
+    if seeds:
+        seeds.save(outdir)
+    if tester.found_error:
+        exit(0)
 
     if prp == 'coverage':
         # if all finished, then also the main KLEE finished,
         # and we can remove the files from side KLEE's -- those
         # are superfluous
-        runcmd(['rm', '-f', f"{outdir}/test*.*.xml"])
+        for f in glob(f"{outdir}/test*.*.xml"):
+            os.unlink(f)
 
 if __name__ == "__main__":
     from sys import argv
@@ -50,6 +50,73 @@ for LLVM in $PREFIX/llvm-*; do
 	done
 done
 
+# link the precompiled models into one archive per tool, pointer width and
+# order of the model directories (options.linkundef), so that symbiotic
+# can lazily link in only the needed functions from a single file
+ORDERS="verifier,libc,posix,kernel verifier,libc,posix,kernel,svcomp"
+# with --string-models=select and --symbolic-input-buffers
+ORDERS="$ORDERS verifier,strings,libc,posix,kernel verifier,strings,libc,posix,kernel,svcomp"
+ORDERS="$ORDERS input,verifier,libc,posix,kernel input,verifier,libc,posix,kernel,svcomp"
+# with --numeric-models=summary
+ORDERS="$ORDERS verifier,numbers,libc,posix,kernel verifier,numbers,libc,posix,kernel,svcomp"
+# slowbeast links only its models of the library functions
+ORDERS="$ORDERS libc"
+for LLVM in $PREFIX/llvm-*; do
+	LINK=$LLVM/bin/llvm-link
+	if [ ! -x "$LINK" ]; then
+		LINK=llvm-link
+	fi
+	for LIBDIR in "$LLVM/lib" "$LLVM/lib32"; do
+		TOOLS=`cd $LIBDIR && find input verifier strings numbers libc posix kernel svcomp -mindepth 1 -maxdepth 1 -type d 2>/dev/null | xargs -r -n1 basename | sort -u`
+		for TOOL in $TOOLS; do
+			for ORDER in $ORDERS; do
+				MODELS=
+				SEEN=" "
+				for TY in ${ORDER//,/ }; do
+					# the same precedence as in symbiotic: the model
+					# specific for the tool goes before the generic one
+					for F in $LIBDIR/$TY/$TOOL/*.bc $LIBDIR/$TY/*.bc; do
+						[ -f "$F" ] || continue
+						NAME=`basename $F`
+						case "$SEEN" in
+							*" $NAME "*) continue;;
+						esac
+						SEEN="$SEEN$NAME "
+						MODELS="$MODELS $F"
+					done
+				done
+
+				ARCHIVE="$LIBDIR/models-$TOOL-${ORDER//,/+}.bc"
+				if [ -n "$MODELS" ] && $LINK -o "$ARCHIVE" $MODELS; then
+					FILES="$FILES ${ARCHIVE#install/}"
+				else
+					echo "Failed creating $ARCHIVE, symbiotic will link the models one by one"
+					rm -f "$ARCHIVE"
+				fi
+			done
+		done
+	done
+done
+
+# create the index of symbols of the precompiled files, so that symbiotic
+# can find all the models needed by undefined functions at once
+for LLVM in $PREFIX/llvm-*; do
+	NM=$LLVM/bin/llvm-nm
+	if [ ! -x "$NM" ]; then
+		NM=llvm-nm
+	fi
+	for LIBDIR in "$LLVM/lib" "$LLVM/lib32"; do
+		IDX="$LIBDIR/symbols.idx"
+		: > "$IDX"
+		for F in `cd $LIBDIR && find . -name '*.bc'`; do
+			DEFINED=`$NM --defined-only -j "$LIBDIR/$F" | tr '\n' ' '`
+			UNDEFINED=`$NM --undefined-only -j "$LIBDIR/$F" | tr '\n' ' '`
+			printf '%s\t%s\t%s\n' "${F#./}" "$DEFINED" "$UNDEFINED" >> "$IDX"
+		done
+		FILES="$FILES ${IDX#install/}"
+	done
+done
+
 
 
 echo "To add precompiled files to distribution, run this command from install/ folder:"
@@ -169,6 +169,7 @@ git add \
 	$DEPENDENCIES \
 	$INSTR\
 	bin/symbiotic \
+	bin/symbiotic-server \
 	bin/kleetester.py \
 	bin/gen-c \
 	include/symbiotic.h \
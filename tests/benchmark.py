@@ -0,0 +1,264 @@
+#!/usr/bin/env python3
+
+"""
+Run symbiotic-cc on the tests and record the wall time and peak memory
+of the whole run together with the time, the size of the module before
+and after and the change of the peak memory of every stage and pass
+that sbt-pipeline ran (see --pass-report). The results are stored into
+a JSON file that can be given to the next run as a baseline, so that
+we can spot the passes that became slower. The startup of the driver
+(importing it and resolving the target) is measured too and it must fit
+into the budget (--startup-budget).
+"""
+
+from glob import glob
+from subprocess import Popen, PIPE, DEVNULL
+from tempfile import TemporaryDirectory
+from os import path
+
+import argparse
+import json
+import os
+import sys
+import time
+
+RED = '\u001b[31m'
+GREEN = '\u001b[32m'
+RESET = '\u001b[0m'
+
+VERSION = 1
+
+
+def print(*args, color='', end='\n'):
+    import builtins
+
+    if not sys.stdout.isatty():
+        builtins.print(*args, end=end)
+    else:
+        builtins.print(color, end='')
+        builtins.print(*args, end='')
+        builtins.print(RESET, end=end)
+
+    sys.stdout.flush()
+
+
+# import the driver as scripts/symbiotic does and resolve the target
+STARTUP = """
+import sys, time
+start = time.perf_counter()
+sys.path.append(sys.argv[1])
+from symbiotic.options import SymbioticOptions
+from symbiotic.runtime import SetupSymbiotic
+from symbiotic.verifier import initialize_verifier
+opts = SymbioticOptions()
+opts.tool_name = sys.argv[2]
+initialize_verifier(opts)
+print(time.perf_counter() - start)
+"""
+
+
+def measure_startup(args):
+    """ The shortest startup time of the driver from a few runs """
+    here = path.dirname(path.abspath(__file__))
+    pkg = path.join(here, '..', 'lib', 'symbioticpy')
+    best = None
+    for _ in range(args.startup_runs):
+        proc = Popen([sys.executable, '-c', STARTUP, pkg, args.target],
+                     stdout=PIPE, stderr=DEVNULL)
+        out, _ = proc.communicate()
+        if proc.returncode != 0:
+            return None
+        tm = float(out.decode('utf-8').strip())
+        best = tm if best is None else min(best, tm)
+    return best
+
+
+def get_property(test):
+    name = path.basename(test)
+    if 'valid-memcleanup' in name:
+        return 'memcleanup'
+    if 'valid-' in name and 'unreach-call' not in name:
+        return 'memsafety'
+    return None
+
+
+def get_tests(args):
+    if args.tests:
+        return args.tests
+
+    here = path.dirname(path.abspath(__file__))
+    tests = []
+    for d in (here, path.join(here, 'long')):
+        for ext in ('*.c', '*.i'):
+            tests += glob(path.join(d, ext))
+    return sorted(tests)
+
+
+def summarize_stages(passes):
+    """
+    Sum up the records of passes into stages, the size of the module
+    is the number of instructions before the first and after the last pass
+    """
+    stages = {}
+    for rec in passes:
+        stage = stages.get(rec['stage'])
+        if stage is None:
+            stage = {'time': 0.0, 'size_before': rec['visited'],
+                     'rss_delta_kb': 0}
+            stages[rec['stage']] = stage
+        stage['time'] += rec['time']
+        stage['size_after'] = rec['visited'] + rec['added'] - rec['removed']
+        stage['rss_delta_kb'] += rec['rss_delta_kb']
+    return stages
+
+
+def run_test(test, args, tmpdir):
+    report = path.join(tmpdir, 'passes.json')
+    cmd = ['symbiotic', '--cc', '--no-integrity-check',
+           '--timeout=%d' % args.timeout,
+           '--pass-report=' + report,
+           '--output=' + path.join(tmpdir, 'out.bc')]
+
+    prp = get_property(test)
+    if prp:
+        cmd.append('--prp=' + prp)
+    if args.is32bit:
+        cmd.append('--32')
+
+    start = time.perf_counter()
+    proc = Popen(cmd + [test], stdout=DEVNULL, stderr=DEVNULL, cwd=tmpdir)
+    # wait4 gives the peak memory of the whole tree of processes
+    # (symbiotic waits for all of its children)
+    _, status, rusage = os.wait4(proc.pid, 0)
+    elapsed = time.perf_counter() - start
+    if os.WIFEXITED(status):
+        proc.returncode = os.WEXITSTATUS(status)
+    else:
+        proc.returncode = -os.WTERMSIG(status)
+
+    passes = []
+    try:
+        with open(report, 'r') as f:
+            passes = json.load(f)
+    except (IOError, OSError, ValueError):
+        # symbiotic failed or sbt-pipeline is not available
+        pass
+
+    return {'returncode': proc.returncode,
+            'time': elapsed,
+            'max_rss_kb': rusage.ru_maxrss,
+            'stages': summarize_stages(passes),
+            'passes': passes}
+
+
+def get_pass_times(passes):
+    times = {}
+    for rec in passes:
+        key = '%s %s' % (rec['stage'], rec['pass'])
+        times[key] = times.get(key, 0.0) + rec['time']
+    return times
+
+
+def compare(results, baseline, args):
+    """ Print the tests and stages that got slower, return their number """
+    slower = 0
+
+    def check(what, new, old):
+        nonlocal slower
+        if new > old * args.threshold and new - old > args.min_time:
+            print('%s: %.3f s -> %.3f s' % (what, old, new), color=RED)
+            slower += 1
+
+    for test, res in results.items():
+        old = baseline.get(test)
+        if old is None:
+            continue
+        check(test, res['time'], old['time'])
+        for stage, data in res['stages'].items():
+            if stage in old['stages']:
+                check('%s [%s]' % (test, stage), data['time'],
+                      old['stages'][stage]['time'])
+        old_passes = get_pass_times(old['passes'])
+        for key, t in get_pass_times(res['passes']).items():
+            if key in old_passes:
+                check('%s [%s]' % (test, key), t, old_passes[key])
+
+    return slower
+
+
+def main(args):
+    baseline = None
+    if args.baseline:
+        with open(args.baseline, 'r') as f:
+            baseline = json.load(f)
+        if baseline.get('version') != VERSION:
+            print('Unknown version of the baseline', color=RED)
+            sys.exit(1)
+
+    startup = measure_startup(args)
+    over_budget = startup is None or startup > args.startup_budget
+    if startup is None:
+        print('Startup of the driver FAILED', color=RED)
+    else:
+        print('Startup of the driver (%s): %.3f s (budget %.3f s)' %
+              (args.target, startup, args.startup_budget),
+              color=RED if over_budget else GREEN)
+
+    results = {}
+    for test in get_tests(args):
+        name = path.relpath(test, path.dirname(path.abspath(__file__)))
+        print(name, end=': ')
+        with TemporaryDirectory() as tmpdir:
+            res = run_test(path.abspath(test), args, tmpdir)
+        results[name] = res
+
+        status = 'OK' if res['returncode'] == 0 else\
+                 'FAILED (%d)' % res['returncode']
+        print('%s %.3f s, %d MB' % (status, res['time'],
+                                    res['max_rss_kb'] // 1024),
+              color=GREEN if res['returncode'] == 0 else RED)
+
+    os.makedirs(path.dirname(path.abspath(args.output)), exist_ok=True)
+    with open(args.output, 'w') as f:
+        json.dump({'version': VERSION,
+                   '32bit': args.is32bit,
+                   'startup': startup,
+                   'tests': results}, f, indent=1)
+    print('Results stored into', args.output)
+
+    if baseline and compare(results, baseline['tests'], args) > 0:
+        sys.exit(1)
+    if over_budget:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+
+    parser.add_argument('--32', action='store_true', dest='is32bit',
+                        default=False, help='use 32-bit environment')
+    parser.add_argument('-o', '--output', action='store',
+                        default='results/benchmark.json',
+                        help='where to store the results (JSON)')
+    parser.add_argument('-b', '--baseline', action='store', default=None,
+                        help='results of a previous run to compare with')
+    parser.add_argument('--threshold', action='store', type=float,
+                        default=1.2, help='report tests and stages that are '
+                        'slower than THRESHOLD times the baseline')
+    parser.add_argument('--min-time', action='store', type=float,
+                        default=0.05, help='ignore slowdowns shorter than '
+                        'MIN_TIME seconds')
+    parser.add_argument('-t', '--timeout', action='store', type=int,
+                        default=300, help='single test timeout')
+    parser.add_argument('--target', action='store', default='klee',
+                        help='the target whose startup is measured')
+    parser.add_argument('--startup-budget', action='store', type=float,
+                        default=0.5, help='fail if the startup of the driver '
+                        'takes more than STARTUP_BUDGET seconds')
+    parser.add_argument('--startup-runs', action='store', type=int,
+                        default=5, help='the number of runs to measure '
+                        'the startup (the shortest one counts)')
+    parser.add_argument('tests', nargs='*', type=str,
+                        help='tests to run (default: tests/ and tests/long/)')
+
+    main(parser.parse_args())
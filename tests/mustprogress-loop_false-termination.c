@@ -0,0 +1,11 @@
+extern unsigned __VERIFIER_nondet_uint(void);
+
+// the loop does not terminate for an odd n, it must not be removed
+// (or accelerated) as a loop that must make progress
+int main(void) {
+	unsigned n = __VERIFIER_nondet_uint();
+	unsigned i = 0;
+	while (i != n)
+		i += 2;
+	return 0;
+}
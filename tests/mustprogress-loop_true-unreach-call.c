@@ -0,0 +1,14 @@
+extern int __VERIFIER_nondet_int(void);
+extern void __VERIFIER_assert(int);
+
+// the loop terminates (the increment cannot overflow), so it is
+// accelerated also without the assumption that it must make progress
+// (KLEE would fork on every iteration otherwise)
+int main(void) {
+	int n = __VERIFIER_nondet_int();
+	int i = 0;
+	while (i < n)
+		++i;
+	__VERIFIER_assert(i == (n > 0 ? n : 0));
+	return 0;
+}
@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+
+"""
+Run the tests of the passes from tests/passes/. A test is an LLVM IR file
+with the commands to run in '; RUN:' lines and the expected output in
+'; CHECK...' lines (a small subset of FileCheck, which is not a part
+of the installation of symbiotic):
+
+  ; RUN: opt -load LLVMsbt.so -some-pass -S %s
+  ; CHECK: this line follows the previous match
+  ; CHECK-NOT: no such line before the next match
+  ; CHECK-COUNT-2: two matches, one after the other
+
+The commands run in the shell in a temporary directory, %s is the test
+file and %t is a prefix of files in the temporary directory. The outputs
+of all commands of a test are checked together, in the order of the
+RUN lines. A test fails if a command fails.
+"""
+
+from glob import glob
+from subprocess import run, PIPE, STDOUT
+from tempfile import TemporaryDirectory
+from os import path
+
+import argparse
+import re
+import sys
+
+GREEN = '\u001b[32m'
+RED = '\u001b[31m'
+RESET = '\u001b[0m'
+
+directive_re = re.compile(r'^;\s*(RUN|CHECK(?:-NOT|-COUNT-([0-9]+))?):(.*)$')
+
+
+def print(*args, color='', end='\n'):
+    import builtins
+
+    if not sys.stdout.isatty():
+        builtins.print(*args, end=end)
+    else:
+        builtins.print(color, end='')
+        builtins.print(*args, end='')
+        builtins.print(RESET, end=end)
+
+    sys.stdout.flush()
+
+
+def parse_test(test):
+    """ The commands and the checks (kind, count, pattern) of the test """
+    commands, checks = [], []
+    with open(test, 'r') as f:
+        for line in f:
+            match = directive_re.match(line.strip())
+            if not match:
+                continue
+            kind, count, arg = match[1], match[2], match[3].strip()
+            if kind == 'RUN':
+                commands.append(arg)
+            elif count:
+                checks.append(('CHECK', int(count), arg))
+            else:
+                checks.append((kind, 1, arg))
+    return commands, checks
+
+
+def check_output(lines, checks):
+    """ Return None if the output matches the checks, the problem otherwise """
+    def find(pattern, start, end):
+        for i in range(start, end):
+            if pattern in lines[i]:
+                return i
+        return None
+
+    def check_forbidden(forbidden, start, end):
+        for pattern in forbidden:
+            i = find(pattern, start, end)
+            if i is not None:
+                return "'{0}' found on line {1}".format(pattern, i + 1)
+        return None
+
+    pos = 0
+    forbidden = []
+    for kind, count, pattern in checks:
+        if kind == 'CHECK-NOT':
+            forbidden.append(pattern)
+            continue
+
+        for n in range(count):
+            i = find(pattern, pos, len(lines))
+            if i is None:
+                return "'{0}' not found (match {1} of {2})"\
+                       .format(pattern, n + 1, count)
+            problem = check_forbidden(forbidden, pos, i)
+            if problem:
+                return problem
+            pos = i + 1
+        forbidden = []
+
+    return check_forbidden(forbidden, pos, len(lines))
+
+
+def run_test(test):
+    """ Run the test, return None if it passed, the problem otherwise """
+    commands, checks = parse_test(test)
+    if not commands:
+        return 'no RUN line'
+
+    output = []
+    with TemporaryDirectory(prefix='symbiotic-pass-test-') as tmpdir:
+        for cmd in commands:
+            cmd = cmd.replace('%s', path.abspath(test))\
+                     .replace('%t', path.join(tmpdir, 'out'))
+            proc = run(cmd, shell=True, cwd=tmpdir, stdout=PIPE, stderr=STDOUT)
+            out = proc.stdout.decode('utf-8', 'replace')
+            output += out.splitlines()
+            if proc.returncode != 0:
+                return 'command failed ({0}): {1}\n{2}'\
+                       .format(proc.returncode, cmd, out)
+
+    problem = check_output(output, checks)
+    if problem:
+        return problem + '\noutput:\n' + '\n'.join(output)
+    return None
+
+
+def main(args):
+    tests = args.tests
+    if not tests:
+        here = path.dirname(path.abspath(__file__))
+        tests = sorted(glob(path.join(here, 'passes', '*.ll')))
+
+    failed = 0
+    for test in tests:
+        print(path.basename(test), end=': ')
+        problem = run_test(test)
+        if problem is None:
+            print('PASS', color=GREEN)
+            continue
+
+        failed += 1
+        print('FAIL', color=RED)
+        print('\t' + problem.replace('\n', '\n\t'))
+
+    print('{0} of {1} tests failed'.format(failed, len(tests)),
+          color=RED if failed else GREEN)
+    sys.exit(int(failed > 0))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('tests', nargs='*', type=str,
+                        help='the tests to run (default: all in passes/)')
+
+    main(parser.parse_args())
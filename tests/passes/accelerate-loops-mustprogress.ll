@@ -0,0 +1,59 @@
+; ScalarEvolution computes a count of the loop i += 2 until i == n
+; in a loop that must make progress, but the loop does not terminate
+; for an odd n, so it is not accelerated (and reach_error stays
+; unreachable). The loop i += 2 while i < n (nsw) is accelerated.
+;
+; RUN: opt -enable-new-pm=0 -load LLVMsbt.so -accelerate-loops -S %s -o -
+;
+; CHECK: Accelerated a loop in step_until_greater
+; CHECK-NOT: Accelerated a loop
+; CHECK: define i32 @step_until_equal
+; CHECK: br i1 %cmp, label %loop, label %exit
+; CHECK: call void @reach_error()
+; CHECK: define i32 @step_until_greater
+; CHECK-NOT: br i1 %cmp, label %loop, label %exit
+; CHECK: ret i32
+
+declare void @reach_error()
+
+define i32 @step_until_equal(i32 %n) mustprogress {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %i.next = add i32 %i, 2
+  %cmp = icmp ne i32 %i.next, %n
+  br i1 %cmp, label %loop, label %exit, !llvm.loop !0
+
+exit:
+  %i.lcssa = phi i32 [ %i.next, %loop ]
+  %odd = and i32 %n, 1
+  %c = icmp ne i32 %odd, 0
+  br i1 %c, label %error, label %end
+
+error:
+  call void @reach_error()
+  br label %end
+
+end:
+  ret i32 %i.lcssa
+}
+
+define i32 @step_until_greater(i32 %n) mustprogress {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %i.next = add nsw i32 %i, 2
+  %cmp = icmp slt i32 %i.next, %n
+  br i1 %cmp, label %loop, label %exit, !llvm.loop !0
+
+exit:
+  %i.lcssa = phi i32 [ %i.next, %loop ]
+  ret i32 %i.lcssa
+}
+
+!0 = distinct !{!0, !1}
+!1 = !{!"llvm.loop.mustprogress"}
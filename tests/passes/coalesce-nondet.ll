@@ -0,0 +1,39 @@
+; The three nondet calls before the call of @use get one buffer of 6 bytes
+; (the bool takes a byte), the call after it gets its own buffer. The names
+; of the buffers list the parts of the calls.
+;
+; RUN: opt -enable-new-pm=0 -load LLVMsbt.so -coalesce-nondet -S %s -o -
+;
+; CHECK: Coalesced 4 nondeterministic values into 2 symbolic buffers
+; CHECK: c"__nondet_buffer|main:__VERIFIER_nondet_int:0:0:4:s|main:__VERIFIER_nondet_bool:0:0:1:b|main:__VERIFIER_nondet_uchar:0:0:1:u\00__nondet_buffer|main:__VERIFIER_nondet_int:0:0:4:s\00"
+; CHECK: define i32 @main()
+; CHECK: alloca [4 x i8]
+; CHECK: alloca [6 x i8]
+; CHECK-NOT: call i32 @__VERIFIER_nondet_int()
+; CHECK: i64 6, i8* getelementptr inbounds ([175 x i8], [175 x i8]* @nondet.names, i64 0, i64 0)
+; CHECK: %a = load i32
+; CHECK: %b = icmp ne i8
+; CHECK: %c = load i8
+; CHECK: call void @use(i32 %a)
+; CHECK: i64 4, i8* getelementptr inbounds ([175 x i8], [175 x i8]* @nondet.names, i64 0, i64 124)
+; CHECK: %d = load i32
+; CHECK-NOT: @__VERIFIER_nondet_
+; CHECK: ret i32
+
+declare i32 @__VERIFIER_nondet_int()
+declare i1 @__VERIFIER_nondet_bool()
+declare i8 @__VERIFIER_nondet_uchar()
+declare void @use(i32)
+
+define i32 @main() {
+entry:
+  %a = call i32 @__VERIFIER_nondet_int()
+  %b = call i1 @__VERIFIER_nondet_bool()
+  %c = call i8 @__VERIFIER_nondet_uchar()
+  call void @use(i32 %a)
+  %d = call i32 @__VERIFIER_nondet_int()
+  %c32 = zext i8 %c to i32
+  %s = add i32 %c32, %d
+  %r = select i1 %b, i32 %s, i32 0
+  ret i32 %r
+}
@@ -0,0 +1,25 @@
+; The constructors run before main, so the prefix of main does not start
+; from the initializers of the globals. The pass does not change anything.
+;
+; RUN: opt -enable-new-pm=0 -load LLVMsbt.so -concrete-prefix -S %s -o -
+;
+; CHECK: Not running the concrete prefix of main, the module has llvm.global_ctors
+; CHECK: @g = global i32 0
+; CHECK-NOT: concrete.prefix
+; CHECK: store i32 1, i32* @g
+; CHECK: ret i32
+
+@g = global i32 0
+@llvm.global_ctors = appending global [1 x { i32, void ()*, i8* }] [{ i32, void ()*, i8* } { i32 65535, void ()* @init, i8* null }]
+
+define internal void @init() {
+  store i32 5, i32* @g
+  ret void
+}
+
+define i32 @main() {
+entry:
+  store i32 1, i32* @g
+  %r = load i32, i32* @g
+  ret i32 %r
+}
@@ -0,0 +1,32 @@
+; A pointer to a local of main must not get into the initializer of
+; a global, the prefix stops before the store of %x into @p. The contents
+; of %x and the store into @g before it are kept.
+;
+; RUN: opt -enable-new-pm=0 -load LLVMsbt.so -concrete-prefix -S %s -o -
+;
+; CHECK: Executed 3 instructions of main concretely (3 in total), initialized 1 globals and 1 locals
+; CHECK: @p = global i32* null
+; CHECK: @g = global i32 2
+; CHECK: concrete.prefix:
+; CHECK: store i32 1, i32* %x
+; CHECK-NOT: store i32 2, i32* @g
+; CHECK: concrete.resume:
+; CHECK: store i32* %x, i32** @p
+; CHECK: call i32 @__VERIFIER_nondet_int()
+
+@p = global i32* null
+@g = global i32 0
+
+declare i32 @__VERIFIER_nondet_int()
+
+define i32 @main() {
+entry:
+  %x = alloca i32
+  store i32 1, i32* %x
+  store i32 2, i32* @g
+  store i32* %x, i32** @p
+  %n = call i32 @__VERIFIER_nondet_int()
+  store i32 %n, i32* %x
+  %r = load i32, i32* %x
+  ret i32 %r
+}
@@ -0,0 +1,44 @@
+; The prefix stops in the fourth iteration of the loop at the input.
+; @sum gets the sum of the first four iterations and the loop continues
+; at the input with i = 3.
+;
+; RUN: opt -enable-new-pm=0 -load LLVMsbt.so -concrete-prefix -S %s -o -
+;
+; CHECK: Executed 30 instructions of main concretely (30 in total), initialized 1 globals and 0 locals
+; CHECK: @sum = global i32 6
+; CHECK: concrete.prefix:
+; CHECK: concrete.resume:
+; CHECK: phi i32 [ 3, %concrete.prefix ]
+; CHECK: call i32 @__VERIFIER_nondet_int()
+; CHECK: icmp slt i32 %i.next, 10
+
+@sum = global i32 0
+
+declare i32 @__VERIFIER_nondet_int()
+
+define i32 @main() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %s = load i32, i32* @sum
+  %s.next = add i32 %s, %i
+  store i32 %s.next, i32* @sum
+  %three = icmp eq i32 %i, 3
+  br i1 %three, label %input, label %latch
+
+input:
+  %x = call i32 @__VERIFIER_nondet_int()
+  store i32 %x, i32* @sum
+  br label %latch
+
+latch:
+  %i.next = add i32 %i, 1
+  %cmp = icmp slt i32 %i.next, 10
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  %r = load i32, i32* @sum
+  ret i32 %r
+}
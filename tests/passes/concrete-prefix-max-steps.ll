@@ -0,0 +1,38 @@
+; With no steps, nothing is executed and main stays the same. With one
+; step, only the branch into the loop is executed, the loop continues
+; in its first iteration and @sum keeps its initializer.
+;
+; RUN: opt -enable-new-pm=0 -load LLVMsbt.so -concrete-prefix -concrete-prefix-max-steps=0 -S %s -o -
+; RUN: opt -enable-new-pm=0 -load LLVMsbt.so -concrete-prefix -concrete-prefix-max-steps=1 -S %s -o -
+;
+; CHECK: Nothing to execute concretely in main
+; CHECK: @sum = global i32 0
+; CHECK-NOT: concrete.prefix
+; CHECK: entry:
+; CHECK: phi i32 [ 0, %entry ]
+; CHECK: Executed 1 instructions of main concretely (1 in total), initialized 0 globals and 0 locals
+; CHECK: @sum = global i32 0
+; CHECK: concrete.prefix:
+; CHECK: concrete.resume:
+; CHECK: phi i32 [ 0, %concrete.prefix ]
+; CHECK: load i32, i32* @sum
+
+@sum = global i32 0
+
+define i32 @main() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %s = load i32, i32* @sum
+  %s.next = add i32 %s, %i
+  store i32 %s.next, i32* @sum
+  %i.next = add i32 %i, 1
+  %cmp = icmp slt i32 %i.next, 10
+  br i1 %cmp, label %loop, label %exit
+
+exit:
+  %r = load i32, i32* @sum
+  ret i32 %r
+}
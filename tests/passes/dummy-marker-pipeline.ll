@@ -0,0 +1,28 @@
+; The markers of allocations inserted by -dummy-marker keep the allocations
+; alive during the optimizations that run in the same sbt-pipeline and
+; -strip-dummy-markers removes them at the end (memsafety runs the stages
+; after slicing like this).
+;
+; RUN: sbt-pipeline %s -o %t.bc -stage=after-slicing -dummy-marker -checkpoint=after-slicing -stage=optimize -O2 -checkpoint=optimize -stage=strip-markers -strip-dummy-markers
+; RUN: llvm-dis %t-after-slicing.bc -o -
+; RUN: llvm-dis %t-optimize.bc -o -
+; RUN: llvm-dis %t.bc -o -
+;
+; CHECK: ModuleID
+; CHECK-COUNT-2: call void @__symbiotic_keep_ptr
+; CHECK: ModuleID
+; CHECK-COUNT-2: call void @__symbiotic_keep_ptr
+; CHECK: ModuleID
+; CHECK-NOT: call void @__symbiotic_keep_ptr
+; CHECK: @malloc(i64 4)
+; CHECK: @malloc(i64 8)
+; CHECK-NOT: call void @__symbiotic_keep_ptr
+
+declare i8* @malloc(i64)
+
+define i32 @main() {
+entry:
+  %p = call i8* @malloc(i64 4)
+  %q = call i8* @malloc(i64 8)
+  ret i32 0
+}
@@ -0,0 +1,55 @@
+; ScalarEvolution computes a count of the loop i += 2 until i == n
+; in a loop that must make progress, but the loop does not terminate
+; for an odd n. Only the loop with i < n is skipped.
+;
+; RUN: opt -enable-new-pm=0 -load LLVMsbt.so -instrument-nontermination -S %s -o -
+;
+; CHECK: Skipped 1 loops that provably terminate
+; CHECK: define i32 @step_until_equal
+; CHECK: call void @__INSTR_check_nontermination
+; CHECK: define i32 @step_until_greater
+; CHECK-NOT: call void @__INSTR_check_nontermination
+; CHECK: ret i32
+
+@g = global i32 0
+
+define i32 @step_until_equal(i32 %n) mustprogress {
+entry:
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %next, %body ]
+  %cmp = icmp ne i32 %i, %n
+  br i1 %cmp, label %body, label %exit
+
+body:
+  %x = load i32, i32* @g
+  store i32 %x, i32* @g
+  %next = add i32 %i, 2
+  br label %header, !llvm.loop !0
+
+exit:
+  ret i32 %i
+}
+
+define i32 @step_until_greater(i32 %n) {
+entry:
+  br label %header
+
+header:
+  %i = phi i32 [ 0, %entry ], [ %next, %body ]
+  %cmp = icmp slt i32 %i, %n
+  br i1 %cmp, label %body, label %exit
+
+body:
+  %x = load i32, i32* @g
+  store i32 %x, i32* @g
+  %next = add nsw i32 %i, 2
+  br label %header, !llvm.loop !0
+
+exit:
+  ret i32 %i
+}
+
+!0 = distinct !{!0, !1}
+!1 = !{!"llvm.loop.mustprogress"}
@@ -0,0 +1,40 @@
+; %a is used only truncated to i8 and i16, so it gets 16 bits. %b is only
+; compared with 0, so it is a bool. The comparison of %c with 5 does not
+; separate 0 and 1 and %d is used whole, so they stay ints.
+;
+; RUN: opt -enable-new-pm=0 -load LLVMsbt.so -narrow-nondet -S %s -o -
+;
+; CHECK: Narrowed 2 nondeterministic values
+; CHECK: define i32 @f()
+; CHECK: %a = call i16 @__VERIFIER_nondet_ushort()
+; CHECK: trunc i16 %a to i8
+; CHECK-NOT: trunc i16 %a to i16
+; CHECK: %b = call i1 @__VERIFIER_nondet_bool()
+; CHECK: zext i1 %b to i32
+; CHECK: %c = call i32 @__VERIFIER_nondet_int()
+; CHECK: %d = call i32 @__VERIFIER_nondet_int()
+; CHECK: %x16 = zext i16 %a to i32
+; CHECK: ret i32
+
+declare i32 @__VERIFIER_nondet_int()
+
+define i32 @f() {
+entry:
+  %a = call i32 @__VERIFIER_nondet_int()
+  %a8 = trunc i32 %a to i8
+  %a16 = trunc i32 %a to i16
+  %b = call i32 @__VERIFIER_nondet_int()
+  %b.ne = icmp ne i32 %b, 0
+  %b.eq = icmp eq i32 0, %b
+  %c = call i32 @__VERIFIER_nondet_int()
+  %c.gt = icmp sgt i32 %c, 5
+  %d = call i32 @__VERIFIER_nondet_int()
+  %x8 = zext i8 %a8 to i32
+  %x16 = zext i16 %a16 to i32
+  %s1 = add i32 %x8, %x16
+  %s2 = add i32 %s1, %d
+  %s3 = select i1 %b.ne, i32 %s2, i32 0
+  %s4 = select i1 %b.eq, i32 %s3, i32 1
+  %s5 = select i1 %c.gt, i32 %s4, i32 2
+  ret i32 %s5
+}
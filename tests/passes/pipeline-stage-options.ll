@@ -0,0 +1,20 @@
+; The options of a pass given in a stage of sbt-pipeline apply only
+; to that stage: the first stage keeps the error call, the second one
+; removes it.
+;
+; RUN: sbt-pipeline %s -o %t.bc -stage=a -normalize-error-sites -checkpoint=a -stage=b -normalize-error-sites -normalize-error-sites-remove
+; RUN: llvm-dis %t-a.bc -o -
+; RUN: llvm-dis %t.bc -o -
+;
+; CHECK: call void @__VERIFIER_error()
+; CHECK: ModuleID
+; CHECK-NOT: call void @__VERIFIER_error()
+; CHECK: call void @__VERIFIER_assume(i32 0)
+
+declare void @__VERIFIER_error()
+
+define i32 @main() {
+entry:
+  call void @__VERIFIER_error()
+  ret i32 0
+}
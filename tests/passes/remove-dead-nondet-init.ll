@@ -0,0 +1,61 @@
+; The initializations of %a (klee_make_nondet) and %c (a store of the value
+; of a nondeterministic temporary) are overwritten before every read and
+; are removed. %b is read on one path before it is written and the address
+; of %d escapes, so their initializations are kept.
+;
+; RUN: opt -enable-new-pm=0 -load LLVMsbt.so -remove-dead-nondet-init -S %s -o -
+;
+; CHECK: Removed 2 dead nondeterministic initializations in f
+; CHECK: define i32 @f(i1 %c0)
+; CHECK-NOT: %tmp = alloca
+; CHECK-NOT: call void @klee_make_nondet(i8* %a.i8
+; CHECK: call void @klee_make_nondet(i8* %b.i8
+; CHECK: call void @klee_make_nondet(i8* %d.i8
+; CHECK: store i32 1, i32* %a
+; CHECK-NOT: load i32, i32* %tmp
+; CHECK: store i32 3, i32* %c
+; CHECK: ret i32
+
+@name = private constant [4 x i8] c"var\00"
+
+declare void @klee_make_nondet(i8*, i64, i8*, i32)
+declare void @use(i32*)
+
+define i32 @f(i1 %c0) {
+entry:
+  %a = alloca i32
+  %b = alloca i32
+  %c = alloca i32
+  %d = alloca i32
+  %tmp = alloca i32
+  %a.i8 = bitcast i32* %a to i8*
+  call void @klee_make_nondet(i8* %a.i8, i64 4, i8* getelementptr ([4 x i8], [4 x i8]* @name, i64 0, i64 0), i32 0)
+  %b.i8 = bitcast i32* %b to i8*
+  call void @klee_make_nondet(i8* %b.i8, i64 4, i8* getelementptr ([4 x i8], [4 x i8]* @name, i64 0, i64 0), i32 1)
+  %tmp.i8 = bitcast i32* %tmp to i8*
+  call void @klee_make_nondet(i8* %tmp.i8, i64 4, i8* getelementptr ([4 x i8], [4 x i8]* @name, i64 0, i64 0), i32 2)
+  %nd = load i32, i32* %tmp
+  store i32 %nd, i32* %c
+  %d.i8 = bitcast i32* %d to i8*
+  call void @klee_make_nondet(i8* %d.i8, i64 4, i8* getelementptr ([4 x i8], [4 x i8]* @name, i64 0, i64 0), i32 3)
+  call void @use(i32* %d)
+  store i32 1, i32* %a
+  br i1 %c0, label %read, label %write
+
+read:
+  %vb = load i32, i32* %b
+  br label %join
+
+write:
+  store i32 2, i32* %b
+  br label %join
+
+join:
+  store i32 3, i32* %c
+  %va = load i32, i32* %a
+  %vb2 = load i32, i32* %b
+  %vc = load i32, i32* %c
+  %s1 = add i32 %va, %vb2
+  %s2 = add i32 %s1, %vc
+  ret i32 %s2
+}
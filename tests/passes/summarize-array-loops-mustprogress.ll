@@ -0,0 +1,53 @@
+; ScalarEvolution computes a count of the loop k += 2 until k == n
+; in a loop that must make progress, but the loop does not terminate for
+; an odd n (and then writes out of the bounds of a). It must not be
+; replaced by memset. The loop with j < 10 (nsw) is replaced.
+;
+; RUN: opt -enable-new-pm=0 -load LLVMsbt.so -summarize-array-loops -S %s -o -
+;
+; CHECK: Replaced a loop in fill_bounded by memset
+; CHECK-NOT: Replaced a loop
+; CHECK: define void @fill_until_equal
+; CHECK-NOT: call void @llvm.memset
+; CHECK: store i8 0, i8* %p
+; CHECK: define void @fill_bounded
+; CHECK: call void @llvm.memset
+
+define void @fill_until_equal(i32 %n) mustprogress {
+entry:
+  %a = alloca [10 x i8]
+  br label %loop
+
+loop:
+  %j = phi i64 [ 0, %entry ], [ %j.next, %loop ]
+  %k = phi i32 [ 0, %entry ], [ %k.next, %loop ]
+  %p = getelementptr [10 x i8], [10 x i8]* %a, i64 0, i64 %j
+  store i8 0, i8* %p
+  %j.next = add i64 %j, 1
+  %k.next = add i32 %k, 2
+  %cmp = icmp ne i32 %k.next, %n
+  br i1 %cmp, label %loop, label %exit, !llvm.loop !0
+
+exit:
+  ret void
+}
+
+define void @fill_bounded() mustprogress {
+entry:
+  %a = alloca [10 x i8]
+  br label %loop
+
+loop:
+  %j = phi i64 [ 0, %entry ], [ %j.next, %loop ]
+  %p = getelementptr [10 x i8], [10 x i8]* %a, i64 0, i64 %j
+  store i8 0, i8* %p
+  %j.next = add nsw i64 %j, 1
+  %cmp = icmp slt i64 %j.next, 10
+  br i1 %cmp, label %loop, label %exit, !llvm.loop !0
+
+exit:
+  ret void
+}
+
+!0 = distinct !{!0, !1}
+!1 = !{!"llvm.loop.mustprogress"}
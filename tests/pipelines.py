@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+
+"""
+Tune the optimization pipelines (see --opt-pipelines): run symbiotic
+on the tests with every candidate pipeline (the optimizations before and
+after slicing), measure the verdicts and the times, and store the best
+candidate for the target and the version of LLVM into the table.
+The best candidate gives no wrong verdict, the most correct verdicts
+and then the shortest total time. Then every probed pass is added
+to the best pipeline and the passes that make some verdict wrong,
+lose some correct verdict or make the tests slower than THRESHOLD times
+are marked as harmful (they are removed from all optimizations).
+"""
+
+from subprocess import Popen, PIPE, DEVNULL
+from tempfile import TemporaryDirectory
+from os import path
+
+import argparse
+import json
+import os
+import sys
+import time
+
+here = path.dirname(path.abspath(__file__))
+sys.path.insert(0, path.join(here, '..', 'lib', 'symbioticpy'))
+
+from benchmark import print, get_property, get_tests, RED, GREEN
+from profiles import get_expected, is_correct
+from symbiotic.optimizations import optimizations
+from symbiotic.optpipelines import VERSION, llvm_major
+
+# the candidates if no file with candidates is given:
+# the same level before and after slicing
+LEVELS = ('conservative', 'klee', 'O2', 'O3')
+PROBES = ('-loop-vectorize', '-slp-vectorizer')
+
+
+def default_candidates():
+    return [{'name': l, 'before': optimizations[l], 'after': optimizations[l]}
+            for l in LEVELS]
+
+
+def optimize_arg(candidate):
+    """ The argument of --optimize for the candidate """
+    items = ['before-opt' + p for p in candidate['before']] +\
+            ['after-opt' + p for p in candidate['after']]
+    return ','.join(items) if items else 'none'
+
+
+def run_symbiotic(test, args, candidate):
+    cmd = ['symbiotic', '--no-integrity-check',
+           '--timeout=%d' % args.timeout,
+           '--target=' + args.target,
+           '--optimize=' + optimize_arg(candidate)]
+    prp = get_property(test)
+    if prp:
+        cmd.append('--prp=' + prp)
+    if args.is32bit:
+        cmd.append('--32')
+
+    with TemporaryDirectory() as tmpdir:
+        start = time.perf_counter()
+        proc = Popen(cmd + [test], stdout=PIPE, stderr=DEVNULL, cwd=tmpdir)
+        out, _ = proc.communicate()
+        elapsed = time.perf_counter() - start
+
+    result = None
+    for line in out.decode('utf-8', 'replace').splitlines():
+        if line.startswith('RESULT: '):
+            result = line[8:].strip()
+    return result, elapsed
+
+
+def evaluate(candidate, tests, args):
+    """ The verdicts and the time of the candidate on the tests """
+    stats = {'correct': 0, 'wrong': 0, 'time': 0.0, 'results': {}}
+    for test, expected in tests:
+        res, tm = run_symbiotic(test, args, candidate)
+        stats['time'] += tm
+        if is_correct(res, expected):
+            stats['correct'] += 1
+        elif res is not None and (res.startswith('true') or
+                                  res.startswith('false')):
+            stats['wrong'] += 1
+        stats['results'][path.relpath(test, here)] = res
+    print('%s: correct %d, wrong %d, %.3f s' %
+          (candidate['name'], stats['correct'], stats['wrong'],
+           stats['time']), color=RED if stats['wrong'] else GREEN)
+    return stats
+
+
+def is_harmful(stats, best, args):
+    return stats['wrong'] > best['wrong'] or\
+           stats['correct'] < best['correct'] or\
+           stats['time'] > best['time'] * args.threshold
+
+
+def store(args, entry):
+    data = {'version': VERSION, 'harmful': [], 'pipelines': []}
+    if path.isfile(args.table):
+        with open(args.table, 'r') as f:
+            data = json.load(f)
+        if data.get('version') != VERSION:
+            print('Unknown version of the table', args.table, color=RED)
+            sys.exit(1)
+
+    pipelines = [p for p in data.get('pipelines', [])
+                 if p.get('target') != entry['target'] or
+                    str(p.get('llvm')) != entry['llvm']]
+    data['pipelines'] = pipelines + [entry]
+    with open(args.table, 'w') as f:
+        json.dump(data, f, indent=2)
+        f.write('\n')
+    print('The pipeline stored into', args.table)
+
+
+def main(args):
+    candidates = default_candidates()
+    if args.candidates:
+        with open(args.candidates, 'r') as f:
+            candidates = json.load(f)
+
+    tests = []
+    for test in get_tests(args):
+        expected = get_expected(test, get_property(test))
+        if expected is not None:
+            tests.append((path.abspath(test), expected))
+    if not tests:
+        print('No tests with a known verdict', color=RED)
+        sys.exit(1)
+
+    results = [(c, evaluate(c, tests, args)) for c in candidates]
+    best, best_stats = max(results, key=lambda r: (-r[1]['wrong'],
+                                                   r[1]['correct'],
+                                                   -r[1]['time']))
+    print('The best pipeline:', best['name'], color=GREEN)
+
+    harmful = []
+    for probe in args.probe or PROBES:
+        candidate = {'name': '%s + %s' % (best['name'], probe),
+                     'before': best['before'],
+                     'after': best['after'] + [probe]}
+        if is_harmful(evaluate(candidate, tests, args), best_stats, args):
+            print('%s is harmful' % probe, color=RED)
+            harmful.append(probe)
+
+    os.makedirs(path.dirname(path.abspath(args.output)), exist_ok=True)
+    with open(args.output, 'w') as f:
+        json.dump({'version': VERSION,
+                   '32bit': args.is32bit,
+                   'target': args.target,
+                   'llvm': args.llvm,
+                   'candidates': [dict(c, **s) for c, s in results]},
+                  f, indent=1)
+    print('Results stored into', args.output)
+
+    store(args, {'target': args.target, 'llvm': args.llvm,
+                 'name': best['name'],
+                 'before': best['before'], 'after': best['after'],
+                 'harmful': harmful,
+                 'tests': len(tests), 'correct': best_stats['correct'],
+                 'time': round(best_stats['time'], 3)})
+
+
+def get_llvm_version():
+    try:
+        proc = Popen(['llvm-config', '--version'], stdout=PIPE)
+        out, _ = proc.communicate()
+        return llvm_major(out.decode('utf-8').strip())
+    except OSError:
+        return 'unknown'
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+
+    parser.add_argument('--32', action='store_true', dest='is32bit',
+                        default=False, help='use 32-bit environment')
+    parser.add_argument('--target', action='store', default='klee',
+                        help='the verifier to tune the pipeline for')
+    parser.add_argument('--llvm', action='store', default=None,
+                        help='the major version of LLVM (default: from '
+                        'llvm-config)')
+    parser.add_argument('--candidates', action='store', default=None,
+                        help='JSON list of {"name", "before", "after"} '
+                        '(default: the levels from optimizations.py)')
+    parser.add_argument('--probe', action='append', default=None,
+                        help='the pass to check if it is harmful (default: '
+                        'the vectorizers), may be given multiple times')
+    parser.add_argument('--table', action='store',
+                        default=path.join(here, '..', 'lib', 'opt-pipelines.json'),
+                        help='the table to store the best pipeline into')
+    parser.add_argument('-o', '--output', action='store',
+                        default='results/pipelines.json',
+                        help='where to store the results (JSON)')
+    parser.add_argument('--threshold', action='store', type=float,
+                        default=1.2, help='mark the probed passes that make '
+                        'the tests slower than THRESHOLD times as harmful')
+    parser.add_argument('-t', '--timeout', action='store', type=int,
+                        default=300, help='single test timeout')
+    parser.add_argument('tests', nargs='*', type=str,
+                        help='tests to run (default: tests/ and tests/long/)')
+
+    args = parser.parse_args()
+    if args.llvm is None:
+        args.llvm = get_llvm_version()
+    main(args)
@@ -0,0 +1,176 @@
+#!/usr/bin/env python3
+
+"""
+Validate the table of KLEE profiles (see --klee-profiles): run symbiotic
+on the tests with the default options of KLEE and with the profiles,
+and report for every profile on how many tests it was used, how many
+verdicts were correct and how long the runs took in both cases.
+A profile fails the validation if it gives a wrong verdict on a test
+that the default options decide correctly, or if it makes its tests
+slower than THRESHOLD times the default.
+"""
+
+from subprocess import Popen, PIPE, DEVNULL
+from tempfile import TemporaryDirectory
+from os import path
+
+import argparse
+import json
+import os
+import sys
+import time
+
+here = path.dirname(path.abspath(__file__))
+sys.path.insert(0, path.join(here, '..', 'lib', 'symbioticpy'))
+
+from benchmark import print, get_property, get_tests, RED, GREEN
+from symbiotic.targets.kleeprofiles import load_profiles, matches
+
+VERSION = 1
+
+
+def get_expected(test, prp):
+    """ The expected verdict by the name of the test (None if unknown) """
+    name = path.basename(test)
+    if prp == 'memcleanup':
+        keys = ('valid-memcleanup',)
+    elif prp == 'memsafety':
+        keys = ('valid-memsafety', 'valid-deref', 'valid-free',
+                'valid-memtrack')
+    else:
+        keys = ('unreach-call',)
+
+    for key in keys:
+        if 'false-' + key in name:
+            return 'false'
+        if 'true-' + key in name:
+            return 'true'
+    return None
+
+
+def run_symbiotic(test, args, tmpdir, profiles):
+    features = path.join(tmpdir, 'features.json')
+    cmd = ['symbiotic', '--no-integrity-check',
+           '--timeout=%d' % args.timeout,
+           '--features=' + features]
+    prp = get_property(test)
+    if prp:
+        cmd.append('--prp=' + prp)
+    if args.is32bit:
+        cmd.append('--32')
+    if profiles:
+        cmd.append('--klee-profiles=' + args.table)
+
+    start = time.perf_counter()
+    proc = Popen(cmd + [test], stdout=PIPE, stderr=DEVNULL, cwd=tmpdir)
+    out, _ = proc.communicate()
+    elapsed = time.perf_counter() - start
+
+    result = None
+    for line in out.decode('utf-8', 'replace').splitlines():
+        if line.startswith('RESULT: '):
+            result = line[8:].strip()
+
+    try:
+        with open(features, 'r') as f:
+            features = json.load(f)
+    except (IOError, OSError, ValueError):
+        features = None
+
+    return result, elapsed, features
+
+
+def is_correct(result, expected):
+    return result is not None and result.startswith(expected)
+
+
+def main(args):
+    profiles = load_profiles(args.table)
+    if not profiles:
+        print('No profiles in', args.table, color=RED)
+        sys.exit(1)
+
+    stats = {p['name']: {'tests': [], 'correct_default': 0,
+                         'correct_profile': 0, 'regressions': [],
+                         'time_default': 0.0, 'time_profile': 0.0}
+             for p in profiles}
+
+    for test in get_tests(args):
+        expected = get_expected(test, get_property(test))
+        if expected is None:
+            continue
+
+        name = path.relpath(test, here)
+        with TemporaryDirectory() as tmpdir:
+            res, tm, features = run_symbiotic(path.abspath(test), args,
+                                              tmpdir, False)
+        used = [p['name'] for p in profiles
+                if features and matches(p, features)]
+        if not used:
+            print('%s: no profile' % name)
+            continue
+
+        with TemporaryDirectory() as tmpdir:
+            pres, ptm, _ = run_symbiotic(path.abspath(test), args,
+                                         tmpdir, True)
+
+        ok = is_correct(pres, expected) or not is_correct(res, expected)
+        print('%s [%s]: %s %.3f s -> %s %.3f s' %
+              (name, ', '.join(used), res, tm, pres, ptm),
+              color=GREEN if ok else RED)
+
+        for p in used:
+            st = stats[p]
+            st['tests'].append(name)
+            st['correct_default'] += is_correct(res, expected)
+            st['correct_profile'] += is_correct(pres, expected)
+            st['time_default'] += tm
+            st['time_profile'] += ptm
+            if not ok:
+                st['regressions'].append(name)
+
+    failed = 0
+    for p, st in stats.items():
+        if not st['tests']:
+            print('%s: not used' % p)
+            continue
+        slower = st['time_profile'] > st['time_default'] * args.threshold
+        bad = st['regressions'] or slower
+        failed += bool(bad)
+        print('%s: %d test(s), correct %d -> %d, %.3f s -> %.3f s' %
+              (p, len(st['tests']), st['correct_default'],
+               st['correct_profile'], st['time_default'], st['time_profile']),
+              color=RED if bad else GREEN)
+
+    os.makedirs(path.dirname(path.abspath(args.output)), exist_ok=True)
+    with open(args.output, 'w') as f:
+        json.dump({'version': VERSION,
+                   '32bit': args.is32bit,
+                   'table': args.table,
+                   'profiles': stats}, f, indent=1)
+    print('Results stored into', args.output)
+
+    if failed > 0:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+
+    parser.add_argument('--32', action='store_true', dest='is32bit',
+                        default=False, help='use 32-bit environment')
+    parser.add_argument('--table', action='store',
+                        default=path.join(here, '..', 'lib', 'klee-profiles.json'),
+                        help='the table of profiles to validate')
+    parser.add_argument('-o', '--output', action='store',
+                        default='results/profiles.json',
+                        help='where to store the results (JSON)')
+    parser.add_argument('--threshold', action='store', type=float,
+                        default=1.2, help='fail the profiles that make '
+                        'their tests slower than THRESHOLD times the default')
+    parser.add_argument('-t', '--timeout', action='store', type=int,
+                        default=300, help='single test timeout')
+    parser.add_argument('tests', nargs='*', type=str,
+                        help='tests to run (default: tests/ and tests/long/)')
+
+    main(parser.parse_args())
@@ -0,0 +1,21 @@
+#!/bin/sh
+
+set -e
+
+# run symbiotic from the scripts/ preferably, so that we measure
+# the current (development) version
+PATH="$PWD/../scripts:$PWD/../install/bin/:$PATH"
+
+# use LLVM tools linked to symbiotic's install directory
+ENV_CMD="$(symbiotic --dump-env-cmd)"
+eval "$ENV_CMD"
+
+# clear the environment
+unset CFLAGS
+unset CXXFLAGS
+unset CPPFLAGS
+unset LDFLAGS
+
+# BENCHMARK=profiles.py validates the table of KLEE profiles instead,
+# BENCHMARK=pipelines.py tunes the optimization pipelines
+./${BENCHMARK:-benchmark.py} "$@"
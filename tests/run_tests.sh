@@ -26,5 +26,11 @@ if [ -n "$CI" ]; then
   ci_args='--color --with-integrity-check'
 fi
 
-./test_runner.py "$@" $ci_args ./*.set
-./test_runner.py "$@" $ci_args --32 ./*.set
+# the number of tests that run in parallel (e.g., JOBS=$(nproc) make check)
+jobs="--jobs=${JOBS:-1}"
+
+# the tests of the passes do not run symbiotic, only opt and sbt-pipeline
+./pass_tests.py
+
+./test_runner.py $jobs "$@" $ci_args ./*.set
+./test_runner.py $jobs "$@" $ci_args --32 ./*.set
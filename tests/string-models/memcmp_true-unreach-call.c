@@ -0,0 +1,18 @@
+extern void __VERIFIER_error(void) __attribute__((noreturn));
+extern unsigned char __VERIFIER_nondet_uchar(void);
+extern int memcmp(const void *, const void *, unsigned long);
+
+#define N 16
+
+int main(void) {
+	unsigned char a[N], b[N];
+	for (int i = 0; i < N; ++i) {
+		a[i] = __VERIFIER_nondet_uchar();
+		b[i] = __VERIFIER_nondet_uchar();
+	}
+
+	int r = memcmp(a, b, N);
+	if (r == 0 && a[N - 1] != b[N - 1])
+		__VERIFIER_error();
+	return 0;
+}
@@ -0,0 +1,19 @@
+extern void __VERIFIER_error(void) __attribute__((noreturn));
+extern char __VERIFIER_nondet_char(void);
+extern int strcmp(const char *, const char *);
+
+#define N 12
+
+int main(void) {
+	char a[N], b[N];
+	for (int i = 0; i < N - 1; ++i) {
+		a[i] = __VERIFIER_nondet_char();
+		b[i] = __VERIFIER_nondet_char();
+	}
+	a[N - 1] = b[N - 1] = '\0';
+
+	int r = strcmp(a, b);
+	if (r == 0 && a[0] != b[0])
+		__VERIFIER_error();
+	return 0;
+}
@@ -0,0 +1,19 @@
+extern void __VERIFIER_error(void) __attribute__((noreturn));
+extern char __VERIFIER_nondet_char(void);
+extern int strncmp(const char *, const char *, unsigned long);
+
+#define N 12
+
+int main(void) {
+	char a[N], b[N];
+	for (int i = 0; i < N - 1; ++i) {
+		a[i] = __VERIFIER_nondet_char();
+		b[i] = __VERIFIER_nondet_char();
+	}
+	a[N - 1] = b[N - 1] = '\0';
+
+	int r = strncmp(a, b, N / 2);
+	if (r < 0 && strncmp(b, a, N / 2) <= 0)
+		__VERIFIER_error();
+	return 0;
+}
@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+
+"""
+Compare the models of string functions (--string-models): run symbiotic
+with KLEE on the programs from tests/string-models/ with the default
+and with the 'select' models and print the number of paths that KLEE
+completed, the number of solver queries (if klee-stats is available)
+and the time of every run.
+"""
+
+from glob import glob
+from subprocess import run, DEVNULL, PIPE
+from tempfile import TemporaryDirectory
+from os import path
+
+import argparse
+import csv
+import re
+import sys
+import time
+
+RED = '\u001b[31m'
+GREEN = '\u001b[32m'
+RESET = '\u001b[0m'
+
+MODELS = ['default', 'select']
+
+
+def print(*args, color='', end='\n'):
+    import builtins
+
+    if not sys.stdout.isatty():
+        builtins.print(*args, end=end)
+    else:
+        builtins.print(color, end='')
+        builtins.print(*args, end='')
+        builtins.print(RESET, end=end)
+
+    sys.stdout.flush()
+
+
+def get_tests(args):
+    if args.tests:
+        return args.tests
+
+    here = path.dirname(path.abspath(__file__))
+    return sorted(glob(path.join(here, 'string-models', '*.c')))
+
+
+def get_paths(kleedir):
+    """ The number of completed paths from the info file of KLEE """
+    try:
+        with open(path.join(kleedir, 'info'), 'r') as f:
+            m = re.search(r'completed paths = (\d+)', f.read())
+    except (IOError, OSError):
+        return None
+    return int(m.group(1)) if m else None
+
+
+def get_queries(kleedir):
+    """ The number of solver queries from klee-stats """
+    try:
+        proc = run(['klee-stats', '--print-all', '--table-format=csv', kleedir],
+                   stdout=PIPE, stderr=DEVNULL, universal_newlines=True)
+    except OSError:
+        return None
+    if proc.returncode != 0:
+        return None
+
+    for row in csv.DictReader(proc.stdout.splitlines()):
+        if 'Queries' in row:
+            try:
+                return int(row['Queries'])
+            except ValueError:
+                return None
+    return None
+
+
+def run_test(test, models, args, tmpdir):
+    cmd = ['symbiotic', '--no-integrity-check', '--save-files',
+           '--timeout=%d' % args.timeout, '--string-models=' + models]
+    if args.is32bit:
+        cmd.append('--32')
+
+    start = time.perf_counter()
+    proc = run(cmd + [test], stdout=PIPE, stderr=DEVNULL, cwd=tmpdir,
+               universal_newlines=True)
+    elapsed = time.perf_counter() - start
+
+    kleedir = path.join(tmpdir, 'symbiotic_files', 'klee-last')
+    result = 'ERROR'
+    for line in proc.stdout.splitlines():
+        if line.startswith('RESULT:'):
+            result = line[7:].strip()
+
+    return {'result': result,
+            'time': elapsed,
+            'paths': get_paths(kleedir),
+            'queries': get_queries(kleedir)}
+
+
+def fmt(val):
+    return '-' if val is None else str(val)
+
+
+def main(args):
+    failed = 0
+    for test in get_tests(args):
+        print(path.basename(test))
+        results = {}
+        for models in MODELS:
+            with TemporaryDirectory() as tmpdir:
+                results[models] = res = run_test(path.abspath(test), models,
+                                                 args, tmpdir)
+            print('  %-8s %-10s paths: %6s  queries: %8s  %.3f s' %
+                  (models, res['result'], fmt(res['paths']),
+                   fmt(res['queries']), res['time']))
+
+        # the models must not change the answer
+        answers = set(r['result'] for r in results.values())
+        if len(answers) != 1:
+            print('  different results: %s' % ', '.join(sorted(answers)),
+                  color=RED)
+            failed += 1
+        else:
+            print('  OK', color=GREEN)
+
+    if failed > 0:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+
+    parser.add_argument('--32', action='store_true', dest='is32bit',
+                        default=False, help='use 32-bit environment')
+    parser.add_argument('-t', '--timeout', action='store', type=int,
+                        default=300, help='single test timeout')
+    parser.add_argument('tests', nargs='*', type=str,
+                        help='tests to run (default: tests/string-models/)')
+
+    main(parser.parse_args())
@@ -1,12 +1,19 @@
 #!/usr/bin/env python3
 
+from concurrent.futures import ThreadPoolExecutor, as_completed
+from fnmatch import fnmatch
 from glob import glob
 from subprocess import Popen, PIPE
 from os import path
+from resource import setrlimit, RLIMIT_AS
+from shutil import rmtree
+from tempfile import mkdtemp
 
 import argparse
+import json
 import re
 import sys
+import time
 
 GREEN = '\u001b[32m'
 RED = '\u001b[31m'
@@ -16,8 +23,17 @@ RESET = '\u001b[0m'
 
 
 result_re = re.compile(r'(?<=^RESULT: ).*(?=\s)', re.MULTILINE)
+verification_time_re = re.compile(r'^INFO: Verification time: ([0-9.]+)',
+                                  re.MULTILINE)
+total_time_re = re.compile(r'^INFO: Total time elapsed: ([0-9.]+)',
+                           re.MULTILINE)
 failure = False
 force_color = False
+# the wall-time budgets from symbiotic-tests.xml as (pattern, budget) pairs
+budgets = []
+# the times of the tests from this run and from the baseline
+times = {}
+baseline = {}
 
 
 def print(*args, color='', end='\n'):
@@ -42,9 +58,70 @@ def get_expected_result(input_regex):
     return 'false(%s)' % input_regex[7:-1]
 
 
-def run_tests(test_files, prp, expected_result, args):
-    global failure
+def parse_seconds(value):
+    # the format of BenchExec: '20 s', '2 min', '20'
+    value = value.strip()
+    if value.endswith('min'):
+        return float(value[:-3]) * 60
+    if value.endswith('s'):
+        return float(value[:-1])
+    return float(value)
+
+
+def load_budgets(xml):
+    """
+    Load the <budget> elements from the benchmark definition, e.g.,
+    <budget name="*memsafety*" preprocessing="5 s" verification="10 s"/>.
+    BenchExec ignores them. If more budgets match a test,
+    the last one is used.
+    """
+    from xml.etree import ElementTree as ET
+
+    for elem in ET.parse(xml).getroot().iter('budget'):
+        budget = {k: parse_seconds(v) for k, v in elem.attrib.items()
+                  if k in ('preprocessing', 'verification', 'total')}
+        budgets.append((elem.get('name', '*'), budget))
+
+
+def get_times(out, elapsed):
+    """
+    Get the verification and preprocessing time from the output of
+    symbiotic (the verification may run more times, e.g., on the unsliced code)
+    """
+    total = total_time_re.search(out)
+    total = float(total[1]) if total else elapsed
+    verification = sum(float(t) for t in verification_time_re.findall(out))
+    return {'total': total,
+            'verification': verification,
+            'preprocessing': max(0.0, total - verification)}
+
+
+def check_times(test, tm, args):
+    """ Check the times against the budget and the baseline """
+    problems = []
+    budget = {}
+    for pattern, b in budgets:
+        if fnmatch(test, pattern) or fnmatch(path.basename(test), pattern):
+            budget = b
+
+    for what, limit in sorted(budget.items()):
+        if tm[what] > limit:
+            problems.append('%s time %.2f s exceeds the budget %.2f s'
+                            % (what, tm[what], limit))
+
+    old = baseline.get(test, {})
+    for what in ('preprocessing', 'verification', 'total'):
+        if what not in old:
+            continue
+        if tm[what] > old[what] * args.threshold and\
+           tm[what] - old[what] > args.min_time:
+            problems.append('%s time %.2f s regressed (baseline %.2f s)'
+                            % (what, tm[what], old[what]))
+
+    return problems
 
+
+def symbiotic_cmd(prp, args):
     cmd = ['symbiotic', '--exit-on-error', '--report=sv-comp',
            '--timeout=%d' % args.timeout]
 
@@ -60,35 +137,108 @@ def run_tests(test_files, prp, expected_result, args):
     if not args.with_integrity_check:
         cmd.append('--no-integrity-check')
 
-    for test in test_files:
-        print(test, end=': ')
-
-        symbiotic = Popen(cmd + [test], stdout=PIPE, stderr=PIPE)
+    return cmd
+
+
+def run_test(test, prp, expected_result, args):
+    """
+    Run symbiotic on one test in its own working directory (the outputs
+    like witnesses of the tests that run in parallel do not clash)
+    with the memory limit, return the record of the run
+    """
+    def limit():
+        if args.memlimit:
+            limit = args.memlimit * 1024 * 1024
+            setrlimit(RLIMIT_AS, (limit, limit))
+
+    workdir = mkdtemp(prefix='symbiotic-test-')
+    try:
+        start = time.perf_counter()
+        symbiotic = Popen(symbiotic_cmd(prp, args) + [path.abspath(test)],
+                          stdout=PIPE, stderr=PIPE, cwd=workdir,
+                          preexec_fn=limit)
         out, err = map(lambda x: x.decode(), symbiotic.communicate())
+        elapsed = time.perf_counter() - start
+    finally:
+        rmtree(workdir, ignore_errors=True)
 
-        if expected_result in out and symbiotic.returncode == 0:
-            print('PASS', color=GREEN)
-            continue
+    return {'test': test, 'prp': prp, 'expected': expected_result,
+            'returncode': symbiotic.returncode, 'out': out, 'err': err,
+            'elapsed': elapsed}
 
-        failure = True
 
-        if 'timeout' in out:
-            print('TIMEOUT', color=YELLOW)
-            continue
+def report(run, args):
+    global failure
 
-        match = result_re.search(out)
-        if match and 'ERROR' not in match[0] and symbiotic.returncode == 0:
-            print('FAIL', color=RED)
-        else:
-            print('FATAL ERROR', color=RED)
+    test, prp, out = run['test'], run['prp'], run['out']
+    expected_result = run['expected']
+    print(test, end=': ')
 
-        print('\tExpected result:', expected_result)
-        print('\tActual result:', match[0] if match else 'N/A')
+    key = '%s:%s:%d' % (prp, test, 32 if args.is32bit else 64)
+    if expected_result in out and run['returncode'] == 0:
+        tm = get_times(out, run['elapsed'])
+        times[key] = tm
 
-        print('\nstdout:')
-        print(out)
-        print('stderr:')
-        print(err)
+        problems = check_times(key, tm, args)
+        if not problems:
+            print('PASS (%.2f s)' % tm['total'], color=GREEN)
+            return
+
+        failure = True
+        print('SLOW', color=RED)
+        for problem in problems:
+            print('\t' + problem)
+        return
+
+    failure = True
+
+    if 'timeout' in out:
+        print('TIMEOUT', color=YELLOW)
+        return
+
+    match = result_re.search(out)
+    if match and 'ERROR' not in match[0] and run['returncode'] == 0:
+        print('FAIL', color=RED)
+    else:
+        print('FATAL ERROR', color=RED)
+
+    print('\tExpected result:', expected_result)
+    print('\tActual result:', match[0] if match else 'N/A')
+
+    print('\nstdout:')
+    print(out)
+    print('stderr:')
+    print(run['err'])
+
+
+def run_tests(tasks, args):
+    """
+    Run the tasks (test, prp, expected result) in args.jobs parallel jobs.
+    The tasks that took the longest in the baseline run first, so that
+    a long task does not start at the end. Return the records of the runs.
+    """
+    bits = 32 if args.is32bit else 64
+    tasks = sorted(tasks, reverse=True,
+                   key=lambda t: baseline.get('%s:%s:%d' % (t[1], t[0], bits),
+                                              {}).get('total', 0.0))
+    runs = []
+    with ThreadPoolExecutor(max_workers=max(1, args.jobs)) as executor:
+        futures = [executor.submit(run_test, test, prp, expected, args)
+                   for (test, prp, expected) in tasks]
+        # report the runs as they finish
+        for future in as_completed(futures):
+            run = future.result()
+            report(run, args)
+            runs.append(run)
+    return runs
+
+
+def report_slowest(runs, num):
+    if num <= 0 or not runs:
+        return
+    print('The slowest tests:', color=BOLD_GRAY)
+    for run in sorted(runs, key=lambda r: r['elapsed'], reverse=True)[:num]:
+        print('\t%7.2f s  %s (%s)' % (run['elapsed'], run['test'], run['prp']))
 
 
 def main(args):
@@ -102,16 +252,41 @@ def main(args):
     global force_color
     force_color = args.force_color
 
+    if args.budgets and path.isfile(args.budgets):
+        load_budgets(args.budgets)
+
+    if args.baseline:
+        global baseline
+        with open(args.baseline, 'r') as f:
+            baseline = json.load(f)
+
+    runs = []
     for test in args.test_sets:
         basename = path.basename(test)
         prp = path.splitext(basename)[0]
         print('Executing', basename, '(%d-bit)' % (32 if args.is32bit else 64),
               color=BOLD_GRAY)
 
+        tasks = []
         with open(test, 'r') as input_regexes:
             for line in input_regexes:
                 line = line.strip()
-                run_tests(glob(line), prp, get_expected_result(line), args)
+                expected = get_expected_result(line)
+                tasks += [(t, prp, expected) for t in glob(line)]
+        runs += run_tests(tasks, args)
+
+    report_slowest(runs, args.slowest)
+
+    if args.save_times:
+        # merge with the stored times, so that the 32-bit and 64-bit
+        # runs can store their times into the same file
+        stored = {}
+        if path.isfile(args.save_times):
+            with open(args.save_times, 'r') as f:
+                stored = json.load(f)
+        stored.update(times)
+        with open(args.save_times, 'w') as f:
+            json.dump(stored, f, indent=1, sort_keys=True)
 
     sys.exit(int(failure))
 
@@ -131,6 +306,29 @@ if __name__ == '__main__':
                         help='enable Symbiotic\'s integrity check')
     parser.add_argument('-t', '--timeout', action='store', type=int,
                         default=20, help='single test timeout')
+    parser.add_argument('--budgets', action='store',
+                        default=path.join(path.dirname(path.abspath(__file__)),
+                                          'symbiotic-tests.xml'),
+                        help='benchmark definition with <budget> elements '
+                        '(wall-time budgets of the tests)')
+    parser.add_argument('-b', '--baseline', action='store', default=None,
+                        help='JSON file with times stored by --save-times, '
+                        'fail if the tests got noticeably slower')
+    parser.add_argument('--save-times', action='store', default=None,
+                        help='store the times of the tests into this JSON file')
+    parser.add_argument('--threshold', action='store', type=float,
+                        default=1.5, help='a test regressed if it is slower '
+                        'than THRESHOLD times the baseline')
+    parser.add_argument('--min-time', action='store', type=float,
+                        default=1.0, help='ignore regressions shorter than '
+                        'MIN_TIME seconds')
+    parser.add_argument('-j', '--jobs', action='store', type=int,
+                        default=1, help='run this number of tests in parallel')
+    parser.add_argument('--memlimit', action='store', type=int, default=None,
+                        help='limit the memory of a test to MEMLIMIT MB')
+    parser.add_argument('--slowest', action='store', type=int, default=10,
+                        help='report this number of the slowest tests '
+                        'at the end')
     parser.add_argument('test_sets', nargs='+', type=str,
                         help='test sets to be executed')
 
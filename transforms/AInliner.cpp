@@ -4,22 +4,41 @@
 // License. See LICENSE.TXT for details.
 
 #include <cassert>
+#include <map>
 #include <set>
+#include <vector>
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Analysis/CallGraph.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_os_ostream.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 
+#include "Compat.h"
+
 llvm::cl::list<std::string> noinline("ainline-noinline",
         llvm::cl::desc("Do not inline the given functions (comma-separated)\n"),
         llvm::cl::CommaSeparated);
 
+llvm::cl::opt<unsigned> budget("ainline-budget",
+        llvm::cl::desc("Inline bottom-up and stop when the module grew by\n"
+                       "this number of instructions (default=0, no budget,\n"
+                       "inline everything)\n"),
+        llvm::cl::init(0));
+
+llvm::cl::opt<unsigned> threshold("ainline-threshold",
+        llvm::cl::desc("Do not inline functions with more instructions than\n"
+                       "this (default=0, no threshold)\n"),
+        llvm::cl::init(0));
+
 using namespace llvm;
 
 class AgressiveInliner : public ModulePass {
@@ -30,6 +49,7 @@ public:
 
   bool runOnModule(Module& M) override;
   bool runOnFunction(Function &F);
+  bool runWithBudget(Module& M);
 };
 
 static RegisterPass<AgressiveInliner>
@@ -38,6 +58,9 @@ DLTU("ainline", "Agressive inliner - inline as much as you can.");
 char AgressiveInliner::ID;
 
 bool AgressiveInliner::runOnModule(Module& M) {
+  if (budget > 0 || threshold > 0)
+    return runWithBudget(M);
+
   bool changed = false;
   for (auto& F : M) {
       changed |= runOnFunction(F);
@@ -53,6 +76,113 @@ static bool shouldIgnore(const std::string& name) {
     return false;
 }
 
+static bool inlineCall(CallInst *CI) {
+    InlineFunctionInfo IFI;
+#if LLVM_VERSION_MAJOR > 10
+    return InlineFunction(*CI, IFI).isSuccess();
+#else
+    return InlineFunction(CI, IFI);
+#endif
+}
+
+static Function *getCalledFunction(CallInst *CI) {
+    auto *CV = calleeOf(CI)->stripPointerCasts();
+    return llvm::dyn_cast<llvm::Function>(CV);
+}
+
+static unsigned getSize(const Function& F) {
+    unsigned size = 0;
+    for (auto& B : F) {
+        for (auto& I : B) {
+            if (!isa<DbgInfoIntrinsic>(I))
+                ++size;
+        }
+    }
+    return size;
+}
+
+// the calls that are not worth inlining: calls of cold functions
+// and calls on paths that end with unreachable (e.g., after abort())
+static bool isCold(CallInst *CI, const Function *callee) {
+    if (callee->hasFnAttribute(Attribute::Cold) ||
+        CI->hasFnAttr(Attribute::Cold))
+        return true;
+
+    return isa<UnreachableInst>(CI->getParent()->getTerminator());
+}
+
+// Inline bottom-up in the call graph, so that the size of a callee
+// already contains the functions inlined into it. Recursive calls,
+// cold calls and calls of functions bigger than the threshold are
+// not inlined and we stop when the growth of the module reaches the budget.
+bool AgressiveInliner::runWithBudget(Module& M) {
+    CallGraph CG(M);
+    std::vector<Function *> order;
+    DenseMap<const Function *, unsigned> scc_of;
+    unsigned scc_num = 0;
+    for (auto I = scc_begin(&CG); !I.isAtEnd(); ++I, ++scc_num) {
+        for (CallGraphNode *N : *I) {
+            if (Function *F = N->getFunction()) {
+                if (F->isDeclaration())
+                    continue;
+                order.push_back(F);
+                scc_of[F] = scc_num;
+            }
+        }
+    }
+
+    uint64_t growth = 0;
+    unsigned skipped = 0;
+    std::map<std::string, unsigned> inlined;
+    bool changed = false;
+    for (Function *F : order) {
+        std::vector<CallInst *> calls;
+        for (auto& B : *F) {
+            for (auto& I : B) {
+                if (auto *CI = dyn_cast<CallInst>(&I)) {
+                    calls.push_back(CI);
+                }
+            }
+        }
+
+        for (auto *CI : calls) {
+            auto *fun = getCalledFunction(CI);
+            if (!fun || fun->isDeclaration())
+                continue; // funptr or undefined function
+
+            if (shouldIgnore(fun->getName().str()))
+                continue;
+
+            if (scc_of.lookup(fun) == scc_of.lookup(F) || isCold(CI, fun)) {
+                ++skipped;
+                continue;
+            }
+
+            unsigned size = getSize(*fun);
+            if ((threshold > 0 && size > threshold) ||
+                (budget > 0 && growth + size > budget)) {
+                ++skipped;
+                continue;
+            }
+
+            if (inlineCall(CI)) {
+                growth += size;
+                ++inlined[fun->getName().str()];
+                changed = true;
+            }
+        }
+    }
+
+    for (auto& it : inlined) {
+        llvm::errs() << "Inlined '" << it.first << "' "
+                     << it.second << " times\n";
+    }
+    llvm::errs() << "Inlining grew the module by " << growth
+                 << " instructions, skipped " << skipped << " calls\n";
+
+    return changed;
+}
+
 bool AgressiveInliner::runOnFunction(Function &F) {
     bool changed = false;
     std::vector<CallInst *> calls;
@@ -67,11 +197,7 @@ bool AgressiveInliner::runOnFunction(Function &F) {
     // FIXME: this is really stupid naive way to inline...
     for (auto *CI : calls) {
         //llvm::errs() << "Inlining: " <<*CI << "\n";
-#if LLVM_VERSION_MAJOR >= 8
-        auto *CV = CI->getCalledOperand()->stripPointerCasts();
-#else
-        auto *CV = CI->getCalledValue()->stripPointerCasts();
-#endif
+        auto *CV = calleeOf(CI)->stripPointerCasts();
         auto *fun = llvm::dyn_cast<llvm::Function>(CV);
         if (!fun)
             continue; // funptr
@@ -0,0 +1,186 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Remove the floating-point computations whose values cannot influence
+// the control flow of the program (and so the reachability of an error).
+// KLEE and its solvers are slow on floating point and such computations
+// are often kept after slicing only because their values are passed to
+// output functions (printf) or because the calls of the library functions
+// (fmod, sqrt, ...) may set errno.
+//
+// A float or double value is relevant if it flows (through floating-point
+// operations and calls of external functions that take and return only
+// numbers) into anything else than an argument of an external function
+// whose result is unused: a comparison, a conversion to an integer,
+// a store, a return, a call of a defined function, ... The irrelevant
+// computations are removed and their arguments of the external functions
+// are replaced by __VERIFIER_nondet_float/__VERIFIER_nondet_double.
+// The values in memory are relevant, the loads of floats are removed only
+// when the loaded value is irrelevant.
+
+#include <vector>
+
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+namespace {
+
+class AbstractFloats : public FunctionPass {
+  bool isFloat(const Type *Ty) const {
+    return Ty->isFloatTy() || Ty->isDoubleTy();
+  }
+
+  bool isCandidate(const Instruction *I) const;
+  bool isHarmlessUse(const Instruction *U) const;
+
+public:
+  static char ID;
+
+  AbstractFloats() : FunctionPass(ID) {}
+
+  bool runOnFunction(Function& F) override;
+};
+
+} // namespace
+
+static RegisterPass<AbstractFloats> AF("abstract-floats",
+                                       "Remove the floating-point computations "
+                                       "that do not influence the control flow");
+char AbstractFloats::ID;
+
+static const Function *getCallee(const CallInst *CI) {
+  return dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+}
+
+// an external function that takes only numbers (no memory),
+// e.g., fmod or sqrt
+static bool takesNumbers(const Function *F) {
+  for (const Argument& A : F->args()) {
+    if (!A.getType()->isFloatingPointTy() && !A.getType()->isIntegerTy())
+      return false;
+  }
+  return !F->isVarArg();
+}
+
+// a float computation that can be removed if its value is irrelevant
+bool AbstractFloats::isCandidate(const Instruction *I) const {
+  if (!isFloat(I->getType()))
+    return false;
+  if (isa<BinaryOperator>(I) || isa<UnaryOperator>(I) || isa<CastInst>(I) ||
+      isa<PHINode>(I) || isa<SelectInst>(I) || isa<ExtractElementInst>(I))
+    return true;
+  // (the volatile loads may have side effects)
+  if (auto *LI = dyn_cast<LoadInst>(I))
+    return !LI->isVolatile();
+  if (auto *CI = dyn_cast<CallInst>(I)) {
+    const Function *F = getCallee(CI);
+    return F && F->isDeclaration() && takesNumbers(F);
+  }
+  return false;
+}
+
+// the use of a float that does not influence the rest of the program
+bool AbstractFloats::isHarmlessUse(const Instruction *U) const {
+  if (isa<DbgInfoIntrinsic>(U))
+    return true;
+  auto *CI = dyn_cast<CallInst>(U);
+  if (!CI || !CI->use_empty())
+    return false;
+  const Function *F = getCallee(CI);
+  return F && F->isDeclaration() && !F->isIntrinsic();
+}
+
+bool AbstractFloats::runOnFunction(Function& F) {
+  // (in the order of the instructions, the nondet calls
+  // are created in the same order in every run)
+  SetVector<Instruction *> candidates;
+  for (Instruction& I : instructions(F)) {
+    if (isCandidate(&I))
+      candidates.insert(&I);
+  }
+  if (candidates.empty())
+    return false;
+
+  // the candidates with a relevant use and the candidates
+  // from which the relevant candidates are computed
+  SmallPtrSet<Instruction *, 32> relevant;
+  SetVector<Instruction *> queue;
+  for (Instruction *I : candidates) {
+    for (User *U : I->users()) {
+      auto *UI = cast<Instruction>(U);
+      if (!candidates.count(UI) && !isHarmlessUse(UI)) {
+        queue.insert(I);
+        break;
+      }
+    }
+  }
+  while (!queue.empty()) {
+    Instruction *I = queue.pop_back_val();
+    if (!relevant.insert(I).second)
+      continue;
+    for (Value *Op : I->operands()) {
+      auto *OpI = dyn_cast<Instruction>(Op);
+      if (OpI && candidates.count(OpI) && !relevant.count(OpI))
+        queue.insert(OpI);
+    }
+  }
+
+  std::vector<Instruction *> removed;
+  for (Instruction *I : candidates) {
+    if (!relevant.count(I))
+      removed.push_back(I);
+  }
+  if (removed.empty())
+    return false;
+
+  Module *M = F.getParent();
+  for (Instruction *I : removed) {
+    Type *Ty = I->getType();
+    Instruction *pos = I;
+    if (isa<PHINode>(I))
+      pos = &*I->getParent()->getFirstInsertionPt();
+
+    CallInst *nondet = nullptr;
+    for (auto it = I->use_begin(); it != I->use_end();) {
+      Use& U = *it++;
+      // (the debugging information gets undef below)
+      auto *UI = cast<Instruction>(U.getUser());
+      if (candidates.count(UI) || isa<DbgInfoIntrinsic>(UI))
+        continue;
+      if (!nondet) {
+        auto C = insertFunction(*M, Ty->isFloatTy()
+                                        ? "__VERIFIER_nondet_float"
+                                        : "__VERIFIER_nondet_double",
+                                Ty, {});
+        nondet = CallInst::Create(C, "", pos);
+        nondet->setDebugLoc(I->getDebugLoc());
+      }
+      U.set(nondet);
+    }
+  }
+
+  // the remaining uses are among the removed instructions
+  for (Instruction *I : removed)
+    I->replaceAllUsesWith(UndefValue::get(I->getType()));
+  for (Instruction *I : removed)
+    I->eraseFromParent();
+
+  errs() << "Removed " << removed.size()
+         << " irrelevant floating-point instructions from "
+         << F.getName() << "\n";
+  return true;
+}
@@ -0,0 +1,153 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Replace the loops that only compute values (like counters
+// for (i = 0; i < N; ++i) x += c;) by the closed form of the values
+// after the loop. The values are add-recurrences of ScalarEvolution
+// evaluated at the number of iterations, which ScalarEvolution computes
+// from the exit condition (so no new nondeterministic value is needed).
+// The symbolic executor then does not fork on every iteration.
+//
+// Only the innermost loops with a single exit, without side effects,
+// memory accesses and instructions that may trap, and with a computable
+// number of iterations (so they terminate) are accelerated. The number must
+// not be one that ScalarEvolution computes only because the loop must make
+// progress (see dropMustProgress), else the accelerated loop would
+// terminate even if the original one does not.
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#if LLVM_VERSION_MAJOR >= 11
+  #include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+#else
+  #include "llvm/Analysis/ScalarEvolutionExpander.h"
+#endif
+
+#include "LoopSummary.h"
+
+#include <utility>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+  class AccelerateLoops : public LoopPass {
+      static bool hasNoEffects(const Loop *L);
+
+    public:
+      static char ID;
+
+      AccelerateLoops() : LoopPass(ID) {}
+
+      bool runOnLoop(Loop *, LPPassManager&) override;
+
+      void getAnalysisUsage(AnalysisUsage& AU) const override {
+        // loop-simplify form (a preheader and dedicated exits), LCSSA
+        // (all the values used after the loop are in the PHI nodes of
+        // the exit block) and the loop analyses
+        getLoopAnalysisUsage(AU);
+      }
+  };
+}
+
+static RegisterPass<AccelerateLoops> AL("accelerate-loops",
+                                        "Replace the loops that only compute "
+                                        "values by the closed form of the values");
+char AccelerateLoops::ID;
+
+bool AccelerateLoops::hasNoEffects(const Loop *L) {
+  for (const BasicBlock *B : L->getBlocks()) {
+    for (const Instruction& I : *B) {
+      if (isa<PHINode>(I) || isa<BranchInst>(I) || isa<SwitchInst>(I) ||
+          isa<DbgInfoIntrinsic>(I))
+        continue;
+      if (I.mayHaveSideEffects() || I.mayReadFromMemory() ||
+          !isSafeToSpeculativelyExecute(&I))
+        return false;
+    }
+  }
+  return true;
+}
+
+bool AccelerateLoops::runOnLoop(Loop *L, LPPassManager& LPM) {
+#if LLVM_VERSION_MAJOR < 8
+  // (we need deleteDeadLoop and LPPassManager::markLoopAsDeleted)
+  return false;
+#else
+  if (!L->getSubLoops().empty())
+    return false;
+
+  BasicBlock *preheader = L->getLoopPreheader();
+  BasicBlock *exiting = L->getExitingBlock();
+  BasicBlock *exit = L->getExitBlock();
+  if (!preheader || !exiting || !exit || exit->getUniquePredecessor() != exiting)
+    return false;
+
+  if (!hasNoEffects(L))
+    return false;
+
+  auto& SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+  bool changed = dropMustProgress(L, SE);
+  // the loop must terminate
+  if (isa<SCEVCouldNotCompute>(SE.getBackedgeTakenCount(L)))
+    return changed;
+
+  // the values used after the loop must be computable
+  // from the values before the loop
+  for (const BasicBlock *B : L->getBlocks()) {
+    for (const Instruction& I : *B) {
+      for (const User *U : I.users()) {
+        auto *UI = cast<Instruction>(U);
+        if (!L->contains(UI) && (UI->getParent() != exit || !isa<PHINode>(UI)))
+          return changed;
+      }
+    }
+  }
+
+  Module *M = preheader->getModule();
+  SCEVExpander expander(SE, M->getDataLayout(), "accel");
+  std::vector<std::pair<PHINode *, const SCEV *>> values;
+  for (PHINode& PN : exit->phis()) {
+    const SCEV *S = SE.getSCEVAtScope(PN.getIncomingValue(0),
+                                      L->getParentLoop());
+    if (isa<SCEVCouldNotCompute>(S) || !SE.isLoopInvariant(S, L) ||
+#if LLVM_VERSION_MAJOR >= 15
+        !expander.isSafeToExpand(S)
+#else
+        !isSafeToExpand(S, SE)
+#endif
+       )
+      return changed;
+    values.emplace_back(&PN, S);
+  }
+
+  for (auto& it : values) {
+    Value *V = expander.expandCodeFor(it.second, it.first->getType(),
+                                      preheader->getTerminator());
+    it.first->replaceAllUsesWith(V);
+    it.first->eraseFromParent();
+  }
+
+  errs() << "Accelerated a loop in " << preheader->getParent()->getName()
+         << " (" << values.size() << " values after the loop)\n";
+
+  auto& DT = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+  auto& LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  deleteDeadLoop(L, &DT, &SE, &LI);
+  LPM.markLoopAsDeleted(*L);
+  return true;
+#endif
+}
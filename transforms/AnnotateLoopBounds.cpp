@@ -0,0 +1,193 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Annotate the loops with an upper bound on the number of executions
+// of their header that ScalarEvolution derives from the exit conditions
+// (and the ranges of the values they use). The bound is stored into
+// the loop metadata of the latch as !{!"sbt.loop.bound", i64 N}, so that
+// the verifiers can stop exploring the paths that would exceed it
+// (such paths are infeasible).
+//
+// With -annotate-loop-bounds-assume, the header also counts its executions
+// and calls __VERIFIER_assume(count <= N), for the verifiers that do not
+// read the metadata (e.g., bounded model checkers, which can then stop
+// unwinding the loop).
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+#include "NewPM.h"
+
+#include <vector>
+
+using namespace llvm;
+
+bool CloneMetadata(const llvm::Instruction *, llvm::Instruction *);
+
+static cl::opt<bool> AssumeBounds("annotate-loop-bounds-assume",
+        cl::desc("Assume the bounds also by __VERIFIER_assume in the headers"),
+        cl::init(false));
+
+namespace {
+
+class AnnotateLoopBounds : public FunctionPass {
+  static void setBound(Loop *L, uint64_t bound);
+  static void assumeBound(Loop *L, uint64_t bound);
+
+public:
+  static bool annotate(Function& F, LoopInfo& LI, ScalarEvolution& SE);
+
+  static char ID;
+
+  AnnotateLoopBounds() : FunctionPass(ID) {}
+
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<ScalarEvolutionWrapperPass>();
+    if (!AssumeBounds)
+      AU.setPreservesAll();
+  }
+
+  bool runOnFunction(Function& F) override;
+};
+
+#if LLVM_VERSION_MAJOR >= 12
+class AnnotateLoopBoundsPass : public PassInfoMixin<AnnotateLoopBoundsPass> {
+public:
+  PreservedAnalyses run(Function& F, FunctionAnalysisManager& FAM) {
+    auto& LI = FAM.getResult<LoopAnalysis>(F);
+    auto& SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+    // the bounds are only metadata
+    if (!AnnotateLoopBounds::annotate(F, LI, SE) || !AssumeBounds)
+      return PreservedAnalyses::all();
+    PreservedAnalyses PA;
+    PA.preserveSet<CFGAnalyses>();
+    return PA;
+  }
+};
+#endif
+
+} // namespace
+
+#if LLVM_VERSION_MAJOR >= 12
+static RegisterNewPMFunctionPass<AnnotateLoopBoundsPass>
+    NALB("annotate-loop-bounds");
+#endif
+
+static RegisterPass<AnnotateLoopBounds> ALB("annotate-loop-bounds",
+                                            "Annotate loops with upper bounds "
+                                            "on their number of iterations");
+char AnnotateLoopBounds::ID;
+
+// add the bound into the loop ID (keep the other properties of the loop)
+void AnnotateLoopBounds::setBound(Loop *L, uint64_t bound) {
+  LLVMContext& Ctx = L->getHeader()->getContext();
+  SmallVector<Metadata *, 4> ops;
+  // the place for the self-reference
+  ops.push_back(nullptr);
+  if (MDNode *ID = L->getLoopID()) {
+    for (unsigned i = 1; i < ID->getNumOperands(); ++i) {
+      auto *prop = dyn_cast<MDNode>(ID->getOperand(i));
+      auto *name = prop && prop->getNumOperands() > 0
+                     ? dyn_cast<MDString>(prop->getOperand(0)) : nullptr;
+      if (!name || name->getString() != "sbt.loop.bound")
+        ops.push_back(ID->getOperand(i));
+    }
+  }
+  ops.push_back(MDNode::get(Ctx, {MDString::get(Ctx, "sbt.loop.bound"),
+                                  ConstantAsMetadata::get(
+                                      ConstantInt::get(Type::getInt64Ty(Ctx),
+                                                       bound))}));
+
+  MDNode *ID = MDNode::getDistinct(Ctx, ops);
+  ID->replaceOperandWith(0, ID);
+  L->setLoopID(ID);
+}
+
+// count the executions of the header in memory (the code may be
+// in the form after -reg2mem) and assume they do not exceed the bound
+void AnnotateLoopBounds::assumeBound(Loop *L, uint64_t bound) {
+  BasicBlock *header = L->getHeader();
+  Function *F = header->getParent();
+  Module *M = F->getParent();
+  LLVMContext& Ctx = M->getContext();
+  Type *I64 = Type::getInt64Ty(Ctx);
+
+  auto assume = insertFunction(*M, "__VERIFIER_assume",
+                               Type::getVoidTy(Ctx),
+                               {Type::getInt32Ty(Ctx)});
+
+  IRBuilder<> entry(&*F->getEntryBlock().getFirstInsertionPt());
+  AllocaInst *counter = entry.CreateAlloca(I64, nullptr, "loop.count");
+
+  // reset the counter on every entry of the loop
+  for (BasicBlock *pred : predecessors(header)) {
+    if (L->contains(pred))
+      continue;
+    new StoreInst(ConstantInt::get(I64, 0), counter, pred->getTerminator());
+  }
+
+  IRBuilder<> B(&*header->getFirstInsertionPt());
+  Value *count = B.CreateAdd(B.CreateLoad(I64, counter),
+                             ConstantInt::get(I64, 1));
+  B.CreateStore(count, counter);
+  Value *ok = B.CreateZExt(B.CreateICmpULE(count, ConstantInt::get(I64, bound)),
+                           Type::getInt32Ty(Ctx));
+  auto *CI = B.CreateCall(assume, {ok});
+  CloneMetadata(header->getTerminator(), CI);
+}
+
+bool AnnotateLoopBounds::runOnFunction(Function& F) {
+  auto& LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  auto& SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+  return annotate(F, LI, SE);
+}
+
+bool AnnotateLoopBounds::annotate(Function& F, LoopInfo& LI,
+                                  ScalarEvolution& SE) {
+  std::vector<std::pair<Loop *, uint64_t>> bounds;
+  for (Loop *L : LI.getLoopsInPreorder()) {
+    // (the loop ID is attached to the latch)
+    if (!L->getLoopLatch())
+      continue;
+#if LLVM_VERSION_MAJOR >= 10
+    const SCEV *max = SE.getConstantMaxBackedgeTakenCount(L);
+#else
+    const SCEV *max = SE.getMaxBackedgeTakenCount(L);
+#endif
+    auto *C = dyn_cast<SCEVConstant>(max);
+    // the number of executions of the header is one more
+    // than the number of taken backedges
+    if (!C || C->getAPInt().getActiveBits() >= 64)
+      continue;
+    bounds.emplace_back(L, C->getAPInt().getZExtValue() + 1);
+  }
+
+  if (bounds.empty())
+    return false;
+
+  for (auto& it : bounds) {
+    setBound(it.first, it.second);
+    if (AssumeBounds)
+      assumeBound(it.first, it.second);
+  }
+
+  errs() << "Annotated " << bounds.size() << " loops with bounds in "
+         << F.getName() << "\n";
+  return true;
+}
@@ -0,0 +1,206 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Annotate the loads and stores with the allocation sites of the objects
+// that their pointer may point to, so that the symbolic executor can
+// resolve a symbolic pointer only among these objects instead of searching
+// the whole address space. The allocation sites (allocas, globals
+// and calls that return new memory, e.g., malloc) get the metadata
+// !sbt.alloc.site !{i64 N} and the accesses get !sbt.points.to !{i64 N, ...}.
+//
+// The points-to sets are flow-insensitive: the pointer is followed through
+// casts, GEPs, phis, selects and the arguments of internal functions
+// (to the values passed by the calls). The accesses through pointers that
+// come from anywhere else (loaded from memory, returned from a function,
+// arguments of external functions, integers, ...) are not annotated,
+// the executor must consider all objects for them.
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned> MaxObjects("annotate-points-to-max",
+        cl::desc("Do not annotate the accesses that may point to more\n"
+                 "objects (default: 32)"),
+        cl::init(32));
+
+namespace {
+
+class AnnotatePointsTo : public ModulePass {
+  const DataLayout *DL = nullptr;
+  std::map<Value *, unsigned> _sites;
+
+  bool getObjects(Value *ptr, std::set<Value *>& objects);
+  MDNode *getSite(Value *V);
+
+public:
+  static char ID;
+
+  AnnotatePointsTo() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<AnnotatePointsTo> APT("annotate-points-to",
+                                          "Annotate memory accesses with "
+                                          "the allocation sites they may "
+                                          "access");
+char AnnotatePointsTo::ID;
+
+static Value *getUnderlying(Value *V, const DataLayout& DL) {
+#if LLVM_VERSION_MAJOR >= 12
+  (void)DL;
+  return getUnderlyingObject(V);
+#else
+  return GetUnderlyingObject(V, DL);
+#endif
+}
+
+// the call returns a new object
+static bool isAllocation(Value *V) {
+  if (isNoAliasCall(V))
+    return true;
+  auto *CI = dyn_cast<CallInst>(V);
+  if (!CI)
+    return false;
+  auto *F = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+  if (!F)
+    return false;
+  StringRef name = F->getName();
+  return name.equals("malloc") || name.equals("calloc") ||
+         name.equals("realloc") || name.equals("alloca") ||
+         name.equals("__VERIFIER_malloc") ||
+         name.equals("__VERIFIER_malloc0") ||
+         name.equals("__VERIFIER_calloc");
+}
+
+// the internal function whose all uses are direct calls
+static bool hasOnlyDirectCalls(const Function *F) {
+  if (!F->hasLocalLinkage())
+    return false;
+  for (const Use& U : F->uses()) {
+    auto *CI = dyn_cast<CallInst>(U.getUser());
+    if (!CI || !CI->isCallee(&U))
+      return false;
+  }
+  return true;
+}
+
+// the allocation sites that ptr may point to,
+// false if we do not know them all
+bool AnnotatePointsTo::getObjects(Value *ptr, std::set<Value *>& objects) {
+  std::set<Value *> visited;
+  std::vector<Value *> worklist{ptr};
+  while (!worklist.empty()) {
+    Value *V = getUnderlying(worklist.back(), *DL);
+    worklist.pop_back();
+    if (!visited.insert(V).second)
+      continue;
+
+    if (isa<AllocaInst>(V) || isa<GlobalVariable>(V) || isAllocation(V)) {
+      objects.insert(V);
+      if (objects.size() > MaxObjects)
+        return false;
+    } else if (isa<ConstantPointerNull>(V) || isa<UndefValue>(V)) {
+      // there is no object
+    } else if (auto *phi = dyn_cast<PHINode>(V)) {
+      for (Value *in : phi->incoming_values())
+        worklist.push_back(in);
+    } else if (auto *S = dyn_cast<SelectInst>(V)) {
+      worklist.push_back(S->getTrueValue());
+      worklist.push_back(S->getFalseValue());
+    } else if (auto *A = dyn_cast<Argument>(V)) {
+      Function *F = A->getParent();
+      if (!hasOnlyDirectCalls(F))
+        return false;
+      for (User *U : F->users()) {
+        auto *CI = cast<CallInst>(U);
+#if LLVM_VERSION_MAJOR >= 8
+        if (A->getArgNo() >= CI->arg_size())
+#else
+        if (A->getArgNo() >= CI->getNumArgOperands())
+#endif
+          return false;
+        worklist.push_back(CI->getArgOperand(A->getArgNo()));
+      }
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+MDNode *AnnotatePointsTo::getSite(Value *V) {
+  LLVMContext& Ctx = V->getContext();
+  auto it = _sites.find(V);
+  unsigned id;
+  if (it != _sites.end()) {
+    id = it->second;
+  } else {
+    id = _sites.size();
+    _sites.emplace(V, id);
+  }
+  return MDNode::get(Ctx, ConstantAsMetadata::get(
+                              ConstantInt::get(Type::getInt64Ty(Ctx), id)));
+}
+
+bool AnnotatePointsTo::runOnModule(Module& M) {
+  DL = &M.getDataLayout();
+  LLVMContext& Ctx = M.getContext();
+
+  unsigned accesses = 0, annotated = 0;
+  for (Function& F : M) {
+    for (BasicBlock& B : F) {
+      for (Instruction& I : B) {
+        Value *ptr;
+        if (auto *LI = dyn_cast<LoadInst>(&I))
+          ptr = LI->getPointerOperand();
+        else if (auto *SI = dyn_cast<StoreInst>(&I))
+          ptr = SI->getPointerOperand();
+        else
+          continue;
+        ++accesses;
+
+        std::set<Value *> objects;
+        if (!getObjects(ptr, objects) || objects.empty())
+          continue;
+
+        std::vector<Metadata *> ids;
+        for (Value *O : objects) {
+          MDNode *site = getSite(O);
+          if (auto *OI = dyn_cast<Instruction>(O))
+            OI->setMetadata("sbt.alloc.site", site);
+          else
+            cast<GlobalVariable>(O)->setMetadata("sbt.alloc.site", site);
+          ids.push_back(site->getOperand(0));
+        }
+        I.setMetadata("sbt.points.to", MDNode::get(Ctx, ids));
+        ++annotated;
+      }
+    }
+  }
+
+  errs() << "Annotated " << annotated << " of " << accesses
+         << " memory accesses with points-to sets\n";
+  return annotated > 0;
+}
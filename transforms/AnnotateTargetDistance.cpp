@@ -0,0 +1,164 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Compute for every block the distance (the number of blocks on the shortest
+// path) to the nearest call of a target function in the interprocedural CFG
+// and attach it to the terminator of the block as
+//
+//   !sbt.target.distance !{i32 D}
+//
+// so that a directed searcher of the symbolic executor can prefer the states
+// that are closer to a target. The paths may enter the called functions
+// (a block with a call is one step from the entry of the callee) and return
+// from them (a returning block is one step from the successors of the blocks
+// that call the function, in any context). The blocks from which no target
+// is reachable have no metadata.
+
+#include <deque>
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+static cl::list<std::string> TargetFns("annotate-target-distance-fn",
+        cl::desc("The target functions (default: __VERIFIER_error,\n"
+                 "__INSTR_fail, __SYMBIOTIC_test_target)"),
+        cl::CommaSeparated);
+
+namespace {
+
+class AnnotateTargetDistance : public ModulePass {
+  DenseMap<const BasicBlock *, unsigned> _distance;
+  std::deque<const BasicBlock *> _queue;
+
+  // the blocks with the calls of a defined function
+  // and the blocks that return from it
+  DenseMap<const Function *, std::vector<const BasicBlock *>> _callers;
+  DenseMap<const Function *, std::vector<const BasicBlock *>> _returns;
+  // the defined functions called in a block
+  DenseMap<const BasicBlock *, std::vector<const Function *>> _callees;
+
+  void relax(const BasicBlock *B, unsigned distance);
+
+public:
+  static char ID;
+
+  AnnotateTargetDistance() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<AnnotateTargetDistance> ATD("annotate-target-distance",
+                                                "Annotate blocks with the "
+                                                "distance to the nearest "
+                                                "target");
+char AnnotateTargetDistance::ID;
+
+// all the edges have the same length, so the first visit
+// of a block (in the breadth-first order) is the shortest
+void AnnotateTargetDistance::relax(const BasicBlock *B, unsigned distance) {
+  if (_distance.count(B))
+    return;
+  _distance[B] = distance;
+  _queue.push_back(B);
+}
+
+bool AnnotateTargetDistance::runOnModule(Module& M) {
+  StringSet<> targets;
+  for (const std::string& name : TargetFns)
+    targets.insert(name);
+  if (targets.empty()) {
+    targets.insert("__VERIFIER_error");
+    targets.insert("__INSTR_fail");
+    targets.insert("__SYMBIOTIC_test_target");
+  }
+
+  for (Function& F : M) {
+    for (BasicBlock& B : F) {
+      if (isa<ReturnInst>(B.getTerminator()))
+        _returns[&F].push_back(&B);
+
+      bool target = false;
+      for (Instruction& I : B) {
+        auto *CI = dyn_cast<CallInst>(&I);
+        if (!CI)
+          continue;
+        auto *callee = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+        if (!callee)
+          continue;
+        if (targets.count(callee->getName()))
+          target = true;
+        else if (!callee->isDeclaration()) {
+          _callers[callee].push_back(&B);
+          _callees[&B].push_back(callee);
+        }
+      }
+      if (target)
+        relax(&B, 0);
+    }
+  }
+
+  if (_queue.empty())
+    return false;
+
+  // the breadth-first search backwards from the targets
+  while (!_queue.empty()) {
+    const BasicBlock *B = _queue.front();
+    _queue.pop_front();
+    unsigned next = _distance[B] + 1;
+
+    for (const BasicBlock *pred : predecessors(B)) {
+      relax(pred, next);
+      // return from the functions called in the predecessor
+      auto it = _callees.find(pred);
+      if (it == _callees.end())
+        continue;
+      for (const Function *F : it->second) {
+        auto rit = _returns.find(F);
+        if (rit != _returns.end())
+          for (const BasicBlock *R : rit->second)
+            relax(R, next);
+      }
+    }
+
+    // call of the function
+    const Function *F = B->getParent();
+    if (B == &F->getEntryBlock()) {
+      auto it = _callers.find(F);
+      if (it != _callers.end())
+        for (const BasicBlock *C : it->second)
+          relax(C, next);
+    }
+  }
+
+  LLVMContext& Ctx = M.getContext();
+  Type *i32 = Type::getInt32Ty(Ctx);
+  for (auto& it : _distance) {
+    auto *T = const_cast<Instruction *>(it.first->getTerminator());
+    T->setMetadata("sbt.target.distance",
+                   MDNode::get(Ctx, ConstantAsMetadata::get(
+                                        ConstantInt::get(i32, it.second))));
+  }
+
+  errs() << "Annotated " << _distance.size()
+         << " blocks with the distance to a target\n";
+  return true;
+}
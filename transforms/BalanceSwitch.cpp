@@ -0,0 +1,178 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Lower switch instructions to balanced binary trees of comparisons
+// (in place of -lowerswitch before slicing, the slicer does not support
+// switch). The adjacent cases with the same successor are merged into
+// ranges and a leaf of the tree checks the whole range at once, so a path
+// through a switch of n cases has O(log n) branches (and forks of the
+// symbolic executor) instead of a chain of up to n comparisons.
+// A leaf that the comparisons above it constrain to its range jumps
+// to the successor without any check.
+
+#include <algorithm>
+#include <vector>
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+namespace {
+
+// the values lo..hi (signed, inclusive) that go to dest
+struct Cluster {
+  APInt lo, hi;
+  BasicBlock *dest;
+};
+
+class BalanceSwitch : public FunctionPass {
+  // the incoming values of the phis in the successors of the switch
+  std::vector<std::pair<PHINode *, Value *>> _incoming;
+  BasicBlock *_default = nullptr;
+  Value *_cond = nullptr;
+
+  void addEdge(BasicBlock *from, BasicBlock *to);
+  void build(BasicBlock *B, const Cluster *begin, const Cluster *end,
+             const APInt& lower, const APInt& upper);
+  void lower(SwitchInst *SI);
+
+public:
+  static char ID;
+
+  BalanceSwitch() : FunctionPass(ID) {}
+
+  bool runOnFunction(Function& F) override;
+};
+
+} // namespace
+
+static RegisterPass<BalanceSwitch> BS("balance-switch",
+                                      "Lower switch instructions to balanced "
+                                      "trees of range checks");
+char BalanceSwitch::ID;
+
+void BalanceSwitch::addEdge(BasicBlock *from, BasicBlock *to) {
+  for (auto& in : _incoming) {
+    if (in.first->getParent() == to)
+      in.first->addIncoming(in.second, from);
+  }
+}
+
+// emit into B the tree that decides among the clusters,
+// the condition is known to be in lower..upper here
+void BalanceSwitch::build(BasicBlock *B, const Cluster *begin,
+                          const Cluster *end, const APInt& lower,
+                          const APInt& upper) {
+  LLVMContext& Ctx = B->getContext();
+  IRBuilder<> builder(B);
+  Type *Ty = _cond->getType();
+
+  if (end - begin == 1) {
+    const Cluster& C = *begin;
+    if (C.lo == lower && C.hi == upper) {
+      builder.CreateBr(C.dest);
+      addEdge(B, C.dest);
+      return;
+    }
+
+    Value *check;
+    if (C.lo == C.hi)
+      check = builder.CreateICmpEQ(_cond, ConstantInt::get(Ty, C.lo));
+    else if (C.lo == lower)
+      check = builder.CreateICmpSLE(_cond, ConstantInt::get(Ty, C.hi));
+    else if (C.hi == upper)
+      check = builder.CreateICmpSGE(_cond, ConstantInt::get(Ty, C.lo));
+    else
+      check = builder.CreateICmpULE(
+          builder.CreateSub(_cond, ConstantInt::get(Ty, C.lo)),
+          ConstantInt::get(Ty, C.hi - C.lo));
+    builder.CreateCondBr(check, C.dest, _default);
+    addEdge(B, C.dest);
+    addEdge(B, _default);
+    return;
+  }
+
+  const Cluster *mid = begin + (end - begin) / 2;
+  Function *F = B->getParent();
+  BasicBlock *left = BasicBlock::Create(Ctx, "NodeBlock", F);
+  BasicBlock *right = BasicBlock::Create(Ctx, "NodeBlock", F);
+  builder.CreateCondBr(builder.CreateICmpSLT(_cond,
+                                             ConstantInt::get(Ty, mid->lo)),
+                       left, right);
+  build(left, begin, mid, lower, mid->lo - 1);
+  build(right, mid, end, mid->lo, upper);
+}
+
+void BalanceSwitch::lower(SwitchInst *SI) {
+  BasicBlock *B = SI->getParent();
+  _cond = SI->getCondition();
+  _default = SI->getDefaultDest();
+
+  std::vector<Cluster> cases;
+  for (auto& C : SI->cases()) {
+    // the values of the default successor are in the gaps
+    if (C.getCaseSuccessor() != _default)
+      cases.push_back({C.getCaseValue()->getValue(),
+                       C.getCaseValue()->getValue(), C.getCaseSuccessor()});
+  }
+  std::sort(cases.begin(), cases.end(),
+            [](const Cluster& a, const Cluster& b) { return a.lo.slt(b.lo); });
+
+  std::vector<Cluster> clusters;
+  for (Cluster& C : cases) {
+    if (!clusters.empty() && clusters.back().dest == C.dest &&
+        !clusters.back().hi.isMaxSignedValue() &&
+        clusters.back().hi + 1 == C.lo)
+      clusters.back().hi = C.hi;
+    else
+      clusters.push_back(C);
+  }
+
+  // the phis get an incoming value for every new edge instead
+  _incoming.clear();
+  for (unsigned i = 0, e = SI->getNumSuccessors(); i < e; ++i) {
+    BasicBlock *succ = SI->getSuccessor(i);
+    for (PHINode& phi : succ->phis()) {
+      int idx = phi.getBasicBlockIndex(B);
+      if (idx < 0)
+        continue;
+      _incoming.emplace_back(&phi, phi.getIncomingValue(idx));
+      while ((idx = phi.getBasicBlockIndex(B)) >= 0)
+        phi.removeIncomingValue(idx, /* DeletePHIIfEmpty = */ false);
+    }
+  }
+
+  SI->eraseFromParent();
+  if (clusters.empty()) {
+    BranchInst::Create(_default, B);
+    addEdge(B, _default);
+    return;
+  }
+
+  unsigned width = _cond->getType()->getIntegerBitWidth();
+  build(B, clusters.data(), clusters.data() + clusters.size(),
+        APInt::getSignedMinValue(width), APInt::getSignedMaxValue(width));
+}
+
+bool BalanceSwitch::runOnFunction(Function& F) {
+  std::vector<SwitchInst *> switches;
+  for (BasicBlock& B : F) {
+    if (auto *SI = dyn_cast<SwitchInst>(B.getTerminator()))
+      switches.push_back(SI);
+  }
+
+  for (SwitchInst *SI : switches)
+    lower(SI);
+  return !switches.empty();
+}
@@ -0,0 +1,481 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// sbt-bench: micro-benchmarks of our passes on synthetic modules.
+//
+//   sbt-bench [-bench=name[,name...]] [-sizes=n[,n...]] [-repeat=N]
+//             [-bench-json=file.json] [options of the passes]
+//
+// Every benchmark generates modules of growing sizes (the meaning of
+// the size depends on the generator, e.g., the number of allocas
+// in a function or the depth of a loop nest), runs the pass on them
+// and prints the time, the throughput (instructions of the module before
+// the pass per second) and the empirical exponent of the scaling between
+// the consecutive sizes (the time grows like instructions^exponent,
+// so 1 is linear and 2 quadratic). The scalings with the exponent over
+// -bench-max-exponent are reported and sbt-bench exits with 2, so that
+// quadratic spots are caught the same way as failing tests.
+//
+// The time of one size is the minimum of -repeat runs, every run
+// on a freshly generated module (the time of generating is not included).
+// sbt-bench replaces the global operator new and reports also the number
+// of the heap allocations of the fastest run (also in the JSON file),
+// so that the passes can be checked to allocate little in their loops.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Pass.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+bool CloneMetadata(const llvm::Instruction *, llvm::Instruction *);
+
+// the number of the calls of operator new of the whole program
+static std::atomic<uint64_t> Allocations{0};
+
+void *operator new(size_t size) {
+    ++Allocations;
+    if (void *ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+
+static cl::list<std::string> Benchmarks("bench",
+                cl::desc("Run only these benchmarks (default: all)"),
+                cl::value_desc("name"), cl::CommaSeparated);
+
+static cl::list<unsigned> Sizes("sizes",
+                cl::desc("The sizes of the generated modules "
+                         "(default: the sizes of the benchmark)"),
+                cl::value_desc("n"), cl::CommaSeparated);
+
+static cl::opt<unsigned> Repeat("repeat",
+                cl::desc("Take the minimal time of N runs (default=3)"),
+                cl::value_desc("N"), cl::init(3));
+
+static cl::opt<double> MaxExponent("bench-max-exponent",
+                cl::desc("Report the scalings with a higher exponent "
+                         "(default=1.5)"),
+                cl::init(1.5));
+
+static cl::opt<std::string> BenchJSON("bench-json",
+                cl::desc("Write the results also into a JSON file"),
+                cl::value_desc("filename"));
+
+static cl::opt<bool> ListBenchmarks("list",
+                cl::desc("Print the names of the benchmarks and exit"),
+                cl::init(false));
+
+namespace {
+
+using Generator = std::function<void(Module&, unsigned)>;
+
+struct Benchmark {
+    std::string name;
+    std::string description;
+    Generator generate;
+    // the passes that run on the module, or (if empty) run
+    // is called instead (for the code that is not a pass)
+    std::vector<std::string> passes;
+    std::function<void(Module&)> run;
+    std::vector<unsigned> sizes;
+    // the values of options that the passes need (if they are not
+    // given on the command line)
+    std::vector<std::pair<std::string, std::string>> options;
+};
+
+struct Result {
+    std::string bench;
+    unsigned size;
+    uint64_t instructions;
+    double time; // seconds
+    uint64_t allocations; // of the fastest run
+    double exponent; // against the previous size, 0 for the first one
+};
+
+static uint64_t countInstructions(const Module& M) {
+    uint64_t n = 0;
+    for (const Function& F : M)
+        for (const BasicBlock& B : F)
+            n += B.size();
+    return n;
+}
+
+static Function *createFunction(Module& M, const std::string& name,
+                                FunctionType *FTy) {
+    return Function::Create(FTy, GlobalValue::ExternalLinkage, name, &M);
+}
+
+// 16 functions, each with n uninitialized allocas that are read
+static void genAllocas(Module& M, unsigned n) {
+    LLVMContext& Ctx = M.getContext();
+    Type *I32 = Type::getInt32Ty(Ctx);
+    auto *FTy = FunctionType::get(I32, false);
+    for (unsigned f = 0; f < 16; ++f) {
+        Function *F = createFunction(M, "fun" + std::to_string(f), FTy);
+        IRBuilder<> B(BasicBlock::Create(Ctx, "entry", F));
+        std::vector<AllocaInst *> allocas;
+        for (unsigned i = 0; i < n; ++i)
+            allocas.push_back(B.CreateAlloca(I32));
+        Value *sum = ConstantInt::get(I32, 0);
+        for (AllocaInst *AI : allocas)
+            sum = B.CreateAdd(sum, B.CreateLoad(I32, AI));
+        B.CreateRet(sum);
+    }
+}
+
+// main with a nest of n loops (in the form after -reg2mem, every loop
+// has its counter in memory), the innermost loop increments a global
+static void genLoopNest(Module& M, unsigned n) {
+    LLVMContext& Ctx = M.getContext();
+    Type *I32 = Type::getInt32Ty(Ctx);
+    auto *G = new GlobalVariable(M, I32, false, GlobalValue::ExternalLinkage,
+                                 ConstantInt::get(I32, 0), "counter");
+    Function *F = createFunction(M, "main", FunctionType::get(I32, false));
+    BasicBlock *entry = BasicBlock::Create(Ctx, "entry", F);
+    IRBuilder<> B(entry);
+
+    std::vector<AllocaInst *> counters;
+    for (unsigned i = 0; i < n; ++i)
+        counters.push_back(B.CreateAlloca(I32));
+
+    // build the loops from the outermost one, every loop jumps
+    // to its latch from the exit of the inner loop
+    BasicBlock *exit = BasicBlock::Create(Ctx, "exit", F);
+    BasicBlock *pred = entry;
+    BasicBlock *outerLatch = exit;
+    for (unsigned i = 0; i < n; ++i) {
+        BasicBlock *header = BasicBlock::Create(Ctx, "header", F);
+        BasicBlock *body = BasicBlock::Create(Ctx, "body", F);
+        BasicBlock *latch = BasicBlock::Create(Ctx, "latch", F);
+
+        B.SetInsertPoint(pred);
+        B.CreateStore(ConstantInt::get(I32, 0), counters[i]);
+        B.CreateBr(header);
+
+        B.SetInsertPoint(header);
+        Value *cmp = B.CreateICmpSLT(B.CreateLoad(I32, counters[i]),
+                                     ConstantInt::get(I32, 2));
+        B.CreateCondBr(cmp, body, outerLatch);
+
+        B.SetInsertPoint(latch);
+        B.CreateStore(B.CreateAdd(B.CreateLoad(I32, counters[i]),
+                                  ConstantInt::get(I32, 1)), counters[i]);
+        B.CreateBr(header);
+
+        pred = body;
+        outerLatch = latch;
+    }
+
+    B.SetInsertPoint(pred);
+    B.CreateStore(B.CreateAdd(B.CreateLoad(I32, G), ConstantInt::get(I32, 1)), G);
+    B.CreateBr(outerLatch);
+
+    B.SetInsertPoint(exit);
+    B.CreateRet(ConstantInt::get(I32, 0));
+}
+
+// main with one block of n instructions, only the last one
+// has a debug location
+static void genBigBlock(Module& M, unsigned n) {
+    LLVMContext& Ctx = M.getContext();
+    Type *I32 = Type::getInt32Ty(Ctx);
+    M.addModuleFlag(Module::Warning, "Debug Info Version",
+                    DEBUG_METADATA_VERSION);
+
+    DIBuilder DIB(M);
+    DIFile *file = DIB.createFile("bench.c", "/");
+    DIB.createCompileUnit(dwarf::DW_LANG_C99, file, "sbt-bench", false, "", 0);
+    auto *SP = DIB.createFunction(file, "main", "main", file, 1,
+                                  DIB.createSubroutineType(
+                                        DIB.getOrCreateTypeArray({})),
+                                  1, DINode::FlagZero,
+                                  DISubprogram::SPFlagDefinition);
+
+    Function *F = createFunction(M, "main", FunctionType::get(I32, false));
+    F->setSubprogram(SP);
+    IRBuilder<> B(BasicBlock::Create(Ctx, "entry", F));
+    AllocaInst *AI = B.CreateAlloca(I32);
+    B.CreateStore(ConstantInt::get(I32, 0), AI);
+    for (unsigned i = 0; i < n; ++i)
+        B.CreateStore(B.CreateAdd(B.CreateLoad(I32, AI, /*isVolatile=*/true),
+                                  ConstantInt::get(I32, 1)), AI);
+    ReturnInst *ret = B.CreateRet(ConstantInt::get(I32, 0));
+    ret->setDebugLoc(DILocation::get(Ctx, 2, 1, SP));
+    DIB.finalize();
+}
+
+// clone the location to a new instruction for every instruction
+// of the module (as the passes do for the instructions they insert)
+static void runCloneMetadata(Module& M) {
+    Type *I32 = Type::getInt32Ty(M.getContext());
+    Instruction *tmp = BinaryOperator::CreateAdd(ConstantInt::get(I32, 0),
+                                                 ConstantInt::get(I32, 0));
+    for (const Function& F : M)
+        for (const BasicBlock& B : F)
+            for (const Instruction& I : B)
+                CloneMetadata(&I, tmp);
+    tmp->deleteValue();
+}
+
+// main calls n undefined functions
+static void genExterns(Module& M, unsigned n) {
+    LLVMContext& Ctx = M.getContext();
+    Type *I32 = Type::getInt32Ty(Ctx);
+    auto *ExtTy = FunctionType::get(I32, {I32}, false);
+    Function *F = createFunction(M, "main", FunctionType::get(I32, false));
+    IRBuilder<> B(BasicBlock::Create(Ctx, "entry", F));
+    Value *sum = ConstantInt::get(I32, 0);
+    for (unsigned i = 0; i < n; ++i) {
+        Function *ext = createFunction(M, "ext" + std::to_string(i), ExtTy);
+        sum = B.CreateAdd(sum, B.CreateCall(ext, {sum}));
+    }
+    B.CreateRet(sum);
+}
+
+static std::vector<Benchmark> getBenchmarks() {
+    return {
+        {"initialize-uninitialized", "16 functions with n allocas",
+         genAllocas, {"initialize-uninitialized"}, nullptr,
+         {250, 500, 1000, 2000}, {}},
+        {"flatten-loops", "a nest of n loops",
+         genLoopNest, {"flatten-loops"}, nullptr,
+         {64, 128, 256, 512}, {}},
+        {"instrument-nontermination", "a nest of n loops",
+         genLoopNest, {"instrument-nontermination"}, nullptr,
+         {64, 128, 256, 512}, {}},
+        {"sbt-loop-unroll", "a nest of n loops (unrolled twice)",
+         genLoopNest, {"sbt-loop-unroll"}, nullptr,
+         {2, 3, 4, 5, 6}, {{"sbt-loop-unroll-count", "2"}}},
+        {"clone-metadata", "a block of 3n instructions",
+         genBigBlock, {}, runCloneMetadata,
+         {1000, 2000, 4000, 8000}, {}},
+        {"delete-undefined", "n calls of undefined functions",
+         genExterns, {"delete-undefined"}, nullptr,
+         {500, 1000, 2000, 4000}, {}},
+    };
+}
+
+static void setDefaultOptions(const Benchmark& bench) {
+    auto& registered = cl::getRegisteredOptions();
+    for (const auto& opt : bench.options) {
+        auto it = registered.find(opt.first);
+        if (it == registered.end()) {
+            errs() << "Unknown option -" << opt.first << "\n";
+            continue;
+        }
+        if (it->second->getNumOccurrences() == 0)
+            it->second->addOccurrence(0, opt.first, opt.second);
+    }
+}
+
+static bool runPasses(Module& M, const std::vector<std::string>& passes) {
+    legacy::PassManager MPM;
+    TargetLibraryInfoImpl TLII(Triple(M.getTargetTriple()));
+    MPM.add(new TargetLibraryInfoWrapperPass(TLII));
+
+    PassRegistry *Registry = PassRegistry::getPassRegistry();
+    for (const std::string& name : passes) {
+        const PassInfo *PI = Registry->getPassInfo(name);
+        if (!PI || !PI->getNormalCtor()) {
+            errs() << "Cannot create pass: " << name << "\n";
+            return false;
+        }
+        MPM.add(PI->createPass());
+    }
+
+    MPM.run(M);
+    return true;
+}
+
+// run the benchmark on one size, return false on an error
+static bool measure(const Benchmark& bench, unsigned size, Result& res) {
+    res.bench = bench.name;
+    res.size = size;
+    res.time = -1;
+    res.allocations = 0;
+    res.exponent = 0;
+
+    for (unsigned r = 0; r < std::max(1u, (unsigned)Repeat); ++r) {
+        LLVMContext Ctx;
+        Module M("bench", Ctx);
+        bench.generate(M, size);
+        if (verifyModule(M, &errs())) {
+            errs() << "The generated module of " << bench.name
+                   << " is broken\n";
+            return false;
+        }
+        res.instructions = countInstructions(M);
+
+        uint64_t allocs = Allocations;
+        auto start = std::chrono::steady_clock::now();
+        if (bench.passes.empty())
+            bench.run(M);
+        else if (!runPasses(M, bench.passes))
+            return false;
+        std::chrono::duration<double> elapsed
+            = std::chrono::steady_clock::now() - start;
+        allocs = Allocations - allocs;
+
+        if (res.time < 0 || elapsed.count() < res.time) {
+            res.time = elapsed.count();
+            res.allocations = allocs;
+        }
+    }
+
+    return true;
+}
+
+static bool writeJSON(const std::string& path, const std::vector<Result>& results) {
+    std::error_code EC;
+#if LLVM_VERSION_MAJOR >= 9
+    raw_fd_ostream out(path, EC, sys::fs::OF_Text);
+#else
+    raw_fd_ostream out(path, EC, sys::fs::F_Text);
+#endif
+    if (EC) {
+        errs() << "Failed opening " << path << ": " << EC.message() << "\n";
+        return false;
+    }
+
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& res = results[i];
+        out << "  {\"bench\": \"" << res.bench << "\""
+            << ", \"size\": " << res.size
+            << ", \"instructions\": " << res.instructions
+            << ", \"time\": " << format("%.6f", res.time)
+            << ", \"allocations\": " << res.allocations
+            << ", \"exponent\": " << format("%.3f", res.exponent) << "}"
+            << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+
+    return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+    llvm_shutdown_obj Y;
+
+    PassRegistry& Registry = *PassRegistry::getPassRegistry();
+    initializeCore(Registry);
+    initializeScalarOpts(Registry);
+    initializeIPO(Registry);
+    initializeAnalysis(Registry);
+    initializeTransformUtils(Registry);
+    initializeTarget(Registry);
+
+    cl::ParseCommandLineOptions(argc, argv,
+                                "micro-benchmarks of symbiotic's passes\n");
+
+    std::vector<Benchmark> benchmarks = getBenchmarks();
+    if (ListBenchmarks) {
+        for (const Benchmark& bench : benchmarks)
+            outs() << bench.name << ": " << bench.description << "\n";
+        return 0;
+    }
+
+    for (const std::string& name : Benchmarks) {
+        if (std::none_of(benchmarks.begin(), benchmarks.end(),
+                         [&name](const Benchmark& b) { return b.name == name; })) {
+            errs() << "Unknown benchmark: " << name << "\n";
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    bool superlinear = false;
+    for (const Benchmark& bench : benchmarks) {
+        if (!Benchmarks.empty() &&
+            std::find(Benchmarks.begin(), Benchmarks.end(), bench.name)
+                == Benchmarks.end())
+            continue;
+
+        setDefaultOptions(bench);
+        outs() << bench.name << " (" << bench.description << ")\n";
+        outs() << "      size instructions    time [ms]        instr/s  exponent"
+                  "  allocations\n";
+
+        std::vector<unsigned> sizes(Sizes.begin(), Sizes.end());
+        if (sizes.empty())
+            sizes = bench.sizes;
+
+        // (an index, the vector may reallocate)
+        size_t prev = results.size();
+        for (unsigned size : sizes) {
+            Result res;
+            if (!measure(bench, size, res))
+                return 1;
+
+            // the exponent of the scaling from the previous size,
+            // the times under a millisecond are mostly noise
+            if (prev < results.size() &&
+                res.instructions > results[prev].instructions &&
+                results[prev].time > 1e-3)
+                res.exponent = std::log(res.time / results[prev].time) /
+                               std::log((double)res.instructions /
+                                        results[prev].instructions);
+
+            outs() << format("  %8u %12llu %12.3f %14.0f %9.2f %12llu",
+                             res.size, (unsigned long long)res.instructions,
+                             res.time * 1000,
+                             res.time > 0 ? res.instructions / res.time : 0.0,
+                             res.exponent,
+                             (unsigned long long)res.allocations);
+            if (res.exponent > MaxExponent) {
+                outs() << "  superlinear!";
+                superlinear = true;
+            }
+            outs() << "\n";
+
+            prev = results.size();
+            results.push_back(res);
+        }
+    }
+
+    if (!BenchJSON.empty() && !writeJSON(BenchJSON, results))
+        return 1;
+
+    return superlinear ? 2 : 0;
+}
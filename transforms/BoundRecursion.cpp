@@ -0,0 +1,152 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Bound the depth of recursion (the counterpart of -sbt-loop-unroll for
+// recursive functions). Every recursive SCC of the call graph gets a global
+// counter of the active calls of its functions: the entry of a function
+// of the SCC increments it, the returns decrement it and the paths that
+// would have more than N active calls are terminated by
+//
+//   __VERIFIER_assume(0)
+//
+// like the paths that exceed the unrolling count of -sbt-loop-unroll-terminate.
+// The calls through pointers are not in the call graph, so the recursions
+// through them are not bounded.
+
+#include <vector>
+
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned> RecursionBound("sbt-recursion-bound-count",
+                                        cl::desc("The maximal number of active "
+                                                 "calls of the functions of "
+                                                 "a recursive SCC"),
+                                        cl::value_desc("N"), cl::init(0));
+
+bool CloneMetadata(const llvm::Instruction *, llvm::Instruction *);
+
+namespace {
+
+class BoundRecursion : public ModulePass {
+  void bound(Function *F, GlobalVariable *depth);
+
+public:
+  static char ID;
+
+  BoundRecursion() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<BoundRecursion> BR("sbt-recursion-bound",
+                                       "Bound the depth of recursion");
+char BoundRecursion::ID;
+
+static bool isRecursive(const std::vector<CallGraphNode *>& SCC) {
+  if (SCC.size() > 1)
+    return true;
+  CallGraphNode *N = SCC.front();
+  for (auto& callee : *N) {
+    if (callee.second == N)
+      return true;
+  }
+  return false;
+}
+
+void BoundRecursion::bound(Function *F, GlobalVariable *depth) {
+  Module *M = F->getParent();
+  LLVMContext& Ctx = M->getContext();
+  Type *I32 = Type::getInt32Ty(Ctx);
+
+  // keep the allocas in the entry block
+  BasicBlock& entry = F->getEntryBlock();
+  auto pos = entry.begin();
+  while (isa<AllocaInst>(&*pos))
+    ++pos;
+  BasicBlock *body = entry.splitBasicBlock(pos, "recursion.body");
+
+  // the contents of the block is:
+  //  __VERIFIER_assume(0)
+  //  unreachable
+  BasicBlock *term = BasicBlock::Create(Ctx, "recursion.term", F);
+  auto assume = insertFunction(*M, "__VERIFIER_assume",
+                               Type::getVoidTy(Ctx), {I32});
+  auto *CI = CallInst::Create(assume, {ConstantInt::get(I32, 0)}, "", term);
+  new UnreachableInst(Ctx, term);
+  // some passes would consider the module broken without the metadata
+  CloneMetadata(&*body->begin(), CI);
+
+  entry.getTerminator()->eraseFromParent();
+  IRBuilder<> B(&entry);
+  Value *cur = B.CreateLoad(I32, depth);
+  B.CreateCondBr(B.CreateICmpUGE(cur, ConstantInt::get(I32, RecursionBound)),
+                 term, body);
+  IRBuilder<> inc(&*body->getFirstInsertionPt());
+  inc.CreateStore(inc.CreateAdd(cur, ConstantInt::get(I32, 1)), depth);
+
+  for (BasicBlock& BB : *F) {
+    if (auto *RI = dyn_cast<ReturnInst>(BB.getTerminator())) {
+      IRBuilder<> R(RI);
+      R.CreateStore(R.CreateSub(R.CreateLoad(I32, depth),
+                                ConstantInt::get(I32, 1)),
+                    depth);
+    }
+  }
+}
+
+bool BoundRecursion::runOnModule(Module& M) {
+  if (RecursionBound == 0) {
+    errs() << "No bound on recursion given (-sbt-recursion-bound-count)\n";
+    return false;
+  }
+
+  // collect the SCCs first, the iterator must not see the changes
+  std::vector<std::vector<Function *>> sccs;
+  CallGraph CG(M);
+  for (auto I = scc_begin(&CG); !I.isAtEnd(); ++I) {
+    if (!isRecursive(*I))
+      continue;
+    std::vector<Function *> funs;
+    for (CallGraphNode *N : *I) {
+      Function *F = N->getFunction();
+      if (F && !F->isDeclaration())
+        funs.push_back(F);
+    }
+    if (!funs.empty())
+      sccs.push_back(std::move(funs));
+  }
+
+  Type *I32 = Type::getInt32Ty(M.getContext());
+  for (auto& funs : sccs) {
+    auto *depth = new GlobalVariable(M, I32, /* isConstant = */ false,
+                                     GlobalValue::InternalLinkage,
+                                     ConstantInt::get(I32, 0),
+                                     "__sbt_recursion_depth");
+    for (Function *F : funs)
+      bound(F, depth);
+  }
+
+  if (!sccs.empty())
+    errs() << "Bounded the recursion of " << sccs.size()
+           << " SCCs to depth " << RecursionBound << "\n";
+  return !sccs.empty();
+}
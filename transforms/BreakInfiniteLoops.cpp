@@ -93,7 +93,10 @@ class BreakInfiniteLoops : public LoopPass {
         // except there will be an edge exiting the loop, which is what
         // we need.
         BasicBlock *exitBB = getExitBB(header->getParent());
-        BasicBlock *nb = BasicBlock::Create(Ctx, "break.inf.loop");
+        // insert the new block before header (it must be in the function
+        // before we create the load, it needs the data layout of the module)
+        BasicBlock *nb = BasicBlock::Create(Ctx, "break.inf.loop",
+                                            header->getParent(), header);
 
         GlobalVariable * gv = getConstantTrueGV(*M);
         LoadInst *LI = new LoadInst(
@@ -113,8 +116,12 @@ class BreakInfiniteLoops : public LoopPass {
                          << *Br << "\n";
         }
 
-        // insert the new block before header
-        nb->insertInto(header->getParent(), header);
+        // all the predecessors of the header become predecessors of the
+        // new block, so move the PHI nodes there (the new block dominates
+        // the header, so all the uses stay dominated by the PHI nodes)
+        while (auto PHI = dyn_cast<PHINode>(&header->front())) {
+          PHI->moveBefore(&nb->front());
+        }
 
         // now change the jump instructions
         for (auto& pr : to_change) {
@@ -13,6 +13,7 @@
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/raw_os_ostream.h"
 
 using namespace llvm;
@@ -21,12 +22,23 @@ static cl::opt<std::string> detect_calls("detect-calls",
                                          cl::desc("Detect calls to functions"),
                                          cl::value_desc("function name"));
 
-
+static cl::opt<std::string> summary_output("check-module-summary",
+                cl::desc("Store the summary of the features that decide "
+                         "which verifier to use (threads, atomics, calls "
+                         "via pointers, floats) into a JSON file"),
+                cl::value_desc("file"));
 
 class CheckModule : public ModulePass {
   bool has_pointer_call = false;
   bool detected_call = false;
 
+  // the summary for -check-module-summary
+  unsigned pthread_calls{0}, verifier_atomic_calls{0}, atomics{0},
+           pointer_calls{0}, float_ops{0};
+
+  void summarize(const Instruction& I);
+  void writeSummary() const;
+
 public:
   static char ID;
 
@@ -42,6 +54,14 @@ static RegisterPass<CheckModule> DLTU("check-module",
 char CheckModule::ID;
 
 bool CheckModule::runOnModule(Module& M) {
+  if (!summary_output.empty()) {
+    for (auto& F : M)
+      for (auto& B : F)
+        for (auto& I : B)
+          summarize(I);
+    writeSummary();
+  }
+
   if (!detect_calls.empty()) {
     if (!M.getFunction(detect_calls)) {
       // the function is not even declared in the module,
@@ -84,3 +104,57 @@ void CheckModule::runOnFunction(Function &F)
   }
 }
 
+
+static bool isFloat(const Instruction& I) {
+  if (I.getType()->isFloatingPointTy())
+    return true;
+  for (const Value *op : I.operands())
+    if (op->getType()->isFloatingPointTy())
+      return true;
+  return false;
+}
+
+void CheckModule::summarize(const Instruction& I) {
+  if (auto *CI = dyn_cast<CallInst>(&I)) {
+    if (CI->isInlineAsm())
+      return;
+    auto F = CI->getCalledFunction();
+    if (!F) {
+      ++pointer_calls;
+      return;
+    }
+
+    auto name = F->getName();
+    if (name.startswith("pthread_"))
+      ++pthread_calls;
+    else if (name.startswith("__VERIFIER_atomic"))
+      ++verifier_atomic_calls;
+    return;
+  }
+
+  if (I.isAtomic())
+    ++atomics;
+  else if (isFloat(I))
+    ++float_ops;
+}
+
+void CheckModule::writeSummary() const {
+  std::error_code EC;
+#if LLVM_VERSION_MAJOR >= 9
+  raw_fd_ostream out(summary_output, EC, sys::fs::OF_Text);
+#else
+  raw_fd_ostream out(summary_output, EC, sys::fs::F_Text);
+#endif
+  if (EC) {
+    errs() << "Failed opening " << summary_output << ": "
+           << EC.message() << "\n";
+    return;
+  }
+
+  out << "{\"version\": 1"
+      << ", \"pthread_calls\": " << pthread_calls
+      << ", \"verifier_atomic_calls\": " << verifier_atomic_calls
+      << ", \"atomics\": " << atomics
+      << ", \"pointer_calls\": " << pointer_calls
+      << ", \"float_ops\": " << float_ops << "}\n";
+}
@@ -10,105 +10,334 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/Type.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
+#include "Compat.h"
+#include "LoopSummary.h"
+
 using namespace llvm;
 
+static cl::opt<std::string> json_output("classify-instructions-json",
+        cl::desc("Store the features of the module into the given file (JSON)"),
+        cl::value_desc("filename"));
+
 namespace {
-  class ClassifyInstr : public FunctionPass {
-      bool stack_array{false};
-      bool stack_var_array{false};
-      bool has_malloc{false}, has_calloc{false},
-           has_realloc{false}, has_big_malloc{false},
-           has_var_malloc{false};
-      bool bit_shift{false}, bit_logic{false};
-
-      void classifyInstruction(Instruction& I) {
-        if (auto AI = dyn_cast<AllocaInst>(&I)) {
-          if (AI->isArrayAllocation()) {
-              stack_array = true;
-              stack_var_array = true;
-          }
-          if (AI->getAllocatedType()->isArrayTy()) {
-              stack_array = true;
-          }
-        } else if (auto CI = dyn_cast<CallInst>(&I)) {
+  // The features of a module that are written by -classify-instructions-json.
+  // Increase the version whenever the meaning of some field changes
+  // (adding new fields is fine).
+  struct InstrFeatures {
+      static const unsigned version = 1;
+
+      // counts of instructions per opcode class
+      unsigned instructions{0};
+      unsigned int_arith{0}, float_arith{0}, bit_logic{0}, bit_shift{0},
+               cmp{0}, float_cmp{0}, casts{0}, float_casts{0},
+               loads{0}, stores{0}, allocas{0}, geps{0}, atomics{0},
+               calls{0}, indirect_calls{0}, branches{0}, switches{0},
+               phis{0}, selects{0}, other{0};
+
+      // memory
+      unsigned stack_arrays{0}, stack_var_arrays{0},
+               mallocs{0}, big_malloc{0}, var_malloc{0},
+               callocs{0}, reallocs{0}, frees{0};
+
+      // calls of interest
+      unsigned pthread_calls{0}, verifier_nondet_calls{0},
+               verifier_atomic_calls{0};
+
+      // the size of the module
+      unsigned functions{0}, defined_functions{0}, blocks{0}, globals{0};
+
+      void classifyCall(CallInst *CI);
+      void classifyInstruction(Instruction& I);
+      void writeJSON(raw_ostream& out, const LoopSummary& loops) const;
+  };
+}
+
+// does the opcode work with floating-point values?
+static bool isFloatOperation(const Instruction& I) {
+    if (I.getType()->isFPOrFPVectorTy())
+        return true;
+    for (const Value *op : I.operands()) {
+        if (op->getType()->isFPOrFPVectorTy())
+            return true;
+    }
+    return false;
+}
+
+void InstrFeatures::classifyCall(CallInst *CI) {
+    ++calls;
+
+    auto CV = calleeOf(CI)->stripPointerCasts();
+    auto F = dyn_cast<Function>(CV);
+    if (!F) {
+        ++indirect_calls;
+        return;
+    }
+
+    const auto& name = F->getName();
+    if (name.equals("malloc")) {
+        ++mallocs;
+        if (auto C = dyn_cast<ConstantInt>(CI->getOperand(0))) {
+            if (C->getZExtValue() > 8)
+                ++big_malloc;
+        } else
+            ++var_malloc;
+    } else if (name.equals("calloc"))
+        ++callocs;
+    else if (name.equals("realloc"))
+        ++reallocs;
+    else if (name.equals("free"))
+        ++frees;
+    else if (name.equals("alloca"))
+        ++stack_var_arrays;
+    else if (name.startswith("pthread_"))
+        ++pthread_calls;
+    else if (name.startswith("__VERIFIER_nondet_"))
+        ++verifier_nondet_calls;
+    else if (name.startswith("__VERIFIER_atomic"))
+        ++verifier_atomic_calls;
+}
+
+void InstrFeatures::classifyInstruction(Instruction& I) {
+    // debugging intrinsics are not a part of the program
+    if (isa<DbgInfoIntrinsic>(&I))
+        return;
+
+    ++instructions;
+
+    if (auto AI = dyn_cast<AllocaInst>(&I)) {
+        ++allocas;
+        if (AI->isArrayAllocation()) {
+            ++stack_arrays;
+            ++stack_var_arrays;
+        } else if (AI->getAllocatedType()->isArrayTy()) {
+            ++stack_arrays;
+        }
+        return;
+    }
+
+    if (auto CI = dyn_cast<CallInst>(&I)) {
+        classifyCall(CI);
+        return;
+    }
+
+    if (I.isBinaryOp()) {
+        switch (I.getOpcode()) {
+          case Instruction::And:
+          case Instruction::Or:
+          case Instruction::Xor:
+            ++bit_logic;
+            break;
+          case Instruction::Shl:
+          case Instruction::AShr:
+          case Instruction::LShr:
+            ++bit_shift;
+            break;
+          default:
+            if (isFloatOperation(I))
+                ++float_arith;
+            else
+                ++int_arith;
+        }
+        return;
+    }
+
+    if (I.isCast()) {
+        ++casts;
+        if (isFloatOperation(I))
+            ++float_casts;
+        return;
+    }
+
+    switch (I.getOpcode()) {
+      case Instruction::ICmp:
+        ++cmp;
+        break;
+      case Instruction::FCmp:
+        ++cmp;
+        ++float_cmp;
+        break;
 #if LLVM_VERSION_MAJOR >= 8
-            auto CV = CI->getCalledOperand()->stripPointerCasts();
-#else
-            auto CV = CI->getCalledValue()->stripPointerCasts();
+      case Instruction::FNeg:
+        ++float_arith;
+        break;
 #endif
-            if (CV) {
-                const auto& name = cast<Function>(CV)->getName();
-                if (name.equals("malloc")) {
-                    has_malloc = true;
-                    if (auto C = dyn_cast<ConstantInt>(CI->getOperand(0))) {
-                        if (C->getZExtValue() > 8)
-                            has_big_malloc = true;
-                    } else
-                        has_var_malloc = true;
-                } else if (name.equals("calloc"))
-                    has_calloc = true;
-                else if (name.equals("realloc"))
-                    has_realloc = true;
-                else if (name.equals("alloca"))
-                    stack_var_array = true;
-            }
-        } else {
-          switch (I.getOpcode()) {
-            case Instruction::And:
-            case Instruction::Or:
-            case Instruction::Xor:
-              bit_logic = true;
-              break;
-            case Instruction::Shl:
-            case Instruction::AShr:
-            case Instruction::LShr:
-              bit_shift = true;
-          }
-        }
+      case Instruction::Load:
+        ++loads;
+        if (cast<LoadInst>(I).isAtomic())
+            ++atomics;
+        break;
+      case Instruction::Store:
+        ++stores;
+        if (cast<StoreInst>(I).isAtomic())
+            ++atomics;
+        break;
+      case Instruction::GetElementPtr:
+        ++geps;
+        break;
+      case Instruction::AtomicCmpXchg:
+      case Instruction::AtomicRMW:
+      case Instruction::Fence:
+        ++atomics;
+        break;
+      case Instruction::Invoke:
+        ++calls;
+        break;
+      case Instruction::Br:
+        ++branches;
+        break;
+      case Instruction::Switch:
+      case Instruction::IndirectBr:
+        ++switches;
+        break;
+      case Instruction::PHI:
+        ++phis;
+        break;
+      case Instruction::Select:
+        ++selects;
+        break;
+      default:
+        ++other;
+    }
+}
 
-      }
+void InstrFeatures::writeJSON(raw_ostream& out, const LoopSummary& L) const {
+    // keep the order of the fields stable, so that the files can be compared
+    out << "{\n"
+        << "  \"version\": " << version << ",\n"
+        << "  \"size\": {"
+        << "\"functions\": " << functions
+        << ", \"defined_functions\": " << defined_functions
+        << ", \"blocks\": " << blocks
+        << ", \"globals\": " << globals
+        << ", \"instructions\": " << instructions << "},\n"
+        << "  \"opcodes\": {"
+        << "\"int_arith\": " << int_arith
+        << ", \"float_arith\": " << float_arith
+        << ", \"bit_logic\": " << bit_logic
+        << ", \"bit_shift\": " << bit_shift
+        << ", \"cmp\": " << cmp
+        << ", \"float_cmp\": " << float_cmp
+        << ", \"casts\": " << casts
+        << ", \"float_casts\": " << float_casts
+        << ", \"loads\": " << loads
+        << ", \"stores\": " << stores
+        << ", \"allocas\": " << allocas
+        << ", \"geps\": " << geps
+        << ", \"atomics\": " << atomics
+        << ", \"calls\": " << calls
+        << ", \"indirect_calls\": " << indirect_calls
+        << ", \"branches\": " << branches
+        << ", \"switches\": " << switches
+        << ", \"phis\": " << phis
+        << ", \"selects\": " << selects
+        << ", \"other\": " << other << "},\n"
+        << "  \"memory\": {"
+        << "\"stack_arrays\": " << stack_arrays
+        << ", \"stack_var_arrays\": " << stack_var_arrays
+        << ", \"malloc\": " << mallocs
+        << ", \"big_malloc\": " << big_malloc
+        << ", \"var_malloc\": " << var_malloc
+        << ", \"calloc\": " << callocs
+        << ", \"realloc\": " << reallocs
+        << ", \"free\": " << frees << "},\n"
+        << "  \"float\": " << ((float_arith + float_cmp + float_casts) > 0
+                                 ? "true" : "false") << ",\n"
+        << "  \"threads\": {"
+        << "\"pthread_calls\": " << pthread_calls
+        << ", \"verifier_atomic_calls\": " << verifier_atomic_calls
+        << ", \"atomics\": " << atomics << "},\n"
+        << "  \"nondet_calls\": " << verifier_nondet_calls << ",\n"
+        << "  \"loops\": ";
+    L.writeJSON(out);
+    out << "}\n";
+}
+
+namespace {
+  class ClassifyInstr : public ModulePass {
+      InstrFeatures features;
 
     public:
       static char ID;
 
-      ClassifyInstr() : FunctionPass(ID) {}
+      ClassifyInstr() : ModulePass(ID) {}
+
+      void getAnalysisUsage(AnalysisUsage &AU) const override {
+        AU.setPreservesAll();
+      }
+
+      bool runOnModule(Module& M) override {
+        for (auto& G : M.globals()) {
+          (void)G;
+          ++features.globals;
+        }
 
-      bool runOnFunction(Function &F) override {
-        for (auto& B : F) {
-          for (auto& I : B) {
-            classifyInstruction(I);
+        for (auto& F : M) {
+          ++features.functions;
+          if (F.isDeclaration())
+            continue;
+
+          ++features.defined_functions;
+          for (auto& B : F) {
+            ++features.blocks;
+            for (auto& I : B) {
+              features.classifyInstruction(I);
+            }
           }
         }
+
+        print();
+
+        if (!json_output.empty())
+          writeJSON(M);
+
         return false;
       }
 
-      bool doFinalization(Module&) override {
-        if (stack_array)
+      void print() const {
+        const InstrFeatures& f = features;
+        if (f.stack_arrays > 0)
             llvm::errs() << "array on stack\n";
-        if (stack_var_array)
+        if (f.stack_var_arrays > 0)
             llvm::errs() << "alloca or variable-length array\n";
-        if (has_malloc) {
+        if (f.mallocs > 0) {
           llvm::errs() << "calls malloc\n";
-          if (has_big_malloc)
+          if (f.big_malloc > 0)
             llvm::errs() << "  > 8b malloc\n";
-          if (has_var_malloc)
+          if (f.var_malloc > 0)
             llvm::errs() << "  var-sized malloc\n";
         }
-        if (has_calloc)
+        if (f.callocs > 0)
             llvm::errs() << "calls calloc\n";
-        if (has_realloc)
+        if (f.reallocs > 0)
             llvm::errs() << "calls reelloc\n";
-        if (bit_logic)
+        if (f.bit_logic > 0)
             llvm::errs() << "bit-wise operations\n";
-        if (bit_shift)
+        if (f.bit_shift > 0)
             llvm::errs() << "bit-shift operations\n";
-        return false;
+      }
+
+      void writeJSON(Module& M) const {
+        std::error_code EC;
+#if LLVM_VERSION_MAJOR >= 9
+        raw_fd_ostream out(json_output, EC, sys::fs::OF_Text);
+#else
+        raw_fd_ostream out(json_output, EC, sys::fs::F_Text);
+#endif
+        if (EC) {
+          errs() << "Failed opening " << json_output << ": "
+                 << EC.message() << "\n";
+          return;
+        }
+        features.writeJSON(out, LoopSummary::compute(M));
       }
   };
 }
@@ -116,4 +345,3 @@ namespace {
 static RegisterPass<ClassifyInstr> CI("classify-instructions",
                                       "Print statistics from module");
 char ClassifyInstr::ID;
-
@@ -3,84 +3,133 @@
 // This file is distributed under the University of Illinois Open Source
 // License. See LICENSE.TXT for details.
 
-#include <vector>
-
-#include "llvm/IR/DataLayout.h"
-#include "llvm/IR/BasicBlock.h"
-#include "llvm/IR/Constants.h"
-#include "llvm/IR/Function.h"
-#include "llvm/IR/GlobalVariable.h"
-#include "llvm/IR/Instructions.h"
+#include <algorithm>
+
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
-#include "llvm/IR/Type.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/raw_ostream.h"
-#include "llvm/Transforms/Utils/BasicBlockUtils.h"
-
-// for checking irreducibility
-#include "llvm/Analysis/LoopIterator.h"
-#include "llvm/Analysis/CFG.h"
 
-#include "llvm/Analysis/LoopInfo.h"
-#include "llvm/Analysis/LoopPass.h"
+#include "LoopSummary.h"
 
 using namespace llvm;
 
-class ClassifyLoops : public LoopPass {
-   bool any{false};
-   bool nested{false};
-   bool nonterm{false};
-   bool irreducible{false};
+static cl::opt<std::string> json_output("classify-loops-json",
+        cl::desc("Store the classification of loops into the given file (JSON)"),
+        cl::value_desc("filename"));
+
+static cl::opt<std::string> lines_output("classify-loops-lines",
+        cl::desc("Store the source lines of every loop into the given\n"
+                 "file (JSON), e.g., to map profiles of verifiers to loops"),
+        cl::value_desc("filename"));
+
+static void writeJSONString(raw_ostream& out, StringRef str) {
+    out << '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            out << '\\';
+        out << c;
+    }
+    out << '"';
+}
+
+// write the function, the file and the first and the last line
+// of every loop that has some debug locations
+static bool writeLoopLines(Module& M, const std::string& path) {
+    std::error_code EC;
+#if LLVM_VERSION_MAJOR >= 9
+    raw_fd_ostream out(path, EC, sys::fs::OF_Text);
+#else
+    raw_fd_ostream out(path, EC, sys::fs::F_Text);
+#endif
+    if (EC) {
+        errs() << "Failed opening " << path << ": " << EC.message() << "\n";
+        return false;
+    }
 
+    bool first = true;
+    out << "[\n";
+    for (Function& F : M) {
+        if (F.isDeclaration())
+            continue;
+
+        DominatorTree DT(F);
+        LoopInfo LI(DT);
+        for (Loop *L : LI.getLoopsInPreorder()) {
+            const DILocation *any = nullptr;
+            unsigned lo = ~0u, hi = 0;
+            for (BasicBlock *B : L->getBlocks()) {
+                for (Instruction& I : *B) {
+                    const DILocation *Loc = I.getDebugLoc().get();
+                    // (the inlined code belongs to other lines)
+                    if (!Loc || Loc->getLine() == 0 || Loc->getInlinedAt())
+                        continue;
+                    any = Loc;
+                    lo = std::min(lo, Loc->getLine());
+                    hi = std::max(hi, Loc->getLine());
+                }
+            }
+            if (!any)
+                continue;
+
+            out << (first ? "  " : ",\n  ") << "{\"function\": ";
+            writeJSONString(out, F.getName());
+            out << ", \"file\": ";
+            writeJSONString(out, any->getFilename());
+            out << ", \"first\": " << lo << ", \"last\": " << hi
+                << ", \"depth\": " << L->getLoopDepth() << "}";
+            first = false;
+        }
+    }
+    out << "\n]\n";
+
+    return true;
+}
+
+class ClassifyLoops : public ModulePass {
    public:
     static char ID;
 
-    ClassifyLoops() : LoopPass(ID) {}
+    ClassifyLoops() : ModulePass(ID) {}
 
     void getAnalysisUsage(AnalysisUsage &AU) const override {
-      AU.setPreservesCFG();
-      AU.addRequired<LoopInfoWrapperPass>();
+      AU.setPreservesAll();
     }
 
-    bool runOnLoop(Loop *L, LPPassManager & /*LPM*/) override {
-      any = true;
-
-      // for now, we detect only nested loops
-      if (L->getParentLoop()) {
-          nested = true;
-      }
+    bool runOnModule(Module& M) override {
+      LoopSummary summary = LoopSummary::compute(M);
 
-      if (!nonterm) {
-        SmallVector<llvm::BasicBlock *, 8> ExitBlocks;
-        L->getExitBlocks(ExitBlocks);
-        if (ExitBlocks.size() == 0) {
-          nonterm = true;
-        }
+      if (summary.loops > 0) {
+          llvm::errs() << "contains loops\n";
+          if (summary.nested())
+              llvm::errs() << "  nested loops\n";
+          if (summary.nonterm > 0)
+              llvm::errs() << "  nonterm loops\n";
+          if (summary.irreducible)
+              llvm::errs() << "  irreducible loops\n";
       }
 
-      if (!irreducible) {
-#if LLVM_VERSION_MAJOR > 6
-        // XXX: hmm, not sure this is working...
-        LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
-        LoopBlocksRPO RPOT(L);
-        RPOT.perform(&LI);
-        irreducible = containsIrreducibleCFG<const BasicBlock *>(RPOT, LI);
+      if (!json_output.empty()) {
+        std::error_code EC;
+#if LLVM_VERSION_MAJOR >= 9
+        raw_fd_ostream out(json_output, EC, sys::fs::OF_Text);
+#else
+        raw_fd_ostream out(json_output, EC, sys::fs::F_Text);
 #endif
+        if (EC) {
+          errs() << "Failed opening " << json_output << ": "
+                 << EC.message() << "\n";
+          return false;
+        }
+        summary.writeJSON(out);
       }
 
-      return false;
-    }
+      if (!lines_output.empty())
+        writeLoopLines(M, lines_output);
 
-    bool doFinalization() override {
-      if (any) {
-          llvm::errs() << "contains loops\n";
-          if (nested)
-              llvm::errs() << "  nested loops\n";
-          if (nonterm)
-              llvm::errs() << "  nonterm loops\n";
-          if (irreducible)
-              llvm::errs() << "  irreducible loops\n";
-      }
       return false;
     }
 };
@@ -88,4 +137,3 @@ class ClassifyLoops : public LoopPass {
 static RegisterPass<ClassifyLoops> CL("classify-loops",
                                       "detect what loops are in the program");
 char ClassifyLoops::ID;
-
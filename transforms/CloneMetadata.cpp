@@ -4,6 +4,8 @@
 // License. See LICENSE.TXT for details.
 
 #include <cassert>
+#include <set>
+
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/Support/raw_ostream.h"
@@ -11,53 +13,70 @@
 
 using namespace llvm;
 
+// the debug location of the closest instruction in the block,
+// we prefer the one after I, then the one before I
+static const llvm::Instruction *getClosestWithLoc(const llvm::Instruction *I)
+{
+    for (auto *Next = I->getNextNode(); Next; Next = Next->getNextNode()) {
+        if (Next->getDebugLoc())
+            return Next;
+    }
+
+    for (auto *Prev = I->getPrevNode(); Prev; Prev = Prev->getPrevNode()) {
+        if (Prev->getDebugLoc())
+            return Prev;
+    }
+
+    return nullptr;
+}
+
 /** Clone metadata from one instruction to another.
  * If i1 does not contain any metadata, then the instruction
  * that is closest to i1 is picked (we prefer the one that is after
  * and if there is none, then use the closest one before).
  *
+ * The search goes from i1 outwards, so the cost depends on the distance
+ * to the closest location, not on the size of the block. In functions
+ * without debugging information there is nothing to search for.
+ *
  * @param i1 the first instruction
  * @param i2 the second instruction without any metadata
  */
 bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2)
 {
-    if (i1->hasMetadata()) {
+    if (i1->getDebugLoc()) {
         i2->setDebugLoc(i1->getDebugLoc());
         return true;
     }
 
-    const llvm::Instruction *metadataI = nullptr;
-    bool after = false;
-    for (const llvm::Instruction& I : *i1->getParent()) {
-        if (&I == i1) {
-            after = true;
-            continue;
-        }
-
-        if (I.hasMetadata()) {
-            // store every "last" instruction with metadata,
-            // so that in the case that we won't find anything
-            // after i1, we can use metadata that are the closest
-            // "before" i1
-            metadataI = &I;
-            if (after)
-                break;
-        }
+    const llvm::BasicBlock *B = i1->getParent();
+    auto SP = B->getParent()->getSubprogram();
+    // only functions with a subprogram can have debug locations
+    if (!SP) {
+        i2->setDebugLoc(DebugLoc());
+        return false;
+    }
+
+    const llvm::Instruction *metadataI = getClosestWithLoc(i1);
+
+    // go through unique predecessors (there may be a cycle of them
+    // in unreachable code)
+    std::set<const llvm::BasicBlock *> visited{B};
+    while (!metadataI) {
+        B = B->getUniquePredecessor();
+        if (!B || !visited.insert(B).second)
+            break;
+
+        const llvm::Instruction *T = B->getTerminator();
+        metadataI = T->getDebugLoc() ? T : getClosestWithLoc(T);
     }
 
     //assert(metadataI && "Did not find dbg in any instruction of a block");
     if (metadataI) {
         i2->setDebugLoc(metadataI->getDebugLoc());
-    } else if (auto pred = i1->getParent()->getUniquePredecessor()) {
-        return CloneMetadata(pred->getTerminator(), i2);
     } else {
-      DebugLoc DL;
-      if (auto SP = i1->getParent()->getParent()->getSubprogram()) {
-        DL = DILocation::get(SP->getContext(), SP->getScopeLine(), 0, SP);
-      }
-      i2->setDebugLoc(DL);
+      i2->setDebugLoc(DILocation::get(SP->getContext(), SP->getScopeLine(), 0, SP));
     }
 
-    return i2->hasMetadata();
+    return true;
 }
-
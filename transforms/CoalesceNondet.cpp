@@ -0,0 +1,207 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Create the nondeterministic values of the __VERIFIER_nondet_* calls
+// of integer types that follow each other in a block (there are no other
+// calls between them) in one symbolic buffer, instead of a symbolic object
+// for every call. The buffer is made nondeterministic at the first call
+// and every call is replaced by a load of its part of the buffer, so KLEE
+// resolves and stores one object instead of many.
+//
+// The name of the buffer lists the parts, so that the tests and the
+// witnesses can be split back into the values of the calls:
+//
+//   __nondet_buffer|function:variable:line:column:size:kind|...
+//
+// where kind is 's' (signed), 'u' (unsigned) or 'b' (_Bool, any value
+// of the byte but 0 is true), see split_objects in testcases.py.
+// All the integer nondet calls are replaced, also the ones that are alone
+// in their block, so that the order of the values in a test is the order
+// of the calls.
+
+#include <string>
+#include <vector>
+
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+#include "NondetBuilder.h"
+
+using namespace llvm;
+
+namespace {
+
+class CoalesceNondet : public ModulePass {
+  std::unique_ptr<NondetBuilder> _nondet;
+
+  void coalesce(Module& M, const std::vector<CallInst *>& calls);
+
+public:
+  static char ID;
+
+  CoalesceNondet() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<CoalesceNondet> CN("coalesce-nondet",
+                                       "Create the nondeterministic values "
+                                       "of a block in one symbolic buffer");
+char CoalesceNondet::ID;
+
+static bool isNondetCall(const Instruction& I) {
+  auto *CI = dyn_cast<CallInst>(&I);
+  // (the only operand is the called function)
+  if (!CI || CI->isInlineAsm() || !CI->getType()->isIntegerTy() ||
+      CI->getNumOperands() != 1)
+    return false;
+
+  auto *callee = CI->getCalledFunction();
+  return callee && callee->isDeclaration() &&
+         callee->getName().startswith("__VERIFIER_nondet_");
+}
+
+static const char *getKind(const CallInst *CI) {
+  if (CI->getType()->isIntegerTy(1))
+    return "b";
+  StringRef type = CI->getCalledFunction()->getName()
+                     .substr(sizeof("__VERIFIER_nondet_") - 1);
+  if (type.startswith("u") || type == "size_t")
+    return "u";
+  return "s";
+}
+
+// the name of the source variable that gets the value of the call
+static std::string getVariable(CallInst *CI) {
+  SmallVector<DbgValueInst *, 2> values;
+  findDbgValues(values, CI);
+  for (DbgValueInst *DVI : values) {
+    if (auto *Var = DVI->getVariable())
+      if (!Var->getName().empty())
+        return Var->getName().str();
+  }
+  return CI->getCalledFunction()->getName().str();
+}
+
+void CoalesceNondet::coalesce(Module& M, const std::vector<CallInst *>& calls) {
+  const DataLayout& DL = M.getDataLayout();
+  LLVMContext& Ctx = M.getContext();
+  Function *F = calls.front()->getFunction();
+
+  std::string name = "__nondet_buffer";
+  std::vector<uint64_t> offsets;
+  uint64_t size = 0;
+  for (CallInst *CI : calls) {
+    uint64_t bytes = DL.getTypeStoreSize(CI->getType());
+    unsigned line = 0, column = 0;
+    if (const DebugLoc& Loc = CI->getDebugLoc()) {
+      line = Loc.getLine();
+      column = Loc.getCol();
+    }
+    name += "|" + F->getName().str() + ":" + getVariable(CI) + ":" +
+            std::to_string(line) + ":" + std::to_string(column) + ":" +
+            std::to_string(bytes) + ":" + getKind(CI);
+    offsets.push_back(size);
+    size += bytes;
+  }
+
+  Type *i8 = Type::getInt8Ty(Ctx);
+  AllocaInst *AI = makeAlloca(ArrayType::get(i8, size), DL, "nondet.buffer",
+                              &*F->getEntryBlock().getFirstInsertionPt());
+
+  CallInst *first = calls.front();
+  IRBuilder<> builder(first);
+  builder.SetCurrentDebugLocation(first->getDebugLoc());
+  Value *buffer = builder.CreatePointerCast(AI, Type::getInt8PtrTy(Ctx));
+  CallInst *make = _nondet->createCall(buffer,
+                                       ConstantInt::get(_nondet->getSizeT(),
+                                                        size),
+                                       name, first);
+  make->setDebugLoc(first->getDebugLoc());
+  builder.Insert(make);
+
+  for (size_t i = 0; i < calls.size(); ++i) {
+    CallInst *CI = calls[i];
+    Type *Ty = CI->getType();
+    unsigned bits = DL.getTypeStoreSizeInBits(Ty);
+    Type *StoreTy = IntegerType::get(Ctx, bits);
+
+    builder.SetInsertPoint(CI);
+    builder.SetCurrentDebugLocation(CI->getDebugLoc());
+    Value *ptr = builder.CreateConstGEP1_64(
+#if LLVM_VERSION_MAJOR >= 8
+        i8,
+#endif
+        buffer, offsets[i]);
+    ptr = builder.CreatePointerCast(ptr, StoreTy->getPointerTo());
+    LoadInst *LI = builder.CreateLoad(
+#if LLVM_VERSION_MAJOR >= 8
+        StoreTy,
+#endif
+        ptr);
+#if LLVM_VERSION_MAJOR >= 10
+    LI->setAlignment(Align(1));
+#else
+    LI->setAlignment(1);
+#endif
+    // _Bool is a byte, any value but 0 is true
+    Value *V = LI;
+    if (StoreTy != Ty)
+      V = builder.CreateICmpNE(LI, ConstantInt::get(StoreTy, 0));
+    V->takeName(CI);
+    CI->replaceAllUsesWith(V);
+    CI->eraseFromParent();
+  }
+}
+
+bool CoalesceNondet::runOnModule(Module& M) {
+  _nondet.reset(new NondetBuilder(M));
+
+  std::vector<std::vector<CallInst *>> runs;
+  for (Function& F : M) {
+    for (BasicBlock& B : F) {
+      std::vector<CallInst *> run;
+      for (Instruction& I : B) {
+        if (isNondetCall(I)) {
+          run.push_back(cast<CallInst>(&I));
+        } else if (isa<CallInst>(I) || isa<InvokeInst>(I)) {
+          // the called function may create values, they must come
+          // before the values of the following nondet calls in tests
+          if (!isa<IntrinsicInst>(I) && !run.empty()) {
+            runs.push_back(std::move(run));
+            run.clear();
+          }
+        }
+      }
+      if (!run.empty())
+        runs.push_back(std::move(run));
+    }
+  }
+
+  unsigned calls = 0;
+  for (auto& run : runs) {
+    coalesce(M, run);
+    calls += run.size();
+  }
+  _nondet->finish();
+
+  if (!runs.empty())
+    errs() << "Coalesced " << calls << " nondeterministic values into "
+           << runs.size() << " symbolic buffers\n";
+  return !runs.empty();
+}
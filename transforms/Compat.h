@@ -0,0 +1,134 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#ifndef SBT_COMPAT_H_
+#define SBT_COMPAT_H_
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+// Helpers for the parts of the LLVM API that differ between the versions
+// that we support, so that the passes do not need to repeat the branches
+// on LLVM_VERSION_MAJOR. Everything is resolved at compile time.
+
+// the result of Module::getOrInsertFunction
+#if LLVM_VERSION_MAJOR >= 9
+using InsertedFunction = llvm::FunctionCallee;
+#else
+using InsertedFunction = llvm::Constant *;
+#endif
+
+// get or insert the declaration of a function (that does not take
+// variadic arguments) into the module
+inline InsertedFunction insertFunction(llvm::Module& M, llvm::StringRef name,
+                                       llvm::Type *retTy,
+                                       llvm::ArrayRef<llvm::Type *> params) {
+  return M.getOrInsertFunction(name,
+                               llvm::FunctionType::get(retTy, params, false));
+}
+
+// the same with the attributes of the function (AttributeList,
+// or AttributeSet in LLVM < 5)
+template <typename AttrsT>
+inline InsertedFunction insertFunction(llvm::Module& M, llvm::StringRef name,
+                                       const AttrsT& attrs, llvm::Type *retTy,
+                                       llvm::ArrayRef<llvm::Type *> params) {
+  return M.getOrInsertFunction(name,
+                               llvm::FunctionType::get(retTy, params, false),
+                               attrs);
+}
+
+// the called value of an inserted function
+inline llvm::Value *calleeOf(InsertedFunction C) {
+#if LLVM_VERSION_MAJOR >= 9
+  return C.getCallee();
+#else
+  return C;
+#endif
+}
+
+// the inserted function (the declaration may have been there already
+// with a different type, the function is then behind a cast)
+inline llvm::Function *functionOf(InsertedFunction C) {
+  return llvm::cast<llvm::Function>(calleeOf(C)->stripPointerCasts());
+}
+
+// the called operand of a call (or invoke) instruction
+#if LLVM_VERSION_MAJOR >= 8
+template <typename CallT>
+inline auto calleeOf(CallT *CI) -> decltype(CI->getCalledOperand()) {
+  return CI->getCalledOperand();
+}
+#else
+template <typename CallT>
+inline auto calleeOf(CallT *CI) -> decltype(CI->getCalledValue()) {
+  return CI->getCalledValue();
+}
+#endif
+
+inline void setAlignment(llvm::AllocaInst *AI, uint64_t align) {
+#if LLVM_VERSION_MAJOR >= 11
+  AI->setAlignment(llvm::Align(align));
+#elif LLVM_VERSION_MAJOR >= 10
+  AI->setAlignment(llvm::MaybeAlign(align));
+#else
+  AI->setAlignment(align);
+#endif
+}
+
+inline uint64_t getAlignment(const llvm::AllocaInst *AI) {
+#if LLVM_VERSION_MAJOR >= 11
+  return AI->getAlign().value();
+#else
+  return AI->getAlignment();
+#endif
+}
+
+// create an alloca of Ty in the address space of allocas
+// and with the preferred alignment of Ty
+inline llvm::AllocaInst *makeAlloca(llvm::Type *Ty, const llvm::DataLayout& DL,
+                                    const llvm::Twine& name = "",
+                                    llvm::Instruction *insertBefore = nullptr) {
+#if LLVM_VERSION_MAJOR >= 11
+  return new llvm::AllocaInst(Ty, DL.getAllocaAddrSpace(), nullptr,
+                              DL.getPrefTypeAlign(Ty), name, insertBefore);
+#else
+#if LLVM_VERSION_MAJOR >= 5
+  auto *AI = new llvm::AllocaInst(Ty, DL.getAllocaAddrSpace(), name,
+                                  insertBefore);
+#else
+  auto *AI = new llvm::AllocaInst(Ty, name, insertBefore);
+#endif
+  setAlignment(AI, DL.getPrefTypeAlignment(Ty));
+  return AI;
+#endif
+}
+
+inline llvm::AllocaInst *makeAlloca(llvm::Type *Ty, const llvm::DataLayout& DL,
+                                    const llvm::Twine& name,
+                                    llvm::BasicBlock *insertAtEnd) {
+#if LLVM_VERSION_MAJOR >= 11
+  return new llvm::AllocaInst(Ty, DL.getAllocaAddrSpace(), nullptr,
+                              DL.getPrefTypeAlign(Ty), name, insertAtEnd);
+#else
+#if LLVM_VERSION_MAJOR >= 5
+  auto *AI = new llvm::AllocaInst(Ty, DL.getAllocaAddrSpace(), name,
+                                  insertAtEnd);
+#else
+  auto *AI = new llvm::AllocaInst(Ty, name, insertAtEnd);
+#endif
+  setAlignment(AI, DL.getPrefTypeAlignment(Ty));
+  return AI;
+#endif
+}
+
+#endif // SBT_COMPAT_H_
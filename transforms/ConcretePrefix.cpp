@@ -0,0 +1,1246 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Execute the deterministic prefix of main concretely and let the program
+// start from the state after it. Many programs build tables or parse
+// constant data before they read the first input and a symbolic executor
+// interprets all of this code with the overhead of symbolic states.
+//
+// The pass interprets main from its entry until it meets an instruction
+// that it cannot evaluate concretely: a call of a declared function
+// (__VERIFIER_nondet_*, klee_make_symbolic, malloc, the error functions,
+// ...), a read of uninitialized memory or of the arguments of main,
+// an access out of bounds, an operation with undefined behavior (division
+// by zero, a wrapping nsw/nuw operation, ...), a floating-point
+// operation, etc. A call of a defined function is executed only as
+// a whole: if its evaluation fails, main stops before the call (so nothing
+// that could reach an input is executed). Then the written globals get
+// new initializers, the contents of the locals of main are stored in
+// a new entry block that continues at the instruction where the evaluation
+// stopped, and the code that became unreachable is removed.
+//
+// The evaluation is limited by -concrete-prefix-max-steps instructions.
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <vector>
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GetElementPtrTypeIterator.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+static cl::opt<uint64_t> MaxSteps("concrete-prefix-max-steps",
+        cl::desc("The maximal number of instructions executed concretely "
+                 "(default: 1000000)"),
+        cl::init(1000000));
+
+namespace {
+
+// the maximal depth of calls
+const unsigned MaxDepth = 256;
+// the maximal size of an object in bytes
+const uint64_t MaxObjectSize = 1 << 26;
+
+struct Object;
+
+// a pointer is an object and an offset into it, null has no object
+struct Ptr {
+  Object *Obj{nullptr};
+  int64_t Off{0};
+};
+
+// a concrete value: an integer (also the bits of a floating-point
+// value) or a pointer
+struct Val {
+  bool IsPtr{false};
+  APInt Int;
+  Ptr P;
+
+  Val() = default;
+  Val(const APInt& I) : Int(I) {}
+  Val(const Ptr& P) : IsPtr(true), P(P) {}
+};
+
+// a global variable, a function or an alloca
+struct Object {
+  Value *Origin;
+  // 0 for globals, the depth of the frame for allocas (main is 1)
+  unsigned Depth;
+  // the contents are unknown (functions, external globals, ...)
+  bool Opaque{false};
+  bool ReadOnly{false};
+  bool Modified{false};
+  std::vector<uint8_t> Bytes;
+  std::vector<bool> Defined;
+  // the pointers stored in the object (the bytes under them are zero)
+  std::map<uint64_t, Ptr> Ptrs;
+
+  Object(Value *O, unsigned D, uint64_t Size, bool Def)
+    : Origin(O), Depth(D), Bytes(Size, 0), Defined(Size, Def) {}
+};
+
+struct Frame {
+  Function *F;
+  unsigned Depth;
+  DenseMap<const Value *, Val> Vals;
+  std::vector<std::list<Object>::iterator> Allocas;
+
+  Frame(Function *F, unsigned D) : F(F), Depth(D) {}
+};
+
+class Interpreter {
+  const DataLayout& DL;
+  std::list<Object> Objects;
+  DenseMap<const GlobalValue *, Object *> Globals;
+  uint64_t Steps{0};
+
+  bool getConst(Constant *C, Val& V);
+  bool getVal(Frame& Fr, Value *V, Val& R);
+  bool writeConst(Object& O, uint64_t Off, Constant *C);
+  void writeInt(Object& O, uint64_t Off, const APInt& I, uint64_t Size);
+  bool storePtr(Object& O, uint64_t Off, const Ptr& P);
+  void clearPtrs(Object& O, uint64_t Off, uint64_t Size);
+  bool inBounds(const Ptr& P, uint64_t Size) const;
+  bool load(const Ptr& P, Type *T, Val& R);
+  bool store(const Ptr& P, const Val& V, Type *T);
+
+  bool binop(BinaryOperator *BO, const APInt& A, const APInt& B, APInt& R);
+  bool icmp(ICmpInst *CI, const Val& A, const Val& B, bool& R);
+  bool convert(CastInst *CI, const Val& A, Val& R);
+  bool gep(Frame& Fr, GetElementPtrInst *GEP, Val& R);
+  bool allocate(Frame& Fr, AllocaInst *AI);
+  bool memIntrinsic(Frame& Fr, MemIntrinsic *MI);
+  bool call(Frame& Fr, CallInst *CI);
+  bool enter(Frame& Fr, BasicBlock *From, BasicBlock *To, Instruction *&Next);
+  bool step(Frame& Fr, Instruction *I, Instruction *&Next);
+  bool run(Function *F, SmallVectorImpl<Val>& Args, unsigned Depth, Val& Ret);
+
+public:
+  Frame Main;
+  DenseMap<const AllocaInst *, Object *> MainAllocas;
+
+  Interpreter(const DataLayout& DL, Function *F) : DL(DL), Main(F, 1) {}
+
+  Object *getGlobal(GlobalValue *G);
+  APInt readInt(const Object& O, uint64_t Off, uint64_t Size,
+                unsigned Bits) const;
+  bool hasPtrs(const Object& O, uint64_t Off, uint64_t Size) const;
+  std::list<Object>& getObjects() { return Objects; }
+  uint64_t getSteps() const { return Steps; }
+
+  unsigned runMain(unsigned Limit, Instruction *&Stop);
+};
+
+// a store of the contents of a local of main into the new entry block
+struct LocalStore {
+  AllocaInst *AI;
+  // the type of the whole local and the indices of the stored part
+  Type *Ty;
+  SmallVector<unsigned, 4> Path;
+  // the stored constant or a pointer to a local
+  Constant *C;
+  Ptr P;
+};
+
+class Snapshot {
+  const DataLayout& DL;
+  Interpreter& Interp;
+
+  bool isZero(const Object& O, uint64_t Off, uint64_t Size) const;
+
+public:
+  Snapshot(const DataLayout& DL, Interpreter& I) : DL(DL), Interp(I) {}
+
+  Constant *getPointer(const Ptr& P, Type *T) const;
+  Constant *getConstant(const Object& O, uint64_t Off, Type *T) const;
+  Value *getValue(IRBuilder<>& IRB, const Val& V, Type *T) const;
+  bool plan(const Object& O, uint64_t Off, Type *T,
+            SmallVectorImpl<unsigned>& Path, LocalStore S,
+            std::vector<LocalStore>& Stores) const;
+  void emit(IRBuilder<>& IRB, const LocalStore& S) const;
+};
+
+class ConcretePrefix : public ModulePass {
+public:
+  static char ID;
+
+  ConcretePrefix() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<ConcretePrefix> CP("concrete-prefix",
+                                       "Execute the deterministic prefix "
+                                       "of main concretely");
+char ConcretePrefix::ID;
+
+static bool isScalar(const Type *T) {
+  return T->isIntegerTy() || T->isFloatingPointTy() || T->isPointerTy();
+}
+
+Object *Interpreter::getGlobal(GlobalValue *G) {
+  auto It = Globals.find(G);
+  if (It != Globals.end())
+    return It->second;
+
+  auto *GV = dyn_cast<GlobalVariable>(G);
+  uint64_t Size = 0;
+  if (GV && GV->getValueType()->isSized())
+    Size = DL.getTypeAllocSize(GV->getValueType());
+  bool Known = GV && GV->hasDefinitiveInitializer() &&
+               !GV->isThreadLocal() && Size <= MaxObjectSize;
+
+  Objects.emplace_back(G, 0, Known ? Size : 0, true);
+  Object *O = &Objects.back();
+  // the initializer can refer to the global itself
+  Globals[G] = O;
+
+  O->ReadOnly = !GV || GV->isConstant();
+  O->Opaque = !Known || !writeConst(*O, 0, GV->getInitializer());
+  O->Modified = false;
+  return O;
+}
+
+bool Interpreter::getConst(Constant *C, Val& V) {
+  if (auto *CI = dyn_cast<ConstantInt>(C)) {
+    V = Val(CI->getValue());
+    return true;
+  }
+  if (auto *CF = dyn_cast<ConstantFP>(C)) {
+    V = Val(CF->getValueAPF().bitcastToAPInt());
+    return true;
+  }
+  if (isa<ConstantPointerNull>(C)) {
+    V = Val(Ptr());
+    return true;
+  }
+  // undef, vectors, constant expressions on integers, ...
+  if (!C->getType()->isPointerTy())
+    return false;
+
+  if (auto *GA = dyn_cast<GlobalAlias>(C))
+    return getConst(GA->getAliasee(), V);
+  if (auto *G = dyn_cast<GlobalValue>(C)) {
+    if (isa<GlobalIFunc>(G))
+      return false;
+    V = Val(Ptr{getGlobal(G), 0});
+    return true;
+  }
+
+  // getelementptr and casts of other constants
+#if LLVM_VERSION_MAJOR >= 10
+  APInt Off(DL.getIndexTypeSizeInBits(C->getType()), 0);
+  Value *Base = C->stripAndAccumulateConstantOffsets(DL, Off, true);
+#else
+  APInt Off(DL.getPointerTypeSizeInBits(C->getType()), 0);
+  Value *Base = C->stripAndAccumulateInBoundsConstantOffsets(DL, Off);
+#endif
+  if (Base == C || !isa<Constant>(Base))
+    return false;
+  if (!getConst(cast<Constant>(Base), V) || !V.IsPtr)
+    return false;
+  V.P.Off += Off.getSExtValue();
+  return true;
+}
+
+bool Interpreter::getVal(Frame& Fr, Value *V, Val& R) {
+  if (auto *C = dyn_cast<Constant>(V))
+    return getConst(C, R);
+
+  // the arguments of main are unknown
+  auto It = Fr.Vals.find(V);
+  if (It == Fr.Vals.end())
+    return false;
+  R = It->second;
+  return true;
+}
+
+bool Interpreter::writeConst(Object& O, uint64_t Off, Constant *C) {
+  Type *T = C->getType();
+  // the bytes are zero already
+  if (C->isNullValue() || isa<UndefValue>(C))
+    return true;
+
+  if (isScalar(T)) {
+    Val V;
+    if (!getConst(C, V))
+      return false;
+    if (V.IsPtr)
+      return storePtr(O, Off, V.P);
+    writeInt(O, Off, V.Int, DL.getTypeStoreSize(T));
+    return true;
+  }
+
+  if (auto *CDS = dyn_cast<ConstantDataSequential>(C)) {
+    if (!T->isArrayTy())
+      return false;
+    uint64_t Size = DL.getTypeAllocSize(CDS->getElementType());
+    for (unsigned i = 0; i < CDS->getNumElements(); ++i) {
+      if (!writeConst(O, Off + i * Size, CDS->getElementAsConstant(i)))
+        return false;
+    }
+    return true;
+  }
+
+  if (auto *CA = dyn_cast<ConstantArray>(C)) {
+    uint64_t Size = DL.getTypeAllocSize(CA->getType()->getElementType());
+    for (unsigned i = 0; i < CA->getNumOperands(); ++i) {
+      if (!writeConst(O, Off + i * Size, CA->getOperand(i)))
+        return false;
+    }
+    return true;
+  }
+
+  if (auto *CS = dyn_cast<ConstantStruct>(C)) {
+    const StructLayout *SL = DL.getStructLayout(CS->getType());
+    for (unsigned i = 0; i < CS->getNumOperands(); ++i) {
+      if (!writeConst(O, Off + SL->getElementOffset(i), CS->getOperand(i)))
+        return false;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+void Interpreter::writeInt(Object& O, uint64_t Off, const APInt& I,
+                           uint64_t Size) {
+  clearPtrs(O, Off, Size);
+  APInt W = I.zextOrTrunc(Size * 8);
+  for (uint64_t b = 0; b < Size; ++b) {
+    uint64_t Idx = DL.isLittleEndian() ? b : Size - 1 - b;
+    O.Bytes[Off + Idx] = W.lshr(b * 8).trunc(8).getZExtValue();
+    O.Defined[Off + Idx] = true;
+  }
+  O.Modified = true;
+}
+
+APInt Interpreter::readInt(const Object& O, uint64_t Off, uint64_t Size,
+                           unsigned Bits) const {
+  APInt R(Size * 8, 0);
+  for (uint64_t b = 0; b < Size; ++b) {
+    uint64_t Idx = DL.isLittleEndian() ? b : Size - 1 - b;
+    R |= APInt(Size * 8, O.Bytes[Off + Idx]).shl(b * 8);
+  }
+  return R.trunc(Bits);
+}
+
+bool Interpreter::hasPtrs(const Object& O, uint64_t Off, uint64_t Size) const {
+  uint64_t PS = DL.getPointerSize();
+  auto It = O.Ptrs.lower_bound(Off >= PS ? Off - PS + 1 : 0);
+  return It != O.Ptrs.end() && It->first < Off + Size;
+}
+
+void Interpreter::clearPtrs(Object& O, uint64_t Off, uint64_t Size) {
+  uint64_t PS = DL.getPointerSize();
+  auto It = O.Ptrs.lower_bound(Off >= PS ? Off - PS + 1 : 0);
+  while (It != O.Ptrs.end() && It->first < Off + Size)
+    It = O.Ptrs.erase(It);
+}
+
+// a pointer to a local must not outlive the local: it can be stored
+// only into the locals of the same or of a deeper frame
+static bool canStore(const Object& O, const Ptr& P) {
+  return !P.Obj || P.Obj->Depth == 0 ||
+         (O.Depth != 0 && P.Obj->Depth <= O.Depth);
+}
+
+bool Interpreter::storePtr(Object& O, uint64_t Off, const Ptr& P) {
+  if (!canStore(O, P))
+    return false;
+
+  uint64_t PS = DL.getPointerSize();
+  clearPtrs(O, Off, PS);
+  std::fill(O.Bytes.begin() + Off, O.Bytes.begin() + Off + PS, 0);
+  std::fill(O.Defined.begin() + Off, O.Defined.begin() + Off + PS, true);
+  if (P.Obj || P.Off != 0)
+    O.Ptrs[Off] = P;
+  O.Modified = true;
+  return true;
+}
+
+bool Interpreter::inBounds(const Ptr& P, uint64_t Size) const {
+  return P.Obj && !P.Obj->Opaque && P.Off >= 0 &&
+         static_cast<uint64_t>(P.Off) + Size <= P.Obj->Bytes.size();
+}
+
+bool Interpreter::load(const Ptr& P, Type *T, Val& R) {
+  uint64_t Size = DL.getTypeStoreSize(T);
+  if (!isScalar(T) || !inBounds(P, Size))
+    return false;
+
+  const Object& O = *P.Obj;
+  uint64_t Off = P.Off;
+  // the uninitialized memory is nondeterministic
+  for (uint64_t i = Off; i < Off + Size; ++i) {
+    if (!O.Defined[i])
+      return false;
+  }
+
+  if (T->isPointerTy()) {
+    auto It = O.Ptrs.find(Off);
+    if (It != O.Ptrs.end()) {
+      R = Val(It->second);
+      return true;
+    }
+    if (hasPtrs(O, Off, Size))
+      return false;
+    for (uint64_t i = Off; i < Off + Size; ++i) {
+      if (O.Bytes[i] != 0)
+        return false;
+    }
+    R = Val(Ptr());
+    return true;
+  }
+
+  if (hasPtrs(O, Off, Size))
+    return false;
+  R = Val(readInt(O, Off, Size, DL.getTypeSizeInBits(T)));
+  return true;
+}
+
+bool Interpreter::store(const Ptr& P, const Val& V, Type *T) {
+  uint64_t Size = DL.getTypeStoreSize(T);
+  if (!isScalar(T) || !inBounds(P, Size) || P.Obj->ReadOnly)
+    return false;
+
+  if (V.IsPtr)
+    return storePtr(*P.Obj, P.Off, V.P);
+  writeInt(*P.Obj, P.Off, V.Int, Size);
+  return true;
+}
+
+bool Interpreter::binop(BinaryOperator *BO, const APInt& A, const APInt& B,
+                        APInt& R) {
+  bool SOv = false, UOv = false;
+  switch (BO->getOpcode()) {
+  case Instruction::Add:
+    R = A.sadd_ov(B, SOv);
+    (void)A.uadd_ov(B, UOv);
+    break;
+  case Instruction::Sub:
+    R = A.ssub_ov(B, SOv);
+    (void)A.usub_ov(B, UOv);
+    break;
+  case Instruction::Mul:
+    R = A.smul_ov(B, SOv);
+    (void)A.umul_ov(B, UOv);
+    break;
+  case Instruction::Shl:
+    if (B.uge(A.getBitWidth()))
+      return false;
+    R = A.sshl_ov(B, SOv);
+    (void)A.ushl_ov(B, UOv);
+    break;
+  case Instruction::LShr:
+    if (B.uge(A.getBitWidth()))
+      return false;
+    R = A.lshr(B);
+    return !BO->isExact() || R.shl(B) == A;
+  case Instruction::AShr:
+    if (B.uge(A.getBitWidth()))
+      return false;
+    R = A.ashr(B);
+    return !BO->isExact() || R.shl(B) == A;
+  case Instruction::UDiv:
+    if (B.isNullValue())
+      return false;
+    R = A.udiv(B);
+    return !BO->isExact() || A.urem(B).isNullValue();
+  case Instruction::SDiv:
+    if (B.isNullValue() || (A.isMinSignedValue() && B.isAllOnesValue()))
+      return false;
+    R = A.sdiv(B);
+    return !BO->isExact() || A.srem(B).isNullValue();
+  case Instruction::URem:
+    if (B.isNullValue())
+      return false;
+    R = A.urem(B);
+    return true;
+  case Instruction::SRem:
+    if (B.isNullValue() || (A.isMinSignedValue() && B.isAllOnesValue()))
+      return false;
+    R = A.srem(B);
+    return true;
+  case Instruction::And:
+    R = A & B;
+    return true;
+  case Instruction::Or:
+    R = A | B;
+    return true;
+  case Instruction::Xor:
+    R = A ^ B;
+    return true;
+  default:
+    return false;
+  }
+
+  // the wrapping nsw/nuw operations give poison
+  return !(BO->hasNoSignedWrap() && SOv) && !(BO->hasNoUnsignedWrap() && UOv);
+}
+
+static bool compare(CmpInst::Predicate P, const APInt& A, const APInt& B) {
+  switch (P) {
+  case CmpInst::ICMP_EQ: return A == B;
+  case CmpInst::ICMP_NE: return A != B;
+  case CmpInst::ICMP_UGT: return A.ugt(B);
+  case CmpInst::ICMP_UGE: return A.uge(B);
+  case CmpInst::ICMP_ULT: return A.ult(B);
+  case CmpInst::ICMP_ULE: return A.ule(B);
+  case CmpInst::ICMP_SGT: return A.sgt(B);
+  case CmpInst::ICMP_SGE: return A.sge(B);
+  case CmpInst::ICMP_SLT: return A.slt(B);
+  case CmpInst::ICMP_SLE: return A.sle(B);
+  default: return false;
+  }
+}
+
+bool Interpreter::icmp(ICmpInst *CI, const Val& A, const Val& B, bool& R) {
+  if (!A.IsPtr) {
+    R = compare(CI->getPredicate(), A.Int, B.Int);
+    return true;
+  }
+
+  // the order of different objects is not known
+  if (A.P.Obj != B.P.Obj) {
+    if (!CI->isEquality())
+      return false;
+    R = CI->getPredicate() == CmpInst::ICMP_NE;
+    return true;
+  }
+  R = compare(CI->getPredicate(), APInt(64, A.P.Off, true),
+              APInt(64, B.P.Off, true));
+  return true;
+}
+
+bool Interpreter::convert(CastInst *CI, const Val& A, Val& R) {
+  Type *T = CI->getType();
+  switch (CI->getOpcode()) {
+  case Instruction::Trunc:
+    R = Val(A.Int.trunc(T->getIntegerBitWidth()));
+    return true;
+  case Instruction::ZExt:
+    R = Val(A.Int.zext(T->getIntegerBitWidth()));
+    return true;
+  case Instruction::SExt:
+    R = Val(A.Int.sext(T->getIntegerBitWidth()));
+    return true;
+  case Instruction::BitCast:
+    // the pointers and the bits of scalars stay the same
+    R = A;
+    return true;
+  case Instruction::PtrToInt:
+    // the addresses of objects are not known
+    if (A.P.Obj)
+      return false;
+    R = Val(APInt(T->getIntegerBitWidth(), A.P.Off, true));
+    return true;
+  case Instruction::IntToPtr:
+    R = Val(Ptr{nullptr, A.Int.sextOrTrunc(64).getSExtValue()});
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool Interpreter::gep(Frame& Fr, GetElementPtrInst *GEP, Val& R) {
+  if (!getVal(Fr, GEP->getPointerOperand(), R) || !R.IsPtr)
+    return false;
+
+  for (auto GTI = gep_type_begin(GEP), E = gep_type_end(GEP);
+       GTI != E; ++GTI) {
+    Val Idx;
+    if (!getVal(Fr, GTI.getOperand(), Idx) || Idx.IsPtr)
+      return false;
+    if (StructType *ST = GTI.getStructTypeOrNull()) {
+      R.P.Off += DL.getStructLayout(ST)->getElementOffset(Idx.Int.getZExtValue());
+    } else {
+      int64_t Size = DL.getTypeAllocSize(GTI.getIndexedType());
+      R.P.Off += Idx.Int.sextOrTrunc(64).getSExtValue() * Size;
+    }
+  }
+  return true;
+}
+
+bool Interpreter::allocate(Frame& Fr, AllocaInst *AI) {
+  uint64_t Count = 1;
+  if (AI->isArrayAllocation()) {
+    Val N;
+    if (!getVal(Fr, AI->getArraySize(), N))
+      return false;
+    Count = N.Int.getZExtValue();
+  }
+
+  uint64_t Size = DL.getTypeAllocSize(AI->getAllocatedType());
+  if (Count > MaxObjectSize || Size * Count > MaxObjectSize)
+    return false;
+
+  Objects.emplace_back(AI, Fr.Depth, Size * Count, false);
+  Fr.Allocas.push_back(std::prev(Objects.end()));
+  Fr.Vals[AI] = Val(Ptr{&Objects.back(), 0});
+  if (&Fr == &Main)
+    MainAllocas[AI] = &Objects.back();
+  return true;
+}
+
+bool Interpreter::memIntrinsic(Frame& Fr, MemIntrinsic *MI) {
+  Val Dst, Len;
+  if (MI->isVolatile() || !getVal(Fr, MI->getRawDest(), Dst) ||
+      !getVal(Fr, MI->getLength(), Len))
+    return false;
+
+  uint64_t N = Len.Int.getZExtValue();
+  if (N == 0)
+    return true;
+  if (!inBounds(Dst.P, N) || Dst.P.Obj->ReadOnly)
+    return false;
+
+  Object& D = *Dst.P.Obj;
+  uint64_t DOff = Dst.P.Off;
+
+  if (auto *MS = dyn_cast<MemSetInst>(MI)) {
+    Val B;
+    if (!getVal(Fr, MS->getValue(), B))
+      return false;
+    clearPtrs(D, DOff, N);
+    std::fill(D.Bytes.begin() + DOff, D.Bytes.begin() + DOff + N,
+              B.Int.getZExtValue());
+    std::fill(D.Defined.begin() + DOff, D.Defined.begin() + DOff + N, true);
+    D.Modified = true;
+    return true;
+  }
+
+  Val Src;
+  auto *MT = cast<MemTransferInst>(MI);
+  if (!getVal(Fr, MT->getRawSource(), Src) || !inBounds(Src.P, N))
+    return false;
+
+  const Object& S = *Src.P.Obj;
+  uint64_t SOff = Src.P.Off;
+
+  // the pointers must be copied whole
+  uint64_t PS = DL.getPointerSize();
+  std::vector<std::pair<uint64_t, Ptr>> Ps;
+  for (auto It = S.Ptrs.lower_bound(SOff >= PS ? SOff - PS + 1 : 0);
+       It != S.Ptrs.end() && It->first < SOff + N; ++It) {
+    if (It->first < SOff || It->first + PS > SOff + N ||
+        !canStore(D, It->second))
+      return false;
+    Ps.emplace_back(It->first - SOff, It->second);
+  }
+
+  // copy through a buffer, the regions can overlap (memmove)
+  std::vector<uint8_t> Bytes(S.Bytes.begin() + SOff,
+                             S.Bytes.begin() + SOff + N);
+  std::vector<bool> Def(S.Defined.begin() + SOff,
+                        S.Defined.begin() + SOff + N);
+  clearPtrs(D, DOff, N);
+  std::copy(Bytes.begin(), Bytes.end(), D.Bytes.begin() + DOff);
+  std::copy(Def.begin(), Def.end(), D.Defined.begin() + DOff);
+  for (auto& P : Ps)
+    D.Ptrs[DOff + P.first] = P.second;
+  D.Modified = true;
+  return true;
+}
+
+bool Interpreter::call(Frame& Fr, CallInst *CI) {
+  if (isa<DbgInfoIntrinsic>(CI))
+    return true;
+
+  if (auto *II = dyn_cast<IntrinsicInst>(CI)) {
+    switch (II->getIntrinsicID()) {
+    case Intrinsic::lifetime_start:
+    case Intrinsic::lifetime_end:
+      return true;
+    default:
+      break;
+    }
+    if (auto *MI = dyn_cast<MemIntrinsic>(II))
+      return memIntrinsic(Fr, MI);
+    return false;
+  }
+
+  Value *CV = calleeOf(CI);
+  Val Callee;
+  if (CI->isInlineAsm() || !getVal(Fr, CV, Callee) || !Callee.P.Obj ||
+      Callee.P.Off != 0)
+    return false;
+
+  auto *F = dyn_cast<Function>(Callee.P.Obj->Origin);
+  if (!F || F->getFunctionType() != CI->getFunctionType())
+    return false;
+
+  SmallVector<Val, 4> Args;
+#if LLVM_VERSION_MAJOR >= 8
+  for (Value *A : CI->args()) {
+#else
+  for (Value *A : CI->arg_operands()) {
+#endif
+    Args.emplace_back();
+    if (!getVal(Fr, A, Args.back()))
+      return false;
+  }
+
+  Val Ret;
+  if (!run(F, Args, Fr.Depth + 1, Ret))
+    return false;
+  if (!CI->getType()->isVoidTy())
+    Fr.Vals[CI] = Ret;
+  return true;
+}
+
+bool Interpreter::enter(Frame& Fr, BasicBlock *From, BasicBlock *To,
+                        Instruction *&Next) {
+  // the PHI nodes take the values at once
+  SmallVector<std::pair<PHINode *, Val>, 8> Vals;
+  for (Instruction& I : *To) {
+    auto *PN = dyn_cast<PHINode>(&I);
+    if (!PN)
+      break;
+    Vals.emplace_back(PN, Val());
+    if (!getVal(Fr, PN->getIncomingValueForBlock(From), Vals.back().second))
+      return false;
+  }
+
+  for (auto& PV : Vals)
+    Fr.Vals[PV.first] = PV.second;
+  Next = To->getFirstNonPHI();
+  return true;
+}
+
+bool Interpreter::step(Frame& Fr, Instruction *I, Instruction *&Next) {
+  if (++Steps > MaxSteps)
+    return false;
+
+  Type *T = I->getType();
+  if (T->isVectorTy() || T->isAggregateType())
+    return false;
+  Next = I->getNextNode();
+
+  Val A, B;
+  if (auto *BI = dyn_cast<BranchInst>(I)) {
+    unsigned Succ = 0;
+    if (BI->isConditional()) {
+      if (!getVal(Fr, BI->getCondition(), A))
+        return false;
+      Succ = A.Int.isNullValue() ? 1 : 0;
+    }
+    return enter(Fr, BI->getParent(), BI->getSuccessor(Succ), Next);
+  }
+
+  if (auto *SI = dyn_cast<SwitchInst>(I)) {
+    if (!getVal(Fr, SI->getCondition(), A))
+      return false;
+    BasicBlock *Dst = SI->getDefaultDest();
+    for (auto C : SI->cases()) {
+      if (C.getCaseValue()->getValue() == A.Int) {
+        Dst = C.getCaseSuccessor();
+        break;
+      }
+    }
+    return enter(Fr, SI->getParent(), Dst, Next);
+  }
+
+  if (auto *BO = dyn_cast<BinaryOperator>(I)) {
+    APInt R;
+    if (!T->isIntegerTy() || !getVal(Fr, BO->getOperand(0), A) ||
+        !getVal(Fr, BO->getOperand(1), B) || !binop(BO, A.Int, B.Int, R))
+      return false;
+    Fr.Vals[I] = Val(R);
+    return true;
+  }
+
+  if (auto *CI = dyn_cast<ICmpInst>(I)) {
+    bool R;
+    if (!getVal(Fr, CI->getOperand(0), A) ||
+        !getVal(Fr, CI->getOperand(1), B) || !icmp(CI, A, B, R))
+      return false;
+    Fr.Vals[I] = Val(APInt(1, R));
+    return true;
+  }
+
+  if (auto *SI = dyn_cast<SelectInst>(I)) {
+    if (!getVal(Fr, SI->getCondition(), A))
+      return false;
+    Value *V = A.Int.isNullValue() ? SI->getFalseValue() : SI->getTrueValue();
+    if (!getVal(Fr, V, B))
+      return false;
+    Fr.Vals[I] = B;
+    return true;
+  }
+
+  if (auto *CI = dyn_cast<CastInst>(I)) {
+    if (!getVal(Fr, CI->getOperand(0), A) || !convert(CI, A, B))
+      return false;
+    Fr.Vals[I] = B;
+    return true;
+  }
+
+  if (auto *GEP = dyn_cast<GetElementPtrInst>(I)) {
+    if (!gep(Fr, GEP, A))
+      return false;
+    Fr.Vals[I] = A;
+    return true;
+  }
+
+  if (auto *LI = dyn_cast<LoadInst>(I)) {
+    if (LI->isVolatile() || LI->isAtomic() ||
+        !getVal(Fr, LI->getPointerOperand(), A) || !load(A.P, T, B))
+      return false;
+    Fr.Vals[I] = B;
+    return true;
+  }
+
+  if (auto *SI = dyn_cast<StoreInst>(I)) {
+    Value *V = SI->getValueOperand();
+    return !SI->isVolatile() && !SI->isAtomic() &&
+           getVal(Fr, SI->getPointerOperand(), A) && getVal(Fr, V, B) &&
+           store(A.P, B, V->getType());
+  }
+
+  if (auto *AI = dyn_cast<AllocaInst>(I))
+    return allocate(Fr, AI);
+
+  if (auto *CI = dyn_cast<CallInst>(I))
+    return call(Fr, CI);
+
+  return false;
+}
+
+bool Interpreter::run(Function *F, SmallVectorImpl<Val>& Args,
+                      unsigned Depth, Val& Ret) {
+  if (F->isDeclaration() || F->isVarArg() || Depth > MaxDepth)
+    return false;
+
+  Frame Fr(F, Depth);
+  unsigned Idx = 0;
+  for (Argument& A : F->args())
+    Fr.Vals[&A] = Args[Idx++];
+
+  bool Ok = false;
+  Instruction *I = &*F->getEntryBlock().begin();
+  while (true) {
+    if (auto *RI = dyn_cast<ReturnInst>(I)) {
+      Ok = true;
+      if (Value *RV = RI->getReturnValue()) {
+        // a pointer to a local would dangle
+        Ok = getVal(Fr, RV, Ret) &&
+             !(Ret.IsPtr && Ret.P.Obj && Ret.P.Obj->Depth == Depth);
+      }
+      break;
+    }
+
+    Instruction *Next;
+    if (!step(Fr, I, Next))
+      break;
+    I = Next;
+  }
+
+  for (auto It : Fr.Allocas)
+    Objects.erase(It);
+  return Ok;
+}
+
+unsigned Interpreter::runMain(unsigned Limit, Instruction *&Stop) {
+  BasicBlock *Entry = &Main.F->getEntryBlock();
+  Instruction *I = &*Entry->begin();
+  unsigned N = 0;
+  for (; N < Limit; ++N) {
+    // the allocas out of the entry block can be executed repeatedly
+    if (isa<ReturnInst>(I) || (isa<AllocaInst>(I) && I->getParent() != Entry))
+      break;
+
+    Instruction *Next;
+    if (!step(Main, I, Next))
+      break;
+    I = Next;
+  }
+
+  Stop = I;
+  return N;
+}
+
+bool Snapshot::isZero(const Object& O, uint64_t Off, uint64_t Size) const {
+  if (Interp.hasPtrs(O, Off, Size))
+    return false;
+  for (uint64_t i = Off; i < Off + Size; ++i) {
+    if (!O.Defined[i] || O.Bytes[i] != 0)
+      return false;
+  }
+  return true;
+}
+
+Constant *Snapshot::getPointer(const Ptr& P, Type *T) const {
+  auto *PT = cast<PointerType>(T);
+  if (!P.Obj) {
+    if (P.Off == 0)
+      return ConstantPointerNull::get(PT);
+    return ConstantExpr::getIntToPtr(ConstantInt::get(DL.getIntPtrType(T),
+                                                      P.Off, true), T);
+  }
+
+  // a local of main
+  auto *G = dyn_cast<GlobalValue>(P.Obj->Origin);
+  if (!G)
+    return nullptr;
+
+  Constant *C = G;
+  if (P.Off != 0) {
+    LLVMContext& Ctx = G->getContext();
+    Type *I8 = Type::getInt8Ty(Ctx);
+    unsigned AS = G->getType()->getPointerAddressSpace();
+    C = ConstantExpr::getGetElementPtr(I8,
+          ConstantExpr::getPointerCast(G, I8->getPointerTo(AS)),
+          ConstantInt::get(Type::getInt64Ty(Ctx), P.Off, true));
+  }
+  return ConstantExpr::getPointerCast(C, T);
+}
+
+Constant *Snapshot::getConstant(const Object& O, uint64_t Off, Type *T) const {
+  if (!T->isSized() || T->isVectorTy())
+    return nullptr;
+  uint64_t Size = DL.getTypeStoreSize(T);
+  if (Off + Size > O.Bytes.size())
+    return nullptr;
+  if (isZero(O, Off, Size))
+    return Constant::getNullValue(T);
+
+  if (auto *ST = dyn_cast<StructType>(T)) {
+    const StructLayout *SL = DL.getStructLayout(ST);
+    std::vector<Constant *> Elems;
+    for (unsigned i = 0; i < ST->getNumElements(); ++i) {
+      Elems.push_back(getConstant(O, Off + SL->getElementOffset(i),
+                                  ST->getElementType(i)));
+      if (!Elems.back())
+        return nullptr;
+    }
+    return ConstantStruct::get(ST, Elems);
+  }
+
+  if (auto *AT = dyn_cast<ArrayType>(T)) {
+    Type *ET = AT->getElementType();
+    uint64_t ESize = DL.getTypeAllocSize(ET);
+    std::vector<Constant *> Elems;
+    for (uint64_t i = 0; i < AT->getNumElements(); ++i) {
+      Elems.push_back(getConstant(O, Off + i * ESize, ET));
+      if (!Elems.back())
+        return nullptr;
+    }
+    return ConstantArray::get(AT, Elems);
+  }
+
+  if (!isScalar(T))
+    return nullptr;
+  for (uint64_t i = Off; i < Off + Size; ++i) {
+    if (!O.Defined[i])
+      return nullptr;
+  }
+
+  if (T->isPointerTy()) {
+    auto It = O.Ptrs.find(Off);
+    if (It == O.Ptrs.end())
+      return nullptr;
+    return getPointer(It->second, T);
+  }
+
+  if (Interp.hasPtrs(O, Off, Size))
+    return nullptr;
+  APInt Bits = Interp.readInt(O, Off, Size, DL.getTypeSizeInBits(T));
+  if (T->isIntegerTy())
+    return ConstantInt::get(T->getContext(), Bits);
+  return ConstantFP::get(T->getContext(), APFloat(T->getFltSemantics(), Bits));
+}
+
+Value *Snapshot::getValue(IRBuilder<>& IRB, const Val& V, Type *T) const {
+  if (!V.IsPtr) {
+    if (T->isIntegerTy())
+      return ConstantInt::get(T->getContext(), V.Int);
+    return ConstantFP::get(T->getContext(), APFloat(T->getFltSemantics(), V.Int));
+  }
+
+  if (Constant *C = getPointer(V.P, T))
+    return C;
+
+  // a pointer into a local of main (the locals of the callees are gone)
+  auto *AI = cast<AllocaInst>(V.P.Obj->Origin);
+  Value *R = AI;
+  if (V.P.Off != 0) {
+    Type *I8 = IRB.getInt8Ty();
+    R = IRB.CreateGEP(I8, IRB.CreatePointerCast(AI, I8->getPointerTo(
+                                                  AI->getType()->getPointerAddressSpace())),
+                      IRB.getInt64(V.P.Off));
+  }
+  return IRB.CreatePointerCast(R, T);
+}
+
+// plan the stores that restore the contents of a local, the parts that
+// were not written stay uninitialized
+bool Snapshot::plan(const Object& O, uint64_t Off, Type *T,
+                    SmallVectorImpl<unsigned>& Path, LocalStore S,
+                    std::vector<LocalStore>& Stores) const {
+  uint64_t Size = DL.getTypeStoreSize(T);
+  if (std::find(O.Defined.begin() + Off, O.Defined.begin() + Off + Size,
+                true) == O.Defined.begin() + Off + Size)
+    return true;
+
+  S.Path.assign(Path.begin(), Path.end());
+  if ((S.C = getConstant(O, Off, T))) {
+    Stores.push_back(S);
+    return true;
+  }
+
+  if (auto *ST = dyn_cast<StructType>(T)) {
+    const StructLayout *SL = DL.getStructLayout(ST);
+    for (unsigned i = 0; i < ST->getNumElements(); ++i) {
+      Path.push_back(i);
+      bool Ok = plan(O, Off + SL->getElementOffset(i), ST->getElementType(i),
+                     Path, S, Stores);
+      Path.pop_back();
+      if (!Ok)
+        return false;
+    }
+    return true;
+  }
+
+  if (auto *AT = dyn_cast<ArrayType>(T)) {
+    uint64_t ESize = DL.getTypeAllocSize(AT->getElementType());
+    for (uint64_t i = 0; i < AT->getNumElements(); ++i) {
+      Path.push_back(i);
+      bool Ok = plan(O, Off + i * ESize, AT->getElementType(), Path, S, Stores);
+      Path.pop_back();
+      if (!Ok)
+        return false;
+    }
+    return true;
+  }
+
+  // a pointer to a local
+  if (!T->isPointerTy() || !O.Ptrs.count(Off))
+    return false;
+  for (uint64_t i = Off; i < Off + Size; ++i) {
+    if (!O.Defined[i])
+      return false;
+  }
+  S.P = O.Ptrs.find(Off)->second;
+  Stores.push_back(S);
+  return true;
+}
+
+void Snapshot::emit(IRBuilder<>& IRB, const LocalStore& S) const {
+  unsigned AS = S.AI->getType()->getPointerAddressSpace();
+  Value *Addr = IRB.CreatePointerCast(S.AI, S.Ty->getPointerTo(AS));
+
+  Type *T = S.Ty;
+  if (!S.Path.empty()) {
+    SmallVector<Value *, 4> Idxs = {IRB.getInt32(0)};
+    for (unsigned i : S.Path) {
+      if (auto *ST = dyn_cast<StructType>(T)) {
+        Idxs.push_back(IRB.getInt32(i));
+        T = ST->getElementType(i);
+      } else {
+        Idxs.push_back(IRB.getInt64(i));
+        T = T->getArrayElementType();
+      }
+    }
+    Addr = IRB.CreateInBoundsGEP(S.Ty, Addr, Idxs);
+  }
+
+  Value *V = S.C ? S.C : getValue(IRB, Val(S.P), T);
+  IRB.CreateStore(V, Addr);
+}
+
+bool ConcretePrefix::runOnModule(Module& M) {
+  Function *F = M.getFunction("main");
+  if (!F || F->isDeclaration() || !F->use_empty())
+    return false;
+
+  // the constructors run before main and the destructors may read
+  // the globals after it, we do not interpret either of them
+  for (const char *Name : {"llvm.global_ctors", "llvm.global_dtors"}) {
+    auto *GV = M.getNamedGlobal(Name);
+    if (GV && GV->hasInitializer() && !GV->getInitializer()->isNullValue()) {
+      errs() << "Not running the concrete prefix of main, "
+             << "the module has " << Name << "\n";
+      return false;
+    }
+  }
+
+  const DataLayout& DL = M.getDataLayout();
+
+  // the first run finds how far we can get, the second one stops there
+  // (a failed call could have changed the state)
+  unsigned N;
+  {
+    Interpreter Interp(DL, F);
+    Instruction *Stop;
+    N = Interp.runMain(~0U, Stop);
+  }
+
+  Interpreter Interp(DL, F);
+  Instruction *Stop;
+  Interp.runMain(N, Stop);
+  Snapshot Snap(DL, Interp);
+
+  // the new initializers of globals
+  std::vector<std::pair<GlobalVariable *, Constant *>> Inits;
+  for (Object& O : Interp.getObjects()) {
+    if (O.Depth != 0 || !O.Modified)
+      continue;
+    auto *GV = cast<GlobalVariable>(O.Origin);
+    Inits.emplace_back(GV, Snap.getConstant(O, 0, GV->getValueType()));
+    if (!Inits.back().second) {
+      errs() << "Cannot store the state of " << GV->getName()
+             << " after the concrete prefix of main\n";
+      return false;
+    }
+  }
+
+  // the stores of the contents of locals, in the order of the allocas
+  std::vector<AllocaInst *> Allocas;
+  std::vector<LocalStore> Stores;
+  for (Instruction& I : F->getEntryBlock()) {
+    auto *AI = dyn_cast<AllocaInst>(&I);
+    auto It = AI ? Interp.MainAllocas.find(AI) : Interp.MainAllocas.end();
+    if (It == Interp.MainAllocas.end())
+      continue;
+
+    const Object& O = *It->second;
+    Type *T = AI->getAllocatedType();
+    if (AI->isArrayAllocation() && DL.getTypeAllocSize(T) > 0)
+      T = ArrayType::get(T, O.Bytes.size() / DL.getTypeAllocSize(T));
+
+    SmallVector<unsigned, 4> Path;
+    LocalStore S{AI, T, {}, nullptr, Ptr()};
+    if (!Snap.plan(O, 0, T, Path, S, Stores)) {
+      errs() << "Cannot store the state of " << AI->getName()
+             << " after the concrete prefix of main\n";
+      return false;
+    }
+    Allocas.push_back(AI);
+  }
+
+  // nothing but the allocas was executed
+  if (Stop->getParent() == &F->getEntryBlock() && Inits.empty() &&
+      Stores.empty()) {
+    errs() << "Nothing to execute concretely in main\n";
+    return false;
+  }
+
+  for (auto& GI : Inits)
+    GI.first->setInitializer(GI.second);
+
+  BasicBlock *OldEntry = &F->getEntryBlock();
+  bool StopInEntry = Stop->getParent() == OldEntry;
+  BasicBlock *Resume = Stop->getParent()->splitBasicBlock(Stop, "concrete.resume");
+  BasicBlock *Entry = BasicBlock::Create(M.getContext(), "concrete.prefix",
+                                         F, OldEntry);
+  auto *Br = BranchInst::Create(Resume, Entry);
+  for (AllocaInst *AI : Allocas)
+    AI->moveBefore(Br);
+  // the allocas that were not reached yet stay at the beginning
+  if (StopInEntry) {
+    for (auto It = Resume->begin(); It != Resume->end();) {
+      auto *AI = dyn_cast<AllocaInst>(&*It++);
+      if (AI && isa<Constant>(AI->getArraySize()))
+        AI->moveBefore(Br);
+    }
+  }
+
+  // the blocks that can be still executed
+  SmallPtrSet<BasicBlock *, 32> Reachable;
+  std::vector<BasicBlock *> Queue = {Entry};
+  Reachable.insert(Entry);
+  while (!Queue.empty()) {
+    BasicBlock *B = Queue.back();
+    Queue.pop_back();
+    for (BasicBlock *Succ : successors(B)) {
+      if (Reachable.insert(Succ).second)
+        Queue.push_back(Succ);
+    }
+  }
+
+  // keep the debugging information of the moved locals
+  for (BasicBlock& B : *F) {
+    if (Reachable.count(&B))
+      continue;
+    for (auto It = B.begin(); It != B.end();) {
+      auto *DDI = dyn_cast<DbgDeclareInst>(&*It++);
+      auto *Addr = DDI ? dyn_cast_or_null<Instruction>(DDI->getAddress())
+                       : nullptr;
+      if (Addr && Addr->getParent() == Entry)
+        DDI->moveBefore(Br);
+    }
+  }
+
+  IRBuilder<> IRB(Br);
+  IRB.SetCurrentDebugLocation(Stop->getDebugLoc());
+  for (const LocalStore& S : Stores)
+    Snap.emit(IRB, S);
+
+  // the values computed by the prefix replace the instructions in the code
+  // that can be still executed, the instructions that can be executed
+  // again keep their values after that
+  std::vector<Instruction *> Computed;
+  for (BasicBlock& B : *F) {
+    for (Instruction& I : B) {
+      if (!isa<AllocaInst>(I) && !I.getType()->isVoidTy() &&
+          Interp.Main.Vals.count(&I))
+        Computed.push_back(&I);
+    }
+  }
+
+  for (Instruction *I : Computed) {
+    SmallVector<Use *, 8> Uses;
+    for (Use& U : I->uses()) {
+      auto *UI = cast<Instruction>(U.getUser());
+      auto *PN = dyn_cast<PHINode>(UI);
+      BasicBlock *UB = PN ? PN->getIncomingBlock(U) : UI->getParent();
+      if (Reachable.count(UB) && (PN || UB != I->getParent()))
+        Uses.push_back(&U);
+    }
+    if (Uses.empty())
+      continue;
+
+    SSAUpdater SSA;
+    SSA.Initialize(I->getType(), I->getName());
+    SSA.AddAvailableValue(Entry, Snap.getValue(IRB, Interp.Main.Vals[I],
+                                               I->getType()));
+    if (Reachable.count(I->getParent()))
+      SSA.AddAvailableValue(I->getParent(), I);
+    for (Use *U : Uses)
+      SSA.RewriteUse(*U);
+  }
+
+  removeUnreachableBlocks(*F);
+
+  errs() << "Executed " << N << " instructions of main concretely ("
+         << Interp.getSteps() << " in total), initialized " << Inits.size()
+         << " globals and " << Allocas.size() << " locals\n";
+  return true;
+}
@@ -0,0 +1,206 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Consolidate the calls of __VERIFIER_assume and klee_assume that
+// the passes (removing the error calls and infinite loops, unrolling,
+// bounding the recursion) and the models insert on their own.
+// KLEE handles every call as a call and as a new constraint, so
+// a run of assumes of a block that are separated only by the computation
+// of their conditions
+//
+//   assume(a); c = x < y; assume(c);
+//
+// is merged into one assume of the conjunction at the last call
+//
+//   c = x < y; assume(a & c);
+//
+// The calls are moved only over the instructions that cannot fail
+// or touch the memory (the paths where a does not hold reach exactly
+// the same code). An assume of a true constant is removed and an assume
+// of false is replaced by klee_silent_exit(0) followed by unreachable.
+// The pass runs right before verification (the models are linked).
+
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+namespace {
+
+class ConsolidateAssumes : public FunctionPass {
+  unsigned merged{0};
+  unsigned removed{0};
+  unsigned terminated{0};
+
+  void terminate(CallInst *CI);
+  bool runOnBlock(BasicBlock& B);
+
+public:
+  static char ID;
+
+  ConsolidateAssumes() : FunctionPass(ID) {}
+
+  bool runOnFunction(Function& F) override;
+
+  bool doFinalization(Module& /*M*/) override {
+    if (merged + removed + terminated > 0)
+      errs() << "Merged " << merged << " assumes into the following ones, "
+             << "removed " << removed << " assumes of true and terminated "
+             << terminated << " paths at assumes of false\n";
+    return false;
+  }
+};
+
+} // namespace
+
+static RegisterPass<ConsolidateAssumes> CA("consolidate-assumes",
+                                           "Merge the adjacent assumes and "
+                                           "evaluate the assumes of constants");
+char ConsolidateAssumes::ID;
+
+static bool isAssume(const Instruction *I) {
+  auto *CI = dyn_cast<CallInst>(I);
+  if (!CI)
+    return false;
+#if LLVM_VERSION_MAJOR >= 8
+  if (CI->arg_size() != 1)
+#else
+  if (CI->getNumArgOperands() != 1)
+#endif
+    return false;
+  if (!CI->getArgOperand(0)->getType()->isIntegerTy())
+    return false;
+  auto *F = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+  if (!F)
+    return false;
+  StringRef name = F->getName();
+  return name == "__VERIFIER_assume" || name == "klee_assume";
+}
+
+// the instructions over which we may move an assume: they cannot fail
+// (no divisions, no shifts that KLEE checks), have no side effects
+// and do not access the memory
+static bool isPure(const Instruction& I) {
+  if (isa<DbgInfoIntrinsic>(&I))
+    return true;
+  if (auto *BO = dyn_cast<BinaryOperator>(&I)) {
+    switch (BO->getOpcode()) {
+    case Instruction::UDiv:
+    case Instruction::SDiv:
+    case Instruction::URem:
+    case Instruction::SRem:
+    case Instruction::Shl:
+    case Instruction::LShr:
+    case Instruction::AShr:
+      return false;
+    default:
+      return true;
+    }
+  }
+  return isa<CmpInst>(&I) || isa<CastInst>(&I) || isa<SelectInst>(&I) ||
+         isa<GetElementPtrInst>(&I) || isa<ExtractValueInst>(&I);
+}
+
+// the assumed condition as i1
+static Value *getCondition(IRBuilder<>& B, Value *arg) {
+  if (arg->getType()->isIntegerTy(1))
+    return arg;
+  if (auto *Ext = dyn_cast<ZExtInst>(arg)) {
+    if (Ext->getOperand(0)->getType()->isIntegerTy(1))
+      return Ext->getOperand(0);
+  }
+  return B.CreateICmpNE(arg, ConstantInt::get(arg->getType(), 0));
+}
+
+// the rest of the block after the call is never executed
+void ConsolidateAssumes::terminate(CallInst *CI) {
+  Module *M = CI->getModule();
+  LLVMContext& Ctx = M->getContext();
+  Type *I32 = Type::getInt32Ty(Ctx);
+  auto exitF = insertFunction(*M, "klee_silent_exit",
+                              Type::getVoidTy(Ctx), {I32});
+  auto *exitCI = CallInst::Create(exitF, {ConstantInt::get(I32, 0)}, "", CI);
+  exitCI->setDoesNotReturn();
+  exitCI->setDebugLoc(CI->getDebugLoc());
+
+  BasicBlock *B = CI->getParent();
+  for (auto *succ : successors(B))
+    succ->removePredecessor(B);
+  while (&B->back() != exitCI) {
+    Instruction& I = B->back();
+    I.replaceAllUsesWith(UndefValue::get(I.getType()));
+    I.eraseFromParent();
+  }
+  new UnreachableInst(Ctx, B);
+  ++terminated;
+}
+
+bool ConsolidateAssumes::runOnBlock(BasicBlock& B) {
+  bool changed = false;
+  // the last assume that we can merge into the next one
+  CallInst *pending = nullptr;
+  for (auto it = B.begin(); it != B.end();) {
+    // (the instructions that we erase are all before it)
+    Instruction *I = &*it++;
+    if (!isAssume(I)) {
+      if (!isPure(*I))
+        pending = nullptr;
+      continue;
+    }
+
+    auto *CI = cast<CallInst>(I);
+    Value *arg = CI->getArgOperand(0);
+    if (auto *C = dyn_cast<ConstantInt>(arg)) {
+      if (C->isZero()) {
+        terminate(CI);
+        return true;
+      }
+      CI->eraseFromParent();
+      ++removed;
+      changed = true;
+      continue;
+    }
+
+    if (pending) {
+      IRBuilder<> Builder(CI);
+      Value *prev = pending->getArgOperand(0);
+      Value *both = Builder.CreateAnd(getCondition(Builder, prev),
+                                      getCondition(Builder, arg));
+      CI->setArgOperand(0, Builder.CreateZExt(both, arg->getType()));
+      pending->eraseFromParent();
+      RecursivelyDeleteTriviallyDeadInstructions(prev);
+      RecursivelyDeleteTriviallyDeadInstructions(arg);
+      ++merged;
+      changed = true;
+    }
+    pending = CI;
+  }
+  return changed;
+}
+
+bool ConsolidateAssumes::runOnFunction(Function& F) {
+  unsigned before = terminated;
+  bool changed = false;
+  for (BasicBlock& B : F)
+    changed |= runOnBlock(B);
+  // the blocks after the assumes of false
+  if (terminated > before)
+    removeUnreachableBlocks(F);
+  return changed;
+}
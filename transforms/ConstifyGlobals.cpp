@@ -0,0 +1,266 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Mark constant the globals that the program never writes, so that
+// the loads from them can be folded and the verifiers do not track them
+// as mutable memory. A global is a candidate if its address does not
+// escape: it is only loaded from, used as the source of memcpy, compared
+// or offset (by getelementptr and casts).
+//
+// The candidates that are written only by stores of constants at the very
+// beginning of main (before any call that could read them and before
+// any read of them) get the stored values into their initializers
+// and are marked constant too. The calls of the input functions
+// (e.g., from -internalize-globals) do not stop the search for such
+// stores, they access only their arguments.
+
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace {
+
+// the accesses to a global
+struct Accesses {
+  std::vector<StoreInst *> Stores;
+  std::vector<Instruction *> Reads;
+  bool Escapes{false};
+};
+
+class ConstifyGlobals : public ModulePass {
+  void collect(Value *V, Accesses& A);
+
+public:
+  static char ID;
+
+  ConstifyGlobals() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<ConstifyGlobals> CG("constify-globals",
+                                        "Mark constant the globals that "
+                                        "are never written");
+char ConstifyGlobals::ID;
+
+void ConstifyGlobals::collect(Value *V, Accesses& A) {
+  for (User *U : V->users()) {
+    if (A.Escapes)
+      return;
+
+    if (auto *CE = dyn_cast<ConstantExpr>(U)) {
+      if (CE->getOpcode() == Instruction::GetElementPtr ||
+          CE->getOpcode() == Instruction::BitCast ||
+          CE->getOpcode() == Instruction::AddrSpaceCast)
+        collect(CE, A);
+      else
+        A.Escapes = true;
+      continue;
+    }
+
+    // used in an initializer of another global etc.
+    auto *I = dyn_cast<Instruction>(U);
+    if (!I) {
+      A.Escapes = true;
+      continue;
+    }
+
+    if (auto *LI = dyn_cast<LoadInst>(I)) {
+      // somebody else can change the memory under volatile accesses
+      if (!LI->isSimple())
+        A.Escapes = true;
+      A.Reads.push_back(LI);
+    } else if (auto *SI = dyn_cast<StoreInst>(I)) {
+      if (SI->getValueOperand() == V || !SI->isSimple())
+        A.Escapes = true;
+      A.Stores.push_back(SI);
+    } else if (isa<GetElementPtrInst>(I) || isa<BitCastInst>(I) ||
+               isa<AddrSpaceCastInst>(I)) {
+      collect(I, A);
+    } else if (auto *MT = dyn_cast<MemTransferInst>(I)) {
+      if (MT->getRawDest() == V || MT->isVolatile())
+        A.Escapes = true;
+      A.Reads.push_back(MT);
+    } else if (!isa<ICmpInst>(I)) {
+      A.Escapes = true;
+    }
+  }
+}
+
+// the calls that access only the memory given in their arguments
+static bool isInputCall(const CallInst *CI) {
+  if (isa<DbgInfoIntrinsic>(CI))
+    return true;
+
+  const Function *F = CI->getCalledFunction();
+  if (!F || !F->isDeclaration())
+    return false;
+
+  StringRef name = F->getName();
+  return name.startswith("__VERIFIER_nondet_") ||
+         name == "__VERIFIER_make_nondet" ||
+         name == "klee_make_symbolic" || name == "klee_make_nondet";
+}
+
+// the initializer with the value V at the offset Off (nullptr if V does
+// not cover exactly one element)
+static Constant *replaceAt(const DataLayout& DL, Constant *Init, uint64_t Off,
+                           Constant *V) {
+  Type *T = Init->getType();
+  if (Off == 0 && T == V->getType())
+    return V;
+
+  SmallVector<Constant *, 16> Elems;
+  if (auto *ST = dyn_cast<StructType>(T)) {
+    const StructLayout *SL = DL.getStructLayout(ST);
+    if (Off >= SL->getSizeInBytes())
+      return nullptr;
+
+    unsigned Idx = SL->getElementContainingOffset(Off);
+    for (unsigned i = 0; i < ST->getNumElements(); ++i)
+      Elems.push_back(Init->getAggregateElement(i));
+    Elems[Idx] = replaceAt(DL, Elems[Idx], Off - SL->getElementOffset(Idx), V);
+    if (!Elems[Idx])
+      return nullptr;
+    return ConstantStruct::get(ST, Elems);
+  }
+
+  if (auto *AT = dyn_cast<ArrayType>(T)) {
+    uint64_t Size = DL.getTypeAllocSize(AT->getElementType());
+    if (Size == 0 || Off / Size >= AT->getNumElements())
+      return nullptr;
+
+    uint64_t Idx = Off / Size;
+    for (uint64_t i = 0; i < AT->getNumElements(); ++i)
+      Elems.push_back(Init->getAggregateElement(i));
+    Elems[Idx] = replaceAt(DL, Elems[Idx], Off - Idx * Size, V);
+    if (!Elems[Idx])
+      return nullptr;
+    return ConstantArray::get(AT, Elems);
+  }
+
+  return nullptr;
+}
+
+bool ConstifyGlobals::runOnModule(Module& M) {
+  const DataLayout& DL = M.getDataLayout();
+
+  std::vector<GlobalVariable *> candidates;
+  DenseMap<GlobalVariable *, Accesses> accesses;
+  DenseMap<const Instruction *, GlobalVariable *> readerOf;
+  for (GlobalVariable& GV : M.globals()) {
+    if (GV.isConstant() || !GV.hasInitializer() ||
+        GV.isExternallyInitialized() || GV.getName().startswith("llvm."))
+      continue;
+    // a common global cannot be constant and the initializer of other
+    // globals may be replaced by another definition at link time
+    if (GV.hasCommonLinkage() || GV.isInterposable())
+      continue;
+#if LLVM_VERSION_MAJOR >= 4
+    if (!GV.hasExactDefinition())
+      continue;
+#endif
+
+    Accesses& A = accesses[&GV];
+    collect(&GV, A);
+    if (A.Escapes)
+      continue;
+
+    candidates.push_back(&GV);
+    for (Instruction *I : A.Reads)
+      readerOf[I] = &GV;
+  }
+
+  // the stores of constants at the beginning of main, with the offsets
+  // into the globals
+  DenseMap<GlobalVariable *, std::vector<std::pair<uint64_t, StoreInst *>>> early;
+  Function *F = M.getFunction("main");
+  if (F && !F->isDeclaration() && F->use_empty()) {
+    SmallPtrSet<GlobalVariable *, 16> read;
+    for (Instruction& I : F->getEntryBlock()) {
+      auto It = readerOf.find(&I);
+      if (It != readerOf.end()) {
+        read.insert(It->second);
+        continue;
+      }
+
+      if (auto *SI = dyn_cast<StoreInst>(&I)) {
+        auto *V = dyn_cast<Constant>(SI->getValueOperand());
+#if LLVM_VERSION_MAJOR >= 10
+        APInt Off(DL.getIndexTypeSizeInBits(SI->getPointerOperandType()), 0);
+        Value *Base = SI->getPointerOperand()
+                        ->stripAndAccumulateConstantOffsets(DL, Off, true);
+#else
+        APInt Off(DL.getPointerTypeSizeInBits(SI->getPointerOperandType()), 0);
+        Value *Base = SI->getPointerOperand()
+                        ->stripAndAccumulateInBoundsConstantOffsets(DL, Off);
+#endif
+        auto *GV = dyn_cast<GlobalVariable>(Base);
+        if (V && GV && !read.count(GV) && !Off.isNegative() &&
+            accesses.count(GV))
+          early[GV].emplace_back(Off.getZExtValue(), SI);
+        continue;
+      }
+
+      if (auto *CI = dyn_cast<CallInst>(&I)) {
+        if (!isInputCall(CI))
+          break;
+        continue;
+      }
+
+      // e.g., atomic instructions
+      if (I.mayReadOrWriteMemory())
+        break;
+    }
+  }
+
+  unsigned constified = 0, folded = 0;
+  for (GlobalVariable *GV : candidates) {
+    const Accesses& A = accesses[GV];
+    if (!A.Stores.empty()) {
+      // all the stores must be at the beginning of main
+      auto It = early.find(GV);
+      if (It == early.end() || It->second.size() != A.Stores.size())
+        continue;
+
+      Constant *Init = GV->getInitializer();
+      for (auto& store : It->second) {
+        Init = replaceAt(DL, Init, store.first,
+                         cast<Constant>(store.second->getValueOperand()));
+        if (!Init)
+          break;
+      }
+      if (!Init)
+        continue;
+
+      GV->setInitializer(Init);
+      for (auto& store : It->second)
+        store.second->eraseFromParent();
+      ++folded;
+    }
+
+    GV->setConstant(true);
+    ++constified;
+  }
+
+  errs() << "Made " << constified << " globals constant ("
+         << folded << " with the initial stores from main)\n";
+  return constified > 0;
+}
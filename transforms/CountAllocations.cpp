@@ -0,0 +1,224 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Count the allocated objects that were not freed yet and check
+// at the end of the program that the count is 0 (valid-memcleanup).
+// Every allocation that succeeded increments the counter
+// __symbiotic_allocations, every free of a non-null pointer decrements it
+// and realloc changes it as it allocates (from null) or frees
+// (to the size 0). Before calls of exit and at the returns from main
+// (or in the last destructor if the module has destructors, e.g., atexit
+// handlers may free the memory), a non-zero counter is reported by
+//
+//   __assert_fail("memory not cleaned up", ...)
+//
+// This replaces the check of KLEE (-check-memcleanup) that walks
+// all the live objects at the end of every path by one comparison,
+// the objects that leaked are in the test of the failing path.
+// The counting is the same as the check only if the memory is allocated
+// and freed through the functions below (the models of the others
+// call them), the double frees and the frees of invalid pointers
+// are not a part of memcleanup.
+
+#include <vector>
+
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+namespace {
+
+enum class CallKind { None, Alloc, Realloc, Free, Exit };
+
+static CallKind getKind(const CallInst *CI) {
+  auto *F = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+  if (!F || !F->isDeclaration())
+    return CallKind::None;
+  return StringSwitch<CallKind>(F->getName())
+      .Cases("malloc", "calloc", "aligned_alloc", "memalign", "valloc",
+             CallKind::Alloc)
+      .Case("realloc", CallKind::Realloc)
+      .Case("free", CallKind::Free)
+      .Cases("exit", "_exit", "_Exit", CallKind::Exit)
+      .Default(CallKind::None);
+}
+
+class CountAllocations : public ModulePass {
+  GlobalVariable *counter{nullptr};
+  Function *check{nullptr};
+  unsigned sites{0};
+
+  void add(IRBuilder<>& B, Value *delta);
+  void countCall(CallInst *CI, CallKind kind);
+  Function *getCheck(Module& M);
+  void insertCheck(Module& M, Instruction *I);
+
+public:
+  static char ID;
+
+  CountAllocations() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<CountAllocations> CA("count-allocations",
+                                         "Count the allocated objects and "
+                                         "check at the exit that none is left");
+char CountAllocations::ID;
+
+// counter += delta (of type i1 or i64) at the builder
+void CountAllocations::add(IRBuilder<>& B, Value *delta) {
+  Type *Ty = counter->getValueType();
+  Value *old = B.CreateLoad(Ty, counter);
+  B.CreateStore(B.CreateAdd(old, B.CreateZExt(delta, Ty)), counter);
+}
+
+void CountAllocations::countCall(CallInst *CI, CallKind kind) {
+  switch (kind) {
+  case CallKind::Alloc: {
+    IRBuilder<> B(CI->getNextNode());
+    add(B, B.CreateIsNotNull(CI));
+    break;
+  }
+  case CallKind::Realloc: {
+    // allocates if the pointer is null, frees if the size is 0
+    // and the result is null (a failed realloc keeps the memory)
+    IRBuilder<> B(CI->getNextNode());
+    Type *Ty = counter->getValueType();
+    Value *ptr = CI->getArgOperand(0);
+    Value *size = CI->getArgOperand(1);
+    Value *allocated = B.CreateAnd(B.CreateIsNull(ptr), B.CreateIsNotNull(CI));
+    Value *freed = B.CreateAnd(B.CreateAnd(B.CreateIsNotNull(ptr),
+                                           B.CreateIsNull(size)),
+                               B.CreateIsNull(CI));
+    add(B, B.CreateSub(B.CreateZExt(allocated, Ty), B.CreateZExt(freed, Ty)));
+    break;
+  }
+  case CallKind::Free: {
+    IRBuilder<> B(CI);
+    Type *Ty = counter->getValueType();
+    Value *old = B.CreateLoad(Ty, counter);
+    Value *freed = B.CreateZExt(B.CreateIsNotNull(CI->getArgOperand(0)), Ty);
+    B.CreateStore(B.CreateSub(old, freed), counter);
+    break;
+  }
+  default:
+    return;
+  }
+  ++sites;
+}
+
+// void __symbiotic_check_allocations(void) {
+//   if (__symbiotic_allocations != 0)
+//     __assert_fail("memory not cleaned up", ...);
+// }
+Function *CountAllocations::getCheck(Module& M) {
+  if (check)
+    return check;
+
+  LLVMContext& Ctx = M.getContext();
+  check = Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false),
+                           GlobalValue::InternalLinkage,
+                           "__symbiotic_check_allocations", &M);
+  BasicBlock *entry = BasicBlock::Create(Ctx, "entry", check);
+  BasicBlock *leak = BasicBlock::Create(Ctx, "leak", check);
+  BasicBlock *done = BasicBlock::Create(Ctx, "done", check);
+
+  IRBuilder<> B(entry);
+  Value *left = B.CreateLoad(counter->getValueType(), counter);
+  B.CreateCondBr(B.CreateIsNotNull(left), leak, done);
+
+  B.SetInsertPoint(leak);
+  Type *CharPtr = Type::getInt8PtrTy(Ctx);
+  Type *Int = Type::getInt32Ty(Ctx);
+  auto assertFail = M.getOrInsertFunction(
+      "__assert_fail",
+      FunctionType::get(Type::getVoidTy(Ctx),
+                        {CharPtr, CharPtr, Int, CharPtr}, false));
+  B.CreateCall(assertFail, {B.CreateGlobalStringPtr("memory not cleaned up"),
+                            B.CreateGlobalStringPtr(M.getSourceFileName()),
+                            ConstantInt::get(Int, 0),
+                            B.CreateGlobalStringPtr("main")});
+  B.CreateUnreachable();
+
+  B.SetInsertPoint(done);
+  B.CreateRetVoid();
+  return check;
+}
+
+void CountAllocations::insertCheck(Module& M, Instruction *I) {
+  CallInst::Create(getCheck(M), "", I);
+}
+
+static bool hasDestructors(Module& M) {
+  auto *dtors = M.getNamedGlobal("llvm.global_dtors");
+  if (!dtors || !dtors->hasInitializer())
+    return false;
+  auto *arr = dyn_cast<ConstantArray>(dtors->getInitializer());
+  return arr && arr->getNumOperands() > 0;
+}
+
+bool CountAllocations::runOnModule(Module& M) {
+  Function *main = M.getFunction("main");
+  if (!main || main->isDeclaration())
+    return false;
+
+  counter = new GlobalVariable(M, Type::getInt64Ty(M.getContext()), false,
+                               GlobalValue::InternalLinkage,
+                               ConstantInt::get(Type::getInt64Ty(M.getContext()),
+                                                0),
+                               "__symbiotic_allocations");
+
+  std::vector<std::pair<CallInst *, CallKind>> calls;
+  std::vector<ReturnInst *> returns;
+  for (Function& F : M) {
+    for (Instruction& I : instructions(F)) {
+      if (auto *CI = dyn_cast<CallInst>(&I)) {
+        CallKind kind = getKind(CI);
+        if (kind != CallKind::None)
+          calls.emplace_back(CI, kind);
+      } else if (auto *RI = dyn_cast<ReturnInst>(&I)) {
+        if (&F == main)
+          returns.push_back(RI);
+      }
+    }
+  }
+
+  unsigned exits = 0;
+  for (auto& call : calls) {
+    if (call.second == CallKind::Exit) {
+      insertCheck(M, call.first);
+      ++exits;
+    } else {
+      countCall(call.first, call.second);
+    }
+  }
+
+  // the destructors run after main returns, check after the last one
+  if (hasDestructors(M))
+    appendToGlobalDtors(M, getCheck(M), 0);
+  else {
+    for (ReturnInst *RI : returns)
+      insertCheck(M, RI);
+  }
+
+  errs() << "Counted the allocations at " << sites << " calls, checking "
+         << exits << " calls of exit and the end of main\n";
+  return true;
+}
@@ -18,7 +18,20 @@
 
 using namespace llvm;
 
-static void print_statistics(llvm::Module *M, const char *prefix = nullptr)
+// the number of instructions in the defined functions,
+// used also by sbt-pipeline (the growth budgets of stages)
+uint64_t count_instructions(const llvm::Module *M)
+{
+    uint64_t inum = 0;
+    for (const Function& F : *M) {
+        for (const BasicBlock& B : F)
+            inum += B.size();
+    }
+    return inum;
+}
+
+// used also by sbt-pipeline
+void print_statistics(llvm::Module *M, const char *prefix = nullptr)
 {
     using namespace llvm;
     uint64_t inum, bnum, fnum, gnum;
@@ -18,6 +18,8 @@
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Support/CommandLine.h"
 
+#include "Compat.h"
+
 using namespace llvm;
 
 static cl::list<std::string> calls("delete-call",
@@ -49,11 +51,7 @@ bool DeleteFuns::runOnFunction(Function &F) {
       if (!CI)
           continue;
 
-#if LLVM_VERSION_MAJOR < 8
-      auto *op = CI->getCalledValue()->stripPointerCasts();
-#else
-      auto *op = CI->getCalledOperand()->stripPointerCasts();
-#endif
+      auto *op = calleeOf(CI)->stripPointerCasts();
 
       auto *fun = dyn_cast<Function>(op);
       if (!fun)
@@ -189,22 +187,16 @@ bool Prepare::replace_ldv_calls(Module& M, Function &F) {
       Constant *new_func = nullptr;
       if (name.equals("ldv_assume")) {
         Type *argTy = Type::getInt32Ty(Ctx);
-        new_func = M.getOrInsertFunction("__VERIFIER_assume", Type::getVoidTy(Ctx),
-                                         argTy
-#if LLVM_VERSION_MAJOR < 5
-                                       , nullptr
-#endif
-                                       );
+        new_func = insertFunction(M, "__VERIFIER_assume",
+                                  Type::getVoidTy(Ctx),
+                                  {argTy});
 
         args.push_back(CI->getOperand(0));
       } else if (name.equals("ldv_stop")) {
         Type *argTy = Type::getInt32Ty(Ctx);
-        new_func = M.getOrInsertFunction("__VERIFIER_silent_exit", Type::getVoidTy(Ctx),
-                                         argTy
-#if LLVM_VERSION_MAJOR < 5
-                                       , nullptr
-#endif
-                                       );
+        new_func = insertFunction(M, "__VERIFIER_silent_exit",
+                                  Type::getVoidTy(Ctx),
+                                  {argTy});
 
         args.push_back(ConstantInt::get(argTy, 0));
       }
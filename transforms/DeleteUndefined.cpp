@@ -5,9 +5,10 @@
 
 #include <cassert>
 #include <vector>
-#include <set>
-#include <unordered_map>
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
@@ -22,6 +23,8 @@
 #else
   #include "llvm/Support/InstIterator.h"
 #endif
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include <llvm/IR/DebugInfoMetadata.h>
@@ -30,23 +33,28 @@
 #include <llvm/Support/Error.h>
 #endif
 
+#include "Compat.h"
+#include "NondetBuilder.h"
+
 using namespace llvm;
 
 bool CloneMetadata(const llvm::Instruction *, llvm::Instruction *);
 
 class DeleteUndefined : public ModulePass {
-  Function *_vms = nullptr; // verifier_make_symbolic function
-  Type *_size_t_Ty = nullptr; // type of size_t
+  std::unique_ptr<NondetBuilder> _nondet;
   bool _nosym; // do not use symbolic values when replacing
 
-  // add global of given type and initialize it in may as nondeterministic
-  Function *get_verifier_make_nondet(llvm::Module *);
-  Type *get_size_t(llvm::Module *);
-
-  unsigned int calls_count = 0;
+  // per-module state (one process may run the pass on several modules):
+  // should the calls of the function be kept (cached result of keepCalls())
+  DenseMap<const Function *, bool> _keep;
+  // the functions whose calls we removed, so that we print them only once
+  SmallPtrSet<const Function *, 16> _removed_calls;
 
+  bool keepCalls(const Function *F);
   //void replaceCall(CallInst *CI, Module *M);
   void defineFunction(Module *M, Function *F);
+  Value *createNondet(Module *M, Function *F, BasicBlock *block);
+  bool defineSummary(Module *M, Function *F, BasicBlock *block);
 protected:
   DeleteUndefined(char id) : ModulePass(id), _nosym(true) {}
 
@@ -76,124 +84,64 @@ static RegisterPass<DeleteUndefinedNoSym> DLTUNS("delete-undefined-nosym",
                                           "possible return value is made 0");
 char DeleteUndefinedNoSym::ID;
 
+// the functions from lib/keep-calls.txt
 static const char *leave_calls[] = {
-// KLEE
-  "klee_make_symbolic",
-  "klee_assume",
-  "klee_abort",
-  "klee_silent_exit",
-  "klee_report_error",
-  "klee_warning_once",
-  "klee_int",
-// standard library
-  "__assert_fail",
-  "abort",
-  "exit",
-  "_exit",
-  "malloc",
-  "calloc",
-  "realloc",
-  "free",
-  "memset",
-  "memcmp",
-  "memcpy",
-  "memmove",
-  "__errno_location",
-  "__ctype_b_loc",
-  "rint",
-  "rintf",
-  "rintl",
-  "lrint",
-  "lrintf",
-  "lrintl",
-  "llrint",
-  "llrintf",
-  "llrintl",
-  "nearbyint",
-  "nearbyintf",
-  "nearbyintl",
-  "remainder",
-  "remainderf",
-  "remainderl",
-  "drem",
-  "dremf",
-  "dreml",
-  "trunc",
-  "truncf",
-  "truncl",
-// fp stuff
-  "nan",
-  "nanf",
-  "nanl",
-  "fmax",
-  "fmaxf",
-  "fmaxl",
-  "frexp",
-  "ldexp",
-  "fabsf",
-  "fdim",
-  "fmin",
-  "fminf",
-  "fminl",
-  "fmaxf",
-  "fmaxl",
-  "modf",
-  "modff",
-  "modfl",
-  "copysign",
-  "copysignf",
-  "copysignl",
-  "__isnan",
-  "__isnanf",
-  "__isnanl",
-  "__isinf",
-  "__isinff",
-  "__isinfl",
-  "__fpclassify",
-  "__fpclassifyf",
-  "__fpclassifyl",
-  "__signbit",
-  "__signbitf",
-  "__signbitl",
-  "__finite",
-  "__finite1",
-  "__finitef",
-  "fesetround",
-  "round",
-  "roundf",
-  "roundl",
-  "fmod",
-  "fmodf",
-  "fmodl",
-// C++
-  "_ZdaPv",
-  "_ZdlPv",
-  "_Znaj",
-  "_Znwj",
-  "_Znam",
-  "_Znwm",
-// pthread stuff
-  "pthread_mutex_lock",
-  "pthread_mutex_unlock",
-  "pthread_mutex_init",
-  "pthread_create",
-  "pthread_exit",
-  "pthread_join",
-  "pthread_cond_init",
-  "pthread_cond_wait",
-  "pthread_cond_signal",
-  "pthread_cond_broadcast",
-// misc
-  "kzalloc",
+#include "KeepCalls.inc"
   nullptr
 };
 
-static bool array_match(const StringRef &name, const char **array)
+static cl::list<std::string> keep_files("delete-undefined-keep",
+        cl::desc("A file with the names of functions (one per line)\n"
+                 "whose calls should be kept, in addition to the built-in\n"
+                 "list (e.g., the functions that have models)"),
+        cl::value_desc("filename"));
+
+static cl::opt<bool> use_summaries("delete-undefined-summaries",
+        cl::desc("Use the attributes of undefined functions (nonnull,\n"
+                 "dereferenceable) and the !range metadata of their calls\n"
+                 "to build tighter bodies (default=false)"),
+        cl::init(false));
+
+static const StringSet<>& getLeaveCalls()
+{
+  static const StringSet<> calls = [] {
+    StringSet<> set;
+    for (const char **curr = leave_calls; *curr; curr++)
+      set.insert(*curr);
+
+    for (const auto& path : keep_files) {
+      auto buf = MemoryBuffer::getFile(path);
+      if (!buf) {
+        errs() << "Failed opening " << path << ": "
+               << buf.getError().message() << "\n";
+        continue;
+      }
+
+      SmallVector<StringRef, 128> lines;
+      (*buf)->getBuffer().split(lines, '\n', -1, false);
+      for (StringRef line : lines) {
+        line = line.trim();
+        if (!line.empty() && !line.startswith("#"))
+          set.insert(line);
+      }
+    }
+    return set;
+  }();
+  return calls;
+}
+
+// the calls of __VERIFIER_* functions and of the functions that
+// the verifiers know are kept
+bool DeleteUndefined::keepCalls(const Function *F)
 {
-  for (const char **curr = array; *curr; curr++)
-    if (name.equals(*curr))
-      return true;
-  return false;
+  auto it = _keep.find(F);
+  if (it != _keep.end())
+    return it->second;
+
+  const auto& name = F->getName();
+  bool keep = name.startswith("__VERIFIER_") || getLeaveCalls().count(name) > 0;
+  _keep[F] = keep;
+  return keep;
 }
 
 bool DeleteUndefined::runOnModule(Module& M) {
@@ -208,6 +156,10 @@ bool DeleteUndefined::runOnModule(Module& M) {
     M.materializeAll();
 #endif
 
+    _nondet.reset(new NondetBuilder(M));
+    _keep.clear();
+    _removed_calls.clear();
+
     // delete/replace the calls in the rest of functions
     bool modified = false;
     for (auto& F : M.getFunctionList()) {
@@ -217,77 +169,136 @@ bool DeleteUndefined::runOnModule(Module& M) {
       modified |= runOnFunction(F);
     }
 
+    _nondet->finish();
     return modified;
 }
 
-static unsigned getKleeMakeNondetCounter(const Function *F) {
-    using namespace llvm;
-
-    unsigned max = 0;
-    for (auto I = F->use_begin(), E = F->use_end(); I != E; ++I) {
-#if ((LLVM_VERSION_MAJOR == 3) && (LLVM_VERSION_MINOR < 5))
-        const Value *use = *I;
-#else
-        const Value *use = I->getUser();
-#endif
-        auto CI = dyn_cast<CallInst>(use);
-        assert(CI && "The use is not call");
-
-        auto C = dyn_cast<ConstantInt>(CI->getArgOperand(3));
-        assert(C && "Invalid operand in klee_make_nondet");
+// create a symbolic value of the return type of F at the end of the block
+Value *DeleteUndefined::createNondet(Module *M, Function *F, BasicBlock *block)
+{
+  LLVMContext& Ctx = M->getContext();
+  Type *Ty = F->getReturnType();
+  AllocaInst *AI = makeAlloca(Ty, M->getDataLayout(), "", block);
+
+  CastInst *CastI = CastInst::CreatePointerCast(AI, Type::getInt8PtrTy(Ctx));
+  CastI->insertAfter(AI);
+
+  std::string namestr = F->getName().str();
+  namestr += ":undeffun:0";
+  CallInst *CI = _nondet->createCall(CastI,
+                                     ConstantInt::get(_nondet->getSizeT(),
+                                     M->getDataLayout().getTypeAllocSize(Ty)),
+                                     namestr);
+  CI->insertAfter(CastI);
+
+  return new LoadInst(
+      AI->getType()->getPointerElementType(),
+      AI,
+      "undefret",
+      block);
+}
 
-        auto val = C->getZExtValue();
-        if (val > max)
-            max = val;
-    }
+// the !range metadata if all the calls of F have the same one
+static MDNode *getCallsRange(Function *F)
+{
+  MDNode *range = nullptr;
+  for (auto *U : F->users()) {
+    auto *CI = dyn_cast<CallInst>(U);
+    if (!CI || CI->getCalledFunction() != F)
+      return nullptr;
+
+    MDNode *N = CI->getMetadata(LLVMContext::MD_range);
+    if (!N || (range && range != N))
+      return nullptr;
+    range = N;
+  }
 
-    return max;
+  return range;
 }
 
-Function *DeleteUndefined::get_verifier_make_nondet(llvm::Module *M)
+// Build the body of F from what we know about its return value:
+// a nonnull or dereferenceable pointer points to a fresh object
+// (allocated by the __VERIFIER_malloc models) and an integer
+// is constrained to the ranges from the !range metadata of the calls.
+// Return false if there is nothing to use (the block is left untouched).
+bool DeleteUndefined::defineSummary(Module *M, Function *F, BasicBlock *block)
 {
-  if (_vms)
-    return _vms;
-
   LLVMContext& Ctx = M->getContext();
-  //void verifier_make_symbolic(void *addr, size_t nbytes, const char *name);
-  auto C = M->getOrInsertFunction("klee_make_nondet",
-                                  Type::getVoidTy(Ctx),
-                                  Type::getInt8PtrTy(Ctx), // addr
-                                  get_size_t(M),   // nbytes
-                                  Type::getInt8PtrTy(Ctx), // name
-                                  Type::getInt32Ty(Ctx) // identifier
-#if LLVM_VERSION_MAJOR < 5
-                                  , nullptr
-#endif
-                                  );
-
-#if LLVM_VERSION_MAJOR >= 9
-  _vms = cast<Function>(C.getCallee());
+  Type *Ty = F->getReturnType();
+  const AttributeList& attrs = F->getAttributes();
+
+  if (auto *PTy = dyn_cast<PointerType>(Ty)) {
+#if LLVM_VERSION_MAJOR >= 14
+    uint64_t size = attrs.getRetDereferenceableBytes();
+    uint64_t size_or_null = attrs.getRetDereferenceableOrNullBytes();
+    bool nonnull = attrs.hasRetAttr(Attribute::NonNull);
 #else
-  _vms = cast<Function>(C);
+    uint64_t size = attrs.getDereferenceableBytes(AttributeList::ReturnIndex);
+    uint64_t size_or_null
+      = attrs.getDereferenceableOrNullBytes(AttributeList::ReturnIndex);
+    bool nonnull = attrs.hasAttribute(AttributeList::ReturnIndex,
+                                      Attribute::NonNull);
 #endif
+    bool may_be_null = false;
+    if (size > 0) {
+      // dereferenceable implies nonnull
+    } else if (size_or_null > 0) {
+      size = size_or_null;
+      may_be_null = !nonnull;
+    } else if (nonnull) {
+      Type *ElemTy = PTy->getPointerElementType();
+      if (!ElemTy->isSized())
+        return false;
+      size = M->getDataLayout().getTypeAllocSize(ElemTy);
+    }
 
-  calls_count = getKleeMakeNondetCounter(_vms);
+    if (size == 0)
+      return false;
+
+    auto C = insertFunction(*M, may_be_null ? "__VERIFIER_malloc" : "__VERIFIER_malloc0",
+                            Type::getInt8PtrTy(Ctx),
+                            {_nondet->getSizeT()});
+    Function *AllocF = functionOf(C);
+    CallInst *CI = CallInst::Create(AllocF,
+                                    {ConstantInt::get(_nondet->getSizeT(), size)},
+                                    "undefret", block);
+    Value *ret = CI;
+    if (Ty != CI->getType())
+      ret = CastInst::CreatePointerCast(CI, Ty, "", block);
+    ReturnInst::Create(Ctx, ret, block);
+    return true;
+  }
 
-  return _vms;
-}
+  if (!Ty->isIntegerTy())
+    return false;
 
-Type *DeleteUndefined::get_size_t(llvm::Module *M)
-{
-  if (_size_t_Ty)
-    return _size_t_Ty;
+  MDNode *range = getCallsRange(F);
+  if (!range)
+    return false;
 
-  std::unique_ptr<DataLayout> DL
-    = std::unique_ptr<DataLayout>(new DataLayout(M->getDataLayout()));
-  LLVMContext& Ctx = M->getContext();
+  // the value is in one of the (possibly wrapping) ranges [lo, hi)
+  Value *val = createNondet(M, F, block);
+  Value *cond = nullptr;
+  for (unsigned i = 0; i + 1 < range->getNumOperands(); i += 2) {
+    auto *lo = mdconst::extract<ConstantInt>(range->getOperand(i));
+    auto *hi = mdconst::extract<ConstantInt>(range->getOperand(i + 1));
+    Value *off = BinaryOperator::CreateSub(val, lo, "", block);
+    Value *in = new ICmpInst(*block, ICmpInst::ICMP_ULT, off,
+                             ConstantExpr::getSub(hi, lo));
+    cond = cond ? BinaryOperator::CreateOr(cond, in, "", block) : in;
+  }
 
-  if (DL->getPointerSizeInBits() > 32)
-    _size_t_Ty = Type::getInt64Ty(Ctx);
-  else
-    _size_t_Ty = Type::getInt32Ty(Ctx);
+  if (!cond)
+    return false;
 
-  return _size_t_Ty;
+  auto C = insertFunction(*M, "__VERIFIER_assume",
+                          Type::getVoidTy(Ctx),
+                          {Type::getInt32Ty(Ctx)});
+  Function *AssumeF = functionOf(C);
+  CallInst::Create(AssumeF, {new ZExtInst(cond, Type::getInt32Ty(Ctx), "", block)},
+                   "", block);
+  ReturnInst::Create(Ctx, val, block);
+  return true;
 }
 
 void DeleteUndefined::defineFunction(Module *M, Function *F)
@@ -301,44 +312,8 @@ void DeleteUndefined::defineFunction(Module *M, Function *F)
     // replace the return value with 0, since we don't want
     // to use the symbolic value
     ReturnInst::Create(Ctx, Constant::getNullValue(F->getReturnType()), block);
-  } else {
-    Type *Ty = F->getReturnType();
-    AllocaInst *AI = new AllocaInst(
-        Ty,
-#if (LLVM_VERSION_MAJOR >= 5)
-        0,
-#endif
-        nullptr,
-        "",
-        block);
-
-    // insert initialization of the new global variable
-    // at the beginning of main
-    Function *vms = get_verifier_make_nondet(M);
-    CastInst *CastI = CastInst::CreatePointerCast(AI, Type::getInt8PtrTy(Ctx));
-    CastI->insertAfter(AI);
-
-    std::vector<Value *> args;
-    args.push_back(CastI);
-    args.push_back(ConstantInt::get(get_size_t(M),
-                   M->getDataLayout().getTypeAllocSize(Ty)));
-    std::string namestr = F->getName().str();
-    namestr += ":undeffun:0";
-    Constant *name = ConstantDataArray::getString(Ctx, namestr);
-    GlobalVariable *nameG = new GlobalVariable(*M, name->getType(), true /*constant */,
-                                               GlobalVariable::PrivateLinkage, name);
-    args.push_back(ConstantExpr::getPointerCast(nameG, Type::getInt8PtrTy(Ctx)));
-    args.push_back(ConstantInt::get(Type::getInt32Ty(Ctx), ++calls_count));
-
-    CallInst *CI = CallInst::Create(vms, args);
-    CI->insertAfter(CastI);
-
-    LoadInst *LI = new LoadInst(
-        AI->getType()->getPointerElementType(),
-        AI,
-        "undefret",
-        block);
-    ReturnInst::Create(Ctx, LI, block);
+  } else if (!use_summaries || !defineSummary(M, F, block)) {
+    ReturnInst::Create(Ctx, createNondet(M, F, block), block);
   }
 
   F->setLinkage(GlobalValue::LinkageTypes::InternalLinkage);
@@ -346,15 +321,9 @@ void DeleteUndefined::defineFunction(Module *M, Function *F)
 
 bool DeleteUndefined::runOnFunction(Function &F)
 {
-  // static set for the calls that we removed, so that
-  // we can print those call only once
-  static std::set<const llvm::Value *> removed_calls;
   Module *M = F.getParent();
 
-  if (F.getName().startswith("__VERIFIER_"))
-    return false;
-
-  if (array_match(F.getName(), leave_calls))
+  if (keepCalls(&F))
     return false;
 
   if (F.empty() && !F.getReturnType()->isVoidTy()) {
@@ -378,11 +347,7 @@ bool DeleteUndefined::runOnFunction(Function &F)
       if (CI->isInlineAsm())
         continue;
 
-#if LLVM_VERSION_MAJOR >= 8
-      Value *val = CI->getCalledOperand()->stripPointerCasts();
-#else
-      Value *val = CI->getCalledValue()->stripPointerCasts();
-#endif
+      Value *val = calleeOf(CI)->stripPointerCasts();
       Function *callee = dyn_cast<Function>(val);
       // if this is intrinsic call or a call via a function pointer,
       // let it be
@@ -399,24 +364,17 @@ bool DeleteUndefined::runOnFunction(Function &F)
         continue;
 
       assert(callee->hasName());
-      StringRef name = callee->getName();
-
-      // if this is __VERIFIER_* call, keep it
-      if (name.startswith("__VERIFIER_"))
+      if (!callee->isDeclaration() || keepCalls(callee))
         continue;
 
-      if (array_match(name, leave_calls))
-        continue;
+      if (_removed_calls.insert(callee).second)
+          errs() << "Removed calls to '" << callee->getName()
+                 << "' (function is undefined)\n";
 
-      if (callee->isDeclaration()) {
-        if (removed_calls.insert(callee).second)
-            errs() << "Removed calls to '" << name << "' (function is undefined)\n";
-
-        // remove the call
-        assert(CI->getType()->isVoidTy());
-        CI->eraseFromParent();
-        modified = true;
-      }
+      // remove the call
+      assert(CI->getType()->isVoidTy());
+      CI->eraseFromParent();
+      modified = true;
     }
   }
   return modified;
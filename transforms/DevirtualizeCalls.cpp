@@ -0,0 +1,145 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Turn indirect calls into direct calls of their possible targets.
+// The targets of a call are the functions whose address is taken and that
+// have the type of the call (a simple type-based analysis). If there are
+// at most -devirtualize-calls-max-targets of them, the call is replaced by
+// comparisons of the called pointer with the targets and direct calls
+// of them. The original indirect call stays in the case that no target
+// matches (e.g., the pointer is invalid or points to a function
+// of a different type), so the behavior of the program does not change.
+
+#include <vector>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned> MaxTargets("devirtualize-calls-max-targets",
+        cl::desc("Devirtualize only the calls with at most this number "
+                 "of possible targets (default: 8)"),
+        cl::init(8));
+
+namespace {
+
+class DevirtualizeCalls : public ModulePass {
+  // the address-taken functions by their types
+  DenseMap<FunctionType *, std::vector<Function *>> _targets;
+
+  void devirtualize(CallInst *CI, const std::vector<Function *>& targets);
+
+public:
+  static char ID;
+
+  DevirtualizeCalls() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<DevirtualizeCalls> DC("devirtualize-calls",
+                                          "Replace indirect calls with direct "
+                                          "calls of their possible targets");
+char DevirtualizeCalls::ID;
+
+void DevirtualizeCalls::devirtualize(CallInst *CI,
+                                     const std::vector<Function *>& targets) {
+  BasicBlock *B = CI->getParent();
+  Function *F = B->getParent();
+  LLVMContext& Ctx = F->getContext();
+  Value *called = calleeOf(CI);
+
+  // B: the code before the call, the comparisons with the targets
+  // follow and end in 'fallback' with the original call
+  BasicBlock *end = B->splitBasicBlock(CI, "devirt.end");
+  B->getTerminator()->eraseFromParent();
+
+  PHINode *phi = nullptr;
+  if (!CI->getType()->isVoidTy()) {
+    phi = PHINode::Create(CI->getType(), targets.size() + 1, "devirt.ret",
+                          &*end->begin());
+  }
+
+  BasicBlock *check = B;
+  for (Function *target : targets) {
+    BasicBlock *call = BasicBlock::Create(Ctx, "devirt." + target->getName(),
+                                          F, end);
+    BasicBlock *next = BasicBlock::Create(Ctx, "devirt.next", F, end);
+
+    auto *cmp = new ICmpInst(*check, ICmpInst::ICMP_EQ, called,
+                             ConstantExpr::getBitCast(target, called->getType()));
+    cmp->setDebugLoc(CI->getDebugLoc());
+    BranchInst::Create(call, next, cmp, check);
+
+    auto *direct = cast<CallInst>(CI->clone());
+    direct->setCalledFunction(target);
+    call->getInstList().push_back(direct);
+    BranchInst::Create(end, call);
+    if (phi)
+      phi->addIncoming(direct, call);
+
+    check = next;
+  }
+
+  // no target matches
+  CI->moveBefore(BranchInst::Create(end, check));
+  if (phi) {
+    CI->replaceAllUsesWith(phi);
+    phi->addIncoming(CI, check);
+  }
+}
+
+bool DevirtualizeCalls::runOnModule(Module& M) {
+  _targets.clear();
+  for (Function& F : M) {
+    if (!F.isIntrinsic() && F.hasAddressTaken())
+      _targets[F.getFunctionType()].push_back(&F);
+  }
+
+  std::vector<CallInst *> calls;
+  for (Function& F : M) {
+    for (BasicBlock& B : F) {
+      for (Instruction& I : B) {
+        auto *CI = dyn_cast<CallInst>(&I);
+        if (!CI || CI->isInlineAsm() || CI->getCalledFunction())
+          continue;
+        const Value *called = calleeOf(CI);
+        // a cast of a function, the call is direct already
+        if (isa<Function>(called->stripPointerCasts()))
+          continue;
+        calls.push_back(CI);
+      }
+    }
+  }
+
+  unsigned devirtualized = 0, skipped = 0;
+  for (CallInst *CI : calls) {
+    auto It = _targets.find(CI->getFunctionType());
+    if (It == _targets.end() || It->second.size() > MaxTargets) {
+      ++skipped;
+      continue;
+    }
+    devirtualize(CI, It->second);
+    ++devirtualized;
+  }
+
+  if (!calls.empty()) {
+    errs() << "Devirtualized " << devirtualized << " indirect calls ("
+           << skipped << " with no or too many targets)\n";
+  }
+  return devirtualized > 0;
+}
@@ -26,6 +26,8 @@
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include <llvm/IR/DebugInfoMetadata.h>
 
+#include "Compat.h"
+
 using namespace llvm;
 
 bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2);
@@ -33,6 +35,8 @@ bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2);
 namespace {
 
 class DummyMarker : public FunctionPass {
+    static Function *getMarker(Module *M);
+
   public:
     static char ID;
 
@@ -41,11 +45,56 @@ class DummyMarker : public FunctionPass {
     virtual bool runOnFunction(Function &F);
 };
 
+// The markers only keep the allocations alive during the optimizations,
+// they must be removed before verification (the verifier would execute
+// a call for every allocation otherwise). This is a pass of its own,
+// so that it can run in the same sbt-pipeline as -dummy-marker.
+class StripDummyMarkers : public FunctionPass {
+  public:
+    static char ID;
+
+    StripDummyMarkers() : FunctionPass(ID) {}
+
+    virtual bool runOnFunction(Function &F);
+};
+
+// The marker captures the pointer, so the optimizations cannot remove
+// the allocation or the stores to it, but it does not touch any memory
+// visible to the program and does not throw, so it does not prevent
+// the optimizations of the code around it.
+Function *DummyMarker::getMarker(Module *M) {
+  LLVMContext& Ctx = M->getContext();
+  auto dummyC = insertFunction(*M, "__symbiotic_keep_ptr",
+                               Type::getVoidTy(Ctx),
+                               {Type::getInt8PtrTy(Ctx)});
+  auto dummy = functionOf(dummyC);
+  dummy->setDoesNotThrow();
+#if LLVM_VERSION_MAJOR >= 4
+  dummy->setOnlyAccessesInaccessibleMemory();
+#endif
+  return dummy;
+}
+
+bool StripDummyMarkers::runOnFunction(Function& F) {
+  bool modified = false;
+  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E;) {
+    auto CI = dyn_cast<CallInst>(&*I);
+    ++I;
+    if (!CI)
+        continue;
+    auto calledFun = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+    if (calledFun && calledFun->getName().equals("__symbiotic_keep_ptr")) {
+      CI->eraseFromParent();
+      modified = true;
+    }
+  }
+  return modified;
+}
+
 bool DummyMarker::runOnFunction(Function &F)
 {
   bool modified = false;
   Module *M = F.getParent();
-  LLVMContext& Ctx = M->getContext();
 
   for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E;) {
     Instruction *ins = &*I;
@@ -54,28 +103,12 @@ bool DummyMarker::runOnFunction(Function &F)
     if (!CI)
         continue;
 
-#if LLVM_VERSION_MAJOR >= 8
-    auto calledFun = dyn_cast<Function>(CI->getCalledOperand()->stripPointerCasts());
-#else
-    auto calledFun = dyn_cast<Function>(CI->getCalledValue()->stripPointerCasts());
-#endif
+    auto calledFun = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
     if (!calledFun)
         continue;
     auto fun = calledFun->getName();
     if (fun.equals("malloc") || fun.equals("calloc")) {
-      auto dummyC = M->getOrInsertFunction("__symbiotic_keep_ptr",
-                                           Type::getVoidTy(Ctx),
-                                           Type::getInt8PtrTy(Ctx)
-#if LLVM_VERSION_MAJOR < 5
-                                           , nullptr
-#endif
-                                           );
-#if LLVM_VERSION_MAJOR >= 9
-      auto dummy = cast<Function>(dummyC.getCallee());
-#else
-      auto dummy = cast<Function>(dummyC);
-#endif
-      auto new_CI = CallInst::Create(dummy, {CI});
+      auto new_CI = CallInst::Create(getMarker(M), {CI});
       CloneMetadata(CI, new_CI);
 
       new_CI->insertAfter(CI);
@@ -91,3 +124,8 @@ static RegisterPass<DummyMarker> DM("dummy-marker",
                                     "Put calls to dummy functions into bitcode to "
                                     "prevent remove the code by optimizations.");
 char DummyMarker::ID;
+
+static RegisterPass<StripDummyMarkers> SDM("strip-dummy-markers",
+                                           "Remove the calls to dummy functions "
+                                           "inserted by -dummy-marker");
+char StripDummyMarkers::ID;
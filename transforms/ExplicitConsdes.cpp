@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "llvm/IR/GlobalVariable.h"
@@ -113,26 +114,93 @@ class ExplicitConsdes : public ModulePass {
                     ty->getFunctionNumParams() == 0;
     }
 
-    void warnIfExitIsUsed(const Instruction& inst) {
-        // inst -> [operands] -> [only function pointers] -> [only exit] -> is_empty
-        for (const auto& op : inst.operands()) {
-            const auto *val = op.get();
-            if (!val)
-                continue;
+    // the functions reachable from main: a call graph with the direct calls,
+    // the functions whose address is taken are reachable from indirect calls
+    std::unordered_set<const Function *> getReachable(Module &mod,
+                                                      Function *main) {
+        std::unordered_set<const Function *> reachable{main};
+        std::vector<const Function *> queue{main};
+        bool hasIndirect = false;
+
+        auto add = [&](const Function *f) {
+            if (reachable.insert(f).second)
+                queue.push_back(f);
+        };
+
+        while (!queue.empty()) {
+            const Function *f = queue.back();
+            queue.pop_back();
+
+            for (const auto &inst : instructions(f)) {
+                const auto *call = dyn_cast<CallInst>(&inst);
+                if (!call)
+                    continue;
+                if (const Function *called = call->getCalledFunction())
+                    add(called);
+                else if (!call->isInlineAsm() && !hasIndirect) {
+                    hasIndirect = true;
+                    for (const auto &other : mod.functions())
+                        if (other.hasAddressTaken())
+                            add(&other);
+                }
+            }
+        }
 
-            const auto *ty = val->getType();
+        return reachable;
+    }
 
-            if (!ty->isPointerTy())
-                continue;
+    // the calls of exit before which we insert the destructors
+    void getExitCalls(Module &mod, Function *main,
+                      std::vector<Instruction *> &dtorsBefore) {
+        // if program has __INSTR_mark_exit, we can't insert instruction between it and exit
+        bool hasMarkExit = (mod.getFunction("__INSTR_mark_exit") != nullptr);
+        std::unordered_set<const Function *> reachable;
+        bool warned = false;
 
-            if (!ty->getPointerElementType()->isFunctionTy())
+        for (auto &func : mod.functions()) {
+            if (!isExit(&func))
                 continue;
 
-            const auto *f = dyn_cast<Function>(val);
-            if (!f || !isExit(f))
-                continue;
+            for (auto *user : func.users()) {
+                auto *call = dyn_cast<CallInst>(user);
+                if (!call || call->getCalledFunction() != &func) {
+                    // the address of exit is taken
+                    if (!warned)
+                        errs() << "explicit-consdes: warning: indirect call of exit is possible in the program\n";
+                    warned = true;
+                    continue;
+                }
+
+                if (reachable.empty())
+                    reachable = getReachable(mod, main);
+                // exit is never called in this function
+                if (reachable.count(call->getParent()->getParent()) == 0)
+                    continue;
+
+                if (!hasMarkExit) {
+                    dtorsBefore.push_back(call);
+                    continue;
+                }
+
+                // look for __INSTR_mark_exit before this call
+#if LLVM_VERSION_MAJOR > 7
+                auto *prev = call->getPrevNonDebugInstruction();
+#else
+                auto *prev = call->getPrevNode();
+#endif
+                auto *markCall = prev ? dyn_cast<CallInst>(prev) : nullptr;
+                if (!markCall)
+                    continue;
+
+                Function *markCalled = markCall->getCalledFunction();
+                if (!markCalled) // indirect call
+                    continue;
+
+                if (!isMarkExit(markCalled))
+                    continue;
 
-            errs() << "explicit-consdes: warning: indirect call of exit is possible in the program\n";
+                dtorsBefore.push_back(markCall);
+            }
         }
     }
 
@@ -181,49 +249,10 @@ class ExplicitConsdes : public ModulePass {
             }
         }
 
-        // if program has __INSTR_mark_exit, we can't insert instruction between it and exit
-        bool hasMarkExit = (mod.getFunction("__INSTR_mark_exit") != nullptr);
-
-        // and finally search for calls to exit in whole program
-        for (auto &func : mod.functions()) {
-            for (auto &inst : instructions(func)) {
-                auto *call = dyn_cast<CallInst>(&inst);
-                if (!call) {
-                    warnIfExitIsUsed(inst);
-                    continue;
-                }
-
-                Function *called = call->getCalledFunction();
-                if (!called) // indirect call
-                    continue;
-
-                if (!isExit(called))
-                    continue;
-
-                if (!hasMarkExit) {
-                    dtorsBefore.push_back(call);
-                } else {
-                    // look for __INSTR_mark_exit before this call
-#if LLVM_VERSION_MAJOR > 7
-                    auto *prev = inst.getPrevNonDebugInstruction();
-#else
-                    auto *prev = inst.getPrevNode();
-#endif
-                    auto *markCall = prev ? dyn_cast<CallInst>(prev) : nullptr;
-                    if (!markCall)
-                        continue;
-
-                    Function *markCalled = markCall->getCalledFunction();
-                    if (!markCalled) // indirect call
-                        continue;
-
-                    if (!isMarkExit(markCalled))
-                        continue;
-
-                    dtorsBefore.push_back(markCall);
-                }
-            }
-        }
+        // and finally search for calls to exit in the program,
+        // that is needed only if there are some destructors
+        if (!dtors.empty())
+            getExitCalls(mod, main, dtorsBefore);
 
         for (auto *before : dtorsBefore) {
             insertCalls(dtors, before);
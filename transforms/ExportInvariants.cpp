@@ -0,0 +1,292 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Export the invariants of loops that ScalarEvolution knows about the source
+// variables, so that they can be put into correctness witnesses (a validator
+// then does not need to find them itself). For every loop with a location
+// in the source, we take the header phis that hold the value of a source
+// variable of an integer type when the loop head is reached (they are
+// described by llvm.dbg.value in the header) and export the range
+// of the values of the variable, e.g., "0 <= i && i <= 10". The range
+// is computed from the recurrences of the variables and the bounds
+// on the number of iterations of the loops.
+//
+// The invariants are written into the file given by -export-invariants-file
+// as a JSON list of {function, file, line, column, invariant}, where
+// the invariant is a C expression that holds every time the loop head
+// (the location) is reached. The module is not modified.
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/BinaryFormat/Dwarf.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "NewPM.h"
+
+#include <set>
+#include <string>
+#include <tuple>
+
+using namespace llvm;
+
+static cl::opt<std::string> InvariantsFile("export-invariants-file",
+        cl::desc("Store the invariants of loops into the given file (JSON)"),
+        cl::value_desc("filename"));
+
+namespace {
+
+struct Invariant {
+  std::string function;
+  std::string file;
+  unsigned line;
+  unsigned column;
+  std::string expr;
+
+  bool operator<(const Invariant& rhs) const {
+    return std::tie(file, line, column, expr) <
+           std::tie(rhs.file, rhs.line, rhs.column, rhs.expr);
+  }
+};
+
+using Invariants = std::set<Invariant>;
+
+class ExportInvariants : public FunctionPass {
+  Invariants invariants;
+
+public:
+  static void exportLoop(Loop *L, ScalarEvolution& SE, Invariants& out);
+  static void write(const Invariants& invariants);
+
+  static char ID;
+
+  ExportInvariants() : FunctionPass(ID) {}
+
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<ScalarEvolutionWrapperPass>();
+    AU.setPreservesAll();
+  }
+
+  bool runOnFunction(Function& F) override;
+  bool doFinalization(Module& M) override;
+};
+
+#if LLVM_VERSION_MAJOR >= 12
+class ExportInvariantsPass : public PassInfoMixin<ExportInvariantsPass> {
+public:
+  PreservedAnalyses run(Module& M, ModuleAnalysisManager& MAM) {
+    auto& FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+    Invariants invariants;
+    for (Function& F : M) {
+      if (F.isDeclaration())
+        continue;
+      auto& LI = FAM.getResult<LoopAnalysis>(F);
+      auto& SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+      for (Loop *L : LI.getLoopsInPreorder())
+        ExportInvariants::exportLoop(L, SE, invariants);
+    }
+    ExportInvariants::write(invariants);
+    return PreservedAnalyses::all();
+  }
+};
+#endif
+
+} // namespace
+
+#if LLVM_VERSION_MAJOR >= 12
+static RegisterNewPMModulePass<ExportInvariantsPass> NEI("export-invariants");
+#endif
+
+static RegisterPass<ExportInvariants> EI("export-invariants",
+                                         "Export the invariants of loops "
+                                         "for correctness witnesses");
+char ExportInvariants::ID;
+
+// the basic type of the variable (without typedefs and qualifiers)
+// if it is an integer type, nullptr otherwise
+static const DIBasicType *getIntegerType(const DILocalVariable *Var) {
+  const DIType *T = Var->getType();
+  while (auto *DT = dyn_cast_or_null<DIDerivedType>(T)) {
+    unsigned tag = DT->getTag();
+    if (tag != dwarf::DW_TAG_typedef && tag != dwarf::DW_TAG_const_type &&
+        tag != dwarf::DW_TAG_volatile_type)
+      return nullptr;
+    T = DT->getBaseType();
+  }
+
+  auto *BT = dyn_cast_or_null<DIBasicType>(T);
+  if (!BT)
+    return nullptr;
+  switch (BT->getEncoding()) {
+  case dwarf::DW_ATE_signed:
+  case dwarf::DW_ATE_signed_char:
+  case dwarf::DW_ATE_unsigned:
+  case dwarf::DW_ATE_unsigned_char:
+    return BT;
+  default:
+    return nullptr;
+  }
+}
+
+static bool isSigned(const DIBasicType *BT) {
+  return BT->getEncoding() == dwarf::DW_ATE_signed ||
+         BT->getEncoding() == dwarf::DW_ATE_signed_char;
+}
+
+// the range of the values as a C expression, or an empty string
+// if the range says nothing
+static std::string rangeExpr(StringRef var, const ConstantRange& R,
+                             bool sign) {
+  if (R.isFullSet() || R.isEmptySet())
+    return "";
+
+  unsigned bits = R.getBitWidth();
+  std::string expr;
+  raw_string_ostream out(expr);
+  if (sign) {
+    const APInt& lo = R.getSignedMin();
+    const APInt& hi = R.getSignedMax();
+    if (!lo.isMinSignedValue())
+      out << lo.getSExtValue() << " <= " << var;
+    if (!hi.isMaxSignedValue()) {
+      if (!lo.isMinSignedValue())
+        out << " && ";
+      out << var << " <= " << hi.getSExtValue();
+    }
+  } else {
+    const APInt& lo = R.getUnsignedMin();
+    const APInt& hi = R.getUnsignedMax();
+    // (the literals must fit into unsigned long long)
+    if (bits > 64)
+      return "";
+    if (!lo.isMinValue())
+      out << lo.getZExtValue() << "u <= " << var;
+    if (!hi.isMaxValue()) {
+      if (!lo.isMinValue())
+        out << " && ";
+      out << var << " <= " << hi.getZExtValue() << "u";
+    }
+  }
+  return out.str();
+}
+
+void ExportInvariants::exportLoop(Loop *L, ScalarEvolution& SE,
+                                  Invariants& invariants) {
+  // the invariants hold at the loop head
+  const DILocation *Loc = L->getStartLoc().get();
+  if (!Loc || Loc->getLine() == 0 || Loc->getInlinedAt())
+    return;
+  const DISubprogram *SP = Loc->getScope()->getSubprogram();
+  if (!SP)
+    return;
+
+  BasicBlock *header = L->getHeader();
+  for (PHINode& phi : header->phis()) {
+    if (!phi.getType()->isIntegerTy() || !SE.isSCEVable(phi.getType()))
+      continue;
+
+    SmallVector<DbgValueInst *, 2> values;
+    findDbgValues(values, &phi);
+    for (DbgValueInst *DVI : values) {
+      // the value of the variable when the loop head is reached
+      if (DVI->getParent() != header)
+        continue;
+      const DILocalVariable *Var = DVI->getVariable();
+      const DILocation *VarLoc = DVI->getDebugLoc().get();
+      if (!Var || Var->getName().empty() || !VarLoc ||
+          VarLoc->getInlinedAt() || Var->getScope()->getSubprogram() != SP)
+        continue;
+      // the phi must be the whole variable
+      if (DVI->getExpression()->getNumElements() != 0)
+        continue;
+      const DIBasicType *BT = getIntegerType(Var);
+      if (!BT || BT->getSizeInBits() != phi.getType()->getIntegerBitWidth())
+        continue;
+
+      const SCEV *S = SE.getSCEV(&phi);
+      bool sign = isSigned(BT);
+      std::string expr = rangeExpr(Var->getName(),
+                                   sign ? SE.getSignedRange(S)
+                                        : SE.getUnsignedRange(S),
+                                   sign);
+      if (expr.empty())
+        continue;
+
+      invariants.insert({SP->getName().str(), Loc->getFilename().str(),
+                         Loc->getLine(), Loc->getColumn(), expr});
+    }
+  }
+}
+
+bool ExportInvariants::runOnFunction(Function&) {
+  auto& LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  auto& SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+
+  for (Loop *L : LI.getLoopsInPreorder())
+    exportLoop(L, SE, invariants);
+
+  return false;
+}
+
+static void writeJSONString(raw_ostream& out, StringRef str) {
+  out << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\')
+      out << '\\';
+    out << c;
+  }
+  out << '"';
+}
+
+bool ExportInvariants::doFinalization(Module&) {
+  write(invariants);
+  return false;
+}
+
+void ExportInvariants::write(const Invariants& invariants) {
+  if (InvariantsFile.empty())
+    return;
+
+  std::error_code EC;
+#if LLVM_VERSION_MAJOR >= 9
+  raw_fd_ostream out(InvariantsFile, EC, sys::fs::OF_Text);
+#else
+  raw_fd_ostream out(InvariantsFile, EC, sys::fs::F_Text);
+#endif
+  if (EC) {
+    errs() << "Failed opening " << InvariantsFile << ": "
+           << EC.message() << "\n";
+    return;
+  }
+
+  bool first = true;
+  out << "[\n";
+  for (const Invariant& inv : invariants) {
+    if (!first)
+      out << ",\n";
+    first = false;
+    out << "  {\"function\": ";
+    writeJSONString(out, inv.function);
+    out << ", \"file\": ";
+    writeJSONString(out, inv.file);
+    out << ", \"line\": " << inv.line << ", \"column\": " << inv.column
+        << ", \"invariant\": ";
+    writeJSONString(out, inv.expr);
+    out << "}";
+  }
+  out << "\n]\n";
+
+  errs() << "Exported " << invariants.size() << " invariants of loops\n";
+}
@@ -0,0 +1,180 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Find the calls of the slicing criteria that can be executed and store
+// them into the file given by -find-criteria-output, one per line:
+//
+//   <criterion> <function> <file>:<line>:<column>
+//
+// (the location is '?' for the calls without debug information).
+// A function can be executed if it is main, a constructor or destructor
+// of the module, or it is referenced (called or its address is taken)
+// from a function that can be executed or from a global that is referenced
+// so. An indirect call in such a function is a call of every criterion
+// whose address is taken and that can be executed, it is stored with
+// the function '<indirect>'. The module is not changed.
+
+#include <vector>
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+static cl::list<std::string> CriteriaFns("find-criteria-fn",
+        cl::desc("The slicing criteria (default: __VERIFIER_error, __assert_fail)"),
+        cl::CommaSeparated);
+
+static cl::opt<std::string> Output("find-criteria-output",
+        cl::desc("Store the calls of the criteria into this file"),
+        cl::init(""));
+
+namespace {
+
+class FindCriteria : public ModulePass {
+  SmallPtrSet<const Value *, 32> _visited;
+  std::vector<const Function *> _reachable;
+
+  void computeReachable(const Module& M);
+
+public:
+  static char ID;
+
+  FindCriteria() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<FindCriteria> FC("find-criteria",
+                                     "Find the calls of the slicing criteria "
+                                     "that can be executed");
+char FindCriteria::ID;
+
+void FindCriteria::computeReachable(const Module& M) {
+  std::vector<const Value *> worklist;
+  if (auto *F = M.getFunction("main"))
+    worklist.push_back(F);
+  for (const char *gname : {"llvm.global_ctors", "llvm.global_dtors",
+                            "llvm.used", "llvm.compiler.used"}) {
+    if (auto *GV = M.getNamedGlobal(gname))
+      worklist.push_back(GV);
+  }
+
+  while (!worklist.empty()) {
+    const Value *V = worklist.back();
+    worklist.pop_back();
+    if (!_visited.insert(V).second)
+      continue;
+
+    if (auto *F = dyn_cast<Function>(V)) {
+      _reachable.push_back(F);
+      for (const BasicBlock& B : *F) {
+        for (const Instruction& I : B) {
+          for (const Value *op : I.operands()) {
+            if (isa<Constant>(op))
+              worklist.push_back(op);
+          }
+        }
+      }
+    } else if (auto *GV = dyn_cast<GlobalVariable>(V)) {
+      if (GV->hasInitializer())
+        worklist.push_back(GV->getInitializer());
+    } else if (auto *GA = dyn_cast<GlobalAlias>(V)) {
+      worklist.push_back(GA->getAliasee());
+    } else if (auto *C = dyn_cast<Constant>(V)) {
+      for (const Value *op : C->operands())
+        worklist.push_back(op);
+    }
+  }
+}
+
+static void writeLocation(raw_ostream& out, const Instruction& I) {
+  const DebugLoc& Loc = I.getDebugLoc();
+  if (!Loc) {
+    out << "?";
+    return;
+  }
+  auto *Scope = cast<DIScope>(Loc.getScope());
+  out << Scope->getFilename() << ":" << Loc.getLine() << ":" << Loc.getCol();
+}
+
+bool FindCriteria::runOnModule(Module& M) {
+  StringSet<> criteria;
+  for (const std::string& name : CriteriaFns)
+    criteria.insert(name);
+  if (criteria.empty()) {
+    criteria.insert("__VERIFIER_error");
+    criteria.insert("__assert_fail");
+  }
+
+  _visited.clear();
+  _reachable.clear();
+  computeReachable(M);
+
+  // the criteria that can be called indirectly
+  std::vector<const Function *> indirect;
+  for (const Function *F : _reachable) {
+    if (criteria.count(F->getName()) && F->hasAddressTaken())
+      indirect.push_back(F);
+  }
+
+  std::string path = Output.empty() ? std::string("-") : Output.getValue();
+  std::error_code EC;
+#if LLVM_VERSION_MAJOR >= 9
+  raw_fd_ostream out(path, EC, sys::fs::OF_Text);
+#else
+  raw_fd_ostream out(path, EC, sys::fs::F_Text);
+#endif
+  if (EC) {
+    errs() << "Failed opening " << path << ": " << EC.message() << "\n";
+    return false;
+  }
+
+  unsigned sites = 0;
+  for (const Function *F : _reachable) {
+    for (const BasicBlock& B : *F) {
+      for (const Instruction& I : B) {
+        auto *CI = dyn_cast<CallInst>(&I);
+        if (!CI || CI->isInlineAsm())
+          continue;
+        const Value *called = calleeOf(CI)->stripPointerCasts();
+        if (auto *callee = dyn_cast<Function>(called)) {
+          if (!criteria.count(callee->getName()))
+            continue;
+          out << callee->getName() << " " << F->getName() << " ";
+          writeLocation(out, I);
+          out << "\n";
+          ++sites;
+          continue;
+        }
+
+        for (const Function *callee : indirect) {
+          out << callee->getName() << " <indirect> ";
+          writeLocation(out, I);
+          out << "\n";
+          ++sites;
+        }
+      }
+    }
+  }
+
+  errs() << "Found " << sites << " calls of the slicing criteria\n";
+  return false;
+}
@@ -27,6 +27,8 @@
 #include <llvm/IR/DebugInfoMetadata.h>
 #include <llvm/Support/CommandLine.h>
 
+#include "Compat.h"
+
 using namespace llvm;
 
 cl::opt<bool> no_change_assumes("no-change-assumes",
@@ -41,106 +43,100 @@ bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2);
 
 namespace {
 
-class FindExits : public FunctionPass {
+class FindExits : public ModulePass {
+    Function *getExit(Module& M);
+    bool insertExits(Module& M);
+    bool changeAssumes(Module& M);
+
   public:
     static char ID;
 
-    FindExits() : FunctionPass(ID) {}
+    FindExits() : ModulePass(ID) {}
 
-    bool runOnFunction(Function &F) override;
-    bool processBlock(BasicBlock& B);
+    bool runOnModule(Module &M) override;
 };
 
-bool FindExits::runOnFunction(Function &F)
-{
-  bool modified = false;
-
-  for (auto& B : F) {
-      modified |= processBlock(B);
-  }
-
-  return modified;
-}
-
-bool FindExits::processBlock(BasicBlock& B) {
-  bool modified = false;
-  Module *M = B.getParent()->getParent();
-  LLVMContext& Ctx = M->getContext();
-  bool isMain = B.getParent()->getName().equals("main");
-
-  Type *argTy = Type::getInt32Ty(Ctx);
-  Function *exitF = nullptr;
-  if (use_exit) {
-    auto exitC = M->getOrInsertFunction("__VERIFIER_exit",
-                                         Type::getVoidTy(Ctx), argTy
-#if LLVM_VERSION_MAJOR < 5
-                                         , nullptr
-#endif
-                                       );
-#if LLVM_VERSION_MAJOR >= 9
-    exitF = cast<Function>(exitC.getCallee());
-#else
-    exitF = cast<Function>(exitC);
-#endif
-  } else {
-    auto exitC = M->getOrInsertFunction("__VERIFIER_silent_exit",
-                                         Type::getVoidTy(Ctx), argTy
-#if LLVM_VERSION_MAJOR < 5
-                                         , nullptr
-#endif
-                                       );
-#if LLVM_VERSION_MAJOR >= 9
-    exitF = cast<Function>(exitC.getCallee());
-#else
-    exitF = cast<Function>(exitC);
-#endif
-  }
+Function *FindExits::getExit(Module& M) {
+  LLVMContext& Ctx = M.getContext();
+  auto exitC = insertFunction(M, use_exit ? "__VERIFIER_exit"
+                                          : "__VERIFIER_silent_exit",
+                              Type::getVoidTy(Ctx),
+                              {Type::getInt32Ty(Ctx)});
+  Function *exitF = functionOf(exitC);
   exitF->addFnAttr(Attribute::NoReturn);
+  return exitF;
+}
 
-  if (succ_begin(&B) == succ_end(&B)) {
-    auto& BI = B.back();
-    if (isMain || !isa<ReturnInst>(&BI)) { // return inst does not abort the program
-                                           // (unless in main) just returns to the caller
-        auto new_CI = CallInst::Create(exitF, {ConstantInt::get(argTy, 0)});
-        CloneMetadata(&BI, new_CI);
-        new_CI->insertBefore(&BI);
-        modified = true;
+// call the exit function before every instruction that leaves
+// the program: the terminators without successors, except for the returns
+// from other functions than main (they just return to the caller)
+bool FindExits::insertExits(Module& M) {
+  std::vector<Instruction *> exits;
+  for (Function& F : M) {
+    if (F.isDeclaration())
+      continue;
+    bool isMain = F.getName().equals("main");
+    for (BasicBlock& B : F) {
+      Instruction *T = B.getTerminator();
+      if (T && T->getNumSuccessors() == 0 &&
+          (isMain || !isa<ReturnInst>(T)))
+        exits.push_back(T);
     }
   }
 
-  if (no_change_assumes) {
-    return modified;
+  Function *exitF = getExit(M);
+  Constant *zero = ConstantInt::get(Type::getInt32Ty(M.getContext()), 0);
+  for (Instruction *T : exits) {
+    auto new_CI = CallInst::Create(exitF, {zero});
+    CloneMetadata(T, new_CI);
+    new_CI->insertBefore(T);
   }
+  return !exits.empty();
+}
 
-  // Change __VERIFIER_assume for __INSTR_check_assume,
-  // as assume(0) is taken as non-terminating
-  for (auto& I : B) {
-    if (auto CI = dyn_cast<CallInst>(&I)) {
-#if LLVM_VERSION_MAJOR >= 8
-      auto calledFun = dyn_cast<Function>(CI->getCalledOperand()->stripPointerCasts());
-#else
-      auto calledFun = dyn_cast<Function>(CI->getCalledValue()->stripPointerCasts());
-#endif
-      if (!calledFun)
-          continue;
-      if (calledFun->getName().equals("__VERIFIER_assume")) {
-        auto ICAC = M->getOrInsertFunction("__INSTR_check_assume",
-                                           Type::getVoidTy(Ctx), argTy
-#if LLVM_VERSION_MAJOR < 5
-                                           , nullptr
-#endif
-                                       );
-#if LLVM_VERSION_MAJOR >= 9
-        auto ICA = cast<Function>(ICAC.getCallee());
-#else
-        auto ICA = cast<Function>(ICAC);
-#endif
-
-          CI->setCalledFunction(ICA);
-          modified = true;
+// Change __VERIFIER_assume for __INSTR_check_assume,
+// as assume(0) is taken as non-terminating
+bool FindExits::changeAssumes(Module& M) {
+  Function *assumeF = M.getFunction("__VERIFIER_assume");
+  if (!assumeF)
+    return false;
+
+  // the calls may be through a cast of the function
+  std::vector<CallInst *> calls;
+  std::vector<Value *> worklist{assumeF};
+  while (!worklist.empty()) {
+    Value *V = worklist.back();
+    worklist.pop_back();
+    for (User *U : V->users()) {
+      if (auto CI = dyn_cast<CallInst>(U)) {
+        if (calleeOf(CI)->stripPointerCasts() == assumeF)
+          calls.push_back(CI);
+      } else if (isa<ConstantExpr>(U) &&
+                 cast<ConstantExpr>(U)->isCast()) {
+        worklist.push_back(U);
       }
     }
   }
+  if (calls.empty())
+    return false;
+
+  LLVMContext& Ctx = M.getContext();
+  auto ICAC = insertFunction(M, "__INSTR_check_assume",
+                             Type::getVoidTy(Ctx),
+                             {Type::getInt32Ty(Ctx)});
+  auto ICA = functionOf(ICAC);
+  for (CallInst *CI : calls)
+    CI->setCalledFunction(ICA);
+  return true;
+}
+
+bool FindExits::runOnModule(Module &M)
+{
+  // (the exit function is declared also if there are no exits)
+  bool modified = insertExits(M);
+
+  if (!no_change_assumes)
+    modified |= changeAssumes(M);
 
   return modified;
 }
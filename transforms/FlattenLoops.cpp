@@ -4,11 +4,13 @@
 // License. See LICENSE.TXT for details.
 
 #include <vector>
-#include <set>
 
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Instructions.h"
@@ -17,154 +19,172 @@
 #include "llvm/IR/Type.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Local.h"
 
 #include "llvm/Analysis/LoopInfo.h"
-#include "llvm/Analysis/LoopPass.h"
+
+#include "Compat.h"
 
 using namespace llvm;
 
 bool CloneMetadata(const llvm::Instruction *, llvm::Instruction *);
 
-class FlattenLoops : public LoopPass {
+// Flatten every nest of loops into one loop: the headers of the loops in
+// the nest are reached only from one new header (the dispatch) that jumps
+// to the header given by a state variable. Every edge to the header of i-th
+// loop of the nest goes through a block that sets the state to i (the
+// outermost loop is 0, the edges entering the nest set it to 0 too).
+// There is one state variable for the whole function.
+class FlattenLoops : public FunctionPass {
+    AllocaInst *_state{nullptr};
+
+    AllocaInst *getState(Function& F);
+    bool flatten(Function& F, Loop *L);
+
   public:
     static char ID;
 
-    FlattenLoops() : LoopPass(ID) {}
-
-    // FIXME: properly change the structure of LoopInfo
-    bool runOnLoop(Loop *L, LPPassManager & /*LPM*/) override {
-        auto *PL = L->getParentLoop();
-        if (!PL)
-            return false;
-
-        auto *parentheader = PL->getHeader();
-        auto *innerheader = L->getHeader();
-        auto *fun = parentheader->getParent();
-        auto& M = *fun->getParent();
-        auto& Ctx = M.getContext();
-        
-        BasicBlock *flaginit = BasicBlock::Create(Ctx, "flatten.init",
-                                                  fun, parentheader);
-        BasicBlock *newheaderbb = BasicBlock::Create(Ctx, "flatten.loop.header",
-                                                     fun, parentheader);
-        // flag whether we are in the inner or outer loop
-        // initialize "inner" to 0
-        auto& entrybb = fun->getEntryBlock();
-        auto *allocaTy = Type::getInt8Ty(Ctx);
-        AllocaInst *flag = new AllocaInst(allocaTy,
-#if (LLVM_VERSION_MAJOR >= 5)
-      0,
-#endif
-      nullptr,
-#if LLVM_VERSION_MAJOR >= 11
-      M.getDataLayout().getPrefTypeAlign(allocaTy),
-#endif
-                                          "inner");
-        flag->insertBefore(&*entrybb.getFirstInsertionPt());
-        auto *SI = new StoreInst(ConstantInt::get(Type::getInt8Ty(Ctx), 0),
-                                 flag, /*isVolatile=*/false,
-#if LLVM_VERSION_MAJOR >= 11
-                flag->getAlign(),
-#endif
-                static_cast<Instruction*>(nullptr));
-        SI->insertAfter(flag);
-        BranchInst::Create(newheaderbb, flaginit);
-
-        SmallVector<llvm::BasicBlock *, 2> exits;
-        L->getExitBlocks(exits);
-        for (auto *outbb : exits) {
-            // set inner to 0
-            new StoreInst(ConstantInt::get(Type::getInt8Ty(Ctx), 0), flag,
-                          &*outbb->getFirstInsertionPt());
-        }
+    FlattenLoops() : FunctionPass(ID) {}
 
-        // redirect edges that jump to the inner header
-        std::set<BranchInst *> jumpsToHeader;
-        for (auto *pred : predecessors(innerheader)) {
-            jumpsToHeader.insert(cast<BranchInst>(pred->getTerminator()));
-        }
+    void getAnalysisUsage(AnalysisUsage& AU) const override {
+        AU.addRequired<LoopInfoWrapperPass>();
+        // we change the structure of loops, so we do not preserve anything
+    }
 
-        for (auto *pBI : jumpsToHeader) {
-            unsigned idx = 0;
-            for (auto* succ : pBI->successors()) {
-                if (succ == innerheader) {
-                    pBI->setSuccessor(idx, newheaderbb);
-                    // set inner flag to true
-                    if (!L->contains(pBI->getParent())) {
-                        new StoreInst(ConstantInt::get(Type::getInt8Ty(Ctx), 1),
-                                      flag, pBI);
-                    }
-                }
-                ++idx;
-            }
-        }
+    bool runOnFunction(Function& F) override;
+};
 
-        // redirect edges that go to parent header to the new header
-        std::set<BranchInst *> jumpsToParentHeader;
-        std::set<BranchInst *> backedgesToParentHeader;
-        for (auto *pred : predecessors(parentheader)) {
-            if (PL->contains(pred))
-                backedgesToParentHeader.insert(cast<BranchInst>(pred->getTerminator()));
-            else
-                jumpsToParentHeader.insert(cast<BranchInst>(pred->getTerminator()));
+static RegisterPass<FlattenLoops> RIL("flatten-loops",
+                                       "Flatten nested loops into non-nested loops");
+char FlattenLoops::ID;
+
+AllocaInst *FlattenLoops::getState(Function& F) {
+    if (_state)
+        return _state;
+
+    auto& Ctx = F.getContext();
+    auto *allocaTy = Type::getInt32Ty(Ctx);
+    _state = makeAlloca(allocaTy, F.getParent()->getDataLayout(),
+                        "flatten.state",
+                        &*F.getEntryBlock().getFirstInsertionPt());
+    return _state;
+}
+
+static void getLoopsInPreorder(Loop *L, std::vector<Loop *>& loops) {
+    loops.push_back(L);
+    for (Loop *S : *L)
+        getLoopsInPreorder(S, loops);
+}
+
+bool FlattenLoops::flatten(Function& F, Loop *L) {
+    std::vector<Loop *> loops;
+    getLoopsInPreorder(L, loops);
+    if (loops.size() < 2)
+        return false;
+
+    // we know how to redirect only branches and switches
+    for (Loop *N : loops) {
+        for (auto *pred : predecessors(N->getHeader())) {
+            auto *TI = pred->getTerminator();
+            if (!isa<BranchInst>(TI) && !isa<SwitchInst>(TI))
+                return false;
         }
+    }
 
-        for (auto *pBI : jumpsToParentHeader) {
-            unsigned idx = 0;
-            for (auto* succ : pBI->successors()) {
-                if (succ == parentheader) {
-                    pBI->setSuccessor(idx, flaginit);
-                }
-                ++idx;
+    // the headers get new predecessors, so demote their PHI nodes first
+    Instruction *allocaPoint = &*F.getEntryBlock().getFirstInsertionPt();
+    for (Loop *N : loops) {
+        std::vector<PHINode *> phis;
+        for (auto& PN : N->getHeader()->phis())
+            phis.push_back(&PN);
+        for (auto *PN : phis)
+            DemotePHIToStack(PN, allocaPoint);
+    }
+
+    auto& Ctx = F.getContext();
+    auto *Int32Ty = Type::getInt32Ty(Ctx);
+    AllocaInst *state = getState(F);
+    BasicBlock *topheader = L->getHeader();
+    std::vector<BasicBlock *> blocks(L->block_begin(), L->block_end());
+
+    BasicBlock *dispatch = BasicBlock::Create(Ctx, "flatten.loop.header",
+                                              &F, topheader);
+    BasicBlock *init = BasicBlock::Create(Ctx, "flatten.init", &F, dispatch);
+    auto *SI = new StoreInst(ConstantInt::get(Int32Ty, 0), state, init);
+    CloneMetadata(topheader->getTerminator(), SI);
+    BranchInst::Create(dispatch, init);
+
+    for (unsigned i = 0; i < loops.size(); ++i) {
+        BasicBlock *header = loops[i]->getHeader();
+        BasicBlock *pad = BasicBlock::Create(Ctx, "flatten.to", &F, dispatch);
+        auto *to = new StoreInst(ConstantInt::get(Int32Ty, i), state, pad);
+        CloneMetadata(header->getTerminator(), to);
+        BranchInst::Create(dispatch, pad);
+
+        SmallVector<BasicBlock *, 8> preds(pred_begin(header), pred_end(header));
+        SmallPtrSet<BasicBlock *, 8> done;
+        for (auto *pred : preds) {
+            if (!done.insert(pred).second)
+                continue;
+
+            // the edges from outside enter the nest through init
+            BasicBlock *target = (i == 0 && !L->contains(pred)) ? init : pad;
+            auto *TI = pred->getTerminator();
+            for (unsigned s = 0; s < TI->getNumSuccessors(); ++s) {
+                if (TI->getSuccessor(s) == header)
+                    TI->setSuccessor(s, target);
             }
         }
+    }
 
-        for (auto *pBI : backedgesToParentHeader) {
-            unsigned idx = 0;
-            for (auto* succ : pBI->successors()) {
-                if (succ == parentheader) {
-                    pBI->setSuccessor(idx, newheaderbb);
+    // NOTE: we must create the branches only now
+    // so that we do not change their successors
+    BasicBlock *cur = dispatch;
+    auto *val = new LoadInst(Int32Ty, state, "flatten.stateval", cur);
+    CloneMetadata(topheader->getTerminator(), val);
+    for (unsigned i = 1; i < loops.size(); ++i) {
+        auto *Cmp = new ICmpInst(*cur, ICmpInst::ICMP_EQ,
+                                 val, ConstantInt::get(Int32Ty, i));
+        BasicBlock *next = topheader;
+        if (i + 1 < loops.size())
+            next = BasicBlock::Create(Ctx, "flatten.dispatch", &F, topheader);
+        auto *BI = BranchInst::Create(loops[i]->getHeader(), next, Cmp, cur);
+        CloneMetadata(val, Cmp);
+        CloneMetadata(val, BI);
+        cur = next;
+    }
+
+    // the values defined in a loop of the nest may no longer dominate
+    // their uses (the headers are reachable only from the dispatch now)
+    DominatorTree DT(F);
+    std::vector<Instruction *> demote;
+    for (auto *B : blocks) {
+        for (auto& I : *B) {
+            for (const Use& U : I.uses()) {
+                if (!DT.dominates(&I, U)) {
+                    demote.push_back(&I);
+                    break;
                 }
-                ++idx;
             }
         }
+    }
+    for (auto *I : demote)
+        DemoteRegToStack(*I, false, allocaPoint);
 
-        // NOTE: we must create the branch inst only now
-        // so that we do not change its successors
-        auto *LI = new LoadInst(Type::getInt8Ty(Ctx), flag,
-                                "innerval", newheaderbb);
-        auto *Cmp = new ICmpInst(ICmpInst::ICMP_EQ,
-                            ConstantInt::get(Type::getInt8Ty(Ctx), 1),
-                            LI);
-        Cmp->insertAfter(LI);
-        BranchInst::Create(innerheader, parentheader, Cmp, newheaderbb);
-
-        // update the LoopPass - add the new block and make it a header
-        // FIXME: exit blocks
-
-        auto *LIWP = getAnalysisIfAvailable<LoopInfoWrapperPass>();
-        auto *loopinfo = LIWP ? &LIWP->getLoopInfo() : nullptr;
-
-        PL->removeChildLoop(L);
-        if (loopinfo)
-            PL->addBasicBlockToLoop(newheaderbb, *loopinfo);
-        else {
-            auto *tmp = PL;
-            while (tmp) {
-                tmp->addBlockEntry(newheaderbb);
-                tmp = tmp->getParentLoop();
-            }
-        }
-        PL->moveToHeader(newheaderbb);
+    llvm::errs() << "Flattened a nest of " << loops.size() << " loops in "
+                 << F.getName() << "\n";
+    return true;
+}
 
-        llvm::errs() << "Flattened a loop with flag " << *flag << "\n";
-        return true;
-    }
+bool FlattenLoops::runOnFunction(Function& F) {
+    _state = nullptr;
 
-    // XXX: we should set preserved analyses
-};
+    auto& LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    std::vector<Loop *> toplevel(LI.begin(), LI.end());
 
-static RegisterPass<FlattenLoops> RIL("flatten-loops",
-                                       "Flatten nested loops into non-nested loops");
-char FlattenLoops::ID;
+    bool changed = false;
+    for (Loop *L : toplevel)
+        changed |= flatten(F, L);
 
+    return changed;
+}
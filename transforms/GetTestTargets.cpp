@@ -4,21 +4,95 @@
 // License. See LICENSE.TXT for details.
 
 #include <cassert>
-#include <set>
-#include <stack>
+#include <string>
+#include <vector>
 
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugLoc.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/CFG.h"
 #include "llvm/Pass.h"
+#if LLVM_VERSION_MAJOR >= 4
+#include "llvm/Bitcode/BitcodeWriter.h"
+#else
+#include "llvm/Bitcode/ReaderWriter.h"
+#endif
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Support/raw_os_ostream.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include "Compat.h"
 
 using namespace llvm;
 
+// Dense numbering of the basic blocks of a module,
+// so that sets of blocks can be bit-vectors
+class BlockNumbering {
+  DenseMap<const BasicBlock *, unsigned> _ids;
+
+public:
+  BlockNumbering(Module& M) {
+    for (auto& F : M)
+      for (auto& B : F) {
+        // (not _ids[&B] = _ids.size(), the insertion may come first)
+        unsigned id = _ids.size();
+        _ids[&B] = id;
+      }
+  }
+
+  unsigned size() const { return _ids.size(); }
+
+  unsigned operator[](const BasicBlock *B) const {
+    auto it = _ids.find(B);
+    assert(it != _ids.end() && "Unknown block");
+    return it->second;
+  }
+};
+
+// DFS worklist of blocks where every block is pushed at most once
+class BlockWorklist {
+  const BlockNumbering& _numbering;
+  BitVector _visited;
+  std::vector<BasicBlock *> _stack;
+
+public:
+  BlockWorklist(const BlockNumbering& numbering)
+  : _numbering(numbering), _visited(numbering.size()) {}
+
+  // push the block if it has not been pushed yet
+  void push(BasicBlock *B) {
+    unsigned id = _numbering[B];
+    if (_visited.test(id))
+      return;
+    _visited.set(id);
+    _stack.push_back(B);
+  }
+
+  BasicBlock *pop() {
+    auto *B = _stack.back();
+    _stack.pop_back();
+    return B;
+  }
+
+  bool empty() const { return _stack.empty(); }
+
+  bool visited(const BasicBlock *B) const {
+    return _visited.test(_numbering[B]);
+  }
+
+  bool anyVisited() const { return _visited.any(); }
+};
+
 class GetTestTargets : public ModulePass {
+  void defineReport(Module& M, Function *F, unsigned targets);
+
 public:
   static char ID;
 
@@ -29,25 +103,89 @@ public:
 
 bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2);
 
+// the calls of this function are the targets
+static const char *TARGET_FUNCTION = "__SYMBIOTIC_test_target";
+
+static cl::opt<bool> ReportTargets("get-test-targets-report",
+        llvm::cl::desc("Define the target function such that KLEE prints\n"
+                       "'__SYMBIOTIC_test_target:<ID>' when a path reaches\n"
+                       "a target for the first time\n"),
+        llvm::cl::init(false));
+
 static RegisterPass<GetTestTargets> GTT("get-test-targets",
                                        "Find targets for tests generation");
 char GetTestTargets::ID;
 
+// void __SYMBIOTIC_test_target(int id) {
+//   if (!reported[id]) {
+//     reported[id] = 1;
+//     klee_print_expr("__SYMBIOTIC_test_target", id);
+//   }
+// }
+// (the globals are per path in KLEE, every path prints a target once)
+void GetTestTargets::defineReport(Module& M, Function *F, unsigned targets) {
+    auto& Ctx = M.getContext();
+    Type *i8 = Type::getInt8Ty(Ctx);
+    Type *i32 = Type::getInt32Ty(Ctx);
+
+    auto *reportedTy = ArrayType::get(i8, targets);
+    auto *reported = new GlobalVariable(M, reportedTy, false,
+                                        GlobalValue::PrivateLinkage,
+                                        ConstantAggregateZero::get(reportedTy),
+                                        "__symbiotic_reported_targets");
+    // void klee_print_expr(const char *msg, ...)
+    auto *printF = functionOf(M.getOrInsertFunction("klee_print_expr",
+            FunctionType::get(Type::getVoidTy(Ctx), {Type::getInt8PtrTy(Ctx)},
+                              /* isVarArg = */ true)));
+
+    BasicBlock *entry = BasicBlock::Create(Ctx, "entry", F);
+    BasicBlock *report = BasicBlock::Create(Ctx, "report", F);
+    BasicBlock *done = BasicBlock::Create(Ctx, "done", F);
+
+    IRBuilder<> builder(entry);
+    Value *id = &*F->arg_begin();
+    Value *ptr = builder.CreateInBoundsGEP(reportedTy, reported,
+                                           {ConstantInt::get(i32, 0), id});
+    Value *val = builder.CreateLoad(
+#if LLVM_VERSION_MAJOR >= 8
+        i8,
+#endif
+        ptr);
+    builder.CreateCondBr(builder.CreateICmpEQ(val, ConstantInt::get(i8, 0)),
+                         report, done);
+
+    builder.SetInsertPoint(report);
+    builder.CreateStore(ConstantInt::get(i8, 1), ptr);
+    builder.CreateCall(printF, {builder.CreateGlobalStringPtr(TARGET_FUNCTION),
+                                id});
+    builder.CreateBr(done);
+
+    builder.SetInsertPoint(done);
+    builder.CreateRetVoid();
+}
+
 bool GetTestTargets::runOnModule(Module& M) {
     bool changed = false;
-    std::set<BasicBlock*> visited;
-    std::stack<BasicBlock*> queue; // not efficient...
     auto& Ctx = M.getContext();
     unsigned n = 0;
 
     auto *mf = M.getFunction("main");
-    if (!mf)
+    if (!mf || mf->isDeclaration())
         return false;
+
+    // one function for all the targets, the argument is the ID of the target
+    Type *argTy = Type::getInt32Ty(Ctx);
+    auto funC = insertFunction(M, TARGET_FUNCTION,
+                               Type::getVoidTy(Ctx),
+                               {argTy});
+    auto *fun = functionOf(funC);
+
+    BlockNumbering numbering(M);
+    BlockWorklist queue(numbering);
     queue.push(&mf->getEntryBlock());
 
     while (!queue.empty()) {
-        auto *cur = queue.top();
-        queue.pop();
+        auto *cur = queue.pop();
 
         bool has_call = false;
         for (auto& I : *cur) {
@@ -55,9 +193,7 @@ bool GetTestTargets::runOnModule(Module& M) {
             if (auto *F = C->getCalledFunction()) {
               if (!F->isDeclaration()) {
                 has_call = true;
-                auto *entry = &F->getEntryBlock();
-                if (visited.insert(entry).second)
-                  queue.push(entry);
+                queue.push(&F->getEntryBlock());
               }
             }
           }
@@ -65,39 +201,40 @@ bool GetTestTargets::runOnModule(Module& M) {
 
         if ((succ_begin(cur) == succ_end(cur)) && !has_call) {
           // generate slicing criterion
-          std::string name = "__SYMBIOTIC_test_target" + std::to_string(n++);
-          auto funC = M.getOrInsertFunction(name,
-                                            Type::getVoidTy(Ctx)
-#if LLVM_VERSION_MAJOR < 5
-                                            , nullptr
-#endif
-                                            );
-#if LLVM_VERSION_MAJOR >= 9
-          auto *fun = cast<Function>(funC.getCallee());
-#else
-          auto *fun = cast<Function>(funC);
-#endif
-          auto new_CI = CallInst::Create(fun);
+          unsigned id = n++;
+          auto new_CI = CallInst::Create(fun, {ConstantInt::get(argTy, id)});
           auto *point = cur->getFirstNonPHI();
           CloneMetadata(point, new_CI);
           new_CI->insertBefore(point);
 
           changed = true;
-          llvm::outs() << name << "\n";
+          // the table of the targets: the ID and the source line
+          llvm::outs() << TARGET_FUNCTION << " " << id;
+          if (const DebugLoc& Loc = new_CI->getDebugLoc())
+            llvm::outs() << " " << Loc.getLine();
+          llvm::outs() << "\n";
         } else {
-          for (auto *succ : successors(cur)) {
-            if (visited.insert(succ).second)
-              queue.push(succ);
-          }
+          for (auto *succ : successors(cur))
+            queue.push(succ);
         }
     }
 
+    if (ReportTargets && n > 0 && fun->isDeclaration())
+      defineReport(M, fun, n);
 
   return changed;
 }
 
 
 class ConstraintToTarget : public ModulePass {
+  // for every block, the targets (their indices) reachable from it
+  std::vector<BitVector> _reaches;
+
+  void computeReachability(const BlockNumbering& numbering,
+                           const std::vector<std::vector<CallInst *>>& calls);
+  bool batch(Module& M, const BlockNumbering& numbering,
+             const std::vector<unsigned>& ids);
+
 public:
   static char ID;
 
@@ -107,103 +244,243 @@ public:
 };
 
 
-static cl::opt<std::string> TheTarget("ctt-target",
-        llvm::cl::desc("Constraint the program to the target\n"));
+static cl::opt<unsigned> TheTarget("ctt-target",
+        llvm::cl::desc("Constraint the program to the target with the given\n"
+                       "ID (see -get-test-targets)\n"));
+
+static cl::list<unsigned> TheTargets("ctt-targets",
+        llvm::cl::desc("Write the program constrained to each of the targets\n"
+                       "with the given IDs into <prefix><ID>.bc (see\n"
+                       "-ctt-output-prefix), the module itself is not changed\n"),
+        llvm::cl::CommaSeparated);
+
+static cl::opt<std::string> OutputPrefix("ctt-output-prefix",
+        llvm::cl::desc("The prefix of the files for -ctt-targets\n"),
+        llvm::cl::init("ctt-"));
 
 static RegisterPass<ConstraintToTarget> CTT("constraint-to-target",
                                        "Find targets for tests generation");
 
 char ConstraintToTarget::ID;
 
-bool ConstraintToTarget::runOnModule(Module& M) {
-    bool changed = false;
-    std::set<BasicBlock*> relevant;
-    std::set<BasicBlock*> visited;
-    std::stack<BasicBlock*> queue; // not efficient...
-    auto& Ctx = M.getContext();
-
-    auto *mf = M.getFunction(TheTarget);
-    if (!mf) {
-        llvm::errs() << "ERROR: did not find the target" << TheTarget << "\n";
-        return false;
-    }
+// get the blocks with calls that use F (directly or as an argument)
+static const std::vector<BasicBlock *>&
+getCallers(DenseMap<const Function *, std::vector<BasicBlock *>>& callers,
+           const Function *F) {
+    auto it = callers.find(F);
+    if (it != callers.end())
+      return it->second;
 
-    for (auto use_it = mf->use_begin(), use_end = mf->use_end();
+    auto& blocks = callers[F];
+    for (auto use_it = F->use_begin(), use_end = F->use_end();
          use_it != use_end; ++use_it) {
 #if ((LLVM_VERSION_MAJOR == 3) && (LLVM_VERSION_MINOR < 5))
-      CallInst *CI = dyn_cast<CallInst>(*use_it);
+      const CallInst *CI = dyn_cast<CallInst>(*use_it);
 #else
-      CallInst *CI = dyn_cast<CallInst>(use_it->getUser());
+      const CallInst *CI = dyn_cast<CallInst>(use_it->getUser());
 #endif
-      if (CI) {
-        if (visited.insert(CI->getParent()).second)
-          queue.push(CI->getParent());
-      }
+      if (CI)
+        blocks.push_back(const_cast<BasicBlock *>(CI->getParent()));
     }
 
-    while (!queue.empty()) {
-        auto *cur = queue.top();
-        queue.pop();
+    return blocks;
+}
 
-        // paths from this block go to the target
-        relevant.insert(cur);
+// the calls of the target with the given ID
+static std::vector<CallInst *> getTargetCalls(Function *targetF, unsigned id) {
+    std::vector<CallInst *> calls;
+    for (auto *U : targetF->users()) {
+      auto *CI = dyn_cast<CallInst>(U);
+      if (!CI)
+        continue;
+      auto *C = dyn_cast<ConstantInt>(CI->getArgOperand(0));
+      if (C && C->getZExtValue() == id)
+        calls.push_back(CI);
+    }
+    return calls;
+}
+
+// The blocks from which a path goes to a target: the predecessors of blocks
+// with the calls of the target and the callers of the functions whose entry
+// reaches it, for all the targets at once (a fixpoint of bit-vectors)
+void ConstraintToTarget::computeReachability(
+        const BlockNumbering& numbering,
+        const std::vector<std::vector<CallInst *>>& calls) {
+    _reaches.assign(numbering.size(), BitVector(calls.size()));
+    DenseMap<const Function *, std::vector<BasicBlock *>> callers;
+    std::vector<BasicBlock *> worklist;
+    BitVector queued(numbering.size());
+
+    auto add = [&](BasicBlock *B, const BitVector& targets) {
+      unsigned id = numbering[B];
+      BitVector joined = _reaches[id];
+      joined |= targets;
+      if (joined == _reaches[id])
+        return;
+      _reaches[id] = std::move(joined);
+      if (!queued.test(id)) {
+        queued.set(id);
+        worklist.push_back(B);
+      }
+    };
+
+    for (unsigned i = 0; i < calls.size(); ++i) {
+      BitVector target(calls.size());
+      target.set(i);
+      for (auto *CI : calls[i])
+        add(CI->getParent(), target);
+    }
+
+    while (!worklist.empty()) {
+        auto *cur = worklist.back();
+        worklist.pop_back();
+        queued.reset(numbering[cur]);
+        BitVector targets = _reaches[numbering[cur]];
 
         if ((pred_begin(cur) == pred_end(cur))) {
           // pop-up from call
-          auto *fun = cur->getParent();
-          for (auto use_it = fun->use_begin(), use_end = fun->use_end();
-               use_it != use_end; ++use_it) {
-#if ((LLVM_VERSION_MAJOR == 3) && (LLVM_VERSION_MINOR < 5))
-            CallInst *CI = dyn_cast<CallInst>(*use_it);
-#else
-            CallInst *CI = dyn_cast<CallInst>(use_it->getUser());
-#endif
-            if (CI) {
-              if (visited.insert(CI->getParent()).second)
-                queue.push(CI->getParent());
-            }
-          }
+          for (auto *B : getCallers(callers, cur->getParent()))
+            add(B, targets);
         } else {
-          for (auto *pred : predecessors(cur)) {
-            if (visited.insert(pred).second)
-              queue.push(pred);
-          }
+          for (auto *pred : predecessors(cur))
+            add(pred, targets);
         }
     }
+}
+
+// the rest of the block after the call is never executed
+static void terminateAfter(CallInst *CI) {
+    BasicBlock *B = CI->getParent();
+    for (auto *succ : successors(B))
+      succ->removePredecessor(B);
+    while (&B->back() != CI) {
+      Instruction& I = B->back();
+      I.replaceAllUsesWith(UndefValue::get(I.getType()));
+      I.eraseFromParent();
+    }
+    new UnreachableInst(B->getContext(), B);
+}
+
+// constrain the module to the target with the given ID:
+// exit silently in the blocks from which the target is not reachable
+template <typename Relevant>
+static bool constrain(Module& M, unsigned id, Relevant relevant) {
+    bool changed = false;
+    auto& Ctx = M.getContext();
 
-    if (relevant.empty()) {
-      llvm::errs() << "Found no relevant blocks\n";
-      return false;
+    // the calls of the other targets are not criteria for slicing
+    std::vector<CallInst *> others;
+    for (auto *U : M.getFunction(TARGET_FUNCTION)->users()) {
+      auto *CI = dyn_cast<CallInst>(U);
+      auto *C = CI ? dyn_cast<ConstantInt>(CI->getArgOperand(0)) : nullptr;
+      if (CI && (!C || C->getZExtValue() != id))
+        others.push_back(CI);
     }
+    for (auto *CI : others)
+      CI->eraseFromParent();
+    changed = !others.empty();
 
     Type *argTy = Type::getInt32Ty(Ctx);
-    auto exitC = M.getOrInsertFunction("__VERIFIER_silent_exit",
-                                       Type::getVoidTy(Ctx), argTy
-#if LLVM_VERSION_MAJOR < 5
-                                   , nullptr
-#endif
-                                   );
-#if LLVM_VERSION_MAJOR >= 9
-    auto exitF = cast<Function>(exitC.getCallee());
-#else
-    auto exitF = cast<Function>(exitC);
-#endif
+    auto exitC = insertFunction(M, "__VERIFIER_silent_exit",
+                                Type::getVoidTy(Ctx),
+                                {argTy});
+    auto exitF = functionOf(exitC);
     exitF->addFnAttr(Attribute::NoReturn);
 
+    std::vector<BasicBlock *> irrelevant;
     for (auto& F : M) {
+      // (the target function is defined with -get-test-targets-report)
+      if (F.getName().equals(TARGET_FUNCTION))
+        continue;
       for (auto& B : F) {
-        if (relevant.count(&B) == 0) {
-          auto new_CI = CallInst::Create(exitF, {ConstantInt::get(argTy, 0)});
-          auto *point = B.getFirstNonPHI();
-          CloneMetadata(point, new_CI);
-          new_CI->insertBefore(point);
-          changed = true;
-        }
+        if (!relevant(&B))
+          irrelevant.push_back(&B);
       }
     }
 
+    for (auto *B : irrelevant) {
+      auto new_CI = CallInst::Create(exitF, {ConstantInt::get(argTy, 0)});
+      auto *point = B->getFirstNonPHI();
+      CloneMetadata(point, new_CI);
+      new_CI->insertBefore(point);
+      terminateAfter(new_CI);
+      changed = true;
+    }
+
   return changed;
 }
 
+bool ConstraintToTarget::batch(Module& M, const BlockNumbering& numbering,
+                               const std::vector<unsigned>& ids) {
+    for (unsigned i = 0; i < ids.size(); ++i) {
+      ValueToValueMapTy VMap;
+#if LLVM_VERSION_MAJOR >= 7
+      std::unique_ptr<Module> clone = CloneModule(M, VMap);
+#else
+      std::unique_ptr<Module> clone(CloneModule(&M, VMap));
+#endif
+      DenseMap<const BasicBlock *, unsigned> original;
+      for (auto& F : M) {
+        if (F.isDeclaration())
+          continue;
+        for (auto& B : F)
+          original[cast<BasicBlock>(VMap[&B])] = numbering[&B];
+      }
+
+      constrain(*clone, ids[i], [&](const BasicBlock *B) {
+        return _reaches[original.lookup(B)].test(i);
+      });
+
+      std::string path = OutputPrefix + std::to_string(ids[i]) + ".bc";
+      std::error_code EC;
+#if LLVM_VERSION_MAJOR >= 6
+      raw_fd_ostream out(path, EC, sys::fs::OF_None);
+#else
+      raw_fd_ostream out(path, EC, sys::fs::F_None);
+#endif
+      if (EC) {
+        llvm::errs() << "ERROR: failed opening " << path << ": "
+                     << EC.message() << "\n";
+        return false;
+      }
+#if LLVM_VERSION_MAJOR >= 7
+      WriteBitcodeToFile(*clone, out);
+#else
+      WriteBitcodeToFile(clone.get(), out);
+#endif
+      llvm::outs() << "Constrained to " << ids[i] << ": " << path << "\n";
+    }
+    return false;
+}
+
+bool ConstraintToTarget::runOnModule(Module& M) {
+    auto *mf = M.getFunction(TARGET_FUNCTION);
+    if (!mf) {
+        llvm::errs() << "ERROR: did not find the targets\n";
+        return false;
+    }
+
+    std::vector<unsigned> ids(TheTargets.begin(), TheTargets.end());
+    if (ids.empty())
+      ids.push_back(TheTarget);
 
+    std::vector<std::vector<CallInst *>> calls;
+    for (unsigned id : ids) {
+      calls.push_back(getTargetCalls(mf, id));
+      if (calls.back().empty()) {
+        llvm::errs() << "ERROR: did not find the target " << id << "\n";
+        return false;
+      }
+    }
 
+    BlockNumbering numbering(M);
+    computeReachability(numbering, calls);
+
+    // write a module for every target, the reachability is computed once
+    if (!TheTargets.empty())
+      return batch(M, numbering, ids);
+
+    return constrain(M, ids[0], [&](const BasicBlock *B) {
+      return _reaches[numbering[B]].test(0);
+    });
+}
@@ -0,0 +1,206 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Compute a hash of every defined function and global variable that does
+// not depend on the debugging information or on the rest of the module,
+// so that two versions of a program can be compared function by function
+// (e.g., to find out whether a change touched the sliced code, see
+// --incremental-verification). The hashes are written into the file given
+// by -hash-functions-output as JSON {"functions": {name: hash},
+// "globals": {name: hash}}.
+//
+// The pass renames the values and drops the metadata to get the same text
+// for the same code, so the module must not be used after it.
+
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <map>
+#include <string>
+
+using namespace llvm;
+
+static cl::opt<std::string> HashesOutput("hash-functions-output",
+        cl::desc("Store the hashes of functions and globals into the given\n"
+                 "file (JSON)"),
+        cl::value_desc("filename"));
+
+namespace {
+
+class HashFunctions : public ModulePass {
+  static std::string hash(StringRef text);
+  static std::string hashFunction(Function& F);
+  static std::string hashGlobal(GlobalVariable& G);
+
+public:
+  static char ID;
+
+  HashFunctions() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<HashFunctions> HF("hash-functions",
+                                      "Compute hashes of functions and "
+                                      "globals that ignore debug info");
+char HashFunctions::ID;
+
+std::string HashFunctions::hash(StringRef text) {
+  MD5 H;
+  H.update(text);
+  MD5::MD5Result R;
+  H.final(R);
+  SmallString<32> str;
+  MD5::stringifyResult(R, str);
+  return str.str().str();
+}
+
+#if LLVM_VERSION_MAJOR >= 10
+static void printAttributes(raw_ostream& out, const AttributeList& attrs) {
+  attrs.print(out);
+}
+#else
+static void printAttributes(raw_ostream&, const AttributeList&) {}
+#endif
+
+std::string HashFunctions::hashFunction(Function& F) {
+  std::string text;
+  raw_string_ostream out(text);
+
+  out << F.getLinkage() << " ";
+  F.getFunctionType()->print(out);
+  out << "\n";
+  printAttributes(out, F.getAttributes());
+
+  // the names of the local values are not a part of the code,
+  // clear them first so that the new names do not clash with them
+  for (Argument& A : F.args())
+    A.setName("");
+  for (BasicBlock& B : F) {
+    B.setName("");
+    for (Instruction& I : B)
+      I.setName("");
+  }
+
+  unsigned n = 0;
+  for (Argument& A : F.args())
+    A.setName("a" + Twine(n++));
+  n = 0;
+  for (BasicBlock& B : F) {
+    B.setName("b" + Twine(n++));
+    for (Instruction& I : B) {
+      if (!I.getType()->isVoidTy())
+        I.setName("v" + Twine(n++));
+    }
+  }
+
+  SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+  for (BasicBlock& B : F) {
+    out << B.getName() << ":\n";
+    for (Instruction& I : B) {
+      if (isa<DbgInfoIntrinsic>(I))
+        continue;
+      // the numbers of the metadata and attribute groups
+      // depend on the rest of the module
+      I.getAllMetadata(MDs);
+      for (auto& MD : MDs)
+        I.setMetadata(MD.first, nullptr);
+      if (auto *CB = dyn_cast<CallBase>(&I)) {
+        printAttributes(out, CB->getAttributes());
+        CB->setAttributes(AttributeList());
+      }
+      I.print(out);
+      out << "\n";
+    }
+  }
+
+  return hash(out.str());
+}
+
+std::string HashFunctions::hashGlobal(GlobalVariable& G) {
+  std::string text;
+  raw_string_ostream out(text);
+  SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+  G.getAllMetadata(MDs);
+  for (auto& MD : MDs)
+    G.setMetadata(MD.first, nullptr);
+  G.print(out);
+  return hash(out.str());
+}
+
+static void writeJSONString(raw_ostream& out, StringRef str) {
+  out << '"';
+  for (char c : str) {
+    if (c == '"' || c == '\\')
+      out << '\\';
+    out << c;
+  }
+  out << '"';
+}
+
+static void writeHashes(raw_ostream& out, const char *name,
+                        const std::map<std::string, std::string>& hashes) {
+  out << "  ";
+  writeJSONString(out, name);
+  out << ": {";
+  bool first = true;
+  for (auto& it : hashes) {
+    out << (first ? "\n" : ",\n") << "    ";
+    first = false;
+    writeJSONString(out, it.first);
+    out << ": \"" << it.second << "\"";
+  }
+  out << "\n  }";
+}
+
+bool HashFunctions::runOnModule(Module& M) {
+  StripDebugInfo(M);
+
+  std::map<std::string, std::string> functions, globals;
+  for (Function& F : M) {
+    if (!F.isDeclaration())
+      functions[F.getName().str()] = hashFunction(F);
+  }
+  unsigned unnamed = 0;
+  for (GlobalVariable& G : M.globals()) {
+    std::string name = G.hasName() ? G.getName().str()
+                                   : std::to_string(unnamed++);
+    globals[name] = hashGlobal(G);
+  }
+
+  if (HashesOutput.empty())
+    return true;
+
+  std::error_code EC;
+#if LLVM_VERSION_MAJOR >= 9
+  raw_fd_ostream out(HashesOutput, EC, sys::fs::OF_Text);
+#else
+  raw_fd_ostream out(HashesOutput, EC, sys::fs::F_Text);
+#endif
+  if (EC) {
+    errs() << "Failed opening " << HashesOutput << ": "
+           << EC.message() << "\n";
+    return true;
+  }
+
+  out << "{\n";
+  writeHashes(out, "functions", functions);
+  out << ",\n";
+  writeHashes(out, "globals", globals);
+  out << "\n}\n";
+  return true;
+}
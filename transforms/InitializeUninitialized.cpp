@@ -3,16 +3,24 @@
 // This file is distributed under the University of Illinois Open Source
 // License. See LICENSE.TXT for details.
 
+#include <algorithm>
 #include <cassert>
+#include <map>
+#include <tuple>
 #include <vector>
 #include <unordered_map>
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/Type.h"
@@ -21,124 +29,278 @@
 #else
   #include "llvm/Support/InstIterator.h"
 #endif
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include <llvm/IR/DebugInfoMetadata.h>
 
+#include "Compat.h"
+#include "LazyNondet.h"
+#include "NondetBuilder.h"
+#include "Parallel.h"
+
 using namespace llvm;
 
 bool CloneMetadata(const llvm::Instruction *, llvm::Instruction *);
 
-class InitializeUninitialized : public ModulePass {
-    Function *_vms = nullptr; // verifier_make_nondet function
-    Type *_size_t_Ty = nullptr; // type of size_t
-    unsigned calls_count = 0;
-
-    std::unique_ptr<DataLayout> DL;
+static cl::opt<bool> interprocedural("initialize-uninitialized-interprocedural",
+        cl::desc("Do not initialize the variables that are written on every\n"
+                 "path before they are read, also by the called functions\n"
+                 "(default=true)"),
+        cl::init(true));
+
+static cl::opt<unsigned> summary_depth("initialize-uninitialized-depth",
+        cl::desc("The depth of the calls that are followed when looking\n"
+                 "for the initialization of a variable (default=3)"),
+        cl::init(3));
+
+static cl::opt<uint64_t> lazy_size("initialize-uninitialized-lazy-size",
+        cl::desc("Make uninitialized arrays on stack that have at least this\n"
+                 "size (in bytes) nondeterministic lazily, by chunks, when\n"
+                 "the chunk is accessed for the first time (0 = never)"),
+        cl::init(0));
+
+namespace {
+
+// Is the memory of a pointer (an alloca or an argument) written as a whole
+// on every path before it is read? The accesses through the pointer
+// (and its bitcasts) are the events: a store, memset or memcpy
+// of the whole size writes it, a call writes it if the callee writes
+// the whole argument before reading it and before every return
+// (the summaries of the callees are cached). The other uses (loads,
+// partial stores, GEPs, escapes) are reads. The analysis is a must
+// data-flow over the blocks reachable from the pointer.
+class DefiniteInit {
+    enum class Event { None, Write, Read };
+
+    const DataLayout& DL;
+    std::map<std::tuple<const Function *, unsigned, uint64_t>, bool> summaries;
+    unsigned depth{0};
+
+    Event getEvent(const Instruction *I,
+                   const SmallPtrSetImpl<const Value *>& aliases,
+                   Type *Ty, uint64_t size);
+    bool writesArgument(const Function *F, unsigned idx, uint64_t size);
 
-    Function *get_verifier_make_nondet(Module *);
-    Type *get_size_t(Module *);
   public:
-    static char ID;
-
-    InitializeUninitialized() : ModulePass(ID) {}
-    bool runOnFunction(Function &F);
+    DefiniteInit(const DataLayout& DL) : DL(DL) {}
+
+    // the size bytes of ptr, the memory of the type Ty (or nullptr),
+    // are written before they are read, starting at the beginning
+    // of the block of 'start' (after the definiton of ptr),
+    // with atReturns also before every return
+    bool initialized(const Value *ptr, Type *Ty, uint64_t size,
+                     const BasicBlock *start, bool atReturns);
+};
 
-    bool runOnModule(Module& M) override {
-      DL = std::unique_ptr<DataLayout>(new DataLayout(M.getDataLayout()));
-      bool modified = false;
+} // namespace
 
-      for (Function& F : M)
-        modified |= runOnFunction(F);
+static bool writesWhole(const Value *len, uint64_t size) {
+    auto *C = dyn_cast<ConstantInt>(len);
+    return C && C->getValue().getActiveBits() <= 64 &&
+           C->getZExtValue() >= size;
+}
 
-      return modified;
+DefiniteInit::Event
+DefiniteInit::getEvent(const Instruction *I,
+                       const SmallPtrSetImpl<const Value *>& aliases,
+                       Type *Ty, uint64_t size) {
+    if (const StoreInst *SI = dyn_cast<StoreInst>(I)) {
+        const Value *val = SI->getValueOperand();
+        if (aliases.count(val))
+            return Event::Read; // the pointer escapes
+        Type *ValTy = val->getType();
+        if (ValTy == Ty || (ValTy->isSized() &&
+                            DL.getTypeStoreSize(ValTy) >= size))
+            return Event::Write;
+        // a part of the memory, it does not read anything
+        return Event::None;
     }
-};
 
+    if (const IntrinsicInst *II = dyn_cast<IntrinsicInst>(I)) {
+        switch (II->getIntrinsicID()) {
+        case Intrinsic::lifetime_start:
+        case Intrinsic::lifetime_end:
+            return Event::None;
+        default:
+            break;
+        }
+    }
 
-static RegisterPass<InitializeUninitialized> INIUNINI("initialize-uninitialized",
-                                                      "initialize all uninitialized variables to non-deterministic value");
-char InitializeUninitialized::ID;
-
-static unsigned getKleeMakeNondetCounter(const Function *F) {
-    using namespace llvm;
+    if (const MemIntrinsic *MI = dyn_cast<MemIntrinsic>(I)) {
+        if (const MemTransferInst *MT = dyn_cast<MemTransferInst>(MI))
+            if (aliases.count(MT->getRawSource()))
+                return Event::Read;
+        if (!MI->isVolatile() && aliases.count(MI->getRawDest()))
+            return writesWhole(MI->getLength(), size) ? Event::Write
+                                                      : Event::None;
+        return Event::Read;
+    }
 
-    unsigned max = 0;
-    for (auto I = F->use_begin(), E = F->use_end(); I != E; ++I) {
-#if ((LLVM_VERSION_MAJOR == 3) && (LLVM_VERSION_MINOR < 5))
-        const Value *use = *I;
+    if (const CallInst *CI = dyn_cast<CallInst>(I)) {
+        auto *F = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+        if (!F || aliases.count(calleeOf(CI)))
+            return Event::Read;
+#if LLVM_VERSION_MAJOR >= 8
+        unsigned args = CI->arg_size();
 #else
-        const Value *use = I->getUser();
+        unsigned args = CI->getNumArgOperands();
 #endif
-        auto CI = dyn_cast<CallInst>(use);
-        assert(CI && "The use is not call");
-
-        auto C = dyn_cast<ConstantInt>(CI->getArgOperand(3));
-        assert(C && "Invalid operand in klee_make_nondet");
-
-        auto val = C->getZExtValue();
-        if (val > max)
-            max = val;
+        int idx = -1;
+        for (unsigned i = 0; i < args; ++i) {
+            if (!aliases.count(CI->getArgOperand(i)))
+                continue;
+            if (idx >= 0)
+                return Event::Read; // passed twice
+            idx = i;
+        }
+        if (idx >= 0 && writesArgument(F, idx, size))
+            return Event::Write;
+        return Event::Read;
     }
 
-    return max;
+    return Event::Read;
 }
 
-Function *InitializeUninitialized::get_verifier_make_nondet(llvm::Module *M)
-{
-  if (_vms)
-    return _vms;
+bool DefiniteInit::writesArgument(const Function *F, unsigned idx,
+                                  uint64_t size) {
+    if (F->isDeclaration() || F->isVarArg() || idx >= F->arg_size() ||
+        depth >= summary_depth)
+        return false;
+
+    auto key = std::make_tuple(F, idx, size);
+    auto it = summaries.find(key);
+    if (it != summaries.end())
+        return it->second;
+    // recursive calls do not initialize the argument
+    summaries[key] = false;
+
+    ++depth;
+    bool result = initialized(&*std::next(F->arg_begin(), idx), nullptr, size,
+                              &F->getEntryBlock(), true);
+    --depth;
+    summaries[key] = result;
+    return result;
+}
 
-  LLVMContext& Ctx = M->getContext();
-  //void verifier_make_symbolic(void *addr, size_t nbytes, const char *name);
-  auto C = M->getOrInsertFunction("klee_make_nondet",
-                                   Type::getVoidTy(Ctx),
-                                   Type::getInt8PtrTy(Ctx), // addr
-                                   get_size_t(M),   // nbytes
-                                   Type::getInt8PtrTy(Ctx), // name
-                                   Type::getInt32Ty(Ctx) // identifier
-#if LLVM_VERSION_MAJOR < 5
-                                   , nullptr
-#endif
-                                   );
-#if LLVM_VERSION_MAJOR >= 9
-  _vms = cast<Function>(C.getCallee());
-#else
-  _vms = cast<Function>(C);
-#endif
+bool DefiniteInit::initialized(const Value *ptr, Type *Ty, uint64_t size,
+                               const BasicBlock *start, bool atReturns) {
+    // the pointer and its bitcasts
+    SmallPtrSet<const Value *, 8> aliases;
+    SmallVector<const Value *, 8> stack{ptr};
+    aliases.insert(ptr);
+    DenseMap<const Instruction *, Event> events;
+    while (!stack.empty()) {
+        const Value *V = stack.pop_back_val();
+        for (const User *U : V->users()) {
+            if (isa<BitCastInst>(U)) {
+                if (aliases.insert(U).second)
+                    stack.push_back(U);
+            } else if (auto *I = dyn_cast<Instruction>(U)) {
+                events[I] = Event::None;
+            } else {
+                return false; // a constant expression
+            }
+        }
+    }
+    for (auto& it : events)
+        it.second = getEvent(it.first, aliases, Ty, size);
+
+    // the blocks reachable from start (start itself has no predecessors
+    // inside, it is the entry block)
+    SmallPtrSet<const BasicBlock *, 32> reachable;
+    SmallVector<const BasicBlock *, 32> order{start};
+    reachable.insert(start);
+    for (size_t i = 0; i < order.size(); ++i) {
+        for (const BasicBlock *succ : successors(order[i])) {
+            if (succ == start)
+                return false;
+            if (reachable.insert(succ).second)
+                order.push_back(succ);
+        }
+    }
 
-  calls_count = getKleeMakeNondetCounter(_vms);
+    // is the memory initialized at the end of the block if it is (not)
+    // at its beginning, false if it is read uninitialized
+    auto transfer = [&](const BasicBlock *B, bool init, bool& read) {
+        for (const Instruction& I : *B) {
+            auto it = events.find(&I);
+            if (it == events.end() || init)
+                continue;
+            if (it->second == Event::Read)
+                read = true;
+            else if (it->second == Event::Write)
+                init = true;
+        }
+        return init;
+    };
+
+    // optimistic start (initialized everywhere), then iterate to the fixpoint
+    DenseMap<const BasicBlock *, bool> out;
+    for (const BasicBlock *B : order)
+        out[B] = true;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const BasicBlock *B : order) {
+            bool in = B != start;
+            for (const BasicBlock *pred : predecessors(B))
+                if (reachable.count(pred))
+                    in &= out[pred];
+            bool read = false;
+            bool init = transfer(B, in, read);
+            if (read)
+                return false;
+            if (init != out[B]) {
+                out[B] = init;
+                changed = true;
+            }
+        }
+    }
 
-  return _vms;
+    if (atReturns) {
+        for (const BasicBlock *B : order)
+            if (isa<ReturnInst>(B->getTerminator()) && !out[B])
+                return false;
+    }
+    return true;
 }
 
-Type *InitializeUninitialized::get_size_t(llvm::Module *M)
-{
-  if (_size_t_Ty)
-    return _size_t_Ty;
+class InitializeUninitialized : public ModulePass {
+    std::unique_ptr<NondetBuilder> _nondet;
+    std::unique_ptr<DataLayout> DL;
+    std::unique_ptr<LazyNondet> _lazy;
 
-  LLVMContext& Ctx = M->getContext();
+    bool initializeLazily(AllocaInst *AI, const std::string& name);
 
-  if (DL->getPointerSizeInBits() > 32)
-    _size_t_Ty = Type::getInt64Ty(Ctx);
-  else
-    _size_t_Ty = Type::getInt32Ty(Ctx);
+  public:
+    static char ID;
 
-  return _size_t_Ty;
-}
+    InitializeUninitialized() : ModulePass(ID) {}
+    bool runOnFunction(Function &F, const std::vector<AllocaInst *>& allocas);
+
+    bool runOnModule(Module& M) override;
+};
+
+
+static RegisterPass<InitializeUninitialized> INIUNINI("initialize-uninitialized",
+                                                      "initialize all uninitialized variables to non-deterministic value");
+char InitializeUninitialized::ID;
 
 // no hard analysis, just check wether the alloca is initialized
 // in the same block. (we could do an O(n) analysis that would
 // do DFS and if the alloca would be initialized on every path
 // before reaching some backedge, then it must be initialized),
 // for all allocas the running time would be O(n^2) and it could
-// probably be decreased (without pointers)
+// probably be decreased (without pointers). The allocas that this
+// does not decide are then checked by DefiniteInit (serially).
+//
+// This is called from several threads, so it must only read the IR
+// (that is also why it does not check whether the type is sized,
+// that may cache the result in the type)
 static bool mayBeUnititialized(const llvm::AllocaInst *AI)
 {
-	Type *AITy = AI->getAllocatedType();
-	if(!AITy->isSized())
-		return true;
-
+    Type *AITy = AI->getAllocatedType();
     const BasicBlock *block = AI->getParent();
     auto I = block->begin();
     auto E = block->end();
@@ -166,144 +328,207 @@ static bool mayBeUnititialized(const llvm::AllocaInst *AI)
     return true;
 }
 
-GlobalVariable *getNameGlobal(Module *M, const std::string& name)
+// Instead of making the whole array nondeterministic right after
+// the allocation, make its chunks nondeterministic when they are accessed
+// for the first time (see LazyNondet, the flags about which chunks were
+// initialized are in a new array on the stack). This is possible only
+// if we see all the accesses to the array.
+// Return false if the array should be initialized at once.
+bool InitializeUninitialized::initializeLazily(AllocaInst *AI,
+                                               const std::string& name)
 {
-  LLVMContext& Ctx = M->getContext();
-  Constant *name_init = ConstantDataArray::getString(Ctx, name);
-  GlobalVariable *G = new GlobalVariable(*M, name_init->getType(), true,
-                                          GlobalValue::PrivateLinkage,
-                                          name_init);
-  return G;
+  uint64_t chunk_size = LazyNondet::getChunkSize();
+  uint64_t size = DL->getTypeAllocSize(AI->getAllocatedType());
+  if (lazy_size == 0 || chunk_size == 0 || size < lazy_size)
+    return false;
+
+  std::vector<Instruction *> accesses;
+  if (!LazyNondet::getAccesses(AI, accesses))
+    return false;
+
+  LLVMContext& Ctx = AI->getContext();
+  uint64_t chunks = (size + chunk_size - 1) / chunk_size;
+
+  auto *FlagsTy = ArrayType::get(Type::getInt8Ty(Ctx), chunks);
+  auto *Flags = makeAlloca(FlagsTy, *DL, "lazy_flags");
+  auto *SI = new StoreInst(ConstantAggregateZero::get(FlagsTy), Flags, false,
+#if LLVM_VERSION_MAJOR >= 11
+                           Align(1),
+#endif
+                           static_cast<Instruction*>(nullptr));
+  auto *Mem = CastInst::CreatePointerCast(AI, Type::getInt8PtrTy(Ctx));
+  auto *FlagsPtr = CastInst::CreatePointerCast(Flags, Type::getInt8PtrTy(Ctx));
+  Flags->insertAfter(AI);
+  SI->insertAfter(Flags);
+  Mem->insertAfter(SI);
+  FlagsPtr->insertAfter(Mem);
+
+  CloneMetadata(AI, Flags);
+  CloneMetadata(AI, SI);
+  CloneMetadata(AI, Mem);
+  CloneMetadata(AI, FlagsPtr);
+
+  _lazy->instrument(accesses, Mem,
+                    ConstantInt::get(_nondet->getSizeT(), size),
+                    FlagsPtr, name);
+  return true;
 }
 
-bool InitializeUninitialized::runOnFunction(Function &F)
+bool InitializeUninitialized::runOnModule(Module& M)
 {
-  // do not run the initializer on __VERIFIER and __INSTR functions
-  const auto& fname = F.getName();
-  if (fname.startswith("__VERIFIER_") || fname.startswith("__INSTR_"))
-    return false;
+  DL = std::unique_ptr<DataLayout>(new DataLayout(M.getDataLayout()));
+  _nondet.reset(new NondetBuilder(M));
+  _lazy.reset(new LazyNondet(M, *_nondet));
+  bool modified = false;
+
+  std::vector<Function *> funs;
+  for (Function& F : M) {
+    // do not run the initializer on __VERIFIER and __INSTR functions
+    const auto& fname = F.getName();
+    if (fname.startswith("__VERIFIER_") || fname.startswith("__INSTR_"))
+      continue;
+    funs.push_back(&F);
+  }
+
+  // find the allocas that may be uninitialized (in parallel),
+  // the instrumentation itself creates values and must be done serially.
+  // The instrumentation of an alloca does not change the result
+  // for other allocas, it inserts code only right after the alloca.
+  std::vector<std::vector<AllocaInst *>> allocas(funs.size());
+  parallelFor(funs.size(), [&](size_t i) {
+    for (inst_iterator I = inst_begin(*funs[i]), E = inst_end(*funs[i]);
+         I != E; ++I) {
+      if (AllocaInst *AI = dyn_cast<AllocaInst>(&*I))
+        if (mayBeUnititialized(AI))
+          allocas[i].push_back(AI);
+    }
+  });
+
+  // drop the allocas that are written on every path before they are read.
+  // Serially, the analysis caches the summaries of the called functions
+  // and computes the sizes of types (that caches the layouts).
+  if (interprocedural) {
+    DefiniteInit analysis(*DL);
+    for (auto& fnAllocas : allocas) {
+      fnAllocas.erase(std::remove_if(fnAllocas.begin(), fnAllocas.end(),
+                                     [&](AllocaInst *AI) {
+        Type *Ty = AI->getAllocatedType();
+        const BasicBlock *B = AI->getParent();
+        if (!Ty->isSized() || AI->isArrayAllocation() ||
+            B != &B->getParent()->getEntryBlock())
+          return false;
+        return analysis.initialized(AI, Ty, DL->getTypeAllocSize(Ty), B,
+                                    false);
+      }), fnAllocas.end());
+    }
+  }
+
+  for (size_t i = 0; i < funs.size(); ++i)
+    modified |= runOnFunction(*funs[i], allocas[i]);
 
+  _nondet->finish();
+  return modified;
+}
+
+bool InitializeUninitialized::runOnFunction(Function &F,
+                                            const std::vector<AllocaInst *>& allocas)
+{
   bool modified = false;
   Module *M = F.getParent();
   LLVMContext& Ctx = M->getContext();
 
-  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E;) {
-    Instruction *ins = &*I;
-    ++I;
-
-    if (AllocaInst *AI = dyn_cast<AllocaInst>(ins)) {
-      if (!mayBeUnititialized(AI))
-        continue;
-
-      Type *Ty = AI->getAllocatedType();
-      CallInst *CI = nullptr;
-      CastInst *CastI = nullptr;
-      StoreInst *SI = nullptr;
-      LoadInst *LI = nullptr;
-      BinaryOperator *MulI = nullptr;
-
-      std::vector<Value *> args;
-
-      // create new allocainst, declare it symbolic and store it
-      // to the original alloca. This way slicer will slice this
-      // initialization away if program initialize it manually later
-      if (Ty->isSized()) {
-        GlobalVariable *name = getNameGlobal(M, F.getName().str() + ":uninitialized:0");
-        Function *C = get_verifier_make_nondet(M);
-        // if this is an array allocation, just call verifier_make_nondet on it,
-        // since storing whole symbolic array into it would have soo huge overhead
-        if (Ty->isArrayTy()) {
-            CastI = CastInst::CreatePointerCast(AI, Type::getInt8PtrTy(Ctx));
-            args.push_back(CastI);
-            args.push_back(ConstantInt::get(get_size_t(M), DL->getTypeAllocSize(Ty)));
-            args.push_back(ConstantExpr::getPointerCast(name, Type::getInt8PtrTy(Ctx)));
-            args.push_back(ConstantInt::get(Type::getInt32Ty(Ctx), ++calls_count));
-
-            CI = CallInst::Create(C, args);
-            CastI->insertAfter(AI);
-            CI->insertAfter(CastI);
-
-            // we must add these metadata due to the inliner pass, that
-            // corrupts the code when metada are missing
-            CloneMetadata(AI, CastI);
+  for (AllocaInst *AI : allocas) {
+    Type *Ty = AI->getAllocatedType();
+    CallInst *CI = nullptr;
+    CastInst *CastI = nullptr;
+    StoreInst *SI = nullptr;
+    LoadInst *LI = nullptr;
+    BinaryOperator *MulI = nullptr;
+
+    // create new allocainst, declare it symbolic and store it
+    // to the original alloca. This way slicer will slice this
+    // initialization away if program initialize it manually later
+    if (Ty->isSized()) {
+      const std::string name = F.getName().str() + ":uninitialized:0";
+      Type *SizeTy = _nondet->getSizeT();
+      // if this is an array allocation, just call verifier_make_nondet on it,
+      // since storing whole symbolic array into it would have soo huge overhead
+      if (Ty->isArrayTy() && initializeLazily(AI, name)) {
+          // the chunks of the array are made nondeterministic
+          // on the first access
+      } else if (Ty->isArrayTy()) {
+          CastI = CastInst::CreatePointerCast(AI, Type::getInt8PtrTy(Ctx));
+          CI = _nondet->createCall(CastI,
+                                   ConstantInt::get(SizeTy, DL->getTypeAllocSize(Ty)),
+                                   name);
+          CastI->insertAfter(AI);
+          CI->insertAfter(CastI);
+
+          // we must add these metadata due to the inliner pass, that
+          // corrupts the code when metada are missing
+          CloneMetadata(AI, CastI);
 	        CloneMetadata(AI, CI);
-        } else if (AI->isArrayAllocation()) {
-            CastI = CastInst::CreatePointerCast(AI, Type::getInt8PtrTy(Ctx));
-            MulI = BinaryOperator::CreateMul(AI->getArraySize(),
-                                             ConstantInt::get(get_size_t(M),
-                                                              DL->getTypeAllocSize(Ty)),
-                                             "val_size");
-            args.push_back(CastI);
-            args.push_back(MulI);
-            args.push_back(ConstantExpr::getPointerCast(name, Type::getInt8PtrTy(Ctx)));
-            args.push_back(ConstantInt::get(Type::getInt32Ty(Ctx), ++calls_count));
-            CI = CallInst::Create(C, args);
-
-            CastI->insertAfter(AI);
-            MulI->insertAfter(CastI);
-            CI->insertAfter(MulI);
-
-            CloneMetadata(AI, CastI);
-            CloneMetadata(AI, MulI);
+      } else if (AI->isArrayAllocation()) {
+          CastI = CastInst::CreatePointerCast(AI, Type::getInt8PtrTy(Ctx));
+          MulI = BinaryOperator::CreateMul(AI->getArraySize(),
+                                           ConstantInt::get(SizeTy,
+                                                            DL->getTypeAllocSize(Ty)),
+                                           "val_size");
+          CI = _nondet->createCall(CastI, MulI, name);
+
+          CastI->insertAfter(AI);
+          MulI->insertAfter(CastI);
+          CI->insertAfter(MulI);
+
+          CloneMetadata(AI, CastI);
+          CloneMetadata(AI, MulI);
 	        CloneMetadata(AI, CI);
-        } else {
-            // when this is not an array allocation,
-            // store the symbolic value into the allocated memory using normal StoreInst.
-            // That will allow slice away more unneeded allocations
-            auto AIS = new AllocaInst(
-                AI->getAllocatedType(),
-#if (LLVM_VERSION_MAJOR >= 5)
-                AI->getType()->getAddressSpace(),
-#endif
-                nullptr,
+      } else {
+          // when this is not an array allocation,
+          // store the symbolic value into the allocated memory using normal StoreInst.
+          // That will allow slice away more unneeded allocations
+          auto AIS = makeAlloca(AI->getAllocatedType(),
+                                M->getDataLayout());
+          setAlignment(AIS, getAlignment(AI));
+          AIS->insertAfter(AI);
+
+          // we created a new allocation, so now we will make it nondeterministic
+          // and store its value into the original allocation
+          CastI = CastInst::CreatePointerCast(AIS, Type::getInt8PtrTy(Ctx));
+          CI = _nondet->createCall(CastI,
+                                   ConstantInt::get(SizeTy, DL->getTypeAllocSize(Ty)),
+                                   name);
+          CastI->insertAfter(AIS);
+          CI->insertAfter(CastI);
+
+          LI = new LoadInst(
+              AIS->getType()->getPointerElementType(),
+              AIS,
+              "",
 #if LLVM_VERSION_MAJOR >= 11
-                AI->getAlign(),
+              false,
+              AIS->getAlign(),
 #endif
-                "",
-                static_cast<Instruction*>(nullptr));
-            AIS->insertAfter(AI);
-
-            // we created a new allocation, so now we will make it nondeterministic
-            // and store its value into the original allocation
-            CastI = CastInst::CreatePointerCast(AIS, Type::getInt8PtrTy(Ctx));
-            args.push_back(CastI);
-            args.push_back(ConstantInt::get(get_size_t(M), DL->getTypeAllocSize(Ty)));
-            args.push_back(ConstantExpr::getPointerCast(name, Type::getInt8PtrTy(Ctx)));
-            args.push_back(ConstantInt::get(Type::getInt32Ty(Ctx), ++calls_count));
-
-            CI = CallInst::Create(C, args);
-            CastI->insertAfter(AIS);
-            CI->insertAfter(CastI);
-
-            LI = new LoadInst(
-                AIS->getType()->getPointerElementType(),
-                AIS,
-                "",
+              static_cast<Instruction*>(nullptr));
+          SI = new StoreInst(
+              LI,
+              AI,
+              false,
 #if LLVM_VERSION_MAJOR >= 11
-                false,
-                AIS->getAlign(),
+              LI->getAlign(),
 #endif
-                static_cast<Instruction*>(nullptr));
-            SI = new StoreInst(
-                LI,
-                AI,
-                false,
-#if LLVM_VERSION_MAJOR >= 11
-                LI->getAlign(),
-#endif
-                static_cast<Instruction*>(nullptr));
-            LI->insertAfter(CI);
-            SI->insertAfter(LI);
+              static_cast<Instruction*>(nullptr));
+          LI->insertAfter(CI);
+          SI->insertAfter(LI);
 
 	        CloneMetadata(AI, AIS);
 	        CloneMetadata(AI, CI);
 	        CloneMetadata(AI, CastI);
 	        CloneMetadata(AI, LI);
-            CloneMetadata(AI, SI);
-        }
-
-        modified = true;
+          CloneMetadata(AI, SI);
       }
+
+      modified = true;
     }
   }
 
@@ -0,0 +1,129 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Replace the calls of the check functions of the instrumentation
+//
+//   __INSTR_check_nontermination(c)   (fails if c holds)
+//   __INSTR_check_assume(c)           (fails if c does not hold)
+//
+// by a branch to a block that calls __INSTR_fail. There is one such block
+// in a function for all the checks, so a check is a branch instead of
+// a call of a (linked) function. The definitions in lib/verifier are
+// always_inline for the tools that link them without this pass.
+
+#include <vector>
+
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+namespace {
+
+class InlineChecks : public FunctionPass {
+  Function *getFail(Module& M);
+
+public:
+  static char ID;
+
+  InlineChecks() : FunctionPass(ID) {}
+
+  bool runOnFunction(Function& F) override;
+};
+
+} // namespace
+
+static RegisterPass<InlineChecks> IC("inline-checks",
+                                     "Replace calls of __INSTR_check_* "
+                                     "by branches to __INSTR_fail");
+char InlineChecks::ID;
+
+Function *InlineChecks::getFail(Module& M) {
+  auto C = insertFunction(M, "__INSTR_fail",
+                          Type::getVoidTy(M.getContext()), {});
+  Function *F = functionOf(C);
+  F->addFnAttr(Attribute::NoReturn);
+  return F;
+}
+
+// does the check fail if its argument is true?
+static bool isCheck(const CallInst *CI, bool& failsIfTrue) {
+  auto *callee = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+  // (the operands are the argument and the called function)
+  if (!callee || CI->getNumOperands() != 2 ||
+      !CI->getArgOperand(0)->getType()->isIntegerTy())
+    return false;
+
+  if (callee->getName().equals("__INSTR_check_nontermination")) {
+    failsIfTrue = true;
+    return true;
+  }
+  if (callee->getName().equals("__INSTR_check_assume")) {
+    failsIfTrue = false;
+    return true;
+  }
+  return false;
+}
+
+bool InlineChecks::runOnFunction(Function& F) {
+  std::vector<std::pair<CallInst *, bool>> checks;
+  for (BasicBlock& B : F) {
+    for (Instruction& I : B) {
+      bool failsIfTrue;
+      if (auto *CI = dyn_cast<CallInst>(&I))
+        if (isCheck(CI, failsIfTrue))
+          checks.emplace_back(CI, failsIfTrue);
+    }
+  }
+  if (checks.empty())
+    return false;
+
+  LLVMContext& Ctx = F.getContext();
+  BasicBlock *failB = BasicBlock::Create(Ctx, "__INSTR_fail", &F);
+  CallInst *failCI = CallInst::Create(getFail(*F.getParent()), {}, "", failB);
+  new UnreachableInst(Ctx, failB);
+
+  // the location of the failure is the common part
+  // of the locations of the checks
+  const DILocation *failLoc = checks.front().first->getDebugLoc().get();
+  for (auto& check : checks) {
+    CallInst *CI = check.first;
+#if LLVM_VERSION_MAJOR >= 8
+    failLoc = DILocation::getMergedLocation(failLoc,
+                                            CI->getDebugLoc().get());
+#endif
+
+    // the rest of the block runs if the check passes
+    BasicBlock *B = CI->getParent();
+    BasicBlock *cont = SplitBlock(B, CI);
+    Instruction *T = B->getTerminator();
+    IRBuilder<> builder(T);
+    builder.SetCurrentDebugLocation(CI->getDebugLoc());
+    Value *cond = CI->getArgOperand(0);
+    if (!cond->getType()->isIntegerTy(1))
+      cond = builder.CreateICmpNE(cond,
+                                  ConstantInt::get(cond->getType(), 0));
+    if (check.second)
+      builder.CreateCondBr(cond, failB, cont);
+    else
+      builder.CreateCondBr(cond, cont, failB);
+    T->eraseFromParent();
+    CI->eraseFromParent();
+  }
+
+  if (failLoc)
+    failCI->setDebugLoc(failLoc);
+  return true;
+}
@@ -0,0 +1,246 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Bracket simple regions of code with klee_open_merge and klee_close_merge,
+// so that KLEE (with -use-merge) merges the states that forked inside
+// the region once they leave it. The regions are:
+//
+//  - the bodies of innermost loops that have one latch and are entered
+//    from the header: every path from the entry of the body ends
+//    at the latch (there are no exits but from the header),
+//  - diamonds and triangles of blocks (if-then-else and if-then)
+//    outside of such loop bodies.
+//
+// A region must not contain calls (the merging in KLEE does not survive
+// returning from a call), allocations on the stack or other terminators
+// than branches and switches, and it has at most
+// -insert-merge-hints-max-blocks blocks. Every path that opens the merge
+// closes it, because the regions are single-entry and single-exit.
+
+#include <algorithm>
+#include <vector>
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2);
+
+static cl::opt<unsigned> MaxBlocks("insert-merge-hints-max-blocks",
+        cl::desc("The maximal number of blocks of a merged region "
+                 "(default: 16)"),
+        cl::init(16));
+
+namespace {
+
+class InsertMergeHints : public ModulePass {
+  Function *_open{nullptr};
+  Function *_close{nullptr};
+  unsigned _loops{0};
+  unsigned _diamonds{0};
+  // the blocks that are already in a merged region
+  SmallPtrSet<const BasicBlock *, 32> _merged;
+
+  Function *getHint(Module& M, const char *name);
+  void bracket(Instruction *open, Instruction *close);
+  bool mergeLoop(Loop *L);
+  bool mergeDiamond(BasicBlock& B);
+
+public:
+  static char ID;
+
+  InsertMergeHints() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<InsertMergeHints> IMH("insert-merge-hints",
+                                          "Bracket simple loop bodies and "
+                                          "diamonds with KLEE's merge hints");
+char InsertMergeHints::ID;
+
+// no calls, no allocations on the stack, only branching terminators
+static bool isSimple(const BasicBlock& B) {
+  for (const Instruction& I : B) {
+    if (isa<DbgInfoIntrinsic>(I))
+      continue;
+    if (isa<CallInst>(I) || isa<InvokeInst>(I) || isa<AllocaInst>(I))
+      return false;
+  }
+
+  const Instruction *T = B.getTerminator();
+  return isa<BranchInst>(T) || isa<SwitchInst>(T);
+}
+
+static bool isFork(const BasicBlock& B) {
+  return B.getTerminator()->getNumSuccessors() > 1;
+}
+
+Function *InsertMergeHints::getHint(Module& M, const char *name) {
+  auto C = insertFunction(M, name,
+                          Type::getVoidTy(M.getContext()),
+                          {});
+  return functionOf(C);
+}
+
+// open the merge before 'open' and close it before 'close'
+void InsertMergeHints::bracket(Instruction *open, Instruction *close) {
+  auto *openCI = CallInst::Create(_open);
+  CloneMetadata(open, openCI);
+  openCI->insertBefore(open);
+
+  auto *closeCI = CallInst::Create(_close);
+  CloneMetadata(close, closeCI);
+  closeCI->insertBefore(close);
+}
+
+bool InsertMergeHints::mergeLoop(Loop *L) {
+  if (!L->getSubLoops().empty())
+    return false;
+
+  BasicBlock *header = L->getHeader();
+  BasicBlock *latch = L->getLoopLatch();
+  if (!latch || latch == header || L->getNumBlocks() - 1 > MaxBlocks)
+    return false;
+
+  // the body is entered from the header only
+  BasicBlock *entry = nullptr;
+  for (BasicBlock *succ : successors(header)) {
+    if (!L->contains(succ))
+      continue;
+    if (entry && entry != succ)
+      return false;
+    entry = succ;
+  }
+  if (!entry || entry == header || !entry->getSinglePredecessor())
+    return false;
+
+  bool forks = false;
+  for (BasicBlock *B : L->getBlocks()) {
+    if (B == header)
+      continue;
+    if (!isSimple(*B))
+      return false;
+    // there are no exits from the body and only the latch
+    // goes back to the header
+    for (BasicBlock *succ : successors(B)) {
+      if (!L->contains(succ) || (succ == header && B != latch))
+        return false;
+    }
+    forks |= isFork(*B);
+  }
+  if (!forks)
+    return false;
+
+  bracket(&*entry->getFirstInsertionPt(), latch->getTerminator());
+  for (BasicBlock *B : L->getBlocks()) {
+    if (B != header)
+      _merged.insert(B);
+  }
+  ++_loops;
+  return true;
+}
+
+bool InsertMergeHints::mergeDiamond(BasicBlock& B) {
+  auto *BI = dyn_cast<BranchInst>(B.getTerminator());
+  if (!BI || !BI->isConditional() || _merged.count(&B))
+    return false;
+
+  BasicBlock *T = BI->getSuccessor(0);
+  BasicBlock *F = BI->getSuccessor(1);
+  if (T == F || T == &B || F == &B)
+    return false;
+
+  // one side of the region, it must have B as the only predecessor
+  // and 'join' as the only successor
+  auto isSide = [&B](const BasicBlock *S, const BasicBlock *join) {
+    return S->getSinglePredecessor() == &B &&
+           S->getSingleSuccessor() == join && isSimple(*S);
+  };
+
+  BasicBlock *join = nullptr;
+  std::vector<BasicBlock *> sides;
+  if (T->getSingleSuccessor() &&
+      T->getSingleSuccessor() == F->getSingleSuccessor()) {
+    join = T->getSingleSuccessor();
+    sides = {T, F};
+  } else if (T->getSingleSuccessor() == F) {
+    join = F;
+    sides = {T};
+  } else if (F->getSingleSuccessor() == T) {
+    join = T;
+    sides = {F};
+  } else {
+    return false;
+  }
+
+  if (join == &B || _merged.count(join))
+    return false;
+  for (BasicBlock *S : sides) {
+    if (!isSide(S, join) || _merged.count(S))
+      return false;
+  }
+
+  // nothing but the region enters the join
+  for (BasicBlock *pred : predecessors(join)) {
+    if (pred != &B && std::find(sides.begin(), sides.end(), pred) == sides.end())
+      return false;
+  }
+
+  bracket(BI, &*join->getFirstInsertionPt());
+  for (BasicBlock *S : sides)
+    _merged.insert(S);
+  ++_diamonds;
+  return true;
+}
+
+bool InsertMergeHints::runOnModule(Module& M) {
+  _open = getHint(M, "klee_open_merge");
+  _close = getHint(M, "klee_close_merge");
+  _loops = _diamonds = 0;
+
+  bool changed = false;
+  for (Function& F : M) {
+    if (F.isDeclaration())
+      continue;
+
+    _merged.clear();
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    for (Loop *L : LI.getLoopsInPreorder())
+      changed |= mergeLoop(L);
+
+    for (BasicBlock& B : F)
+      changed |= mergeDiamond(B);
+  }
+
+  errs() << "Inserted merge hints for " << _loops << " loop bodies and "
+         << _diamonds << " diamonds\n";
+
+  if (!changed) {
+    // do not leave the declarations in the module
+    if (_open->use_empty())
+      _open->eraseFromParent();
+    if (_close->use_empty())
+      _close->eraseFromParent();
+  }
+
+  return changed;
+}
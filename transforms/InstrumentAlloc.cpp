@@ -13,6 +13,7 @@
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/Type.h"
@@ -21,9 +22,14 @@
 #else
   #include "llvm/Support/InstIterator.h"
 #endif
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
+#include "Compat.h"
+#include "LazyNondet.h"
+#include "NondetBuilder.h"
+
 using namespace llvm;
 
 class InstrumentAlloc : public FunctionPass {
@@ -53,42 +59,31 @@ static RegisterPass<InstrumentAllocNeverFails> INSTALLOCNF("instrument-alloc-nf"
                                                            "allocation never fail");
 char InstrumentAllocNeverFails::ID;
 
-static void replace_malloc(Module *M, CallInst *CI, bool never_fails)
+// the size of allocations from which on we use the lazy models
+static cl::opt<uint64_t> lazy_size("instrument-alloc-lazy-size",
+        cl::desc("Allocations of at least this size (in bytes) use models\n"
+                 "that make the memory nondeterministic lazily (malloc)\n"
+                 "or just zero it (calloc), 0 = never"),
+        cl::init(0));
+
+static Function *get_model(Module *M, const std::string& name, CallInst *CI)
 {
-  Value *C = nullptr;
+  std::vector<Type *> params;
+  for (unsigned i = 0; i < CI->getNumOperands() - 1; ++i)
+    params.push_back(CI->getOperand(i)->getType());
 
-  if (never_fails) {
-    auto X = M->getOrInsertFunction("__VERIFIER_malloc0", CI->getType(),
-                                    CI->getOperand(0)->getType()
-#if LLVM_VERSION_MAJOR < 5
-    , nullptr
-#endif
-    );
-#if LLVM_VERSION_MAJOR >= 9
-    C = X.getCallee();
-#else
-    C = X;
-#endif
-  } else {
-    auto X = M->getOrInsertFunction("__VERIFIER_malloc", CI->getType(), CI->getOperand(0)->getType()
-#if LLVM_VERSION_MAJOR < 5
-    , nullptr
-#endif
-    );
-#if LLVM_VERSION_MAJOR >= 9
-    C = X.getCallee();
-#else
-    C = X;
-#endif
-  }
+  return functionOf(insertFunction(*M, name, CI->getType(), params));
+}
 
-  assert(C);
-  Function *Malloc = cast<Function>(C);
+static CallInst *replace_alloc(Module *M, CallInst *CI, const std::string& name)
+{
+  Function *Alloc = get_model(M, name, CI);
 
   std::vector<Value *> args;
-  args.push_back(CI->getOperand(0));
+  for (unsigned i = 0; i < CI->getNumOperands() - 1; ++i)
+    args.push_back(CI->getOperand(i));
 
-  CallInst *new_CI = CallInst::Create(Malloc, args);
+  CallInst *new_CI = CallInst::Create(Alloc, args);
 
   SmallVector<std::pair<unsigned, MDNode *>, 8> metadata;
   CI->getAllMetadata(metadata);
@@ -101,55 +96,125 @@ static void replace_malloc(Module *M, CallInst *CI, bool never_fails)
   new_CI->insertBefore(CI);
   CI->replaceAllUsesWith(new_CI);
   CI->eraseFromParent();
+
+  return new_CI;
 }
 
-static void replace_calloc(Module *M, CallInst *CI, bool never_fails)
+static cl::opt<bool> deref_never_fails("instrument-alloc-deref-nf",
+        cl::desc("Use the models that never fail for allocations whose result\n"
+                 "is dereferenced right away (before it is compared, stored\n"
+                 "or any function is called). If such allocation fails,\n"
+                 "the program only dereferences NULL."),
+        cl::init(false));
+
+static cl::opt<bool> replace_realloc("instrument-alloc-realloc",
+        cl::desc("Replace realloc by the model that may fail and that\n"
+                 "keeps the object when shrinking it (the accesses after\n"
+                 "the new end are not errors then, not for memory safety)"),
+        cl::init(false));
+
+// Is the result of the allocation dereferenced in its block before it is used
+// in any other way (apart from casts and GEPs) and before any call?
+// Then the allocation failing ends with a NULL dereference and cannot affect
+// other properties than memory safety.
+static bool is_dereferenced_first(CallInst *CI)
 {
-  Value *C = nullptr;
-  if (never_fails) {
-    auto X = M->getOrInsertFunction("__VERIFIER_calloc0", CI->getType(), CI->getOperand(0)->getType(), CI->getOperand(1)->getType()
-#if LLVM_VERSION_MAJOR < 5
-    , nullptr
-#endif
-    );
-#if LLVM_VERSION_MAJOR >= 9
-    C = X.getCallee();
-#else
-    C = X;
-#endif
-  } else {
-    auto X = M->getOrInsertFunction("__VERIFIER_calloc", CI->getType(), CI->getOperand(0)->getType(), CI->getOperand(1)->getType()
-#if LLVM_VERSION_MAJOR < 5
-    , nullptr
-#endif
-    );
-#if LLVM_VERSION_MAJOR >= 9
-    C = X.getCallee();
-#else
-    C = X;
-#endif
+  std::set<const Value *> derived{CI};
+  for (auto I = ++BasicBlock::iterator(CI), E = CI->getParent()->end();
+       I != E; ++I) {
+    Instruction *ins = &*I;
+    if (isa<DbgInfoIntrinsic>(ins))
+      continue;
+    if (isa<CallInst>(ins) || isa<InvokeInst>(ins) || ins->isTerminator())
+      return false;
+
+    if (auto *LI = dyn_cast<LoadInst>(ins)) {
+      if (derived.count(LI->getPointerOperand()))
+        return true;
+    } else if (auto *SI = dyn_cast<StoreInst>(ins)) {
+      if (derived.count(SI->getValueOperand()))
+        return false;
+      if (derived.count(SI->getPointerOperand()))
+        return true;
+    } else if (isa<BitCastInst>(ins) || isa<GetElementPtrInst>(ins)) {
+      if (derived.count(ins->getOperand(0))) {
+        // the pointer must not be the index
+        for (unsigned i = 1; i < ins->getNumOperands(); ++i)
+          if (derived.count(ins->getOperand(i)))
+            return false;
+        derived.insert(ins);
+      } else {
+        for (const Use& U : ins->operands())
+          if (derived.count(U.get()))
+            return false;
+      }
+    } else {
+      for (const Use& U : ins->operands())
+        if (derived.count(U.get()))
+          return false;
+    }
   }
 
-  assert(C);
-  Function *Calloc = cast<Function>(C);
+  return false;
+}
 
-  std::vector<Value *> args;
-  args.push_back(CI->getOperand(0));
-  args.push_back(CI->getOperand(1));
+// is the allocation big enough (or of unknown size) for the lazy models?
+static bool use_lazy(CallInst *CI)
+{
+  if (lazy_size == 0)
+    return false;
 
-  CallInst *new_CI = CallInst::Create(Calloc, args);
+  uint64_t size = 1;
+  for (unsigned i = 0; i < CI->getNumOperands() - 1; ++i) {
+    auto C = dyn_cast<ConstantInt>(CI->getOperand(i));
+    if (!C)
+      return true;
+    size *= C->getZExtValue();
+  }
 
-  SmallVector<std::pair<unsigned, MDNode *>, 8> metadata;
-  CI->getAllMetadata(metadata);
-  // copy the metadata
-  for (auto& md : metadata)
-    new_CI->setMetadata(md.first, md.second);
-  // copy the attributes (like zeroext etc.)
-  new_CI->setAttributes(CI->getAttributes());
+  return size >= lazy_size;
+}
 
-  new_CI->insertBefore(CI);
-  CI->replaceAllUsesWith(new_CI);
-  CI->eraseFromParent();
+// Replace malloc with a model that returns memory that is not
+// nondeterministic and make the memory nondeterministic on the first access
+// (see LazyNondet). This is possible only if we see all the accesses to
+// the memory, otherwise use the usual model.
+static bool replace_malloc_lazy(Module *M, CallInst *CI, bool never_fails,
+                                NondetBuilder& nondet)
+{
+  std::vector<Instruction *> accesses;
+  if (!LazyNondet::getAccesses(CI, accesses))
+    return false;
+
+  Value *size = CI->getOperand(0);
+  CallInst *mem = replace_alloc(M, CI, never_fails ? "__VERIFIER_malloc0_lazy"
+                                                   : "__VERIFIER_malloc_lazy");
+
+  // char *__VERIFIER_make_nondet_lazy_flags(size_t size, size_t chunk)
+  LLVMContext& Ctx = M->getContext();
+  Type *SizeTy = nondet.getSizeT();
+  auto X = insertFunction(*M, "__VERIFIER_make_nondet_lazy_flags",
+                          Type::getInt8PtrTy(Ctx),
+                          {SizeTy, SizeTy});
+  Function *FlagsF = functionOf(X);
+  std::vector<Value *> args = {
+    size, ConstantInt::get(SizeTy, LazyNondet::getChunkSize())
+  };
+  auto *flags = CallInst::Create(FlagsF, args, "lazy_flags");
+  flags->insertAfter(mem);
+  if (mem->getDebugLoc())
+    flags->setDebugLoc(mem->getDebugLoc());
+
+  Value *memptr = mem;
+  if (mem->getType() != Type::getInt8PtrTy(Ctx)) {
+    auto *cast = CastInst::CreatePointerCast(mem, Type::getInt8PtrTy(Ctx));
+    cast->insertAfter(flags);
+    memptr = cast;
+  }
+
+  LazyNondet lazy(*M, nondet);
+  lazy.instrument(accesses, memptr, size, flags, "malloc");
+  return true;
 }
 
 static bool instrument_alloc(Function &F, bool never_fails)
@@ -161,6 +226,7 @@ static bool instrument_alloc(Function &F, bool never_fails)
 
   bool modified = false;
   Module *M = F.getParent();
+  NondetBuilder nondet(*M);
 
   for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E;) {
     Instruction *ins = &*I;
@@ -169,27 +235,47 @@ static bool instrument_alloc(Function &F, bool never_fails)
       if (CI->isInlineAsm())
         continue;
 
-#if LLVM_VERSION_MAJOR >= 8
-      const Value *val = CI->getCalledOperand()->stripPointerCasts();
-#else
-      const Value *val = CI->getCalledValue()->stripPointerCasts();
-#endif
+      const Value *val = calleeOf(CI)->stripPointerCasts();
       const Function *callee = dyn_cast<Function>(val);
       if (!callee || callee->isIntrinsic())
         continue;
 
       assert(callee->hasName());
       StringRef name = callee->getName();
+      if (name.equals("realloc")) {
+        // the realloc of KLEE never fails
+        if (replace_realloc && !never_fails) {
+          replace_alloc(M, CI, "__VERIFIER_realloc");
+          modified = true;
+        }
+        continue;
+      }
+      if (!name.equals("malloc") && !name.equals("calloc"))
+        continue;
 
+      bool nf = never_fails ||
+                (deref_never_fails && is_dereferenced_first(CI));
       if (name.equals("malloc")) {
-        replace_malloc(M, CI, never_fails);
+        if (!use_lazy(CI) ||
+            !replace_malloc_lazy(M, CI, nf, nondet))
+          replace_alloc(M, CI, nf ? "__VERIFIER_malloc0"
+                                  : "__VERIFIER_malloc");
         modified = true;
-      } else if (name.equals("calloc")) {
-        replace_calloc(M, CI, never_fails);
+      } else {
+        // calloc returns zeroed memory, so the memory
+        // does not need to be nondeterministic at all
+        if (use_lazy(CI))
+          replace_alloc(M, CI, nf ? "__VERIFIER_calloc0_lazy"
+                                  : "__VERIFIER_calloc_lazy");
+        else
+          replace_alloc(M, CI, nf ? "__VERIFIER_calloc0"
+                                  : "__VERIFIER_calloc");
         modified = true;
       }
     }
   }
+
+  nondet.finish();
   return modified;
 }
 
@@ -4,15 +4,17 @@
 // License. See LICENSE.TXT for details.
 
 #include <map>
-#include <vector>
-#include <set>
+#include <utility>
 
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/Type.h"
@@ -23,26 +25,63 @@
 
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+
+#include "Compat.h"
+#include "LoopSummary.h"
 
 llvm::cl::opt<bool> insertHeader("instrument-nontermination-mark-header",
         llvm::cl::desc("Insert a function that marks the header of the loop"),
         llvm::cl::init(false));
 
+llvm::cl::opt<bool> packedState("instrument-nontermination-packed",
+        llvm::cl::desc("Copy the state of the loop into one buffer and compare\n"
+                       "it using memcmp instead of comparing the variables\n"
+                       "one by one"),
+        llvm::cl::init(false));
+
+// the loops whose every loop of the nest has a number of iterations
+// computed by ScalarEvolution (a ranking function) terminate and do not
+// get the checks. The loop ID of such loop gets !{!"sbt.loop.terminates"}.
+llvm::cl::opt<bool> skipTerminating("instrument-nontermination-skip-terminating",
+        llvm::cl::desc("Do not instrument the loops that provably terminate "
+                       "(default=true)"),
+        llvm::cl::init(true));
+
 using namespace llvm;
 
 bool CloneMetadata(const llvm::Instruction *, llvm::Instruction *);
 
+// the variables of a loop (allocas and globals) in the order in which
+// we found them, so that the instrumentation does not depend on addresses
+using ValueSet = SmallSetVector<llvm::Value *, 16>;
+
 class InstrumentNontermination : public LoopPass {
-  bool checkInstruction(Instruction& I, std::set<llvm::Value *>& variables,
-                        std::vector<llvm::Function *> callstack);
-  bool checkFunction(Function *F, std::set<llvm::Value *>& variables,
-                     std::vector<llvm::Function *> callstack);
+  // the global variables that a function (and its callees) may use
+  // and whether we can handle the function at all.
+  // The summaries do not depend on the loop that calls the function
+  // (the allocas of called functions are not interesting),
+  // so we compute them only once.
+  struct FunctionSummary {
+    enum { InProgress, Failed, Done } state;
+    ValueSet globals;
+  };
+  std::map<const Function *, FunctionSummary> _summaries;
+
+  const FunctionSummary& getSummary(Function *F);
+  bool checkInstruction(Instruction& I, ValueSet& variables,
+                        bool nestedCall);
+  bool checkFunction(Function *F, ValueSet& variables);
   bool instrumentLoop(Loop *L);
-  bool instrumentLoop(Loop *L, const std::set<llvm::Value *>& variables);
+  bool instrumentLoop(Loop *L, const ValueSet& variables);
+  bool instrumentLoopPacked(Loop *L, const ValueSet& variables);
   bool instrumentEmptyLoop(Loop *L);
+  bool terminates(Loop *L, ScalarEvolution& SE) const;
+  void markTerminating(Loop *L) const;
+  unsigned _terminating{0};
 
   bool checkOperand(llvm::Value *v,
-                    std::set<llvm::Value *>& usedValues,
+                    ValueSet& usedValues,
                     bool nestedCall) {
       if (isa<AllocaInst>(v)) {
           if (!nestedCall) {
@@ -63,21 +102,38 @@ class InstrumentNontermination : public LoopPass {
   Function *_assert{nullptr};
   Function *_fail{nullptr};
   Function *_header{nullptr};
+  Function *_memcmp{nullptr};
+
+  Function *getAssertFun(Module *M) {
+    if (!_assert) {
+      auto& Ctx = M->getContext();
+      auto F = insertFunction(*M, "__INSTR_check_nontermination",
+                              Type::getVoidTy(Ctx), // retval
+                              {Type::getInt1Ty(Ctx)}); // condition
+      _assert = functionOf(F);
+    }
+    return _assert;
+  }
+
+  Function *getMemcmpFun(Module *M) {
+    if (!_memcmp) {
+      auto& Ctx = M->getContext();
+      auto F = insertFunction(*M, "memcmp",
+                              Type::getInt32Ty(Ctx), // retval
+                              {Type::getInt8PtrTy(Ctx),
+                               Type::getInt8PtrTy(Ctx),
+                               M->getDataLayout().getIntPtrType(Ctx)});
+      _memcmp = functionOf(F);
+    }
+    return _memcmp;
+  }
 
   Function *getHeaderFun(Module *M) {
     if (!_header) {
       auto& Ctx = M->getContext();
-      auto F = M->getOrInsertFunction("__INSTR_check_nontermination_header",
-                                      Type::getVoidTy(Ctx) // retval
-#if LLVM_VERSION_MAJOR < 5
-                                      , nullptr
-#endif
-                                      );
-#if LLVM_VERSION_MAJOR >= 9
-      _header = cast<Function>(F.getCallee()->stripPointerCasts());
-#else
-      _header = cast<Function>(F);
-#endif
+      auto F = insertFunction(*M, "__INSTR_check_nontermination_header",
+                              Type::getVoidTy(Ctx), {}); // retval
+      _header = functionOf(F);
     }
     return _header;
   }
@@ -87,6 +143,10 @@ class InstrumentNontermination : public LoopPass {
 
     InstrumentNontermination() : LoopPass(ID) {}
 
+    void getAnalysisUsage(AnalysisUsage& AU) const override {
+      AU.addRequired<ScalarEvolutionWrapperPass>();
+    }
+
     bool runOnLoop(Loop *L, LPPassManager & /*LPM*/) override {
       // for now, we detect only nested loops
       if (L->getParentLoop()) {
@@ -94,13 +154,63 @@ class InstrumentNontermination : public LoopPass {
           return false;
       }
 
-      return instrumentLoop(L);
+      bool changed = false;
+      if (skipTerminating) {
+          auto& SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+          changed = dropMustProgress(L, SE);
+          if (terminates(L, SE)) {
+              markTerminating(L);
+              ++_terminating;
+              return true;
+          }
+      }
+
+      return instrumentLoop(L) || changed;
+    }
+
+    bool doFinalization() override {
+      if (_terminating > 0)
+        llvm::errs() << "Skipped " << _terminating
+                     << " loops that provably terminate\n";
+      return false;
     }
 };
 
+// every loop of the nest has a bound on the number of its iterations
+bool InstrumentNontermination::terminates(Loop *L, ScalarEvolution& SE) const {
+  for (Loop *SL : L->getLoopsInPreorder()) {
+    if (!isa<SCEVCouldNotCompute>(SE.getBackedgeTakenCount(SL)))
+      continue;
+#if LLVM_VERSION_MAJOR >= 10
+    if (!isa<SCEVCouldNotCompute>(SE.getConstantMaxBackedgeTakenCount(SL)))
+#else
+    if (!isa<SCEVCouldNotCompute>(SE.getMaxBackedgeTakenCount(SL)))
+#endif
+      continue;
+    return false;
+  }
+  return true;
+}
+
+// record the proof into the loop ID (keep the other properties of the loop)
+void InstrumentNontermination::markTerminating(Loop *L) const {
+  LLVMContext& Ctx = L->getHeader()->getContext();
+  SmallVector<Metadata *, 4> ops;
+  // the place for the self-reference
+  ops.push_back(nullptr);
+  if (MDNode *ID = L->getLoopID()) {
+    for (unsigned i = 1; i < ID->getNumOperands(); ++i)
+      ops.push_back(ID->getOperand(i));
+  }
+  ops.push_back(MDNode::get(Ctx, {MDString::get(Ctx, "sbt.loop.terminates")}));
+
+  MDNode *ID = MDNode::getDistinct(Ctx, ops);
+  ID->replaceOperandWith(0, ID);
+  L->setLoopID(ID);
+}
+
 bool InstrumentNontermination::checkFunction(Function *F,
-                                             std::set<llvm::Value *>& usedValues,
-                                             std::vector<llvm::Function *> callstack) {
+                                             ValueSet& usedValues) {
   if (!F) // call via pointer
       return false;
 
@@ -116,27 +226,46 @@ bool InstrumentNontermination::checkFunction(Function *F,
       F->getName().startswith("llvm.dbg."))
     return true;
 
-  for (auto *onstack : callstack) {
-      if (onstack == F) {
-          return false; // recursion
-      }
-  }
+  const auto& summary = getSummary(F);
+  if (summary.state != FunctionSummary::Done)
+    return false;
 
-  callstack.push_back(F);
+  usedValues.insert(summary.globals.begin(), summary.globals.end());
+  return true;
+}
 
+const InstrumentNontermination::FunctionSummary&
+InstrumentNontermination::getSummary(Function *F) {
+  // recursion -- we got to a function whose summary we are computing,
+  // so all the functions on the way fail too
+  static const FunctionSummary recursion{FunctionSummary::Failed, {}};
+
+  auto it = _summaries.find(F);
+  if (it != _summaries.end()) {
+    if (it->second.state == FunctionSummary::InProgress)
+      return recursion;
+    return it->second;
+  }
+
+  // std::map does not invalidate the reference when inserting
+  auto& summary = _summaries[F];
+  summary.state = FunctionSummary::InProgress;
   for (auto& B : *F) {
     for (auto& I : B) {
-      if (!checkInstruction(I, usedValues, callstack)) {
-        return false;
+      if (!checkInstruction(I, summary.globals, true)) {
+        summary.state = FunctionSummary::Failed;
+        summary.globals.clear();
+        return summary;
       }
     }
   }
 
-  return true;
+  summary.state = FunctionSummary::Done;
+  return summary;
 }
 
 bool InstrumentNontermination::instrumentLoop(Loop *L) {
-  std::set<llvm::Value *> usedValues;
+  ValueSet usedValues;
 
   for (auto *block : L->blocks()) {
     // check that the loop reads and writes only to known
@@ -144,7 +273,7 @@ bool InstrumentNontermination::instrumentLoop(Loop *L) {
     for (auto& I : *block) {
       // hmm... could be implemented more efficiently,
       // but it should be quite fast even though.
-      if (!checkInstruction(I, usedValues, {})) {
+      if (!checkInstruction(I, usedValues, false)) {
         return false;
       }
     }
@@ -155,13 +284,12 @@ bool InstrumentNontermination::instrumentLoop(Loop *L) {
 }
 
 bool InstrumentNontermination::checkInstruction(Instruction& I,
-                                                std::set<llvm::Value*>& usedValues,
-                                                std::vector<llvm::Function *> callstack) {
-  bool isNested = !callstack.empty();
+                                                ValueSet& usedValues,
+                                                bool isNested) {
   //llvm::errs() << "checking (" << isNested << "): " << I << "\n";
 
   if (auto *CI = dyn_cast<CallInst>(&I)) {
-    if (!checkFunction(CI->getCalledFunction(), usedValues, callstack)) {
+    if (!checkFunction(CI->getCalledFunction(), usedValues)) {
       return false;
     }
   } else if (auto LI = dyn_cast<LoadInst>(&I)) {
@@ -183,13 +311,17 @@ bool InstrumentNontermination::checkInstruction(Instruction& I,
 }
 
 
-bool InstrumentNontermination::instrumentLoop(Loop *L, const std::set<llvm::Value *>& variables) {
+bool InstrumentNontermination::instrumentLoop(Loop *L, const ValueSet& variables) {
+  if (packedState)
+    return instrumentLoopPacked(L, variables);
+
   auto *header = L->getHeader();
   assert(header);
   auto *M = header->getModule();
 
   // mapping of old to new ones
-  std::map<Value *, Value *> mapping;
+  SmallVector<std::pair<Value *, Value *>, 16> mapping;
+  mapping.reserve(variables.size());
 
   // for each variable, create its copy in the header
   // and store the last recent value from the original
@@ -203,13 +335,8 @@ bool InstrumentNontermination::instrumentLoop(Loop *L, const std::set<llvm::Valu
     } else if (auto *G = dyn_cast<GlobalValue>(v)) {
         // create a new alloca that
         // is going to be inserted at the beginning of the header
-        newVal = new AllocaInst(
-            G->getType()->getContainedType(0),
-#if (LLVM_VERSION_MAJOR >= 5)
-            G->getType()->getAddressSpace(),
-#endif
-            nullptr,
-            "",
+        newVal = makeAlloca(
+            G->getValueType(), header->getModule()->getDataLayout(), "",
             // put the alloca on the beginning of the function
             header->getParent()->getBasicBlockList().front().getTerminator());
     } else {
@@ -218,7 +345,7 @@ bool InstrumentNontermination::instrumentLoop(Loop *L, const std::set<llvm::Valu
     }
 
     assert(newVal);
-    mapping[v] = newVal;
+    mapping.emplace_back(v, newVal);
   }
 
   if (mapping.empty()) {
@@ -318,27 +445,8 @@ bool InstrumentNontermination::instrumentLoop(Loop *L, const std::set<llvm::Valu
 
     assert(lastCond);
 
-    if (!_assert) {
-      auto M = header->getParent()->getParent();
-      auto& Ctx = M->getContext();
-      auto F = M->getOrInsertFunction("__INSTR_check_nontermination",
-                                      Type::getVoidTy(Ctx), // retval
-                                      Type::getInt1Ty(Ctx)  // condition
-#if LLVM_VERSION_MAJOR < 5
-                                      , nullptr
-#endif
-                                      );
-#if LLVM_VERSION_MAJOR >= 9
-      _assert = cast<Function>(F.getCallee()->stripPointerCasts());
-#else
-      _assert = cast<Function>(F);
-#endif
-    }
-
-
     // insert the assertion that all the values are the same
-    assert(_assert);
-    auto *CI = CallInst::Create(_assert, {lastCond});
+    auto *CI = CallInst::Create(getAssertFun(M), {lastCond});
     if (lastCond->hasMetadata())
       CloneMetadata(lastCond, CI);
     else
@@ -350,6 +458,98 @@ bool InstrumentNontermination::instrumentLoop(Loop *L, const std::set<llvm::Valu
   return true;
 }
 
+// copy the variables one after another into the buffer before 'where'
+static void copyState(const ValueSet& variables,
+                      Value *buffer, Instruction *where,
+                      const Instruction *md) {
+  auto& DL = where->getModule()->getDataLayout();
+  auto& Ctx = where->getContext();
+  IRBuilder<> IRB(where);
+
+  uint64_t offset = 0;
+  for (auto *v : variables) {
+    uint64_t size = DL.getTypeAllocSize(v->getType()->getPointerElementType());
+    auto *dst = IRB.CreateConstInBoundsGEP1_64(Type::getInt8Ty(Ctx),
+                                               buffer, offset);
+    auto *src = IRB.CreatePointerCast(v, Type::getInt8PtrTy(Ctx));
+#if LLVM_VERSION_MAJOR >= 10
+    auto *CI = IRB.CreateMemCpy(dst, MaybeAlign(1), src, MaybeAlign(1), size);
+#elif LLVM_VERSION_MAJOR >= 7
+    auto *CI = IRB.CreateMemCpy(dst, 1, src, 1, size);
+#else
+    auto *CI = IRB.CreateMemCpy(dst, src, size, 1);
+#endif
+    CloneMetadata(md, CI);
+    if (auto *I = dyn_cast<Instruction>(dst))
+      CloneMetadata(md, I);
+    if (auto *I = dyn_cast<Instruction>(src))
+      CloneMetadata(md, I);
+    offset += size;
+  }
+}
+
+// Like instrumentLoop(), but the state of the loop is stored into
+// one buffer in the header and compared with the state on the back edges
+// using one call of memcmp
+bool InstrumentNontermination::instrumentLoopPacked(Loop *L,
+                                                    const ValueSet& variables) {
+  if (variables.empty()) {
+      return instrumentEmptyLoop(L);
+  }
+
+  auto *header = L->getHeader();
+  auto *M = header->getModule();
+  auto& Ctx = M->getContext();
+  auto& DL = M->getDataLayout();
+
+  uint64_t size = 0;
+  for (auto *v : variables)
+    size += DL.getTypeAllocSize(v->getType()->getPointerElementType());
+
+  auto *entryTerm = header->getParent()->getEntryBlock().getTerminator();
+  auto *bufTy = ArrayType::get(Type::getInt8Ty(Ctx), size);
+  Value *buffers[2];
+  const char *names[2] = {"nonterm.state", "nonterm.cur"};
+  for (unsigned i = 0; i < 2; ++i) {
+    auto *AI = makeAlloca(bufTy, DL, names[i], entryTerm);
+    buffers[i] = CastInst::CreatePointerCast(AI, Type::getInt8PtrTy(Ctx), "",
+                                             entryTerm);
+  }
+  Value *state = buffers[0];
+  Value *current = buffers[1];
+
+  // store the state of variables at the loop head
+  auto *where = &*header->getFirstInsertionPt();
+  copyState(variables, state, where, header->getTerminator());
+  if (insertHeader) {
+      auto *CI = CallInst::Create(getHeaderFun(M));
+      CloneMetadata(header->getTerminator(), CI);
+      CI->insertBefore(header->getTerminator());
+  }
+
+  // compare the old and new state after the iteration of the loop
+  auto *sizeVal = ConstantInt::get(DL.getIntPtrType(Ctx), size);
+  for (auto I = pred_begin(header), E = pred_end(header); I != E; ++I) {
+    if (!L->contains(*I))
+      continue;
+
+    auto *term = (*I)->getTerminator();
+    copyState(variables, current, term, term);
+
+    auto *cmp = CallInst::Create(getMemcmpFun(M), {state, current, sizeVal},
+                                 "", term);
+    auto *eq = new ICmpInst(term, ICmpInst::ICMP_EQ, cmp,
+                            ConstantInt::get(cmp->getType(), 0));
+    auto *CI = CallInst::Create(getAssertFun(M), {eq}, "", term);
+    CloneMetadata(term, cmp);
+    CloneMetadata(term, eq);
+    CloneMetadata(term, CI);
+  }
+
+  llvm::errs() << "Instrumented a loop with non-termination checks (packed)\n";
+  return true;
+}
+
 bool InstrumentNontermination::instrumentEmptyLoop(Loop *L) {
   auto *header = L->getHeader();
 
@@ -390,17 +590,9 @@ bool InstrumentNontermination::instrumentEmptyLoop(Loop *L) {
   auto M = header->getParent()->getParent();
   auto& Ctx = M->getContext();
   if (!_fail) {
-    auto F = M->getOrInsertFunction("__INSTR_fail",
-                                    Type::getVoidTy(Ctx) // retval
-#if LLVM_VERSION_MAJOR < 5
-                                    , nullptr
-#endif
-                                    );
-#if LLVM_VERSION_MAJOR >= 9
-    _fail = cast<Function>(F.getCallee()->stripPointerCasts());
-#else
-    _fail = cast<Function>(F);
-#endif
+    auto F = insertFunction(*M, "__INSTR_fail",
+                            Type::getVoidTy(Ctx), {}); // retval
+    _fail = functionOf(F);
     _fail->setDoesNotReturn();
   }
 
@@ -3,7 +3,10 @@
 // This file is distributed under the University of Illinois Open Source
 // License. See LICENSE.TXT for details.
 
+#include <algorithm>
 #include <cassert>
+#include <map>
+#include <utility>
 #include <vector>
 
 #include "llvm/IR/DataLayout.h"
@@ -11,17 +14,49 @@
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/Type.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 #include <llvm/IR/DebugInfoMetadata.h>
 
+#include "Compat.h"
+
 using namespace llvm;
 
 bool CloneMetadata(const llvm::Instruction *, llvm::Instruction *);
 
+static cl::opt<bool> accessed_only("internalize-globals-accessed-only",
+        cl::desc("Make non-deterministic only the parts of external globals\n"
+                 "(fields, index ranges) that the program accesses, the rest\n"
+                 "stays zero-initialized (default=false)"),
+        cl::init(false));
+
+static cl::opt<unsigned> batch_min("internalize-globals-batch",
+        cl::desc("Initialize the external globals in a loop over a table of\n"
+                 "their addresses, sizes and names if there is at least\n"
+                 "the given number of them (default=0, never)"),
+        cl::init(0));
+
+namespace {
+// byte ranges [first, second) of an object
+using Ranges = std::vector<std::pair<uint64_t, uint64_t>>;
+
+// the parts of a global (or of the object it points to)
+// that are made non-deterministic
+struct GlobalInit {
+  Value *memory;
+  std::string name;
+  // the constant with the name for the calls of __VERIFIER_make_nondet
+  GlobalVariable *nameG;
+  Ranges ranges;
+};
+}
+
 class InternalizeGlobals : public ModulePass {
     Function *_vms = nullptr; // verifier_make_nondet function
     Type *_size_t_Ty = nullptr; // type of size_t
@@ -31,6 +66,18 @@ class InternalizeGlobals : public ModulePass {
     Function *get_verifier_make_nondet(Module *);
     Type *get_size_t(Module *);
     bool initializeExternalGlobals(Module&);
+
+    void createCalls(Module& M, const std::vector<GlobalInit>& inits,
+                     BasicBlock& block);
+    void createInitFunction(Module& M, const std::vector<GlobalInit>& inits,
+                            BasicBlock& block);
+
+    bool getSubobject(GEPOperator *GEP, uint64_t& lo, uint64_t& hi,
+                      bool& exact);
+    bool collectRanges(Value *ptr, uint64_t lo, uint64_t hi, bool exact,
+                       Ranges& ranges);
+    bool getAccessedRanges(GlobalVariable *GV, Value *memory,
+                           uint64_t size, Ranges& ranges);
   public:
     static char ID;
 
@@ -51,6 +98,7 @@ char InternalizeGlobals::ID;
 bool InternalizeGlobals::initializeExternalGlobals(Module& M) {
   bool modified = false;
   LLVMContext& Ctx = M.getContext();
+  std::vector<GlobalInit> inits;
 
   for (Module::global_iterator I = M.global_begin(),
                                E = M.global_end(); I != E; ++I) {
@@ -125,31 +173,28 @@ bool InternalizeGlobals::initializeExternalGlobals(Module& M) {
       }
     }
 
-    Function *vms = get_verifier_make_nondet(&M);
-    CastInst *CastI = CastInst::CreatePointerCast(memory, Type::getInt8PtrTy(Ctx));
-
-    std::vector<Value *> args;
-    args.push_back(CastI);
-    args.push_back(ConstantInt::get(get_size_t(&M), DL->getTypeAllocSize(Ty)));
     std::string nameStr = GV->hasName() ? GV->getName().str() : "extern-global";
     Constant *name
         = ConstantDataArray::getString(Ctx, nameStr);
     GlobalVariable *nameG = new GlobalVariable(M, name->getType(), true /*constant */,
                                                GlobalVariable::PrivateLinkage, name);
-    args.push_back(ConstantExpr::getPointerCast(nameG, Type::getInt8PtrTy(Ctx)));
-    CallInst *CI = CallInst::Create(vms, args);
 
-    Function *main = M.getFunction("main");
-    assert(main && "Do not have main");
-    BasicBlock& block = main->getBasicBlockList().front();
-    // there must be some instruction, otherwise we would not be calling
-    // this function
-    Instruction& Inst = *(block.begin());
-    CastI->insertBefore(&Inst);
-    CI->insertBefore(&Inst);
-
-    // add metadata due to the inliner pass
-    CloneMetadata(&Inst, CI);
+    uint64_t size = DL->getTypeAllocSize(Ty);
+    Ranges ranges;
+    if (!accessed_only || !getAccessedRanges(GV, memory, size, ranges))
+      ranges = {{0, size}};
+
+    inits.push_back(GlobalInit{memory, nameStr, nameG, ranges});
+
+    if (accessed_only && (ranges.size() != 1 || ranges[0].first != 0 ||
+                          ranges[0].second != size)) {
+      uint64_t bytes = 0;
+      for (const auto& range : ranges)
+        bytes += range.second - range.first;
+      errs() << "Made " << bytes << " of " << size << " bytes of '"
+             << GV->getName() << "' non-deterministic in "
+             << ranges.size() << " parts\n";
+    }
 
     modified = true;
 
@@ -159,9 +204,294 @@ bool InternalizeGlobals::initializeExternalGlobals(Module& M) {
     errs() << "Made global variable '" << GV->getName() << "' non-extern\n";
   }
 
+  if (inits.empty())
+    return modified;
+
+  Function *main = M.getFunction("main");
+  assert(main && "Do not have main");
+  BasicBlock& block = main->getBasicBlockList().front();
+
+  if (batch_min > 0 && inits.size() >= batch_min)
+    createInitFunction(M, inits, block);
+  else
+    createCalls(M, inits, block);
+
   return modified;
 }
 
+// Get the range of bytes [lo, hi) of the object that the GEP can point to
+// if its base points to [lo, hi) (exactly to lo if 'exact' is set).
+// A non-constant index into an array makes the range the whole array.
+bool InternalizeGlobals::getSubobject(GEPOperator *GEP, uint64_t& lo,
+                                      uint64_t& hi, bool& exact) {
+  Type *Ty = GEP->getSourceElementType();
+  bool first = true;
+  for (auto I = GEP->idx_begin(), E = GEP->idx_end(); I != E; ++I) {
+    auto *C = dyn_cast<ConstantInt>(*I);
+    if (C && C->isNegative())
+      return false;
+
+    if (first) {
+      first = false;
+      // the index of the pointer operand moves the pointer over the bounds
+      // of the type, we can follow it only if we know where we are
+      if (C && C->isZero())
+        continue;
+      if (!C || !exact)
+        return false;
+      lo += C->getZExtValue() * DL->getTypeAllocSize(Ty);
+      if (lo > hi)
+        return false;
+      continue;
+    }
+
+    if (auto *STy = dyn_cast<StructType>(Ty)) {
+      unsigned idx = cast<ConstantInt>(*I)->getZExtValue();
+      if (exact)
+        lo += DL->getStructLayout(STy)->getElementOffset(idx);
+      Ty = STy->getElementType(idx);
+    } else if (auto *ATy = dyn_cast<ArrayType>(Ty)) {
+      Type *ElemTy = ATy->getElementType();
+      if (exact) {
+        if (C) {
+          lo += C->getZExtValue() * DL->getTypeAllocSize(ElemTy);
+        } else {
+          // any element of the array
+          hi = lo + DL->getTypeAllocSize(ATy);
+          exact = false;
+        }
+      }
+      Ty = ElemTy;
+    } else {
+      return false;
+    }
+
+    if (exact)
+      hi = lo + DL->getTypeAllocSize(Ty);
+  }
+
+  return true;
+}
+
+// Collect the ranges of bytes that are accessed through 'ptr'. The 'ptr'
+// points to lo (if 'exact' is set) or somewhere into [lo, hi). Return false
+// if the accesses cannot be bounded (e.g., the pointer escapes).
+bool InternalizeGlobals::collectRanges(Value *ptr, uint64_t lo, uint64_t hi,
+                                       bool exact, Ranges& ranges) {
+  for (auto *U : ptr->users()) {
+    if (auto *LI = dyn_cast<LoadInst>(U)) {
+      uint64_t size = DL->getTypeStoreSize(LI->getType());
+      if (exact && lo + size > hi)
+        return false;
+      ranges.emplace_back(lo, exact ? lo + size : hi);
+    } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+      if (SI->getValueOperand() == ptr)
+        return false; // the pointer escapes
+      uint64_t size = DL->getTypeStoreSize(SI->getValueOperand()->getType());
+      if (exact && lo + size > hi)
+        return false;
+      ranges.emplace_back(lo, exact ? lo + size : hi);
+    } else if (auto *GEP = dyn_cast<GEPOperator>(U)) {
+      uint64_t sublo = lo, subhi = hi;
+      bool subexact = exact;
+      if (!getSubobject(GEP, sublo, subhi, subexact) || subhi > hi)
+        return false;
+      if (!collectRanges(GEP, sublo, subhi, subexact, ranges))
+        return false;
+    } else if (isa<BitCastOperator>(U)) {
+      if (!collectRanges(U, lo, hi, exact, ranges))
+        return false;
+    } else if (isa<ICmpInst>(U)) {
+      // comparing the pointer does not access the memory
+    } else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Compute the sorted disjoint ranges of bytes of 'memory' (the global GV
+// or the object that GV points to) that can be accessed by the program.
+bool InternalizeGlobals::getAccessedRanges(GlobalVariable *GV, Value *memory,
+                                           uint64_t size, Ranges& ranges) {
+  if (memory == GV) {
+    if (!collectRanges(GV, 0, size, true, ranges))
+      return false;
+  } else {
+    // the object is accessed through the pointer loaded from GV
+    for (auto *U : GV->users()) {
+      if (auto *LI = dyn_cast<LoadInst>(U)) {
+        if (!collectRanges(LI, 0, size, true, ranges))
+          return false;
+      } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+        // GV is overwritten, the accesses through the new value of GV
+        // are harmless (but GV must not escape)
+        if (SI->getValueOperand() == GV)
+          return false;
+      } else {
+        return false;
+      }
+    }
+  }
+
+  std::sort(ranges.begin(), ranges.end());
+  Ranges merged;
+  for (const auto& range : ranges) {
+    if (!merged.empty() && range.first <= merged.back().second)
+      merged.back().second = std::max(merged.back().second, range.second);
+    else
+      merged.push_back(range);
+  }
+  ranges.swap(merged);
+  return true;
+}
+
+// Insert the calls of __VERIFIER_make_nondet for every initialized part
+// of the globals at the beginning of the block. Every global is put before
+// the previous ones, so the last global is initialized first.
+void InternalizeGlobals::createCalls(Module& M,
+                                     const std::vector<GlobalInit>& inits,
+                                     BasicBlock& block) {
+  LLVMContext& Ctx = M.getContext();
+  Function *vms = get_verifier_make_nondet(&M);
+
+  for (const GlobalInit& init : inits) {
+    // there must be some instruction, otherwise we would not be calling
+    // this function
+    Instruction& Inst = *(block.begin());
+
+    CastInst *CastI = nullptr;
+    for (const auto& range : init.ranges) {
+      if (!CastI) {
+        CastI = CastInst::CreatePointerCast(init.memory, Type::getInt8PtrTy(Ctx));
+        CastI->insertBefore(&Inst);
+      }
+
+      Value *ptr = CastI;
+      if (range.first > 0) {
+        auto *GEP = GetElementPtrInst::CreateInBounds(
+#if LLVM_VERSION_MAJOR >= 4
+                                        Type::getInt8Ty(Ctx),
+#endif
+                                        CastI,
+                                        ConstantInt::get(get_size_t(&M),
+                                                         range.first));
+        GEP->insertBefore(&Inst);
+        ptr = GEP;
+      }
+
+      std::vector<Value *> args;
+      args.push_back(ptr);
+      args.push_back(ConstantInt::get(get_size_t(&M), range.second - range.first));
+      args.push_back(ConstantExpr::getPointerCast(init.nameG, Type::getInt8PtrTy(Ctx)));
+      CallInst *CI = CallInst::Create(vms, args);
+      CI->insertBefore(&Inst);
+
+      // add metadata due to the inliner pass
+      CloneMetadata(&Inst, CI);
+    }
+  }
+}
+
+// Create the function __symbiotic_init_globals that loops over a constant
+// table of {address, size, offset of the name} and calls
+// __VERIFIER_make_nondet for every entry. The names are stored in one
+// constant array. The globals are initialized in the same order
+// as createCalls() does it. Call the function at the beginning of the block.
+void InternalizeGlobals::createInitFunction(Module& M,
+                                            const std::vector<GlobalInit>& inits,
+                                            BasicBlock& block) {
+  LLVMContext& Ctx = M.getContext();
+  Type *SizeTy = get_size_t(&M);
+  Type *I8Ty = Type::getInt8Ty(Ctx);
+  Type *I8PtrTy = Type::getInt8PtrTy(Ctx);
+
+  std::string names;
+  std::map<std::string, uint64_t> name_offsets;
+  StructType *DescTy = StructType::get(Ctx, {I8PtrTy, SizeTy, SizeTy});
+  std::vector<Constant *> entries;
+
+  for (auto I = inits.rbegin(), E = inits.rend(); I != E; ++I) {
+    const GlobalInit& init = *I;
+    // the names are in the table
+    init.nameG->eraseFromParent();
+
+    auto it = name_offsets.find(init.name);
+    if (it == name_offsets.end()) {
+      it = name_offsets.emplace(init.name, names.size()).first;
+      names += init.name;
+      names.push_back('\0');
+    }
+
+    Constant *base = ConstantExpr::getPointerCast(cast<Constant>(init.memory),
+                                                  I8PtrTy);
+    for (const auto& range : init.ranges) {
+      Constant *addr = base;
+      if (range.first > 0)
+        addr = ConstantExpr::getInBoundsGetElementPtr(I8Ty, base,
+                                 ConstantInt::get(SizeTy, range.first));
+      entries.push_back(ConstantStruct::get(DescTy, {
+                          addr,
+                          ConstantInt::get(SizeTy, range.second - range.first),
+                          ConstantInt::get(SizeTy, it->second)}));
+    }
+  }
+
+  Constant *namesC = ConstantDataArray::getString(Ctx, names,
+                                                  false /* AddNull */);
+  auto *namesG = new GlobalVariable(M, namesC->getType(), true /*constant */,
+                                    GlobalVariable::PrivateLinkage, namesC,
+                                    "__symbiotic_globals_names");
+  ArrayType *TableTy = ArrayType::get(DescTy, entries.size());
+  auto *tableG = new GlobalVariable(M, TableTy, true /*constant */,
+                                    GlobalVariable::PrivateLinkage,
+                                    ConstantArray::get(TableTy, entries),
+                                    "__symbiotic_globals_table");
+
+  Function *F = Function::Create(FunctionType::get(Type::getVoidTy(Ctx), false),
+                                 GlobalValue::InternalLinkage,
+                                 "__symbiotic_init_globals", &M);
+  BasicBlock *entry = BasicBlock::Create(Ctx, "entry", F);
+  BasicBlock *loop = BasicBlock::Create(Ctx, "loop", F);
+  BasicBlock *exit = BasicBlock::Create(Ctx, "exit", F);
+
+  IRBuilder<> B(entry);
+  B.CreateBr(loop);
+
+  B.SetInsertPoint(loop);
+  PHINode *idx = B.CreatePHI(SizeTy, 2, "idx");
+  idx->addIncoming(ConstantInt::get(SizeTy, 0), entry);
+  Value *zero = ConstantInt::get(SizeTy, 0);
+  auto loadField = [&](Type *Ty, unsigned field, const char *name) {
+    Value *ptr = B.CreateInBoundsGEP(TableTy, tableG,
+                                     {zero, idx, B.getInt32(field)});
+    return new LoadInst(Ty, ptr, name, loop);
+  };
+  Value *addr = loadField(I8PtrTy, 0, "addr");
+  Value *size = loadField(SizeTy, 1, "size");
+  Value *off = loadField(SizeTy, 2, "name.off");
+  Value *name = B.CreateInBoundsGEP(namesC->getType(), namesG, {zero, off},
+                                    "name");
+  B.CreateCall(get_verifier_make_nondet(&M), {addr, size, name});
+  Value *next = B.CreateAdd(idx, ConstantInt::get(SizeTy, 1), "idx.next");
+  idx->addIncoming(next, loop);
+  B.CreateCondBr(B.CreateICmpULT(next, ConstantInt::get(SizeTy, entries.size())),
+                 loop, exit);
+
+  B.SetInsertPoint(exit);
+  B.CreateRetVoid();
+
+  Instruction& Inst = *(block.begin());
+  CallInst *CI = CallInst::Create(F);
+  CI->insertBefore(&Inst);
+  // add metadata due to the inliner pass
+  CloneMetadata(&Inst, CI);
+
+  errs() << "Initializing " << entries.size() << " parts of external globals "
+            "in __symbiotic_init_globals\n";
+}
+
 Function *InternalizeGlobals::get_verifier_make_nondet(llvm::Module *M)
 {
   if (_vms)
@@ -169,20 +499,12 @@ Function *InternalizeGlobals::get_verifier_make_nondet(llvm::Module *M)
 
   LLVMContext& Ctx = M->getContext();
   //void verifier_make_symbolic(void *addr, size_t nbytes, const char *name);
-  auto C = M->getOrInsertFunction("__VERIFIER_make_nondet",
-                                   Type::getVoidTy(Ctx),
-                                   Type::getInt8PtrTy(Ctx), // addr
-                                   get_size_t(M),   // nbytes
-                                   Type::getInt8PtrTy(Ctx) // name
-#if LLVM_VERSION_MAJOR < 5
-                                   , nullptr
-#endif
-                                   );
-#if LLVM_VERSION_MAJOR >= 9
-  _vms = cast<Function>(C.getCallee());
-#else
-  _vms = cast<Function>(C);
-#endif
+  auto C = insertFunction(*M, "__VERIFIER_make_nondet",
+                          Type::getVoidTy(Ctx),
+                          {Type::getInt8PtrTy(Ctx), // addr
+                           get_size_t(M), // nbytes
+                           Type::getInt8PtrTy(Ctx)}); // name
+  _vms = functionOf(C);
 
 
   return _vms;
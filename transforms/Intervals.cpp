@@ -0,0 +1,473 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// The interval analysis (see Intervals.h). The ranges start empty
+// (the code is not reached yet) and grow on a worklist of instructions
+// until the fixpoint. A phi node in a loop header that has grown a few
+// times is widened: the bound that grows is moved to the signed minimum
+// or maximum. Then a few rounds of narrowing take back what the branch
+// conditions in the loop bound (for (i = 0; i < 100; ++i) gets [0, 101)).
+
+#include <cassert>
+#include <deque>
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/InstrTypes.h"
+
+#include "Compat.h"
+#include "Intervals.h"
+
+using namespace llvm;
+
+static RegisterPass<IntervalAnalysis> IA("interval-analysis",
+                                         "Compute the intervals of "
+                                         "the integer values",
+                                         false /* only CFG */,
+                                         true /* analysis */);
+char IntervalAnalysis::ID;
+
+// widen the phi nodes in loop headers after this many updates,
+// the other values (cycles in irreducible code) a bit later
+static const unsigned HeaderUpdates = 2;
+static const unsigned OtherUpdates = 8;
+// the rounds of narrowing after the fixpoint
+static const unsigned NarrowingRounds = 2;
+// the number of the dominators whose branch conditions refine a use
+static const unsigned MaxDominators = 32;
+
+static unsigned numArgs(const CallInst *CI) {
+#if LLVM_VERSION_MAJOR >= 8
+  return CI->arg_size();
+#else
+  return CI->getNumArgOperands();
+#endif
+}
+
+// are all the uses of F direct calls with the right number of arguments?
+// Then the call sites are all the places where the arguments come from
+static bool onlyCalledDirectly(const Function& F) {
+  if (!F.hasLocalLinkage() || F.isVarArg())
+    return false;
+
+  for (const Use& U : F.uses()) {
+    auto *CI = dyn_cast<CallInst>(U.getUser());
+    if (!CI || calleeOf(CI) != &F || numArgs(CI) != F.arg_size())
+      return false;
+    for (unsigned i = 0; i < numArgs(CI); ++i)
+      if (CI->getArgOperand(i) == &F)
+        return false;
+  }
+  return true;
+}
+
+static const Function *directCallee(const CallInst *CI) {
+  return dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+}
+
+static ConstantRange widen(const ConstantRange& old, const ConstantRange& R) {
+  if (old.isEmptySet())
+    return R;
+  unsigned bw = R.getBitWidth();
+  if (old.isSignWrappedSet() || R.isSignWrappedSet())
+    return ConstantRange(bw, true);
+
+  APInt lo = R.getSignedMin(), hi = R.getSignedMax();
+  if (lo.slt(old.getSignedMin()))
+    lo = APInt::getSignedMinValue(bw);
+  if (hi.sgt(old.getSignedMax()))
+    hi = APInt::getSignedMaxValue(bw);
+  if (lo.isMinSignedValue() && hi.isMaxSignedValue())
+    return ConstantRange(bw, true);
+  return ConstantRange(lo, hi + 1);
+}
+
+ConstantRange IntervalAnalysis::lookup(const Value *V) const {
+  assert(V->getType()->isIntegerTy() && "Not an integer value");
+  if (auto *C = dyn_cast<ConstantInt>(V))
+    return ConstantRange(C->getValue());
+
+  auto it = ranges.find(V);
+  if (it != ranges.end())
+    return it->second;
+  return ConstantRange(V->getType()->getIntegerBitWidth(), true);
+}
+
+// refine the range R of V by the fact that the branch on Cond
+// was taken (or not)
+ConstantRange IntervalAnalysis::refine(const Value *V, const Value *Cond,
+                                       bool taken, ConstantRange R) const {
+  if (auto *Cmp = dyn_cast<ICmpInst>(Cond)) {
+    CmpInst::Predicate pred = Cmp->getPredicate();
+    const Value *other;
+    if (Cmp->getOperand(0) == V) {
+      other = Cmp->getOperand(1);
+    } else if (Cmp->getOperand(1) == V) {
+      other = Cmp->getOperand(0);
+      pred = CmpInst::getSwappedPredicate(pred);
+    } else {
+      return R;
+    }
+
+    if (!other->getType()->isIntegerTy())
+      return R;
+    if (!taken)
+      pred = CmpInst::getInversePredicate(pred);
+    return R.intersectWith(
+        ConstantRange::makeAllowedICmpRegion(pred, lookup(other)));
+  }
+
+  // both conditions hold on the true branch of 'and'
+  // and neither of them on the false branch of 'or'
+  if (auto *BO = dyn_cast<BinaryOperator>(Cond)) {
+    if ((taken && BO->getOpcode() == Instruction::And) ||
+        (!taken && BO->getOpcode() == Instruction::Or)) {
+      R = refine(V, BO->getOperand(0), taken, R);
+      return refine(V, BO->getOperand(1), taken, R);
+    }
+  }
+
+  return R;
+}
+
+// refine R by the branches that must have been taken to get to B
+ConstantRange IntervalAnalysis::refineAt(const Value *V, const BasicBlock *B,
+                                         ConstantRange R) const {
+  if (isa<Constant>(V))
+    return R;
+  auto it = domTrees.find(B->getParent());
+  if (it == domTrees.end())
+    return R;
+
+  const DominatorTree& DT = *it->second;
+  auto *node = DT.getNode(B);
+  for (unsigned n = 0; node && node->getIDom() && n < MaxDominators; ++n) {
+    const BasicBlock *D = node->getIDom()->getBlock();
+    auto *BI = dyn_cast<BranchInst>(D->getTerminator());
+    if (BI && BI->isConditional() &&
+        BI->getSuccessor(0) != BI->getSuccessor(1)) {
+      for (unsigned k = 0; k < 2; ++k) {
+        if (DT.dominates(BasicBlockEdge(D, BI->getSuccessor(k)), B)) {
+          R = refine(V, BI->getCondition(), k == 0, R);
+          break;
+        }
+      }
+    }
+    node = node->getIDom();
+  }
+  return R;
+}
+
+// the range of the i-th incoming value of P when it comes along its edge
+ConstantRange IntervalAnalysis::incoming(const PHINode *P, unsigned i) const {
+  const Value *V = P->getIncomingValue(i);
+  const BasicBlock *B = P->getIncomingBlock(i);
+  ConstantRange R = lookup(V);
+
+  auto *BI = dyn_cast<BranchInst>(B->getTerminator());
+  if (BI && BI->isConditional() &&
+      BI->getSuccessor(0) != BI->getSuccessor(1))
+    R = refine(V, BI->getCondition(), BI->getSuccessor(0) == P->getParent(),
+               R);
+  return refineAt(V, B, R);
+}
+
+ConstantRange IntervalAnalysis::transfer(const Instruction *I) const {
+  unsigned bw = I->getType()->getIntegerBitWidth();
+  auto operand = [this, I](unsigned i) {
+    return getRangeAt(I->getOperand(i), I);
+  };
+
+  if (auto *P = dyn_cast<PHINode>(I)) {
+    ConstantRange R(bw, false /* empty */);
+    for (unsigned i = 0; i < P->getNumIncomingValues(); ++i)
+      R = R.unionWith(incoming(P, i));
+    return R;
+  }
+
+  if (auto *BO = dyn_cast<BinaryOperator>(I)) {
+    ConstantRange L = operand(0), R = operand(1);
+#if LLVM_VERSION_MAJOR >= 9
+    return L.binaryOp(BO->getOpcode(), R);
+#else
+    switch (BO->getOpcode()) {
+      case Instruction::Add: return L.add(R);
+      case Instruction::Sub: return L.sub(R);
+      case Instruction::Mul: return L.multiply(R);
+      case Instruction::UDiv: return L.udiv(R);
+      case Instruction::Shl: return L.shl(R);
+      case Instruction::LShr: return L.lshr(R);
+      case Instruction::And: return L.binaryAnd(R);
+      case Instruction::Or: return L.binaryOr(R);
+      default: return ConstantRange(bw, true);
+    }
+#endif
+  }
+
+  if (auto *CI = dyn_cast<CastInst>(I)) {
+    if (!CI->getSrcTy()->isIntegerTy())
+      return ConstantRange(bw, true);
+    switch (CI->getOpcode()) {
+      case Instruction::Trunc: return operand(0).truncate(bw);
+      case Instruction::ZExt: return operand(0).zeroExtend(bw);
+      case Instruction::SExt: return operand(0).signExtend(bw);
+      default: return ConstantRange(bw, true);
+    }
+  }
+
+  if (auto *Cmp = dyn_cast<ICmpInst>(I)) {
+    if (!Cmp->getOperand(0)->getType()->isIntegerTy())
+      return ConstantRange(bw, true);
+    ConstantRange L = operand(0), R = operand(1);
+    if (L.isEmptySet() || R.isEmptySet())
+      return ConstantRange(bw, false);
+    CmpInst::Predicate pred = Cmp->getPredicate();
+    if (ConstantRange::makeSatisfyingICmpRegion(pred, R).contains(L))
+      return ConstantRange(APInt(1, 1));
+    pred = CmpInst::getInversePredicate(pred);
+    if (ConstantRange::makeSatisfyingICmpRegion(pred, R).contains(L))
+      return ConstantRange(APInt(1, 0));
+    return ConstantRange(bw, true);
+  }
+
+  if (auto *S = dyn_cast<SelectInst>(I)) {
+    if (!S->getCondition()->getType()->isIntegerTy())
+      return ConstantRange(bw, true);
+    ConstantRange C = operand(0);
+    ConstantRange T = refine(S->getTrueValue(), S->getCondition(), true,
+                             operand(1));
+    ConstantRange F = refine(S->getFalseValue(), S->getCondition(), false,
+                             operand(2));
+    if (C.isEmptySet())
+      return C;
+    if (C.isSingleElement())
+      return C.getSingleElement()->isOneValue() ? T : F;
+    return T.unionWith(F);
+  }
+
+  if (auto *CI = dyn_cast<CallInst>(I)) {
+    auto it = returns.find(directCallee(CI));
+    if (it != returns.end())
+      return it->second;
+  }
+
+  return ConstantRange(bw, true);
+}
+
+// join R into the range of V, return true if the range has changed
+bool IntervalAnalysis::join(DenseMap<const Value *, ConstantRange>& map,
+                            const Value *V, const ConstantRange& R,
+                            bool header) {
+  auto it = map.find(V);
+  if (it == map.end()) {
+    map.insert({V, R});
+    return true;
+  }
+
+  ConstantRange U = it->second.unionWith(R);
+  if (U == it->second)
+    return false;
+
+  if (++updates[V] > (header ? HeaderUpdates : OtherUpdates))
+    U = widen(it->second, U);
+  it->second = U;
+  return true;
+}
+
+bool IntervalAnalysis::runOnModule(Module& M) {
+  releaseMemory();
+
+  std::deque<const Instruction *> worklist;
+  DenseSet<const Instruction *> queued;
+  auto push = [&worklist, &queued](const Value *V) {
+    if (auto *I = dyn_cast<Instruction>(V))
+      if (queued.insert(I).second)
+        worklist.push_back(I);
+  };
+  // V has changed. Push its users and the uses that may be
+  // refined by a comparison with V
+  auto changed = [&push](const Value *V) {
+    for (const User *U : V->users()) {
+      push(U);
+      if (isa<ICmpInst>(U))
+        for (const Value *op : U->operands())
+          for (const User *UU : op->users())
+            push(UU);
+    }
+  };
+
+  for (Function& F : M) {
+    if (F.isDeclaration())
+      continue;
+
+    auto *DT = new DominatorTree(F);
+    domTrees[&F].reset(DT);
+    LoopInfo LI(*DT);
+    for (Loop *L : LI.getLoopsInPreorder())
+      loopHeaders.insert(L->getHeader());
+
+    // the arguments of internal functions come from the call sites,
+    // the others may be anything
+    if (onlyCalledDirectly(F))
+      for (Argument& A : F.args())
+        if (A.getType()->isIntegerTy())
+          ranges.insert({&A, ConstantRange(A.getType()->getIntegerBitWidth(),
+                                           false)});
+    if (F.getReturnType()->isIntegerTy() && !F.isInterposable())
+      returns.insert({&F, ConstantRange(F.getReturnType()
+                                          ->getIntegerBitWidth(), false)});
+
+    for (Instruction& I : instructions(F)) {
+      if (I.getType()->isIntegerTy())
+        ranges.insert({&I, ConstantRange(I.getType()->getIntegerBitWidth(),
+                                         false)});
+      push(&I);
+    }
+  }
+
+  while (!worklist.empty()) {
+    const Instruction *I = worklist.front();
+    worklist.pop_front();
+    queued.erase(I);
+
+    if (auto *RI = dyn_cast<ReturnInst>(I)) {
+      const Function *F = RI->getFunction();
+      const Value *RV = RI->getReturnValue();
+      if (RV && returns.count(F) &&
+          join(returns, F, getRangeAt(RV, RI), false))
+        for (const User *U : F->users())
+          push(U);
+      continue;
+    }
+
+    if (auto *CI = dyn_cast<CallInst>(I)) {
+      const Function *F = directCallee(CI);
+      if (F && !F->isDeclaration() && numArgs(CI) == F->arg_size()) {
+        for (const Argument& A : F->args()) {
+          const Value *actual = CI->getArgOperand(A.getArgNo());
+          if (ranges.count(&A) && actual->getType() == A.getType() &&
+              join(ranges, &A, getRangeAt(actual, CI), false))
+            changed(&A);
+        }
+      }
+    }
+
+    if (I->getType()->isIntegerTy() &&
+        join(ranges, I, transfer(I),
+             isa<PHINode>(I) && loopHeaders.count(I->getParent())))
+      changed(I);
+  }
+
+  // narrowing: recompute the values in the order of the CFG
+  // (and the arguments and the returned values) and keep the new
+  // range if it is smaller
+  auto narrow = [](ConstantRange& old, const ConstantRange& R) {
+    if (R != old && old.contains(R))
+      old = R;
+  };
+  for (unsigned round = 0; round < NarrowingRounds; ++round) {
+    for (Function& F : M) {
+      if (F.isDeclaration())
+        continue;
+
+      for (Argument& A : F.args()) {
+        auto it = ranges.find(&A);
+        if (it == ranges.end())
+          continue;
+        ConstantRange R(A.getType()->getIntegerBitWidth(), false);
+        for (const User *U : F.users()) {
+          auto *CI = cast<CallInst>(U);
+          R = R.unionWith(getRangeAt(CI->getArgOperand(A.getArgNo()), CI));
+        }
+        narrow(it->second, R);
+      }
+
+      auto ret = returns.find(&F);
+      ConstantRange RR(1, false);
+      if (ret != returns.end())
+        RR = ConstantRange(ret->second.getBitWidth(), false);
+
+      ReversePostOrderTraversal<Function *> RPOT(&F);
+      for (BasicBlock *B : RPOT) {
+        for (Instruction& I : *B) {
+          if (I.getType()->isIntegerTy())
+            narrow(ranges.find(&I)->second, transfer(&I));
+          if (auto *RI = dyn_cast<ReturnInst>(&I))
+            if (ret != returns.end() && RI->getReturnValue())
+              RR = RR.unionWith(getRangeAt(RI->getReturnValue(), RI));
+        }
+      }
+
+      if (ret != returns.end())
+        narrow(ret->second, RR);
+    }
+  }
+
+  return false;
+}
+
+void IntervalAnalysis::releaseMemory() {
+  ranges.clear();
+  updates.clear();
+  returns.clear();
+  loopHeaders.clear();
+  domTrees.clear();
+}
+
+ConstantRange IntervalAnalysis::getRange(const Value *V) const {
+  return lookup(V);
+}
+
+ConstantRange IntervalAnalysis::getRangeAt(const Value *V,
+                                           const Instruction *At) const {
+  if (auto *P = dyn_cast<PHINode>(At)) {
+    // a use in a phi node is at the end of the incoming block
+    ConstantRange R(V->getType()->getIntegerBitWidth(), false);
+    for (unsigned i = 0; i < P->getNumIncomingValues(); ++i)
+      if (P->getIncomingValue(i) == V)
+        R = R.unionWith(incoming(P, i));
+    return R;
+  }
+  return refineAt(V, At->getParent(), lookup(V));
+}
+
+ConstantRange IntervalAnalysis::getReturnRange(const Function *F) const {
+  auto it = returns.find(F);
+  if (it != returns.end())
+    return it->second;
+  return ConstantRange(F->getReturnType()->getIntegerBitWidth(), true);
+}
+
+void IntervalAnalysis::print(raw_ostream& out, const Module *M) const {
+  for (const Function& F : *M) {
+    if (F.isDeclaration())
+      continue;
+
+    out << "function " << F.getName();
+    auto it = returns.find(&F);
+    if (it != returns.end())
+      out << " returns " << it->second;
+    out << "\n";
+
+    auto printRange = [this, &out](const Value& V) {
+      if (!V.getType()->isIntegerTy())
+        return;
+      ConstantRange R = lookup(&V);
+      if (R.isFullSet())
+        return;
+      out << "  ";
+      V.printAsOperand(out, false);
+      out << " " << R << "\n";
+    };
+    for (const Argument& A : F.args())
+      printRange(A);
+    for (const Instruction& I : instructions(F))
+      printRange(I);
+  }
+}
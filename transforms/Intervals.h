@@ -0,0 +1,80 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#ifndef SBT_INTERVALS_H_
+#define SBT_INTERVALS_H_
+
+#include <map>
+#include <memory>
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+// The intervals of the integer SSA values of a module (-interval-analysis).
+// The analysis is sparse (it follows the def-use chains), the uses are
+// refined by the branch conditions that dominate them, the values
+// of the phi nodes in loop headers are widened (and narrowed again
+// after the fixpoint) and it is interprocedural: the calls of defined
+// functions get the range of the returned values, the arguments of
+// internal functions get the ranges from their call sites.
+//
+// The passes that need ranges require this analysis instead of asking
+// ScalarEvolution or LazyValueInfo on their own, so that one opt run
+// computes the ranges only once. The analysis does not use the nsw/nuw
+// flags, so the passes may change them without invalidating it.
+class IntervalAnalysis : public llvm::ModulePass {
+  // the current ranges of the instructions and the arguments
+  llvm::DenseMap<const llvm::Value *, llvm::ConstantRange> ranges;
+  // how many times a range has grown (for widening)
+  llvm::DenseMap<const llvm::Value *, unsigned> updates;
+  // the ranges of the values returned by the functions
+  llvm::DenseMap<const llvm::Value *, llvm::ConstantRange> returns;
+  llvm::SmallPtrSet<const llvm::BasicBlock *, 16> loopHeaders;
+  std::map<const llvm::Function *,
+           std::unique_ptr<llvm::DominatorTree>> domTrees;
+
+  llvm::ConstantRange lookup(const llvm::Value *V) const;
+  llvm::ConstantRange refine(const llvm::Value *V, const llvm::Value *Cond,
+                             bool taken, llvm::ConstantRange R) const;
+  llvm::ConstantRange refineAt(const llvm::Value *V,
+                               const llvm::BasicBlock *B,
+                               llvm::ConstantRange R) const;
+  llvm::ConstantRange incoming(const llvm::PHINode *P, unsigned i) const;
+  llvm::ConstantRange transfer(const llvm::Instruction *I) const;
+  bool join(llvm::DenseMap<const llvm::Value *, llvm::ConstantRange>& map,
+            const llvm::Value *V, const llvm::ConstantRange& R, bool header);
+
+public:
+  static char ID;
+
+  IntervalAnalysis() : llvm::ModulePass(ID) {}
+
+  void getAnalysisUsage(llvm::AnalysisUsage& AU) const override {
+    AU.setPreservesAll();
+  }
+
+  bool runOnModule(llvm::Module& M) override;
+  void releaseMemory() override;
+  void print(llvm::raw_ostream& out, const llvm::Module *M) const override;
+
+  // the range of an integer value (the full set if nothing is known,
+  // the empty set for the code that is never reached)
+  llvm::ConstantRange getRange(const llvm::Value *V) const;
+  // the range of V at the instruction At, refined by the conditions
+  // of the branches that dominate At
+  llvm::ConstantRange getRangeAt(const llvm::Value *V,
+                                 const llvm::Instruction *At) const;
+  // the range of the values returned by F
+  llvm::ConstantRange getReturnRange(const llvm::Function *F) const;
+};
+
+#endif // SBT_INTERVALS_H_
@@ -0,0 +1,402 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// sbt-ktest2xml: convert .ktest files generated by KLEE into Test-Comp
+// test-case XML files. This is the native counterpart of TestCaseWriter from
+// symbiotic/testsuits/testcases.py and writes the same inputs:
+//
+//   sbt-ktest2xml -o test-suite -j 4 klee-out/ test000001.ktest ...
+//
+// The arguments are .ktest files or directories with them. The files are
+// memory-mapped and the XML is written directly while parsing, the files
+// are processed by several threads (-j). A test covers an error if KLEE
+// wrote also testN.<kind>.err for it.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::list<std::string> Inputs(cl::Positional, cl::OneOrMore,
+                cl::desc("<.ktest files or directories>"));
+
+static cl::opt<std::string> OutputDir("o",
+                cl::desc("Output directory (default: the current directory)"),
+                cl::value_desc("directory"),
+                cl::init("."));
+
+static cl::opt<unsigned> Jobs("j",
+                cl::desc("Number of threads (default: the number of CPUs)"),
+                cl::init(0));
+
+static cl::opt<bool> AllObjects("all-objects",
+                cl::desc("Dump also objects that are not from main "
+                         "(in the order in which they were created)"),
+                cl::init(false));
+
+namespace {
+
+struct Test {
+    std::string path;
+    std::string output;
+    bool coversError;
+};
+
+// a read-only memory mapping of a file
+class MappedFile {
+    const uint8_t *_data{nullptr};
+    size_t _size{0};
+
+public:
+    MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *mem = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mem != MAP_FAILED) {
+                _data = static_cast<const uint8_t *>(mem);
+                _size = st.st_size;
+            }
+        }
+
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (_data)
+            munmap(const_cast<uint8_t *>(_data), _size);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t *data() const { return _data; }
+    size_t size() const { return _size; }
+};
+
+// parser of the data of a .ktest file
+class KtestReader {
+    const uint8_t *_pos;
+    const uint8_t *_end;
+
+public:
+    KtestReader(const uint8_t *data, size_t size)
+    : _pos(data), _end(data + size) {}
+
+    bool readU32(uint32_t& val) {
+        if (_end - _pos < 4)
+            return false;
+        // the numbers are stored in big endian
+        val = (uint32_t(_pos[0]) << 24) | (uint32_t(_pos[1]) << 16) |
+              (uint32_t(_pos[2]) << 8) | uint32_t(_pos[3]);
+        _pos += 4;
+        return true;
+    }
+
+    bool readBytes(uint32_t size, const uint8_t *& bytes) {
+        if (uint64_t(_end - _pos) < size)
+            return false;
+        bytes = _pos;
+        _pos += size;
+        return true;
+    }
+
+    bool skip(uint32_t size) {
+        const uint8_t *tmp;
+        return readBytes(size, tmp);
+    }
+};
+
+struct Input {
+    StringRef variable;
+    unsigned line;
+    int64_t value;
+};
+
+} // anonymous namespace
+
+static bool isIdentifier(StringRef name) {
+    if (name.empty())
+        return false;
+
+    auto isStart = [](char c) {
+        return c == '_' || c == '$' || (c >= 'a' && c <= 'z') ||
+               (c >= 'A' && c <= 'Z');
+    };
+
+    if (!isStart(name[0]))
+        return false;
+    for (char c : name.drop_front())
+        if (!isStart(c) && !(c >= '0' && c <= '9'))
+            return false;
+    return true;
+}
+
+// the value as TestCaseWriter dumps it
+static int64_t getValue(const uint8_t *bytes, uint32_t size) {
+    switch (size) {
+        case 8: { int64_t v; memcpy(&v, bytes, 8); return v; }
+        case 4: { int32_t v; memcpy(&v, bytes, 4); return v; }
+        case 2: { int16_t v; memcpy(&v, bytes, 2); return v; }
+        case 1: return static_cast<int8_t>(bytes[0]);
+        default:
+            // the objects of other sizes are dumped byte per byte
+            // and only the last byte remains
+            return bytes[size - 1];
+    }
+}
+
+// Convert one test, return an error message or an empty string
+static std::string convert(const Test& test) {
+    MappedFile file(test.path);
+    if (!file.data())
+        return "cannot map the file";
+
+    KtestReader R(file.data(), file.size());
+    const uint8_t *hdr;
+    if (!R.readBytes(5, hdr) ||
+        (memcmp(hdr, "KTEST", 5) != 0 && memcmp(hdr, "BOUT\n", 5) != 0))
+        return "unrecognized file";
+
+    uint32_t version, num;
+    if (!R.readU32(version) || version > 3)
+        return "unrecognized version";
+
+    // skip args
+    if (!R.readU32(num))
+        return "truncated file";
+    for (uint32_t i = 0; i < num; ++i) {
+        uint32_t size;
+        if (!R.readU32(size) || !R.skip(size))
+            return "truncated file";
+    }
+
+    if (version >= 2 && !R.skip(8))
+        return "truncated file";
+
+    if (!R.readU32(num))
+        return "truncated file";
+
+    std::vector<Input> inputs;
+    // the parts are function:variable:line:column
+    auto addInput = [&inputs](ArrayRef<StringRef> parts,
+                              const uint8_t *bytes, uint32_t size) {
+        if (size == 0)
+            return;
+        if (!AllObjects && parts[0] != "main")
+            return;
+        if (!isIdentifier(parts[1]))
+            return;
+
+        unsigned line = 0;
+        if (parts[2].getAsInteger(10, line) && !AllObjects)
+            return;
+
+        inputs.push_back(Input{parts[1], line, getValue(bytes, size)});
+    };
+
+    for (uint32_t i = 0; i < num; ++i) {
+        uint32_t nameSize, size;
+        const uint8_t *name, *bytes;
+        if (!R.readU32(nameSize) || !R.readBytes(nameSize, name) ||
+            !R.readU32(size) || !R.readBytes(size, bytes))
+            return "truncated file";
+
+        StringRef nameStr(reinterpret_cast<const char *>(name), nameSize);
+        SmallVector<StringRef, 4> parts;
+        if (!nameStr.startswith("__nondet_buffer|")) {
+            nameStr.split(parts, ':');
+            if (parts.size() == 4)
+                addInput(parts, bytes, size);
+            continue;
+        }
+
+        // a buffer with the values of several nondet calls, the parts are
+        // function:variable:line:column:size:kind (see -coalesce-nondet)
+        SmallVector<StringRef, 8> values;
+        nameStr.split(values, '|');
+        uint32_t offset = 0;
+        for (StringRef value : makeArrayRef(values).drop_front()) {
+            parts.clear();
+            value.split(parts, ':');
+            uint32_t valueSize;
+            if (parts.size() < 6 || parts[4].getAsInteger(10, valueSize) ||
+                valueSize > size - offset)
+                break;
+            addInput(makeArrayRef(parts).take_front(4), bytes + offset,
+                     valueSize);
+            offset += valueSize;
+        }
+    }
+
+    if (!AllObjects) {
+        std::stable_sort(inputs.begin(), inputs.end(),
+                         [](const Input& a, const Input& b) {
+                             return a.line < b.line;
+                         });
+    }
+
+    std::string tmp = test.output + ".tmp";
+    {
+        std::ofstream out(tmp);
+        if (!out)
+            return "cannot create " + tmp;
+
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n"
+            << "<!DOCTYPE testcase PUBLIC \"+//IDN sosy-lab.org//DTD test-format "
+               "testcase 1.0//EN\" \"https://sosy-lab.org/test-format/"
+               "testcase-1.0.dtd\">\n";
+        out << (test.coversError ? "<testcase key=\"coverError\">\n"
+                                 : "<testcase>\n");
+        // the variables are identifiers, there is nothing to escape
+        for (const Input& in : inputs)
+            out << "  <input variable=\"" << in.variable.str() << "\">"
+                << in.value << "</input>\n";
+        out << "</testcase>\n";
+
+        if (!out)
+            return "failed writing " + tmp;
+    }
+
+    if (std::error_code ec = sys::fs::rename(tmp, test.output)) {
+        sys::fs::remove(tmp);
+        return "failed writing " + test.output + ": " + ec.message();
+    }
+
+    return "";
+}
+
+static std::string getOutput(StringRef path) {
+    SmallString<128> out(OutputDir);
+    sys::path::append(out, sys::path::stem(path) + ".xml");
+    return out.str().str();
+}
+
+// the prefixes 'testN.' of .err files in the directory: testN.ktest
+// covers an error if KLEE wrote also testN.<kind>.err
+using ErrorPrefixes = std::set<std::string>;
+
+static const ErrorPrefixes& getErrorPrefixes(const std::string& dir) {
+    static std::map<std::string, ErrorPrefixes> cache;
+    auto it = cache.find(dir);
+    if (it != cache.end())
+        return it->second;
+
+    ErrorPrefixes& prefixes = cache[dir];
+    std::error_code ec;
+    for (sys::fs::directory_iterator I(dir, ec), E; I != E && !ec;
+         I.increment(ec)) {
+        StringRef name = sys::path::filename(I->path());
+        if (name.endswith(".err"))
+            prefixes.insert(name.substr(0, name.find('.') + 1).str());
+    }
+
+    return prefixes;
+}
+
+static void addFile(const std::string& path, std::vector<Test>& tests) {
+    std::string parent = sys::path::parent_path(path).str();
+    const ErrorPrefixes& prefixes = getErrorPrefixes(parent.empty() ? "." : parent);
+    bool covers = prefixes.count(sys::path::stem(path).str() + ".") > 0;
+    tests.push_back(Test{path, getOutput(path), covers});
+}
+
+// gather .ktest files from the directory
+static bool addDirectory(const std::string& dir, std::vector<Test>& tests) {
+    std::vector<std::string> ktests;
+    std::error_code ec;
+    for (sys::fs::directory_iterator I(dir, ec), E; I != E && !ec;
+         I.increment(ec)) {
+        StringRef path = I->path();
+        if (path.endswith(".ktest"))
+            ktests.push_back(path.str());
+    }
+
+    if (ec) {
+        errs() << "ERROR: cannot read directory " << dir << ": "
+               << ec.message() << "\n";
+        return false;
+    }
+
+    std::sort(ktests.begin(), ktests.end());
+    for (const std::string& path : ktests)
+        addFile(path, tests);
+
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    cl::ParseCommandLineOptions(argc, argv,
+                                "Convert KLEE .ktest files to Test-Comp XML\n");
+
+    std::vector<Test> tests;
+    bool ok = true;
+    for (const std::string& in : Inputs) {
+        if (sys::fs::is_directory(in))
+            ok &= addDirectory(in, tests);
+        else
+            addFile(in, tests);
+    }
+
+    if (std::error_code ec = sys::fs::create_directories(OutputDir)) {
+        errs() << "ERROR: cannot create " << OutputDir << ": "
+               << ec.message() << "\n";
+        return 1;
+    }
+
+    unsigned jobs = Jobs;
+    if (jobs == 0)
+        jobs = std::max(1u, std::thread::hardware_concurrency());
+    jobs = std::min<size_t>(jobs, std::max<size_t>(1, tests.size()));
+
+    std::vector<std::string> errors(tests.size());
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < tests.size(); i = next++)
+            errors[i] = convert(tests[i]);
+    };
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < jobs; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto& t : threads)
+        t.join();
+
+    unsigned converted = 0;
+    for (size_t i = 0; i < tests.size(); ++i) {
+        if (errors[i].empty()) {
+            ++converted;
+        } else {
+            errs() << "ERROR: failed converting " << tests[i].path << ": "
+                   << errors[i] << "\n";
+            ok = false;
+        }
+    }
+
+    errs() << "Converted " << converted << " test(s)\n";
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/CommandLine.h"
+
+#include "Compat.h"
+#include "LazyNondet.h"
+
+using namespace llvm;
+
+bool CloneMetadata(const llvm::Instruction *, llvm::Instruction *);
+
+static cl::opt<uint64_t> chunk_size("lazy-nondet-chunk-size",
+        cl::desc("The size of chunks (in bytes) of memory that is made\n"
+                 "nondeterministic lazily (default 64)"),
+        cl::init(64));
+
+uint64_t LazyNondet::getChunkSize() {
+    return chunk_size;
+}
+
+static bool isFree(const CallInst *CI, const Value *V) {
+    auto F = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+    return F && F->getName().equals("free") && CI->getArgOperand(0) == V;
+}
+
+bool LazyNondet::getAccesses(Value *mem, std::vector<Instruction *>& accesses) {
+    std::vector<Value *> worklist = {mem};
+    while (!worklist.empty()) {
+        Value *V = worklist.back();
+        worklist.pop_back();
+
+        for (auto *U : V->users()) {
+            if (auto *LI = dyn_cast<LoadInst>(U)) {
+                accesses.push_back(LI);
+            } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+                // storing the pointer itself
+                if (SI->getPointerOperand() != V)
+                    return false;
+                accesses.push_back(SI);
+            } else if (isa<GetElementPtrInst>(U) || isa<BitCastInst>(U)) {
+                worklist.push_back(U);
+            } else if (isa<ICmpInst>(U)) {
+                // comparing the pointer does not access the memory
+            } else if (auto *II = dyn_cast<IntrinsicInst>(U)) {
+                if (II->getIntrinsicID() != Intrinsic::lifetime_start &&
+                    II->getIntrinsicID() != Intrinsic::lifetime_end &&
+                    !isa<DbgInfoIntrinsic>(II))
+                    return false;
+            } else if (auto *CI = dyn_cast<CallInst>(U)) {
+                if (!isFree(CI, V))
+                    return false;
+            } else {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+Function *LazyNondet::getInit() {
+    if (_init)
+        return _init;
+
+    LLVMContext& Ctx = M.getContext();
+    Type *SizeTy = _nondet.getSizeT();
+    // void __VERIFIER_make_nondet_lazy(void *mem, size_t size, size_t chunk,
+    //                                  char *flags, void *ptr, size_t width,
+    //                                  const char *name);
+    auto C = insertFunction(M, "__VERIFIER_make_nondet_lazy",
+                            Type::getVoidTy(Ctx),
+                            {Type::getInt8PtrTy(Ctx), // mem
+                             SizeTy, // size
+                             SizeTy, // chunk
+                             Type::getInt8PtrTy(Ctx), // flags
+                             Type::getInt8PtrTy(Ctx), // ptr
+                             SizeTy, // width
+                             Type::getInt8PtrTy(Ctx)}); // name
+    _init = functionOf(C);
+
+    return _init;
+}
+
+void LazyNondet::instrument(const std::vector<Instruction *>& accesses,
+                            Value *mem, Value *size, Value *flags,
+                            const std::string& name) {
+    LLVMContext& Ctx = M.getContext();
+    const DataLayout& DL = M.getDataLayout();
+    Type *SizeTy = _nondet.getSizeT();
+    Function *init = getInit();
+    Constant *nameC = _nondet.getName(name);
+
+    for (Instruction *I : accesses) {
+        Value *ptr;
+        Type *accessTy;
+        if (auto *LI = dyn_cast<LoadInst>(I)) {
+            ptr = LI->getPointerOperand();
+            accessTy = LI->getType();
+        } else {
+            auto *SI = cast<StoreInst>(I);
+            ptr = SI->getPointerOperand();
+            accessTy = SI->getValueOperand()->getType();
+        }
+
+        auto *Ptr = CastInst::CreatePointerCast(ptr, Type::getInt8PtrTy(Ctx),
+                                                "", I);
+        std::vector<Value *> args = {
+            mem,
+            size,
+            ConstantInt::get(SizeTy, chunk_size),
+            flags,
+            Ptr,
+            ConstantInt::get(SizeTy, DL.getTypeStoreSize(accessTy)),
+            nameC
+        };
+        auto *CI = CallInst::Create(init, args, "", I);
+
+        CloneMetadata(I, Ptr);
+        CloneMetadata(I, CI);
+    }
+}
@@ -0,0 +1,55 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#ifndef SBT_LAZY_NONDET_H_
+#define SBT_LAZY_NONDET_H_
+
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+
+#include "NondetBuilder.h"
+
+// Makes memory nondeterministic lazily. The memory is split into chunks
+// and every load and store into the memory is preceded by the call
+//   __VERIFIER_make_nondet_lazy(mem, size, chunk, flags, ptr, width, name)
+// that makes the accessed chunks nondeterministic when they are accessed
+// for the first time (flags has one byte for every chunk and must be
+// zeroed). The helper is in lib/verifier/klee.
+//
+// This is used by -initialize-uninitialized and -instrument-alloc
+// for big objects, so that KLEE keeps symbolic only their used parts.
+class LazyNondet {
+    llvm::Module& M;
+    NondetBuilder& _nondet;
+    llvm::Function *_init = nullptr;
+
+    llvm::Function *getInit();
+
+public:
+    LazyNondet(llvm::Module& mod, NondetBuilder& nondet)
+        : M(mod), _nondet(nondet) {}
+
+    // the value of -lazy-nondet-chunk-size
+    static uint64_t getChunkSize();
+
+    // Get the loads and stores that access the memory pointed by mem.
+    // Return false if the memory may be accessed also in some other way,
+    // e.g., when the pointer is passed to a function (other than free)
+    // or stored to memory
+    static bool getAccesses(llvm::Value *mem,
+                            std::vector<llvm::Instruction *>& accesses);
+
+    // insert the calls of the helper before the accesses,
+    // mem and flags must be i8*, size must be size_t
+    void instrument(const std::vector<llvm::Instruction *>& accesses,
+                    llvm::Value *mem, llvm::Value *size, llvm::Value *flags,
+                    const std::string& name);
+};
+
+#endif // SBT_LAZY_NONDET_H_
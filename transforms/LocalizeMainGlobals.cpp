@@ -0,0 +1,126 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Replace the globals that only main accesses by local variables of main.
+// Only the main thread can access such a global (its address does not
+// escape), so its accesses are not visible to the other threads, but
+// a stateless model checker (e.g., Nidhugg) still explores
+// the interleavings around them. The local variables are on the stack
+// of the main thread and the optimizations can turn them into registers.
+//
+// A global is replaced if it is used only by loads from it and stores
+// into it (not of its address), getelementptrs, casts and comparisons
+// in main, and main is not called from the program (so it runs just once).
+
+#include <utility>
+#include <vector>
+
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+namespace {
+
+class LocalizeMainGlobals : public ModulePass {
+  bool isLocal(const Value *V, const Function *main) const;
+
+public:
+  static char ID;
+
+  LocalizeMainGlobals() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<LocalizeMainGlobals> LMG("localize-main-globals",
+                                             "Replace the globals that only "
+                                             "main accesses by local variables");
+char LocalizeMainGlobals::ID;
+
+// are all the uses of V (the global or a pointer derived from it)
+// in main and without letting the address escape?
+bool LocalizeMainGlobals::isLocal(const Value *V, const Function *main) const {
+  for (const User *U : V->users()) {
+    auto *I = dyn_cast<Instruction>(U);
+    // constant expressions or initializers of other globals
+    if (!I || I->getFunction() != main)
+      return false;
+
+    if (auto *LI = dyn_cast<LoadInst>(I)) {
+      if (!LI->isSimple())
+        return false;
+    } else if (auto *SI = dyn_cast<StoreInst>(I)) {
+      if (SI->getValueOperand() == V || !SI->isSimple())
+        return false;
+    } else if (isa<GetElementPtrInst>(I) || isa<BitCastInst>(I)) {
+      if (!isLocal(I, main))
+        return false;
+    } else if (!isa<ICmpInst>(I)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool LocalizeMainGlobals::runOnModule(Module& M) {
+  Function *main = M.getFunction("main");
+  if (!main || main->isDeclaration() || !main->use_empty())
+    return false;
+
+#if LLVM_VERSION_MAJOR >= 5
+  unsigned allocaAS = M.getDataLayout().getAllocaAddrSpace();
+#else
+  unsigned allocaAS = 0;
+#endif
+  std::vector<GlobalVariable *> globals;
+  for (GlobalVariable& GV : M.globals()) {
+    if (!GV.hasInitializer() || GV.isExternallyInitialized() ||
+        GV.isThreadLocal() || GV.getName().startswith("llvm."))
+      continue;
+    // (the locals are in the address space of allocas)
+    if (GV.getType()->getAddressSpace() != allocaAS)
+      continue;
+    if (!GV.use_empty() && isLocal(&GV, main))
+      globals.push_back(&GV);
+  }
+
+  if (globals.empty())
+    return false;
+
+  BasicBlock& entry = main->getEntryBlock();
+  Instruction *allocaPoint = &*entry.begin();
+  Instruction *initPoint = &*entry.getFirstInsertionPt();
+  while (isa<AllocaInst>(initPoint))
+    initPoint = initPoint->getNextNode();
+
+  std::vector<std::pair<GlobalVariable *, AllocaInst *>> locals;
+  for (GlobalVariable *GV : globals) {
+    auto *AI = makeAlloca(GV->getValueType(), M.getDataLayout(),
+                          GV->getName() + ".local", allocaPoint);
+    locals.emplace_back(GV, AI);
+  }
+
+  // initialize the locals after all the allocas
+  for (auto& it : locals) {
+    new StoreInst(it.first->getInitializer(), it.second, initPoint);
+    it.first->replaceAllUsesWith(it.second);
+    it.first->eraseFromParent();
+  }
+
+  errs() << "Replaced " << globals.size()
+         << " globals used only by main with local variables\n";
+  return true;
+}
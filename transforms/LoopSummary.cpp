@@ -0,0 +1,131 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/CFG.h"
+#if LLVM_VERSION_MAJOR > 6
+#include "llvm/Analysis/CFG.h"
+#endif
+
+#include "LoopSummary.h"
+
+using namespace llvm;
+
+void LoopSummary::addFunction(Function& F, const LoopInfo& LI) {
+    bool any = false;
+    for (Loop *L : LI.getLoopsInPreorder()) {
+        any = true;
+        ++loops;
+
+        if (L->getLoopDepth() > max_depth)
+            max_depth = L->getLoopDepth();
+
+        SmallVector<BasicBlock *, 8> exits;
+        L->getExitBlocks(exits);
+        if (exits.empty())
+            ++nonterm;
+    }
+
+    if (any)
+        ++functions;
+
+#if LLVM_VERSION_MAJOR > 6
+    if (!irreducible) {
+        ReversePostOrderTraversal<const Function *> RPOT(&F);
+        irreducible = containsIrreducibleCFG<const BasicBlock *>(RPOT, LI);
+    }
+#else
+    // we cannot check it, so be conservative
+    if (!F.isDeclaration())
+        irreducible = true;
+#endif
+}
+
+LoopSummary LoopSummary::compute(Module& M) {
+    LoopSummary summary;
+    for (Function& F : M) {
+        if (F.isDeclaration())
+            continue;
+
+        DominatorTree DT(F);
+        LoopInfo LI(DT);
+        summary.addFunction(F, LI);
+    }
+
+    return summary;
+}
+
+bool LoopSummary::has(const std::string& kind, bool& known) const {
+    known = true;
+    if (kind == "loops")
+        return loops > 0;
+    if (kind == "nonterm-loops")
+        return nonterm > 0;
+    if (kind == "nested-loops")
+        return nested();
+    if (kind == "irreducible-loops")
+        return irreducible;
+
+    known = false;
+    return false;
+}
+
+void LoopSummary::writeJSON(raw_ostream& out) const {
+    out << "{\"loops\": " << loops
+        << ", \"nonterm\": " << nonterm
+        << ", \"max_depth\": " << max_depth
+        << ", \"functions\": " << functions
+        << ", \"nested\": " << (nested() ? "true" : "false")
+        << ", \"irreducible\": " << (irreducible ? "true" : "false")
+        << "}\n";
+}
+
+bool dropMustProgress(Loop *L, ScalarEvolution& SE) {
+#if LLVM_VERSION_MAJOR >= 12
+    bool changed = false;
+    // the counts of all loops of the function may depend on the attribute
+    Function *F = L->getHeader()->getParent();
+    if (F->mustProgress()) {
+        F->removeFnAttr(Attribute::MustProgress);
+        SE.forgetAllLoops();
+        changed = true;
+    }
+
+    bool nestChanged = false;
+    for (Loop *SL : L->getLoopsInPreorder()) {
+        MDNode *ID = SL->getLoopID();
+        if (!ID || !findOptionMDForLoopID(ID, "llvm.loop.mustprogress"))
+            continue;
+
+        // keep the other properties of the loop, the first operand
+        // is the self-reference
+        SmallVector<Metadata *, 4> ops;
+        ops.push_back(nullptr);
+        for (unsigned i = 1; i < ID->getNumOperands(); ++i) {
+            auto *Op = dyn_cast<MDNode>(ID->getOperand(i));
+            auto *Name = Op && Op->getNumOperands() > 0
+                            ? dyn_cast<MDString>(Op->getOperand(0)) : nullptr;
+            if (!Name || Name->getString() != "llvm.loop.mustprogress")
+                ops.push_back(ID->getOperand(i));
+        }
+
+        MDNode *NewID = MDNode::getDistinct(ID->getContext(), ops);
+        NewID->replaceOperandWith(0, NewID);
+        SL->setLoopID(NewID);
+        nestChanged = true;
+    }
+
+    if (nestChanged)
+        SE.forgetLoop(L);
+    return changed || nestChanged;
+#else
+    (void) L;
+    (void) SE;
+    return false;
+#endif
+}
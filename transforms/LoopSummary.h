@@ -0,0 +1,61 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#ifndef SBT_LOOP_SUMMARY_H_
+#define SBT_LOOP_SUMMARY_H_
+
+#include <string>
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace llvm {
+class ScalarEvolution;
+}
+
+// What loops are in a module. This is used by -classify-loops and by
+// sbt-pipeline to skip the stages that cannot change the module
+// (e.g., breaking infinite loops in a module without such loops).
+struct LoopSummary {
+    // the number of (natural) loops
+    unsigned loops{0};
+    // the number of loops without any exit (like while(1) {})
+    unsigned nonterm{0};
+    // the maximal depth of nested loops (1 = no nested loops)
+    unsigned max_depth{0};
+    // the number of functions with loops
+    unsigned functions{0};
+    // is there a function with irreducible control flow
+    // (such cycles are not natural loops)
+    bool irreducible{false};
+
+    bool nested() const { return max_depth > 1; }
+
+    // add the loops of a function
+    void addFunction(llvm::Function& F, const llvm::LoopInfo& LI);
+
+    // compute the summary of the whole module
+    static LoopSummary compute(llvm::Module& M);
+
+    // does the module have the loops of the given kind? The kind
+    // is one of: loops, nonterm-loops, nested-loops, irreducible-loops.
+    // Return false and set 'known' to false for an unknown kind
+    bool has(const std::string& kind, bool& known) const;
+
+    void writeJSON(llvm::raw_ostream& out) const;
+};
+
+// ScalarEvolution takes the loops that must make progress as finite
+// (clang marks so the C11 loops with a non-constant condition and all
+// C++ functions), e.g., it computes a count of i += 2 until i == n.
+// Such a count does not prove that the loop terminates. Remove the
+// assumption (it only allows optimizations) from the function of L and
+// from the loops of its nest and make SE compute the counts again.
+// Return true if the module changed.
+bool dropMustProgress(llvm::Loop *L, llvm::ScalarEvolution& SE);
+
+#endif // SBT_LOOP_SUMMARY_H_
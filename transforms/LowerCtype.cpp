@@ -0,0 +1,206 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Replace the classifications of characters through the table
+// of __ctype_b_loc (the isdigit(), isalpha(), isspace(), ... macros of glibc)
+//
+//   (*__ctype_b_loc())[c] & _ISdigit
+//
+// by comparisons of c with the ranges of the class ('0' <= c <= '9').
+// With a symbolic c, the read from the table is a read from a symbolic
+// offset of a 384-entry array that KLEE encodes as an array term,
+// the comparisons are much cheaper for the solver.
+//
+// The reads from the table are replaced only if all their uses are masks
+// by constants (possibly after an extension). The masks are evaluated
+// bit by bit with the classes of the "C" locale (of the model of
+// __ctype_b_loc in lib/libc/klee), an index outside the table (it has
+// the entries from -128 to 255) gives 0 instead of an invalid read.
+
+#include <utility>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Local.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+namespace {
+
+class LowerCtype : public FunctionPass {
+  unsigned lowered{0};
+
+  bool lower(LoadInst *LI, Value *index, const DataLayout& DL);
+
+public:
+  static char ID;
+
+  LowerCtype() : FunctionPass(ID) {}
+
+  bool runOnFunction(Function& F) override;
+
+  bool doFinalization(Module& /*M*/) override {
+    if (lowered > 0)
+      errs() << "Lowered " << lowered
+             << " classifications of characters to comparisons\n";
+    return false;
+  }
+};
+
+} // namespace
+
+static RegisterPass<LowerCtype> LC("lower-ctype",
+                                   "Replace the reads from the table of "
+                                   "__ctype_b_loc by comparisons");
+char LowerCtype::ID;
+
+using Range = std::pair<int, int>;
+
+// the characters of the classes of glibc (bit N of the table entry
+// in the big-endian order, a little-endian entry has the bytes swapped)
+static SmallVector<Range, 4> getClass(unsigned bit) {
+  switch (bit) {
+  case 0: return {{'A', 'Z'}};                                  // upper
+  case 1: return {{'a', 'z'}};                                  // lower
+  case 2: return {{'A', 'Z'}, {'a', 'z'}};                      // alpha
+  case 3: return {{'0', '9'}};                                  // digit
+  case 4: return {{'0', '9'}, {'A', 'F'}, {'a', 'f'}};          // xdigit
+  case 5: return {{'\t', '\r'}, {' ', ' '}};                    // space
+  case 6: return {{' ', '~'}};                                  // print
+  case 7: return {{'!', '~'}};                                  // graph
+  case 8: return {{'\t', '\t'}, {' ', ' '}};                    // blank
+  case 9: return {{0, 31}, {127, 127}};                         // cntrl
+  case 10: return {{'!', '/'}, {':', '@'}, {'[', '`'}, {'{', '~'}}; // punct
+  case 11: return {{'0', '9'}, {'A', 'Z'}, {'a', 'z'}};         // alnum
+  default: return {};
+  }
+}
+
+static bool isCtypeTable(const Value *V) {
+  auto *ptr = dyn_cast<LoadInst>(V);
+  if (!ptr)
+    return false;
+  auto *CI = dyn_cast<CallInst>(ptr->getPointerOperand()->stripPointerCasts());
+  if (!CI)
+    return false;
+  auto *F = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+  return F && F->getName() == "__ctype_b_loc";
+}
+
+static BinaryOperator *getMask(User *U) {
+  auto *BO = dyn_cast<BinaryOperator>(U);
+  if (!BO || BO->getOpcode() != Instruction::And ||
+      !isa<ConstantInt>(BO->getOperand(1)))
+    return nullptr;
+  return BO;
+}
+
+// the masks of the loaded entry, an extension of the entry may be between
+static bool getMasks(LoadInst *LI, SmallVectorImpl<BinaryOperator *>& masks) {
+  for (User *U : LI->users()) {
+    if (!isa<ZExtInst>(U) && !isa<SExtInst>(U)) {
+      auto *BO = getMask(U);
+      if (!BO)
+        return false;
+      masks.push_back(BO);
+      continue;
+    }
+    for (User *EU : U->users()) {
+      auto *BO = getMask(EU);
+      if (!BO)
+        return false;
+      masks.push_back(BO);
+    }
+  }
+  return !masks.empty();
+}
+
+bool LowerCtype::lower(LoadInst *LI, Value *index, const DataLayout& DL) {
+  if (LI->isVolatile() || !LI->getType()->isIntegerTy(16))
+    return false;
+  SmallVector<BinaryOperator *, 4> masks;
+  if (!getMasks(LI, masks))
+    return false;
+
+  IRBuilder<> B(LI);
+  for (BinaryOperator *BO : masks) {
+    // (the sign extension copies bit 15 of the entry to the higher bits)
+    const APInt& mask = cast<ConstantInt>(BO->getOperand(1))->getValue();
+    bool sext = isa<SExtInst>(BO->getOperand(0));
+    Type *Ty = BO->getType();
+    Value *result = nullptr;
+    for (unsigned bit = 0; bit < Ty->getIntegerBitWidth(); ++bit) {
+      if (!mask[bit])
+        continue;
+      unsigned entryBit = bit < 16 ? bit : (sext ? 15 : 16);
+      if (entryBit >= 16)
+        continue;
+      unsigned classBit = DL.isLittleEndian() ? (entryBit + 8) % 16 : entryBit;
+
+      Type *IdxTy = index->getType();
+      Value *in = B.getFalse();
+      for (const Range& R : getClass(classBit)) {
+        // lo <= index <= hi as (index - lo) <=u (hi - lo)
+        Value *off = B.CreateSub(index, ConstantInt::get(IdxTy, R.first));
+        Value *cmp = B.CreateICmpULE(off, ConstantInt::get(IdxTy,
+                                                           R.second - R.first));
+        in = isa<Constant>(in) ? cmp : B.CreateOr(in, cmp);
+      }
+      Value *value = B.CreateSelect(in,
+                                    ConstantInt::get(Ty, APInt::getOneBitSet(
+                                            Ty->getIntegerBitWidth(), bit)),
+                                    ConstantInt::get(Ty, 0));
+      result = result ? B.CreateOr(result, value) : value;
+    }
+    BO->replaceAllUsesWith(result ? result : ConstantInt::get(Ty, 0));
+    BO->eraseFromParent();
+  }
+
+  // the extensions of the entry are dead now
+  SmallVector<Instruction *, 4> exts;
+  for (User *U : LI->users())
+    exts.push_back(cast<Instruction>(U));
+  for (Instruction *I : exts)
+    I->eraseFromParent();
+
+  ++lowered;
+  return true;
+}
+
+bool LowerCtype::runOnFunction(Function& F) {
+  const DataLayout& DL = F.getParent()->getDataLayout();
+  std::vector<std::pair<LoadInst *, Value *>> reads;
+  for (Instruction& I : instructions(F)) {
+    auto *LI = dyn_cast<LoadInst>(&I);
+    if (!LI)
+      continue;
+    auto *GEP = dyn_cast<GetElementPtrInst>(LI->getPointerOperand());
+    if (!GEP || GEP->getNumIndices() != 1 ||
+        !isCtypeTable(GEP->getPointerOperand()))
+      continue;
+    reads.emplace_back(LI, GEP->getOperand(1));
+  }
+
+  bool changed = false;
+  for (auto& read : reads) {
+    if (lower(read.first, read.second, DL)) {
+      // the read and the address are dead now
+      RecursivelyDeleteTriviallyDeadInstructions(read.first);
+      changed = true;
+    }
+  }
+  return changed;
+}
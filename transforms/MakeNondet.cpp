@@ -4,11 +4,7 @@
 // License. See LICENSE.TXT for details.
 
 #include <cassert>
-#include <map>
 #include <vector>
-#include <set>
-#include <fstream>
-#include <sstream>
 
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/BasicBlock.h"
@@ -29,6 +25,10 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include "Compat.h"
+#include "NondetBuilder.h"
+#include "SourceLines.h"
+
 using namespace llvm;
 
 static cl::opt<std::string> source_name("make-nondet-source",
@@ -40,10 +40,10 @@ class MakeNondet : public ModulePass {
   // every item is (line number, call)
   std::vector<std::pair<unsigned, CallInst *>> calls_to_replace;
   std::vector<std::pair<unsigned, CallInst *>> allocs_to_handle;
-  std::set<unsigned> lines_nums;
-  std::map<unsigned, std::string> lines;
-  Function *_vms = nullptr; // verifier_make_symbolic function
-  Type *_size_t_Ty = nullptr; // type of size_t
+  // do some calls have a line number, so that we need the source?
+  bool need_source = false;
+  const SourceLines *source = nullptr;
+  std::unique_ptr<NondetBuilder> _nondet;
 
   void handleCall(Function& F, CallInst *CI, bool ismalloc);
   void mapLines();
@@ -52,12 +52,6 @@ class MakeNondet : public ModulePass {
   void replaceCall(Module& M, CallInst *CI, unsigned line, const std::string& var);
   void handleAlloc(Module& M, CallInst *CI, unsigned line, const std::string& var);
 
-  // add global of given type and initialize it in may as nondeterministic
-  Function *get_verifier_make_nondet(llvm::Module&);
-  Type *get_size_t(llvm::Module& );
-
-  unsigned call_identifier = 0;
-
 public:
   static char ID;
 
@@ -66,12 +60,15 @@ public:
   // must be module pass, so that we can iterate over
   // declarations too
   virtual bool runOnModule(Module &M) {
+    _nondet.reset(new NondetBuilder(M));
+
     for (auto& F : M)
       runOnFunction(F);
 
     mapLines();
     replaceCalls(M);
     handleAllocs(M);
+    _nondet->finish();
 
     return !calls_to_replace.empty() || !allocs_to_handle.empty();
   }
@@ -83,11 +80,7 @@ void MakeNondet::runOnFunction(Function &F) {
 
   for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
     if (CallInst *CI = dyn_cast<CallInst>(&*I)) {
-#if LLVM_VERSION_MAJOR >= 8
-      auto fun = dyn_cast<Function>(CI->getCalledOperand()->stripPointerCasts());
-#else
-      auto fun = dyn_cast<Function>(CI->getCalledValue()->stripPointerCasts());
-#endif
+      auto fun = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
       if (!fun)
           continue;
       auto name = fun->getName();
@@ -105,7 +98,7 @@ void MakeNondet::handleCall(Function& /*F*/, CallInst *CI, bool ismalloc) {
 	    allocs_to_handle.emplace_back(Loc.getLine(), CI);
     else
 	    calls_to_replace.emplace_back(Loc.getLine(), CI);
-    lines_nums.insert(Loc.getLine());
+    need_source = true;
   } else {
     if (ismalloc)
 	    allocs_to_handle.emplace_back(0, CI);
@@ -115,69 +108,30 @@ void MakeNondet::handleCall(Function& /*F*/, CallInst *CI, bool ismalloc) {
 }
 
 void MakeNondet::mapLines() {
-  if (lines_nums.empty()) {
+  if (!need_source) {
     assert(calls_to_replace.empty());
     return;
   }
 
-  std::ifstream file(source_name);
-
-  if (file.is_open()) {
-    unsigned n = 1;
-    std::string line;
-
-    while (getline(file,line)) {
-      if (lines_nums.count(n) > 0)
-		lines[n] = std::move(line);
-      ++n;
-    }
-
-    file.close();
-  } else {
+  source = SourceLines::get(source_name);
+  if (!source) {
 	errs() << "Couldn't open file: " << source_name << "\n";
     abort();
   }
-
-  assert(lines.size() == lines_nums.size());
 }
 
 void MakeNondet::replaceCall(Module& M, CallInst *CI,
                                       unsigned line, const std::string& var) {
-  // NOTE: this must be called before using call_identifier
-  auto make_nondet = get_verifier_make_nondet(M);
   std::string parent_name = cast<Function>(CI->getParent()->getParent())->getName().str();
   std::string name = parent_name + ":" + var + ":" + std::to_string(line);
-  Constant *name_const = ConstantDataArray::getString(M.getContext(), name);
-  GlobalVariable *nameG = new GlobalVariable(M, name_const->getType(), true /*constant */,
-                                             GlobalVariable::PrivateLinkage, name_const);
-
-  AllocaInst *AI = new AllocaInst(
-      CI->getType(),
-#if (LLVM_VERSION_MAJOR >= 5)
-      0,
-#endif
-      nullptr,
-#if LLVM_VERSION_MAJOR >= 11
-      M.getDataLayout().getPrefTypeAlign(CI->getType()),
-#endif
-      "",
-      static_cast<Instruction*>(nullptr));
+
+  AllocaInst *AI = makeAlloca(CI->getType(), M.getDataLayout());
 
   CastInst *CastI = CastInst::CreatePointerCast(AI, Type::getInt8PtrTy(M.getContext()));
 
-  std::vector<Value *> args;
-  // memory
-  args.push_back(CastI);
-  // nbytes
-  args.push_back(ConstantInt::get(get_size_t(M),
-                                  M.getDataLayout().getTypeAllocSize(CI->getType())));
-  // name
-  args.push_back(ConstantExpr::getPointerCast(nameG,
-                                              Type::getInt8PtrTy(M.getContext())));
-  // identifier
-  args.push_back(ConstantInt::get(Type::getInt32Ty(M.getContext()), ++call_identifier));
-
-  CallInst *new_CI = CallInst::Create(make_nondet, args);
+  auto nbytes = ConstantInt::get(_nondet->getSizeT(),
+                                 M.getDataLayout().getTypeAllocSize(CI->getType()));
+  CallInst *new_CI = _nondet->createCall(CastI, nbytes, name, CI);
   if (auto Loc = CI->getDebugLoc())
     new_CI->setDebugLoc(Loc);
 
@@ -204,41 +158,29 @@ void MakeNondet::replaceCall(Module& M, CallInst *CI,
 
 void MakeNondet::handleAlloc(Module& M, CallInst *CI,
                                       unsigned line, const std::string& var) {
-  auto make_nondet = get_verifier_make_nondet(M);
   std::string parent_name = cast<Function>(CI->getParent()->getParent())->getName().str();
   std::string name = parent_name + ":" + var + ":" + std::to_string(line);
-  Constant *name_const = ConstantDataArray::getString(M.getContext(), name);
-  GlobalVariable *nameG = new GlobalVariable(M, name_const->getType(), true /*constant */,
-                                             GlobalVariable::PrivateLinkage, name_const);
 
   CastInst *CastI = CastInst::CreatePointerCast(CI, Type::getInt8PtrTy(M.getContext()));
   CastI->insertAfter(CI);
 
-  std::vector<Value *> args;
-  // memory
-  args.push_back(CastI);
   // nbytes
+  Value *nbytes;
   if (CI->getCalledFunction()->getName().equals("calloc")) {
     auto Mul = BinaryOperator::Create(Instruction::Mul,
                                       CI->getOperand(0),
                                       CI->getOperand(1));
-    auto CastI2 = CastInst::CreateZExtOrBitCast(Mul, get_size_t(M));
+    auto CastI2 = CastInst::CreateZExtOrBitCast(Mul, _nondet->getSizeT());
     Mul->insertBefore(CastI);
     CastI2->insertAfter(Mul);
-    args.push_back(CastI2);
+    nbytes = CastI2;
   } else {
-    auto CastI2 = CastInst::CreateZExtOrBitCast(CI->getOperand(0), get_size_t(M));
+    auto CastI2 = CastInst::CreateZExtOrBitCast(CI->getOperand(0), _nondet->getSizeT());
     CastI2->insertBefore(CastI);
-    args.push_back(CastI2);
+    nbytes = CastI2;
   }
 
-  // name
-  args.push_back(ConstantExpr::getPointerCast(nameG,
-                                              Type::getInt8PtrTy(M.getContext())));
-  // identifier
-  args.push_back(ConstantInt::get(Type::getInt32Ty(M.getContext()), ++call_identifier));
-
-  CallInst *new_CI = CallInst::Create(make_nondet, args);
+  CallInst *new_CI = _nondet->createCall(CastI, nbytes, name, CI);
   if (auto Loc = CI->getDebugLoc())
     new_CI->setDebugLoc(Loc);
   new_CI->insertAfter(CastI);
@@ -302,9 +244,9 @@ void MakeNondet::replaceCalls(Module& M) {
     unsigned line_num = pr.first;
 	CallInst *CI = pr.second;
 
-    auto it = lines.find(line_num);
+    bool has_line = source && line_num > 0 && line_num <= source->size();
     replaceCall(M, CI, line_num,
-                it == lines.end() ? "" : getName(it->second));
+                has_line ? getName(source->getLine(line_num).str()) : "");
   }
 }
 
@@ -313,81 +255,11 @@ void MakeNondet::handleAllocs(Module& M) {
     unsigned line_num = pr.first;
 	CallInst *CI = pr.second;
 
-    auto it = lines.find(line_num);
-    auto name = getName(it->second);
+    auto name = getName(source ? source->getLine(line_num).str() : "");
     handleAlloc(M, CI, line_num, name == "--" ? "%dynalloc" : name);
   }
 }
 
-static unsigned getKleeMakeNondetCounter(const Function *F) {
-    using namespace llvm;
-
-    unsigned max = 0;
-    for (auto I = F->use_begin(), E = F->use_end(); I != E; ++I) {
-#if ((LLVM_VERSION_MAJOR == 3) && (LLVM_VERSION_MINOR < 5))
-        const Value *use = *I;
-#else
-        const Value *use = I->getUser();
-#endif
-        auto CI = dyn_cast<CallInst>(use);
-        assert(CI && "The use is not call");
-
-        auto C = dyn_cast<ConstantInt>(CI->getArgOperand(3));
-        assert(C && "Invalid operand in klee_make_nondet");
-
-        auto val = C->getZExtValue();
-        if (val > max)
-            max = val;
-    }
-
-    return max;
-}
-
-Function *MakeNondet::get_verifier_make_nondet(llvm::Module& M)
-{
-  if (_vms)
-    return _vms;
-
-  LLVMContext& Ctx = M.getContext();
-  //void verifier_make_symbolic(void *addr, size_t nbytes, const char *name);
-  auto C = M.getOrInsertFunction("klee_make_nondet",
-                                 Type::getVoidTy(Ctx),
-                                 Type::getInt8PtrTy(Ctx), // addr
-                                 // FIXME: get rid of the nbytes
-                                 // -- make the object symbolic entirely
-                                 get_size_t(M),   // nbytes
-                                 Type::getInt8PtrTy(Ctx), // name
-                                 Type::getInt32Ty(Ctx) // identifier
-#if LLVM_VERSION_MAJOR < 5
-                                 , nullptr
-#endif
-                                 );
-#if LLVM_VERSION_MAJOR >= 9
-  _vms = cast<Function>(C.getCallee());
-#else
-  _vms = cast<Function>(C);
-#endif
-
-  call_identifier = getKleeMakeNondetCounter(_vms);
-
-  return _vms;
-}
-
-Type *MakeNondet::get_size_t(llvm::Module& M)
-{
-  if (_size_t_Ty)
-    return _size_t_Ty;
-
-  LLVMContext& Ctx = M.getContext();
-
-  if (M.getDataLayout().getPointerSizeInBits() > 32)
-    _size_t_Ty = Type::getInt64Ty(Ctx);
-  else
-    _size_t_Ty = Type::getInt32Ty(Ctx);
-
-  return _size_t_Ty;
-}
-
 static RegisterPass<MakeNondet> MND("make-nondet",
                                     "Replace calls to verifier funs with code "
                                     " that registers new symbolic objects "
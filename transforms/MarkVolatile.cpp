@@ -4,6 +4,7 @@
 // License. See LICENSE.TXT for details.
 
 #include <cassert>
+#include <map>
 #include <vector>
 #include <set>
 
@@ -22,16 +23,26 @@
 #else
   #include "llvm/Support/InstIterator.h"
 #endif
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include <llvm/IR/DebugInfoMetadata.h>
 
+#include "Compat.h"
+
 using namespace llvm;
 
+static cl::opt<bool> skip_redundant("mark-volatile-skip-redundant",
+        cl::desc("Do not make volatile the marked accesses that are checked "
+                 "already by a volatile access to the same pointer earlier "
+                 "in the block (default=false)."),
+        cl::init(false));
+
 namespace {
 
 class MarkVolatile : public FunctionPass {
     bool has_unmarked{false};
+    unsigned skipped{0};
   public:
     static char ID;
 
@@ -43,40 +54,96 @@ class MarkVolatile : public FunctionPass {
       if (has_unmarked) {
         errs() << "[Warning]: some marked instruction were not made volatile\n";
       }
+      if (skipped > 0) {
+        errs() << "Kept " << skipped << " redundant marked accesses non-volatile\n";
+      }
       return false;
     }
 };
 
-bool MarkVolatile::runOnFunction(Function &F)
-{
-  bool modified = false;
-  LLVMContext& ctx = F.getParent()->getContext();
+static const Function *getMark(const Instruction *I) {
+  const CallInst *CI = dyn_cast<CallInst>(I);
+  if (!CI || CI->isInlineAsm())
+    return nullptr;
 
-  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E; ++I) {
-    Instruction *ins = &*I;
-    if (CallInst *CI = dyn_cast<CallInst>(ins)) {
-      if (CI->isInlineAsm())
-        continue;
+  const Value *val = calleeOf(CI)->stripPointerCasts();
+  const Function *callee = dyn_cast<Function>(val);
+  if (!callee || callee->isIntrinsic())
+    return nullptr;
 
-#if LLVM_VERSION_MAJOR >= 8
-      const Value *val = CI->getCalledOperand()->stripPointerCasts();
-#else
-      const Value *val = CI->getCalledValue()->stripPointerCasts();
-#endif
-      const Function *callee = dyn_cast<Function>(val);
-      if (!callee || callee->isIntrinsic())
-        continue;
+  assert(callee->hasName());
+  if (!callee->getName().startswith("__INSTR_mark_"))
+    return nullptr;
 
-      assert(callee->hasName());
-      StringRef name = callee->getName();
+  return callee;
+}
 
-      if (!name.startswith("__INSTR_mark_"))
+// The memory that the load or store accesses, or nullptr
+static const Value *getAccess(const Instruction *I, const DataLayout& DL,
+                              uint64_t& size) {
+  if (auto *SI = dyn_cast<StoreInst>(I)) {
+    size = DL.getTypeStoreSize(SI->getValueOperand()->getType());
+    return SI->getPointerOperand()->stripPointerCasts();
+  } else if (auto *LI = dyn_cast<LoadInst>(I)) {
+    size = DL.getTypeStoreSize(LI->getType());
+    return LI->getPointerOperand()->stripPointerCasts();
+  }
+  return nullptr;
+}
+
+// Can the instruction change the validity of memory?
+// (free, end of the scope, etc.) We are conservative and take
+// all calls except marks and debugging intrinsics.
+static bool mayChangeValidity(const Instruction *I) {
+  if (!isa<CallInst>(I) && !isa<InvokeInst>(I))
+    return false;
+  if (isa<DbgInfoIntrinsic>(I))
+    return false;
+  return getMark(I) == nullptr;
+}
+
+bool MarkVolatile::runOnFunction(Function &F)
+{
+  bool modified = false;
+  LLVMContext& ctx = F.getParent()->getContext();
+  const DataLayout& DL = F.getParent()->getDataLayout();
+
+  for (BasicBlock& B : F) {
+    // pointers that were accessed by a volatile access in this block
+    // (since the last call) and the size of the access
+    std::map<const Value *, uint64_t> checked;
+
+    for (auto I = B.begin(), E = B.end(); I != E; ++I) {
+      Instruction *ins = &*I;
+      if (!getMark(ins)) {
+        if (mayChangeValidity(ins))
+          checked.clear();
         continue;
+      }
 
       // we found a marked instruction, make it volatile
       // if it is store or load
       auto nextIt = I;
       ++nextIt;
+      if (nextIt == E) {
+          has_unmarked = true;
+          continue;
+      }
+
+      if (skip_redundant) {
+          uint64_t size;
+          if (const Value *ptr = getAccess(&*nextIt, DL, size)) {
+              auto it = checked.find(ptr);
+              if (it != checked.end() && it->second >= size) {
+                  // the same memory was checked already, optimizations
+                  // may remove or move this access
+                  ++skipped;
+                  continue;
+              }
+              checked[ptr] = size;
+          }
+      }
+
       if (StoreInst *SI = dyn_cast<StoreInst>(&*nextIt)) {
           SI->setVolatile(true);
           modified = true;
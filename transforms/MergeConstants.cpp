@@ -0,0 +1,165 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Merge the private constant globals whose address is not significant
+// (unnamed_addr, e.g., string literals and the tables of the models)
+// into a few pools and replace them by the pointers into the pools.
+// KLEE creates a memory object for every global, so it then tracks
+// and searches a few big objects instead of thousands of small ones.
+// The accesses out of the bounds of a merged constant read the next
+// constant in the pool, so the pass is not for memory safety.
+
+#include <vector>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned> PoolSize("merge-constants-pool-size",
+        cl::desc("The maximal size of a pool of constants in bytes\n"
+                 "(default: 65536)"),
+        cl::init(65536));
+
+namespace {
+
+class MergeConstants : public ModulePass {
+  void merge(Module& M, const std::vector<GlobalVariable *>& globals);
+
+public:
+  static char ID;
+
+  MergeConstants() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<MergeConstants> MC("merge-constants",
+                                       "Merge private constant globals "
+                                       "into pools");
+char MergeConstants::ID;
+
+static bool canMerge(const GlobalVariable& G) {
+  return G.isConstant() && G.hasInitializer() && G.hasLocalLinkage() &&
+#if LLVM_VERSION_MAJOR >= 4
+         G.hasGlobalUnnamedAddr() &&
+#else
+         G.hasUnnamedAddr() &&
+#endif
+         !G.isThreadLocal() && !G.hasSection() &&
+         !G.isExternallyInitialized() && G.getType()->getAddressSpace() == 0 &&
+         !G.hasMetadata() && !G.getName().startswith("llvm.");
+}
+
+static uint64_t getAlignment(const GlobalVariable& G, const DataLayout& DL) {
+  if (uint64_t align = G.getAlignment())
+    return align;
+#if LLVM_VERSION_MAJOR >= 11
+  return DL.getABITypeAlign(G.getValueType()).value();
+#else
+  return DL.getABITypeAlignment(G.getValueType());
+#endif
+}
+
+void MergeConstants::merge(Module& M,
+                           const std::vector<GlobalVariable *>& globals) {
+  const DataLayout& DL = M.getDataLayout();
+  LLVMContext& Ctx = M.getContext();
+  Type *i8 = Type::getInt8Ty(Ctx);
+
+  // a packed structure of the initializers,
+  // padded to the alignments of the globals
+  std::vector<Constant *> fields;
+  std::vector<unsigned> indices;
+  uint64_t size = 0, poolAlign = 1;
+  for (GlobalVariable *G : globals) {
+    uint64_t align = getAlignment(*G, DL);
+    poolAlign = std::max(poolAlign, align);
+    if (uint64_t pad = (align - size % align) % align) {
+      fields.push_back(ConstantAggregateZero::get(ArrayType::get(i8, pad)));
+      size += pad;
+    }
+    indices.push_back(fields.size());
+    fields.push_back(G->getInitializer());
+    size += DL.getTypeAllocSize(G->getValueType());
+  }
+
+  std::vector<Type *> types;
+  for (Constant *C : fields)
+    types.push_back(C->getType());
+  StructType *Ty = StructType::get(Ctx, types, /* isPacked = */ true);
+  auto *pool = new GlobalVariable(M, Ty, /* isConstant = */ true,
+                                  GlobalValue::PrivateLinkage,
+                                  ConstantStruct::get(Ty, fields),
+                                  "__constant_pool");
+#if LLVM_VERSION_MAJOR >= 4
+  pool->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
+#else
+  pool->setUnnamedAddr(true);
+#endif
+#if LLVM_VERSION_MAJOR >= 10
+  pool->setAlignment(Align(poolAlign));
+#else
+  pool->setAlignment(poolAlign);
+#endif
+
+  Type *i32 = Type::getInt32Ty(Ctx);
+  for (size_t i = 0; i < globals.size(); ++i) {
+    GlobalVariable *G = globals[i];
+    Constant *idx[] = {ConstantInt::get(i32, 0),
+                       ConstantInt::get(i32, indices[i])};
+    Constant *ptr = ConstantExpr::getInBoundsGetElementPtr(Ty, pool, idx);
+    G->replaceAllUsesWith(ConstantExpr::getPointerCast(ptr, G->getType()));
+    G->eraseFromParent();
+  }
+}
+
+bool MergeConstants::runOnModule(Module& M) {
+  const DataLayout& DL = M.getDataLayout();
+
+  std::vector<std::vector<GlobalVariable *>> pools;
+  std::vector<GlobalVariable *> pool;
+  uint64_t size = 0;
+  for (GlobalVariable& G : M.globals()) {
+    if (!canMerge(G))
+      continue;
+    uint64_t gsize = DL.getTypeAllocSize(G.getValueType());
+    if (gsize > PoolSize)
+      continue;
+    if (size + gsize > PoolSize) {
+      pools.push_back(std::move(pool));
+      pool.clear();
+      size = 0;
+    }
+    pool.push_back(&G);
+    size += gsize;
+  }
+  pools.push_back(std::move(pool));
+
+  unsigned merged = 0, created = 0;
+  for (auto& P : pools) {
+    // one global is a pool already
+    if (P.size() < 2)
+      continue;
+    merge(M, P);
+    merged += P.size();
+    ++created;
+  }
+
+  if (merged > 0)
+    errs() << "Merged " << merged << " constant globals into " << created
+           << " pools\n";
+  return merged > 0;
+}
@@ -0,0 +1,146 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Merge the functions with identical bodies (like -mergefunc), e.g.,
+// the same helper from several translation units or the clones of
+// a model. A function is replaced by an identical one only if:
+//
+//  - it is internal and its address is not taken (the calls are
+//    redirected and it is removed, no thunks are created),
+//  - neither function is one of those that the instrumentation and
+//    the verifiers know by name (__INSTR_*, __VERIFIER_*, ...), calling
+//    such a function instead of a helper would change the semantics,
+//  - the instructions of both functions have the same debug locations,
+//    so that the witnesses still point to the right lines.
+//
+// Merging makes the callers identical too, so the pass repeats
+// until nothing changes.
+
+#include <map>
+#include <vector>
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#if LLVM_VERSION_MAJOR >= 4
+#include "llvm/Transforms/Utils/FunctionComparator.h"
+#endif
+
+using namespace llvm;
+
+namespace {
+
+class MergeIdenticalFunctions : public ModulePass {
+public:
+  static char ID;
+
+  MergeIdenticalFunctions() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<MergeIdenticalFunctions> MIF("merge-identical-functions",
+                                                 "Merge the functions with "
+                                                 "identical bodies");
+char MergeIdenticalFunctions::ID;
+
+static bool isKnownByName(const Function& F) {
+  StringRef name = F.getName();
+  return name == "main" || name.startswith("__INSTR_") ||
+         name.startswith("__VERIFIER_") || name.startswith("__symbiotic_") ||
+         name.startswith("klee_") || name.startswith("__sbt_");
+}
+
+// can F be removed and its calls redirected to another function?
+static bool canBeReplaced(const Function& F) {
+  return F.hasLocalLinkage() && !F.hasAddressTaken();
+}
+
+static bool sameLocation(const DebugLoc& A, const DebugLoc& B) {
+  if (!A || !B)
+    return !A && !B;
+  if (A.getLine() != B.getLine() || A.getCol() != B.getCol())
+    return false;
+
+  auto *SA = dyn_cast<DIScope>(A.getScope());
+  auto *SB = dyn_cast<DIScope>(B.getScope());
+  if (!SA || !SB)
+    return SA == SB;
+  return SA->getFilename() == SB->getFilename() &&
+         SA->getDirectory() == SB->getDirectory();
+}
+
+// do the instructions have the same debug locations? (If the blocks are
+// in a different order, we do not merge, even though the bodies are
+// identical)
+static bool sameDebugLocations(Function& F, Function& G) {
+  auto I = inst_begin(F), IE = inst_end(F);
+  auto J = inst_begin(G), JE = inst_end(G);
+  for (; I != IE && J != JE; ++I, ++J) {
+    if (!sameLocation(I->getDebugLoc(), J->getDebugLoc()))
+      return false;
+  }
+  return I == IE && J == JE;
+}
+
+bool MergeIdenticalFunctions::runOnModule(Module& M) {
+#if LLVM_VERSION_MAJOR >= 4
+  unsigned merged = 0;
+  bool changed;
+  do {
+    changed = false;
+
+    std::map<FunctionComparator::FunctionHash, std::vector<Function *>> buckets;
+    for (Function& F : M) {
+      if (!F.isDeclaration() && !F.isInterposable() && !isKnownByName(F))
+        buckets[FunctionComparator::functionHash(F)].push_back(&F);
+    }
+
+    GlobalNumberState numbers;
+    for (auto& it : buckets) {
+      auto& funs = it.second;
+      if (funs.size() < 2)
+        continue;
+
+      SmallPtrSet<Function *, 8> removed;
+      for (Function *G : funs) {
+        if (!canBeReplaced(*G))
+          continue;
+
+        for (Function *F : funs) {
+          if (F == G || removed.count(F) ||
+              F->getFunctionType() != G->getFunctionType())
+            continue;
+          if (FunctionComparator(F, G, &numbers).compare() != 0 ||
+              !sameDebugLocations(*F, *G))
+            continue;
+
+          G->replaceAllUsesWith(F);
+          removed.insert(G);
+          ++merged;
+          break;
+        }
+      }
+
+      for (Function *G : removed)
+        G->eraseFromParent();
+      changed |= !removed.empty();
+    }
+  } while (changed);
+
+  if (merged > 0)
+    errs() << "Merged " << merged << " identical functions\n";
+  return merged > 0;
+#else
+  (void) M;
+  return false;
+#endif
+}
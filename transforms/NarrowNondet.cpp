@@ -0,0 +1,205 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Make the symbolic values of __VERIFIER_nondet_* calls only as wide as
+// the program needs them, the queries of the symbolic executor are then
+// smaller. A call is narrowed if
+//
+//  - all its uses truncate it (e.g., char c = __VERIFIER_nondet_int();),
+//    it is then replaced by a call of the nondet function of the widest
+//    truncated type (rounded up to _Bool, char, short or int), or
+//  - all its uses compare it with constants and the comparisons split
+//    the values in the same way (e.g., if (__VERIFIER_nondet_int()),
+//    or x = __VERIFIER_nondet_int(); if (x > 0) ... else if (x <= 0) ...),
+//    it is then replaced by the zero extension of __VERIFIER_nondet_bool().
+//    Only the comparisons that separate 0 and 1 are used, so that
+//    the values in tests and witnesses are valid also for the original call.
+//
+// In both cases the new value can be used in place of the old one
+// for every value of the old call that the program can observe.
+
+#include <vector>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+namespace {
+
+class NarrowNondet : public ModulePass {
+  Function *getNondet(Module& M, unsigned width);
+  bool narrowTrunc(Module& M, CallInst *CI);
+  bool narrowCompare(Module& M, CallInst *CI);
+
+public:
+  static char ID;
+
+  NarrowNondet() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<NarrowNondet> NN("narrow-nondet",
+                                     "Narrow the nondeterministic values "
+                                     "to the bits that the program uses");
+char NarrowNondet::ID;
+
+static bool isNondetCall(const Instruction& I) {
+  auto *CI = dyn_cast<CallInst>(&I);
+  // (the only operand is the called function)
+  if (!CI || CI->isInlineAsm() || !CI->getType()->isIntegerTy() ||
+      CI->getNumOperands() != 1)
+    return false;
+
+  auto *callee = CI->getCalledFunction();
+  return callee && callee->isDeclaration() &&
+         callee->getName().startswith("__VERIFIER_nondet_");
+}
+
+// the nondet function that returns the given number of bits,
+// nullptr if the module declares it with another type
+Function *NarrowNondet::getNondet(Module& M, unsigned width) {
+  const char *name;
+  switch (width) {
+  case 1: name = "__VERIFIER_nondet_bool"; break;
+  case 8: name = "__VERIFIER_nondet_uchar"; break;
+  case 16: name = "__VERIFIER_nondet_ushort"; break;
+  case 32: name = "__VERIFIER_nondet_uint"; break;
+  default: return nullptr;
+  }
+
+  Type *Ty = Type::getIntNTy(M.getContext(), width);
+  Function *F = M.getFunction(name);
+  if (F) {
+    if (F->getReturnType() != Ty || F->arg_size() != 0 || F->isVarArg())
+      return nullptr;
+    return F;
+  }
+  return functionOf(insertFunction(M, name, Ty, {}));
+}
+
+static void replaceCall(CallInst *CI, CallInst *newCI) {
+  newCI->setDebugLoc(CI->getDebugLoc());
+  newCI->takeName(CI);
+}
+
+bool NarrowNondet::narrowTrunc(Module& M, CallInst *CI) {
+  unsigned width = 0;
+  for (User *U : CI->users()) {
+    auto *T = dyn_cast<TruncInst>(U);
+    if (!T)
+      return false;
+    width = std::max(width, T->getType()->getIntegerBitWidth());
+  }
+
+  unsigned narrow = width == 1 ? 1 : width <= 8 ? 8 : width <= 16 ? 16 : 32;
+  if (width == 0 || narrow >= CI->getType()->getIntegerBitWidth())
+    return false;
+  Function *F = getNondet(M, narrow);
+  if (!F)
+    return false;
+
+  IRBuilder<> builder(CI);
+  builder.SetCurrentDebugLocation(CI->getDebugLoc());
+  CallInst *newCI = builder.CreateCall(F);
+  replaceCall(CI, newCI);
+
+  std::vector<User *> users(CI->user_begin(), CI->user_end());
+  for (User *U : users) {
+    auto *T = cast<TruncInst>(U);
+    builder.SetInsertPoint(T);
+    Value *V = builder.CreateTruncOrBitCast(newCI, T->getType());
+    if (V != newCI)
+      V->takeName(T);
+    T->replaceAllUsesWith(V);
+    T->eraseFromParent();
+  }
+  CI->eraseFromParent();
+  return true;
+}
+
+// the values of the call for which the comparison holds
+static bool getRegion(ICmpInst *Cmp, CallInst *CI, ConstantRange& region) {
+  CmpInst::Predicate pred = Cmp->getPredicate();
+  Value *other = Cmp->getOperand(1);
+  if (Cmp->getOperand(0) != CI) {
+    pred = Cmp->getSwappedPredicate();
+    other = Cmp->getOperand(0);
+  }
+  auto *C = dyn_cast<ConstantInt>(other);
+  if (!C || other == CI)
+    return false;
+  region = ConstantRange::makeExactICmpRegion(pred, C->getValue());
+  return true;
+}
+
+bool NarrowNondet::narrowCompare(Module& M, CallInst *CI) {
+  if (CI->use_empty())
+    return false;
+
+  unsigned width = CI->getType()->getIntegerBitWidth();
+  ConstantRange split(width, true);
+  bool first = true;
+  for (User *U : CI->users()) {
+    auto *Cmp = dyn_cast<ICmpInst>(U);
+    ConstantRange region(width, true);
+    if (!Cmp || !getRegion(Cmp, CI, region))
+      return false;
+    if (first) {
+      split = region;
+      first = false;
+    } else if (region != split && region != split.inverse()) {
+      return false;
+    }
+  }
+
+  // 0 and 1 must be on different sides of the split
+  if (split.contains(APInt(width, 0)) == split.contains(APInt(width, 1)))
+    return false;
+  Function *F = getNondet(M, 1);
+  if (!F)
+    return false;
+
+  IRBuilder<> builder(CI);
+  builder.SetCurrentDebugLocation(CI->getDebugLoc());
+  CallInst *newCI = builder.CreateCall(F);
+  replaceCall(CI, newCI);
+  CI->replaceAllUsesWith(builder.CreateZExt(newCI, CI->getType()));
+  CI->eraseFromParent();
+  return true;
+}
+
+bool NarrowNondet::runOnModule(Module& M) {
+  std::vector<CallInst *> calls;
+  for (Function& F : M) {
+    for (BasicBlock& B : F) {
+      for (Instruction& I : B) {
+        if (isNondetCall(I) && !I.getType()->isIntegerTy(1))
+          calls.push_back(cast<CallInst>(&I));
+      }
+    }
+  }
+
+  unsigned narrowed = 0;
+  for (CallInst *CI : calls) {
+    if (narrowTrunc(M, CI) || narrowCompare(M, CI))
+      ++narrowed;
+  }
+
+  if (narrowed > 0)
+    errs() << "Narrowed " << narrowed << " nondeterministic values\n";
+  return narrowed > 0;
+}
@@ -0,0 +1,117 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// The entry point of LLVMsbt.so as a plugin of the new pass manager.
+// The passes ported to the new pass manager (see NewPM.h) are added
+// directly, so they share the analyses cached by the analysis managers
+// (e.g., LoopInfo and DominatorTree are not rebuilt between two ported
+// passes that preserve them). Every other pass of LLVMsbt (and any other
+// legacy pass that the new pass manager does not know, e.g., -lowerswitch)
+// is run by LegacyPassAdaptor in a legacy pass manager on the whole module.
+
+#include "llvm/Config/llvm-config.h"
+
+#if LLVM_VERSION_MAJOR >= 12
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+#include "llvm/PassInfo.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+#include "NewPM.h"
+
+using namespace llvm;
+
+namespace {
+
+// (function-local statics, the registrations run
+// in the static constructors of other files)
+std::map<std::string, FunctionPassAdder>& functionPasses() {
+  static std::map<std::string, FunctionPassAdder> passes;
+  return passes;
+}
+
+std::map<std::string, ModulePassAdder>& modulePasses() {
+  static std::map<std::string, ModulePassAdder> passes;
+  return passes;
+}
+
+class LegacyPassAdaptor : public PassInfoMixin<LegacyPassAdaptor> {
+  const PassInfo *PI;
+
+public:
+  LegacyPassAdaptor(const PassInfo *PI) : PI(PI) {}
+
+  PreservedAnalyses run(Module& M, ModuleAnalysisManager&) {
+    legacy::PassManager PM;
+    PM.add(PI->createPass());
+    return PM.run(M) ? PreservedAnalyses::none() : PreservedAnalyses::all();
+  }
+
+  static StringRef name() { return "LegacyPassAdaptor"; }
+};
+
+bool addFunctionPass(StringRef name, FunctionPassManager& FPM) {
+  auto it = functionPasses().find(name.str());
+  if (it == functionPasses().end())
+    return false;
+  it->second(FPM);
+  return true;
+}
+
+bool addModulePass(StringRef name, ModulePassManager& MPM) {
+  auto it = modulePasses().find(name.str());
+  if (it != modulePasses().end()) {
+    it->second(MPM);
+    return true;
+  }
+
+  FunctionPassManager FPM;
+  if (addFunctionPass(name, FPM)) {
+    MPM.addPass(createModuleToFunctionPassAdaptor(std::move(FPM)));
+    return true;
+  }
+
+  const PassInfo *PI = PassRegistry::getPassRegistry()->getPassInfo(name);
+  if (!PI || PI->isAnalysis() || !PI->getNormalCtor())
+    return false;
+  MPM.addPass(LegacyPassAdaptor(PI));
+  return true;
+}
+
+} // namespace
+
+void registerNewPMFunctionPass(const char *name, FunctionPassAdder adder) {
+  functionPasses()[name] = std::move(adder);
+}
+
+void registerNewPMModulePass(const char *name, ModulePassAdder adder) {
+  modulePasses()[name] = std::move(adder);
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "LLVMsbt", "1.0", [](PassBuilder& PB) {
+            PB.registerPipelineParsingCallback(
+                [](StringRef name, FunctionPassManager& FPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  return addFunctionPass(name, FPM);
+                });
+            PB.registerPipelineParsingCallback(
+                [](StringRef name, ModulePassManager& MPM,
+                   ArrayRef<PassBuilder::PipelineElement>) {
+                  return addModulePass(name, MPM);
+                });
+          }};
+}
+
+#endif // LLVM_VERSION_MAJOR >= 12
@@ -0,0 +1,52 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#ifndef SBT_NEW_PM_H_
+#define SBT_NEW_PM_H_
+
+#include "llvm/Config/llvm-config.h"
+
+#if LLVM_VERSION_MAJOR >= 12
+
+#include <functional>
+
+#include "llvm/IR/PassManager.h"
+
+// The passes of LLVMsbt in the new pass manager. LLVMsbt.so is also a pass
+// plugin (opt -load-pass-plugin LLVMsbt.so -passes=...): the passes that
+// are ported to the new pass manager register themselves here by
+//
+//   static RegisterNewPMFunctionPass<XPass> X("name");
+//
+// (or RegisterNewPMModulePass), under the same name as the legacy pass.
+// The other passes run in the new pass manager through an adaptor
+// that runs the legacy pass in a legacy pass manager (see NewPM.cpp).
+using FunctionPassAdder = std::function<void(llvm::FunctionPassManager&)>;
+using ModulePassAdder = std::function<void(llvm::ModulePassManager&)>;
+
+void registerNewPMFunctionPass(const char *name, FunctionPassAdder adder);
+void registerNewPMModulePass(const char *name, ModulePassAdder adder);
+
+template <typename PassT>
+struct RegisterNewPMFunctionPass {
+  RegisterNewPMFunctionPass(const char *name) {
+    registerNewPMFunctionPass(name, [](llvm::FunctionPassManager& FPM) {
+      FPM.addPass(PassT());
+    });
+  }
+};
+
+template <typename PassT>
+struct RegisterNewPMModulePass {
+  RegisterNewPMModulePass(const char *name) {
+    registerNewPMModulePass(name, [](llvm::ModulePassManager& MPM) {
+      MPM.addPass(PassT());
+    });
+  }
+};
+
+#endif // LLVM_VERSION_MAJOR >= 12
+
+#endif // SBT_NEW_PM_H_
@@ -0,0 +1,282 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#include <cassert>
+#include <vector>
+
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DebugLoc.h"
+#include "llvm/IR/Metadata.h"
+
+#include "Compat.h"
+#include "NondetBuilder.h"
+
+using namespace llvm;
+
+// prefix of globals with the names of nondet objects
+static const char *name_prefix = "nondet.name.";
+// the constant array with all the names of nondet objects
+static const char *pool_name = "nondet.names";
+
+// 32-bit FNV-1a, the identifiers must not depend on the LLVM's hashing
+// that may differ between builds and runs
+static uint32_t hashString(const std::string& str, uint32_t h = 2166136261u) {
+  for (unsigned char c : str) {
+    h ^= c;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+void NondetBuilder::loadUsed() {
+  _used_loaded = true;
+
+  Function *F = getMakeNondet();
+  for (auto I = F->use_begin(), E = F->use_end(); I != E; ++I) {
+#if ((LLVM_VERSION_MAJOR == 3) && (LLVM_VERSION_MINOR < 5))
+    const Value *use = *I;
+#else
+    const Value *use = I->getUser();
+#endif
+    auto CI = dyn_cast<CallInst>(use);
+    assert(CI && "The use is not call");
+
+    auto C = dyn_cast<ConstantInt>(CI->getArgOperand(3));
+    assert(C && "Invalid operand in klee_make_nondet");
+    _used.insert(C->getZExtValue());
+  }
+}
+
+void NondetBuilder::loadPool() {
+  _pool_loaded = true;
+
+  GlobalVariable *pool = M.getNamedGlobal(pool_name);
+  if (!pool || !pool->hasInitializer())
+    return;
+
+  auto *CDA = dyn_cast<ConstantDataArray>(pool->getInitializer());
+  if (!CDA)
+    return;
+
+  // the names are separated by zeros
+  StringRef data = CDA->getRawDataValues();
+  uint64_t offset = 0;
+  while (offset < data.size()) {
+    size_t end = data.find('\0', offset);
+    if (end == StringRef::npos)
+      break;
+    _pooled.emplace(data.substr(offset, end - offset).str(), offset);
+    offset = end + 1;
+  }
+}
+
+Constant *NondetBuilder::getPooledName(GlobalVariable *pool, uint64_t offset) {
+  LLVMContext& Ctx = M.getContext();
+  Constant *idx[] = {ConstantInt::get(Type::getInt64Ty(Ctx), 0),
+                     ConstantInt::get(Type::getInt64Ty(Ctx), offset)};
+  return ConstantExpr::getInBoundsGetElementPtr(
+#if LLVM_VERSION_MAJOR >= 4
+                                                pool->getValueType(),
+#endif
+                                                pool, idx);
+}
+
+// Move the names created by this builder into the pool. The pool is
+// recreated with the new names appended, so the offsets of the names
+// from the previous passes do not change.
+void NondetBuilder::poolNames() {
+  if (_newNames.empty())
+    return;
+
+  if (!_pool_loaded)
+    loadPool();
+
+  GlobalVariable *oldPool = M.getNamedGlobal(pool_name);
+  std::string data;
+  if (oldPool && oldPool->hasInitializer()) {
+    if (auto *CDA = dyn_cast<ConstantDataArray>(oldPool->getInitializer()))
+      data = CDA->getRawDataValues().str();
+  }
+
+  size_t oldSize = data.size();
+  std::vector<std::pair<GlobalVariable *, uint64_t>> moved;
+  for (GlobalVariable *nameG : _newNames) {
+    auto *CDA = cast<ConstantDataArray>(nameG->getInitializer());
+    // the string without the terminating zero
+    std::string name = CDA->getAsCString().str();
+    auto it = _pooled.find(name);
+    if (it == _pooled.end()) {
+      it = _pooled.emplace(name, data.size()).first;
+      data += name;
+      data.push_back('\0');
+    }
+    moved.emplace_back(nameG, it->second);
+  }
+  _newNames.clear();
+
+  GlobalVariable *pool = oldPool;
+  if (data.size() != oldSize) {
+    LLVMContext& Ctx = M.getContext();
+    Constant *C = ConstantDataArray::getString(Ctx, data, false /* no zero */);
+    pool = new GlobalVariable(M, C->getType(), true /*constant */,
+                              GlobalVariable::PrivateLinkage, C);
+
+    if (oldPool) {
+      // the users of the old pool are the pointers to the names
+      std::vector<User *> users(oldPool->user_begin(), oldPool->user_end());
+      for (User *U : users) {
+        auto *CE = dyn_cast<ConstantExpr>(U);
+        if (!CE || CE->getOpcode() != Instruction::GetElementPtr ||
+            CE->getNumOperands() != 3)
+          continue;
+        auto *off = dyn_cast<ConstantInt>(CE->getOperand(2));
+        if (!off)
+          continue;
+        CE->replaceAllUsesWith(getPooledName(pool, off->getZExtValue()));
+      }
+
+      if (!oldPool->use_empty())
+        oldPool->replaceAllUsesWith(ConstantExpr::getBitCast(pool,
+                                                             oldPool->getType()));
+      pool->takeName(oldPool);
+      oldPool->eraseFromParent();
+    } else {
+      pool->setName(pool_name);
+    }
+  }
+
+  Type *I8PtrTy = Type::getInt8PtrTy(M.getContext());
+  for (auto& it : moved) {
+    GlobalVariable *nameG = it.first;
+    Constant *ptr = getPooledName(pool, it.second);
+    // the calls use the name as i8*, replace these casts directly
+    std::vector<User *> users(nameG->user_begin(), nameG->user_end());
+    for (User *U : users) {
+      auto *CE = dyn_cast<ConstantExpr>(U);
+      if (CE && CE->getType() == I8PtrTy)
+        CE->replaceAllUsesWith(ptr);
+    }
+
+    if (!nameG->use_empty())
+      nameG->replaceAllUsesWith(ConstantExpr::getBitCast(ptr, nameG->getType()));
+    nameG->eraseFromParent();
+  }
+
+  // the pointers to the names are not valid anymore
+  _names.clear();
+}
+
+void NondetBuilder::finish() {
+  poolNames();
+}
+
+unsigned NondetBuilder::getId(const std::string& name, const Instruction *at) {
+  if (!_used_loaded)
+    loadUsed();
+
+  std::string key = name;
+  if (at) {
+    if (const DebugLoc& Loc = at->getDebugLoc()) {
+      key += "@" + std::to_string(Loc.getLine()) + ":" +
+             std::to_string(Loc.getCol());
+    }
+  }
+
+  uint32_t h = hashString(key);
+  for (uint32_t ordinal = 0; ; ++ordinal) {
+    // the identifiers are positive 32-bit integers
+    unsigned id = hashString(std::to_string(ordinal), h) & 0x7fffffff;
+    if (id != 0 && _used.insert(id).second)
+      return id;
+  }
+}
+
+Function *NondetBuilder::getMakeNondet()
+{
+  if (_vms)
+    return _vms;
+
+  LLVMContext& Ctx = M.getContext();
+  //void verifier_make_symbolic(void *addr, size_t nbytes, const char *name);
+  auto C = insertFunction(M, "klee_make_nondet",
+                          Type::getVoidTy(Ctx),
+                          {Type::getInt8PtrTy(Ctx), // addr
+                           // FIXME: get rid of the nbytes
+                           // -- make the object symbolic entirely
+                           getSizeT(), // nbytes
+                           Type::getInt8PtrTy(Ctx), // name
+                           Type::getInt32Ty(Ctx)}); // identifier
+  _vms = functionOf(C);
+
+  return _vms;
+}
+
+Type *NondetBuilder::getSizeT()
+{
+  if (_size_t_Ty)
+    return _size_t_Ty;
+
+  LLVMContext& Ctx = M.getContext();
+
+  if (M.getDataLayout().getPointerSizeInBits() > 32)
+    _size_t_Ty = Type::getInt64Ty(Ctx);
+  else
+    _size_t_Ty = Type::getInt32Ty(Ctx);
+
+  return _size_t_Ty;
+}
+
+Constant *NondetBuilder::getName(const std::string& name)
+{
+  auto it = _names.find(name);
+  if (it != _names.end())
+    return it->second;
+
+  LLVMContext& Ctx = M.getContext();
+  if (!_pool_loaded)
+    loadPool();
+
+  auto pit = _pooled.find(name);
+  if (pit != _pooled.end()) {
+    GlobalVariable *pool = M.getNamedGlobal(pool_name);
+    assert(pool && "The pool of names is missing");
+    Constant *ptr = getPooledName(pool, pit->second);
+    _names.emplace(name, ptr);
+    return ptr;
+  }
+
+  Constant *name_const = ConstantDataArray::getString(Ctx, name);
+
+  // the global may have been created by a previous pass
+  std::string gname = name_prefix + name;
+  GlobalVariable *nameG = M.getNamedGlobal(gname);
+  if (!nameG || !nameG->hasInitializer() ||
+      nameG->getInitializer() != name_const) {
+    nameG = new GlobalVariable(M, name_const->getType(), true /*constant */,
+                               GlobalVariable::PrivateLinkage, name_const,
+                               gname);
+  }
+  _newNames.push_back(nameG);
+
+  Constant *ptr = ConstantExpr::getPointerCast(nameG, Type::getInt8PtrTy(Ctx));
+  _names.emplace(name, ptr);
+  return ptr;
+}
+
+CallInst *NondetBuilder::createCall(Value *mem, Value *nbytes,
+                                    const std::string& name,
+                                    const Instruction *at)
+{
+  Function *vms = getMakeNondet();
+
+  std::vector<Value *> args;
+  args.push_back(mem);
+  args.push_back(nbytes);
+  args.push_back(getName(name));
+  args.push_back(ConstantInt::get(Type::getInt32Ty(M.getContext()),
+                                  getId(name, at)));
+
+  return CallInst::Create(vms, args);
+}
@@ -0,0 +1,83 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#ifndef SBT_NONDET_BUILDER_H_
+#define SBT_NONDET_BUILDER_H_
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Type.h"
+
+// Creates calls to
+//   klee_make_nondet(void *addr, size_t nbytes, const char *name, int id)
+// for the passes that make memory nondeterministic.
+//
+// The identifiers must be unique in the module. They are derived from
+// the name of the object, the source location of the instruction that
+// the call is created for (if given) and an ordinal of the calls with
+// the same name and location, so that they do not change when calls are
+// added or removed elsewhere in the program (the tests and witnesses
+// from a previous version of the program refer to the same objects).
+// On a collision with an identifier that is already used in the module,
+// the next ordinal is tried. The name strings are shared, calls with the same
+// name use the same string. At the end of the pass, the new names are
+// moved into one module-wide constant array (the pool) and the calls
+// point into it.
+class NondetBuilder {
+    llvm::Module& M;
+    llvm::Function *_vms = nullptr; // klee_make_nondet function
+    llvm::Type *_size_t_Ty = nullptr; // type of size_t
+
+    // the identifiers used in the module
+    std::unordered_set<unsigned> _used;
+    bool _used_loaded = false;
+
+    std::unordered_map<std::string, llvm::Constant *> _names;
+    // globals with the names created by this builder (not pooled yet)
+    std::vector<llvm::GlobalVariable *> _newNames;
+
+    // offsets of the names in the pool
+    std::unordered_map<std::string, uint64_t> _pooled;
+    bool _pool_loaded = false;
+
+    void loadUsed();
+    void loadPool();
+    llvm::Constant *getPooledName(llvm::GlobalVariable *pool, uint64_t offset);
+    void poolNames();
+
+public:
+    NondetBuilder(llvm::Module& mod) : M(mod) {}
+
+    llvm::Function *getMakeNondet();
+    llvm::Type *getSizeT();
+
+    // get a new identifier for a call of klee_make_nondet that makes
+    // the object 'name' nondeterministic at the instruction 'at'
+    unsigned getId(const std::string& name,
+                   const llvm::Instruction *at = nullptr);
+
+    // get i8* pointer to the constant string 'name'
+    llvm::Constant *getName(const std::string& name);
+
+    // create (not insert) the call klee_make_nondet(mem, nbytes, name, id)
+    // with a fresh id, mem must be i8*. If 'at' is given, its source
+    // location is a part of the identifier.
+    llvm::CallInst *createCall(llvm::Value *mem, llvm::Value *nbytes,
+                               const std::string& name,
+                               const llvm::Instruction *at = nullptr);
+
+    // pool the names, call this at the end of the pass
+    void finish();
+};
+
+#endif // SBT_NONDET_BUILDER_H_
@@ -0,0 +1,207 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Rewrite the calls of error functions according to the property in one walk
+// over the calls in the module. This does what -replace-asserts,
+// -remove-error-calls and -replace-ubsan do, but classifies every call only
+// once:
+//
+//  - the calls of the functions given by -normalize-error-sites-assert-fn
+//    are replaced with the call of __VERIFIER_error,
+//  - with -normalize-error-sites-remove, the original calls of
+//    __VERIFIER_error and __assert_fail abort the path silently
+//    (__VERIFIER_assume(0) or __VERIFIER_exit(0) with ..-use-exit),
+//  - the UBSan checks are replaced with the call of __VERIFIER_error
+//    or removed (-normalize-error-sites-ubsan).
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/IR/Type.h"
+#include "llvm/Support/CommandLine.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2);
+
+static cl::list<std::string> assertFns("normalize-error-sites-assert-fn",
+        cl::desc("Replace the calls of these functions with __VERIFIER_error"),
+        cl::CommaSeparated);
+
+static cl::opt<bool> removeErrors("normalize-error-sites-remove",
+        cl::desc("Remove the calls of __VERIFIER_error and __assert_fail "
+                 "(abort the path silently instead)"),
+        cl::init(false));
+
+static cl::opt<bool> useExit("normalize-error-sites-use-exit",
+        cl::desc("Insert __VERIFIER_exit(0) instead of __VERIFIER_assume(0) "
+                 "for the removed error calls"),
+        cl::init(false));
+
+enum class UBSanMode { Keep, Replace, Remove, RemoveKeepShifts };
+
+static cl::opt<UBSanMode> ubsanMode("normalize-error-sites-ubsan",
+        cl::desc("What to do with the UBSan checks:"),
+        cl::values(clEnumValN(UBSanMode::Keep, "keep", "Keep them (default)"),
+                   clEnumValN(UBSanMode::Replace, "replace",
+                              "Replace them with __VERIFIER_error"),
+                   clEnumValN(UBSanMode::Remove, "remove", "Remove them"),
+                   clEnumValN(UBSanMode::RemoveKeepShifts, "remove-keep-shifts",
+                              "Remove all but the checks of shifts, "
+                              "replace those with __VERIFIER_error")
+#if LLVM_VERSION_MAJOR < 4
+                   , clEnumValEnd
+#endif
+                  ),
+        cl::init(UBSanMode::Keep));
+
+namespace {
+
+class NormalizeErrorSites : public ModulePass {
+  enum class Action { None, ToError, ToAbort, Remove };
+
+  Function *_error{nullptr};
+  Function *_abort{nullptr};
+
+  Action classify(const Function *callee) const;
+  Function *getError(Module& M);
+  Function *getAbort(Module& M);
+
+public:
+  static char ID;
+
+  NormalizeErrorSites() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<NormalizeErrorSites> NES("normalize-error-sites",
+                                             "Replace and remove the calls of "
+                                             "error functions at once");
+char NormalizeErrorSites::ID;
+
+NormalizeErrorSites::Action
+NormalizeErrorSites::classify(const Function *callee) const {
+  StringRef name = callee->getName();
+
+  if (name.startswith("__ubsan_handle")) {
+    // UBSan handlers that are defined are not checks
+    if (!callee->isDeclaration())
+      return Action::None;
+    switch (ubsanMode) {
+      case UBSanMode::Keep:
+        return Action::None;
+      case UBSanMode::Replace:
+        return Action::ToError;
+      case UBSanMode::Remove:
+        return Action::Remove;
+      case UBSanMode::RemoveKeepShifts:
+        return name.startswith("__ubsan_handle_shift") ? Action::ToError
+                                                       : Action::Remove;
+    }
+  }
+
+  // the asserts are error calls, so they get removed
+  // if we remove the error calls
+  bool isAssert = callee->isDeclaration() &&
+                  std::find(assertFns.begin(), assertFns.end(), name.str())
+                    != assertFns.end();
+  bool isError = name.equals("__VERIFIER_error") ||
+                 name.equals("__assert_fail");
+
+  if (removeErrors && (isError || isAssert))
+    return Action::ToAbort;
+  if (isAssert)
+    return Action::ToError;
+
+  return Action::None;
+}
+
+Function *NormalizeErrorSites::getError(Module& M) {
+  if (!_error) {
+    auto C = insertFunction(M, "__VERIFIER_error",
+                            Type::getVoidTy(M.getContext()),
+                            {});
+    _error = functionOf(C);
+  }
+  return _error;
+}
+
+Function *NormalizeErrorSites::getAbort(Module& M) {
+  if (!_abort) {
+    LLVMContext& Ctx = M.getContext();
+    auto C = insertFunction(M, useExit ? "__VERIFIER_exit" : "__VERIFIER_assume",
+                            Type::getVoidTy(Ctx),
+                            {Type::getInt32Ty(Ctx)});
+    _abort = functionOf(C);
+  }
+  return _abort;
+}
+
+bool NormalizeErrorSites::runOnModule(Module& M) {
+  _error = _abort = nullptr;
+
+  // collect the calls first, the rewriting creates new calls
+  // of __VERIFIER_error that must not be classified again
+  std::vector<std::pair<CallInst *, Action>> sites;
+  for (Function& F : M) {
+    for (BasicBlock& B : F) {
+      for (Instruction& I : B) {
+        auto *CI = dyn_cast<CallInst>(&I);
+        if (!CI || CI->isInlineAsm())
+          continue;
+
+        const Value *val = calleeOf(CI)->stripPointerCasts();
+        const Function *callee = dyn_cast<Function>(val);
+        if (!callee || callee->isIntrinsic() || !callee->hasName())
+          continue;
+
+        Action act = classify(callee);
+        if (act != Action::None)
+          sites.emplace_back(CI, act);
+      }
+    }
+  }
+
+  for (auto& site : sites) {
+    CallInst *CI = site.first;
+    CallInst *CI2 = nullptr;
+    switch (site.second) {
+      case Action::ToError:
+        CI2 = CallInst::Create(getError(M));
+        break;
+      case Action::ToAbort: {
+        // this just aborts the path (if normal exit would be inserted,
+        // the tools would check leaks -- this is just a silent exit)
+        Type *argTy = Type::getInt32Ty(M.getContext());
+        CI2 = CallInst::Create(getAbort(M), {ConstantInt::get(argTy, 0)});
+        break;
+      }
+      case Action::Remove:
+      case Action::None:
+        break;
+    }
+
+    if (CI2) {
+      CloneMetadata(CI, CI2);
+      CI2->insertAfter(CI);
+    }
+    if (!CI->use_empty())
+      CI->replaceAllUsesWith(UndefValue::get(CI->getType()));
+    CI->eraseFromParent();
+  }
+
+  return !sites.empty();
+}
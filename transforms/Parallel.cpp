@@ -0,0 +1,21 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#include "llvm/Support/CommandLine.h"
+
+#include "Parallel.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned> sbt_threads("sbt-threads",
+        cl::desc("The number of threads for the per-function analyses "
+                 "of our passes (default 1)"),
+        cl::init(1));
+
+unsigned getSbtThreads() {
+    if (sbt_threads == 0)
+        return std::thread::hardware_concurrency();
+    return sbt_threads;
+}
@@ -0,0 +1,49 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#ifndef SBT_PARALLEL_H_
+#define SBT_PARALLEL_H_
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// the value of -sbt-threads (defined in Parallel.cpp)
+unsigned getSbtThreads();
+
+// Call fn(i) for every i in [0, n) using -sbt-threads threads.
+//
+// LLVM IR is not thread-safe (creating instructions or constants changes
+// use lists and the context), so fn must only read the IR. The passes use
+// this to run their per-function analysis in parallel and do the changes
+// of the module serially afterwards.
+template <typename Fn>
+void parallelFor(size_t n, Fn fn) {
+    unsigned threads = getSbtThreads();
+    if (threads <= 1 || n <= 1) {
+        for (size_t i = 0; i < n; ++i)
+            fn(i);
+        return;
+    }
+
+    if (threads > n)
+        threads = n;
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < n)
+            fn(i);
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+        pool.emplace_back(worker);
+    worker();
+    for (auto& thr : pool)
+        thr.join();
+}
+
+#endif // SBT_PARALLEL_H_
@@ -0,0 +1,960 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// sbt-pipeline: load a module once and run a sequence of stages (lists of
+// passes) on it in memory. The command line mirrors 'opt -load LLVMsbt.so':
+//
+//   sbt-pipeline in.bc -o out.bc -stage=prepare -remove-error-calls
+//                -remove-infinite-loops -stage=opt -O3 -checkpoint=prepare
+//
+// Every argument that names a registered pass (or -O0..-O3) is added to the
+// current stage, everything else is handed over to the LLVM command-line
+// parser (so that options of our passes keep working). The options that
+// follow a stage (or a pass) apply only to that stage: before every stage,
+// all options are reset and the options of the stage are parsed again
+// together with the options of the driver (-o, -checkpoint, ...) and those
+// given before the first stage, which apply to all stages. So one pass may
+// run in two stages with different options. Stages can be also
+// given in a file (-stage-file), one stage per line in the form
+// 'name: -pass1 -pass2 ...'. The module is written only at the end and
+// after the stages that were given to -checkpoint.
+//
+// A stage can also link in a library of models (-link-needed=lib.bc) before
+// running its passes. The library is loaded lazily and only the functions
+// that the module needs (transitively) are materialized and linked.
+// -link=file.bc links the whole file (as llvm-link does), so that linking
+// does not need to write the module and load it in another process.
+// -link-only=fun[,fun...] restricts -link-needed of the stage to the given
+// undefined functions (and to what their definitions need).
+//
+// -run-if=kind[,kind...] makes the stage conditional: it runs only if the
+// module has loops of one of the given kinds (loops, nonterm-loops,
+// nested-loops, irreducible-loops) when the stage starts. This way we skip
+// the stages that cannot change the module (and their -reg2mem).
+//
+// -tool-stage=lib.so runs a tool (sbt-instr, sbt-slicer) from the library
+// on the module in memory before the passes of the stage (see ToolStage.h)
+// and -tool-arg=arg appends an argument for the last tool of the stage.
+//
+// -stats=label prints statistics about the module (as -count-instr does)
+// after the passes of the stage, without the need to load the module
+// in another process.
+//
+// With -pass-report=file.json, every pass runs separately and its wall time,
+// the number of instructions it visited (the size of the module), the number
+// of instructions it added and removed and the change of the peak RSS are
+// written into the given file.
+//
+// -max-growth=F makes the stage roll back (to the module before the stage)
+// if it multiplies the number of instructions by more than F, and
+// -max-bitcode-size=N if the bitcode of the module after the stage takes
+// more than N bytes. The stage is then skipped with a message 'sbt-pipeline:
+// stage 'name' over its budget ..., rolled back'. With -max-growth-fail,
+// the stage that is over its budget is not rolled back (e.g., the module
+// is useless without it), sbt-pipeline exits with 4 instead.
+//
+// When an allocation fails (e.g., the process runs with a limited address
+// space), sbt-pipeline prints 'sbt-pipeline: out of memory in stage N
+// 'name'' (N is the index of the stage from 0) and exits with 3, so that
+// the caller can run the stages again without the offending one.
+// -memory-report prints the peak memory after every stage.
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <memory>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "llvm/ADT/Triple.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Pass.h"
+#include "llvm/PassRegistry.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#if LLVM_VERSION_MAJOR >= 4
+#include "llvm/Bitcode/BitcodeWriter.h"
+#else
+#include "llvm/Bitcode/ReaderWriter.h"
+#endif
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/IPO.h"
+#if LLVM_VERSION_MAJOR >= 4
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#endif
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include "LoopSummary.h"
+#include "ToolStage.h"
+
+using namespace llvm;
+
+// defined in CountInstr.cpp
+void print_statistics(llvm::Module *M, const char *prefix);
+uint64_t count_instructions(const llvm::Module *M);
+
+static cl::opt<std::string> InputFilename(cl::Positional,
+                                          cl::desc("<input bitcode>"),
+                                          cl::init("-"));
+
+static cl::opt<std::string> OutputFilename("o",
+                                           cl::desc("Output filename"),
+                                           cl::value_desc("filename"),
+                                           cl::init("-"));
+
+static cl::list<std::string> Checkpoints("checkpoint",
+                cl::desc("Write the module also after the given stage "
+                         "(into <output>-<stage>.bc)"),
+                cl::value_desc("stage"));
+
+static cl::opt<bool> VerifyEach("verify-each",
+                cl::desc("Verify the module after each stage"),
+                cl::init(false));
+
+static cl::opt<bool> DisableVerify("disable-verify",
+                cl::desc("Do not verify the resulting module"),
+                cl::init(false));
+
+static cl::opt<std::string> PassReport("pass-report",
+                cl::desc("Run passes one by one and write their time, "
+                         "changes of the code and memory into a JSON file"),
+                cl::value_desc("filename"));
+
+static cl::opt<bool> MemoryReport("memory-report",
+                cl::desc("Print the peak memory after every stage"),
+                cl::init(false));
+
+// the exit code when we run out of memory
+static const int EXIT_OUT_OF_MEMORY = 3;
+// the exit code when a stage with -max-growth-fail is over its budget
+static const int EXIT_OVER_BUDGET = 4;
+
+namespace {
+
+struct PassRecord {
+    std::string stage;
+    std::string pass;
+    double time; // seconds
+    uint64_t visited;
+    uint64_t added;
+    uint64_t removed;
+    long rss_delta; // kB
+
+    PassRecord(const std::string& s, const std::string& p)
+    : stage(s), pass(p), time(0), visited(0), added(0), removed(0),
+      rss_delta(0) {}
+};
+
+static std::vector<PassRecord> records;
+
+struct Stage {
+    std::string name;
+    // names of passes, -O<n> is stored as "O<n>"
+    std::vector<std::string> passes;
+    // files that we link (the bool is true if we link
+    // only the needed functions from the file)
+    std::vector<std::pair<std::string, bool>> libs;
+    // link only these undefined functions from the libraries (-link-only)
+    std::vector<std::string> link_only;
+    // print statistics with these labels after the stage
+    std::vector<std::string> stats;
+    // run the stage only if the module has some of these kinds of loops
+    std::vector<std::string> run_if;
+    // the libraries of the tools that run on the module (-tool-stage)
+    // and their arguments (-tool-arg)
+    std::vector<std::pair<std::string, std::vector<std::string>>> tools;
+    // the budget of the growth of the module (0 = no budget):
+    // the factor of the number of instructions, the size of the bitcode
+    double max_growth{0};
+    uint64_t max_bitcode_size{0};
+    // fail instead of rolling back the stage that is over the budget
+    bool growth_fail{false};
+    // the options that apply only to this stage
+    std::vector<std::string> options;
+
+    Stage(const std::string& n) : name(n) {}
+
+    bool hasBudget() const { return max_growth > 0 || max_bitcode_size > 0; }
+};
+
+static bool isOptLevel(const std::string& arg) {
+    return arg.size() == 2 && arg[0] == 'O' && arg[1] >= '0' && arg[1] <= '3';
+}
+
+static std::string stripDashes(const std::string& arg) {
+    size_t n = 0;
+    while (n < arg.size() && n < 2 && arg[n] == '-')
+        ++n;
+    return arg.substr(n);
+}
+
+static bool isPassName(const std::string& name) {
+    if (name.find('=') != std::string::npos)
+        return false;
+
+    return isOptLevel(name) ||
+           PassRegistry::getPassRegistry()->getPassInfo(name) != nullptr;
+}
+
+#if LLVM_VERSION_MAJOR >= 4
+// the registered option named by the argument (-name or -name=value)
+static cl::Option *findOption(const std::string& arg) {
+    std::string name = stripDashes(arg);
+    name = name.substr(0, name.find('='));
+    auto& opts = cl::getRegisteredOptions();
+    auto it = opts.find(name);
+    return it == opts.end() ? nullptr : it->second;
+}
+
+// the options of the driver apply to all stages
+static bool isDriverOption(const cl::Option *O) {
+    return O == &OutputFilename || O == std::addressof(Checkpoints) ||
+           O == &VerifyEach || O == &DisableVerify || O == &PassReport ||
+           O == &MemoryReport;
+}
+#endif
+
+// parse the options that apply to all stages and those of the stage
+static void parseOptions(const std::vector<const char *>& global,
+                         const std::vector<std::string>& options) {
+    std::vector<const char *> clargs(global);
+    for (const std::string& opt : options)
+        clargs.push_back(opt.c_str());
+    cl::ParseCommandLineOptions(clargs.size(), clargs.data(),
+                                "symbiotic in-memory pass pipeline\n");
+}
+
+// read stages from a file with lines 'name: -pass1 -pass2 ...',
+// the arguments are appended to args so that they are processed
+// in the same way as the arguments from the command line
+static bool readStageFile(const std::string& path,
+                          std::vector<std::string>& args) {
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        errs() << "Failed opening stage file " << path << "\n";
+        return false;
+    }
+
+    std::string line;
+    unsigned lineno = 0;
+    while (std::getline(in, line)) {
+        ++lineno;
+        auto comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+
+        auto colon = line.find(':');
+        if (colon == std::string::npos) {
+            if (line.find_first_not_of(" \t\r") != std::string::npos) {
+                errs() << path << ":" << lineno
+                       << ": expected 'name: passes...'\n";
+                return false;
+            }
+            continue;
+        }
+
+        std::istringstream name(line.substr(0, colon));
+        std::string stagename;
+        name >> stagename;
+        args.push_back("-stage=" + stagename);
+
+        std::istringstream passes(line.substr(colon + 1));
+        std::string tok;
+        while (passes >> tok)
+            args.push_back(tok);
+    }
+
+    return true;
+}
+
+static void addOptLevel(legacy::PassManagerBase& MPM,
+                        legacy::FunctionPassManager& FPM,
+                        unsigned level) {
+    PassManagerBuilder Builder;
+    Builder.OptLevel = level;
+    if (level > 1)
+        Builder.Inliner = createFunctionInliningPass(level, 0, false);
+    else
+#if LLVM_VERSION_MAJOR >= 4
+        Builder.Inliner = createAlwaysInlinerLegacyPass();
+#else
+        Builder.Inliner = createAlwaysInlinerPass();
+#endif
+
+    Builder.populateFunctionPassManager(FPM);
+    Builder.populateModulePassManager(MPM);
+}
+
+static bool writeModule(Module& M, const std::string& path) {
+    std::error_code EC;
+#if LLVM_VERSION_MAJOR >= 6
+    auto Out = std::unique_ptr<ToolOutputFile>(
+                    new ToolOutputFile(path, EC, sys::fs::OF_None));
+#else
+    auto Out = std::unique_ptr<tool_output_file>(
+                    new tool_output_file(path, EC, sys::fs::F_None));
+#endif
+    if (EC) {
+        errs() << "Failed opening " << path << ": " << EC.message() << "\n";
+        return false;
+    }
+
+#if LLVM_VERSION_MAJOR >= 7
+    WriteBitcodeToFile(M, Out->os());
+#else
+    WriteBitcodeToFile(&M, Out->os());
+#endif
+    Out->keep();
+    return true;
+}
+
+// counts the bytes of the bitcode without storing them
+class CountingStream : public raw_ostream {
+    uint64_t count{0};
+
+    void write_impl(const char * /*ptr*/, size_t size) override {
+        count += size;
+    }
+    uint64_t current_pos() const override { return count; }
+
+public:
+    CountingStream() { SetUnbuffered(); }
+};
+
+static uint64_t bitcodeSize(Module& M) {
+    CountingStream out;
+#if LLVM_VERSION_MAJOR >= 7
+    WriteBitcodeToFile(M, out);
+#else
+    WriteBitcodeToFile(&M, out);
+#endif
+    return out.tell();
+}
+
+// is the module after the stage within the budget of the stage,
+// 'before' is the number of instructions before the stage
+static bool withinBudget(Module& M, const Stage& stage, uint64_t before) {
+    uint64_t after = count_instructions(&M);
+    if (stage.max_growth > 0 && before > 0 &&
+        after > stage.max_growth * before) {
+        errs() << "sbt-pipeline: stage '" << stage.name << "' over its budget, "
+               << "it grew the module from " << before << " to " << after
+               << " instructions (max " << format("%g", stage.max_growth) << "x)";
+        return false;
+    }
+    if (stage.max_bitcode_size > 0) {
+        uint64_t size = bitcodeSize(M);
+        if (size > stage.max_bitcode_size) {
+            errs() << "sbt-pipeline: stage '" << stage.name
+                   << "' over its budget, the bitcode takes " << size
+                   << " bytes (max " << stage.max_bitcode_size << ")";
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string checkpointName(const std::string& stage) {
+    std::string base = OutputFilename;
+    if (base == "-")
+        base = "pipeline";
+    auto dot = base.rfind('.');
+    if (dot != std::string::npos && base.find('/', dot) == std::string::npos)
+        base.erase(dot);
+    return base + "-" + stage + ".bc";
+}
+
+static bool linkAll(Module& M, const std::string& path) {
+    SMDiagnostic Err;
+    std::unique_ptr<Module> Lib = parseIRFile(path, Err, M.getContext());
+    if (!Lib) {
+        Err.print("sbt-pipeline", errs());
+        return false;
+    }
+
+    if (Linker::linkModules(M, std::move(Lib))) {
+        errs() << "Failed linking " << path << "\n";
+        return false;
+    }
+
+    return true;
+}
+
+static bool linkNeeded(Module& M, const std::string& path,
+                       const std::vector<std::string>& only) {
+    SMDiagnostic Err;
+    std::unique_ptr<Module> Lib = getLazyIRFileModule(path, Err, M.getContext());
+    if (!Lib) {
+        Err.print("sbt-pipeline", errs());
+        return false;
+    }
+
+    // the linker replaces the declarations, so remember just the names
+    std::vector<std::string> undefined;
+    // the declarations that we do not want to link are hidden
+    // under another name during linking
+    std::vector<std::pair<Function *, std::string>> hidden;
+    std::unordered_set<std::string> wanted(only.begin(), only.end());
+    for (Function& F : M) {
+        if (!F.isDeclaration() || F.isIntrinsic())
+            continue;
+
+        if (wanted.empty() || wanted.count(F.getName().str()) > 0) {
+            undefined.push_back(F.getName().str());
+        } else {
+            hidden.emplace_back(&F, F.getName().str());
+        }
+    }
+    for (auto& it : hidden)
+        it.first->setName("__sbt_hidden." + it.second);
+
+    bool failed = Linker::linkModules(M, std::move(Lib),
+                                      Linker::Flags::LinkOnlyNeeded);
+
+    // the linked functions may have brought new declarations or even the
+    // definitions (that they need) of the hidden functions, merge them
+    for (auto& it : hidden) {
+        Function *F = it.first;
+        Function *G = M.getFunction(it.second);
+        if (!G) {
+            F->setName(it.second);
+            continue;
+        }
+
+        if (G->isDeclaration()) {
+            G->replaceAllUsesWith(ConstantExpr::getBitCast(F, G->getType()));
+            G->eraseFromParent();
+            F->setName(it.second);
+        } else {
+            F->replaceAllUsesWith(ConstantExpr::getBitCast(G, F->getType()));
+            F->eraseFromParent();
+            undefined.push_back(it.second);
+        }
+    }
+
+    if (failed) {
+        errs() << "Failed linking " << path << "\n";
+        return false;
+    }
+
+    for (const std::string& name : undefined) {
+        Function *F = M.getFunction(name);
+        if (F && !F->isDeclaration())
+            errs() << "Linked our definition of '" << name << "'\n";
+    }
+
+    return true;
+}
+
+static bool runTool(Module& M, const std::string& lib,
+                    const std::vector<std::string>& args) {
+    std::string err;
+    auto DL = sys::DynamicLibrary::getPermanentLibrary(lib.c_str(), &err);
+    if (!DL.isValid()) {
+        errs() << "Failed loading " << lib << ": " << err << "\n";
+        return false;
+    }
+    auto run = reinterpret_cast<SbtToolStageFn>(
+        DL.getAddressOfSymbol(SBT_TOOL_STAGE_SYMBOL));
+    if (!run) {
+        errs() << lib << " does not export " << SBT_TOOL_STAGE_SYMBOL << "\n";
+        return false;
+    }
+
+    std::vector<const char *> argv = { lib.c_str() };
+    for (const std::string& arg : args)
+        argv.push_back(arg.c_str());
+    argv.push_back(nullptr);
+    if (run(&M, argv.size() - 1, argv.data()) != 0) {
+        errs() << "The tool from " << lib << " failed\n";
+        return false;
+    }
+    return true;
+}
+
+static bool runPasses(Module& M, const std::vector<std::string>& passes) {
+    legacy::PassManager MPM;
+    legacy::FunctionPassManager FPM(&M);
+    bool hasFPM = false;
+
+    TargetLibraryInfoImpl TLII(Triple(M.getTargetTriple()));
+    MPM.add(new TargetLibraryInfoWrapperPass(TLII));
+
+    PassRegistry *Registry = PassRegistry::getPassRegistry();
+    for (const std::string& name : passes) {
+        if (isOptLevel(name)) {
+            addOptLevel(MPM, FPM, name[1] - '0');
+            hasFPM = true;
+            continue;
+        }
+
+        const PassInfo *PI = Registry->getPassInfo(name);
+        assert(PI && "Unknown pass");
+        if (!PI->getNormalCtor()) {
+            errs() << "Cannot create pass: " << name << "\n";
+            return false;
+        }
+        MPM.add(PI->createPass());
+    }
+
+    if (VerifyEach)
+        MPM.add(createVerifierPass());
+
+    // like opt, run the function simplification passes of -O<n> first
+    if (hasFPM) {
+        FPM.doInitialization();
+        for (Function& F : M)
+            FPM.run(F);
+        FPM.doFinalization();
+    }
+
+    MPM.run(M);
+    return true;
+}
+
+static long getPeakRSS() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss;
+}
+
+// the message about running out of memory, prepared when a stage starts
+// (we cannot allocate anything when the memory is gone)
+static char oom_message[256] = "sbt-pipeline: out of memory\n";
+
+static void setOutOfMemoryStage(unsigned idx, const std::string& name) {
+    snprintf(oom_message, sizeof(oom_message),
+             "sbt-pipeline: out of memory in stage %u '%s'\n",
+             idx, name.c_str());
+}
+
+static void outOfMemory() {
+    ssize_t ret = write(STDERR_FILENO, oom_message, strlen(oom_message));
+    (void)ret;
+    _exit(EXIT_OUT_OF_MEMORY);
+}
+
+#if LLVM_VERSION_MAJOR >= 5
+#if LLVM_VERSION_MAJOR >= 14
+static void badAlloc(void *, const char *, bool) {
+#else
+static void badAlloc(void *, const std::string&, bool) {
+#endif
+    outOfMemory();
+}
+#endif
+
+static void getInstructions(Module& M,
+                            std::unordered_set<const Instruction *>& insts) {
+    insts.clear();
+    for (const Function& F : M)
+        for (const BasicBlock& B : F)
+            for (const Instruction& I : B)
+                insts.insert(&I);
+}
+
+static bool runReported(Module& M, const Stage& stage, const std::string& pass) {
+    records.emplace_back(stage.name, pass);
+    PassRecord& rec = records.back();
+
+    std::unordered_set<const Instruction *> before, after;
+    getInstructions(M, before);
+    rec.visited = before.size();
+
+    long rss = getPeakRSS();
+    auto start = std::chrono::steady_clock::now();
+
+    if (!runPasses(M, {pass}))
+        return false;
+
+    std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start;
+    rec.time = elapsed.count();
+    rec.rss_delta = getPeakRSS() - rss;
+
+    // NOTE: a new instruction may get the address of a removed one,
+    // so the numbers may be slightly lower than the real ones
+    getInstructions(M, after);
+    for (const Instruction *I : after)
+        if (before.count(I) == 0)
+            ++rec.added;
+    for (const Instruction *I : before)
+        if (after.count(I) == 0)
+            ++rec.removed;
+
+    return true;
+}
+
+static void writeJSONString(raw_ostream& out, const std::string& str) {
+    out << '"';
+    for (char c : str) {
+        if (c == '"' || c == '\\')
+            out << '\\';
+        out << c;
+    }
+    out << '"';
+}
+
+static bool writePassReport(const std::string& path) {
+    std::error_code EC;
+#if LLVM_VERSION_MAJOR >= 9
+    raw_fd_ostream out(path, EC, sys::fs::OF_Text);
+#else
+    raw_fd_ostream out(path, EC, sys::fs::F_Text);
+#endif
+    if (EC) {
+        errs() << "Failed opening " << path << ": " << EC.message() << "\n";
+        return false;
+    }
+
+    out << "[\n";
+    for (size_t i = 0; i < records.size(); ++i) {
+        const PassRecord& rec = records[i];
+        out << "  {\"stage\": ";
+        writeJSONString(out, rec.stage);
+        out << ", \"pass\": ";
+        writeJSONString(out, rec.pass);
+        out << ", \"time\": " << format("%.6f", rec.time)
+            << ", \"visited\": " << rec.visited
+            << ", \"added\": " << rec.added
+            << ", \"removed\": " << rec.removed
+            << ", \"rss_delta_kb\": " << rec.rss_delta << "}"
+            << (i + 1 < records.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+
+    return true;
+}
+
+// the summary of loops of the module, computed only when some stage
+// needs it and dropped when a stage changes the module
+static std::unique_ptr<LoopSummary> loop_summary;
+
+static bool shouldRun(Module& M, const Stage& stage) {
+    if (stage.run_if.empty())
+        return true;
+
+    if (!loop_summary)
+        loop_summary.reset(new LoopSummary(LoopSummary::compute(M)));
+
+    for (const std::string& kind : stage.run_if) {
+        bool known;
+        bool has = loop_summary->has(kind, known);
+        if (!known) {
+            errs() << "Unknown kind of loops in -run-if: " << kind << "\n";
+            // run the stage, it is only slower
+            return true;
+        }
+        if (has)
+            return true;
+    }
+
+    return false;
+}
+
+static bool runStage(Module& M, const Stage& stage) {
+    if (!shouldRun(M, stage)) {
+        errs() << "Skipping stage '" << stage.name << "', "
+               << "the module does not have the loops it needs\n";
+        // print the statistics anyway
+        for (const std::string& label : stage.stats) {
+            std::string prefix = "INFO: " + label + "stats: ";
+            print_statistics(&M, prefix.c_str());
+        }
+        return true;
+    }
+
+    if (!stage.libs.empty() || !stage.passes.empty() || !stage.tools.empty())
+        loop_summary.reset();
+
+    for (const auto& lib : stage.libs) {
+        if (!(lib.second ? linkNeeded(M, lib.first, stage.link_only)
+                         : linkAll(M, lib.first)))
+            return false;
+    }
+
+    for (const auto& tool : stage.tools) {
+        if (!runTool(M, tool.first, tool.second))
+            return false;
+    }
+
+    if (PassReport.empty()) {
+        if (!runPasses(M, stage.passes))
+            return false;
+    } else {
+        for (const std::string& pass : stage.passes) {
+            if (!runReported(M, stage, pass))
+                return false;
+        }
+    }
+
+    for (const std::string& label : stage.stats) {
+        std::string prefix = "INFO: " + label + "stats: ";
+        print_statistics(&M, prefix.c_str());
+    }
+
+    if (MemoryReport)
+        errs() << "Stage '" << stage.name << "': peak memory "
+               << getPeakRSS() / 1024 << " MB\n";
+
+    return true;
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[]) {
+    llvm_shutdown_obj Y;
+
+    PassRegistry& Registry = *PassRegistry::getPassRegistry();
+    initializeCore(Registry);
+    initializeScalarOpts(Registry);
+    initializeIPO(Registry);
+    initializeAnalysis(Registry);
+    initializeTransformUtils(Registry);
+    initializeInstCombine(Registry);
+#if LLVM_VERSION_MAJOR >= 7
+    initializeAggressiveInstCombine(Registry);
+#endif
+    initializeInstrumentation(Registry);
+    initializeVectorization(Registry);
+    initializeTarget(Registry);
+
+    // expand stage files first
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 12, "-stage-file=") == 0) {
+            if (!readStageFile(arg.substr(12), args))
+                return 1;
+        } else if (arg == "-stage-file" && i + 1 < argc) {
+            if (!readStageFile(argv[++i], args))
+                return 1;
+        } else {
+            args.push_back(arg);
+        }
+    }
+
+    // split passes into stages and hand the rest over to cl::
+    std::vector<Stage> stages;
+    std::vector<const char *> clargs = { argv[0] };
+    // the next argument is the value of the last option (-name value),
+    // it goes where the option went
+    bool valueNext = false, valueGlobal = false;
+    for (const std::string& arg : args) {
+        if (valueNext) {
+            valueNext = false;
+            if (valueGlobal)
+                clargs.push_back(arg.c_str());
+            else
+                stages.back().options.push_back(arg);
+            continue;
+        }
+
+        if (arg.compare(0, 7, "-stage=") == 0) {
+            stages.emplace_back(arg.substr(7));
+            continue;
+        }
+
+        if (arg.compare(0, 13, "-link-needed=") == 0) {
+            if (stages.empty())
+                stages.emplace_back("default");
+            stages.back().libs.emplace_back(arg.substr(13), true);
+            continue;
+        }
+
+        if (arg.compare(0, 11, "-link-only=") == 0) {
+            if (stages.empty())
+                stages.emplace_back("default");
+            std::istringstream funs(arg.substr(11));
+            std::string fun;
+            while (std::getline(funs, fun, ','))
+                stages.back().link_only.push_back(fun);
+            continue;
+        }
+
+        if (arg.compare(0, 6, "-link=") == 0) {
+            if (stages.empty())
+                stages.emplace_back("default");
+            stages.back().libs.emplace_back(arg.substr(6), false);
+            continue;
+        }
+
+        if (arg.compare(0, 8, "-run-if=") == 0) {
+            if (stages.empty())
+                stages.emplace_back("default");
+            std::istringstream kinds(arg.substr(8));
+            std::string kind;
+            while (std::getline(kinds, kind, ','))
+                stages.back().run_if.push_back(kind);
+            continue;
+        }
+
+        if (arg.compare(0, 12, "-tool-stage=") == 0) {
+            if (stages.empty())
+                stages.emplace_back("default");
+            stages.back().tools.emplace_back(arg.substr(12),
+                                             std::vector<std::string>());
+            continue;
+        }
+
+        if (arg.compare(0, 10, "-tool-arg=") == 0) {
+            if (stages.empty() || stages.back().tools.empty()) {
+                errs() << "-tool-arg without -tool-stage\n";
+                return 1;
+            }
+            stages.back().tools.back().second.push_back(arg.substr(10));
+            continue;
+        }
+
+        bool growth = arg.compare(0, 12, "-max-growth=") == 0;
+        if (growth || arg.compare(0, 18, "-max-bitcode-size=") == 0) {
+            if (stages.empty())
+                stages.emplace_back("default");
+            std::string value = arg.substr(arg.find('=') + 1);
+            char *end = nullptr;
+            if (growth)
+                stages.back().max_growth = std::strtod(value.c_str(), &end);
+            else
+                stages.back().max_bitcode_size =
+                        std::strtoull(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0') {
+                errs() << "Invalid budget: " << arg << "\n";
+                return 1;
+            }
+            continue;
+        }
+
+        if (arg == "-max-growth-fail") {
+            if (stages.empty())
+                stages.emplace_back("default");
+            stages.back().growth_fail = true;
+            continue;
+        }
+
+        if (arg.compare(0, 7, "-stats=") == 0) {
+            if (stages.empty())
+                stages.emplace_back("default");
+            stages.back().stats.push_back(arg.substr(7));
+            continue;
+        }
+
+        if (arg.size() > 1 && arg[0] == '-') {
+            std::string name = stripDashes(arg);
+            if (isPassName(name)) {
+                if (stages.empty())
+                    stages.emplace_back("default");
+                stages.back().passes.push_back(name);
+                continue;
+            }
+        }
+
+#if LLVM_VERSION_MAJOR >= 4
+        // the options before the first stage, the options of the driver
+        // and the positional arguments apply to all stages
+        cl::Option *O = findOption(arg);
+        bool global = stages.empty() || arg.size() < 2 || arg[0] != '-' ||
+                      (O && isDriverOption(O));
+        valueNext = O && arg.find('=') == std::string::npos &&
+                    O->getValueExpectedFlag() == cl::ValueRequired;
+        valueGlobal = global;
+        if (!global) {
+            stages.back().options.push_back(arg);
+            continue;
+        }
+#endif
+        clargs.push_back(arg.c_str());
+    }
+
+    parseOptions(clargs, {});
+
+    std::set_new_handler(outOfMemory);
+#if LLVM_VERSION_MAJOR >= 5
+    install_bad_alloc_error_handler(badAlloc);
+#endif
+
+    LLVMContext Context;
+    SMDiagnostic Err;
+    std::unique_ptr<Module> M = parseIRFile(InputFilename, Err, Context);
+    if (!M) {
+        Err.print(argv[0], errs());
+        return 1;
+    }
+
+    for (unsigned idx = 0; idx < stages.size(); ++idx) {
+        const Stage& stage = stages[idx];
+        setOutOfMemoryStage(idx, stage.name);
+
+#if LLVM_VERSION_MAJOR >= 4
+        // the options of the previous stage do not apply to this one
+        cl::ResetAllOptionOccurrences();
+        parseOptions(clargs, stage.options);
+#endif
+
+        // keep the module before the stage to roll back to
+        uint64_t before = 0;
+        std::unique_ptr<Module> backup;
+        if (stage.hasBudget()) {
+            before = count_instructions(M.get());
+            if (!stage.growth_fail)
+#if LLVM_VERSION_MAJOR >= 7
+                backup = CloneModule(*M);
+#else
+                backup = CloneModule(M.get());
+#endif
+        }
+
+        if (!runStage(*M, stage))
+            return 1;
+
+        if (stage.hasBudget() && !withinBudget(*M, stage, before)) {
+            if (!backup) {
+                errs() << "\n";
+                return EXIT_OVER_BUDGET;
+            }
+            errs() << ", rolled back\n";
+            M = std::move(backup);
+            loop_summary.reset();
+        }
+
+        for (const std::string& chk : Checkpoints) {
+            if (chk == stage.name && !writeModule(*M, checkpointName(chk)))
+                return 1;
+        }
+    }
+
+    if (!DisableVerify && verifyModule(*M, &errs())) {
+        errs() << "The module is broken after running the pipeline\n";
+        return 1;
+    }
+
+    if (!PassReport.empty() && !writePassReport(PassReport))
+        return 1;
+
+    return writeModule(*M, OutputFilename) ? 0 : 1;
+}
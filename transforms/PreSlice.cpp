@@ -0,0 +1,165 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// A cheap slicing before the slicer: remove the calls of functions
+// without side effects whose results are not used. A function has no side
+// effects if it writes only into its own local variables and calls only
+// functions without side effects and the intrinsics that do not access
+// memory. The calls of declarations (including the instrumentation),
+// the indirect calls and the calls of the slicing criteria are side
+// effects. The removed calls may not terminate, so this is not usable
+// for checking termination (as the slicer without -cd-alg=ntscd).
+//
+// The functions and globals that are not used anymore are removed
+// by -prune-unreachable that runs after this pass.
+
+#include <vector>
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#if LLVM_VERSION_MAJOR >= 12
+  #include "llvm/Analysis/ValueTracking.h"
+#endif
+
+using namespace llvm;
+
+static cl::list<std::string> Criteria("pre-slice-criteria",
+        cl::desc("The slicing criteria (the names of functions)"),
+        cl::CommaSeparated);
+
+namespace {
+
+class PreSlice : public ModulePass {
+  StringSet<> _criteria;
+  // the defined functions that may have side effects
+  SmallPtrSet<const Function *, 32> _impure;
+
+  bool isPureCall(const CallInst *CI) const;
+  bool isPure(const Function& F) const;
+  void computeImpure(Module& M);
+
+public:
+  static char ID;
+
+  PreSlice() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<PreSlice> PS("pre-slice",
+                                 "Remove the unused calls of functions "
+                                 "without side effects");
+char PreSlice::ID;
+
+static bool isLocal(const Value *Ptr, const Function& F) {
+#if LLVM_VERSION_MAJOR >= 12
+  auto *AI = dyn_cast<AllocaInst>(getUnderlyingObject(Ptr));
+#else
+  auto *AI = dyn_cast<AllocaInst>(GetUnderlyingObject(
+                   Ptr, F.getParent()->getDataLayout()));
+#endif
+  return AI && AI->getFunction() == &F;
+}
+
+bool PreSlice::isPureCall(const CallInst *CI) const {
+  if (CI->isInlineAsm())
+    return false;
+
+  if (isa<DbgInfoIntrinsic>(CI))
+    return true;
+
+  const Function *F = CI->getCalledFunction();
+  if (!F || _criteria.count(F->getName()) > 0)
+    return false;
+
+  if (F->isIntrinsic())
+    return F->doesNotAccessMemory() ||
+           F->getIntrinsicID() == Intrinsic::lifetime_start ||
+           F->getIntrinsicID() == Intrinsic::lifetime_end;
+
+  return !F->isDeclaration() && _impure.count(F) == 0;
+}
+
+bool PreSlice::isPure(const Function& F) const {
+  // main is called by the environment and the variadic functions
+  // may be called with arguments that are not local
+  if (F.getName() == "main" || F.isVarArg())
+    return false;
+
+  for (const BasicBlock& B : F) {
+    for (const Instruction& I : B) {
+      if (auto *SI = dyn_cast<StoreInst>(&I)) {
+        if (!SI->isSimple() || !isLocal(SI->getPointerOperand(), F))
+          return false;
+      } else if (auto *LI = dyn_cast<LoadInst>(&I)) {
+        if (!LI->isSimple())
+          return false;
+      } else if (auto *MI = dyn_cast<MemIntrinsic>(&I)) {
+        if (MI->isVolatile() || !isLocal(MI->getRawDest(), F))
+          return false;
+      } else if (auto *CI = dyn_cast<CallInst>(&I)) {
+        if (!isPureCall(CI))
+          return false;
+      } else if (I.mayWriteToMemory() || I.isEHPad() ||
+                 isa<InvokeInst>(&I)) {
+        // atomics, fences, exceptions
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void PreSlice::computeImpure(Module& M) {
+  // start with all functions pure and remove the ones that are not,
+  // so that recursive functions can be pure too
+  bool changed;
+  do {
+    changed = false;
+    for (const Function& F : M) {
+      if (F.isDeclaration() || _impure.count(&F) || isPure(F))
+        continue;
+      _impure.insert(&F);
+      changed = true;
+    }
+  } while (changed);
+}
+
+bool PreSlice::runOnModule(Module& M) {
+  for (const std::string& name : Criteria)
+    _criteria.insert(name);
+
+  computeImpure(M);
+
+  std::vector<CallInst *> calls;
+  for (Function& F : M) {
+    for (BasicBlock& B : F) {
+      for (Instruction& I : B) {
+        auto *CI = dyn_cast<CallInst>(&I);
+        if (!CI || !CI->use_empty() || isa<IntrinsicInst>(CI))
+          continue;
+        const Function *callee = CI->getCalledFunction();
+        if (callee && !callee->isDeclaration() && isPureCall(CI))
+          calls.push_back(CI);
+      }
+    }
+  }
+
+  for (CallInst *CI : calls)
+    CI->eraseFromParent();
+
+  errs() << "Removed " << calls.size()
+         << " unused calls of functions without side effects\n";
+  return !calls.empty();
+}
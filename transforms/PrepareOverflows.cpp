@@ -1,15 +1,13 @@
 #include "llvm/Pass.h"
+#include "llvm/ADT/StringSwitch.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Function.h"
 #include "llvm/Support/raw_ostream.h"
-#include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
-#include <set>
 #include <vector>
-#include <map>
 
 using namespace llvm;
 
@@ -20,108 +18,100 @@ struct PrepareOverflows : public FunctionPass {
   static char ID;
   PrepareOverflows() : FunctionPass(ID) {}
 
-  void handleExtractValue(ExtractValueInst* EVI) {
-      Instruction* I = dyn_cast<Instruction>(EVI->getAggregateOperand());
-      if (!I)
-          return;
-
-      auto search = binOpsMap.find(I);
-      if (search != binOpsMap.end()) {
-          if (*(EVI->indices().begin()) == 0) {
-              BinaryOperator* binOp = BinaryOperator::CreateNSW(search->second,
-                                        I->getOperand(0), I->getOperand(1));
-              replaceMap.emplace(EVI, binOp);
-          } else if (*(EVI->indices().begin()) == 1) {
-              Constant* CI = ConstantInt::getFalse(Type::getInt1Ty(EVI->getContext()));
-              replaceMap.emplace(EVI, CI);
-          }
-      }
-  }
-
-  void handleBinOp(Instruction::BinaryOps type, Instruction* I) {
-      BinaryOperator::CreateNSW(type, I->getOperand(0), I->getOperand(1));
-      binOpsMap.emplace(I, type);
+  static bool isRelevantFunction(StringRef name) {
+      return StringSwitch<bool>(name)
+          .Case("__ubsan_handle_add_overflow", true)
+          .Case("__ubsan_handle_sub_overflow", true)
+          .Case("__ubsan_handle_mul_overflow", true)
+          .Case("__ubsan_handle_divrem_overflow", true)
+          .Case("__ubsan_handle_negate_overflow", true)
+          .Default(false);
   }
 
-  void handleCall(CallInst* CI) {
-      if (!CI->getCalledFunction() || !CI->getCalledFunction()->hasName())
-          return;
-
-      auto search = relevantFunctions.find(CI->getCalledFunction()->getName().str());
-      if(search != relevantFunctions.end()) {
-          deleteInsts.insert(CI);
-      }
-  }
-
-  void handleSBinOpIntrinsic(IntrinsicInst* II, Instruction::BinaryOps type) {
-      deleteInsts.insert(II);
-      binOpsMap.emplace(II, type);
-  }
-
-  void handleIntrinsic(IntrinsicInst* II) {
+  static bool getBinOp(IntrinsicInst* II, Instruction::BinaryOps& type) {
       switch (II->getIntrinsicID()) {
           case Intrinsic::sadd_with_overflow:
-            handleSBinOpIntrinsic(II, Instruction::BinaryOps::Add);
-            break;
+            type = Instruction::BinaryOps::Add;
+            return true;
           case Intrinsic::ssub_with_overflow:
-            handleSBinOpIntrinsic(II, Instruction::BinaryOps::Sub);
-            break;
+            type = Instruction::BinaryOps::Sub;
+            return true;
           case Intrinsic::smul_with_overflow:
-            handleSBinOpIntrinsic(II, Instruction::BinaryOps::Mul);
-            break;
+            type = Instruction::BinaryOps::Mul;
+            return true;
           default:
-            break;
+            return false;
+      }
+  }
+
+  // replace the extracted result of II by the nsw operation
+  // and the extracted overflow flag by false
+  static bool replaceIntrinsic(IntrinsicInst* II, Instruction::BinaryOps type) {
+      std::vector<ExtractValueInst*> extracts;
+      for (auto* U : II->users()) {
+          auto* EVI = dyn_cast<ExtractValueInst>(U);
+          // we do not know how to replace other uses
+          if (!EVI || EVI->getNumIndices() != 1)
+              return false;
+          extracts.push_back(EVI);
       }
+
+      BinaryOperator* binOp = nullptr;
+      for (auto* EVI : extracts) {
+          Value* val;
+          if (*(EVI->idx_begin()) == 0) {
+              if (!binOp) {
+                  binOp = BinaryOperator::CreateNSW(type, II->getArgOperand(0),
+                                                    II->getArgOperand(1), "", II);
+                  binOp->setDebugLoc(II->getDebugLoc());
+              }
+              binOp->takeName(EVI);
+              val = binOp;
+          } else {
+              val = ConstantInt::getFalse(Type::getInt1Ty(EVI->getContext()));
+          }
+
+          EVI->replaceAllUsesWith(val);
+          EVI->eraseFromParent();
+      }
+
+      II->eraseFromParent();
+      return true;
   }
 
   bool runOnFunction(Function &F) override {
+      std::vector<std::pair<IntrinsicInst*, Instruction::BinaryOps>> intrinsics;
+      std::vector<CallInst*> calls;
+
       for (auto& BB : F) {
-         for (auto& I : BB) {
-              if (auto* II = dyn_cast<IntrinsicInst>(&I)) {
-                  handleIntrinsic(II);
-              } else if (auto* CI = dyn_cast<CallInst>(&I)) {
-                  handleCall(CI);
-              } else if (auto* EVI = dyn_cast<ExtractValueInst>(&I)) {
-                  handleExtractValue(EVI);
+          for (auto& I : BB) {
+              auto* CI = dyn_cast<CallInst>(&I);
+              if (!CI)
+                  continue;
+
+              Instruction::BinaryOps type;
+              if (auto* II = dyn_cast<IntrinsicInst>(CI)) {
+                  if (getBinOp(II, type))
+                      intrinsics.emplace_back(II, type);
+              } else if (auto* callee = CI->getCalledFunction()) {
+                  if (isRelevantFunction(callee->getName()))
+                      calls.push_back(CI);
               }
           }
       }
 
-      for (const auto& p : replaceMap) {
-         if (!p.first || !p.second)
-             continue;
-
-         Instruction* I = dyn_cast<Instruction>(p.second);
-         if (I)
-            ReplaceInstWithInst(p.first, I);
-         else {
-            BasicBlock::iterator BI(p.first);
-            ReplaceInstWithValue(p.first->getParent()->getInstList(), BI, p.second);
-         }
-      }
+      bool changed = false;
+      for (auto& it : intrinsics)
+          changed |= replaceIntrinsic(it.first, it.second);
 
-      // delete instructions that should be removed
-      for (auto i = deleteInsts.rbegin(); i != deleteInsts.rend(); ++i ) {
-          (*i)->eraseFromParent();
+      // the calls of ubsan handlers return void
+      for (auto* CI : calls) {
+          CI->eraseFromParent();
+          changed = true;
       }
 
-      deleteInsts.clear();
-      binOpsMap.clear();
-      replaceMap.clear();
-      return false;
+      return changed;
   }
-
- private:
-   std::set<Instruction*> deleteInsts;
-   std::map<Instruction*, Instruction::BinaryOps> binOpsMap;
-   std::map<Instruction*, Value*> replaceMap;
-   std::set<std::string> relevantFunctions {
-          "__ubsan_handle_add_overflow",
-          "__ubsan_handle_sub_overflow",
-          "__ubsan_handle_mul_overflow",
-          "__ubsan_handle_divrem_overflow",
-          "__ubsan_handle_negate_overflow"
-   };
 };
 } // end of anonymous namespace
 
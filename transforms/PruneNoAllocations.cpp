@@ -0,0 +1,224 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Find the functions from which an allocation or a free of memory
+// can be reached (by a call of malloc, calloc, realloc, free, their
+// __VERIFIER_ variants or another known allocating function) and if
+// main and the constructors and destructors of the module cannot reach
+// any, remove the body of main (it just returns 0). This is meant
+// for memcleanup: a program that never allocates memory on the heap
+// cannot leak it.
+//
+// A function can reach an allocation if it references (calls or takes
+// the address of) a function that can, if it has an indirect call
+// and some function with its address taken can, or if it calls
+// a declaration with a function pointer argument (e.g., atexit or qsort,
+// the models of which call the argument) and some function with
+// its address taken can. The other declarations are assumed not
+// to allocate, symbiotic either removes them or links models to them.
+
+#include <vector>
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+static cl::list<std::string> AllocFns("prune-no-allocations-alloc-fn",
+        cl::desc("Further functions that allocate or free memory"),
+        cl::CommaSeparated);
+
+namespace {
+
+class PruneNoAllocations : public ModulePass {
+  StringSet<> _allocFns;
+  SmallPtrSet<const Function *, 32> _allocating;
+  bool _addressTakenAllocates{false};
+
+  bool isAllocFn(const Function& F) const;
+  bool references(const Value *V) const;
+  bool reaches(const Function& F) const;
+  void computeAllocating(Module& M);
+
+public:
+  static char ID;
+
+  PruneNoAllocations() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<PruneNoAllocations> PNA("prune-no-allocations",
+                                            "Remove the body of main if it "
+                                            "cannot allocate or free memory");
+char PruneNoAllocations::ID;
+
+bool PruneNoAllocations::isAllocFn(const Function& F) const {
+  StringRef name = F.getName();
+  return _allocFns.count(name) > 0 ||
+         name.startswith("__VERIFIER_malloc") ||
+         name.startswith("__VERIFIER_calloc") ||
+         name.startswith("__VERIFIER_make_nondet_lazy");
+}
+
+// does the constant V (a called value or an operand) reference
+// a function that can reach an allocation?
+bool PruneNoAllocations::references(const Value *V) const {
+  if (auto *F = dyn_cast<Function>(V))
+    return _allocating.count(F) > 0;
+
+  // the initializers of globals are checked by their uses
+  auto *C = dyn_cast<Constant>(V);
+  if (!C || isa<GlobalValue>(C))
+    return false;
+  for (const Value *op : C->operands()) {
+    if (references(op))
+      return true;
+  }
+  return false;
+}
+
+static bool hasFunctionPointerArg(const FunctionType *FT) {
+  for (Type *T : FT->params()) {
+    auto *PT = dyn_cast<PointerType>(T);
+#if LLVM_VERSION_MAJOR >= 15
+    // we cannot tell the opaque pointers apart
+    if (PT)
+#elif LLVM_VERSION_MAJOR >= 14
+    if (PT && (PT->isOpaque() ||
+               PT->getNonOpaquePointerElementType()->isFunctionTy()))
+#else
+    if (PT && PT->getElementType()->isFunctionTy())
+#endif
+      return true;
+  }
+  return FT->isVarArg();
+}
+
+bool PruneNoAllocations::reaches(const Function& F) const {
+  for (const BasicBlock& B : F) {
+    for (const Instruction& I : B) {
+      for (const Value *op : I.operands()) {
+        if (isa<Constant>(op) && references(op))
+          return true;
+      }
+
+      if (!_addressTakenAllocates)
+        continue;
+
+      const Value *called;
+      if (auto *CI = dyn_cast<CallInst>(&I)) {
+        // we do not know what the assembly does
+        if (CI->isInlineAsm())
+          return true;
+        called = calleeOf(CI);
+      } else if (auto *II = dyn_cast<InvokeInst>(&I)) {
+        called = calleeOf(II);
+      } else {
+        continue;
+      }
+
+      auto *callee = dyn_cast<Function>(called->stripPointerCasts());
+      if (!callee)
+        return true;
+      if (callee->isDeclaration() && !callee->isIntrinsic() &&
+          hasFunctionPointerArg(callee->getFunctionType()))
+        return true;
+    }
+  }
+  return false;
+}
+
+void PruneNoAllocations::computeAllocating(Module& M) {
+  for (const Function& F : M) {
+    if (isAllocFn(F))
+      _allocating.insert(&F);
+  }
+
+  bool changed;
+  do {
+    changed = false;
+    for (const Function& F : M) {
+      if (_allocating.count(&F) || F.isDeclaration() || !reaches(F))
+        continue;
+      _allocating.insert(&F);
+      changed = true;
+    }
+
+    if (!_addressTakenAllocates) {
+      for (const Function *F : _allocating) {
+        if (F->hasAddressTaken()) {
+          _addressTakenAllocates = changed = true;
+          break;
+        }
+      }
+    }
+  } while (changed);
+}
+
+bool PruneNoAllocations::runOnModule(Module& M) {
+  Function *main = M.getFunction("main");
+  if (!main || main->isDeclaration())
+    return false;
+
+  for (const char *name : {"malloc", "calloc", "realloc", "reallocarray",
+                           "free", "aligned_alloc", "memalign", "valloc",
+                           "pvalloc", "posix_memalign", "strdup", "strndup",
+                           "wcsdup", "asprintf", "vasprintf", "getline",
+                           "getdelim", "realpath", "get_current_dir_name",
+                           "getcwd", "tempnam", "open_memstream", "fopen",
+                           "fdopen", "freopen", "fclose", "tmpfile",
+                           "opendir", "closedir", "scandir", "kmalloc",
+                           "__kmalloc", "kzalloc", "kcalloc", "krealloc",
+                           "kfree", "__kfree", "vmalloc", "vzalloc", "vfree"})
+    _allocFns.insert(name);
+  for (const std::string& name : AllocFns)
+    _allocFns.insert(name);
+
+  computeAllocating(M);
+
+  unsigned defined = 0, allocating = 0;
+  for (const Function& F : M) {
+    if (F.isDeclaration())
+      continue;
+    ++defined;
+    allocating += _allocating.count(&F);
+  }
+  errs() << allocating << " of " << defined
+         << " functions may allocate or free memory\n";
+
+  if (_allocating.count(main))
+    return false;
+
+  // the constructors and destructors are called from main later
+  // (see -explicit-consdes)
+  for (const char *gname : {"llvm.global_ctors", "llvm.global_dtors"}) {
+    auto *GV = M.getNamedGlobal(gname);
+    if (GV && GV->hasInitializer() && references(GV->getInitializer()))
+      return false;
+  }
+
+  main->deleteBody();
+  BasicBlock *B = BasicBlock::Create(M.getContext(), "entry", main);
+  Type *RT = main->getReturnType();
+  ReturnInst::Create(M.getContext(),
+                     RT->isVoidTy() ? nullptr : Constant::getNullValue(RT), B);
+
+  errs() << "main cannot allocate or free memory, removed its body\n";
+  return true;
+}
@@ -0,0 +1,143 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Remove the nsw flag from signed arithmetic operations that provably
+// cannot overflow. The instrumentation for signed overflows checks only
+// the nsw operations, so these operations do not get any check.
+//
+// The ranges of the operands are taken from the interval analysis
+// (Intervals.h) and from ScalarEvolution, an operation is safe if one
+// of them proves it. ScalarEvolution must not use the nsw flags of the
+// operations that we are checking (it would assume that they do not
+// overflow), so the flags are removed before the analysis and restored
+// for the operations that we could not prove safe. The interval analysis
+// does not use the flags at all.
+
+#include <vector>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/ConstantRange.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "llvm/Analysis/ScalarEvolution.h"
+
+#include "Intervals.h"
+
+using namespace llvm;
+
+class PruneOverflowChecks : public ModulePass {
+  bool pruneFunction(Function& F, const IntervalAnalysis& IA);
+
+public:
+  static char ID;
+
+  PruneOverflowChecks() : ModulePass(ID) {}
+
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<IntervalAnalysis>();
+    AU.addRequired<ScalarEvolutionWrapperPass>();
+  }
+
+  bool runOnModule(Module& M) override;
+};
+
+static RegisterPass<PruneOverflowChecks> PROC("prune-overflow-checks",
+                                              "Remove the nsw flag from signed "
+                                              "operations that cannot overflow");
+char PruneOverflowChecks::ID;
+
+static bool isChecked(const Instruction& I) {
+  switch (I.getOpcode()) {
+    case Instruction::Add:
+    case Instruction::Sub:
+    case Instruction::Mul:
+      return I.getType()->isIntegerTy() && I.hasNoSignedWrap();
+    default:
+      return false;
+  }
+}
+
+static bool cannotOverflow(BinaryOperator *I, ConstantRange lhs,
+                           ConstantRange rhs) {
+  unsigned bw = I->getType()->getIntegerBitWidth();
+
+  // (the operation is not reachable)
+  if (lhs.isEmptySet() || rhs.isEmptySet())
+    return false;
+
+  // compute the result in twice the width, there it cannot overflow
+  lhs = lhs.signExtend(2*bw);
+  rhs = rhs.signExtend(2*bw);
+
+  ConstantRange result(2*bw, true /* full */);
+  switch (I->getOpcode()) {
+    case Instruction::Add: result = lhs.add(rhs); break;
+    case Instruction::Sub: result = lhs.sub(rhs); break;
+    case Instruction::Mul: result = lhs.multiply(rhs); break;
+    default: return false;
+  }
+
+  if (result.isFullSet() || result.isSignWrappedSet())
+    return false;
+
+  APInt min = APInt::getSignedMinValue(bw).sext(2*bw);
+  APInt max = APInt::getSignedMaxValue(bw).sext(2*bw);
+  return result.getSignedMin().sge(min) && result.getSignedMax().sle(max);
+}
+
+static bool cannotOverflow(ScalarEvolution& SE, BinaryOperator *I) {
+  return cannotOverflow(I, SE.getSignedRange(SE.getSCEV(I->getOperand(0))),
+                        SE.getSignedRange(SE.getSCEV(I->getOperand(1))));
+}
+
+static bool cannotOverflow(const IntervalAnalysis& IA, BinaryOperator *I) {
+  return cannotOverflow(I, IA.getRangeAt(I->getOperand(0), I),
+                        IA.getRangeAt(I->getOperand(1), I));
+}
+
+bool PruneOverflowChecks::pruneFunction(Function& F,
+                                        const IntervalAnalysis& IA) {
+  std::vector<BinaryOperator *> checked;
+  for (Instruction& I : instructions(F)) {
+    if (isChecked(I)) {
+      checked.push_back(cast<BinaryOperator>(&I));
+      I.setHasNoSignedWrap(false);
+    }
+  }
+
+  if (checked.empty())
+    return false;
+
+  auto& SE = getAnalysis<ScalarEvolutionWrapperPass>(F).getSE();
+
+  std::vector<BinaryOperator *> keep;
+  for (BinaryOperator *I : checked) {
+    if (cannotOverflow(IA, I))
+      continue;
+    if (!SE.isSCEVable(I->getType()) || !cannotOverflow(SE, I))
+      keep.push_back(I);
+  }
+
+  for (BinaryOperator *I : keep)
+    I->setHasNoSignedWrap(true);
+
+  return keep.size() != checked.size();
+}
+
+bool PruneOverflowChecks::runOnModule(Module& M) {
+  const auto& IA = getAnalysis<IntervalAnalysis>();
+
+  bool changed = false;
+  for (Function& F : M) {
+    if (!F.isDeclaration())
+      changed |= pruneFunction(F, IA);
+  }
+  return changed;
+}
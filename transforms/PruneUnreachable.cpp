@@ -0,0 +1,154 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#include <vector>
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#if LLVM_VERSION_MAJOR >= 4 || (LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR >= 5)
+  #include "llvm/IR/InstIterator.h"
+#else
+  #include "llvm/Support/InstIterator.h"
+#endif
+#include "llvm/Transforms/Utils/Local.h"
+
+using namespace llvm;
+
+// Remove the blocks that are not reachable from the entry of their function
+// and the bodies of functions that cannot be reached from main or from
+// the constructors and destructors of the module (the ones that
+// -explicit-consdes calls from main). A function is reachable if it is
+// referenced (called or its address is taken) from a reachable function
+// or from the initializer of a global that is referenced so. The globals
+// that are not referenced from the reachable code are removed too.
+//
+// This runs before instrumentation, so that the instrumentation and the
+// following passes work only with the code that can be executed.
+class PruneUnreachable : public ModulePass {
+    SmallPtrSet<const Function *, 32> reachable;
+    SmallPtrSet<const Value *, 32> visited;
+    std::vector<const Value *> worklist;
+    std::vector<const Function *> functions;
+
+    void add(const Value *V) {
+        if (!visited.insert(V).second)
+            return;
+
+        if (auto F = dyn_cast<Function>(V)) {
+            reachable.insert(F);
+            functions.push_back(F);
+        } else if (auto GV = dyn_cast<GlobalVariable>(V)) {
+            if (GV->hasInitializer())
+                worklist.push_back(GV->getInitializer());
+        } else if (auto GA = dyn_cast<GlobalAlias>(V)) {
+            worklist.push_back(GA->getAliasee());
+        } else if (auto C = dyn_cast<Constant>(V)) {
+            for (const Value *op : C->operands())
+                worklist.push_back(op);
+        }
+    }
+
+    void addReferenced(const Function& F) {
+        for (const_inst_iterator I = inst_begin(F), E = inst_end(F);
+             I != E; ++I) {
+            for (const Value *op : I->operands()) {
+                if (isa<Constant>(op))
+                    worklist.push_back(op);
+            }
+        }
+    }
+
+    void computeReachable(Module& M) {
+        for (const Function& F : M) {
+            // the functions that may be called by the instrumentation
+            // or by our other passes
+            const auto& name = F.getName();
+            if (name.equals("main") || name.startswith("__VERIFIER_") ||
+                name.startswith("__INSTR_") || name.startswith("__symbiotic_"))
+                worklist.push_back(&F);
+        }
+
+        for (const char *gname : {"llvm.global_ctors", "llvm.global_dtors",
+                                  "llvm.used", "llvm.compiler.used"}) {
+            if (auto GV = M.getNamedGlobal(gname))
+                worklist.push_back(GV);
+        }
+
+        size_t processed = 0;
+        while (!worklist.empty() || processed < functions.size()) {
+            while (!worklist.empty()) {
+                const Value *V = worklist.back();
+                worklist.pop_back();
+                add(V);
+            }
+
+            if (processed < functions.size())
+                addReferenced(*functions[processed++]);
+        }
+    }
+
+  public:
+    static char ID;
+
+    PruneUnreachable() : ModulePass(ID) {}
+
+    bool runOnModule(Module& M) override {
+        if (!M.getFunction("main"))
+            return false;
+
+        bool changed = false;
+        for (Function& F : M) {
+            if (!F.isDeclaration())
+                changed |= removeUnreachableBlocks(F);
+        }
+
+        computeReachable(M);
+
+        std::vector<Function *> unreachable;
+        for (Function& F : M) {
+            if (!F.isDeclaration() && reachable.count(&F) == 0)
+                unreachable.push_back(&F);
+        }
+
+        // delete all the bodies first, the functions may call each other
+        for (Function *F : unreachable)
+            F->deleteBody();
+
+        // remove the globals that are not used anymore and that are not
+        // reachable (they may reference each other, so repeat it)
+        bool erased;
+        do {
+            erased = false;
+            for (auto I = M.global_begin(), E = M.global_end(); I != E;) {
+                GlobalVariable *GV = &*I++;
+                if (GV->use_empty() && visited.count(GV) == 0 &&
+                    !GV->getName().startswith("llvm.")) {
+                    GV->eraseFromParent();
+                    erased = changed = true;
+                }
+            }
+        } while (erased);
+
+        // the functions that are still used are referenced
+        // from globals that are not reachable, keep their declarations
+        for (Function *F : unreachable) {
+            if (F->use_empty())
+                F->eraseFromParent();
+        }
+
+        return changed || !unreachable.empty();
+    }
+};
+
+static RegisterPass<PruneUnreachable> PU("prune-unreachable",
+                                         "Remove blocks and functions that cannot be "
+                                         "reached from main or from module constructors");
+char PruneUnreachable::ID;
@@ -0,0 +1,235 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Cut away the code from which the target of a violation witness cannot be
+// reached, so that the validator does not explore the paths that cannot
+// confirm the witness. The target is given by its line (and optionally
+// the name of the file) and the program is matched to it by the debug
+// locations. A path that enters a block that is cut away ends with
+// __VERIFIER_silent_exit.
+//
+// A function may reach the target if it contains an instruction from
+// the target line or it calls (or passes as an argument, e.g., to
+// pthread_create) a function that may reach the target. Calls via
+// pointers are assumed to reach the target. A block of a function may
+// reach the target if it has a path (in the function) to a block that
+// contains the target or a call that may reach it, or to a return
+// (the caller may reach the target after the call) unless the function
+// is main. The rest of blocks is cut away.
+//
+// The pass does nothing in programs with threads (a thread cannot stop
+// the whole program), or if there are no instructions from the target line.
+
+#include <vector>
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2);
+
+static cl::opt<unsigned> TargetLine("prune-witness-path-line",
+        cl::desc("The line of the target of the witness"),
+        cl::init(0));
+
+static cl::opt<std::string> TargetFile("prune-witness-path-file",
+        cl::desc("The file of the target of the witness (the name "
+                 "without directories, default: any file)"),
+        cl::init(""));
+
+namespace {
+
+class PruneWitnessPath : public ModulePass {
+  SmallPtrSet<const BasicBlock *, 32> _targets;
+  SmallPtrSet<const Function *, 32> _reaching;
+
+  bool isTarget(const Instruction& I) const;
+  bool mayReach(const Instruction& I) const;
+  bool findTargets(Module& M);
+  void computeReaching(Module& M);
+  bool prune(Function& F, Function *exitF);
+
+public:
+  static char ID;
+
+  PruneWitnessPath() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<PruneWitnessPath> PWP("prune-witness-path",
+                                          "Cut away the code from which "
+                                          "the target of a witness cannot "
+                                          "be reached");
+char PruneWitnessPath::ID;
+
+bool PruneWitnessPath::isTarget(const Instruction& I) const {
+  const DebugLoc& Loc = I.getDebugLoc();
+  if (!Loc || Loc.getLine() != TargetLine)
+    return false;
+
+  if (TargetFile.empty())
+    return true;
+
+  auto *Scope = cast<DIScope>(Loc.getScope());
+  return sys::path::filename(Scope->getFilename()) == TargetFile;
+}
+
+// the instruction is a call that may reach the target
+bool PruneWitnessPath::mayReach(const Instruction& I) const {
+  auto *CI = dyn_cast<CallInst>(&I);
+  if (!CI || CI->isInlineAsm())
+    return false;
+
+  const Value *val = calleeOf(CI)->stripPointerCasts();
+  const Function *callee = dyn_cast<Function>(val);
+  if (!callee)
+    return true;
+  if (_reaching.count(callee))
+    return true;
+
+#if LLVM_VERSION_MAJOR >= 8
+  for (const Value *arg : CI->args()) {
+#else
+  for (const Value *arg : CI->arg_operands()) {
+#endif
+    auto *F = dyn_cast<Function>(arg->stripPointerCasts());
+    if (F && _reaching.count(F))
+      return true;
+  }
+
+  return false;
+}
+
+bool PruneWitnessPath::findTargets(Module& M) {
+  for (Function& F : M) {
+    for (BasicBlock& B : F) {
+      for (Instruction& I : B) {
+        if (isTarget(I)) {
+          _targets.insert(&B);
+          _reaching.insert(&F);
+          break;
+        }
+      }
+    }
+  }
+
+  return !_targets.empty();
+}
+
+void PruneWitnessPath::computeReaching(Module& M) {
+  bool changed;
+  do {
+    changed = false;
+    for (Function& F : M) {
+      if (F.isDeclaration() || _reaching.count(&F))
+        continue;
+
+      for (BasicBlock& B : F) {
+        for (Instruction& I : B) {
+          if (mayReach(I)) {
+            _reaching.insert(&F);
+            changed = true;
+            break;
+          }
+        }
+        if (_reaching.count(&F))
+          break;
+      }
+    }
+  } while (changed);
+}
+
+bool PruneWitnessPath::prune(Function& F, Function *exitF) {
+  SmallPtrSet<const BasicBlock *, 32> relevant;
+  std::vector<const BasicBlock *> queue;
+  bool isMain = F.getName().equals("main");
+
+  for (BasicBlock& B : F) {
+    bool seed = _targets.count(&B) > 0 ||
+                (!isMain && isa<ReturnInst>(B.getTerminator()));
+    for (auto I = B.begin(), E = B.end(); !seed && I != E; ++I)
+      seed = mayReach(*I);
+
+    if (seed && relevant.insert(&B).second)
+      queue.push_back(&B);
+  }
+
+  while (!queue.empty()) {
+    const BasicBlock *cur = queue.back();
+    queue.pop_back();
+    for (const BasicBlock *pred : predecessors(cur)) {
+      if (relevant.insert(pred).second)
+        queue.push_back(pred);
+    }
+  }
+
+  bool changed = false;
+  Type *argTy = Type::getInt32Ty(F.getContext());
+  for (BasicBlock& B : F) {
+    if (relevant.count(&B))
+      continue;
+
+    auto *new_CI = CallInst::Create(exitF, {ConstantInt::get(argTy, 0)});
+    auto *point = B.getFirstNonPHI();
+    CloneMetadata(point, new_CI);
+    new_CI->insertBefore(point);
+    changed = true;
+  }
+
+  return changed;
+}
+
+bool PruneWitnessPath::runOnModule(Module& M) {
+  _targets.clear();
+  _reaching.clear();
+
+  if (TargetLine == 0)
+    return false;
+
+  if (auto *F = M.getFunction("pthread_create")) {
+    if (!F->use_empty())
+      return false;
+  }
+
+  if (!findTargets(M)) {
+    errs() << "WARNING: Found no instructions at the target of the witness, "
+              "not pruning the program\n";
+    return false;
+  }
+
+  computeReaching(M);
+
+  auto& Ctx = M.getContext();
+  Type *argTy = Type::getInt32Ty(Ctx);
+  auto exitC = insertFunction(M, "__VERIFIER_silent_exit",
+                              Type::getVoidTy(Ctx),
+                              {argTy});
+  auto exitF = functionOf(exitC);
+  exitF->addFnAttr(Attribute::NoReturn);
+
+  bool changed = false;
+  for (Function& F : M) {
+    if (!F.isDeclaration() && &F != exitF)
+      changed |= prune(F, exitF);
+  }
+
+  return changed;
+}
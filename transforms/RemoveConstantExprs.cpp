@@ -4,8 +4,9 @@
 // License. See LICENSE.TXT for details.
 
 #include <cassert>
-#include <set>
+#include <utility>
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/InstIterator.h"
@@ -13,6 +14,8 @@
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_os_ostream.h"
 
+#include "Compat.h"
+
 using namespace llvm;
 
 class RemoveConstantExprs : public ModulePass {
@@ -38,70 +41,81 @@ bool RemoveConstantExprs::runOnModule(Module& M) {
   return changed;
 }
 
-static inline llvm::ConstantExpr *getCEOperand(llvm::Instruction& I) {
-    for (auto& op : I.operands()) {
-      if (auto *CE = dyn_cast<ConstantExpr>(&op)) {
-          return CE;
-      }
+// The lowered constant expressions of one function. The instruction
+// created for a constant expression is shared by all its uses in
+// the same block (we go through the block in order, so the first
+// use dominates the rest), the uses in PHI nodes get their instruction
+// at the end of the incoming block.
+class CELowering {
+  using Key = std::pair<BasicBlock *, ConstantExpr *>;
+  DenseMap<Key, Instruction *> _lowered;
+  DenseMap<Key, Instruction *> _lowered_phi;
+
+  Instruction *create(ConstantExpr *CE, Instruction *insertPoint,
+                      DenseMap<Key, Instruction *>& memo) {
+    Key key{insertPoint->getParent(), CE};
+    auto it = memo.find(key);
+    if (it != memo.end())
+      return it->second;
+
+    auto *newI = CE->getAsInstruction();
+    newI->insertBefore(insertPoint);
+    // the operands are lowered before the new instruction
+    // (and are shared in the block too)
+    for (unsigned i = 0, e = newI->getNumOperands(); i < e; ++i) {
+      if (auto *opCE = dyn_cast<ConstantExpr>(newI->getOperand(i)))
+        newI->setOperand(i, create(opCE, newI, memo));
     }
-    return nullptr;
-}
 
-template <typename Queue>
-void queueCEInst(Queue& queue, llvm::Instruction& I) {
-  if (auto *CE = getCEOperand(I)) {
-    queue.insert(std::make_pair(&I, CE));
+    memo[key] = newI;
+    return newI;
   }
-}
 
-bool RemoveConstantExprs::runOnFunction(Function &F) {
-  using namespace llvm;
+public:
+  // lower the constant expressions in the operands of I,
+  // return true if something changed
+  bool lower(Instruction& I) {
+    bool changed = false;
+    for (unsigned i = 0, e = I.getNumOperands(); i < e; ++i) {
+      auto *CE = dyn_cast<ConstantExpr>(I.getOperand(i));
+      if (!CE)
+        continue;
 
-  std::set<std::pair<Instruction *, ConstantExpr*>> instsWithCE;
+      // FIXME: HACK for slowbeast
+      // if this CE is a cast of the function in function call, skip it
+      // FIXME: make this configurable
+      if (auto *Call = dyn_cast<CallInst>(&I)) {
+        if (calleeOf(Call) == CE)
+          continue;
+      }
 
-  for (auto& I : llvm::instructions(F)) {
-      queueCEInst(instsWithCE, I);
-  }
+      Instruction *newI;
+      if (auto *PHI = dyn_cast<PHINode>(&I)) {
+        BasicBlock *pred = PHI->getIncomingBlock(i);
+        newI = create(CE, pred->getTerminator(), _lowered_phi);
+      } else {
+        newI = create(CE, &I, _lowered);
+      }
 
-  bool changed = false;
-  while (!instsWithCE.empty()) {
-    // FIXME: this is not very efficient, but let's optimize later
-    auto cur = instsWithCE.begin();
-    auto *I = cur->first;
-    auto *CE = cur->second;
-    instsWithCE.erase(cur);
-
-    // FIXME: HACK for slowbeast
-    // if this CE is a cast of the function in function call, skip it
-    // FIXME: make this configurable
-    if (auto *Call = dyn_cast<CallInst>(I)) {
-#if LLVM_VERSION_MAJOR >= 8
-      if (Call->getCalledOperand() == CE)
-#else
-      if (Call->getCalledValue() == CE)
-#endif
-        continue;
+      I.setOperand(i, newI);
+      changed = true;
     }
-    auto *newI = CE->getAsInstruction();
-    newI->insertBefore(I);
-    I->replaceUsesOfWith(CE, newI);
-    // the instruction may contain another CE
-    queueCEInst(instsWithCE, *I);
-    // the new instruction may contain CE
-    queueCEInst(instsWithCE, *newI);
-
-    changed = true;
+
+    return changed;
   }
+};
+
+bool RemoveConstantExprs::runOnFunction(Function &F) {
+  using namespace llvm;
 
-/* Does not hold with the HACK
-#ifndef NDEBUG 
+  CELowering lowering;
+  bool changed = false;
+  // the new instructions are inserted before the current instruction
+  // (or into the predecessors of PHI nodes) and have their operands
+  // lowered already, so one pass over the function is enough
   for (auto& I : llvm::instructions(F)) {
-      queueCEInst(instsWithCE, I);
+    changed |= lowering.lower(I);
   }
-  assert(instsWithCE.empty() && "Did not reach fixpoint");
-#endif
-*/
 
   return changed;
 }
-
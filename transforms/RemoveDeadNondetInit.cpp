@@ -0,0 +1,250 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Remove the nondeterministic initializations of local variables
+// (created by -initialize-uninitialized) that are overwritten on every path
+// before the variable is read. Every removed initialization saves
+// a symbolic object and the variables of the solver.
+//
+// An initialization is either a call of klee_make_nondet on the whole
+// alloca, or a store of the value loaded from a nondeterministic temporary
+// alloca (the way the scalars are initialized). Only the allocas whose
+// address does not escape are handled, so all their reads and writes
+// are the instructions that use them (through casts and getelementptrs).
+// An initialization is dead if every path from it reaches an instruction
+// that overwrites the whole variable (or ends its lifetime) or leaves
+// the function before reading the variable.
+
+#include <vector>
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace {
+
+class RemoveDeadNondetInit : public FunctionPass {
+  // how the instructions access one alloca
+  struct Accesses {
+    SmallPtrSet<const Instruction *, 8> reads;
+    SmallPtrSet<const Instruction *, 8> kills;
+  };
+
+  Function *_makeNondet{nullptr};
+
+  bool isMakeNondet(const Instruction *I) const {
+    auto *CI = dyn_cast<CallInst>(I);
+    return CI && _makeNondet && CI->getCalledFunction() == _makeNondet;
+  }
+
+  static bool coversWhole(const Value *len, uint64_t size) {
+    auto *C = dyn_cast<ConstantInt>(len);
+    return C && C->getZExtValue() >= size;
+  }
+
+  bool getAccesses(const Value *ptr, const AllocaInst *AI, uint64_t size,
+                   const DataLayout& DL, Accesses& acc) const;
+  bool isKilled(const Instruction *init, const Accesses& acc) const;
+
+public:
+  static char ID;
+
+  RemoveDeadNondetInit() : FunctionPass(ID) {}
+
+  bool doInitialization(Module& M) override {
+    _makeNondet = M.getFunction("klee_make_nondet");
+    return false;
+  }
+
+  bool runOnFunction(Function& F) override;
+};
+
+} // namespace
+
+static RegisterPass<RemoveDeadNondetInit> RDNI("remove-dead-nondet-init",
+                                               "Remove the nondeterministic "
+                                               "initializations of variables "
+                                               "that are always overwritten "
+                                               "before a read");
+char RemoveDeadNondetInit::ID;
+
+// collect the reads of the alloca and the instructions that overwrite
+// it whole, return false if its address may escape
+bool RemoveDeadNondetInit::getAccesses(const Value *ptr, const AllocaInst *AI,
+                                       uint64_t size, const DataLayout& DL,
+                                       Accesses& acc) const {
+  for (const User *U : ptr->users()) {
+    auto *I = dyn_cast<Instruction>(U);
+    if (!I)
+      return false;
+
+    // does the instruction access the whole alloca?
+    bool whole = ptr->stripPointerCasts() == AI;
+    if (isa<LoadInst>(I)) {
+      acc.reads.insert(I);
+    } else if (auto *SI = dyn_cast<StoreInst>(I)) {
+      if (SI->getValueOperand() == ptr)
+        return false;
+      if (whole && !SI->isVolatile() &&
+          DL.getTypeStoreSize(SI->getValueOperand()->getType()) >= size)
+        acc.kills.insert(I);
+    } else if (isa<BitCastInst>(I) || isa<GetElementPtrInst>(I)) {
+      if (!getAccesses(I, AI, size, DL, acc))
+        return false;
+    } else if (isa<DbgInfoIntrinsic>(I)) {
+      continue;
+    } else if (auto *II = dyn_cast<IntrinsicInst>(I)) {
+      auto ID = II->getIntrinsicID();
+      if (ID == Intrinsic::lifetime_start || ID == Intrinsic::lifetime_end) {
+        // the memory is undefined after these
+        acc.kills.insert(I);
+      } else if (auto *MT = dyn_cast<MemTransferInst>(I)) {
+        if (MT->getRawSource() == ptr)
+          acc.reads.insert(I);
+        if (MT->getRawDest() == ptr && whole && !MT->isVolatile() &&
+            coversWhole(MT->getLength(), size))
+          acc.kills.insert(I);
+      } else if (auto *MS = dyn_cast<MemSetInst>(I)) {
+        if (whole && !MS->isVolatile() && coversWhole(MS->getLength(), size))
+          acc.kills.insert(I);
+      } else {
+        return false;
+      }
+    } else if (isMakeNondet(I)) {
+      auto *CI = cast<CallInst>(I);
+      if (CI->getArgOperand(0) != ptr)
+        return false;
+      if (whole && coversWhole(CI->getArgOperand(1), size))
+        acc.kills.insert(I);
+    } else {
+      // comparisons of the address, calls, returns, ...
+      return false;
+    }
+  }
+  return true;
+}
+
+// does every path from init overwrite the alloca before reading it?
+bool RemoveDeadNondetInit::isKilled(const Instruction *init,
+                                    const Accesses& acc) const {
+  SmallPtrSet<const BasicBlock *, 16> visited;
+  std::vector<const Instruction *> worklist{init->getNextNode()};
+  while (!worklist.empty()) {
+    const Instruction *I = worklist.back();
+    worklist.pop_back();
+
+    for (; I; I = I->getNextNode()) {
+      if (acc.reads.count(I))
+        return false;
+      // (getting back to the initialization overwrites the variable too)
+      if (I == init || acc.kills.count(I))
+        break;
+
+      if (I->isTerminator()) {
+        for (unsigned i = 0; i < I->getNumSuccessors(); ++i) {
+          const BasicBlock *succ = I->getSuccessor(i);
+          if (visited.insert(succ).second)
+            worklist.push_back(&*succ->begin());
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool RemoveDeadNondetInit::runOnFunction(Function& F) {
+  if (!_makeNondet || _makeNondet->use_empty())
+    return false;
+
+  const DataLayout& DL = F.getParent()->getDataLayout();
+  std::vector<Instruction *> toErase;
+  unsigned removed = 0;
+
+  for (Instruction& I : F.getEntryBlock()) {
+    auto *AI = dyn_cast<AllocaInst>(&I);
+    if (!AI || AI->isArrayAllocation() || !AI->getAllocatedType()->isSized())
+      continue;
+
+    uint64_t size = DL.getTypeAllocSize(AI->getAllocatedType());
+    Accesses acc;
+    if (!getAccesses(AI, AI, size, DL, acc))
+      continue;
+
+    for (const Instruction *CK : acc.kills) {
+      auto *K = const_cast<Instruction *>(CK);
+      // the calls of klee_make_nondet on the whole alloca
+      if (isMakeNondet(K)) {
+        if (isKilled(K, acc)) {
+          toErase.push_back(K);
+          ++removed;
+        }
+        continue;
+      }
+
+      // the store of a value loaded from a nondeterministic temporary
+      auto *SI = dyn_cast<StoreInst>(K);
+      if (!SI)
+        continue;
+      auto *LI = dyn_cast<LoadInst>(SI->getValueOperand());
+      if (!LI || !LI->hasOneUse())
+        continue;
+      auto *tmp = dyn_cast<AllocaInst>(LI->getPointerOperand());
+      if (!tmp || tmp == AI)
+        continue;
+
+      bool onlyNondet = true;
+      std::vector<Instruction *> tmpUsers;
+      for (User *U : tmp->users()) {
+        auto *UI = cast<Instruction>(U);
+        if (UI == LI)
+          continue;
+        auto *Cast = dyn_cast<BitCastInst>(UI);
+        if (!Cast || !Cast->hasOneUse() ||
+            !isMakeNondet(cast<Instruction>(*Cast->user_begin()))) {
+          onlyNondet = false;
+          break;
+        }
+        // (the cast is erased with the call)
+        tmpUsers.push_back(cast<Instruction>(*Cast->user_begin()));
+      }
+      if (!onlyNondet || !isKilled(SI, acc))
+        continue;
+
+      toErase.push_back(SI);
+      toErase.push_back(LI);
+      toErase.insert(toErase.end(), tmpUsers.begin(), tmpUsers.end());
+      toErase.push_back(tmp);
+      ++removed;
+    }
+  }
+
+  if (toErase.empty())
+    return false;
+
+  for (Instruction *I : toErase) {
+    // the casts of the address of the original alloca
+    Value *ptr = nullptr;
+    if (isMakeNondet(I))
+      ptr = cast<CallInst>(I)->getArgOperand(0);
+    I->eraseFromParent();
+    if (auto *Cast = dyn_cast_or_null<CastInst>(ptr)) {
+      if (Cast->use_empty())
+        Cast->eraseFromParent();
+    }
+  }
+
+  errs() << "Removed " << removed << " dead nondeterministic initializations in "
+         << F.getName() << "\n";
+  return true;
+}
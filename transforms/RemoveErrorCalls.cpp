@@ -26,6 +26,8 @@
 #include <llvm/IR/DebugInfoMetadata.h>
 #include <llvm/Support/CommandLine.h>
 
+#include "Compat.h"
+
 using namespace llvm;
 
 bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2);
@@ -59,11 +61,7 @@ bool RemoveErrorCalls::runOnFunction(Function &F)
       if (CI->isInlineAsm())
         continue;
 
-#if LLVM_VERSION_MAJOR >= 8
-      const Value *val = CI->getCalledOperand()->stripPointerCasts();
-#else
-      const Value *val = CI->getCalledValue()->stripPointerCasts();
-#endif
+      const Value *val = calleeOf(CI)->stripPointerCasts();
       const Function *callee = dyn_cast<Function>(val);
       if (!callee || callee->isIntrinsic())
         continue;
@@ -76,13 +74,9 @@ bool RemoveErrorCalls::runOnFunction(Function &F)
         if (!ext) {
           Type *argTy = Type::getInt32Ty(Ctx);
           auto extF
-            = M->getOrInsertFunction(useExit ? "__VERIFIER_exit" :
-                                               "__VERIFIER_assume",
-                                     Type::getVoidTy(Ctx), argTy
-#if LLVM_VERSION_MAJOR < 5
-                                       , nullptr
-#endif
-                                       );
+            = insertFunction(*M, useExit ? "__VERIFIER_exit" : "__VERIFIER_assume",
+                             Type::getVoidTy(Ctx),
+                             {argTy});
 
           std::vector<Value *> args = { ConstantInt::get(argTy, 0) };
           ext = std::unique_ptr<CallInst>(CallInst::Create(extF, args));
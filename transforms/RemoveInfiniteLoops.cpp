@@ -3,15 +3,19 @@
 // This file is distributed under the University of Illinois Open Source
 // License. See LICENSE.TXT for details.
 
-#include <vector>
 #include <set>
+#include <string>
+#include <vector>
 
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/Type.h"
@@ -20,42 +24,54 @@
 #else
   #include "llvm/Support/InstIterator.h"
 #endif
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 
+#include "Compat.h"
+
 using namespace llvm;
 
+// Find the cycles of the control flow (strongly connected components
+// of the CFG, one sweep of Tarjan's algorithm per function) that have
+// no exit and do nothing observable (no calls, no writes to memory),
+// e.g., LABEL: goto LABEL; or while (1) { if (x) ... else ...; },
+// and terminate the paths that enter them (-remove-infinite-loops-action):
+// by __VERIFIER_assume(0) (the default) or by exit(0).
+
+static cl::opt<std::string> Action("remove-infinite-loops-action",
+        cl::desc("What to do with the paths that enter an infinite loop:\n"
+                 "'assume' (__VERIFIER_assume(0), the default) or 'exit'\n"
+                 "(exit(0))"),
+        cl::init("assume"));
+
 class RemoveInfiniteLoops : public FunctionPass {
-    bool isLoop(BasicBlock *block) {
-     // check if this is a block that unconditionally jumps on itself
-     std::set<BasicBlock *> visited;
-     visited.insert(block);
-     auto *cur = block;
-     do {
-       for (auto& I : *cur) {
-           if (I.mayWriteToMemory())
-               return false;
-           if (isa<CallInst>(&I))
-               return false;
-           if (isa<ReturnInst>(&I))
-               return false;
-       }
-
-       cur = cur->getUniqueSuccessor();
-       if (!cur) {// no loop
-           return false;
-       }
-
-       if (!visited.insert(cur).second) {
-           // hit a cycle
-           return true;
-       }
-     } while (true);
-
-     assert(false && "Should not be reachable");
-     return false;
+    // a cycle without exits that does nothing
+    static bool isInfiniteLoop(const std::vector<BasicBlock *>& scc) {
+      std::set<const BasicBlock *> blocks(scc.begin(), scc.end());
+      for (BasicBlock *block : scc) {
+        for (auto& I : *block) {
+          if (I.mayWriteToMemory())
+            return false;
+          if (isa<DbgInfoIntrinsic>(&I))
+            continue;
+          if (isa<CallInst>(&I) || isa<InvokeInst>(&I))
+            return false;
+        }
+
+        Instruction *T = block->getTerminator();
+        if (T->getNumSuccessors() == 0)
+          return false;
+        for (unsigned i = 0, e = T->getNumSuccessors(); i < e; ++i) {
+          if (!blocks.count(T->getSuccessor(i)))
+            return false;
+        }
+      }
+      return true;
     }
 
+    Function *getTerminate(Module& M);
+
   public:
     static char ID;
 
@@ -65,55 +81,57 @@ class RemoveInfiniteLoops : public FunctionPass {
 };
 
 static RegisterPass<RemoveInfiniteLoops> RIL("remove-infinite-loops",
-                                             "delete patterns like LABEL: goto LABEL"
-                                             "and replace them with exit(0)");
+                                             "terminate the paths that enter "
+                                             "cycles without exits");
 char RemoveInfiniteLoops::ID;
 
 bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2);
 
+Function *RemoveInfiniteLoops::getTerminate(Module& M) {
+  LLVMContext& Ctx = M.getContext();
+  Type *argTy = Type::getInt32Ty(Ctx);
+  auto C = insertFunction(M, Action == "exit" ? "exit" : "__VERIFIER_assume",
+                          Type::getVoidTy(Ctx),
+                          {argTy});
+  return functionOf(C);
+}
+
 bool RemoveInfiniteLoops::runOnFunction(Function &F) {
-  Module *M = F.getParent();
+  if (F.isDeclaration())
+    return false;
 
-  std::vector<BasicBlock *> to_process;
-  for (BasicBlock& block : F) {
-    if (isLoop(&block))
-        to_process.push_back(&block);
+  // collect the loops first, scc_iterator must not see the changes
+  std::vector<std::vector<BasicBlock *>> loops;
+  for (auto I = scc_begin(&F); !I.isAtEnd(); ++I) {
+    if (I.hasCycle() && isInfiniteLoop(*I))
+      loops.push_back(*I);
   }
 
-  if (to_process.empty())
+  if (loops.empty())
     return false;
 
-  CallInst* ext;
+  Module *M = F.getParent();
   LLVMContext& Ctx = M->getContext();
-  Type *argTy = Type::getInt32Ty(Ctx);
-  auto C = M->getOrInsertFunction("__VERIFIER_assume",
-                                  Type::getVoidTy(Ctx),
-                                  argTy
-#if LLVM_VERSION_MAJOR < 5
-                                  , nullptr
-#endif
-                                  );
-#if LLVM_VERSION_MAJOR >= 9
-  auto extF = cast<Function>(C.getCallee()->stripPointerCasts());
-#else
-  auto extF = cast<Function>(C->stripPointerCasts());
-#endif
-
-  std::vector<Value *> args = { ConstantInt::get(argTy, 0) };
-
-  for (BasicBlock *block : to_process) {
-    Instruction *T = block->getTerminator();
-    ext = CallInst::Create(extF, args);
-    CloneMetadata(&*(block->begin()), ext);
-    ext->insertBefore(T);
-
-    // replace the jump with unreachable,
-    // since the assume(0) will terminate the computation
-    new UnreachableInst(Ctx, T);
-    T->eraseFromParent();
+  Function *terminate = getTerminate(*M);
+  std::vector<Value *> args = { ConstantInt::get(Type::getInt32Ty(Ctx), 0) };
+
+  for (auto& loop : loops) {
+    for (BasicBlock *block : loop) {
+      Instruction *T = block->getTerminator();
+      CallInst *ext = CallInst::Create(terminate, args);
+      CloneMetadata(&*(block->begin()), ext);
+      ext->insertBefore(T);
+
+      // replace the jump with unreachable,
+      // since the call will terminate the computation
+      for (unsigned i = 0, e = T->getNumSuccessors(); i < e; ++i)
+        T->getSuccessor(i)->removePredecessor(block);
+      new UnreachableInst(Ctx, T);
+      T->eraseFromParent();
+    }
   }
 
-  llvm::errs() << "Removed infinite loop in " << F.getName().data() << "\n";
+  llvm::errs() << "Removed " << loops.size() << " infinite loop(s) in "
+               << F.getName().data() << "\n";
   return true;
 }
-
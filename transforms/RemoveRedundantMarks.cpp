@@ -0,0 +1,295 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Remove the marks of the memsafety instrumentation (__INSTR_mark_* before
+// a load or a store) that are redundant: the access is dominated by
+// a marked access through the same pointer of at least the same size
+// (a marked store covers also loads) and no call (that could free
+// the memory or end its scope) is on any path between them. The marks are
+// the slicing criteria and -mark-volatile makes the marked accesses
+// volatile, every removed mark frees the code for the slicer and for the
+// optimizations.
+//
+// With -remove-redundant-marks-hoist, the marked loads of loop-invariant
+// pointers in innermost loops without calls are checked once in the
+// preheader (a marked volatile load) instead of on every iteration,
+// if they are executed on every iteration of the loop.
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+static cl::opt<bool> Hoist("remove-redundant-marks-hoist",
+        cl::desc("Check the loop-invariant marked loads in the preheaders "
+                 "of loops (default=true)"),
+        cl::init(true));
+
+namespace {
+
+// a mark and the access after it
+struct Mark {
+  CallInst *call;
+  Instruction *access;
+  const Value *ptr;
+  uint64_t size;
+  bool store;
+};
+
+class RemoveRedundantMarks : public FunctionPass {
+  unsigned removed{0};
+  unsigned hoisted{0};
+
+  // the blocks with an instruction that may change the validity of memory
+  std::set<const BasicBlock *> _dirty;
+
+  bool noCallBetween(const Instruction *from, const Instruction *to) const;
+  bool covers(const Mark& first, const Mark& second,
+              const DominatorTree& DT) const;
+  bool hoist(Loop *L, std::vector<Mark>& marks, const DominatorTree& DT);
+
+public:
+  static char ID;
+
+  RemoveRedundantMarks() : FunctionPass(ID) {}
+
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<DominatorTreeWrapperPass>();
+    AU.addRequired<LoopInfoWrapperPass>();
+  }
+
+  bool runOnFunction(Function& F) override;
+
+  bool doFinalization(Module& /*M*/) override {
+    if (removed > 0)
+      errs() << "Removed " << removed << " redundant marks of accesses ("
+             << hoisted << " checked in preheaders)\n";
+    return false;
+  }
+};
+
+} // namespace
+
+static RegisterPass<RemoveRedundantMarks> RRM("remove-redundant-marks",
+                                              "Remove the marks of accesses "
+                                              "that are checked already");
+char RemoveRedundantMarks::ID;
+
+static bool isMark(const Instruction *I) {
+  auto *CI = dyn_cast<CallInst>(I);
+  if (!CI || CI->isInlineAsm())
+    return false;
+  auto *callee = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+  return callee && callee->getName().startswith("__INSTR_mark_");
+}
+
+// Can the instruction change the validity of memory?
+// (the same as in -mark-volatile, all calls except marks
+// and debugging intrinsics)
+static bool mayChangeValidity(const Instruction *I) {
+  if (!isa<CallInst>(I) && !isa<InvokeInst>(I))
+    return false;
+  if (isa<DbgInfoIntrinsic>(I))
+    return false;
+  return !isMark(I);
+}
+
+static bool getMark(CallInst *CI, const DataLayout& DL, Mark& mark) {
+  if (!isMark(CI) || !CI->use_empty())
+    return false;
+  Instruction *next = CI->getNextNode();
+  mark.call = CI;
+  mark.access = next;
+  if (auto *LI = dyn_cast_or_null<LoadInst>(next)) {
+    mark.ptr = LI->getPointerOperand()->stripPointerCasts();
+    mark.size = DL.getTypeStoreSize(LI->getType());
+    mark.store = false;
+    return true;
+  }
+  if (auto *SI = dyn_cast_or_null<StoreInst>(next)) {
+    mark.ptr = SI->getPointerOperand()->stripPointerCasts();
+    mark.size = DL.getTypeStoreSize(SI->getValueOperand()->getType());
+    mark.store = true;
+    return true;
+  }
+  return false;
+}
+
+// no instruction that may change the validity of memory is on any path
+// from 'from' to 'to' ('from' dominates 'to')
+bool RemoveRedundantMarks::noCallBetween(const Instruction *from,
+                                         const Instruction *to) const {
+  const BasicBlock *P = from->getParent();
+  const BasicBlock *B = to->getParent();
+  if (P == B) {
+    for (auto *I = from->getNextNode(); I != to; I = I->getNextNode()) {
+      if (mayChangeValidity(I))
+        return false;
+    }
+    return true;
+  }
+
+  for (auto *I = from->getNextNode(); I; I = I->getNextNode()) {
+    if (mayChangeValidity(I))
+      return false;
+  }
+  for (auto *I = &B->front(); I != to; I = I->getNextNode()) {
+    if (mayChangeValidity(I))
+      return false;
+  }
+
+  // the blocks that can reach B (without going through B)
+  std::set<const BasicBlock *> toB;
+  std::vector<const BasicBlock *> stack(pred_begin(B), pred_end(B));
+  while (!stack.empty()) {
+    const BasicBlock *X = stack.back();
+    stack.pop_back();
+    if (X == B || !toB.insert(X).second)
+      continue;
+    stack.insert(stack.end(), pred_begin(X), pred_end(X));
+  }
+
+  // the blocks between P and B
+  std::set<const BasicBlock *> visited;
+  stack.assign(succ_begin(P), succ_end(P));
+  while (!stack.empty()) {
+    const BasicBlock *X = stack.back();
+    stack.pop_back();
+    if (X == B || !toB.count(X) || !visited.insert(X).second)
+      continue;
+    if (_dirty.count(X))
+      return false;
+    stack.insert(stack.end(), succ_begin(X), succ_end(X));
+  }
+  return true;
+}
+
+bool RemoveRedundantMarks::covers(const Mark& first, const Mark& second,
+                                  const DominatorTree& DT) const {
+  return first.ptr == second.ptr && first.size >= second.size &&
+         (first.store || !second.store) &&
+         DT.dominates(first.access, second.call) &&
+         noCallBetween(first.access, second.call);
+}
+
+// check the loop-invariant marked loads of L in its preheader
+bool RemoveRedundantMarks::hoist(Loop *L, std::vector<Mark>& marks,
+                                 const DominatorTree& DT) {
+  BasicBlock *preheader = L->getLoopPreheader();
+  if (!preheader || !L->getSubLoops().empty())
+    return false;
+  for (const BasicBlock *B : L->blocks()) {
+    if (_dirty.count(B))
+      return false;
+  }
+
+  SmallVector<BasicBlock *, 4> exiting, latches;
+  L->getExitingBlocks(exiting);
+  L->getLoopLatches(latches);
+
+  bool changed = false;
+  for (Mark& mark : marks) {
+    auto *LI = dyn_cast<LoadInst>(mark.access);
+    if (!LI || LI->isVolatile() || !L->contains(LI))
+      continue;
+    // (the casts of the pointer can be hoisted)
+    bool invariant = L->makeLoopInvariant(LI->getPointerOperand(), changed);
+    for (Value *arg : mark.call->args())
+      invariant = invariant && L->makeLoopInvariant(arg, changed);
+    if (!invariant)
+      continue;
+
+    // the load is executed on every iteration
+    // (and on the first one before leaving the loop)
+    const BasicBlock *B = LI->getParent();
+    bool always = true;
+    for (BasicBlock *E : exiting)
+      always &= DT.dominates(B, E);
+    for (BasicBlock *T : latches)
+      always &= DT.dominates(B, T);
+    if (!always)
+      continue;
+
+    Instruction *pos = preheader->getTerminator();
+    auto *newMark = cast<CallInst>(mark.call->clone());
+    newMark->insertBefore(pos);
+    auto *check = cast<LoadInst>(LI->clone());
+    check->setName("check");
+    check->setVolatile(true);
+    check->insertBefore(pos);
+
+    mark.call->eraseFromParent();
+    mark.call = newMark;
+    mark.access = check;
+    ++hoisted;
+    ++removed;
+    changed = true;
+  }
+  return changed;
+}
+
+bool RemoveRedundantMarks::runOnFunction(Function& F) {
+  const DataLayout& DL = F.getParent()->getDataLayout();
+  std::vector<Mark> marks;
+  _dirty.clear();
+  for (Instruction& I : instructions(F)) {
+    Mark mark;
+    if (auto *CI = dyn_cast<CallInst>(&I)) {
+      if (getMark(CI, DL, mark))
+        marks.push_back(mark);
+    }
+    if (mayChangeValidity(&I))
+      _dirty.insert(I.getParent());
+  }
+  if (marks.empty())
+    return false;
+
+  auto& DT = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
+  auto& LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+
+  bool modified = false;
+  if (Hoist) {
+    for (Loop *L : LI.getLoopsInPreorder())
+      modified |= hoist(L, marks, DT);
+  }
+
+  // the kept marks of every pointer (in the order of the instructions,
+  // a dominating mark comes first, the hoisted marks dominate the loops)
+  std::map<const Value *, std::vector<const Mark *>> kept;
+  for (Mark& mark : marks) {
+    bool redundant = false;
+    for (const Mark *first : kept[mark.ptr]) {
+      if (covers(*first, mark, DT)) {
+        redundant = true;
+        break;
+      }
+    }
+    if (redundant) {
+      mark.call->eraseFromParent();
+      ++removed;
+      modified = true;
+    } else {
+      kept[mark.ptr].push_back(&mark);
+    }
+  }
+
+  return modified;
+}
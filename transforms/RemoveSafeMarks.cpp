@@ -0,0 +1,205 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// The memsafety instrumentation puts a call of __INSTR_mark_* before every
+// access that it could not prove safe. The marked accesses are made volatile
+// (-mark-volatile) and they are the slicing criteria, so every mark blocks
+// optimizations and slicing. This pass removes the marks of loads, stores
+// and memory intrinsics that access a fixed-size alloca or global only
+// in bounds, using ScalarEvolution for the offsets (e.g. in loops).
+
+#include <cassert>
+#include <set>
+#include <vector>
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+namespace {
+
+class RemoveSafeMarks : public FunctionPass {
+  unsigned removed{0};
+
+  bool isSafe(ScalarEvolution& SE, const DataLayout& DL,
+              Value *ptr, const SCEV *len);
+  bool isSafe(ScalarEvolution& SE, const DataLayout& DL, Instruction *I);
+
+public:
+  static char ID;
+
+  RemoveSafeMarks() : FunctionPass(ID) {}
+
+  void getAnalysisUsage(AnalysisUsage& AU) const override {
+    AU.addRequired<ScalarEvolutionWrapperPass>();
+  }
+
+  bool runOnFunction(Function& F) override;
+
+  bool doFinalization(Module& /*M*/) override {
+    if (removed > 0)
+      errs() << "Removed " << removed << " marks of safe accesses\n";
+    return false;
+  }
+};
+
+} // namespace
+
+static RegisterPass<RemoveSafeMarks> RSM("remove-safe-marks",
+                                         "Remove the marks of accesses "
+                                         "that are in bounds");
+char RemoveSafeMarks::ID;
+
+// does the alloca live in the whole function? With lifetime markers,
+// an in-bounds access can still be out of the scope of the variable
+static bool hasLifetimeMarkers(const Value *V, std::set<const Value *>& visited) {
+  if (!visited.insert(V).second)
+    return false;
+
+  for (const User *U : V->users()) {
+    if (auto *II = dyn_cast<IntrinsicInst>(U)) {
+      if (II->getIntrinsicID() == Intrinsic::lifetime_start ||
+          II->getIntrinsicID() == Intrinsic::lifetime_end)
+        return true;
+    } else if (isa<BitCastInst>(U) || isa<GetElementPtrInst>(U)) {
+      if (hasLifetimeMarkers(U, visited))
+        return true;
+    }
+  }
+
+  return false;
+}
+
+// the size of the memory object or 0 if it is not known
+static uint64_t getObjectSize(const DataLayout& DL, const Value *V) {
+  if (auto *AI = dyn_cast<AllocaInst>(V)) {
+    if (!AI->isStaticAlloca())
+      return 0;
+
+    std::set<const Value *> visited;
+    if (hasLifetimeMarkers(AI, visited))
+      return 0;
+
+    auto *C = cast<ConstantInt>(AI->getArraySize());
+    return DL.getTypeAllocSize(AI->getAllocatedType()) * C->getZExtValue();
+  }
+
+  if (auto *GV = dyn_cast<GlobalVariable>(V)) {
+    // the definition may have a different size
+    if (GV->isDeclaration() || GV->isInterposable())
+      return 0;
+    if (!GV->getValueType()->isSized())
+      return 0;
+    return DL.getTypeAllocSize(GV->getValueType());
+  }
+
+  return 0;
+}
+
+// is the access to [ptr, ptr + len) in bounds of an alloca or global?
+bool RemoveSafeMarks::isSafe(ScalarEvolution& SE, const DataLayout& DL,
+                             Value *ptr, const SCEV *len) {
+  if (!SE.isSCEVable(ptr->getType()))
+    return false;
+
+  const SCEV *ptrS = SE.getSCEV(ptr);
+  auto *base = dyn_cast<SCEVUnknown>(SE.getPointerBase(ptrS));
+  if (!base)
+    return false;
+
+  uint64_t size = getObjectSize(DL, base->getValue());
+  if (size == 0)
+    return false;
+
+  const SCEV *offset = SE.getMinusSCEV(ptrS, base);
+  if (isa<SCEVCouldNotCompute>(offset))
+    return false;
+
+  ConstantRange off = SE.getSignedRange(offset);
+  ConstantRange lenR = SE.getUnsignedRange(len);
+  if (off.isSignWrappedSet() || lenR.isWrappedSet())
+    return false;
+
+  // offset >= 0 && offset + len <= size (in 128 bits, no overflow there)
+  APInt minOff = off.getSignedMin().sext(128);
+  APInt maxEnd = off.getSignedMax().sext(128) + lenR.getUnsignedMax().zext(128);
+  return !minOff.isNegative() && maxEnd.ule(APInt(128, size));
+}
+
+bool RemoveSafeMarks::isSafe(ScalarEvolution& SE, const DataLayout& DL,
+                             Instruction *I) {
+  Type *SizeTy = DL.getIntPtrType(I->getContext());
+
+  if (auto *LI = dyn_cast<LoadInst>(I)) {
+    return isSafe(SE, DL, LI->getPointerOperand(),
+                  SE.getConstant(SizeTy, DL.getTypeStoreSize(LI->getType())));
+  } else if (auto *SI = dyn_cast<StoreInst>(I)) {
+    Type *Ty = SI->getValueOperand()->getType();
+    return isSafe(SE, DL, SI->getPointerOperand(),
+                  SE.getConstant(SizeTy, DL.getTypeStoreSize(Ty)));
+  } else if (auto *MI = dyn_cast<MemIntrinsic>(I)) {
+    if (!SE.isSCEVable(MI->getLength()->getType()))
+      return false;
+    const SCEV *len = SE.getSCEV(MI->getLength());
+    if (!isSafe(SE, DL, MI->getRawDest(), len))
+      return false;
+    if (auto *MT = dyn_cast<MemTransferInst>(MI))
+      return isSafe(SE, DL, MT->getRawSource(), len);
+    return true;
+  }
+
+  return false;
+}
+
+bool RemoveSafeMarks::runOnFunction(Function& F) {
+  std::vector<CallInst *> marks;
+  for (Instruction& I : instructions(F)) {
+    auto *CI = dyn_cast<CallInst>(&I);
+    if (!CI || CI->isInlineAsm() || !CI->use_empty())
+      continue;
+
+    const Value *val = calleeOf(CI)->stripPointerCasts();
+    const Function *callee = dyn_cast<Function>(val);
+    if (!callee || !callee->getName().startswith("__INSTR_mark_"))
+      continue;
+
+    // the marked instruction is right after the mark (see -mark-volatile)
+    Instruction *next = CI->getNextNode();
+    if (next && (isa<LoadInst>(next) || isa<StoreInst>(next) ||
+                 isa<MemIntrinsic>(next)))
+      marks.push_back(CI);
+  }
+
+  if (marks.empty())
+    return false;
+
+  auto& SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+  const DataLayout& DL = F.getParent()->getDataLayout();
+
+  bool modified = false;
+  for (CallInst *CI : marks) {
+    if (isSafe(SE, DL, CI->getNextNode())) {
+      CI->eraseFromParent();
+      ++removed;
+      modified = true;
+    }
+  }
+
+  return modified;
+}
@@ -4,10 +4,7 @@
 // License. See LICENSE.TXT for details.
 
 #include <cassert>
-#include <map>
 #include <vector>
-#include <set>
-#include <fstream>
 #include <sstream>
 
 #include "llvm/IR/DataLayout.h"
@@ -29,6 +26,9 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include "Compat.h"
+#include "SourceLines.h"
+
 using namespace llvm;
 
 static cl::opt<std::string> source_name("rename-verifier-funs-source",
@@ -40,8 +40,9 @@ class RenameVerifierFuns : public ModulePass
 {
   // every item is (line number, call)
   std::vector<std::pair<unsigned, CallInst *>> calls_to_replace;
-  std::set<unsigned> lines_nums;
-  std::map<unsigned, std::string> lines;
+  // do some calls have a line number, so that we need the source?
+  bool need_source = false;
+  const SourceLines *source = nullptr;
 
   void handleCall(Function& F, CallInst *CI);
   void mapLines();
@@ -95,49 +96,31 @@ void RenameVerifierFuns::handleCall(Function& /*F*/, CallInst *CI) {
   const DebugLoc& Loc = CI->getDebugLoc();
   if (Loc) {
 	calls_to_replace.emplace_back(Loc.getLine(), CI);
-    lines_nums.insert(Loc.getLine());
+    need_source = true;
   }
 }
 
 void RenameVerifierFuns::mapLines() {
-  if (lines_nums.empty()) {
+  if (!need_source) {
     assert(calls_to_replace.empty());
     return;
   }
 
-  std::ifstream file(source_name);
-
-  if (file.is_open()) {
-    unsigned n = 1;
-    std::string line;
-
-    while (getline(file,line)) {
-      if (lines_nums.count(n) > 0)
-		lines[n] = std::move(line);
-      ++n;
-    }
-
-    file.close();
-  } else {
+  source = SourceLines::get(source_name);
+  if (!source) {
 	errs() << "Couldn't open file: " << source_name << "\n";
     abort();
   }
-
-  assert(lines.size() == lines_nums.size());
 }
 
 static void replaceCall(Module& M, CallInst *CI, unsigned line, const std::string& var) {
   std::string parent_name = cast<Function>(CI->getParent()->getParent())->getName().str();
   std::string name = parent_name + ":" + var + ":" + std::to_string(line);
   Function *called_func = CI->getCalledFunction();
-  auto new_func = M.getOrInsertFunction(called_func->getName().str() + "_named",
-								        called_func->getAttributes(),
-									    called_func->getReturnType(),
-                                        Type::getInt8PtrTy(M.getContext())
-#if LLVM_VERSION_MAJOR < 5
-                                             , nullptr
-#endif
-                                       );
+  auto new_func = insertFunction(M, called_func->getName().str() + "_named",
+                                 called_func->getAttributes(),
+                                 called_func->getReturnType(),
+                                 {Type::getInt8PtrTy(M.getContext())});
   assert(new_func);
 
   std::vector<Value *> args;
@@ -188,7 +171,8 @@ void RenameVerifierFuns::replaceCalls(Module& M) {
     unsigned line_num = pr.first;
 	CallInst *CI = pr.second;
 
-    std::string line = lines[line_num];
+    assert(source && line_num <= source->size());
+    std::string line = source->getLine(line_num).str();
     assert(!line.empty());
 
     replaceCall(M, CI, line_num, getName(line));
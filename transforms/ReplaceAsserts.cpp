@@ -26,6 +26,8 @@
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include <llvm/IR/DebugInfoMetadata.h>
 
+#include "Compat.h"
+
 using namespace llvm;
 
 llvm::cl::opt<std::string> assert_fn("replace-asserts-fn",
@@ -60,11 +62,7 @@ bool ReplaceAsserts::runOnFunction(Function &F)
       if (CI->isInlineAsm())
         continue;
 
-#if LLVM_VERSION_MAJOR >= 8
-      const Value *val = CI->getCalledOperand()->stripPointerCasts();
-#else
-      const Value *val = CI->getCalledValue()->stripPointerCasts();
-#endif
+      const Value *val = calleeOf(CI)->stripPointerCasts();
       const Function *callee = dyn_cast<Function>(val);
       if (!callee || callee->isIntrinsic())
         continue;
@@ -79,17 +77,10 @@ bool ReplaceAsserts::runOnFunction(Function &F)
 
       if (!ver_err) {
         LLVMContext& Ctx = M->getContext();
-        auto C = M->getOrInsertFunction("__VERIFIER_error",
-                                        Type::getVoidTy(Ctx)
-#if LLVM_VERSION_MAJOR < 5
-                                         , nullptr
-#endif
-                                         );
-#if LLVM_VERSION_MAJOR >= 9
-        ver_err = cast<Function>(C.getCallee()->stripPointerCasts());
-#else
-        ver_err = cast<Function>(C);
-#endif
+        auto C = insertFunction(*M, "__VERIFIER_error",
+                                Type::getVoidTy(Ctx),
+                                {});
+        ver_err = functionOf(C);
       }
 
       auto CI2 = CallInst::Create(ver_err);
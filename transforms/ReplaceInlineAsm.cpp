@@ -0,0 +1,469 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Replace the common idioms of inline assembly (as in the kernel code)
+// by their equivalents in LLVM IR, the verifiers do not handle inline
+// assembly (the other passes skip these calls). The replaced idioms are:
+//
+//  - compiler barriers and no-ops ("", nop, pause) are removed,
+//    memory fences (mfence, lfence, sfence, lock; addl $0,(%esp))
+//    become the fence instruction,
+//  - bswap becomes llvm.bswap,
+//  - the lock-prefixed read-modify-write instructions (inc, dec, add, sub,
+//    and, or, xor, xadd, cmpxchg) and xchg become atomicrmw/cmpxchg,
+//  - the instructions that read the state of the processor (rdtsc, cpuid,
+//    rdrand, ...) return nondeterministic values.
+//
+// The rest of inline assembly is kept.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+#include "NondetBuilder.h"
+
+using namespace llvm;
+
+bool CloneMetadata(const llvm::Instruction *, llvm::Instruction *);
+
+namespace {
+
+// one instruction of the assembly
+struct AsmInsn {
+  std::string mnemonic;
+  std::vector<std::string> operands;
+  bool lock{false};
+};
+
+std::vector<AsmInsn> parseAsm(StringRef str) {
+  std::vector<AsmInsn> insns;
+  bool lock = false;
+  SmallVector<StringRef, 4> lines;
+  str.split(lines, ';');
+  for (StringRef line : lines) {
+    SmallVector<StringRef, 4> parts;
+    line.split(parts, '\n');
+    for (StringRef part : parts) {
+      part = part.trim(" \t");
+      if (part.empty())
+        continue;
+      if (part == "lock") {
+        lock = true;
+        continue;
+      }
+      // (as in rep; nop)
+      if (part == "rep")
+        continue;
+      if (part.startswith("lock ")) {
+        lock = true;
+        part = part.drop_front(5).ltrim(" \t");
+      }
+
+      AsmInsn insn;
+      auto split = part.split(' ');
+      insn.mnemonic = split.first.str();
+      SmallVector<StringRef, 2> ops;
+      split.second.split(ops, ',', -1, false);
+      for (StringRef op : ops)
+        insn.operands.push_back(op.trim(" \t").str());
+      insn.lock = lock;
+      lock = false;
+      insns.push_back(insn);
+    }
+  }
+  return insns;
+}
+
+// the number of the operand ($N or ${N:modifier}), or -1
+int getOperandNumber(StringRef op) {
+  if (!op.consume_front("$") || op.startswith("$"))
+    return -1;
+  if (op.consume_front("{"))
+    op = op.take_until([](char c) { return c == ':' || c == '}'; });
+  unsigned N;
+  if (op.getAsInteger(10, N))
+    return -1;
+  return N;
+}
+
+// the immediate operand ($$N)
+bool getImmediate(StringRef op, int64_t& val) {
+  return op.consume_front("$$") && !op.getAsInteger(0, val);
+}
+
+// the base of the mnemonic without the suffix with the width
+// (incl -> inc), if it is one of the given mnemonics
+StringRef getBase(StringRef mnem, const StringSet<>& bases) {
+  if (bases.count(mnem))
+    return mnem;
+  if (!mnem.empty() && StringRef("bwlq").contains(mnem.back()) &&
+      bases.count(mnem.drop_back()))
+    return mnem.drop_back();
+  return "";
+}
+
+// how the operands of the assembly map to the arguments and the results
+// of the call
+class Operands {
+  CallInst *CI;
+  InlineAsm::ConstraintInfoVector constraints;
+  std::vector<int> args, results;
+  unsigned numResults{0};
+
+public:
+  Operands(CallInst *CI, InlineAsm *IA) : CI(CI), constraints(IA->ParseConstraints()) {
+    int arg = 0;
+    for (auto& C : constraints) {
+      args.push_back(-1);
+      results.push_back(-1);
+      if (C.Type == InlineAsm::isClobber)
+        continue;
+      if (C.Type == InlineAsm::isOutput && !C.isIndirect)
+        results.back() = numResults++;
+      else
+        args.back() = arg++;
+    }
+  }
+
+  unsigned size() const { return constraints.size(); }
+  unsigned getNumResults() const { return numResults; }
+  bool hasIndirectOutput() const {
+    for (auto& C : constraints)
+      if (C.Type == InlineAsm::isOutput && C.isIndirect)
+        return true;
+    return false;
+  }
+
+  // the result that the register operand k is returned in, or -1
+  int getResult(int k) const {
+    return k >= 0 && k < (int)size() ? results[k] : -1;
+  }
+
+  // the value of the operand k before the assembly runs
+  // (an input, or the input tied to the output k)
+  Value *getValue(int k) const {
+    if (k < 0 || k >= (int)size())
+      return nullptr;
+    auto& C = constraints[k];
+    if (C.Type == InlineAsm::isInput && !C.isIndirect && args[k] >= 0)
+      return CI->getArgOperand(args[k]);
+    if (results[k] >= 0 && C.hasMatchingInput())
+      return getValue(C.MatchingInput);
+    return nullptr;
+  }
+
+  // the memory operand k and the type of its value
+  Value *getPointer(int k, Type *& Ty) const {
+    if (k < 0 || k >= (int)size() || !constraints[k].isIndirect || args[k] < 0)
+      return nullptr;
+    Value *ptr = CI->getArgOperand(args[k]);
+    Ty = nullptr;
+#if LLVM_VERSION_MAJOR >= 14
+    if (CI->paramHasAttr(args[k], Attribute::ElementType))
+      Ty = CI->getParamAttr(args[k], Attribute::ElementType).getValueAsType();
+#endif
+#if LLVM_VERSION_MAJOR < 15
+    if (!Ty)
+      Ty = ptr->getType()->getPointerElementType();
+#endif
+    return Ty ? ptr : nullptr;
+  }
+
+  // the output register with the given constraint code (e.g., {ax})
+  int getOutput(StringRef code) const {
+    for (unsigned k = 0; k < size(); ++k) {
+      auto& C = constraints[k];
+      if (results[k] >= 0 && C.Codes.size() == 1 && C.Codes[0] == code)
+        return k;
+    }
+    return -1;
+  }
+};
+
+class ReplaceInlineAsm : public ModulePass {
+  std::unique_ptr<NondetBuilder> _nondet;
+
+  bool replaceBarrier(CallInst *CI, const std::vector<AsmInsn>& insns);
+  bool replaceBswap(CallInst *CI, const Operands& ops, const AsmInsn& insn);
+  bool replaceAtomic(CallInst *CI, const Operands& ops, const AsmInsn& insn);
+  bool replaceByNondet(CallInst *CI, const Operands& ops);
+  bool replace(CallInst *CI);
+
+public:
+  static char ID;
+
+  ReplaceInlineAsm() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<ReplaceInlineAsm> RIA("replace-inline-asm",
+                                          "Replace the common idioms of inline "
+                                          "assembly by LLVM IR");
+char ReplaceInlineAsm::ID;
+
+// the whole assembly is a barrier or does nothing
+bool ReplaceInlineAsm::replaceBarrier(CallInst *CI,
+                                      const std::vector<AsmInsn>& insns) {
+  if (!CI->getType()->isVoidTy())
+    return false;
+
+  bool fence = false;
+  for (auto& insn : insns) {
+    StringRef mnem = insn.mnemonic;
+    if (mnem == "nop" || mnem == "pause")
+      continue;
+    if (mnem == "mfence" || mnem == "lfence" || mnem == "sfence") {
+      fence = true;
+      continue;
+    }
+    // lock; addl $0,0(%esp) (or orl) is the fence on old processors
+    int64_t imm;
+    if (insn.lock && !getBase(mnem, {"add", "or"}).empty() &&
+        insn.operands.size() == 2 && getImmediate(insn.operands[0], imm) &&
+        imm == 0 && StringRef(insn.operands[1]).endswith("sp)")) {
+      fence = true;
+      continue;
+    }
+    return false;
+  }
+
+  if (fence) {
+    auto *FI = new FenceInst(CI->getContext(),
+#if LLVM_VERSION_MAJOR >= 5
+                             AtomicOrdering::SequentiallyConsistent,
+                             SyncScope::System,
+#else
+                             SequentiallyConsistent,
+#endif
+                             CI);
+    CloneMetadata(CI, FI);
+  }
+  CI->eraseFromParent();
+  return true;
+}
+
+// bswap $0 with the output tied to the input
+bool ReplaceInlineAsm::replaceBswap(CallInst *CI, const Operands& ops,
+                                    const AsmInsn& insn) {
+  if (getBase(insn.mnemonic, {"bswap"}).empty() || insn.operands.size() != 1 ||
+      ops.getNumResults() != 1)
+    return false;
+  int k = getOperandNumber(insn.operands[0]);
+  Value *val = ops.getValue(k);
+  if (ops.getResult(k) != 0 || !val || val->getType() != CI->getType() ||
+      !CI->getType()->isIntegerTy() || CI->getType()->getIntegerBitWidth() % 16)
+    return false;
+
+  Function *bswap = Intrinsic::getDeclaration(CI->getModule(), Intrinsic::bswap,
+                                              {CI->getType()});
+  auto *newCI = CallInst::Create(bswap, {val}, "", CI);
+  CloneMetadata(CI, newCI);
+  CI->replaceAllUsesWith(newCI);
+  CI->eraseFromParent();
+  return true;
+}
+
+// a lock-prefixed read-modify-write instruction or xchg
+bool ReplaceInlineAsm::replaceAtomic(CallInst *CI, const Operands& ops,
+                                     const AsmInsn& insn) {
+  static const StringSet<> locked = {"inc", "dec", "add", "sub", "and",
+                                     "or", "xor", "xadd", "cmpxchg", "xchg"};
+  StringRef op = getBase(insn.mnemonic, locked);
+  // xchg with memory is always locked
+  if (op.empty() || (!insn.lock && op != "xchg"))
+    return false;
+
+  std::vector<int> nums;
+  for (auto& str : insn.operands)
+    nums.push_back(getOperandNumber(str));
+
+  // the memory, the source value and the register that gets
+  // the old value (or -1)
+  Value *ptr = nullptr, *src = nullptr;
+  Type *Ty = nullptr;
+  int written = -1;
+  if (op == "inc" || op == "dec") {
+    if (nums.size() != 1)
+      return false;
+    ptr = ops.getPointer(nums[0], Ty);
+    if (ptr && Ty->isIntegerTy())
+      src = ConstantInt::get(Ty, 1);
+  } else if (nums.size() == 2) {
+    if (op == "xchg" && ops.getPointer(nums[0], Ty))
+      std::swap(nums[0], nums[1]);
+    ptr = ops.getPointer(nums[1], Ty);
+    int64_t imm;
+    if (ptr && Ty->isIntegerTy() && getImmediate(insn.operands[0], imm))
+      src = ConstantInt::get(Ty, imm);
+    else
+      src = ops.getValue(nums[0]);
+    if (op == "xadd" || op == "xchg")
+      written = nums[0];
+    else if (op == "cmpxchg")
+      written = ops.getOutput("{ax}");
+  }
+  if (!ptr || !src || !Ty->isIntegerTy() || src->getType() != Ty ||
+      ((op == "xadd" || op == "xchg" || op == "cmpxchg") &&
+       ops.getResult(written) < 0))
+    return false;
+
+  Value *expected = nullptr;
+  if (op == "cmpxchg") {
+    expected = ops.getValue(written);
+    if (!expected || expected->getType() != Ty)
+      return false;
+  }
+
+  // the other results must keep the values of the inputs
+  std::vector<Value *> results(ops.getNumResults(), nullptr);
+  for (unsigned k = 0; k < ops.size(); ++k) {
+    int r = ops.getResult(k);
+    if (r < 0 || (int)k == written)
+      continue;
+    if (!(results[r] = ops.getValue(k)))
+      return false;
+  }
+
+  auto ordering = AtomicOrdering::SequentiallyConsistent;
+#if LLVM_VERSION_MAJOR >= 13
+  // (the natural alignment of the atomic instructions)
+  Align align(CI->getModule()->getDataLayout().getTypeStoreSize(Ty));
+#endif
+  Instruction *old;
+  if (op == "cmpxchg") {
+    auto *CX = new AtomicCmpXchgInst(ptr, expected, src,
+#if LLVM_VERSION_MAJOR >= 13
+                                     align,
+#endif
+                                     ordering, ordering,
+                                     SyncScope::System, CI);
+    CloneMetadata(CI, CX);
+    old = ExtractValueInst::Create(CX, {0}, "", CI);
+  } else {
+    AtomicRMWInst::BinOp binop = AtomicRMWInst::Xchg;
+    if (op == "inc" || op == "add" || op == "xadd")
+      binop = AtomicRMWInst::Add;
+    else if (op == "dec" || op == "sub")
+      binop = AtomicRMWInst::Sub;
+    else if (op == "and")
+      binop = AtomicRMWInst::And;
+    else if (op == "or")
+      binop = AtomicRMWInst::Or;
+    else if (op == "xor")
+      binop = AtomicRMWInst::Xor;
+    old = new AtomicRMWInst(binop, ptr, src,
+#if LLVM_VERSION_MAJOR >= 13
+                            align,
+#endif
+                            ordering, SyncScope::System, CI);
+  }
+  CloneMetadata(CI, old);
+  if (written >= 0)
+    results[ops.getResult(written)] = old;
+
+  if (!CI->getType()->isVoidTy()) {
+    Value *res = nullptr;
+    if (CI->getType()->isStructTy()) {
+      res = UndefValue::get(CI->getType());
+      for (unsigned r = 0; r < results.size(); ++r)
+        res = InsertValueInst::Create(res, results[r], {r}, "", CI);
+    } else {
+      res = results[0];
+    }
+    CI->replaceAllUsesWith(res);
+  }
+  CI->eraseFromParent();
+  return true;
+}
+
+// an instruction that reads the state of the processor,
+// all the results are nondeterministic
+bool ReplaceInlineAsm::replaceByNondet(CallInst *CI, const Operands& ops) {
+  if (ops.hasIndirectOutput())
+    return false;
+  if (CI->getType()->isVoidTy()) {
+    CI->eraseFromParent();
+    return true;
+  }
+
+  Function *F = CI->getFunction();
+  Type *Ty = CI->getType();
+  const DataLayout& DL = F->getParent()->getDataLayout();
+  auto *AI = makeAlloca(Ty, DL, "", &*F->getEntryBlock().getFirstInsertionPt());
+  auto *CastI = CastInst::CreatePointerCast(AI, Type::getInt8PtrTy(CI->getContext()),
+                                            "", CI);
+  auto *MN = _nondet->createCall(CastI,
+                                 ConstantInt::get(_nondet->getSizeT(),
+                                                  DL.getTypeAllocSize(Ty)),
+                                 F->getName().str() + ":asm:0", CI);
+  MN->insertAfter(CastI);
+  auto *LI = new LoadInst(Ty, AI, "asm",
+#if LLVM_VERSION_MAJOR >= 11
+                          false, AI->getAlign(),
+#endif
+                          CI);
+  CloneMetadata(CI, MN);
+  CloneMetadata(CI, LI);
+  CI->replaceAllUsesWith(LI);
+  CI->eraseFromParent();
+  return true;
+}
+
+bool ReplaceInlineAsm::replace(CallInst *CI) {
+  auto *IA = cast<InlineAsm>(calleeOf(CI));
+  std::vector<AsmInsn> insns = parseAsm(IA->getAsmString());
+  if (replaceBarrier(CI, insns))
+    return true;
+  if (insns.size() != 1)
+    return false;
+
+  static const StringSet<> readsState = {"rdtsc", "rdtscp", "cpuid", "rdrand",
+                                         "rdseed", "rdpid", "xgetbv", "rdpmc"};
+  Operands ops(CI, IA);
+  if (!getBase(insns[0].mnemonic, readsState).empty())
+    return replaceByNondet(CI, ops);
+  return replaceBswap(CI, ops, insns[0]) || replaceAtomic(CI, ops, insns[0]);
+}
+
+bool ReplaceInlineAsm::runOnModule(Module& M) {
+  std::vector<CallInst *> calls;
+  for (Function& F : M) {
+    for (BasicBlock& B : F) {
+      for (Instruction& I : B) {
+        auto *CI = dyn_cast<CallInst>(&I);
+        if (CI && CI->isInlineAsm())
+          calls.push_back(CI);
+      }
+    }
+  }
+  if (calls.empty())
+    return false;
+
+  _nondet.reset(new NondetBuilder(M));
+  unsigned replaced = 0;
+  for (CallInst *CI : calls)
+    replaced += replace(CI);
+  _nondet->finish();
+
+  errs() << "Replaced " << replaced << " of " << calls.size()
+         << " inline assembly calls\n";
+  return replaced > 0;
+}
@@ -22,17 +22,35 @@
 #else
   #include "llvm/Support/InstIterator.h"
 #endif
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include <llvm/IR/DebugInfoMetadata.h>
 
+#include "Compat.h"
+
 using namespace llvm;
 
 bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2);
 
+static cl::opt<bool> skip_unescaped("replace-lifetime-markers-skip-unescaped",
+        cl::desc("Remove the lifetime markers of allocas whose address is not "
+                 "taken (they cannot be accessed out of their scope) "
+                 "(default=false)."),
+        cl::init(false));
+
+static cl::opt<bool> batch("replace-lifetime-markers-batch",
+        cl::desc("Replace consecutive lifetime markers of static allocas with "
+                 "one call of __VERIFIER_scope_enter_n/leave_n that takes "
+                 "an array of the objects (default=false)."),
+        cl::init(false));
+
 namespace {
 
 class ReplaceLifetimeMarkers : public FunctionPass {
+    Function *getScopeFun(Module *M, const char *name, bool many);
+    void replaceGroup(Function &F, std::vector<IntrinsicInst *>& group);
+
   public:
     static char ID;
 
@@ -41,57 +59,170 @@ class ReplaceLifetimeMarkers : public FunctionPass {
     virtual bool runOnFunction(Function &F);
 };
 
-bool ReplaceLifetimeMarkers::runOnFunction(Function &F)
-{
-  bool modified = false;
+static bool isLifetimeMarker(const Instruction *I) {
+  auto *II = dyn_cast<IntrinsicInst>(I);
+  return II && (II->getIntrinsicID() == Intrinsic::lifetime_start ||
+                II->getIntrinsicID() == Intrinsic::lifetime_end);
+}
+
+static AllocaInst *getAlloca(IntrinsicInst *II) {
+  return dyn_cast<AllocaInst>(II->getOperand(1)->stripPointerCasts());
+}
+
+// is the address of the memory used only for loading and storing?
+static bool isAddressTaken(const Value *V) {
+  for (const User *U : V->users()) {
+    if (isa<LoadInst>(U)) {
+      continue;
+    } else if (auto *SI = dyn_cast<StoreInst>(U)) {
+      if (SI->getValueOperand() == V)
+        return true;
+    } else if (isa<DbgInfoIntrinsic>(U) ||
+               isLifetimeMarker(cast<Instruction>(U))) {
+      continue;
+    } else if (isa<BitCastInst>(U) || isa<GetElementPtrInst>(U)) {
+      if (isAddressTaken(U))
+        return true;
+    } else {
+      return true;
+    }
+  }
+  return false;
+}
+
+Function *ReplaceLifetimeMarkers::getScopeFun(Module *M, const char *name,
+                                              bool many) {
+  LLVMContext& Ctx = M->getContext();
+  std::vector<Type *> args;
+  if (many) {
+    // void fun(void **objs, size_t n)
+    args.push_back(Type::getInt8PtrTy(Ctx)->getPointerTo());
+    args.push_back(M->getDataLayout().getIntPtrType(Ctx));
+  } else {
+    // void fun(void *obj)
+    args.push_back(Type::getInt8PtrTy(Ctx));
+  }
+
+  return functionOf(insertFunction(*M, name, Type::getVoidTy(Ctx), args));
+}
+
+// Replace a group of consecutive markers of the same kind
+void ReplaceLifetimeMarkers::replaceGroup(Function &F,
+                                          std::vector<IntrinsicInst *>& group) {
   Module *M = F.getParent();
   LLVMContext& Ctx = M->getContext();
-  auto ver_scope_enterC = M->getOrInsertFunction("__VERIFIER_scope_enter",
-                                                 Type::getVoidTy(Ctx),
-                                                 Type::getInt8PtrTy(Ctx)
-#if LLVM_VERSION_MAJOR < 5
-                                                 , nullptr
-#endif
-                                                 );
-  auto ver_scope_leaveC = M->getOrInsertFunction("__VERIFIER_scope_leave",
-                                                 Type::getVoidTy(Ctx),
-                                                 Type::getInt8PtrTy(Ctx)
-#if LLVM_VERSION_MAJOR < 5
-                                                 , nullptr
+  bool enter = group[0]->getIntrinsicID() == Intrinsic::lifetime_start;
+
+  // the array of the objects is filled once at the beginning of the function,
+  // so all the objects must be static allocas from the entry block
+  // that precede that place
+  BasicBlock& entry = F.getEntryBlock();
+  std::set<AllocaInst *> leading;
+  auto fillPoint = entry.getFirstInsertionPt();
+  while (auto *AI = dyn_cast<AllocaInst>(&*fillPoint)) {
+    leading.insert(AI);
+    ++fillPoint;
+  }
+
+  bool canBatch = batch && group.size() > 1;
+  for (IntrinsicInst *II : group) {
+    AllocaInst *AI = getAlloca(II);
+    if (!canBatch || !AI || !AI->isStaticAlloca() || leading.count(AI) == 0) {
+      canBatch = false;
+      break;
+    }
+  }
+
+  if (!canBatch) {
+    Function *fun = getScopeFun(M, enter ? "__VERIFIER_scope_enter"
+                                         : "__VERIFIER_scope_leave", false);
+    for (IntrinsicInst *II : group) {
+      CallInst *CI = CallInst::Create(fun, { II->getOperand(1) });
+      CloneMetadata(II, CI);
+      CI->insertAfter(II);
+      II->eraseFromParent();
+    }
+    return;
+  }
+
+  Type *I8PtrTy = Type::getInt8PtrTy(Ctx);
+  Type *SizeTy = M->getDataLayout().getIntPtrType(Ctx);
+  ArrayType *ArrTy = ArrayType::get(I8PtrTy, group.size());
+  AllocaInst *objs = makeAlloca(ArrTy, M->getDataLayout(),
+                                enter ? "scope.enter" : "scope.leave",
+                                &*entry.getFirstInsertionPt());
+
+  Instruction *fill = &*fillPoint;
+  for (unsigned i = 0; i < group.size(); ++i) {
+    Value *obj = CastInst::CreatePointerCast(getAlloca(group[i]), I8PtrTy,
+                                             "", fill);
+    Value *idx[] = {ConstantInt::get(SizeTy, 0), ConstantInt::get(SizeTy, i)};
+    Value *slot = GetElementPtrInst::CreateInBounds(
+#if LLVM_VERSION_MAJOR >= 4
+                                                    ArrTy,
 #endif
-                                                 );
-#if LLVM_VERSION_MAJOR >= 9
-  auto ver_scope_enter = cast<Function>(ver_scope_enterC.getCallee());
-  auto ver_scope_leave = cast<Function>(ver_scope_leaveC.getCallee());
-#else
-  auto ver_scope_enter = cast<Function>(ver_scope_enterC);
-  auto ver_scope_leave = cast<Function>(ver_scope_leaveC);
+                                                    objs, idx, "", fill);
+    new StoreInst(obj, slot, fill);
+  }
+
+  Value *idx[] = {ConstantInt::get(SizeTy, 0), ConstantInt::get(SizeTy, 0)};
+  Instruction *last = group.back();
+  Value *first = GetElementPtrInst::CreateInBounds(
+#if LLVM_VERSION_MAJOR >= 4
+                                                   ArrTy,
 #endif
+                                                   objs, idx, "", last);
+  Function *fun = getScopeFun(M, enter ? "__VERIFIER_scope_enter_n"
+                                       : "__VERIFIER_scope_leave_n", true);
+  CallInst *CI = CallInst::Create(fun, { first, ConstantInt::get(SizeTy,
+                                                                 group.size()) });
+  CloneMetadata(last, CI);
+  CI->insertAfter(last);
+
+  for (IntrinsicInst *II : group)
+    II->eraseFromParent();
+}
 
-  for (inst_iterator I = inst_begin(F), E = inst_end(F); I != E;) {
-    Instruction *ins = &*I;
-    ++I;
-    if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(ins)) {
-      if (II->getIntrinsicID() != Intrinsic::lifetime_start &&
-          II->getIntrinsicID() != Intrinsic::lifetime_end)
-          continue;
+bool ReplaceLifetimeMarkers::runOnFunction(Function &F)
+{
+  // groups of consecutive markers of the same kind
+  // (only casts and debugging intrinsics may be between them)
+  std::vector<std::vector<IntrinsicInst *>> groups;
+  std::vector<IntrinsicInst *> removed;
+
+  for (BasicBlock& B : F) {
+    std::vector<IntrinsicInst *> *cur = nullptr;
+    for (Instruction& I : B) {
+      if (!isLifetimeMarker(&I)) {
+        if (!isa<CastInst>(&I) && !isa<DbgInfoIntrinsic>(&I))
+          cur = nullptr;
+        continue;
+      }
 
-        CallInst* CI = nullptr;
-        if (II->getIntrinsicID() == Intrinsic::lifetime_start) {
-            CI = CallInst::Create(ver_scope_enter, { II->getOperand(1) });
-        } else if (II->getIntrinsicID() == Intrinsic::lifetime_end) {
-            CI = CallInst::Create(ver_scope_leave, { II->getOperand(1) });
+      IntrinsicInst *II = cast<IntrinsicInst>(&I);
+      if (skip_unescaped) {
+        AllocaInst *AI = getAlloca(II);
+        if (AI && !isAddressTaken(AI)) {
+          removed.push_back(II);
+          continue;
         }
+      }
 
-        CloneMetadata(II, CI);
-
-        CI->insertAfter(II);
-        II->eraseFromParent();
-
-        modified = true;
+      if (!cur || (*cur)[0]->getIntrinsicID() != II->getIntrinsicID()) {
+        groups.emplace_back();
+        cur = &groups.back();
       }
+      cur->push_back(II);
+    }
   }
-  return modified;
+
+  for (IntrinsicInst *II : removed)
+    II->eraseFromParent();
+
+  for (auto& group : groups)
+    replaceGroup(F, group);
+
+  return !groups.empty() || !removed.empty();
 }
 
 } // namespace
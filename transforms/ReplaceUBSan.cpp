@@ -26,6 +26,8 @@
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include <llvm/IR/DebugInfoMetadata.h>
 
+#include "Compat.h"
+
 using namespace llvm;
 
 bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2);
@@ -64,11 +66,7 @@ bool ReplaceUBSan::runOnFunction(Function &F)
       if (CI->isInlineAsm())
         continue;
 
-#if LLVM_VERSION_MAJOR >= 8
-      const Value *val = CI->getCalledOperand()->stripPointerCasts();
-#else
-      const Value *val = CI->getCalledValue()->stripPointerCasts();
-#endif
+      const Value *val = calleeOf(CI)->stripPointerCasts();
       const Function *callee = dyn_cast<Function>(val);
       if (!callee || callee->isIntrinsic())
         continue;
@@ -92,17 +90,10 @@ bool ReplaceUBSan::runOnFunction(Function &F)
         // replace
         if (!ver_err) {
           LLVMContext& Ctx = M->getContext();
-          auto C = M->getOrInsertFunction("__VERIFIER_error",
-                                          Type::getVoidTy(Ctx)
-#if LLVM_VERSION_MAJOR < 5
-                                          , nullptr
-#endif
-                                         );
-#if LLVM_VERSION_MAJOR >= 9
-          ver_err = cast<Function>(C.getCallee()->stripPointerCasts());
-#else
-          ver_err = cast<Function>(C);
-#endif
+          auto C = insertFunction(*M, "__VERIFIER_error",
+                                  Type::getVoidTy(Ctx),
+                                  {});
+          ver_err = functionOf(C);
         }
 
         auto CI2 = CallInst::Create(ver_err);
@@ -4,17 +4,26 @@
 // License. See LICENSE.TXT for details.
 
 #include <cassert>
+#include <map>
+#include <set>
 #include <vector>
 
+#include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/Type.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
 
 #if LLVM_VERSION_MAJOR >= 4 || (LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR >= 5)
   #include "llvm/IR/InstIterator.h"
@@ -29,14 +38,202 @@ bool CloneMetadata(const llvm::Instruction *i1, llvm::Instruction *i2);
 
 namespace {
 
+// The atomic sections (the code between __VERIFIER_atomic_begin and
+// __VERIFIER_atomic_end) are implemented by locking a mutex. Instead of
+// one global lock for all sections, give the same lock only to the
+// sections that may access the same memory, so that the stateless model
+// checkers do not explore the interleavings of independent sections.
+//
+// A section starts at a call of begin and spans all the code reachable
+// from it in the function until a call of end. The objects that
+// a section accesses are the underlying globals and allocas of the
+// pointers of its memory accesses. A section whose memory is not known
+// (it calls a function, accesses memory through a loaded pointer or leaves
+// the function without calling end) and the calls of end that no known
+// section reaches use the region 0, the global lock of the models.
+// The calls of begin and end of a section are replaced by calls of
+// __symbiotic_atomic_begin/end_region with the number of the region.
 class ReplaceVerifierAtomic : public ModulePass {
+    // what one section accesses
+    struct Section {
+        std::vector<CallInst *> ends;
+        std::set<const Value *> objects;
+        bool unknown{false};
+    };
+
+    static bool isCallOf(const Instruction& I, StringRef a, StringRef b) {
+        auto *CI = dyn_cast<CallInst>(&I);
+        if (!CI)
+            return false;
+        auto *F = dyn_cast<Function>(calleeOf(CI)->stripPointerCasts());
+        return F && (F->getName() == a || F->getName() == b);
+    }
+
+    static bool isBegin(const Instruction& I) {
+        return isCallOf(I, "__VERIFIER_atomic_begin", "__symbiotic_atomic_begin");
+    }
+
+    static bool isEnd(const Instruction& I) {
+        return isCallOf(I, "__VERIFIER_atomic_end", "__symbiotic_atomic_end");
+    }
+
+    const DataLayout *_DL{nullptr};
+
+    void addObject(const Value *ptr, Section& S) const {
+#if LLVM_VERSION_MAJOR >= 12
+        const Value *obj = getUnderlyingObject(ptr);
+#else
+        const Value *obj = GetUnderlyingObject(ptr, *_DL);
+#endif
+        if (isa<GlobalVariable>(obj) || isa<AllocaInst>(obj))
+            S.objects.insert(obj);
+        else
+            S.unknown = true;
+    }
+
+    void addAccesses(Instruction& I, Section& S) const {
+        if (auto *LI = dyn_cast<LoadInst>(&I)) {
+            addObject(LI->getPointerOperand(), S);
+        } else if (auto *SI = dyn_cast<StoreInst>(&I)) {
+            addObject(SI->getPointerOperand(), S);
+        } else if (auto *RMW = dyn_cast<AtomicRMWInst>(&I)) {
+            addObject(RMW->getPointerOperand(), S);
+        } else if (auto *CX = dyn_cast<AtomicCmpXchgInst>(&I)) {
+            addObject(CX->getPointerOperand(), S);
+        } else if (auto *MT = dyn_cast<MemTransferInst>(&I)) {
+            addObject(MT->getRawDest(), S);
+            addObject(MT->getRawSource(), S);
+        } else if (auto *MS = dyn_cast<MemSetInst>(&I)) {
+            addObject(MS->getRawDest(), S);
+        } else if (auto *CI = dyn_cast<CallInst>(&I)) {
+            auto *F = CI->getCalledFunction();
+            if (isa<DbgInfoIntrinsic>(CI) ||
+                (F && F->isIntrinsic() && F->doesNotAccessMemory()) ||
+                (F && F->getName().startswith("__VERIFIER_nondet_")))
+                return;
+            S.unknown = true;
+        } else if (I.mayReadOrWriteMemory()) {
+            S.unknown = true;
+        }
+    }
+
+    // collect the code of the section that starts at the call of begin
+    Section getSection(CallInst *begin) const {
+        Section S;
+        SmallPtrSet<BasicBlock *, 16> visited;
+        std::vector<Instruction *> worklist{begin->getNextNode()};
+        while (!worklist.empty()) {
+            Instruction *I = worklist.back();
+            worklist.pop_back();
+
+            for (; I; I = I->getNextNode()) {
+                if (isEnd(*I)) {
+                    S.ends.push_back(cast<CallInst>(I));
+                    break;
+                }
+                // nested sections or the section leaves the function
+                if (isBegin(*I) || isa<ReturnInst>(I) || isa<ResumeInst>(I)) {
+                    S.unknown = true;
+                    break;
+                }
+
+                addAccesses(*I, S);
+
+                if (I->isTerminator()) {
+                    for (unsigned i = 0; i < I->getNumSuccessors(); ++i) {
+                        BasicBlock *succ = I->getSuccessor(i);
+                        if (visited.insert(succ).second)
+                            worklist.push_back(&*succ->begin());
+                    }
+                }
+            }
+        }
+        return S;
+    }
+
+    static Function *getRegionFunction(Module& M, const char *name) {
+        LLVMContext& Ctx = M.getContext();
+        auto C = insertFunction(M, name,
+                                Type::getVoidTy(Ctx),
+                                {Type::getInt32Ty(Ctx)});
+        return functionOf(C);
+    }
+
+    static void replace(CallInst *CI, Function *F, unsigned region) {
+        auto *num = ConstantInt::get(Type::getInt32Ty(CI->getContext()), region);
+        auto *newCI = CallInst::Create(F, {num}, "", CI);
+        CloneMetadata(CI, newCI);
+        CI->eraseFromParent();
+    }
+
+    bool assignRegions(Module& M) {
+        _DL = &M.getDataLayout();
+        std::vector<CallInst *> begins, ends;
+        for (Function& F : M) {
+            for (Instruction& I : instructions(F)) {
+                if (isBegin(I))
+                    begins.push_back(cast<CallInst>(&I));
+                else if (isEnd(I))
+                    ends.push_back(cast<CallInst>(&I));
+            }
+        }
+        if (begins.empty() && ends.empty())
+            return false;
+
+        // the calls of the same section (and of the sections that share
+        // a call of end) must use the same lock, nullptr is the region 0
+        EquivalenceClasses<const Value *> classes;
+        classes.insert(nullptr);
+        std::map<const CallInst *, Section> sections;
+        for (CallInst *begin : begins) {
+            Section& S = sections[begin] = getSection(begin);
+            classes.insert(begin);
+            for (CallInst *end : S.ends)
+                classes.unionSets(begin, end);
+            if (S.unknown)
+                classes.unionSets(begin, nullptr);
+        }
+        for (CallInst *end : ends) {
+            if (classes.findValue(end) == classes.end())
+                classes.unionSets(end, nullptr);
+        }
+
+        // the sections that access the same object must use the same lock
+        std::map<const Value *, const Value *> accessedBy;
+        for (auto& it : sections) {
+            for (const Value *obj : it.second.objects) {
+                auto res = accessedBy.emplace(obj, it.first);
+                if (!res.second)
+                    classes.unionSets(res.first->second, it.first);
+            }
+        }
+
+        std::map<const Value *, unsigned> regions;
+        regions[classes.getLeaderValue(nullptr)] = 0;
+        auto getRegion = [&](const CallInst *CI) {
+            const Value *leader = classes.getLeaderValue(CI);
+            return regions.emplace(leader, regions.size()).first->second;
+        };
+
+        Function *beginRegion = getRegionFunction(M, "__symbiotic_atomic_begin_region");
+        Function *endRegion = getRegionFunction(M, "__symbiotic_atomic_end_region");
+        for (CallInst *begin : begins)
+            replace(begin, beginRegion, getRegion(begin));
+        for (CallInst *end : ends)
+            replace(end, endRegion, getRegion(end));
+
+        errs() << "Assigned " << begins.size() << " atomic sections to "
+               << regions.size() << " locks\n";
+        return true;
+    }
+
   public:
     static char ID;
 
     ReplaceVerifierAtomic() : ModulePass(ID) {}
 
     bool runOnModule(Module &M) override {
-        bool changed = false;
+        bool changed = assignRegions(M);
         // nidhugg has a bug that incorrectly handles __VERIFIER_atomic_ functions
         // The only problem is in the name of the function,
         // so just rename it and use our implementations.
@@ -0,0 +1,67 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Define the global __symbiotic_input_limit that the models of functions
+// reading input (fgets) use as the maximal length of the read string.
+// The models contain only a weak definition (no limit), so this definition
+// takes precedence when the models are linked in later.
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned> InputLimit("set-input-limit-value",
+        cl::desc("The maximal number of characters that the models "
+                 "of input functions read at once (0 = no limit)\n"),
+        cl::init(0));
+
+namespace {
+
+class SetInputLimit : public ModulePass {
+public:
+  static char ID;
+
+  SetInputLimit() : ModulePass(ID) {}
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<SetInputLimit> SIL("set-input-limit",
+                                       "Set the maximal length of input "
+                                       "read by the models of functions");
+char SetInputLimit::ID;
+
+bool SetInputLimit::runOnModule(Module& M) {
+  if (InputLimit == 0)
+    return false;
+
+  Type *SizeTy = M.getDataLayout().getIntPtrType(M.getContext());
+  Constant *init = ConstantInt::get(SizeTy, InputLimit);
+
+  GlobalVariable *GV = M.getGlobalVariable("__symbiotic_input_limit");
+  if (GV && GV->getValueType() != SizeTy) {
+    errs() << "ERROR: __symbiotic_input_limit has a wrong type\n";
+    return false;
+  }
+
+  if (!GV) {
+    GV = new GlobalVariable(M, SizeTy, true /* constant */,
+                            GlobalValue::ExternalLinkage, init,
+                            "__symbiotic_input_limit");
+  } else {
+    GV->setInitializer(init);
+    GV->setLinkage(GlobalValue::ExternalLinkage);
+    GV->setConstant(true);
+  }
+
+  return true;
+}
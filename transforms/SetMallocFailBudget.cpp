@@ -0,0 +1,64 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Define the global __symbiotic_malloc_fail_budget that the models
+// of __VERIFIER_malloc and __VERIFIER_calloc use as the maximal number
+// of allocations that may fail on a path. Like -set-input-limit, the models
+// contain only a weak definition (no limit), so this definition takes
+// precedence when the models are linked in later.
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned> FailBudget("set-malloc-fail-budget-value",
+        cl::desc("The maximal number of allocations that may fail "
+                 "on a path\n"),
+        cl::value_desc("K"), cl::init(0));
+
+namespace {
+
+class SetMallocFailBudget : public ModulePass {
+public:
+  static char ID;
+
+  SetMallocFailBudget() : ModulePass(ID) {}
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<SetMallocFailBudget> SMFB("set-malloc-fail-budget",
+                                              "Set the maximal number of "
+                                              "failing allocations on a path");
+char SetMallocFailBudget::ID;
+
+bool SetMallocFailBudget::runOnModule(Module& M) {
+  Type *I32 = Type::getInt32Ty(M.getContext());
+  Constant *init = ConstantInt::get(I32, FailBudget);
+
+  GlobalVariable *GV = M.getGlobalVariable("__symbiotic_malloc_fail_budget");
+  if (GV && GV->getValueType() != I32) {
+    errs() << "ERROR: __symbiotic_malloc_fail_budget has a wrong type\n";
+    return false;
+  }
+
+  if (!GV) {
+    GV = new GlobalVariable(M, I32, true /* constant */,
+                            GlobalValue::ExternalLinkage, init,
+                            "__symbiotic_malloc_fail_budget");
+  } else {
+    GV->setInitializer(init);
+    GV->setLinkage(GlobalValue::ExternalLinkage);
+    GV->setConstant(true);
+  }
+
+  return true;
+}
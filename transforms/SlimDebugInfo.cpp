@@ -0,0 +1,51 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Strip the debugging information of the verified module down to the line
+// tables (the locations of instructions and the subprograms of their scopes).
+// That is all that the verifier needs for the error traces, the tests and
+// the witnesses: the names of the variables that get the nondeterministic
+// values are already in the names of the symbolic objects (see
+// NondetBuilder), so the variables, the types and the composite types
+// only make the bitcode bigger and slower to load.
+//
+// The invariants for the witnesses of correctness need the variables,
+// they are exported from the module before slicing (-export-invariants).
+
+#include "llvm/IR/DebugInfo.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+namespace {
+
+class SlimDebugInfo : public ModulePass {
+public:
+  static char ID;
+
+  SlimDebugInfo() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<SlimDebugInfo> SDI("slim-debug-info",
+                                       "Strip the debugging information "
+                                       "to line tables");
+char SlimDebugInfo::ID;
+
+bool SlimDebugInfo::runOnModule(Module& M) {
+#if LLVM_VERSION_MAJOR >= 5
+  return stripNonLineTableDebugInfo(M);
+#else
+  (void)M;
+  errs() << "Stripping the debugging information to line tables "
+            "needs LLVM 5\n";
+  return false;
+#endif
+}
@@ -0,0 +1,59 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#include <cstring>
+#include <map>
+
+#include "SourceLines.h"
+
+using namespace llvm;
+
+SourceLines::SourceLines(std::unique_ptr<MemoryBuffer> buffer)
+    : _buffer(std::move(buffer)) {
+    const char *begin = _buffer->getBufferStart();
+    const char *end = _buffer->getBufferEnd();
+
+    _starts.push_back(0);
+    const char *pos = begin;
+    while (pos < end) {
+        auto nl = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+        if (!nl)
+            break;
+        pos = nl + 1;
+        _starts.push_back(pos - begin);
+    }
+
+    // the last line does not need to end with the new-line character
+    if (static_cast<size_t>(end - begin) != _starts.back())
+        _starts.push_back(end - begin);
+}
+
+const SourceLines *SourceLines::get(const std::string& path) {
+    static std::map<std::string, std::unique_ptr<SourceLines>> files;
+
+    auto it = files.find(path);
+    if (it != files.end())
+        return it->second.get();
+
+    auto buffer = MemoryBuffer::getFile(path);
+    if (!buffer)
+        return nullptr;
+
+    auto *lines = new SourceLines(std::move(*buffer));
+    files.emplace(path, std::unique_ptr<SourceLines>(lines));
+    return lines;
+}
+
+StringRef SourceLines::getLine(unsigned n) const {
+    if (n == 0 || n > size())
+        return StringRef();
+
+    size_t start = _starts[n - 1];
+    size_t end = _starts[n];
+    StringRef line(_buffer->getBufferStart() + start, end - start);
+    if (line.endswith("\n"))
+        line = line.drop_back();
+    return line;
+}
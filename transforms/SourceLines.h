@@ -0,0 +1,42 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#ifndef SBT_SOURCE_LINES_H_
+#define SBT_SOURCE_LINES_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+// Lines of a source file. The file is mapped into memory (by MemoryBuffer)
+// and only the offsets of the lines are stored, so getting a line
+// is O(1) and does not copy it.
+class SourceLines {
+    std::unique_ptr<llvm::MemoryBuffer> _buffer;
+    // offsets of the starts of the lines in the buffer,
+    // the last item is the end of the buffer
+    std::vector<size_t> _starts;
+
+    SourceLines(std::unique_ptr<llvm::MemoryBuffer> buffer);
+
+public:
+    // get the lines of the file 'path', the file is read only once
+    // even when more passes ask for it. Return nullptr if the file
+    // cannot be read.
+    static const SourceLines *get(const std::string& path);
+
+    // the number of lines in the file
+    unsigned size() const { return _starts.size() - 1; }
+
+    // get the line 'n' without the new-line character,
+    // lines are numbered from 1. Return an empty string
+    // if there is no such line.
+    llvm::StringRef getLine(unsigned n) const;
+};
+
+#endif // SBT_SOURCE_LINES_H_
@@ -0,0 +1,170 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Restrict the program to one cube of its input space, so that the cubes
+// can be explored by independent verifiers. The input space is split
+// on the lowest -split-input-space-bits bits of the first nondeterministic
+// values in main: the pass inserts __VERIFIER_assume after the calls of
+// __VERIFIER_nondet_* so that the bits of the values are the bits of
+// the number -split-input-space-cube (the lowest bits of the cube are
+// the bits of the first value, etc.). The program is correct if and only
+// if all its cubes are correct.
+//
+// Only the calls in main that are not on a cycle are used, so that
+// every call is executed at most once and the constraints of a cube
+// do not restrict the following iterations of some loop. A path that does
+// not go through some of the calls is not restricted by that call
+// (it is explored in more cubes). If there are not enough bits in
+// the values, the cubes that differ in the missing bits are infeasible
+// except for the one with the missing bits set to 0.
+
+#include <algorithm>
+#include <vector>
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned> SplitBits("split-input-space-bits",
+        cl::desc("The number of bits of the input to split on "
+                 "(there are 2^N cubes)"),
+        cl::init(0));
+
+static cl::opt<unsigned> SplitCube("split-input-space-cube",
+        cl::desc("The number of the cube to keep"),
+        cl::init(0));
+
+namespace {
+
+class SplitInputSpace : public ModulePass {
+  Function *getAssume(Module& M);
+  void getInputs(Function& F, std::vector<CallInst *>& inputs);
+
+public:
+  static char ID;
+
+  SplitInputSpace() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<SplitInputSpace> SIS("split-input-space",
+                                         "Restrict the program to one cube "
+                                         "of its input space");
+char SplitInputSpace::ID;
+
+static bool isNondetCall(const Instruction& I) {
+  auto *CI = dyn_cast<CallInst>(&I);
+  if (!CI || CI->isInlineAsm() || !CI->getType()->isIntegerTy())
+    return false;
+
+  auto *callee = CI->getCalledFunction();
+  return callee && callee->getName().startswith("__VERIFIER_nondet_");
+}
+
+Function *SplitInputSpace::getAssume(Module& M) {
+  LLVMContext& Ctx = M.getContext();
+  auto C = insertFunction(M, "__VERIFIER_assume",
+                          Type::getVoidTy(Ctx),
+                          {Type::getInt32Ty(Ctx)});
+  return functionOf(C);
+}
+
+// the calls of nondet functions that are executed at most once,
+// in the reverse post-order of their blocks
+void SplitInputSpace::getInputs(Function& F, std::vector<CallInst *>& inputs) {
+  SmallPtrSet<const BasicBlock *, 32> cyclic;
+  for (auto I = scc_begin(&F); !I.isAtEnd(); ++I) {
+    if (I.hasCycle()) {
+      for (const BasicBlock *B : *I)
+        cyclic.insert(B);
+    }
+  }
+
+  ReversePostOrderTraversal<Function *> RPOT(&F);
+  for (BasicBlock *B : RPOT) {
+    if (cyclic.count(B))
+      continue;
+    for (Instruction& I : *B) {
+      if (isNondetCall(I))
+        inputs.push_back(cast<CallInst>(&I));
+    }
+  }
+}
+
+bool SplitInputSpace::runOnModule(Module& M) {
+  if (SplitBits == 0)
+    return false;
+
+  Function *F = M.getFunction("main");
+  if (!F || F->isDeclaration())
+    return false;
+
+  // the entry of main runs more times if main is called
+  if (!F->use_empty()) {
+    errs() << "WARNING: main is called in the program, "
+              "not splitting the input space\n";
+    return false;
+  }
+
+  std::vector<CallInst *> inputs;
+  getInputs(*F, inputs);
+
+  Function *assumeF = getAssume(M);
+  Type *i32 = Type::getInt32Ty(M.getContext());
+  uint64_t cube = SplitCube;
+  unsigned bits = 0;
+
+  for (CallInst *CI : inputs) {
+    if (bits == SplitBits)
+      break;
+
+    unsigned width = CI->getType()->getIntegerBitWidth();
+    unsigned num = std::min(width, (unsigned)SplitBits - bits);
+    APInt mask = APInt::getLowBitsSet(width, num);
+    APInt value(width, num < 64 ? cube & ((1ULL << num) - 1) : cube);
+
+    IRBuilder<> builder(CI->getNextNode());
+    builder.SetCurrentDebugLocation(CI->getDebugLoc());
+    auto *masked = builder.CreateAnd(CI, ConstantInt::get(CI->getType(), mask));
+    auto *cond = builder.CreateICmpEQ(masked,
+                                      ConstantInt::get(CI->getType(), value));
+    builder.CreateCall(assumeF, {builder.CreateZExt(cond, i32)});
+
+    cube = num < 64 ? cube >> num : 0;
+    bits += num;
+  }
+
+  if (bits < SplitBits) {
+    errs() << "WARNING: Found only " << bits << " bits of the input "
+              "to split on instead of " << SplitBits << "\n";
+    // the cubes that differ only in the missing bits would be the same,
+    // keep just one of them
+    if (cube != 0) {
+      Instruction *point = &*F->getEntryBlock().getFirstInsertionPt();
+      IRBuilder<> builder(point);
+      builder.SetCurrentDebugLocation(point->getDebugLoc());
+      builder.CreateCall(assumeF, {ConstantInt::get(i32, 0)});
+    }
+  }
+
+  return true;
+}
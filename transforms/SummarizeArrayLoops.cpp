@@ -0,0 +1,271 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Replace the loops that fill an array with a value (for (i = 0; i < n; ++i)
+// a[i] = 0;) or copy one array into another (a[i] = b[i]) by a call
+// of memset or memcpy before the loop. A symbolic executor then does one
+// operation with a symbolic size instead of forking on every iteration,
+// and the instrumentation checks the bounds of the whole range at once
+// (so this must run before the instrumentation that makes the accesses
+// volatile). The loop itself is left empty for the optimizations.
+//
+// The loop must be the innermost one, with a single exit, a computable
+// number of iterations (not computed only because the loop must make
+// progress, see dropMustProgress), and the store (and the load for
+// copying) must be its only memory accesses and must run in every
+// iteration. The store must go to consecutive elements forward, the copied
+// arrays must be different objects (memcpy does not allow overlapping).
+
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#if LLVM_VERSION_MAJOR >= 11
+  #include "llvm/Transforms/Utils/ScalarEvolutionExpander.h"
+#else
+  #include "llvm/Analysis/ScalarEvolutionExpander.h"
+#endif
+
+#include "LoopSummary.h"
+#include "NewPM.h"
+
+using namespace llvm;
+
+namespace {
+  class SummarizeArrayLoops : public LoopPass {
+      // the number of executions of B in the loop (of type Ty), or nullptr
+      static const SCEV *getExecutions(Loop *L, const BasicBlock *B, Type *Ty,
+                                       ScalarEvolution& SE, DominatorTree& DT);
+      // the start of the consecutive accesses through ptr to elements
+      // of the given size, or nullptr
+      static const SCEV *getStart(Loop *L, Value *ptr, uint64_t size,
+                                  ScalarEvolution& SE);
+
+    public:
+      static char ID;
+
+      SummarizeArrayLoops() : LoopPass(ID) {}
+
+      static bool summarize(Loop *L, ScalarEvolution& SE, DominatorTree& DT);
+
+      bool runOnLoop(Loop *, LPPassManager&) override;
+
+      void getAnalysisUsage(AnalysisUsage& AU) const override {
+        getLoopAnalysisUsage(AU);
+      }
+  };
+
+#if LLVM_VERSION_MAJOR >= 12
+  // (the loops are not removed or changed structurally, so this runs
+  // as a function pass over the innermost loops)
+  class SummarizeArrayLoopsPass : public PassInfoMixin<SummarizeArrayLoopsPass> {
+    public:
+      PreservedAnalyses run(Function& F, FunctionAnalysisManager& FAM) {
+        auto& LI = FAM.getResult<LoopAnalysis>(F);
+        auto& SE = FAM.getResult<ScalarEvolutionAnalysis>(F);
+        auto& DT = FAM.getResult<DominatorTreeAnalysis>(F);
+        bool changed = false;
+        for (Loop *L : LI.getLoopsInPreorder())
+          changed |= SummarizeArrayLoops::summarize(L, SE, DT);
+        if (!changed)
+          return PreservedAnalyses::all();
+
+        PreservedAnalyses PA;
+        PA.preserveSet<CFGAnalyses>();
+        PA.preserve<ScalarEvolutionAnalysis>();
+        return PA;
+      }
+  };
+#endif
+}
+
+#if LLVM_VERSION_MAJOR >= 12
+static RegisterNewPMFunctionPass<SummarizeArrayLoopsPass>
+    NSAL("summarize-array-loops");
+#endif
+
+static RegisterPass<SummarizeArrayLoops> SAL("summarize-array-loops",
+                                             "Replace the loops that fill or copy "
+                                             "arrays by memset or memcpy");
+char SummarizeArrayLoops::ID;
+
+const SCEV *SummarizeArrayLoops::getExecutions(Loop *L, const BasicBlock *B,
+                                               Type *Ty, ScalarEvolution& SE,
+                                               DominatorTree& DT) {
+  BasicBlock *latch = L->getLoopLatch();
+  BasicBlock *exiting = L->getExitingBlock();
+  if (!latch || !exiting || !DT.dominates(B, latch))
+    return nullptr;
+
+  const SCEV *taken = SE.getBackedgeTakenCount(L);
+  if (isa<SCEVCouldNotCompute>(taken))
+    return nullptr;
+  // (extend it first, so that adding one cannot overflow)
+  taken = SE.getTruncateOrZeroExtend(taken, Ty);
+
+  // the exit is tested at the end of every iteration (do-while),
+  // B runs also in the last iteration
+  if (exiting == latch)
+    return SE.getAddExpr(taken, SE.getOne(taken->getType()));
+  // the exit is tested at the header (while), B runs only
+  // in the iterations that take the backedge
+  if (exiting == L->getHeader() && B != exiting)
+    return taken;
+  return nullptr;
+}
+
+const SCEV *SummarizeArrayLoops::getStart(Loop *L, Value *ptr, uint64_t size,
+                                          ScalarEvolution& SE) {
+  auto *AR = dyn_cast<SCEVAddRecExpr>(SE.getSCEV(ptr));
+  if (!AR || AR->getLoop() != L || !AR->isAffine())
+    return nullptr;
+  auto *step = dyn_cast<SCEVConstant>(AR->getStepRecurrence(SE));
+  if (!step || step->getAPInt() != size)
+    return nullptr;
+  return AR->getStart();
+}
+
+static const Value *getObject(const SCEV *start, ScalarEvolution& SE) {
+  auto *base = dyn_cast<SCEVUnknown>(SE.getPointerBase(start));
+  if (!base)
+    return nullptr;
+#if LLVM_VERSION_MAJOR >= 12
+  const Value *obj = getUnderlyingObject(base->getValue());
+#else
+  const Value *obj = GetUnderlyingObject(base->getValue(),
+                                         base->getValue()->getModule()->getDataLayout());
+#endif
+  return isIdentifiedObject(obj) ? obj : nullptr;
+}
+
+bool SummarizeArrayLoops::runOnLoop(Loop *L, LPPassManager&) {
+  return summarize(L, getAnalysis<ScalarEvolutionWrapperPass>().getSE(),
+                   getAnalysis<DominatorTreeWrapperPass>().getDomTree());
+}
+
+bool SummarizeArrayLoops::summarize(Loop *L, ScalarEvolution& SE,
+                                    DominatorTree& DT) {
+#if LLVM_VERSION_MAJOR < 11
+  // (we need the alignments of loads and stores as Align)
+  return false;
+#else
+  if (!L->getSubLoops().empty())
+    return false;
+
+  BasicBlock *preheader = L->getLoopPreheader();
+  if (!preheader || !L->getExitBlock())
+    return false;
+
+  // find the only store and load
+  StoreInst *SI = nullptr;
+  LoadInst *LI = nullptr;
+  for (BasicBlock *B : L->getBlocks()) {
+    for (Instruction& I : *B) {
+      if (isa<DbgInfoIntrinsic>(I))
+        continue;
+      if (auto *S = dyn_cast<StoreInst>(&I)) {
+        if (SI || !S->isSimple())
+          return false;
+        SI = S;
+      } else if (auto *Ld = dyn_cast<LoadInst>(&I)) {
+        if (LI || !Ld->isSimple())
+          return false;
+        LI = Ld;
+      } else if (I.mayHaveSideEffects() || I.mayReadOrWriteMemory() ||
+                 (!I.isTerminator() && !isa<PHINode>(I) &&
+                  !isSafeToSpeculativelyExecute(&I))) {
+        return false;
+      }
+    }
+  }
+  if (!SI)
+    return false;
+
+  Function *F = preheader->getParent();
+  const DataLayout& DL = F->getParent()->getDataLayout();
+  Value *val = SI->getValueOperand();
+  uint64_t size = DL.getTypeStoreSize(val->getType());
+  if (size == 0 || size != DL.getTypeAllocSize(val->getType()))
+    return false;
+
+  // (the number of iterations must not assume that the loop terminates)
+  bool changed = dropMustProgress(L, SE);
+  Type *IntPtrTy = DL.getIntPtrType(SI->getPointerOperandType());
+  const SCEV *executions = getExecutions(L, SI->getParent(), IntPtrTy, SE, DT);
+  const SCEV *dst = getStart(L, SI->getPointerOperand(), size, SE);
+  if (!executions || !dst)
+    return changed;
+
+  // fill with a byte, or copy the loaded values (the load runs
+  // in the same iteration before the store)
+  Value *byte = nullptr;
+  const SCEV *src = nullptr;
+  if (LI) {
+    if (LI != val || !LI->hasOneUse() || LI->getParent() != SI->getParent())
+      return changed;
+    src = getStart(L, LI->getPointerOperand(), size, SE);
+    if (!src)
+      return changed;
+    const Value *dstObj = getObject(dst, SE);
+    const Value *srcObj = getObject(src, SE);
+    if (!dstObj || !srcObj || dstObj == srcObj)
+      return changed;
+  } else {
+    if (!L->isLoopInvariant(val))
+      return changed;
+    byte = isBytewiseValue(val, DL);
+    if (!byte || isa<UndefValue>(byte))
+      return changed;
+  }
+
+  const SCEV *len = SE.getMulExpr(executions, SE.getConstant(IntPtrTy, size));
+  for (const SCEV *S : {dst, src, len}) {
+    if (S && (!SE.isLoopInvariant(S, L) ||
+#if LLVM_VERSION_MAJOR >= 15
+              !SCEVExpander(SE, DL, "").isSafeToExpand(S)
+#else
+              !isSafeToExpand(S, SE)
+#endif
+             ))
+      return changed;
+  }
+
+  SCEVExpander expander(SE, DL, "summary");
+  Instruction *at = preheader->getTerminator();
+  Value *dstV = expander.expandCodeFor(dst, SI->getPointerOperandType(), at);
+  Value *lenV = expander.expandCodeFor(len, IntPtrTy, at);
+
+  IRBuilder<> builder(at);
+  // keep the location of the store for the reports of errors
+  builder.SetCurrentDebugLocation(SI->getDebugLoc());
+  if (LI) {
+    Value *srcV = expander.expandCodeFor(src, LI->getPointerOperandType(), at);
+    builder.CreateMemCpy(dstV, SI->getAlign(), srcV, LI->getAlign(), lenV);
+  } else {
+    builder.CreateMemSet(dstV, byte, lenV, SI->getAlign());
+  }
+
+  errs() << "Replaced a loop in " << F->getName() << " by "
+         << (LI ? "memcpy" : "memset") << "\n";
+
+  SI->eraseFromParent();
+  if (LI)
+    LI->eraseFromParent();
+  SE.forgetLoop(L);
+  return true;
+#endif
+}
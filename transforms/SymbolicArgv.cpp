@@ -0,0 +1,132 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+// Give main symbolic arguments (--symbolic-argv): main is renamed
+// to __symbiotic_main and the new main calls it with the arguments
+// made by the model __symbiotic_make_argv (lib/verifier/klee)
+//
+//   int main(void) {
+//     char buf[1 + count * (length + 1)];
+//     char *argv[count + 2];
+//     int argc = __symbiotic_make_argv(buf, count, length, argv,
+//                                      "__symbiotic_argv|count|length");
+//     return __symbiotic_main(argc, argv, &argv[argc]);
+//   }
+//
+// All the arguments are one symbolic object of a bounded size
+// (instead of an object for every argument and per-character handling),
+// its name tells the tests how to split it back into the arguments
+// (see split_argv in testcases.py). The environment is empty.
+
+#include <string>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Compat.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned> ArgvCount("symbolic-argv-count",
+        cl::desc("The maximal number of the arguments after argv[0] "
+                 "(at most 255, default 2)"),
+        cl::init(2));
+
+static cl::opt<unsigned> ArgvLength("symbolic-argv-length",
+        cl::desc("The maximal length of an argument (default 8)"),
+        cl::init(8));
+
+namespace {
+
+class SymbolicArgv : public ModulePass {
+public:
+  static char ID;
+
+  SymbolicArgv() : ModulePass(ID) {}
+
+  bool runOnModule(Module& M) override;
+};
+
+} // namespace
+
+static RegisterPass<SymbolicArgv> SA("symbolic-argv",
+                                     "Call main with the arguments "
+                                     "from one symbolic object");
+char SymbolicArgv::ID;
+
+bool SymbolicArgv::runOnModule(Module& M) {
+  Function *orig = M.getFunction("main");
+  if (!orig || orig->isDeclaration() || orig->arg_size() < 2)
+    return false;
+
+  FunctionType *FT = orig->getFunctionType();
+  if (!FT->getParamType(0)->isIntegerTy() ||
+      !FT->getParamType(1)->isPointerTy() ||
+      (FT->getNumParams() > 2 && !FT->getParamType(2)->isPointerTy())) {
+    errs() << "main has unknown parameters, not making argv symbolic\n";
+    return false;
+  }
+
+  unsigned count = ArgvCount;
+  if (count > 255) {
+    errs() << "At most 255 symbolic arguments, using 255\n";
+    count = 255;
+  }
+  unsigned length = ArgvLength;
+
+  LLVMContext& Ctx = M.getContext();
+  Type *I32 = Type::getInt32Ty(Ctx);
+  Type *CharPtr = Type::getInt8PtrTy(Ctx);
+  Type *ArgvTy = PointerType::getUnqual(CharPtr);
+
+  orig->setName("__symbiotic_main");
+  Function *main = Function::Create(FunctionType::get(I32, false),
+                                    GlobalValue::ExternalLinkage, "main", &M);
+  IRBuilder<> B(BasicBlock::Create(Ctx, "entry", main));
+
+  uint64_t size = 1 + uint64_t(count) * (length + 1);
+  Value *buf = B.CreateAlloca(ArrayType::get(B.getInt8Ty(), size), nullptr,
+                              "argv.buf");
+  Value *argv = B.CreateAlloca(ArrayType::get(CharPtr, count + 2), nullptr,
+                               "argv");
+  buf = B.CreateBitOrPointerCast(buf, CharPtr);
+  argv = B.CreateBitOrPointerCast(argv, ArgvTy);
+
+  auto make = insertFunction(M, "__symbiotic_make_argv", I32,
+                             {CharPtr, I32, I32, ArgvTy, CharPtr});
+  std::string name = "__symbiotic_argv|" + std::to_string(count) + "|" +
+                     std::to_string(length);
+  Value *argc = B.CreateCall(make, {buf, ConstantInt::get(I32, count),
+                                    ConstantInt::get(I32, length), argv,
+                                    B.CreateGlobalStringPtr(name)},
+                             "argc");
+
+  SmallVector<Value *, 3> args;
+  args.push_back(B.CreateSExtOrTrunc(argc, FT->getParamType(0)));
+  args.push_back(B.CreateBitOrPointerCast(argv, FT->getParamType(1)));
+  if (FT->getNumParams() > 2) {
+    // argv[argc] is null, the environment is empty
+    Value *envp = B.CreateGEP(CharPtr, argv, argc);
+    args.push_back(B.CreateBitOrPointerCast(envp, FT->getParamType(2)));
+  }
+  for (unsigned i = 3; i < FT->getNumParams(); ++i)
+    args.push_back(Constant::getNullValue(FT->getParamType(i)));
+
+  Value *ret = B.CreateCall(orig, args);
+  if (ret->getType()->isIntegerTy())
+    B.CreateRet(B.CreateSExtOrTrunc(ret, I32));
+  else
+    B.CreateRet(ConstantInt::get(I32, 0));
+
+  errs() << "Made " << count << " symbolic arguments of main "
+         << "of at most " << length << " characters\n";
+  return true;
+}
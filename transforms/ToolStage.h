@@ -0,0 +1,29 @@
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+
+#ifndef SBT_TOOL_STAGE_H_
+#define SBT_TOOL_STAGE_H_
+
+// The interface of the libraries that run a tool (sbt-instr, sbt-slicer)
+// on the module that sbt-pipeline holds in memory (-tool-stage=lib.so),
+// so that the tool does not need to load the module and write it again.
+// The library is built against the same LLVM as sbt-pipeline and exports
+//
+//   extern "C" int sbt_tool_stage(llvm::Module *M, int argc, const char *argv[]);
+//
+// argv are the arguments of the tool without the input and the output file
+// (argv[0] is the path of the library). The function transforms M in place and
+// returns 0 on success; on failure the module may be broken and sbt-pipeline
+// gives up (there is no file to fall back to).
+
+namespace llvm {
+class Module;
+}
+
+#define SBT_TOOL_STAGE_SYMBOL "sbt_tool_stage"
+
+typedef int (*SbtToolStageFn)(llvm::Module *M, int argc, const char *argv[]);
+
+#endif // SBT_TOOL_STAGE_H_
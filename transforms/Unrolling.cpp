@@ -9,11 +9,18 @@
 
 #include "llvm/Pass.h"
 #include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/Transforms/Utils.h"
 #include "llvm/Transforms/Utils/Cloning.h"
 
 #include "llvm/Support/CommandLine.h"
 
+#include "Compat.h"
+
+#include <algorithm>
 #include <map>
+#include <set>
 
 using namespace llvm;
 
@@ -25,15 +32,38 @@ static cl::opt<bool> TerminateLoop("sbt-loop-unroll-terminate",
                                     cl::desc("Terminate the paths that exceed the "
                                              "unrolling count."));
 
+static cl::opt<unsigned> FullUnrollMax("sbt-loop-unroll-full-max",
+                                   cl::desc("Unroll completely the loops with a constant "
+                                            "trip count of at most N (the loops with\n"
+                                            "a trip count smaller than the unrolling "
+                                            "count are unrolled completely always)"),
+                                   cl::value_desc("N"), cl::init(0));
+
+static cl::opt<unsigned> UnrollBudget("sbt-loop-unroll-budget",
+                                   cl::desc("Unroll a loop only as many times as its "
+                                            "copies have at most N instructions\n"
+                                            "(default=0, no limit)"),
+                                   cl::value_desc("N"), cl::init(0));
+
+static cl::opt<bool> UnrollReport("sbt-loop-unroll-report",
+                                   cl::desc("Print how many times was every loop unrolled"));
+
 
 namespace {
   class LoopUnroll : public LoopPass {
+      // the trip counts of the loops in the current function (by headers),
+      // computed before we unroll the inner loops
+      const Function *_tripsFun = nullptr;
+      std::map<const BasicBlock *, unsigned> _trips;
+
     public:
       static char ID;
 
       LoopUnroll() : LoopPass(ID) {}
 
       bool runOnLoop(Loop *, LPPassManager&) override;
+      unsigned getTripCount(Loop *L);
+      void getAnalysisUsage(AnalysisUsage& AU) const override;
   };
 }
 
@@ -52,13 +82,9 @@ static BasicBlock *createTerminatingBlock(Function *F,
 
   F->getBasicBlockList().push_back(block);
 
-  auto assume = M->getOrInsertFunction("__VERIFIER_assume",
-                                       Type::getVoidTy(Ctx),
-                                       Type::getInt32Ty(Ctx)
-#if LLVM_VERSION_MAJOR < 5
-                                       , nullptr
-#endif
-                         );
+  auto assume = insertFunction(*M, "__VERIFIER_assume",
+                               Type::getVoidTy(Ctx),
+                               {Type::getInt32Ty(Ctx)});
   // The contents of the block is:
   //  __VERIFIER_assume(0)
   //  unreachable
@@ -113,17 +139,28 @@ static void replaceSuccessor(const std::vector<BasicBlock *>& Blocks,
   }
 }
 
+static Value *mapValue(Value *val, ValueToValueMapTy& VMap) {
+  auto it = VMap.find(val);
+  if (it != VMap.end())
+    return it->second;
+  return val;
+}
+
 // redirect value uses and PHI nodes
 static void redirectValues(BasicBlock *newB,
                            ValueToValueMapTy& VMap,
-                           const std::map<BasicBlock *, BasicBlock *>& /*BlocksMap*/) {
+                           const std::map<BasicBlock *, BasicBlock *>& BlocksMap) {
 
   for (auto& I : *newB) {
-    if (isa<PHINode>(&I)) {
-      llvm::errs() << "PHI nodes are not supported yet\n";
-      abort();
-     //for (auto i = 0; i < PHI->getNumIncomingValues(); ++i) {
-     //}
+    if (auto PHI = dyn_cast<PHINode>(&I)) {
+      // the blocks from outside of the loop are left as they are,
+      // the header is fixed in fixHeaderPHIs()
+      for (unsigned i = 0; i < PHI->getNumIncomingValues(); ++i) {
+        PHI->setIncomingValue(i, mapValue(PHI->getIncomingValue(i), VMap));
+        auto it = BlocksMap.find(PHI->getIncomingBlock(i));
+        if (it != BlocksMap.end())
+          PHI->setIncomingBlock(i, it->second);
+      }
     } else {
       for (unsigned i = 0; i < I.getNumOperands(); ++i) {
         if (VMap.count(I.getOperand(i))) {
@@ -134,6 +171,91 @@ static void redirectValues(BasicBlock *newB,
   }
 }
 
+static void removeIncomingFrom(BasicBlock *B,
+                               const std::map<BasicBlock *, BasicBlock *>& BlocksMap,
+                               bool inLoop) {
+  for (auto& I : *B) {
+    auto PHI = dyn_cast<PHINode>(&I);
+    if (!PHI)
+      break;
+
+    for (unsigned i = PHI->getNumIncomingValues(); i > 0; --i) {
+      if ((BlocksMap.count(PHI->getIncomingBlock(i - 1)) > 0) == inLoop)
+        PHI->removeIncomingValue(i - 1, false /* DeletePHIIfEmpty */);
+    }
+  }
+}
+
+// The old header is entered only from outside of the (old) body now and
+// the new header only from the old and the new latches: the new header
+// gets the values of the old latches and the old header loses them.
+static void fixHeaderPHIs(BasicBlock *oldH, BasicBlock *newH,
+                          const std::map<BasicBlock *, BasicBlock *>& BlocksMap) {
+  auto NI = newH->begin();
+  for (auto I = oldH->begin(); isa<PHINode>(&*I); ++I, ++NI) {
+    auto PHI = cast<PHINode>(&*I);
+    auto NPHI = cast<PHINode>(&*NI);
+    for (unsigned i = 0; i < PHI->getNumIncomingValues(); ++i) {
+      if (BlocksMap.count(PHI->getIncomingBlock(i)) > 0)
+        NPHI->addIncoming(PHI->getIncomingValue(i), PHI->getIncomingBlock(i));
+    }
+  }
+
+  removeIncomingFrom(oldH, BlocksMap, true);
+  // the entries from outside of the loop and from the old latches
+  // that were remapped to the new latches stay
+  for (auto& I : *newH) {
+    auto NPHI = dyn_cast<PHINode>(&I);
+    if (!NPHI)
+      break;
+
+    for (unsigned i = NPHI->getNumIncomingValues(); i > 0; --i) {
+      auto pred = NPHI->getIncomingBlock(i - 1);
+      bool fromLoop = false;
+      for (auto& it : BlocksMap) {
+        if (it.first == pred || it.second == pred) {
+          fromLoop = true;
+          break;
+        }
+      }
+      if (!fromLoop)
+        NPHI->removeIncomingValue(i - 1, false /* DeletePHIIfEmpty */);
+    }
+  }
+}
+
+// the exit blocks are entered also from the new body
+// (the values used outside of the loop go through these PHI nodes,
+//  the loop is in LCSSA form)
+static void fixExitPHIs(const std::vector<BasicBlock *>& Blocks,
+                        ValueToValueMapTy& VMap,
+                        const std::map<BasicBlock *, BasicBlock *>& BlocksMap) {
+  for (auto Block : Blocks) {
+    std::set<BasicBlock *> exits;
+    for (auto succ : successors(Block)) {
+      if (BlocksMap.count(succ) == 0)
+        exits.insert(succ);
+    }
+
+    auto newB = BlocksMap.find(Block)->second;
+    for (auto exit : exits) {
+      for (auto& I : *exit) {
+        auto PHI = dyn_cast<PHINode>(&I);
+        if (!PHI)
+          break;
+
+        std::vector<Value *> vals;
+        for (unsigned i = 0; i < PHI->getNumIncomingValues(); ++i) {
+          if (PHI->getIncomingBlock(i) == Block)
+            vals.push_back(mapValue(PHI->getIncomingValue(i), VMap));
+        }
+        for (auto val : vals)
+          PHI->addIncoming(val, newB);
+      }
+    }
+  }
+}
+
 static std::vector<BasicBlock *>
 cloneLoopBody(Function *F, const std::vector<BasicBlock *> Blocks) {
 
@@ -157,6 +279,9 @@ cloneLoopBody(Function *F, const std::vector<BasicBlock *> Blocks) {
       redirectValues(NewBlocks[i], VMap, BlocksMap);
   }
 
+  fixHeaderPHIs(Blocks[0], NewBlocks[0], BlocksMap);
+  fixExitPHIs(Blocks, VMap, BlocksMap);
+
   // reconnect the exit nodes from the old loop body
   // to the header of the new body
   replaceSuccessor(Blocks, Blocks[0], NewBlocks[0]);
@@ -165,12 +290,81 @@ cloneLoopBody(Function *F, const std::vector<BasicBlock *> Blocks) {
 }
 
 
-bool LoopUnroll::runOnLoop(Loop *L, LPPassManager& /*LPM*/) {
+void LoopUnroll::getAnalysisUsage(AnalysisUsage& AU) const {
+  // we need a single entry of the header and that all the values
+  // used outside of the loop go through PHI nodes in the exit blocks
+  AU.addRequiredID(LoopSimplifyID);
+  AU.addRequiredID(LCSSAID);
+  AU.addRequired<LoopInfoWrapperPass>();
+  AU.addRequired<ScalarEvolutionWrapperPass>();
+}
+
+static unsigned getLoopSize(const Loop *L) {
+  unsigned size = 0;
+  for (auto *B : L->getBlocks())
+    size += B->size();
+  return size;
+}
+
+unsigned LoopUnroll::getTripCount(Loop *L) {
+  auto F = L->getHeader()->getParent();
+  if (_tripsFun != F) {
+    _tripsFun = F;
+    _trips.clear();
+
+    auto& LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+    auto& SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+    std::vector<Loop *> loops(LI.begin(), LI.end());
+    while (!loops.empty()) {
+      Loop *Cur = loops.back();
+      loops.pop_back();
+      _trips[Cur->getHeader()] = SE.getSmallConstantTripCount(Cur);
+      loops.insert(loops.end(), Cur->begin(), Cur->end());
+    }
+  }
 
-  if (UnrollCount <= 1)
-    return false;
+  auto it = _trips.find(L->getHeader());
+  return it == _trips.end() ? 0 : it->second;
+}
 
+bool LoopUnroll::runOnLoop(Loop *L, LPPassManager& LPM) {
   auto F = (*L->block_begin())->getParent();
+  auto& SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+
+  // the number of copies of the body and whether the paths
+  // that go past the last copy should be terminated
+  unsigned count = UnrollCount;
+  bool terminate = TerminateLoop;
+
+  // if we know the trip count and it is small, we can unroll
+  // the loop completely -- the back edges of the last copy
+  // are never taken
+  unsigned size = getLoopSize(L);
+  unsigned trips = getTripCount(L);
+  if (trips > 0 && (trips <= UnrollCount || trips <= FullUnrollMax) &&
+      (UnrollBudget == 0 || (uint64_t)trips * size <= UnrollBudget)) {
+    count = trips;
+    terminate = true;
+  } else if (UnrollBudget > 0 && size > 0 &&
+             (uint64_t)count * size > UnrollBudget) {
+    count = std::max(1u, UnrollBudget / size);
+  }
+
+  if (UnrollReport) {
+    llvm::errs() << "[Unrolling] " << F->getName() << ": loop "
+                 << L->getHeader()->getName() << " (" << size
+                 << " instructions, trip count ";
+    if (trips > 0)
+      llvm::errs() << trips;
+    else
+      llvm::errs() << "unknown";
+    llvm::errs() << ") unrolled " << count << " times"
+                 << (terminate ? ", terminated" : "") << "\n";
+  }
+
+  if (count <= 1 && !terminate)
+    return false;
+
   const auto& Blocks = L->getBlocks();
 
   std::vector<BasicBlock *> LastBlocks(Blocks.begin(), Blocks.end());
@@ -179,14 +373,59 @@ bool LoopUnroll::runOnLoop(Loop *L, LPPassManager& /*LPM*/) {
   if (LastBlocks[0] != L->getHeader())
       abort();
 
-  for (unsigned n = 1; n < UnrollCount; ++n)
+  auto& LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+  Loop *Parent = L->getParentLoop();
+  for (unsigned n = 1; n < count; ++n) {
+      // the copies are inside the parent loop, so that they are
+      // unrolled with it (the last one is handled below)
+      if (Parent && n > 1) {
+        for (auto B : LastBlocks)
+          Parent->addBasicBlockToLoop(B, LI);
+      }
       LastBlocks = cloneLoopBody(F, LastBlocks);
+  }
 
   // replace the next iterations with assume(false) if desired
-  if (TerminateLoop) {
+  if (terminate) {
     auto termB = createTerminatingBlock(F, LastBlocks[0]->getTerminator());
     replaceSuccessor(LastBlocks, LastBlocks[0], termB);
+
+    std::map<BasicBlock *, BasicBlock *> LastMap;
+    for (auto B : LastBlocks)
+      LastMap[B] = B;
+    removeIncomingFrom(LastBlocks[0], LastMap, true);
   }
 
+  // the loop (and so the loops that contain it) changed
+  Loop *Outermost = L;
+  while (Outermost->getParentLoop())
+    Outermost = Outermost->getParentLoop();
+  SE.forgetLoop(Outermost);
+
+#if LLVM_VERSION_MAJOR >= 6
+  // L is not a loop anymore (its latches jump to the next copy),
+  // only the last copy may be a loop if the paths were not terminated
+  // (the copies must be in their loops first, LoopInfo::erase()
+  // uses them to find out which blocks stay in the parent loop)
+  if (count > 1) {
+    Loop *Last = Parent;
+    if (!terminate) {
+      Last = LI.AllocateLoop();
+      if (Parent)
+        Parent->addChildLoop(Last);
+      else
+        LI.addTopLevelLoop(Last);
+    }
+    if (Last) {
+      for (auto B : LastBlocks)
+        Last->addBasicBlockToLoop(B, LI);
+    }
+  }
+  LPM.markLoopAsDeleted(*L);
+  LI.erase(L);
+#else
+  (void) Parent;
+#endif
+
   return true;
 }